@@ -0,0 +1,2042 @@
+/*
+ * skbench.c
+ * =========
+ * 
+ * Microbenchmarks for the kernels of the skvm module.
+ * 
+ * Syntax:
+ * 
+ *   skbench [options] [out.json]
+ *   skbench -compare [base.json] [new.json] [percent]
+ * 
+ * The first form times the skvm kernels and writes the results as JSON
+ * to the given file, or to standard output if no file is given.  A
+ * progress line for each benchmark is written to standard error.  The
+ * options are:
+ * 
+ *   -t [n] sets the number of threads with skvm_threads(), where the
+ *   default of zero selects the skvm default
+ * 
+ *   -m [secs] sets the minimum time spent repeating each benchmark,
+ *   which defaults to 0.2 seconds
+ * 
+ *   -f [text] only runs benchmarks whose names contain the given text
+ * 
+ *   -d [dir] sets the directory for the temporary image files of the
+ *   load and store benchmarks, which defaults to the current directory
+ * 
+ * The benchmarks are:
+ * 
+ *   sample/[alg]/[transform]/[src]-[target]/[mask] times skvm_sample()
+ *   on a 512x512 source and target.  The transforms are identity,
+ *   translate (by whole pixels), subpixel (translation by fractions of
+ *   a pixel), scale (by 1.5 about the center), and rotate (by 30
+ *   degrees about the center).  The channel counts of the source and
+ *   target are 1, 3, or 4, or f for a float target.  The masks are
+ *   none, proc (boundary lines), shape (feathered ellipse), raster (a
+ *   grayscale raster mask), and rle (a compressed raster mask).  Every
+ *   channel combination is timed without a mask, and every mask is
+ *   timed with ARGB source and target.
+ * 
+ *   load/[format]/[size] and store/[format]/[size] time loading and
+ *   storing square ARGB images of PNG, JPEG, and Motion-JPEG files of
+ *   256, 1024, and 2048 pixels across.
+ * 
+ *   fill/[channels]/[size] and invert/[channels]/[size] time
+ *   skvm_load_fill() and skvm_color_invert() at the same sizes.
+ * 
+ * Each benchmark is run once to warm up and then repeated until both
+ * the minimum time has passed and it ran at least three times.  The
+ * median time of the repetitions is reported in nanoseconds per pixel
+ * and millions of pixels per second, along with the fastest
+ * repetition.  Pixels are counted in the target buffer for sampling
+ * and in the image for everything else.  Sampling results also report
+ * how the last repetition was balanced across threads, where an
+ * imbalance of 1.0 means every thread was busy for the same time (see
+ * skvm_balance).
+ * 
+ * The second form compares two result files written by the first form
+ * and prints the change of each benchmark present in both.  Benchmarks
+ * that got slower by more than the given percentage, which defaults to
+ * 5, are flagged as regressions, and the exit status is then non-zero.
+ * This allows a saved baseline to be checked after a change:
+ * 
+ *   skbench base.json
+ *   (rebuild with the change)
+ *   skbench new.json
+ *   skbench -compare base.json new.json
+ * 
+ * Compilation:
+ * 
+ *   - "make skbench" in the repository root builds it (see Makefile)
+ *   - Build with the same compiler flags as the sparkle program
+ *   - Include directory must contain skvm.h (the repository root)
+ *   - Requires the skvm.c module
+ *   - Requires POSIX threads, which may require -lpthread
+ *   - May require the math library -lm on some platforms
+ *   - Requires libsophistry and libsophistry-jpeg (via skvm)
+ *   - Depends on libjpeg 6B, libpng, and zlib (via libsophistry)
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "skvm.h"
+
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * The width and height of the source and target of the sampling
+ * benchmarks.
+ */
+#define SAMPLE_DIM (512)
+
+/*
+ * The default minimum time in seconds to repeat each benchmark, and
+ * the limits on the number of repetitions.
+ */
+#define DEF_MIN_TIME (0.2)
+#define MIN_REPS (3)
+#define MAX_REPS (4096)
+
+/*
+ * The number of frames in the Motion-JPEG file read by the load/mjpg
+ * benchmarks.
+ */
+#define MJPG_FRAMES (4)
+
+/*
+ * The JPEG quality used by the store benchmarks.
+ */
+#define JPEG_QUALITY (90)
+
+/*
+ * The maximum length of a path, including the terminating nul.
+ */
+#define MAX_PATH (4096)
+
+/*
+ * The maximum length of a benchmark name, including the terminating
+ * nul.
+ */
+#define MAX_NAME (64)
+
+/*
+ * The default percentage by which a benchmark must get slower to be
+ * flagged as a regression by the comparison.
+ */
+#define DEF_THRESHOLD (5.0)
+
+/*
+ * Buffer registers used by the benchmarks.
+ */
+#define REG_DOT   (0)   /* 1x1 ARGB color of a painted layer */
+#define REG_ART   (1)   /* Opaque painted ARGB image */
+#define REG_SRC1  (2)   /* Grayscale sampling source */
+#define REG_SRC3  (3)   /* RGB sampling source */
+#define REG_SRC4  (4)   /* Translucent ARGB sampling source */
+#define REG_DST   (5)   /* Sampling target */
+#define REG_MASK  (6)   /* Grayscale raster mask */
+#define REG_RLE   (7)   /* Compressed raster mask */
+#define REG_IMG   (8)   /* Image of the load, store, fill, and invert */
+#define REG_COUNT (9)
+
+/*
+ * Matrix registers used by the benchmarks.
+ */
+#define MAT_XFORM (0)   /* Transform of the sampling benchmarks */
+#define MAT_LAYER (1)   /* Transform of a painted layer */
+#define MAT_COUNT (2)
+
+/*
+ * The kinds of operation that a benchmark times.
+ */
+#define CASE_SAMPLE     (0)
+#define CASE_FILL       (1)
+#define CASE_INVERT     (2)
+#define CASE_LOAD_PNG   (3)
+#define CASE_LOAD_JPEG  (4)
+#define CASE_LOAD_MJPG  (5)
+#define CASE_STORE_PNG  (6)
+#define CASE_STORE_JPEG (7)
+#define CASE_STORE_MJPG (8)
+
+/*
+ * The transforms of the sampling benchmarks.
+ */
+#define XFORM_IDENTITY  (0)
+#define XFORM_TRANSLATE (1)
+#define XFORM_SUBPIXEL  (2)
+#define XFORM_SCALE     (3)
+#define XFORM_ROTATE    (4)
+#define XFORM_COUNT     (5)
+
+/*
+ * The masks of the sampling benchmarks.
+ */
+#define MASK_NONE   (0)
+#define MASK_PROC   (1)
+#define MASK_SHAPE  (2)
+#define MASK_RASTER (3)
+#define MASK_RLE    (4)
+#define MASK_COUNT  (5)
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * A single benchmark.
+ */
+typedef struct {
+  
+  /*
+   * One of the CASE_ constants.
+   */
+  int kind;
+  
+  /*
+   * The sampling parameters, for CASE_SAMPLE.
+   * 
+   * A copy is passed to each call, since skvm_sample() may modify it.
+   */
+  SKVM_SAMPLE_PARAM sp;
+  
+  /*
+   * The next frame to load, for CASE_LOAD_MJPG.
+   */
+  int32_t frame;
+  
+  /*
+   * The path of the file to load or store.
+   * 
+   * For CASE_LOAD_MJPG, this is the path of the index file.
+   */
+  const char *pPath;
+  
+} BENCH_CASE;
+
+/*
+ * The state of a benchmark run.
+ */
+typedef struct {
+  
+  /*
+   * The virtual machine context.
+   */
+  SKVM_CTX *pv;
+  
+  /*
+   * The file the results are written to.
+   */
+  FILE *pOut;
+  
+  /*
+   * The text that benchmark names must contain, or NULL to run all
+   * benchmarks.
+   */
+  const char *pFilter;
+  
+  /*
+   * The minimum time in seconds to repeat each benchmark.
+   */
+  double min_time;
+  
+  /*
+   * The number of results written so far.
+   */
+  int32_t count;
+  
+  /*
+   * The times of the repetitions of the current benchmark.
+   */
+  double t[MAX_REPS];
+  
+} BENCH;
+
+/*
+ * A result read back from a result file.
+ */
+typedef struct {
+  
+  /*
+   * The name of the benchmark.
+   */
+  char name[MAX_NAME];
+  
+  /*
+   * The median nanoseconds per pixel.
+   */
+  double ns;
+  
+} RESULT;
+
+/*
+ * Static data
+ * ===========
+ */
+
+/*
+ * The name of the executing module, for diagnostic messages.
+ */
+static const char *pModule = NULL;
+
+/*
+ * The sampling algorithms that are timed, and their names.
+ * 
+ * Bilinear and bicubic sampling are not implemented by skvm yet and
+ * abort the process, so they must be added here once they are.
+ */
+static const int m_alg[] = {
+  SKVM_ALG_NEAREST
+};
+static const char *m_alg_name[] = {
+  "nearest"
+};
+
+/*
+ * The names of the XFORM_ and MASK_ constants.
+ */
+static const char *m_xform_name[XFORM_COUNT] = {
+  "identity", "translate", "subpixel", "scale", "rotate"
+};
+static const char *m_mask_name[MASK_COUNT] = {
+  "none", "proc", "shape", "raster", "rle"
+};
+
+/*
+ * The sizes of the images of the load, store, fill, and invert
+ * benchmarks.
+ */
+static const int32_t m_size[] = {256, 1024, 2048};
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Prototypes */
+static int parse_int(const char *pstr, int32_t *pv);
+static int parse_double(const char *pstr, double *pv);
+static double clock_secs(void);
+static int cmp_double(const void *pa, const void *pb);
+
+static void layer(
+    SKVM_CTX      * pv,
+    int32_t         i,
+    int             a,
+    int             r,
+    int             g,
+    int             b,
+    int             blend,
+    int             shape,
+    const double  * pGeom);
+static void paint(SKVM_CTX *pv, int32_t i);
+static void sample_init(
+    SKVM_SAMPLE_PARAM * ps,
+    int32_t             src,
+    int32_t             dst);
+static void setup_sources(SKVM_CTX *pv);
+static void setup_xform(SKVM_CTX *pv, int xform);
+static void setup_target(SKVM_CTX *pv, int c);
+static void setup_mask(SKVM_SAMPLE_PARAM *ps, int mask);
+
+static int case_run(BENCH *pb, BENCH_CASE *pc);
+static int bench_case(
+    BENCH         * pb,
+    const char    * pName,
+    const char    * pGroup,
+    int32_t         pixels,
+    BENCH_CASE    * pc);
+
+static int bench_sample(BENCH *pb);
+static int write_mjpg(
+    SKVM_CTX    * pv,
+    const char  * pMjpgPath,
+    const char  * pIndexPath);
+static int bench_io(BENCH *pb, const char *pDir, int32_t size);
+static int bench_image(BENCH *pb, int32_t size);
+static int run_bench(
+    const char  * pOutPath,
+    const char  * pDir,
+    const char  * pFilter,
+    int32_t       threads,
+    double        min_time);
+
+static int read_results(
+    const char  *  pPath,
+    RESULT      ** ppr,
+    int32_t     *  pCount);
+static int run_compare(
+    const char  * pBasePath,
+    const char  * pNewPath,
+    double        threshold);
+
+/*
+ * Parse the given string as a signed decimal integer.
+ * 
+ * Parameters:
+ * 
+ *   pstr - the string to parse
+ * 
+ *   pv - receives the parsed value
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the string is not a valid integer
+ */
+static int parse_int(const char *pstr, int32_t *pv) {
+  
+  int status = 1;
+  long v = 0;
+  char *endptr = NULL;
+  
+  /* Check parameters */
+  if ((pstr == NULL) || (pv == NULL)) {
+    abort();
+  }
+  
+  /* Parse the value */
+  errno = 0;
+  v = strtol(pstr, &endptr, 10);
+  if ((errno != 0) || (endptr == pstr) || (*endptr != 0)) {
+    status = 0;
+  }
+  if (status) {
+    if ((v < INT32_MIN) || (v > INT32_MAX)) {
+      status = 0;
+    }
+  }
+  
+  /* Return the value if successful */
+  if (status) {
+    *pv = (int32_t) v;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Parse the given string as a finite floating-point value.
+ * 
+ * Parameters:
+ * 
+ *   pstr - the string to parse
+ * 
+ *   pv - receives the parsed value
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the string is not a valid value
+ */
+static int parse_double(const char *pstr, double *pv) {
+  
+  int status = 1;
+  double v = 0.0;
+  char *endptr = NULL;
+  
+  /* Check parameters */
+  if ((pstr == NULL) || (pv == NULL)) {
+    abort();
+  }
+  
+  /* Parse the value */
+  errno = 0;
+  v = strtod(pstr, &endptr);
+  if ((errno != 0) || (endptr == pstr) || (*endptr != 0)) {
+    status = 0;
+  }
+  if (status) {
+    if (!isfinite(v)) {
+      status = 0;
+    }
+  }
+  
+  /* Return the value if successful */
+  if (status) {
+    *pv = v;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Read a monotonic clock.
+ * 
+ * Return:
+ * 
+ *   the time in seconds from an arbitrary starting point
+ */
+static double clock_secs(void) {
+  
+  struct timespec ts;
+  
+  /* Initialize structures */
+  memset(&ts, 0, sizeof(struct timespec));
+  
+  /* Read the clock */
+  if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+    abort();
+  }
+  
+  /* Return the time in seconds */
+  return ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0);
+}
+
+/*
+ * Comparison function for sorting doubles in ascending order with
+ * qsort().
+ * 
+ * Parameters:
+ * 
+ *   pa - the first double
+ * 
+ *   pb - the second double
+ * 
+ * Return:
+ * 
+ *   less than, equal to, or greater than zero as the first double is
+ *   less than, equal to, or greater than the second
+ */
+static int cmp_double(const void *pa, const void *pb) {
+  
+  double a = 0.0;
+  double b = 0.0;
+  int result = 0;
+  
+  /* Check parameters */
+  if ((pa == NULL) || (pb == NULL)) {
+    abort();
+  }
+  
+  /* Compare the values */
+  a = *((const double *) pa);
+  b = *((const double *) pb);
+  if (a < b) {
+    result = -1;
+  } else if (a > b) {
+    result = 1;
+  } else {
+    result = 0;
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Paint a single layer of solid color over the whole of a loaded ARGB
+ * buffer register.
+ * 
+ * The color is composited with the given blend mode through the given
+ * shape mask, or through no mask if the shape is SKVM_SHAPE_NONE.
+ * pGeom holds the shape_ fields x0 y0 x1 y1 r f of the sampling
+ * parameters, and is ignored if there is no shape.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer register to paint over
+ * 
+ *   a - the alpha channel of the color
+ * 
+ *   r - the red channel of the color
+ * 
+ *   g - the green channel of the color
+ * 
+ *   b - the blue channel of the color
+ * 
+ *   blend - one of the SKVM_BLEND_ constants
+ * 
+ *   shape - one of the SKVM_SHAPE_ constants
+ * 
+ *   pGeom - the six shape coordinates, or NULL if there is no shape
+ */
+static void layer(
+    SKVM_CTX      * pv,
+    int32_t         i,
+    int             a,
+    int             r,
+    int             g,
+    int             b,
+    int             blend,
+    int             shape,
+    const double  * pGeom) {
+  
+  SKVM_SAMPLE_PARAM sp;
+  int32_t w = 0;
+  int32_t h = 0;
+  
+  /* Initialize structures */
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  
+  /* Check parameters */
+  if ((pv == NULL) || ((shape != SKVM_SHAPE_NONE) && (pGeom == NULL))) {
+    abort();
+  }
+  
+  /* Set the color of the single-pixel layer source */
+  skvm_reset(pv, REG_DOT, 1, 1, 4);
+  skvm_load_fill(pv, REG_DOT, a, r, g, b);
+  
+  /* Stretch the layer source over the whole buffer */
+  skvm_get_dim(pv, i, &w, &h);
+  skvm_matrix_reset(pv, MAT_LAYER);
+  skvm_matrix_scale(pv, MAT_LAYER, (double) w, (double) h);
+  
+  /* Composite the layer */
+  sample_init(&sp, REG_DOT, i);
+  sp.t_matrix = MAT_LAYER;
+  sp.blend = blend;
+  if (shape != SKVM_SHAPE_NONE) {
+    sp.mask_shape = shape;
+    sp.shape_x0 = pGeom[0];
+    sp.shape_y0 = pGeom[1];
+    sp.shape_x1 = pGeom[2];
+    sp.shape_y1 = pGeom[3];
+    sp.shape_r = pGeom[4];
+    sp.shape_f = pGeom[5];
+  }
+  skvm_sample(pv, &sp);
+}
+
+/*
+ * Paint a test image over the whole of an ARGB buffer register.
+ * 
+ * The register must already have been reset to ARGB.  The image is
+ * made of smooth ramps and shapes with both soft and hard edges, so
+ * that the image codecs have realistic content to work with.  The
+ * image is always opaque.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer register to paint
+ */
+static void paint(SKVM_CTX *pv, int32_t i) {
+  
+  SKVM_SAMPLE_PARAM sp;
+  int32_t w = 0;
+  int32_t h = 0;
+  double fw = 0.0;
+  double fh = 0.0;
+  double geom[6];
+  
+  /* Initialize structures */
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  memset(geom, 0, sizeof(double) * 6);
+  
+  /* Check parameters */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Get the dimensions */
+  skvm_get_dim(pv, i, &w, &h);
+  fw = (double) w;
+  fh = (double) h;
+  
+  /* Opaque background */
+  skvm_load_fill(pv, i, 255, 40, 60, 90);
+  
+  /* Diagonal ramp across the whole image */
+  geom[0] = 0.0;
+  geom[1] = 0.0;
+  geom[2] = fw;
+  geom[3] = fh;
+  layer(pv, i, 255, 230, 120, 30, SKVM_BLEND_OVER,
+        SKVM_SHAPE_LINEAR, geom);
+  
+  /* Soft radial glow */
+  geom[0] = fw * 0.3;
+  geom[1] = fh * 0.4;
+  geom[4] = fw * 0.1;
+  geom[5] = fw * 0.25;
+  layer(pv, i, 200, 20, 200, 240, SKVM_BLEND_OVER,
+        SKVM_SHAPE_RADIAL, geom);
+  
+  /* Translucent ellipse with an anti-aliased edge */
+  geom[0] = fw * 0.5;
+  geom[1] = fh * 0.1;
+  geom[2] = fw * 0.95;
+  geom[3] = fh * 0.6;
+  geom[4] = 0.0;
+  geom[5] = 1.0;
+  layer(pv, i, 160, 250, 250, 250, SKVM_BLEND_MULTIPLY,
+        SKVM_SHAPE_ELLIPSE, geom);
+  
+  /* Rounded rectangle with a hard edge */
+  geom[0] = fw * 0.1;
+  geom[1] = fh * 0.6;
+  geom[2] = fw * 0.6;
+  geom[3] = fh * 0.95;
+  geom[4] = fw * 0.05;
+  geom[5] = 1.0;
+  layer(pv, i, 220, 10, 160, 60, SKVM_BLEND_OVER,
+        SKVM_SHAPE_RRECT, geom);
+  
+  /* Brighten one quadrant with boundary lines */
+  skvm_get_dim(pv, i, &w, &h);
+  skvm_reset(pv, REG_DOT, 1, 1, 4);
+  skvm_load_fill(pv, REG_DOT, 255, 40, 40, 40);
+  skvm_matrix_reset(pv, MAT_LAYER);
+  skvm_matrix_scale(pv, MAT_LAYER, fw, fh);
+  sample_init(&sp, REG_DOT, i);
+  sp.t_matrix = MAT_LAYER;
+  sp.blend = SKVM_BLEND_ADD;
+  sp.flags = SKVM_FLAG_PROCMASK | SKVM_FLAG_RIGHTMODE |
+              SKVM_FLAG_BELOWMODE;
+  sp.x_boundary = 0.7;
+  sp.y_boundary = 0.7;
+  skvm_sample(pv, &sp);
+}
+
+/*
+ * Initialize sampling parameters for sampling the whole source into
+ * the target without any mask, with nearest neighbor sampling and the
+ * identity transform in MAT_XFORM.
+ * 
+ * Parameters:
+ * 
+ *   ps - the parameters to initialize
+ * 
+ *   src - the source buffer register
+ * 
+ *   dst - the target buffer register
+ */
+static void sample_init(
+    SKVM_SAMPLE_PARAM * ps,
+    int32_t             src,
+    int32_t             dst) {
+  
+  /* Check parameters */
+  if (ps == NULL) {
+    abort();
+  }
+  
+  /* Set the parameters */
+  memset(ps, 0, sizeof(SKVM_SAMPLE_PARAM));
+  ps->src_buf = src;
+  ps->target_buf = dst;
+  ps->t_matrix = MAT_XFORM;
+  ps->x_boundary = 0.0;
+  ps->y_boundary = 0.0;
+  ps->mask_shape = SKVM_SHAPE_NONE;
+  ps->sample_alg = SKVM_ALG_NEAREST;
+  ps->blend = SKVM_BLEND_OVER;
+  ps->flags = SKVM_FLAG_PROCMASK | SKVM_FLAG_LEFTMODE |
+              SKVM_FLAG_ABOVEMODE;
+}
+
+/*
+ * Set up the sources and raster masks of the sampling benchmarks.
+ * 
+ * The ARGB source is translucent towards its edges, so that sampling
+ * it blends with the target.  The grayscale and RGB sources are opaque
+ * conversions of the same painted image.  Both raster masks are a
+ * feathered ellipse.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ */
+static void setup_sources(SKVM_CTX *pv) {
+  
+  SKVM_SAMPLE_PARAM sp;
+  double geom[6];
+  
+  /* Initialize structures */
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  memset(geom, 0, sizeof(double) * 6);
+  
+  /* Check parameters */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Paint the opaque image */
+  skvm_reset(pv, REG_ART, SAMPLE_DIM, SAMPLE_DIM, 4);
+  paint(pv, REG_ART);
+  skvm_matrix_reset(pv, MAT_XFORM);
+  
+  /* Convert it to the grayscale and RGB sources */
+  skvm_reset(pv, REG_SRC1, SAMPLE_DIM, SAMPLE_DIM, 1);
+  skvm_load_fill(pv, REG_SRC1, 255, 0, 0, 0);
+  sample_init(&sp, REG_ART, REG_SRC1);
+  sp.blend = SKVM_BLEND_SRC;
+  skvm_sample(pv, &sp);
+  
+  skvm_reset(pv, REG_SRC3, SAMPLE_DIM, SAMPLE_DIM, 3);
+  skvm_load_fill(pv, REG_SRC3, 255, 0, 0, 0);
+  sample_init(&sp, REG_ART, REG_SRC3);
+  sp.blend = SKVM_BLEND_SRC;
+  skvm_sample(pv, &sp);
+  
+  /* Fade it out towards the edges for the ARGB source */
+  skvm_reset(pv, REG_SRC4, SAMPLE_DIM, SAMPLE_DIM, 4);
+  skvm_load_fill(pv, REG_SRC4, 0, 0, 0, 0);
+  sample_init(&sp, REG_ART, REG_SRC4);
+  sp.mask_shape = SKVM_SHAPE_RADIAL;
+  sp.shape_x0 = SAMPLE_DIM * 0.5;
+  sp.shape_y0 = SAMPLE_DIM * 0.5;
+  sp.shape_r = SAMPLE_DIM * 0.2;
+  sp.shape_f = SAMPLE_DIM * 0.4;
+  skvm_sample(pv, &sp);
+  
+  /* Draw the grayscale raster mask */
+  skvm_reset(pv, REG_MASK, SAMPLE_DIM, SAMPLE_DIM, 1);
+  skvm_load_fill(pv, REG_MASK, 255, 0, 0, 0);
+  geom[0] = SAMPLE_DIM * 0.1;
+  geom[1] = SAMPLE_DIM * 0.05;
+  geom[2] = SAMPLE_DIM * 0.9;
+  geom[3] = SAMPLE_DIM * 0.8;
+  geom[5] = 8.0;
+  layer(pv, REG_MASK, 255, 255, 255, 255, SKVM_BLEND_OVER,
+        SKVM_SHAPE_ELLIPSE, geom);
+  
+  /* Compress a copy of it for the compressed raster mask */
+  skvm_reset(pv, REG_RLE, SAMPLE_DIM, SAMPLE_DIM, 1);
+  skvm_load_fill(pv, REG_RLE, 255, 0, 0, 0);
+  layer(pv, REG_RLE, 255, 255, 255, 255, SKVM_BLEND_OVER,
+        SKVM_SHAPE_ELLIPSE, geom);
+  skvm_mask_compress(pv, REG_RLE);
+}
+
+/*
+ * Set MAT_XFORM to one of the sampling benchmark transforms.
+ * 
+ * Matrix operations premultiply, so the transforms about the center
+ * first move the center to the origin.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   xform - one of the XFORM_ constants
+ */
+static void setup_xform(SKVM_CTX *pv, int xform) {
+  
+  double c = 0.0;
+  
+  /* Check parameters */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Build the transform */
+  c = ((double) SAMPLE_DIM) / 2.0;
+  skvm_matrix_reset(pv, MAT_XFORM);
+  if (xform == XFORM_IDENTITY) {
+    /* Leave as identity */
+  
+  } else if (xform == XFORM_TRANSLATE) {
+    skvm_matrix_translate(pv, MAT_XFORM, 37.0, -21.0);
+  
+  } else if (xform == XFORM_SUBPIXEL) {
+    skvm_matrix_translate(pv, MAT_XFORM, 37.5, -21.25);
+  
+  } else if (xform == XFORM_SCALE) {
+    skvm_matrix_translate(pv, MAT_XFORM, -c, -c);
+    skvm_matrix_scale(pv, MAT_XFORM, 1.5, 1.5);
+    skvm_matrix_translate(pv, MAT_XFORM, c, c);
+  
+  } else if (xform == XFORM_ROTATE) {
+    skvm_matrix_translate(pv, MAT_XFORM, -c, -c);
+    skvm_matrix_rotate(pv, MAT_XFORM, 30.0);
+    skvm_matrix_translate(pv, MAT_XFORM, c, c);
+  
+  } else {
+    abort();
+  }
+}
+
+/*
+ * Reset and load the sampling target with an opaque color.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   c - the channel count of the target, or zero for a float target
+ */
+static void setup_target(SKVM_CTX *pv, int c) {
+  
+  /* Check parameters */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Reset and fill the target */
+  if (c == 0) {
+    skvm_reset_float(pv, REG_DST, SAMPLE_DIM, SAMPLE_DIM);
+  } else {
+    skvm_reset(pv, REG_DST, SAMPLE_DIM, SAMPLE_DIM, c);
+  }
+  skvm_load_fill(pv, REG_DST, 255, 90, 110, 130);
+}
+
+/*
+ * Set the mask of sampling parameters to one of the sampling benchmark
+ * masks.
+ * 
+ * The parameters must have been initialized with sample_init().
+ * 
+ * Parameters:
+ * 
+ *   ps - the sampling parameters
+ * 
+ *   mask - one of the MASK_ constants
+ */
+static void setup_mask(SKVM_SAMPLE_PARAM *ps, int mask) {
+  
+  /* Check parameters */
+  if (ps == NULL) {
+    abort();
+  }
+  
+  /* Set the mask */
+  if (mask == MASK_NONE) {
+    /* Leave unmasked */
+  
+  } else if (mask == MASK_PROC) {
+    ps->flags = SKVM_FLAG_PROCMASK | SKVM_FLAG_LEFTMODE |
+                SKVM_FLAG_ABOVEMODE;
+    ps->x_boundary = 0.3;
+    ps->y_boundary = 0.3;
+  
+  } else if (mask == MASK_SHAPE) {
+    ps->mask_shape = SKVM_SHAPE_ELLIPSE;
+    ps->shape_x0 = SAMPLE_DIM * 0.05;
+    ps->shape_y0 = SAMPLE_DIM * 0.1;
+    ps->shape_x1 = SAMPLE_DIM * 0.95;
+    ps->shape_y1 = SAMPLE_DIM * 0.9;
+    ps->shape_f = 4.0;
+  
+  } else if ((mask == MASK_RASTER) || (mask == MASK_RLE)) {
+    ps->flags = SKVM_FLAG_RASTERMASK;
+    if (mask == MASK_RASTER) {
+      ps->mask_buf = REG_MASK;
+    } else {
+      ps->mask_buf = REG_RLE;
+    }
+    ps->mask_x = 0;
+    ps->mask_y = 0;
+  
+  } else {
+    abort();
+  }
+}
+
+/*
+ * Run a benchmark operation once.
+ * 
+ * Parameters:
+ * 
+ *   pb - the benchmark run
+ * 
+ *   pc - the benchmark
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the operation failed
+ */
+static int case_run(BENCH *pb, BENCH_CASE *pc) {
+  
+  int status = 1;
+  SKVM_SAMPLE_PARAM sp;
+  
+  /* Check parameters */
+  if ((pb == NULL) || (pc == NULL)) {
+    abort();
+  }
+  
+  /* Run the operation */
+  if (pc->kind == CASE_SAMPLE) {
+    memcpy(&sp, &(pc->sp), sizeof(SKVM_SAMPLE_PARAM));
+    skvm_sample(pb->pv, &sp);
+  
+  } else if (pc->kind == CASE_FILL) {
+    skvm_load_fill(pb->pv, REG_IMG, 255, 12, 34, 56);
+  
+  } else if (pc->kind == CASE_INVERT) {
+    skvm_color_invert(pb->pv, REG_IMG);
+  
+  } else if (pc->kind == CASE_LOAD_PNG) {
+    status = skvm_load_png(pb->pv, REG_IMG, pc->pPath);
+  
+  } else if (pc->kind == CASE_LOAD_JPEG) {
+    status = skvm_load_jpeg(pb->pv, REG_IMG, pc->pPath);
+  
+  } else if (pc->kind == CASE_LOAD_MJPG) {
+    status = skvm_load_mjpg(pb->pv, REG_IMG, pc->frame, pc->pPath);
+    pc->frame = (pc->frame + 1) % MJPG_FRAMES;
+  
+  } else if (pc->kind == CASE_STORE_PNG) {
+    status = skvm_store_png(pb->pv, REG_IMG, pc->pPath);
+  
+  } else if (pc->kind == CASE_STORE_JPEG) {
+    status = skvm_store_jpeg(pb->pv, REG_IMG, pc->pPath,
+                              0, JPEG_QUALITY);
+  
+  } else if (pc->kind == CASE_STORE_MJPG) {
+    status = skvm_store_jpeg(pb->pv, REG_IMG, pc->pPath,
+                              1, JPEG_QUALITY);
+  
+  } else {
+    abort();
+  }
+  
+  /* Report any error */
+  if (!status) {
+    fprintf(stderr, "%s: Benchmark operation failed: %s!\n",
+      pModule, skvm_reason(pb->pv));
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Time a benchmark and write its result.
+ * 
+ * If the benchmark name does not contain the filter text, the
+ * benchmark is skipped and the function succeeds.
+ * 
+ * Parameters:
+ * 
+ *   pb - the benchmark run
+ * 
+ *   pName - the name of the benchmark
+ * 
+ *   pGroup - the group of the benchmark, which is the first part of
+ *   its name
+ * 
+ *   pixels - the number of pixels processed by each repetition
+ * 
+ *   pc - the benchmark
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the operation failed
+ */
+static int bench_case(
+    BENCH         * pb,
+    const char    * pName,
+    const char    * pGroup,
+    int32_t         pixels,
+    BENCH_CASE    * pc) {
+  
+  int status = 1;
+  int32_t reps = 0;
+  int32_t j = 0;
+  double total = 0.0;
+  double t = 0.0;
+  double med = 0.0;
+  double busy_max = 0.0;
+  double busy_sum = 0.0;
+  SKVM_BALANCE bal;
+  
+  /* Initialize structures */
+  memset(&bal, 0, sizeof(SKVM_BALANCE));
+  
+  /* Check parameters */
+  if ((pb == NULL) || (pName == NULL) || (pGroup == NULL) ||
+      (pixels < 1) || (pc == NULL)) {
+    abort();
+  }
+  
+  /* Skip if filtered out */
+  if (pb->pFilter != NULL) {
+    if (strstr(pName, pb->pFilter) == NULL) {
+      return 1;
+    }
+  }
+  
+  /* Warm up */
+  status = case_run(pb, pc);
+  
+  /* Repeat until both the minimum time and the minimum number of
+   * repetitions are reached */
+  if (status) {
+    for(reps = 0; reps < MAX_REPS; reps++) {
+      if ((reps >= MIN_REPS) && (total >= pb->min_time)) {
+        break;
+      }
+      
+      t = clock_secs();
+      if (!case_run(pb, pc)) {
+        status = 0;
+        break;
+      }
+      t = clock_secs() - t;
+      
+      (pb->t)[reps] = t;
+      total += t;
+    }
+  }
+  
+  /* Get the median repetition time, and how the last repetition of a
+   * sampling benchmark was balanced */
+  if (status) {
+    qsort(pb->t, (size_t) reps, sizeof(double), &cmp_double);
+    if ((reps % 2) != 0) {
+      med = (pb->t)[reps / 2];
+    } else {
+      med = ((pb->t)[reps / 2 - 1] + (pb->t)[reps / 2]) / 2.0;
+    }
+    
+    if (pc->kind == CASE_SAMPLE) {
+      skvm_balance(&bal);
+      for(j = 0; j < bal.workers; j++) {
+        busy_sum += (bal.busy)[j];
+        if ((bal.busy)[j] > busy_max) {
+          busy_max = (bal.busy)[j];
+        }
+      }
+    }
+  }
+  
+  /* Write the result */
+  if (status) {
+    if (pb->count > 0) {
+      fprintf(pb->pOut, ",\n");
+    }
+    fprintf(pb->pOut,
+      "    {\"name\":\"%s\",\"group\":\"%s\",\"pixels\":%ld,"
+      "\"reps\":%ld,",
+      pName, pGroup, (long) pixels, (long) reps);
+    fprintf(pb->pOut,
+      "\"ns_per_pixel\":%.4f,\"ns_per_pixel_min\":%.4f,"
+      "\"mpixel_per_s\":%.3f",
+      med * 1000000000.0 / ((double) pixels),
+      (pb->t)[0] * 1000000000.0 / ((double) pixels),
+      ((double) pixels) / (med * 1000000.0));
+    if (pc->kind == CASE_SAMPLE) {
+      fprintf(pb->pOut,
+        ",\"workers\":%ld,\"tiles\":%ld,\"steals\":%ld,",
+        (long) bal.workers, (long) bal.tiles, (long) bal.steals);
+      if (busy_sum > 0.0) {
+        fprintf(pb->pOut, "\"imbalance\":%.3f",
+          busy_max * ((double) bal.workers) / busy_sum);
+      } else {
+        fprintf(pb->pOut, "\"imbalance\":null");
+      }
+    }
+    fprintf(pb->pOut, "}");
+    (pb->count)++;
+    
+    fprintf(stderr, "%s: %-36s %10.2f Mpixel/s\n",
+      pModule, pName, ((double) pixels) / (med * 1000000.0));
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Run the sampling benchmarks.
+ * 
+ * Parameters:
+ * 
+ *   pb - the benchmark run
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if a benchmark failed
+ */
+static int bench_sample(BENCH *pb) {
+  
+  static const int chan[3] = {1, 3, 4};
+  static const int32_t src[3] = {REG_SRC1, REG_SRC3, REG_SRC4};
+  
+  int status = 1;
+  int a = 0;
+  int x = 0;
+  int s = 0;
+  int d = 0;
+  int m = 0;
+  char dname[2];
+  char name[MAX_NAME];
+  BENCH_CASE bc;
+  
+  /* Initialize structures */
+  memset(dname, 0, 2);
+  memset(name, 0, MAX_NAME);
+  memset(&bc, 0, sizeof(BENCH_CASE));
+  
+  /* Check parameters */
+  if (pb == NULL) {
+    abort();
+  }
+  
+  /* Set up the sources and masks */
+  setup_sources(pb->pv);
+  
+  /* Go through all algorithms and transforms */
+  for(a = 0; a < (int) (sizeof(m_alg) / sizeof(int)); a++) {
+    for(x = 0; x < XFORM_COUNT; x++) {
+      setup_xform(pb->pv, x);
+      
+      /* Time every channel combination without a mask, where target
+       * index 3 is the float target */
+      for(d = 0; d < 4; d++) {
+        if (d < 3) {
+          setup_target(pb->pv, chan[d]);
+          dname[0] = (char) ('0' + chan[d]);
+        } else {
+          setup_target(pb->pv, 0);
+          dname[0] = 'f';
+        }
+        
+        for(s = 0; s < 3; s++) {
+          memset(&bc, 0, sizeof(BENCH_CASE));
+          bc.kind = CASE_SAMPLE;
+          sample_init(&(bc.sp), src[s], REG_DST);
+          bc.sp.sample_alg = m_alg[a];
+          
+          sprintf(name, "sample/%s/%s/%d-%s/%s",
+            m_alg_name[a], m_xform_name[x], chan[s], dname,
+            m_mask_name[MASK_NONE]);
+          if (!bench_case(pb, name, "sample",
+                (int32_t) (SAMPLE_DIM * SAMPLE_DIM), &bc)) {
+            status = 0;
+            break;
+          }
+        }
+        
+        if (!status) {
+          break;
+        }
+      }
+      
+      /* Time every mask with ARGB source and target */
+      if (status) {
+        setup_target(pb->pv, 4);
+        for(m = MASK_NONE + 1; m < MASK_COUNT; m++) {
+          memset(&bc, 0, sizeof(BENCH_CASE));
+          bc.kind = CASE_SAMPLE;
+          sample_init(&(bc.sp), REG_SRC4, REG_DST);
+          bc.sp.sample_alg = m_alg[a];
+          setup_mask(&(bc.sp), m);
+          
+          sprintf(name, "sample/%s/%s/4-4/%s",
+            m_alg_name[a], m_xform_name[x], m_mask_name[m]);
+          if (!bench_case(pb, name, "sample",
+                (int32_t) (SAMPLE_DIM * SAMPLE_DIM), &bc)) {
+            status = 0;
+            break;
+          }
+        }
+      }
+      
+      if (!status) {
+        break;
+      }
+    }
+    
+    if (!status) {
+      break;
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+
+/*
+ * Build a Motion-JPEG file and its index file.
+ * 
+ * The Motion-JPEG file gets MJPG_FRAMES frames of the image in
+ * REG_IMG, which is inverted after each frame so that the frames
+ * differ.  The index file has the format described for
+ * skvm_load_mjpg().
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   pMjpgPath - the path of the Motion-JPEG file to build
+ * 
+ *   pIndexPath - the path of the index file to write
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int write_mjpg(
+    SKVM_CTX    * pv,
+    const char  * pMjpgPath,
+    const char  * pIndexPath) {
+  
+  int status = 1;
+  int32_t f = 0;
+  int k = 0;
+  uint64_t v = 0;
+  uint64_t ofs[MJPG_FRAMES];
+  uint8_t be[8];
+  struct stat st;
+  FILE *pf = NULL;
+  
+  /* Initialize structures */
+  memset(ofs, 0, sizeof(uint64_t) * MJPG_FRAMES);
+  memset(be, 0, 8);
+  memset(&st, 0, sizeof(struct stat));
+  
+  /* Check parameters */
+  if ((pv == NULL) || (pMjpgPath == NULL) || (pIndexPath == NULL)) {
+    abort();
+  }
+  
+  /* Append the frames, recording the file size before each */
+  unlink(pMjpgPath);
+  for(f = 0; f < MJPG_FRAMES; f++) {
+    if (f > 0) {
+      if (stat(pMjpgPath, &st)) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to stat Motion-JPEG file!\n",
+          pModule);
+        break;
+      }
+      ofs[f] = (uint64_t) st.st_size;
+    }
+    
+    if (!skvm_store_jpeg(pv, REG_IMG, pMjpgPath, 1, JPEG_QUALITY)) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to store frame: %s!\n",
+        pModule, skvm_reason(pv));
+      break;
+    }
+    skvm_color_invert(pv, REG_IMG);
+  }
+  
+  /* Create the index file */
+  if (status) {
+    pf = fopen(pIndexPath, "wb");
+    if (pf == NULL) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to create index file!\n", pModule);
+    }
+  }
+  
+  /* Write the frame count followed by the frame offsets, all as
+   * big-endian 64-bit integers */
+  if (status) {
+    for(f = -1; f < MJPG_FRAMES; f++) {
+      if (f < 0) {
+        v = (uint64_t) MJPG_FRAMES;
+      } else {
+        v = ofs[f];
+      }
+      for(k = 0; k < 8; k++) {
+        be[k] = (uint8_t) (v >> (56 - 8 * k));
+      }
+      if (fwrite(be, 1, 8, pf) != 8) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to write index file!\n", pModule);
+        break;
+      }
+    }
+  }
+  
+  /* Close the index file */
+  if (pf != NULL) {
+    if (fclose(pf)) {
+      if (status) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to close index file!\n", pModule);
+      }
+    }
+    pf = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Run the load and store benchmarks at one image size.
+ * 
+ * The image files are written to the given directory and removed
+ * afterwards.  The store benchmarks run first, and then the files read
+ * by the load benchmarks are written, so that loads do not depend on
+ * which store benchmarks were filtered out.
+ * 
+ * Parameters:
+ * 
+ *   pb - the benchmark run
+ * 
+ *   pDir - the directory for the image files
+ * 
+ *   size - the width and height of the image
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if a benchmark failed
+ */
+static int bench_io(BENCH *pb, const char *pDir, int32_t size) {
+  
+  static const char *name[6] = {
+    "store/png", "store/jpeg", "store/mjpg",
+    "load/png", "load/jpeg", "load/mjpg"
+  };
+  static const int kind[6] = {
+    CASE_STORE_PNG, CASE_STORE_JPEG, CASE_STORE_MJPG,
+    CASE_LOAD_PNG, CASE_LOAD_JPEG, CASE_LOAD_MJPG
+  };
+  
+  int status = 1;
+  int want = 0;
+  int named = 0;
+  int j = 0;
+  char full[MAX_NAME];
+  char png[MAX_PATH];
+  char jpg[MAX_PATH];
+  char mjpg[MAX_PATH];
+  char ix[MAX_PATH];
+  char out[MAX_PATH];
+  const char *path[6];
+  BENCH_CASE bc;
+  
+  /* Initialize structures */
+  memset(full, 0, MAX_NAME);
+  memset(png, 0, MAX_PATH);
+  memset(jpg, 0, MAX_PATH);
+  memset(mjpg, 0, MAX_PATH);
+  memset(ix, 0, MAX_PATH);
+  memset(out, 0, MAX_PATH);
+  memset(&bc, 0, sizeof(BENCH_CASE));
+  
+  /* Check parameters */
+  if ((pb == NULL) || (pDir == NULL) || (size < 1)) {
+    abort();
+  }
+  
+  /* Skip the setup if every benchmark is filtered out */
+  for(j = 0; j < 6; j++) {
+    sprintf(full, "%s/%ld", name[j], (long) size);
+    if ((pb->pFilter == NULL) || (strstr(full, pb->pFilter) != NULL)) {
+      want = 1;
+    }
+  }
+  if (!want) {
+    return 1;
+  }
+  
+  /* Build the file paths */
+  if ((snprintf(png, MAX_PATH, "%s/skbench.png", pDir) >= MAX_PATH) ||
+      (snprintf(jpg, MAX_PATH, "%s/skbench.jpg", pDir) >= MAX_PATH) ||
+      (snprintf(mjpg, MAX_PATH, "%s/skbench.mjpg", pDir) >= MAX_PATH) ||
+      (snprintf(ix, MAX_PATH, "%s.ix", mjpg) >= MAX_PATH) ||
+      (snprintf(out, MAX_PATH, "%s/skbench_out.mjpg", pDir) >=
+        MAX_PATH)) {
+    status = 0;
+    fprintf(stderr, "%s: Directory path is too long!\n", pModule);
+  } else {
+    named = 1;
+  }
+  path[0] = png;
+  path[1] = jpg;
+  path[2] = out;
+  path[3] = png;
+  path[4] = jpg;
+  path[5] = ix;
+  
+  /* Paint the image */
+  if (status) {
+    skvm_reset(pb->pv, REG_IMG, size, size, 4);
+    paint(pb->pv, REG_IMG);
+    unlink(out);
+  }
+  
+  /* Time the stores */
+  for(j = 0; status && (j < 3); j++) {
+    memset(&bc, 0, sizeof(BENCH_CASE));
+    bc.kind = kind[j];
+    bc.pPath = path[j];
+    sprintf(full, "%s/%ld", name[j], (long) size);
+    status = bench_case(pb, full, "store", size * size, &bc);
+  }
+  
+  /* Write the files for the loads */
+  if (status) {
+    if ((!skvm_store_png(pb->pv, REG_IMG, png)) ||
+        (!skvm_store_jpeg(pb->pv, REG_IMG, jpg, 0, JPEG_QUALITY))) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to store image: %s!\n",
+        pModule, skvm_reason(pb->pv));
+    }
+  }
+  if (status) {
+    status = write_mjpg(pb->pv, mjpg, ix);
+  }
+  
+  /* Time the loads */
+  for(j = 3; status && (j < 6); j++) {
+    memset(&bc, 0, sizeof(BENCH_CASE));
+    bc.kind = kind[j];
+    bc.pPath = path[j];
+    sprintf(full, "%s/%ld", name[j], (long) size);
+    status = bench_case(pb, full, "load", size * size, &bc);
+  }
+  
+  /* Remove any files that were written */
+  if (named) {
+    unlink(png);
+    unlink(jpg);
+    unlink(mjpg);
+    unlink(ix);
+    unlink(out);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Run the fill and invert benchmarks at one image size.
+ * 
+ * Parameters:
+ * 
+ *   pb - the benchmark run
+ * 
+ *   size - the width and height of the image
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if a benchmark failed
+ */
+static int bench_image(BENCH *pb, int32_t size) {
+  
+  static const int chan[4] = {1, 3, 4, 0};
+  
+  int status = 1;
+  int j = 0;
+  char full[MAX_NAME];
+  BENCH_CASE bc;
+  
+  /* Initialize structures */
+  memset(full, 0, MAX_NAME);
+  memset(&bc, 0, sizeof(BENCH_CASE));
+  
+  /* Check parameters */
+  if ((pb == NULL) || (size < 1)) {
+    abort();
+  }
+  
+  /* Time fills of each channel count, where zero is a float buffer */
+  for(j = 0; status && (j < 4); j++) {
+    if (chan[j] > 0) {
+      skvm_reset(pb->pv, REG_IMG, size, size, chan[j]);
+      sprintf(full, "fill/%d/%ld", chan[j], (long) size);
+    } else {
+      skvm_reset_float(pb->pv, REG_IMG, size, size);
+      sprintf(full, "fill/f/%ld", (long) size);
+    }
+    
+    memset(&bc, 0, sizeof(BENCH_CASE));
+    bc.kind = CASE_FILL;
+    status = bench_case(pb, full, "fill", size * size, &bc);
+  }
+  
+  /* Time inversions of each channel count, which float buffers do not
+   * support */
+  for(j = 0; status && (j < 3); j++) {
+    skvm_reset(pb->pv, REG_IMG, size, size, chan[j]);
+    skvm_load_fill(pb->pv, REG_IMG, 255, 12, 34, 56);
+    sprintf(full, "invert/%d/%ld", chan[j], (long) size);
+    
+    memset(&bc, 0, sizeof(BENCH_CASE));
+    bc.kind = CASE_INVERT;
+    status = bench_case(pb, full, "invert", size * size, &bc);
+  }
+  
+  /* Release the image */
+  skvm_reset(pb->pv, REG_IMG, 1, 1, 1);
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Run all benchmarks and write the results.
+ * 
+ * Parameters:
+ * 
+ *   pOutPath - the path of the result file, or NULL for standard
+ *   output
+ * 
+ *   pDir - the directory for the temporary image files
+ * 
+ *   pFilter - the text benchmark names must contain, or NULL
+ * 
+ *   threads - the thread count for skvm_threads()
+ * 
+ *   min_time - the minimum time in seconds to repeat each benchmark
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int run_bench(
+    const char  * pOutPath,
+    const char  * pDir,
+    const char  * pFilter,
+    int32_t       threads,
+    double        min_time) {
+  
+  int status = 1;
+  int j = 0;
+  long ncpu = 0;
+  BENCH *pb = NULL;
+  
+  /* Check parameters */
+  if ((pDir == NULL) || (!(min_time > 0.0))) {
+    abort();
+  }
+  
+  /* Allocate the benchmark run */
+  pb = (BENCH *) calloc(1, sizeof(BENCH));
+  if (pb == NULL) {
+    abort();
+  }
+  pb->pFilter = pFilter;
+  pb->min_time = min_time;
+  
+  /* Open the result file */
+  if (pOutPath != NULL) {
+    pb->pOut = fopen(pOutPath, "w");
+    if (pb->pOut == NULL) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to create result file!\n", pModule);
+    }
+  } else {
+    pb->pOut = stdout;
+  }
+  
+  /* Set the threads and allocate the context */
+  if (status) {
+    skvm_threads(threads);
+    pb->pv = skvm_alloc(REG_COUNT, MAT_COUNT);
+  }
+  
+  /* Write the start of the results */
+  if (status) {
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    fprintf(pb->pOut, "{\n  \"suite\":\"skbench\",\n");
+    fprintf(pb->pOut, "  \"threads\":%ld,\n  \"processors\":%ld,\n",
+      (long) threads, ncpu);
+    fprintf(pb->pOut, "  \"min_time\":%.3f,\n  \"results\":[\n",
+      min_time);
+  }
+  
+  /* Run the benchmarks */
+  if (status) {
+    status = bench_sample(pb);
+  }
+  for(j = 0; status && (j < (int) (sizeof(m_size) / sizeof(int32_t)));
+      j++) {
+    status = bench_image(pb, m_size[j]);
+  }
+  for(j = 0; status && (j < (int) (sizeof(m_size) / sizeof(int32_t)));
+      j++) {
+    status = bench_io(pb, pDir, m_size[j]);
+  }
+  
+  /* Write the end of the results */
+  if (status) {
+    fprintf(pb->pOut, "\n  ]\n}\n");
+  }
+  
+  /* Close the result file */
+  if ((pOutPath != NULL) && (pb->pOut != NULL)) {
+    if (fclose(pb->pOut)) {
+      if (status) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to write result file!\n", pModule);
+      }
+    }
+  } else if (pb->pOut != NULL) {
+    if (fflush(pb->pOut)) {
+      status = 0;
+    }
+  }
+  pb->pOut = NULL;
+  
+  /* Release the context and the benchmark run */
+  skvm_free(pb->pv);
+  pb->pv = NULL;
+  free(pb);
+  pb = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Read the results of a result file.
+ * 
+ * Only the name and the median nanoseconds per pixel of each result
+ * are read.  Results are recognized as lines that have both a name and
+ * an ns_per_pixel field, which is the layout run_bench() writes.
+ * 
+ * If successful, *ppr is set to a dynamically allocated array of the
+ * results, which the caller must free, and *pCount is set to the
+ * number of results.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path of the result file
+ * 
+ *   ppr - receives the array of results
+ * 
+ *   pCount - receives the number of results
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int read_results(
+    const char  *  pPath,
+    RESULT      ** ppr,
+    int32_t     *  pCount) {
+  
+  int status = 1;
+  FILE *pf = NULL;
+  RESULT *pr = NULL;
+  RESULT *pGrow = NULL;
+  int32_t count = 0;
+  int32_t cap = 0;
+  const char *pName = NULL;
+  const char *pNs = NULL;
+  const char *pEnd = NULL;
+  char *endptr = NULL;
+  char line[MAX_PATH];
+  
+  /* Initialize structures */
+  memset(line, 0, MAX_PATH);
+  
+  /* Check parameters */
+  if ((pPath == NULL) || (ppr == NULL) || (pCount == NULL)) {
+    abort();
+  }
+  *ppr = NULL;
+  *pCount = 0;
+  
+  /* Open the file */
+  pf = fopen(pPath, "r");
+  if (pf == NULL) {
+    status = 0;
+    fprintf(stderr, "%s: Failed to open %s!\n", pModule, pPath);
+  }
+  
+  /* Read each result line */
+  while (status && (fgets(line, MAX_PATH, pf) != NULL)) {
+    pName = strstr(line, "\"name\":\"");
+    pNs = strstr(line, "\"ns_per_pixel\":");
+    if ((pName == NULL) || (pNs == NULL)) {
+      continue;
+    }
+    pName += strlen("\"name\":\"");
+    pNs += strlen("\"ns_per_pixel\":");
+    
+    /* Grow the array if necessary */
+    if (count >= cap) {
+      if (cap < 1) {
+        cap = 64;
+      } else {
+        cap *= 2;
+      }
+      pGrow = (RESULT *) realloc(pr, sizeof(RESULT) * ((size_t) cap));
+      if (pGrow == NULL) {
+        abort();
+      }
+      pr = pGrow;
+    }
+    
+    /* Get the name and the time */
+    pEnd = strchr(pName, '"');
+    if ((pEnd == NULL) || (pEnd - pName >= MAX_NAME)) {
+      status = 0;
+      fprintf(stderr, "%s: Invalid result name in %s!\n",
+        pModule, pPath);
+      break;
+    }
+    memset(pr[count].name, 0, MAX_NAME);
+    memcpy(pr[count].name, pName, (size_t) (pEnd - pName));
+    
+    pr[count].ns = strtod(pNs, &endptr);
+    if ((endptr == pNs) || (!isfinite(pr[count].ns))) {
+      status = 0;
+      fprintf(stderr, "%s: Invalid result time in %s!\n",
+        pModule, pPath);
+      break;
+    }
+    count++;
+  }
+  
+  /* Check for read errors */
+  if (status) {
+    if (ferror(pf)) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to read %s!\n", pModule, pPath);
+    }
+  }
+  
+  /* Close the file */
+  if (pf != NULL) {
+    fclose(pf);
+    pf = NULL;
+  }
+  
+  /* Return the results if successful, else release them */
+  if (status) {
+    *ppr = pr;
+    *pCount = count;
+  } else {
+    free(pr);
+  }
+  pr = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Compare two result files and print the change of each benchmark.
+ * 
+ * Parameters:
+ * 
+ *   pBasePath - the path of the baseline result file
+ * 
+ *   pNewPath - the path of the new result file
+ * 
+ *   threshold - the percentage by which a benchmark must get slower
+ *   to be a regression
+ * 
+ * Return:
+ * 
+ *   non-zero if there were no regressions, zero if there were
+ *   regressions or an error
+ */
+static int run_compare(
+    const char  * pBasePath,
+    const char  * pNewPath,
+    double        threshold) {
+  
+  int status = 1;
+  RESULT *pBase = NULL;
+  RESULT *pNew = NULL;
+  int32_t base_count = 0;
+  int32_t new_count = 0;
+  int32_t i = 0;
+  int32_t j = 0;
+  int32_t matched = 0;
+  int32_t slower = 0;
+  int32_t faster = 0;
+  double limit = 0.0;
+  double ratio = 0.0;
+  double log_sum = 0.0;
+  const char *pFlag = NULL;
+  
+  /* Check parameters */
+  if ((pBasePath == NULL) || (pNewPath == NULL) ||
+      (!(threshold >= 0.0))) {
+    abort();
+  }
+  
+  /* Read both files */
+  status = read_results(pBasePath, &pBase, &base_count);
+  if (status) {
+    status = read_results(pNewPath, &pNew, &new_count);
+  }
+  
+  /* Compare each new result with the baseline result of the same
+   * name */
+  if (status) {
+    limit = 1.0 + threshold / 100.0;
+    printf("%-36s %12s %12s %9s\n",
+      "benchmark", "base ns/px", "new ns/px", "change");
+    
+    for(i = 0; i < new_count; i++) {
+      for(j = 0; j < base_count; j++) {
+        if (strcmp(pNew[i].name, pBase[j].name) == 0) {
+          break;
+        }
+      }
+      if ((j >= base_count) ||
+          (!(pBase[j].ns > 0.0)) || (!(pNew[i].ns > 0.0))) {
+        continue;
+      }
+      
+      ratio = pNew[i].ns / pBase[j].ns;
+      log_sum += log(ratio);
+      matched++;
+      
+      pFlag = "";
+      if (ratio > limit) {
+        pFlag = "  SLOWER";
+        slower++;
+      } else if (ratio < 1.0 / limit) {
+        pFlag = "  faster";
+        faster++;
+      }
+      
+      printf("%-36s %12.4f %12.4f %+8.2f%%%s\n",
+        pNew[i].name, pBase[j].ns, pNew[i].ns,
+        (ratio - 1.0) * 100.0, pFlag);
+    }
+    
+    printf("\n%ld compared, %ld slower, %ld faster",
+      (long) matched, (long) slower, (long) faster);
+    if (matched > 0) {
+      printf(", geometric mean change %+.2f%%",
+        (exp(log_sum / ((double) matched)) - 1.0) * 100.0);
+    }
+    printf("\n");
+    
+    if (slower > 0) {
+      status = 0;
+    }
+  }
+  
+  /* Release the results */
+  free(pBase);
+  pBase = NULL;
+  free(pNew);
+  pNew = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Program entrypoint
+ * ==================
+ */
+
+int main(int argc, char *argv[]) {
+  
+  int status = 1;
+  int i = 0;
+  int32_t threads = 0;
+  double min_time = DEF_MIN_TIME;
+  double threshold = DEF_THRESHOLD;
+  const char *pOutPath = NULL;
+  const char *pDir = ".";
+  const char *pFilter = NULL;
+  
+  /* Set module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "skbench";
+  }
+  
+  /* Compare mode */
+  if ((argc >= 2) && (strcmp(argv[1], "-compare") == 0)) {
+    if ((argc != 4) && (argc != 5)) {
+      status = 0;
+      fprintf(stderr, "%s: Unrecognized arguments!\n", pModule);
+    }
+    if (status && (argc == 5)) {
+      if (!parse_double(argv[4], &threshold)) {
+        status = 0;
+      } else if (threshold < 0.0) {
+        status = 0;
+      }
+      if (!status) {
+        fprintf(stderr, "%s: Invalid percentage!\n", pModule);
+      }
+    }
+    if (status) {
+      status = run_compare(argv[2], argv[3], threshold);
+    }
+    
+    if (status) {
+      return 0;
+    } else {
+      return 1;
+    }
+  }
+  
+  /* Parse the options */
+  for(i = 1; status && (i < argc); i++) {
+    if ((strcmp(argv[i], "-t") == 0) ||
+        (strcmp(argv[i], "-m") == 0) ||
+        (strcmp(argv[i], "-f") == 0) ||
+        (strcmp(argv[i], "-d") == 0)) {
+      if (i + 1 >= argc) {
+        status = 0;
+        fprintf(stderr, "%s: Missing option value!\n", pModule);
+        break;
+      }
+      
+      if (strcmp(argv[i], "-t") == 0) {
+        if (!parse_int(argv[i + 1], &threads)) {
+          status = 0;
+        } else if ((threads < 0) || (threads > SKVM_MAX_THREADS)) {
+          status = 0;
+        }
+        if (!status) {
+          fprintf(stderr, "%s: Invalid thread count!\n", pModule);
+        }
+      
+      } else if (strcmp(argv[i], "-m") == 0) {
+        if (!parse_double(argv[i + 1], &min_time)) {
+          status = 0;
+        } else if ((!(min_time > 0.0)) || (min_time > 60.0)) {
+          status = 0;
+        }
+        if (!status) {
+          fprintf(stderr, "%s: Invalid minimum time!\n", pModule);
+        }
+      
+      } else if (strcmp(argv[i], "-f") == 0) {
+        pFilter = argv[i + 1];
+      
+      } else {
+        pDir = argv[i + 1];
+      }
+      i++;
+    
+    } else if ((argv[i][0] != '-') && (pOutPath == NULL)) {
+      pOutPath = argv[i];
+    
+    } else {
+      status = 0;
+      fprintf(stderr, "%s: Unrecognized arguments!\n", pModule);
+    }
+  }
+  
+  /* Run the benchmarks */
+  if (status) {
+    status = run_bench(pOutPath, pDir, pFilter, threads, min_time);
+  }
+  
+  /* Invert status and return */
+  if (status) {
+    status = 0;
+  } else {
+    status = 1;
+  }
+  return status;
+}
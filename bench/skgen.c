@@ -0,0 +1,2008 @@
+/*
+ * skgen.c
+ * =======
+ * 
+ * Synthetic workload generator for scale testing of the Sparkle
+ * renderer.
+ * 
+ * Syntax:
+ * 
+ *   skgen [params] [dir]
+ * 
+ * Reads the parameter file [params] and writes a workload into the
+ * directory [dir], which is created if it does not exist.  The
+ * workload consists of Sparkle scripts that composite a number of
+ * sprites onto a canvas for a number of frames, along with the
+ * synthetic PNG and JPEG images they load.  The same parameter file
+ * always gives exactly the same scripts and images, on any platform,
+ * so stress cases can be regenerated rather than stored.
+ * 
+ * All paths within the scripts are relative to [dir], so the scripts
+ * must be run with [dir] as the current directory:
+ * 
+ *   skgen params.txt work
+ *   cd work
+ *   sparkle < workload.sparkle
+ * 
+ * The directory receives:
+ * 
+ *   [name].sparkle, the script rendering all frames, or [name]-[f].sparkle
+ *   for each frame [f] counted from zero in five digits, along with the
+ *   batch list [name].list naming all of them, if split is set
+ * 
+ *   assets/sprite-[k].png or assets/sprite-[k].jpg for each sprite
+ *   image, assets/mask-[k].png for each mask image, and
+ *   assets/background.png or assets/background.jpg if there is a
+ *   background image
+ * 
+ *   frames/, which is where the scripts store the rendered frames
+ * 
+ * Parameter file:
+ * 
+ * Each line of the parameter file holds a parameter name followed by
+ * its values, separated by whitespace.  Blank lines and lines that
+ * begin with "#" are ignored.  Parameters may be given in any order,
+ * each at most once, and parameters that are not given keep their
+ * defaults.  The parameters are:
+ * 
+ *   name [text] is the name of the scripts, made of letters, digits,
+ *   "-" and "_" (default "workload")
+ * 
+ *   seed [n] seeds the pseudo-random generator, which determines
+ *   everything that is not set by another parameter (default 1)
+ * 
+ *   canvas [w] [h] is the size of the canvas, each up to SKVM_MAX_DIM
+ *   (default 1920 1080)
+ * 
+ *   frames [n] is the number of frames, from 1 to 100000 (default 1)
+ * 
+ *   sprites [n] is the number of sprites drawn in each frame, from 1
+ *   to 100000 (default 100)
+ * 
+ *   images [n] is the number of distinct sprite images, from 1 to
+ *   MAX_IMAGES, which the sprites pick from at random (default 8)
+ * 
+ *   size [min] [max] is the range of the width and height of the
+ *   sprite images in pixels, from 1 to 4096 (default 32 128)
+ * 
+ *   scale [min] [max] is the range of the scaling of each sprite,
+ *   greater than zero (default 1.0 1.0)
+ * 
+ *   rotate [deg] is the largest rotation of a sprite in degrees,
+ *   where zero does not rotate (default 0)
+ * 
+ *   quarter [0|1] restricts rotations to multiples of 90 degrees
+ *   (default 0)
+ * 
+ *   spin [deg] is the largest change of the rotation of a sprite from
+ *   one frame to the next (default 0)
+ * 
+ *   motion [px] is the largest distance a sprite moves from one frame
+ *   to the next, where sprites leaving the canvas come back in on the
+ *   opposite side (default 0)
+ * 
+ *   alpha [0|1] makes the sprite images translucent ARGB images rather
+ *   than opaque images (default 1)
+ * 
+ *   format [png|jpeg] is the format of the sprite images, where JPEG
+ *   sprite images are always opaque (default png)
+ * 
+ *   masks [ratio] is the share of sprites, from 0.0 to 1.0, that are
+ *   drawn through a mask (default 0.0)
+ * 
+ *   mask [shape|raster|rle|mix] is the kind of mask, where shape is a
+ *   feathered ellipse around the sprite, raster and rle are a
+ *   grayscale mask image loaded as it is or compressed and placed over
+ *   the sprite, and mix picks one of the three for each masked sprite
+ *   (default shape)
+ * 
+ *   background [fill|png|jpeg] is whether each frame starts out as a
+ *   solid color or as a copy of a background image of the size of the
+ *   canvas (default fill)
+ * 
+ *   accumulate [0|1] renders into a float buffer (default 0)
+ * 
+ *   output [png|jpeg|mjpg|none] is how frames are stored, where mjpg
+ *   appends all frames to frames/[name].mjpg, which must be deleted
+ *   before running the script again, and may not be combined with
+ *   split, and none does not store them (default png)
+ * 
+ *   threads [n] and pipeline [n] are written to the %threads and
+ *   %pipeline headers, which are left out if zero (default 0 0)
+ * 
+ *   split [0|1] writes one script for each frame instead of a single
+ *   script, for running with "sparkle --batch" (default 0)
+ * 
+ * Sprites are drawn with nearest neighbor sampling and the OVER blend,
+ * centered on their position, scaled and then rotated about their
+ * center.  The position, rotation, scale, image, motion, and mask of
+ * each sprite are chosen when the workload is generated and then
+ * animated from frame to frame, so each frame draws the same sprites
+ * in the same order.  Generating the images of a large canvas needs
+ * as much memory as the renderer needs to load them.
+ * 
+ * Compilation:
+ * 
+ *   - "make skgen" in the repository root builds it (see Makefile)
+ *   - Build with the same compiler flags as the sparkle program
+ *   - Include directory must contain skvm.h (the repository root)
+ *   - Requires the skvm.c module
+ *   - Requires POSIX mkdir()
+ *   - Requires POSIX threads, which may require -lpthread
+ *   - May require the math library -lm on some platforms
+ *   - Requires libsophistry and libsophistry-jpeg (via skvm)
+ *   - Depends on libjpeg 6B, libpng, and zlib (via libsophistry)
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "skvm.h"
+
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * The largest number of frames and sprites.
+ */
+#define MAX_FRAMES (100000)
+#define MAX_SPRITES (100000)
+
+/*
+ * The largest number of distinct sprite images.
+ * 
+ * Each image may need a sprite, raster mask, and compressed mask
+ * register in the scripts, so this must leave room for three registers
+ * of each image plus the canvas and background within SKVM_MAX_BUFC.
+ */
+#define MAX_IMAGES (1024)
+
+/*
+ * The largest width or height of a sprite image.
+ */
+#define MAX_SIZE (4096)
+
+/*
+ * The maximum length of a parameter file line and of the name
+ * parameter, including the terminating nul.
+ */
+#define MAX_LINE (1024)
+#define MAX_NAME (64)
+
+/*
+ * The maximum length of a path, including the terminating nul.
+ */
+#define MAX_PATH (4096)
+
+/*
+ * The JPEG quality of the generated images and the stored frames.
+ */
+#define JPEG_QUALITY (90)
+
+/*
+ * Buffer and matrix registers used while painting images.
+ */
+#define GEN_DOT   (0)   /* 1x1 ARGB color of a painted layer */
+#define GEN_IMG   (1)   /* Image being painted */
+#define GEN_COUNT (2)
+
+#define GEN_MLAYER (0)  /* Transform of a painted layer */
+#define GEN_MCOUNT (1)
+
+/*
+ * Fixed buffer registers of the scripts.  The sprite images, raster
+ * masks, and compressed masks follow in three blocks of the number of
+ * images each.
+ */
+#define REG_CANVAS (0)
+#define REG_BACK   (1)
+#define REG_FIRST  (2)
+
+/*
+ * The values of the format and background parameters.
+ */
+#define FMT_NONE (0)
+#define FMT_PNG  (1)
+#define FMT_JPEG (2)
+#define FMT_MJPG (3)
+
+/*
+ * The kinds of mask.  MASK_MIX is only used for the mask parameter.
+ */
+#define MASK_NONE   (0)
+#define MASK_SHAPE  (1)
+#define MASK_RASTER (2)
+#define MASK_RLE    (3)
+#define MASK_MIX    (4)
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * The parameters of a workload.
+ */
+typedef struct {
+
+  char name[MAX_NAME];
+  uint64_t seed;
+  int32_t canvas_w;
+  int32_t canvas_h;
+  int32_t frames;
+  int32_t sprites;
+  int32_t images;
+  int32_t size_min;
+  int32_t size_max;
+  double scale_min;
+  double scale_max;
+  double rotate;
+  int quarter;
+  double spin;
+  double motion;
+  int alpha;
+  int format;
+  double masks;
+  int mask;
+  int background;
+  int accumulate;
+  int output;
+  int32_t threads;
+  int32_t pipeline;
+  int split;
+
+} PARAMS;
+
+/*
+ * A sprite image.
+ */
+typedef struct {
+
+  /*
+   * The dimensions of the image.
+   */
+  int32_t w;
+  int32_t h;
+  
+  /*
+   * Non-zero if any sprite uses the raster mask or compressed mask of
+   * this image.
+   */
+  int raster;
+  int rle;
+
+} IMAGE;
+
+/*
+ * A sprite, as it is in the first frame.
+ */
+typedef struct {
+
+  /*
+   * The index of the sprite image.
+   */
+  int32_t image;
+  
+  /*
+   * One of the MASK_ constants other than MASK_MIX.
+   */
+  int mask;
+  
+  /*
+   * The position of the center on the canvas and its change from one
+   * frame to the next.
+   */
+  double x;
+  double y;
+  double dx;
+  double dy;
+  
+  /*
+   * The rotation in degrees and its change from one frame to the next.
+   */
+  double rot;
+  double drot;
+  
+  /*
+   * The scaling.
+   */
+  double scale;
+
+} SPRITE;
+
+/*
+ * Static data
+ * ===========
+ */
+
+/*
+ * The name of the executing module, for diagnostic messages.
+ */
+static const char *pModule = NULL;
+
+/*
+ * The state of the pseudo-random generator.
+ */
+static uint64_t m_rng = 0;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Prototypes */
+static uint64_t rng_next(void);
+static double rng_unit(void);
+static double rng_range(double lo, double hi);
+static int32_t rng_int(int32_t lo, int32_t hi);
+
+static int parse_int(const char *pstr, int32_t *pv);
+static int parse_double(const char *pstr, double *pv);
+static int parse_flag(const char *pstr, int *pv);
+static void params_default(PARAMS *pp);
+static int params_set(
+          PARAMS  * pp,
+    const char    * pKey,
+          char   ** ppArg,
+          int       argc,
+          long      line);
+static int params_read(const char *pPath, PARAMS *pp);
+
+static void layer(
+    SKVM_CTX      * pv,
+    int             a,
+    int             r,
+    int             g,
+    int             b,
+    int             shape,
+    const double  * pGeom);
+static void paint_sprite(SKVM_CTX *pv, int alpha);
+static void paint_mask(SKVM_CTX *pv);
+static void paint_background(SKVM_CTX *pv);
+static int store_image(
+          SKVM_CTX  * pv,
+    const char      * pDir,
+    const char      * pFile,
+          int         format);
+static int make_dir(const char *pDir, const char *pSub);
+
+static void plan(
+    const PARAMS  * pp,
+          IMAGE   * pImg,
+          SPRITE  * pSpr);
+static int write_assets(
+    const char    * pDir,
+    const PARAMS  * pp,
+    const IMAGE   * pImg);
+static void write_header(
+          FILE    * pf,
+    const PARAMS  * pp,
+    const IMAGE   * pImg);
+static void write_frame(
+          FILE    * pf,
+    const PARAMS  * pp,
+    const IMAGE   * pImg,
+    const SPRITE  * pSpr,
+          int32_t   f);
+static int write_scripts(
+    const char    * pDir,
+    const PARAMS  * pp,
+    const IMAGE   * pImg,
+    const SPRITE  * pSpr);
+static int generate(const char *pParamPath, const char *pDir);
+
+/*
+ * Get the next value of the pseudo-random generator.
+ * 
+ * This is the SplitMix64 generator, so that the same seed gives the
+ * same workload on every platform.
+ * 
+ * Return:
+ * 
+ *   the next 64-bit value
+ */
+static uint64_t rng_next(void) {
+
+  uint64_t z = 0;
+  
+  m_rng += UINT64_C(0x9e3779b97f4a7c15);
+  z = m_rng;
+  z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return z ^ (z >> 31);
+}
+
+/*
+ * Get a pseudo-random value in range [0.0, 1.0).
+ * 
+ * Return:
+ * 
+ *   the random value
+ */
+static double rng_unit(void) {
+  return ((double) (rng_next() >> 11)) / 9007199254740992.0;
+}
+
+/*
+ * Get a pseudo-random value in range [lo, hi).
+ * 
+ * Parameters:
+ * 
+ *   lo - the lower bound
+ * 
+ *   hi - the upper bound, which must not be less than lo
+ * 
+ * Return:
+ * 
+ *   the random value, which is lo if both bounds are equal
+ */
+static double rng_range(double lo, double hi) {
+
+  /* Check parameters */
+  if (!(hi >= lo)) {
+    abort();
+  }
+  
+  /* Get the value */
+  return lo + ((hi - lo) * rng_unit());
+}
+
+/*
+ * Get a pseudo-random integer in range [lo, hi].
+ * 
+ * Parameters:
+ * 
+ *   lo - the lower bound
+ * 
+ *   hi - the upper bound, which must not be less than lo
+ * 
+ * Return:
+ * 
+ *   the random integer
+ */
+static int32_t rng_int(int32_t lo, int32_t hi) {
+
+  /* Check parameters */
+  if (hi < lo) {
+    abort();
+  }
+  
+  /* Get the value */
+  return lo + (int32_t) (rng_next() %
+                          ((uint64_t) (((int64_t) hi) - lo + 1)));
+}
+
+/*
+ * Parse the given string as a signed decimal integer.
+ * 
+ * Parameters:
+ * 
+ *   pstr - the string to parse
+ * 
+ *   pv - receives the parsed value
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the string is not a valid integer
+ */
+static int parse_int(const char *pstr, int32_t *pv) {
+
+  int status = 1;
+  long v = 0;
+  char *endptr = NULL;
+  
+  /* Check parameters */
+  if ((pstr == NULL) || (pv == NULL)) {
+    abort();
+  }
+  
+  /* Parse the value */
+  errno = 0;
+  v = strtol(pstr, &endptr, 10);
+  if ((errno != 0) || (endptr == pstr) || (*endptr != 0)) {
+    status = 0;
+  }
+  if (status) {
+    if ((v < INT32_MIN) || (v > INT32_MAX)) {
+      status = 0;
+    }
+  }
+  
+  /* Return the value if successful */
+  if (status) {
+    *pv = (int32_t) v;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Parse the given string as a finite floating-point value.
+ * 
+ * Parameters:
+ * 
+ *   pstr - the string to parse
+ * 
+ *   pv - receives the parsed value
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the string is not a valid value
+ */
+static int parse_double(const char *pstr, double *pv) {
+
+  int status = 1;
+  double v = 0.0;
+  char *endptr = NULL;
+  
+  /* Check parameters */
+  if ((pstr == NULL) || (pv == NULL)) {
+    abort();
+  }
+  
+  /* Parse the value */
+  errno = 0;
+  v = strtod(pstr, &endptr);
+  if ((errno != 0) || (endptr == pstr) || (*endptr != 0)) {
+    status = 0;
+  }
+  if (status) {
+    if (!isfinite(v)) {
+      status = 0;
+    }
+  }
+  
+  /* Return the value if successful */
+  if (status) {
+    *pv = v;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Parse the given string as a flag that is either 0 or 1.
+ * 
+ * Parameters:
+ * 
+ *   pstr - the string to parse
+ * 
+ *   pv - receives the parsed flag
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the string is not a valid flag
+ */
+static int parse_flag(const char *pstr, int *pv) {
+
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pstr == NULL) || (pv == NULL)) {
+    abort();
+  }
+  
+  /* Parse the flag */
+  if (strcmp(pstr, "0") == 0) {
+    *pv = 0;
+  } else if (strcmp(pstr, "1") == 0) {
+    *pv = 1;
+  } else {
+    status = 0;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Set workload parameters to their defaults.
+ * 
+ * Parameters:
+ * 
+ *   pp - the parameters to initialize
+ */
+static void params_default(PARAMS *pp) {
+
+  /* Check parameters */
+  if (pp == NULL) {
+    abort();
+  }
+  
+  /* Set the defaults */
+  memset(pp, 0, sizeof(PARAMS));
+  strcpy(pp->name, "workload");
+  pp->seed = 1;
+  pp->canvas_w = 1920;
+  pp->canvas_h = 1080;
+  pp->frames = 1;
+  pp->sprites = 100;
+  pp->images = 8;
+  pp->size_min = 32;
+  pp->size_max = 128;
+  pp->scale_min = 1.0;
+  pp->scale_max = 1.0;
+  pp->rotate = 0.0;
+  pp->quarter = 0;
+  pp->spin = 0.0;
+  pp->motion = 0.0;
+  pp->alpha = 1;
+  pp->format = FMT_PNG;
+  pp->masks = 0.0;
+  pp->mask = MASK_SHAPE;
+  pp->background = FMT_NONE;
+  pp->accumulate = 0;
+  pp->output = FMT_PNG;
+  pp->threads = 0;
+  pp->pipeline = 0;
+  pp->split = 0;
+}
+
+/*
+ * Set a single workload parameter from a line of the parameter file.
+ * 
+ * Error messages are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pp - the parameters
+ * 
+ *   pKey - the parameter name
+ * 
+ *   ppArg - the values following the name
+ * 
+ *   argc - the number of values
+ * 
+ *   line - the line number, for error messages
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the parameter is not valid
+ */
+static int params_set(
+          PARAMS  * pp,
+    const char    * pKey,
+          char   ** ppArg,
+          int       argc,
+          long      line) {
+  
+  int status = 1;
+  int want = 1;
+  int32_t iv = 0;
+  const char *pc = NULL;
+  
+  /* Check parameters */
+  if ((pp == NULL) || (pKey == NULL) || (ppArg == NULL) ||
+      (argc < 0)) {
+    abort();
+  }
+  
+  /* Determine the number of values of the parameter */
+  if ((strcmp(pKey, "canvas") == 0) || (strcmp(pKey, "size") == 0) ||
+      (strcmp(pKey, "scale") == 0)) {
+    want = 2;
+  }
+  if (argc != want) {
+    fprintf(stderr, "%s: Line %ld: Wrong number of values!\n",
+      pModule, line);
+    return 0;
+  }
+  
+  /* Set the parameter */
+  if (strcmp(pKey, "name") == 0) {
+    if ((strlen(ppArg[0]) < 1) || (strlen(ppArg[0]) >= MAX_NAME)) {
+      status = 0;
+    }
+    for(pc = ppArg[0]; status && (*pc != 0); pc++) {
+      if (!(((*pc >= 'A') && (*pc <= 'Z')) ||
+            ((*pc >= 'a') && (*pc <= 'z')) ||
+            ((*pc >= '0') && (*pc <= '9')) ||
+            (*pc == '-') || (*pc == '_'))) {
+        status = 0;
+      }
+    }
+    if (status) {
+      strcpy(pp->name, ppArg[0]);
+    }
+  
+  } else if (strcmp(pKey, "seed") == 0) {
+    status = parse_int(ppArg[0], &iv);
+    if (status) {
+      pp->seed = (uint64_t) (int64_t) iv;
+    }
+  
+  } else if (strcmp(pKey, "canvas") == 0) {
+    if ((!parse_int(ppArg[0], &(pp->canvas_w))) ||
+        (!parse_int(ppArg[1], &(pp->canvas_h)))) {
+      status = 0;
+    } else if ((pp->canvas_w < 1) || (pp->canvas_w > SKVM_MAX_DIM) ||
+                (pp->canvas_h < 1) || (pp->canvas_h > SKVM_MAX_DIM)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "frames") == 0) {
+    if (!parse_int(ppArg[0], &(pp->frames))) {
+      status = 0;
+    } else if ((pp->frames < 1) || (pp->frames > MAX_FRAMES)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "sprites") == 0) {
+    if (!parse_int(ppArg[0], &(pp->sprites))) {
+      status = 0;
+    } else if ((pp->sprites < 1) || (pp->sprites > MAX_SPRITES)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "images") == 0) {
+    if (!parse_int(ppArg[0], &(pp->images))) {
+      status = 0;
+    } else if ((pp->images < 1) || (pp->images > MAX_IMAGES)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "size") == 0) {
+    if ((!parse_int(ppArg[0], &(pp->size_min))) ||
+        (!parse_int(ppArg[1], &(pp->size_max)))) {
+      status = 0;
+    } else if ((pp->size_min < 1) || (pp->size_max > MAX_SIZE) ||
+                (pp->size_min > pp->size_max)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "scale") == 0) {
+    if ((!parse_double(ppArg[0], &(pp->scale_min))) ||
+        (!parse_double(ppArg[1], &(pp->scale_max)))) {
+      status = 0;
+    } else if ((!(pp->scale_min > 0.0)) ||
+                (pp->scale_min > pp->scale_max) ||
+                (pp->scale_max > 1024.0)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "rotate") == 0) {
+    if (!parse_double(ppArg[0], &(pp->rotate))) {
+      status = 0;
+    } else if ((pp->rotate < 0.0) || (pp->rotate > 360.0)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "quarter") == 0) {
+    status = parse_flag(ppArg[0], &(pp->quarter));
+  
+  } else if (strcmp(pKey, "spin") == 0) {
+    if (!parse_double(ppArg[0], &(pp->spin))) {
+      status = 0;
+    } else if ((pp->spin < 0.0) || (pp->spin > 360.0)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "motion") == 0) {
+    if (!parse_double(ppArg[0], &(pp->motion))) {
+      status = 0;
+    } else if ((pp->motion < 0.0) || (pp->motion > SKVM_MAX_DIM)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "alpha") == 0) {
+    status = parse_flag(ppArg[0], &(pp->alpha));
+  
+  } else if (strcmp(pKey, "format") == 0) {
+    if (strcmp(ppArg[0], "png") == 0) {
+      pp->format = FMT_PNG;
+    } else if (strcmp(ppArg[0], "jpeg") == 0) {
+      pp->format = FMT_JPEG;
+    } else {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "masks") == 0) {
+    if (!parse_double(ppArg[0], &(pp->masks))) {
+      status = 0;
+    } else if ((pp->masks < 0.0) || (pp->masks > 1.0)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "mask") == 0) {
+    if (strcmp(ppArg[0], "shape") == 0) {
+      pp->mask = MASK_SHAPE;
+    } else if (strcmp(ppArg[0], "raster") == 0) {
+      pp->mask = MASK_RASTER;
+    } else if (strcmp(ppArg[0], "rle") == 0) {
+      pp->mask = MASK_RLE;
+    } else if (strcmp(ppArg[0], "mix") == 0) {
+      pp->mask = MASK_MIX;
+    } else {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "background") == 0) {
+    if (strcmp(ppArg[0], "fill") == 0) {
+      pp->background = FMT_NONE;
+    } else if (strcmp(ppArg[0], "png") == 0) {
+      pp->background = FMT_PNG;
+    } else if (strcmp(ppArg[0], "jpeg") == 0) {
+      pp->background = FMT_JPEG;
+    } else {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "accumulate") == 0) {
+    status = parse_flag(ppArg[0], &(pp->accumulate));
+  
+  } else if (strcmp(pKey, "output") == 0) {
+    if (strcmp(ppArg[0], "png") == 0) {
+      pp->output = FMT_PNG;
+    } else if (strcmp(ppArg[0], "jpeg") == 0) {
+      pp->output = FMT_JPEG;
+    } else if (strcmp(ppArg[0], "mjpg") == 0) {
+      pp->output = FMT_MJPG;
+    } else if (strcmp(ppArg[0], "none") == 0) {
+      pp->output = FMT_NONE;
+    } else {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "threads") == 0) {
+    if (!parse_int(ppArg[0], &(pp->threads))) {
+      status = 0;
+    } else if ((pp->threads < 0) || (pp->threads > SKVM_MAX_THREADS)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "pipeline") == 0) {
+    if (!parse_int(ppArg[0], &(pp->pipeline))) {
+      status = 0;
+    } else if ((pp->pipeline < 0) ||
+                (pp->pipeline > SKVM_MAX_PIPELINE)) {
+      status = 0;
+    }
+  
+  } else if (strcmp(pKey, "split") == 0) {
+    status = parse_flag(ppArg[0], &(pp->split));
+  
+  } else {
+    fprintf(stderr, "%s: Line %ld: Unknown parameter %s!\n",
+      pModule, line, pKey);
+    return 0;
+  }
+  
+  /* Report an invalid value */
+  if (!status) {
+    fprintf(stderr, "%s: Line %ld: Invalid value for %s!\n",
+      pModule, line, pKey);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Read a parameter file.
+ * 
+ * The parameters must already have been set to their defaults with
+ * params_default().  Error messages are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the parameter file
+ * 
+ *   pp - the parameters to update
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the file could not be read or
+ *   holds an invalid parameter
+ */
+static int params_read(const char *pPath, PARAMS *pp) {
+
+  static const char *keys[] = {
+    "name", "seed", "canvas", "frames", "sprites", "images", "size",
+    "scale", "rotate", "quarter", "spin", "motion", "alpha", "format",
+    "masks", "mask", "background", "accumulate", "output", "threads",
+    "pipeline", "split"
+  };
+  
+  int status = 1;
+  int argc = 0;
+  int k = 0;
+  long line = 0;
+  uint32_t seen = 0;
+  char *pTok = NULL;
+  char *pKey = NULL;
+  char *argv[4];
+  char buf[MAX_LINE];
+  FILE *pf = NULL;
+  
+  /* Initialize structures */
+  memset(argv, 0, sizeof(char *) * 4);
+  memset(buf, 0, MAX_LINE);
+  
+  /* Check parameters */
+  if ((pPath == NULL) || (pp == NULL)) {
+    abort();
+  }
+  
+  /* Open the parameter file */
+  pf = fopen(pPath, "r");
+  if (pf == NULL) {
+    status = 0;
+    fprintf(stderr, "%s: Failed to open parameter file!\n", pModule);
+  }
+  
+  /* Read each line */
+  while (status && (fgets(buf, MAX_LINE, pf) != NULL)) {
+    line++;
+    if ((strchr(buf, '\n') == NULL) && (!feof(pf))) {
+      status = 0;
+      fprintf(stderr, "%s: Line %ld: Line is too long!\n",
+        pModule, line);
+      break;
+    }
+    
+    /* Split the line into the name and values, skipping blank lines
+     * and comments */
+    pKey = strtok(buf, " \t\r\n");
+    if ((pKey == NULL) || (pKey[0] == '#')) {
+      continue;
+    }
+    argc = 0;
+    for(pTok = strtok(NULL, " \t\r\n"); pTok != NULL;
+        pTok = strtok(NULL, " \t\r\n")) {
+      if (argc >= 4) {
+        argc++;
+        break;
+      }
+      argv[argc] = pTok;
+      argc++;
+    }
+    
+    /* Make sure each parameter is only given once */
+    for(k = 0; k < (int) (sizeof(keys) / sizeof(keys[0])); k++) {
+      if (strcmp(pKey, keys[k]) == 0) {
+        if (seen & (UINT32_C(1) << k)) {
+          status = 0;
+          fprintf(stderr, "%s: Line %ld: Parameter %s given twice!\n",
+            pModule, line, pKey);
+        }
+        seen |= (UINT32_C(1) << k);
+        break;
+      }
+    }
+    
+    /* Set the parameter */
+    if (status) {
+      status = params_set(pp, pKey, argv, argc, line);
+    }
+  }
+  if (status && ferror(pf)) {
+    status = 0;
+    fprintf(stderr, "%s: Failed to read parameter file!\n", pModule);
+  }
+  
+  /* Split scripts may run in parallel, so they can not append to a
+   * shared M-JPEG stream */
+  if (status && pp->split && (pp->output == FMT_MJPG)) {
+    status = 0;
+    fprintf(stderr, "%s: Split workloads can not use mjpg output!\n",
+      pModule);
+  }
+  
+  /* JPEG sprite images have no alpha channel */
+  if (status && (pp->format == FMT_JPEG)) {
+    pp->alpha = 0;
+  }
+  
+  /* Close the file if open */
+  if (pf != NULL) {
+    fclose(pf);
+    pf = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Paint a single layer of solid color over the whole of GEN_IMG.
+ * 
+ * The color is composited over the image through the given shape mask.
+ * pGeom holds the shape_ fields x0 y0 x1 y1 r f of the sampling
+ * parameters.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   a - the alpha channel of the color
+ * 
+ *   r - the red channel of the color
+ * 
+ *   g - the green channel of the color
+ * 
+ *   b - the blue channel of the color
+ * 
+ *   shape - one of the SKVM_SHAPE_ constants other than
+ *   SKVM_SHAPE_NONE
+ * 
+ *   pGeom - the six shape coordinates
+ */
+static void layer(
+    SKVM_CTX      * pv,
+    int             a,
+    int             r,
+    int             g,
+    int             b,
+    int             shape,
+    const double  * pGeom) {
+  
+  SKVM_SAMPLE_PARAM sp;
+  int32_t w = 0;
+  int32_t h = 0;
+  
+  /* Initialize structures */
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  
+  /* Check parameters */
+  if ((pv == NULL) || (shape == SKVM_SHAPE_NONE) || (pGeom == NULL)) {
+    abort();
+  }
+  
+  /* Set the color of the single-pixel layer source */
+  skvm_reset(pv, GEN_DOT, 1, 1, 4);
+  skvm_load_fill(pv, GEN_DOT, a, r, g, b);
+  
+  /* Stretch the layer source over the whole image */
+  skvm_get_dim(pv, GEN_IMG, &w, &h);
+  skvm_matrix_reset(pv, GEN_MLAYER);
+  skvm_matrix_scale(pv, GEN_MLAYER, (double) w, (double) h);
+  
+  /* Composite the layer */
+  sp.src_buf = GEN_DOT;
+  sp.target_buf = GEN_IMG;
+  sp.t_matrix = GEN_MLAYER;
+  sp.sample_alg = SKVM_ALG_NEAREST;
+  sp.blend = SKVM_BLEND_OVER;
+  sp.flags = SKVM_FLAG_PROCMASK | SKVM_FLAG_LEFTMODE |
+              SKVM_FLAG_ABOVEMODE;
+  sp.mask_shape = shape;
+  sp.shape_x0 = pGeom[0];
+  sp.shape_y0 = pGeom[1];
+  sp.shape_x1 = pGeom[2];
+  sp.shape_y1 = pGeom[3];
+  sp.shape_r = pGeom[4];
+  sp.shape_f = pGeom[5];
+  skvm_sample(pv, &sp);
+}
+
+/*
+ * Paint a random sprite image over the whole of GEN_IMG.
+ * 
+ * GEN_IMG must already have been reset to ARGB with the size of the
+ * sprite.  The sprite is a rounded body with a gradient and a few
+ * spots.  If alpha is non-zero, everything outside the body is
+ * transparent and the body has a soft edge, else the body is drawn
+ * on an opaque background.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   alpha - non-zero for a translucent sprite
+ */
+static void paint_sprite(SKVM_CTX *pv, int alpha) {
+
+  int32_t w = 0;
+  int32_t h = 0;
+  int32_t k = 0;
+  int32_t spots = 0;
+  double fw = 0.0;
+  double fh = 0.0;
+  double d = 0.0;
+  double geom[6];
+  
+  /* Initialize structures */
+  memset(geom, 0, sizeof(double) * 6);
+  
+  /* Check parameters */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Get the dimensions */
+  skvm_get_dim(pv, GEN_IMG, &w, &h);
+  fw = (double) w;
+  fh = (double) h;
+  
+  /* Background */
+  if (alpha) {
+    skvm_load_fill(pv, GEN_IMG, 0, 0, 0, 0);
+  } else {
+    skvm_load_fill(pv, GEN_IMG, 255,
+      rng_int(0, 255), rng_int(0, 255), rng_int(0, 255));
+  }
+  
+  /* Body */
+  geom[0] = 0.0;
+  geom[1] = 0.0;
+  geom[2] = fw;
+  geom[3] = fh;
+  geom[4] = rng_range(0.0, 0.5) * ((fw < fh) ? fw : fh);
+  geom[5] = alpha ? rng_range(0.0, 0.2) * ((fw < fh) ? fw : fh) : 0.0;
+  layer(pv, 255, rng_int(0, 255), rng_int(0, 255), rng_int(0, 255),
+        SKVM_SHAPE_RRECT, geom);
+  
+  /* Gradient across the body */
+  geom[0] = rng_range(0.0, fw);
+  geom[1] = rng_range(0.0, fh);
+  geom[2] = rng_range(0.0, fw);
+  geom[3] = rng_range(0.0, fh);
+  if ((geom[0] == geom[2]) && (geom[1] == geom[3])) {
+    geom[2] = geom[0] + 1.0;
+  }
+  layer(pv, rng_int(64, 192),
+        rng_int(0, 255), rng_int(0, 255), rng_int(0, 255),
+        SKVM_SHAPE_LINEAR, geom);
+  
+  /* Spots */
+  spots = rng_int(1, 4);
+  for(k = 0; k < spots; k++) {
+    d = rng_range(0.1, 0.4) * ((fw < fh) ? fw : fh);
+    geom[0] = rng_range(d, fw - d);
+    geom[1] = rng_range(d, fh - d);
+    geom[2] = 0.0;
+    geom[3] = 0.0;
+    geom[4] = d * 0.5;
+    geom[5] = d * 0.5;
+    layer(pv, rng_int(128, 255),
+          rng_int(0, 255), rng_int(0, 255), rng_int(0, 255),
+          SKVM_SHAPE_RADIAL, geom);
+  }
+}
+
+/*
+ * Paint a random mask image over the whole of GEN_IMG.
+ * 
+ * GEN_IMG must already have been reset to grayscale with the size of
+ * the mask.  The mask is a feathered ellipse with a hole, so that it
+ * has full black and full white areas as well as edges.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ */
+static void paint_mask(SKVM_CTX *pv) {
+
+  int32_t w = 0;
+  int32_t h = 0;
+  double fw = 0.0;
+  double fh = 0.0;
+  double geom[6];
+  
+  /* Initialize structures */
+  memset(geom, 0, sizeof(double) * 6);
+  
+  /* Check parameters */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Get the dimensions */
+  skvm_get_dim(pv, GEN_IMG, &w, &h);
+  fw = (double) w;
+  fh = (double) h;
+  
+  /* Ellipse */
+  skvm_load_fill(pv, GEN_IMG, 255, 0, 0, 0);
+  geom[0] = 0.0;
+  geom[1] = 0.0;
+  geom[2] = fw;
+  geom[3] = fh;
+  geom[5] = rng_range(1.0, 0.25 * ((fw < fh) ? fw : fh) + 1.0);
+  layer(pv, 255, 255, 255, 255, SKVM_SHAPE_ELLIPSE, geom);
+  
+  /* Hole */
+  geom[0] = rng_range(0.2, 0.4) * fw;
+  geom[1] = rng_range(0.2, 0.4) * fh;
+  geom[2] = geom[0] + (0.2 * fw) + 1.0;
+  geom[3] = geom[1] + (0.2 * fh) + 1.0;
+  geom[5] = 1.0;
+  layer(pv, 255, 0, 0, 0, SKVM_SHAPE_RECT, geom);
+}
+
+/*
+ * Paint a background image over the whole of GEN_IMG.
+ * 
+ * GEN_IMG must already have been reset to ARGB.  The background is an
+ * opaque gradient with a few large soft glows.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ */
+static void paint_background(SKVM_CTX *pv) {
+
+  int32_t w = 0;
+  int32_t h = 0;
+  int32_t k = 0;
+  double fw = 0.0;
+  double fh = 0.0;
+  double geom[6];
+  
+  /* Initialize structures */
+  memset(geom, 0, sizeof(double) * 6);
+  
+  /* Check parameters */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Get the dimensions */
+  skvm_get_dim(pv, GEN_IMG, &w, &h);
+  fw = (double) w;
+  fh = (double) h;
+  
+  /* Gradient */
+  skvm_load_fill(pv, GEN_IMG, 255,
+    rng_int(0, 128), rng_int(0, 128), rng_int(0, 128));
+  geom[0] = 0.0;
+  geom[1] = 0.0;
+  geom[2] = fw;
+  geom[3] = fh;
+  layer(pv, 255, rng_int(0, 255), rng_int(0, 255), rng_int(0, 255),
+        SKVM_SHAPE_LINEAR, geom);
+  
+  /* Glows */
+  for(k = 0; k < 3; k++) {
+    geom[0] = rng_range(0.0, fw);
+    geom[1] = rng_range(0.0, fh);
+    geom[4] = rng_range(0.0, 0.1) * fw;
+    geom[5] = rng_range(0.1, 0.3) * fw + 1.0;
+    layer(pv, rng_int(64, 160),
+          rng_int(0, 255), rng_int(0, 255), rng_int(0, 255),
+          SKVM_SHAPE_RADIAL, geom);
+  }
+}
+
+/*
+ * Store GEN_IMG as an image file in a directory.
+ * 
+ * Error messages are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   pDir - the directory
+ * 
+ *   pFile - the file name within the directory
+ * 
+ *   format - FMT_PNG or FMT_JPEG
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the file could not be written
+ */
+static int store_image(
+          SKVM_CTX  * pv,
+    const char      * pDir,
+    const char      * pFile,
+          int         format) {
+  
+  int status = 1;
+  char path[MAX_PATH];
+  
+  /* Initialize structures */
+  memset(path, 0, MAX_PATH);
+  
+  /* Check parameters */
+  if ((pv == NULL) || (pDir == NULL) || (pFile == NULL)) {
+    abort();
+  }
+  
+  /* Build the path */
+  if (snprintf(path, MAX_PATH, "%s/%s", pDir, pFile) >= MAX_PATH) {
+    status = 0;
+    fprintf(stderr, "%s: Directory path is too long!\n", pModule);
+  }
+  
+  /* Store the image */
+  if (status) {
+    if (format == FMT_PNG) {
+      status = skvm_store_png(pv, GEN_IMG, path);
+    } else if (format == FMT_JPEG) {
+      status = skvm_store_jpeg(pv, GEN_IMG, path, 0, JPEG_QUALITY);
+    } else {
+      abort();
+    }
+    if (!status) {
+      fprintf(stderr, "%s: Failed to store %s: %s!\n",
+        pModule, path, skvm_reason(pv));
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Create a directory, or a subdirectory within it, unless it already
+ * exists.
+ * 
+ * Error messages are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the directory
+ * 
+ *   pSub - the subdirectory to create within it, or NULL to create the
+ *   directory itself
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the directory could not be created
+ */
+static int make_dir(const char *pDir, const char *pSub) {
+
+  int status = 1;
+  char path[MAX_PATH];
+  
+  /* Initialize structures */
+  memset(path, 0, MAX_PATH);
+  
+  /* Check parameters */
+  if (pDir == NULL) {
+    abort();
+  }
+  
+  /* Build the path */
+  if (pSub != NULL) {
+    if (snprintf(path, MAX_PATH, "%s/%s", pDir, pSub) >= MAX_PATH) {
+      status = 0;
+      fprintf(stderr, "%s: Directory path is too long!\n", pModule);
+    }
+  } else {
+    if (snprintf(path, MAX_PATH, "%s", pDir) >= MAX_PATH) {
+      status = 0;
+      fprintf(stderr, "%s: Directory path is too long!\n", pModule);
+    }
+  }
+  
+  /* Create the directory */
+  if (status) {
+    if (mkdir(path, 0777)) {
+      if (errno != EEXIST) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to create directory %s!\n",
+          pModule, path);
+      }
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Choose the sprite images and the sprites of a workload.
+ * 
+ * The pseudo-random generator must have been seeded.
+ * 
+ * Parameters:
+ * 
+ *   pp - the parameters
+ * 
+ *   pImg - the array of pp->images images to fill in
+ * 
+ *   pSpr - the array of pp->sprites sprites to fill in
+ */
+static void plan(
+    const PARAMS  * pp,
+          IMAGE   * pImg,
+          SPRITE  * pSpr) {
+  
+  int32_t i = 0;
+  double a = 0.0;
+  double d = 0.0;
+  SPRITE *ps = NULL;
+  
+  /* Check parameters */
+  if ((pp == NULL) || (pImg == NULL) || (pSpr == NULL)) {
+    abort();
+  }
+  
+  /* Choose the image sizes */
+  for(i = 0; i < pp->images; i++) {
+    pImg[i].w = rng_int(pp->size_min, pp->size_max);
+    pImg[i].h = rng_int(pp->size_min, pp->size_max);
+  }
+  
+  /* Choose the sprites */
+  for(i = 0; i < pp->sprites; i++) {
+    ps = &(pSpr[i]);
+    ps->image = rng_int(0, pp->images - 1);
+    
+    ps->x = rng_range(0.0, (double) pp->canvas_w);
+    ps->y = rng_range(0.0, (double) pp->canvas_h);
+    a = rng_range(0.0, 2.0 * M_PI);
+    d = rng_range(0.0, pp->motion);
+    ps->dx = d * cos(a);
+    ps->dy = d * sin(a);
+    
+    if (pp->quarter) {
+      ps->rot = 90.0 * ((double) rng_int(0, 3));
+      ps->drot = 90.0 * floor(rng_range(0.0, pp->spin / 90.0 + 1.0));
+      if (pp->rotate == 0.0) {
+        ps->rot = 0.0;
+      }
+    } else {
+      ps->rot = rng_range(-pp->rotate, pp->rotate);
+      ps->drot = rng_range(-pp->spin, pp->spin);
+    }
+    
+    ps->scale = rng_range(pp->scale_min, pp->scale_max);
+    
+    ps->mask = MASK_NONE;
+    if (rng_unit() < pp->masks) {
+      if (pp->mask == MASK_MIX) {
+        ps->mask = rng_int(MASK_SHAPE, MASK_RLE);
+      } else {
+        ps->mask = pp->mask;
+      }
+    }
+    if (ps->mask == MASK_RASTER) {
+      pImg[ps->image].raster = 1;
+    } else if (ps->mask == MASK_RLE) {
+      pImg[ps->image].rle = 1;
+    }
+  }
+}
+
+/*
+ * Paint and store the images of a workload.
+ * 
+ * The pseudo-random generator continues from plan().  Error messages
+ * are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the workload directory
+ * 
+ *   pp - the parameters
+ * 
+ *   pImg - the images
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if an image could not be stored
+ */
+static int write_assets(
+    const char    * pDir,
+    const PARAMS  * pp,
+    const IMAGE   * pImg) {
+  
+  int status = 1;
+  int32_t i = 0;
+  char file[MAX_NAME];
+  SKVM_CTX *pv = NULL;
+  
+  /* Initialize structures */
+  memset(file, 0, MAX_NAME);
+  
+  /* Check parameters */
+  if ((pDir == NULL) || (pp == NULL) || (pImg == NULL)) {
+    abort();
+  }
+  
+  /* Allocate a context */
+  pv = skvm_alloc(GEN_COUNT, GEN_MCOUNT);
+  
+  /* Sprite images and their masks */
+  for(i = 0; status && (i < pp->images); i++) {
+    skvm_reset(pv, GEN_IMG, pImg[i].w, pImg[i].h, 4);
+    paint_sprite(pv, pp->alpha);
+    if (pp->format == FMT_PNG) {
+      sprintf(file, "assets/sprite-%04ld.png", (long) i);
+    } else {
+      sprintf(file, "assets/sprite-%04ld.jpg", (long) i);
+    }
+    status = store_image(pv, pDir, file, pp->format);
+    
+    if (status && (pImg[i].raster || pImg[i].rle)) {
+      skvm_reset(pv, GEN_IMG, pImg[i].w, pImg[i].h, 1);
+      paint_mask(pv);
+      sprintf(file, "assets/mask-%04ld.png", (long) i);
+      status = store_image(pv, pDir, file, FMT_PNG);
+    }
+  }
+  
+  /* Background image */
+  if (status && (pp->background != FMT_NONE)) {
+    skvm_reset(pv, GEN_IMG, pp->canvas_w, pp->canvas_h, 4);
+    paint_background(pv);
+    if (pp->background == FMT_PNG) {
+      status = store_image(pv, pDir, "assets/background.png", FMT_PNG);
+    } else {
+      status = store_image(pv, pDir, "assets/background.jpg", FMT_JPEG);
+    }
+  }
+  
+  /* Free the context */
+  skvm_free(pv);
+  pv = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Write the header of a script and the operations that load its
+ * images.
+ * 
+ * Sprite image i is loaded into register REG_FIRST + i, its raster
+ * mask into REG_FIRST + images + i, and its compressed mask into
+ * REG_FIRST + 2 * images + i, where masks are only loaded if a sprite
+ * uses them.
+ * 
+ * Parameters:
+ * 
+ *   pf - the script file
+ * 
+ *   pp - the parameters
+ * 
+ *   pImg - the images
+ */
+static void write_header(
+          FILE    * pf,
+    const PARAMS  * pp,
+    const IMAGE   * pImg) {
+  
+  int32_t i = 0;
+  int32_t reg = 0;
+  const char *pExt = NULL;
+  
+  /* Check parameters */
+  if ((pf == NULL) || (pp == NULL) || (pImg == NULL)) {
+    abort();
+  }
+  
+  /* Header */
+  fprintf(pf, "%%sparkle;\n");
+  fprintf(pf, "%%bufcount %ld;\n",
+    (long) (REG_FIRST + (3 * pp->images)));
+  fprintf(pf, "%%matcount 1;\n");
+  if (pp->threads > 0) {
+    fprintf(pf, "%%threads %ld;\n", (long) pp->threads);
+  }
+  if (pp->pipeline > 0) {
+    fprintf(pf, "%%pipeline %ld;\n", (long) pp->pipeline);
+  }
+  
+  /* Sprite images and masks */
+  pExt = (pp->format == FMT_PNG) ? "png" : "jpg";
+  for(i = 0; i < pp->images; i++) {
+    reg = REG_FIRST + i;
+    fprintf(pf, "%ld %ld %ld %d reset\n",
+      (long) reg, (long) pImg[i].w, (long) pImg[i].h,
+      pp->alpha ? 4 : 3);
+    fprintf(pf, "%ld \"assets/sprite-%04ld.%s\" %s\n",
+      (long) reg, (long) i, pExt,
+      (pp->format == FMT_PNG) ? "load_png" : "load_jpeg");
+    
+    if (pImg[i].raster) {
+      reg = REG_FIRST + pp->images + i;
+      fprintf(pf, "%ld %ld %ld 1 reset\n",
+        (long) reg, (long) pImg[i].w, (long) pImg[i].h);
+      fprintf(pf, "%ld \"assets/mask-%04ld.png\" load_png\n",
+        (long) reg, (long) i);
+    }
+    if (pImg[i].rle) {
+      reg = REG_FIRST + (2 * pp->images) + i;
+      fprintf(pf, "%ld %ld %ld 1 reset\n",
+        (long) reg, (long) pImg[i].w, (long) pImg[i].h);
+      fprintf(pf, "%ld \"assets/mask-%04ld.png\" load_mask\n",
+        (long) reg, (long) i);
+    }
+  }
+  
+  /* Background image */
+  if (pp->background != FMT_NONE) {
+    fprintf(pf, "%d %ld %ld 3 reset\n",
+      REG_BACK, (long) pp->canvas_w, (long) pp->canvas_h);
+    if (pp->background == FMT_PNG) {
+      fprintf(pf, "%d \"assets/background.png\" load_png\n", REG_BACK);
+    } else {
+      fprintf(pf, "%d \"assets/background.jpg\" load_jpeg\n",
+        REG_BACK);
+    }
+  }
+  
+  /* Canvas and sampling state */
+  if (pp->accumulate) {
+    fprintf(pf, "%d %ld %ld reset_float\n",
+      REG_CANVAS, (long) pp->canvas_w, (long) pp->canvas_h);
+  } else {
+    fprintf(pf, "%d %ld %ld 3 reset\n",
+      REG_CANVAS, (long) pp->canvas_w, (long) pp->canvas_h);
+  }
+  fprintf(pf, "%d sample_target\n", REG_CANVAS);
+  fprintf(pf, "0 sample_matrix\n");
+  fprintf(pf, "sample_nearest\n");
+}
+
+/*
+ * Write the operations that render and store one frame.
+ * 
+ * Parameters:
+ * 
+ *   pf - the script file
+ * 
+ *   pp - the parameters
+ * 
+ *   pImg - the images
+ * 
+ *   pSpr - the sprites
+ * 
+ *   f - the frame index
+ */
+static void write_frame(
+          FILE    * pf,
+    const PARAMS  * pp,
+    const IMAGE   * pImg,
+    const SPRITE  * pSpr,
+          int32_t   f) {
+  
+  int32_t i = 0;
+  int32_t src = -1;
+  int masked = 0;
+  double x = 0.0;
+  double y = 0.0;
+  double rot = 0.0;
+  double hw = 0.0;
+  double hh = 0.0;
+  const SPRITE *ps = NULL;
+  const IMAGE *pi = NULL;
+  
+  /* Check parameters */
+  if ((pf == NULL) || (pp == NULL) || (pImg == NULL) ||
+      (pSpr == NULL) || (f < 0)) {
+    abort();
+  }
+  
+  /* Start the frame with the background */
+  if (pp->background == FMT_NONE) {
+    fprintf(pf, "%d 255 32 40 56 fill\n", REG_CANVAS);
+  } else {
+    fprintf(pf, "%d 255 0 0 0 fill\n", REG_CANVAS);
+    fprintf(pf, "%d sample_source\n", REG_BACK);
+    fprintf(pf, "0 identity\n");
+    fprintf(pf, "sample_blend_src\nsample\nsample_blend_over\n");
+  }
+  
+  /* Draw the sprites */
+  for(i = 0; i < pp->sprites; i++) {
+    ps = &(pSpr[i]);
+    pi = &(pImg[ps->image]);
+    
+    /* Animate the sprite, wrapping it around the canvas */
+    x = fmod(ps->x + (ps->dx * f), (double) pp->canvas_w);
+    if (x < 0.0) {
+      x += (double) pp->canvas_w;
+    }
+    y = fmod(ps->y + (ps->dy * f), (double) pp->canvas_h);
+    if (y < 0.0) {
+      y += (double) pp->canvas_h;
+    }
+    rot = fmod(ps->rot + (ps->drot * f), 360.0);
+    
+    /* Select the source if it changed */
+    if (ps->image != src) {
+      fprintf(pf, "%ld sample_source\n", (long) (REG_FIRST + ps->image));
+      src = ps->image;
+    }
+    
+    /* Set the mask, where shape masks are inscribed in the scaled
+     * sprite and raster masks are centered on it, neither of them
+     * rotated */
+    if (masked) {
+      fprintf(pf, "sample_mask_none\n");
+      masked = 0;
+    }
+    if (ps->mask == MASK_SHAPE) {
+      hw = 0.5 * ps->scale * ((double) pi->w);
+      hh = 0.5 * ps->scale * ((double) pi->h);
+      fprintf(pf, "%.3f %.3f %.3f %.3f %.3f sample_mask_ellipse\n",
+        x - hw, y - hh, x + hw, y + hh,
+        0.25 * ((hw < hh) ? hw : hh));
+      masked = 1;
+    
+    } else if ((ps->mask == MASK_RASTER) || (ps->mask == MASK_RLE)) {
+      if (ps->mask == MASK_RASTER) {
+        fprintf(pf, "%ld sample_mask_raster\n",
+          (long) (REG_FIRST + pp->images + ps->image));
+      } else {
+        fprintf(pf, "%ld sample_mask_raster\n",
+          (long) (REG_FIRST + (2 * pp->images) + ps->image));
+      }
+      fprintf(pf, "%ld %ld sample_mask_offset\n",
+        (long) floor(x - (0.5 * pi->w)),
+        (long) floor(y - (0.5 * pi->h)));
+      masked = 1;
+    }
+    
+    /* Set the transform and draw */
+    fprintf(pf, "0 identity\n");
+    fprintf(pf, "0 %.1f %.1f translate\n",
+      -0.5 * ((double) pi->w), -0.5 * ((double) pi->h));
+    if (ps->scale != 1.0) {
+      fprintf(pf, "0 %.6f %.6f scale\n", ps->scale, ps->scale);
+    }
+    if (rot != 0.0) {
+      fprintf(pf, "0 %.6f rotate\n", rot);
+    }
+    fprintf(pf, "0 %.3f %.3f translate\n", x, y);
+    fprintf(pf, "sample\n");
+  }
+  if (masked) {
+    fprintf(pf, "sample_mask_none\n");
+  }
+  
+  /* Store the frame */
+  if (pp->output == FMT_PNG) {
+    fprintf(pf, "%d \"frames/%s-%05ld.png\" store_png\n",
+      REG_CANVAS, pp->name, (long) f);
+  } else if (pp->output == FMT_JPEG) {
+    fprintf(pf, "%d \"frames/%s-%05ld.jpg\" %d store_jpeg\n",
+      REG_CANVAS, pp->name, (long) f, JPEG_QUALITY);
+  } else if (pp->output == FMT_MJPG) {
+    fprintf(pf, "%d \"frames/%s.mjpg\" %d store_mjpg\n",
+      REG_CANVAS, pp->name, JPEG_QUALITY);
+  }
+}
+
+/*
+ * Write the scripts of a workload.
+ * 
+ * Error messages are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the workload directory
+ * 
+ *   pp - the parameters
+ * 
+ *   pImg - the images
+ * 
+ *   pSpr - the sprites
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if a script could not be written
+ */
+static int write_scripts(
+    const char    * pDir,
+    const PARAMS  * pp,
+    const IMAGE   * pImg,
+    const SPRITE  * pSpr) {
+  
+  int status = 1;
+  int32_t f = 0;
+  char path[MAX_PATH];
+  FILE *pf = NULL;
+  FILE *pList = NULL;
+  
+  /* Initialize structures */
+  memset(path, 0, MAX_PATH);
+  
+  /* Check parameters */
+  if ((pDir == NULL) || (pp == NULL) || (pImg == NULL) ||
+      (pSpr == NULL)) {
+    abort();
+  }
+  
+  /* Open the batch list if split */
+  if (pp->split) {
+    if (snprintf(path, MAX_PATH, "%s/%s.list", pDir, pp->name) >=
+          MAX_PATH) {
+      status = 0;
+      fprintf(stderr, "%s: Directory path is too long!\n", pModule);
+    }
+    if (status) {
+      pList = fopen(path, "w");
+      if (pList == NULL) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to create %s!\n", pModule, path);
+      }
+    }
+  }
+  
+  /* Write each frame, opening a new script for each frame if split
+   * and else a single script for the first frame */
+  for(f = 0; status && (f < pp->frames); f++) {
+    if (pp->split || (f == 0)) {
+      if (pp->split) {
+        if (snprintf(path, MAX_PATH, "%s/%s-%05ld.sparkle",
+              pDir, pp->name, (long) f) >= MAX_PATH) {
+          status = 0;
+        }
+        if (status) {
+          fprintf(pList, "%s-%05ld.sparkle\n", pp->name, (long) f);
+        }
+      } else {
+        if (snprintf(path, MAX_PATH, "%s/%s.sparkle",
+              pDir, pp->name) >= MAX_PATH) {
+          status = 0;
+        }
+      }
+      if (!status) {
+        fprintf(stderr, "%s: Directory path is too long!\n", pModule);
+        break;
+      }
+      
+      pf = fopen(path, "w");
+      if (pf == NULL) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to create %s!\n", pModule, path);
+        break;
+      }
+      write_header(pf, pp, pImg);
+    }
+    
+    write_frame(pf, pp, pImg, pSpr, f);
+    
+    if (pp->split || (f == pp->frames - 1)) {
+      fprintf(pf, "|;\n");
+      if (fclose(pf)) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to write %s!\n", pModule, path);
+      }
+      pf = NULL;
+    }
+  }
+  
+  /* Close any files left open */
+  if (pf != NULL) {
+    fclose(pf);
+    pf = NULL;
+  }
+  if (pList != NULL) {
+    if (fclose(pList)) {
+      if (status) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to write batch list!\n", pModule);
+      }
+    }
+    pList = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Generate a workload.
+ * 
+ * Parameters:
+ * 
+ *   pParamPath - the path to the parameter file
+ * 
+ *   pDir - the workload directory
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int generate(const char *pParamPath, const char *pDir) {
+
+  int status = 1;
+  PARAMS par;
+  IMAGE *pImg = NULL;
+  SPRITE *pSpr = NULL;
+  
+  /* Check parameters */
+  if ((pParamPath == NULL) || (pDir == NULL)) {
+    abort();
+  }
+  
+  /* Read the parameters */
+  params_default(&par);
+  status = params_read(pParamPath, &par);
+  
+  /* Create the directories */
+  if (status) {
+    if ((!make_dir(pDir, NULL)) || (!make_dir(pDir, "assets")) ||
+        (!make_dir(pDir, "frames"))) {
+      status = 0;
+    }
+  }
+  
+  /* Plan the workload */
+  if (status) {
+    pImg = (IMAGE *) calloc((size_t) par.images, sizeof(IMAGE));
+    pSpr = (SPRITE *) calloc((size_t) par.sprites, sizeof(SPRITE));
+    if ((pImg == NULL) || (pSpr == NULL)) {
+      abort();
+    }
+    
+    m_rng = par.seed;
+    plan(&par, pImg, pSpr);
+  }
+  
+  /* Write the images and scripts */
+  if (status) {
+    status = write_assets(pDir, &par, pImg);
+  }
+  if (status) {
+    status = write_scripts(pDir, &par, pImg, pSpr);
+  }
+  
+  /* Report the workload */
+  if (status) {
+    fprintf(stderr,
+      "%s: %s: %ld frames of %ld sprites from %ld images on %ldx%ld\n",
+      pModule, par.name, (long) par.frames, (long) par.sprites,
+      (long) par.images, (long) par.canvas_w, (long) par.canvas_h);
+  }
+  
+  /* Free the plan */
+  if (pImg != NULL) {
+    free(pImg);
+    pImg = NULL;
+  }
+  if (pSpr != NULL) {
+    free(pSpr);
+    pSpr = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Program entrypoint
+ * ==================
+ */
+
+int main(int argc, char *argv[]) {
+
+  int status = 1;
+  
+  /* Set module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "skgen";
+  }
+  
+  /* Check arguments */
+  if (argc != 3) {
+    status = 0;
+    fprintf(stderr, "%s: Expecting a parameter file and directory!\n",
+      pModule);
+  }
+  
+  /* Generate the workload */
+  if (status) {
+    status = generate(argv[1], argv[2]);
+  }
+  
+  /* Invert status and return */
+  if (status) {
+    status = 0;
+  } else {
+    status = 1;
+  }
+  return status;
+}
@@ -0,0 +1,1900 @@
+/*
+ * skconform.c
+ * ===========
+ * 
+ * Conformance checks of the sampling kernels of the skvm module.
+ * 
+ * Syntax:
+ * 
+ *   skconform [options]
+ * 
+ * Renders a fixed corpus of sampling operations with skvm_sample() and
+ * checks that the fast paths of skvm render the same images as its
+ * reference renderer (see skvm_reference) and as a directory of golden
+ * images.  A line for each failing
+ * case and a summary are written to standard error.  The exit status
+ * is zero only if every case passed, so the program can gate changes
+ * to the kernels.  Everything the cases sample is painted by the
+ * program itself, so no input files or network access are needed.
+ * 
+ * The options are:
+ * 
+ *   -g [dir] compares every case with the golden image [name].png in
+ *   the given directory, where [name] is the case name with each "/"
+ *   replaced by "_", which defaults to the conform/golden directory of
+ *   the repository so that the program is run from the repository root
+ * 
+ *   -nogold only compares with the reference renderer, without any
+ *   golden images
+ * 
+ *   -bless writes the reference rendering of every case into the
+ *   golden directory instead of comparing with it, which is how the
+ *   golden images are made in the first place
+ * 
+ *   -o [path] writes a line of JSON for every case to the given file,
+ *   with the case name, whether it passed, and the mse, psnr, ssim,
+ *   and maxerr of each comparison as reported by skvm_compare(), where
+ *   psnr is null for identical images
+ * 
+ *   -t [n] sets the number of threads of the fast paths with
+ *   skvm_threads(), where the default of zero selects the skvm default;
+ *   the reference renderer always runs on a single thread
+ * 
+ *   -f [text] only runs cases whose names contain the given text
+ * 
+ *   -e [n] sets the largest absolute difference allowed in any channel
+ *   of any pixel, in range [0, 255], which defaults to 2
+ * 
+ *   -p [db] sets the lowest PSNR in decibels allowed, which defaults
+ *   to 50
+ * 
+ * A case passes if the fast rendering is within both thresholds of the
+ * reference rendering, and also of the golden image unless -nogold is
+ * given.
+ * 
+ * The cases are named [xform]/[src]-[target]/[variant].  The source is
+ * a 157x131 image and the target is 301x263, so that sampling crosses
+ * the tile boundaries of skvm.  The transforms are identity, translate
+ * (by whole pixels), subpixel (translation by fractions of a pixel),
+ * scale (up by 1.7), shrink (down by 0.6), rotate (by 30 degrees),
+ * turn90, turn180, turn270 (quarter turns), flipx, and flipy, all
+ * about the center of the target.  The channel counts of the source
+ * and target are 1, 3, or 4, or f for a float target.
+ * 
+ * Every channel combination is rendered with the plain variant, which
+ * is an unmasked OVER blend.  Every other variant is rendered with an
+ * ARGB source into both an ARGB and a float target.  The variants
+ * cover all the sampling flags, mask kinds, and blend modes:
+ * 
+ *   proc-la and proc-rb are boundary lines in left/above and
+ *   right/below mode
+ * 
+ *   rect, ellipse, rrect, linear, and radial are shape masks, and
+ *   invert is an inverted ellipse on top of boundary lines
+ * 
+ *   raster, raster-argb, and rle are grayscale, ARGB, and compressed
+ *   raster masks covering the target, and raster-ofs and rle-ofs are
+ *   smaller grayscale and compressed masks at an offset, partly
+ *   outside the target
+ * 
+ *   add, multiply, screen, src, dstin, and dstout are the blend modes
+ * 
+ *   subarea samples a subarea of the source
+ * 
+ *   lut, cmat, and lut-cmat apply a sticky lookup table and/or color
+ *   matrix to sampled pixels
+ * 
+ * The store/alpha case composites translucent colors over a transparent
+ * ARGB target with both renderers, and checks that the alpha channel
+ * of the stored result is exactly the alpha of the color.  The
+ * paths/src case copies a translucent ARGB source with arbitrary
+ * channel bytes into a transparent ARGB target with the SRC blend,
+ * through the exact kernel (identity), the general kernel (a
+ * translation up and left by a quarter pixel, which samples the same
+ * source pixels), and the reference renderer, and checks that all
+ * three are identical to each other.  The store/round case composites
+ * many faint layers into grayscale, RGB, ARGB, and float targets, and
+ * checks that the 8-bit targets stay within one step of each other and
+ * within two steps of the float target, so that every 8-bit store
+ * rounds the same way.  Exact cases like these ignore the thresholds.
+ * 
+ * Targets start out as a translucent painted background, so that
+ * blending with target alpha is covered too.  Only nearest neighbor
+ * sampling is covered, because skvm does not implement the other
+ * algorithms yet.
+ * 
+ * The golden images in conform/golden were blessed with the reference
+ * renderer and are part of the repository, so the default run also
+ * catches changes to the reference renderer itself.  A change that is
+ * meant to change the rendering blesses a new set and commits it with
+ * the change:
+ * 
+ *   skconform -bless
+ * 
+ * A private golden set can also be made with the build before a change
+ * and checked with the build after it:
+ * 
+ *   skconform -g golden -bless
+ *   (rebuild with the change)
+ *   skconform -g golden
+ * 
+ * Compilation:
+ * 
+ *   - "make skconform" in the repository root builds it (see Makefile)
+ *   - Build with the same compiler flags as the sparkle program
+ *   - Include directory must contain skvm.h (the repository root)
+ *   - Requires the skvm.c module
+ *   - Requires POSIX threads, which may require -lpthread
+ *   - May require the math library -lm on some platforms
+ *   - Requires libsophistry and libsophistry-jpeg (via skvm)
+ *   - Depends on libjpeg 6B, libpng, and zlib (via libsophistry)
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "skvm.h"
+
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * The dimensions of the sampling source and target.
+ */
+#define SRC_W (157)
+#define SRC_H (131)
+#define TGT_W (301)
+#define TGT_H (263)
+
+/*
+ * The dimensions and target position of the offset raster masks.
+ */
+#define OFS_W (120)
+#define OFS_H (90)
+#define OFS_X (-23)
+#define OFS_Y (190)
+
+/*
+ * The default thresholds of the comparisons.
+ */
+#define DEF_MAX_ERR (2)
+#define DEF_MIN_PSNR (50.0)
+
+/*
+ * The default golden image directory, relative to the repository root.
+ */
+#define DEF_GOLD "conform/golden"
+
+/*
+ * The maximum length of a path, including the terminating nul.
+ */
+#define MAX_PATH (4096)
+
+/*
+ * The maximum length of a case name, including the terminating nul.
+ */
+#define MAX_NAME (64)
+
+/*
+ * Buffer registers used by the cases.
+ */
+#define REG_DOT   (0)   /* 1x1 ARGB color of a painted layer */
+#define REG_SRC1  (1)   /* Grayscale sampling source */
+#define REG_SRC3  (2)   /* RGB sampling source */
+#define REG_SRC4  (3)   /* Translucent ARGB sampling source */
+#define REG_BACK  (4)   /* Translucent ARGB target background */
+#define REG_MASK  (5)   /* Grayscale raster mask */
+#define REG_MASKA (6)   /* ARGB raster mask */
+#define REG_MASKS (7)   /* Small grayscale raster mask */
+#define REG_RLE   (8)   /* Compressed raster mask */
+#define REG_RLES  (9)   /* Small compressed raster mask */
+#define REG_REF   (10)  /* Target of the reference renderer */
+#define REG_DST   (11)  /* Target of the fast paths */
+#define REG_GOLD  (12)  /* Golden image */
+#define REG_RAW   (13)  /* Translucent ARGB source with arbitrary bytes */
+#define REG_COUNT (14)
+
+/*
+ * Matrix registers used by the cases.
+ */
+#define MAT_XFORM (0)   /* Transform of the case */
+#define MAT_LAYER (1)   /* Transform of a painted layer */
+#define MAT_COUNT (2)
+
+/*
+ * The transforms of the cases.
+ */
+#define XFORM_IDENTITY  (0)
+#define XFORM_TRANSLATE (1)
+#define XFORM_SUBPIXEL  (2)
+#define XFORM_SCALE     (3)
+#define XFORM_SHRINK    (4)
+#define XFORM_ROTATE    (5)
+#define XFORM_TURN90    (6)
+#define XFORM_TURN180   (7)
+#define XFORM_TURN270   (8)
+#define XFORM_FLIPX     (9)
+#define XFORM_FLIPY     (10)
+#define XFORM_COUNT     (11)
+
+/*
+ * The variants of the cases.
+ */
+#define VAR_PLAIN       (0)
+#define VAR_PROC_LA     (1)
+#define VAR_PROC_RB     (2)
+#define VAR_RECT        (3)
+#define VAR_ELLIPSE     (4)
+#define VAR_RRECT       (5)
+#define VAR_LINEAR      (6)
+#define VAR_RADIAL      (7)
+#define VAR_INVERT      (8)
+#define VAR_RASTER      (9)
+#define VAR_RASTER_ARGB (10)
+#define VAR_RASTER_OFS  (11)
+#define VAR_RLE         (12)
+#define VAR_RLE_OFS     (13)
+#define VAR_ADD         (14)
+#define VAR_MULTIPLY    (15)
+#define VAR_SCREEN      (16)
+#define VAR_SRC         (17)
+#define VAR_DSTIN       (18)
+#define VAR_DSTOUT      (19)
+#define VAR_SUBAREA     (20)
+#define VAR_LUT         (21)
+#define VAR_CMAT        (22)
+#define VAR_LUT_CMAT    (23)
+#define VAR_COUNT       (24)
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * The state of a conformance run.
+ */
+typedef struct {
+  
+  /*
+   * The virtual machine context.
+   */
+  SKVM_CTX *pv;
+  
+  /*
+   * The file the report is written to, or NULL if there is no report.
+   */
+  FILE *pOut;
+  
+  /*
+   * The text that case names must contain, or NULL to run all cases.
+   */
+  const char *pFilter;
+  
+  /*
+   * The golden image directory, or NULL if there are no golden images.
+   */
+  const char *pGold;
+  
+  /*
+   * Non-zero if golden images are written rather than compared.
+   */
+  int bless;
+  
+  /*
+   * The comparison thresholds.
+   */
+  int32_t max_err;
+  double min_psnr;
+  
+  /*
+   * The number of cases run and the number that failed.
+   */
+  int32_t count;
+  int32_t failed;
+  
+  /*
+   * The number of golden images written when blessing.
+   */
+  int32_t written;
+  
+} CONF;
+
+/*
+ * Static data
+ * ===========
+ */
+
+/*
+ * The name of the executing module, for diagnostic messages.
+ */
+static const char *pModule = NULL;
+
+/*
+ * The names of the XFORM_ and VAR_ constants.
+ */
+static const char *m_xform_name[XFORM_COUNT] = {
+  "identity", "translate", "subpixel", "scale", "shrink", "rotate",
+  "turn90", "turn180", "turn270", "flipx", "flipy"
+};
+static const char *m_var_name[VAR_COUNT] = {
+  "plain", "proc-la", "proc-rb", "rect", "ellipse", "rrect", "linear",
+  "radial", "invert", "raster", "raster-argb", "raster-ofs", "rle",
+  "rle-ofs", "add", "multiply", "screen", "src", "dstin", "dstout",
+  "subarea", "lut", "cmat", "lut-cmat"
+};
+
+/*
+ * The color lookup table of the lut variants, which is filled in by
+ * setup_sources().
+ */
+static uint8_t m_lut[1024];
+
+/*
+ * The color matrix of the cmat variants, which swaps red and blue,
+ * desaturates green, and fades alpha.
+ */
+static const double m_cmat[20] = {
+  0.8,  0.0,  0.0,  0.0, 10.0,
+  0.0,  0.1,  0.2,  0.9,  0.0,
+  0.0,  0.3,  0.4,  0.3, -5.0,
+  0.0,  0.9,  0.0,  0.2,  0.0
+};
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Prototypes */
+static int parse_int(const char *pstr, int32_t *pv);
+static int parse_double(const char *pstr, double *pv);
+
+static void layer(
+    SKVM_CTX      * pv,
+    int32_t         i,
+    int             a,
+    int             r,
+    int             g,
+    int             b,
+    int             blend,
+    int             shape,
+    const double  * pGeom);
+static void paint(SKVM_CTX *pv, int32_t i, int opaque);
+static void sample_init(
+    SKVM_SAMPLE_PARAM * ps,
+    int32_t             src,
+    int32_t             dst);
+static void setup_sources(SKVM_CTX *pv);
+static void setup_xform(SKVM_CTX *pv, int xform);
+static void setup_target(SKVM_CTX *pv, int32_t i, int c);
+static void setup_variant(SKVM_SAMPLE_PARAM *ps, int v);
+
+static void report(
+          CONF          * pc,
+    const char          * pKey,
+    const SKVM_COMPARE  * pr,
+          int             c);
+static int check(CONF *pc, const SKVM_COMPARE *pr, int c);
+static int golden(CONF *pc, const char *pName, int c, int *pPass);
+static int conf_case(
+    CONF        * pc,
+    int           xform,
+    int           sc,
+    int           dc,
+    int           v);
+static void exact_case(CONF *pc, const char *pName, int pass);
+static void store_case(CONF *pc);
+static void src_case(CONF *pc);
+static void round_case(CONF *pc);
+static int run_conf(
+    const char  * pOutPath,
+    const char  * pGold,
+    const char  * pFilter,
+    int           bless,
+    int32_t       threads,
+    int32_t       max_err,
+    double        min_psnr);
+
+/*
+ * Parse the given string as a signed decimal integer.
+ * 
+ * Parameters:
+ * 
+ *   pstr - the string to parse
+ * 
+ *   pv - receives the parsed value
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the string is not a valid integer
+ */
+static int parse_int(const char *pstr, int32_t *pv) {
+  
+  int status = 1;
+  long v = 0;
+  char *endptr = NULL;
+  
+  /* Check parameters */
+  if ((pstr == NULL) || (pv == NULL)) {
+    abort();
+  }
+  
+  /* Parse the value */
+  errno = 0;
+  v = strtol(pstr, &endptr, 10);
+  if ((errno != 0) || (endptr == pstr) || (*endptr != 0)) {
+    status = 0;
+  }
+  if (status) {
+    if ((v < INT32_MIN) || (v > INT32_MAX)) {
+      status = 0;
+    }
+  }
+  
+  /* Return the value if successful */
+  if (status) {
+    *pv = (int32_t) v;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Parse the given string as a finite floating-point value.
+ * 
+ * Parameters:
+ * 
+ *   pstr - the string to parse
+ * 
+ *   pv - receives the parsed value
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the string is not a valid value
+ */
+static int parse_double(const char *pstr, double *pv) {
+  
+  int status = 1;
+  double v = 0.0;
+  char *endptr = NULL;
+  
+  /* Check parameters */
+  if ((pstr == NULL) || (pv == NULL)) {
+    abort();
+  }
+  
+  /* Parse the value */
+  errno = 0;
+  v = strtod(pstr, &endptr);
+  if ((errno != 0) || (endptr == pstr) || (*endptr != 0)) {
+    status = 0;
+  }
+  if (status) {
+    if (!isfinite(v)) {
+      status = 0;
+    }
+  }
+  
+  /* Return the value if successful */
+  if (status) {
+    *pv = v;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Paint a single layer of solid color over the whole of a loaded
+ * buffer register.
+ * 
+ * The color is composited with the given blend mode through the given
+ * shape mask, or through no mask if the shape is SKVM_SHAPE_NONE.
+ * pGeom holds the shape_ fields x0 y0 x1 y1 r f of the sampling
+ * parameters, and is ignored if there is no shape.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer register to paint over
+ * 
+ *   a - the alpha channel of the color
+ * 
+ *   r - the red channel of the color
+ * 
+ *   g - the green channel of the color
+ * 
+ *   b - the blue channel of the color
+ * 
+ *   blend - one of the SKVM_BLEND_ constants
+ * 
+ *   shape - one of the SKVM_SHAPE_ constants
+ * 
+ *   pGeom - the six shape coordinates, or NULL if there is no shape
+ */
+static void layer(
+    SKVM_CTX      * pv,
+    int32_t         i,
+    int             a,
+    int             r,
+    int             g,
+    int             b,
+    int             blend,
+    int             shape,
+    const double  * pGeom) {
+  
+  SKVM_SAMPLE_PARAM sp;
+  int32_t w = 0;
+  int32_t h = 0;
+  
+  /* Initialize structures */
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  
+  /* Check parameters */
+  if ((pv == NULL) || ((shape != SKVM_SHAPE_NONE) && (pGeom == NULL))) {
+    abort();
+  }
+  
+  /* Set the color of the single-pixel layer source */
+  skvm_reset(pv, REG_DOT, 1, 1, 4);
+  skvm_load_fill(pv, REG_DOT, a, r, g, b);
+  
+  /* Stretch the layer source over the whole buffer */
+  skvm_get_dim(pv, i, &w, &h);
+  skvm_matrix_reset(pv, MAT_LAYER);
+  skvm_matrix_scale(pv, MAT_LAYER, (double) w, (double) h);
+  
+  /* Composite the layer */
+  sample_init(&sp, REG_DOT, i);
+  sp.t_matrix = MAT_LAYER;
+  sp.blend = blend;
+  if (shape != SKVM_SHAPE_NONE) {
+    sp.mask_shape = shape;
+    sp.shape_x0 = pGeom[0];
+    sp.shape_y0 = pGeom[1];
+    sp.shape_x1 = pGeom[2];
+    sp.shape_y1 = pGeom[3];
+    sp.shape_r = pGeom[4];
+    sp.shape_f = pGeom[5];
+  }
+  skvm_sample(pv, &sp);
+}
+
+/*
+ * Paint a test image over the whole of an ARGB buffer register.
+ * 
+ * The register must already have been reset to ARGB.  The image has
+ * smooth ramps, hard and soft edges, and fine stripes, so that
+ * sampling from the wrong source pixel is visible.  If opaque is zero,
+ * the image gets translucent towards its bottom right.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer register to paint
+ * 
+ *   opaque - non-zero for an opaque image
+ */
+static void paint(SKVM_CTX *pv, int32_t i, int opaque) {
+  
+  int32_t w = 0;
+  int32_t h = 0;
+  int32_t k = 0;
+  double fw = 0.0;
+  double fh = 0.0;
+  double geom[6];
+  
+  /* Initialize structures */
+  memset(geom, 0, sizeof(double) * 6);
+  
+  /* Check parameters */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Get the dimensions */
+  skvm_get_dim(pv, i, &w, &h);
+  fw = (double) w;
+  fh = (double) h;
+  
+  /* Opaque background */
+  skvm_load_fill(pv, i, 255, 40, 60, 90);
+  
+  /* Diagonal ramp across the whole image */
+  geom[0] = 0.0;
+  geom[1] = 0.0;
+  geom[2] = fw;
+  geom[3] = fh;
+  layer(pv, i, 255, 230, 120, 30, SKVM_BLEND_OVER,
+        SKVM_SHAPE_LINEAR, geom);
+  
+  /* Soft radial glow */
+  geom[0] = fw * 0.3;
+  geom[1] = fh * 0.4;
+  geom[4] = fw * 0.1;
+  geom[5] = fw * 0.25;
+  layer(pv, i, 200, 20, 200, 240, SKVM_BLEND_OVER,
+        SKVM_SHAPE_RADIAL, geom);
+  
+  /* Rounded rectangle with a hard edge */
+  geom[0] = fw * 0.1;
+  geom[1] = fh * 0.6;
+  geom[2] = fw * 0.6;
+  geom[3] = fh * 0.95;
+  geom[4] = fw * 0.05;
+  geom[5] = 1.0;
+  layer(pv, i, 220, 10, 160, 60, SKVM_BLEND_OVER,
+        SKVM_SHAPE_RRECT, geom);
+  
+  /* Stripes one pixel wide in the top right */
+  for(k = (w * 2) / 3; k < w; k += 2) {
+    geom[0] = (double) k;
+    geom[1] = 0.0;
+    geom[2] = (double) (k + 1);
+    geom[3] = fh * 0.4;
+    geom[4] = 0.0;
+    geom[5] = 0.0;
+    layer(pv, i, 255, 250, 250, 250, SKVM_BLEND_OVER,
+          SKVM_SHAPE_RECT, geom);
+  }
+  
+  /* Fade out towards the bottom right unless opaque */
+  if (!opaque) {
+    geom[0] = fw;
+    geom[1] = fh;
+    geom[2] = fw * 0.3;
+    geom[3] = fh * 0.3;
+    layer(pv, i, 255, 255, 255, 255, SKVM_BLEND_DSTIN,
+          SKVM_SHAPE_LINEAR, geom);
+  }
+}
+
+/*
+ * Initialize sampling parameters for sampling the whole source into
+ * the target without any mask, with nearest neighbor sampling and the
+ * transform in MAT_XFORM.
+ * 
+ * Parameters:
+ * 
+ *   ps - the parameters to initialize
+ * 
+ *   src - the source buffer register
+ * 
+ *   dst - the target buffer register
+ */
+static void sample_init(
+    SKVM_SAMPLE_PARAM * ps,
+    int32_t             src,
+    int32_t             dst) {
+  
+  /* Check parameters */
+  if (ps == NULL) {
+    abort();
+  }
+  
+  /* Set the parameters */
+  memset(ps, 0, sizeof(SKVM_SAMPLE_PARAM));
+  ps->src_buf = src;
+  ps->target_buf = dst;
+  ps->t_matrix = MAT_XFORM;
+  ps->x_boundary = 0.0;
+  ps->y_boundary = 0.0;
+  ps->mask_shape = SKVM_SHAPE_NONE;
+  ps->sample_alg = SKVM_ALG_NEAREST;
+  ps->blend = SKVM_BLEND_OVER;
+  ps->flags = SKVM_FLAG_PROCMASK | SKVM_FLAG_LEFTMODE |
+              SKVM_FLAG_ABOVEMODE;
+}
+
+/*
+ * Set up the sources, target background, raster masks, and lookup
+ * table of the cases.
+ * 
+ * Everything is painted with the reference renderer, so that the
+ * inputs of the cases do not depend on the fast paths being checked.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ */
+static void setup_sources(SKVM_CTX *pv) {
+  
+  SKVM_SAMPLE_PARAM sp;
+  int k = 0;
+  double geom[6];
+  
+  /* Initialize structures */
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  memset(geom, 0, sizeof(double) * 6);
+  
+  /* Check parameters */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Paint with the reference renderer */
+  skvm_reference(SKVM_REF_ON);
+  
+  /* Paint the translucent ARGB source and the opaque image that the
+   * grayscale and RGB sources are converted from, which is kept in
+   * the target background register for now */
+  skvm_reset(pv, REG_SRC4, SRC_W, SRC_H, 4);
+  paint(pv, REG_SRC4, 0);
+  skvm_reset(pv, REG_BACK, SRC_W, SRC_H, 4);
+  paint(pv, REG_BACK, 1);
+  skvm_matrix_reset(pv, MAT_XFORM);
+  
+  skvm_reset(pv, REG_SRC1, SRC_W, SRC_H, 1);
+  skvm_load_fill(pv, REG_SRC1, 255, 0, 0, 0);
+  sample_init(&sp, REG_BACK, REG_SRC1);
+  sp.blend = SKVM_BLEND_SRC;
+  skvm_sample(pv, &sp);
+  
+  skvm_reset(pv, REG_SRC3, SRC_W, SRC_H, 3);
+  skvm_load_fill(pv, REG_SRC3, 255, 0, 0, 0);
+  sample_init(&sp, REG_BACK, REG_SRC3);
+  sp.blend = SKVM_BLEND_SRC;
+  skvm_sample(pv, &sp);
+  
+  /* Paint the target background, which is a translucent wash with an
+   * opaque band */
+  skvm_reset(pv, REG_BACK, TGT_W, TGT_H, 4);
+  skvm_load_fill(pv, REG_BACK, 140, 90, 110, 130);
+  geom[0] = 0.0;
+  geom[1] = TGT_H * 0.45;
+  geom[2] = TGT_W;
+  geom[3] = TGT_H * 0.55;
+  layer(pv, REG_BACK, 255, 200, 30, 90, SKVM_BLEND_SRC,
+        SKVM_SHAPE_RECT, geom);
+  
+  /* Draw the grayscale and compressed raster masks covering the
+   * target, which are a feathered ellipse */
+  geom[0] = TGT_W * 0.1;
+  geom[1] = TGT_H * 0.05;
+  geom[2] = TGT_W * 0.9;
+  geom[3] = TGT_H * 0.8;
+  geom[5] = 12.0;
+  
+  skvm_reset(pv, REG_MASK, TGT_W, TGT_H, 1);
+  skvm_load_fill(pv, REG_MASK, 255, 0, 0, 0);
+  layer(pv, REG_MASK, 255, 255, 255, 255, SKVM_BLEND_OVER,
+        SKVM_SHAPE_ELLIPSE, geom);
+  
+  skvm_reset(pv, REG_RLE, TGT_W, TGT_H, 1);
+  skvm_load_fill(pv, REG_RLE, 255, 0, 0, 0);
+  layer(pv, REG_RLE, 255, 255, 255, 255, SKVM_BLEND_OVER,
+        SKVM_SHAPE_ELLIPSE, geom);
+  skvm_mask_compress(pv, REG_RLE);
+  
+  /* The ARGB raster mask is a radial ramp in its alpha channel, under
+   * color channels that must be ignored */
+  geom[0] = TGT_W * 0.6;
+  geom[1] = TGT_H * 0.4;
+  geom[4] = TGT_W * 0.1;
+  geom[5] = TGT_W * 0.3;
+  skvm_reset(pv, REG_MASKA, TGT_W, TGT_H, 4);
+  skvm_load_fill(pv, REG_MASKA, 0, 250, 10, 70);
+  layer(pv, REG_MASKA, 255, 10, 250, 70, SKVM_BLEND_OVER,
+        SKVM_SHAPE_RADIAL, geom);
+  
+  /* The small masks are a hard-edged rounded rectangle */
+  geom[0] = OFS_W * 0.05;
+  geom[1] = OFS_H * 0.1;
+  geom[2] = OFS_W * 0.95;
+  geom[3] = OFS_H * 0.9;
+  geom[4] = OFS_H * 0.2;
+  geom[5] = 0.0;
+  
+  skvm_reset(pv, REG_MASKS, OFS_W, OFS_H, 1);
+  skvm_load_fill(pv, REG_MASKS, 255, 0, 0, 0);
+  layer(pv, REG_MASKS, 255, 255, 255, 255, SKVM_BLEND_OVER,
+        SKVM_SHAPE_RRECT, geom);
+  
+  skvm_reset(pv, REG_RLES, OFS_W, OFS_H, 1);
+  skvm_load_fill(pv, REG_RLES, 255, 0, 0, 0);
+  layer(pv, REG_RLES, 255, 255, 255, 255, SKVM_BLEND_OVER,
+        SKVM_SHAPE_RRECT, geom);
+  skvm_mask_compress(pv, REG_RLES);
+  
+  skvm_reference(SKVM_REF_DEFAULT);
+  
+  /* The lookup table inverts alpha partly and applies a different
+   * curve to each color channel */
+  for(k = 0; k < 256; k++) {
+    m_lut[k] = (uint8_t) (255 - (k / 3));
+    m_lut[256 + k] = (uint8_t) ((k * k) / 255);
+    m_lut[512 + k] = (uint8_t) (255 - k);
+    m_lut[768 + k] = (uint8_t) ((k < 128) ? (k * 2) : 255);
+  }
+}
+
+/*
+ * Set MAT_XFORM to one of the transforms of the cases.
+ * 
+ * Matrix operations premultiply, so each transform first moves the
+ * center of the source to the origin and finally moves it to the
+ * center of the target.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   xform - one of the XFORM_ constants
+ */
+static void setup_xform(SKVM_CTX *pv, int xform) {
+  
+  /* Check parameters */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Move the source center to the origin */
+  skvm_matrix_reset(pv, MAT_XFORM);
+  skvm_matrix_translate(pv, MAT_XFORM,
+    -((double) (SRC_W / 2)), -((double) (SRC_H / 2)));
+  
+  /* Apply the transform */
+  if (xform == XFORM_IDENTITY) {
+    /* Leave as identity */
+    
+  } else if (xform == XFORM_TRANSLATE) {
+    skvm_matrix_translate(pv, MAT_XFORM, 97.0, -61.0);
+    
+  } else if (xform == XFORM_SUBPIXEL) {
+    skvm_matrix_translate(pv, MAT_XFORM, 37.5, -21.25);
+    
+  } else if (xform == XFORM_SCALE) {
+    skvm_matrix_scale(pv, MAT_XFORM, 1.7, 1.7);
+    
+  } else if (xform == XFORM_SHRINK) {
+    skvm_matrix_scale(pv, MAT_XFORM, 0.6, 0.6);
+    
+  } else if (xform == XFORM_ROTATE) {
+    skvm_matrix_rotate(pv, MAT_XFORM, 30.0);
+    
+  } else if (xform == XFORM_TURN90) {
+    skvm_matrix_rotate(pv, MAT_XFORM, 90.0);
+    
+  } else if (xform == XFORM_TURN180) {
+    skvm_matrix_rotate(pv, MAT_XFORM, 180.0);
+    
+  } else if (xform == XFORM_TURN270) {
+    skvm_matrix_rotate(pv, MAT_XFORM, 270.0);
+    
+  } else if (xform == XFORM_FLIPX) {
+    skvm_matrix_scale(pv, MAT_XFORM, -1.0, 1.0);
+    
+  } else if (xform == XFORM_FLIPY) {
+    skvm_matrix_scale(pv, MAT_XFORM, 1.0, -1.0);
+    
+  } else {
+    abort();
+  }
+  
+  /* Move the origin to the target center */
+  skvm_matrix_translate(pv, MAT_XFORM,
+    (double) (TGT_W / 2), (double) (TGT_H / 2));
+}
+
+/*
+ * Reset a target register and copy the target background into it.
+ * 
+ * The copy is made with the reference renderer.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the target register
+ * 
+ *   c - the channel count of the target, or zero for a float target
+ */
+static void setup_target(SKVM_CTX *pv, int32_t i, int c) {
+  
+  SKVM_SAMPLE_PARAM sp;
+  
+  /* Initialize structures */
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  
+  /* Check parameters */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Reset the target */
+  if (c == 0) {
+    skvm_reset_float(pv, i, TGT_W, TGT_H);
+  } else {
+    skvm_reset(pv, i, TGT_W, TGT_H, c);
+  }
+  skvm_load_fill(pv, i, 0, 0, 0, 0);
+  
+  /* Copy the background */
+  skvm_reference(SKVM_REF_ON);
+  skvm_matrix_reset(pv, MAT_LAYER);
+  sample_init(&sp, REG_BACK, i);
+  sp.t_matrix = MAT_LAYER;
+  sp.blend = SKVM_BLEND_SRC;
+  skvm_sample(pv, &sp);
+  skvm_reference(SKVM_REF_DEFAULT);
+}
+
+/*
+ * Apply one of the case variants to sampling parameters.
+ * 
+ * The parameters must have been initialized with sample_init().
+ * 
+ * Parameters:
+ * 
+ *   ps - the sampling parameters
+ * 
+ *   v - one of the VAR_ constants
+ */
+static void setup_variant(SKVM_SAMPLE_PARAM *ps, int v) {
+  
+  /* Check parameters */
+  if (ps == NULL) {
+    abort();
+  }
+  
+  /* Procedural masks */
+  if (v == VAR_PLAIN) {
+    /* Leave unmasked */
+    
+  } else if (v == VAR_PROC_LA) {
+    ps->x_boundary = 0.3;
+    ps->y_boundary = 0.45;
+    
+  } else if (v == VAR_PROC_RB) {
+    ps->flags = SKVM_FLAG_PROCMASK | SKVM_FLAG_RIGHTMODE |
+                SKVM_FLAG_BELOWMODE;
+    ps->x_boundary = 0.7;
+    ps->y_boundary = 0.55;
+    
+  } else if ((v == VAR_RECT) || (v == VAR_ELLIPSE) ||
+              (v == VAR_RRECT) || (v == VAR_INVERT)) {
+    ps->shape_x0 = TGT_W * 0.15 + 0.3;
+    ps->shape_y0 = TGT_H * 0.1 + 0.6;
+    ps->shape_x1 = TGT_W * 0.85 + 0.2;
+    ps->shape_y1 = TGT_H * 0.9 + 0.7;
+    if (v == VAR_RECT) {
+      ps->mask_shape = SKVM_SHAPE_RECT;
+    } else if (v == VAR_RRECT) {
+      ps->mask_shape = SKVM_SHAPE_RRECT;
+      ps->shape_r = TGT_H * 0.15;
+      ps->shape_f = 1.0;
+    } else {
+      ps->mask_shape = SKVM_SHAPE_ELLIPSE;
+      ps->shape_f = 6.0;
+    }
+    if (v == VAR_INVERT) {
+      ps->flags |= SKVM_FLAG_SHAPEINVERT;
+      ps->x_boundary = 0.2;
+      ps->y_boundary = 0.1;
+    }
+    
+  } else if (v == VAR_LINEAR) {
+    ps->mask_shape = SKVM_SHAPE_LINEAR;
+    ps->shape_x0 = TGT_W * 0.2;
+    ps->shape_y0 = TGT_H * 0.9;
+    ps->shape_x1 = TGT_W * 0.7;
+    ps->shape_y1 = TGT_H * 0.3;
+    
+  } else if (v == VAR_RADIAL) {
+    ps->mask_shape = SKVM_SHAPE_RADIAL;
+    ps->shape_x0 = TGT_W * 0.45;
+    ps->shape_y0 = TGT_H * 0.55;
+    ps->shape_r = TGT_H * 0.15;
+    ps->shape_f = TGT_H * 0.3;
+    
+  /* Raster masks */
+  } else if ((v == VAR_RASTER) || (v == VAR_RASTER_ARGB) ||
+              (v == VAR_RLE)) {
+    ps->flags = SKVM_FLAG_RASTERMASK;
+    if (v == VAR_RASTER) {
+      ps->mask_buf = REG_MASK;
+    } else if (v == VAR_RASTER_ARGB) {
+      ps->mask_buf = REG_MASKA;
+    } else {
+      ps->mask_buf = REG_RLE;
+    }
+    ps->mask_x = 0;
+    ps->mask_y = 0;
+    
+  } else if ((v == VAR_RASTER_OFS) || (v == VAR_RLE_OFS)) {
+    ps->flags = SKVM_FLAG_RASTERMASK;
+    if (v == VAR_RASTER_OFS) {
+      ps->mask_buf = REG_MASKS;
+      ps->mask_x = OFS_X;
+      ps->mask_y = OFS_Y;
+    } else {
+      ps->mask_buf = REG_RLES;
+      ps->mask_x = TGT_W + OFS_X - OFS_W + 40;
+      ps->mask_y = -OFS_Y / 4;
+    }
+    
+  /* Blend modes */
+  } else if (v == VAR_ADD) {
+    ps->blend = SKVM_BLEND_ADD;
+    
+  } else if (v == VAR_MULTIPLY) {
+    ps->blend = SKVM_BLEND_MULTIPLY;
+    
+  } else if (v == VAR_SCREEN) {
+    ps->blend = SKVM_BLEND_SCREEN;
+    
+  } else if (v == VAR_SRC) {
+    ps->blend = SKVM_BLEND_SRC;
+    
+  } else if (v == VAR_DSTIN) {
+    ps->blend = SKVM_BLEND_DSTIN;
+    
+  } else if (v == VAR_DSTOUT) {
+    ps->blend = SKVM_BLEND_DSTOUT;
+    
+  /* Other flags */
+  } else if (v == VAR_SUBAREA) {
+    ps->flags |= SKVM_FLAG_SUBAREA;
+    ps->src_x = 13;
+    ps->src_y = 29;
+    ps->src_w = SRC_W - 40;
+    ps->src_h = SRC_H - 51;
+    
+  } else if ((v == VAR_LUT) || (v == VAR_CMAT) ||
+              (v == VAR_LUT_CMAT)) {
+    if (v != VAR_CMAT) {
+      ps->flags |= SKVM_FLAG_COLORLUT;
+      ps->pLut = m_lut;
+    }
+    if (v != VAR_LUT) {
+      ps->flags |= SKVM_FLAG_COLORMATRIX;
+      ps->pCMat = m_cmat;
+    }
+    
+  } else {
+    abort();
+  }
+}
+
+/*
+ * Write one comparison of a case to the report as a JSON object
+ * member.
+ * 
+ * If there is no report, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pc - the conformance run
+ * 
+ *   pKey - the key of the member
+ * 
+ *   pr - the comparison
+ * 
+ *   c - the number of channels compared
+ */
+static void report(
+          CONF          * pc,
+    const char          * pKey,
+    const SKVM_COMPARE  * pr,
+          int             c) {
+  
+  int k = 0;
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pKey == NULL) || (pr == NULL) ||
+      (c < 1) || (c > 4)) {
+    abort();
+  }
+  
+  /* Ignore if no report */
+  if (pc->pOut == NULL) {
+    return;
+  }
+  
+  /* Write the comparison */
+  fprintf(pc->pOut, ",\"%s\":{\"mse\":%.6f,", pKey, pr->mse);
+  if (isfinite(pr->psnr)) {
+    fprintf(pc->pOut, "\"psnr\":%.4f,", pr->psnr);
+  } else {
+    fprintf(pc->pOut, "\"psnr\":null,");
+  }
+  fprintf(pc->pOut, "\"ssim\":%.6f,\"maxerr\":[", pr->ssim);
+  for(k = 0; k < c; k++) {
+    fprintf(pc->pOut, "%s%ld", (k > 0) ? "," : "",
+      (long) (pr->maxerr)[k]);
+  }
+  fprintf(pc->pOut, "]}");
+}
+
+/*
+ * Check a comparison against the thresholds of the run.
+ * 
+ * Parameters:
+ * 
+ *   pc - the conformance run
+ * 
+ *   pr - the comparison
+ * 
+ *   c - the number of channels compared
+ * 
+ * Return:
+ * 
+ *   non-zero if within the thresholds, zero if not
+ */
+static int check(CONF *pc, const SKVM_COMPARE *pr, int c) {
+  
+  int pass = 1;
+  int k = 0;
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pr == NULL) || (c < 1) || (c > 4)) {
+    abort();
+  }
+  
+  /* Check the thresholds, where identical buffers have an infinite
+   * PSNR */
+  if (pr->psnr < pc->min_psnr) {
+    pass = 0;
+  }
+  for(k = 0; k < c; k++) {
+    if ((pr->maxerr)[k] > pc->max_err) {
+      pass = 0;
+    }
+  }
+  
+  /* Return result */
+  return pass;
+}
+
+/*
+ * Write or compare the golden image of a case.
+ * 
+ * The reference rendering must be in REG_REF and the fast rendering in
+ * REG_DST.  When blessing, the reference rendering is written to the
+ * golden image and the case passes.  Otherwise, the golden image is
+ * loaded into REG_GOLD, the fast rendering is compared with it, and
+ * the comparison is added to the report.
+ * 
+ * Parameters:
+ * 
+ *   pc - the conformance run
+ * 
+ *   pName - the name of the case
+ * 
+ *   c - the channel count of the target, or zero for a float target
+ * 
+ *   pPass - receives whether the case passed
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the golden image could not be read
+ *   or written
+ */
+static int golden(CONF *pc, const char *pName, int c, int *pPass) {
+  
+  int status = 1;
+  int32_t k = 0;
+  char path[MAX_PATH];
+  SKVM_COMPARE cmp;
+  
+  /* Initialize structures */
+  memset(path, 0, MAX_PATH);
+  memset(&cmp, 0, sizeof(SKVM_COMPARE));
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pName == NULL) || (pPass == NULL) ||
+      (pc->pGold == NULL)) {
+    abort();
+  }
+  
+  /* Build the path of the golden image */
+  if (snprintf(path, MAX_PATH, "%s/%s.png", pc->pGold, pName) >=
+        MAX_PATH) {
+    status = 0;
+    fprintf(stderr, "%s: Golden directory path is too long!\n",
+      pModule);
+  }
+  if (status) {
+    for(k = (int32_t) strlen(pc->pGold) + 1; path[k] != 0; k++) {
+      if (path[k] == '/') {
+        path[k] = '_';
+      }
+    }
+  }
+  
+  /* Write the golden image when blessing */
+  if (status && pc->bless) {
+    if (!skvm_store_png(pc->pv, REG_REF, path)) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to write %s: %s!\n",
+        pModule, path, skvm_reason(pc->pv));
+    } else {
+      (pc->written)++;
+    }
+    *pPass = 1;
+    
+  /* Otherwise, compare with the golden image, loaded as the ARGB
+   * values a float target is stored as */
+  } else if (status) {
+    if (c == 0) {
+      skvm_reset(pc->pv, REG_GOLD, TGT_W, TGT_H, 4);
+    } else {
+      skvm_reset(pc->pv, REG_GOLD, TGT_W, TGT_H, c);
+    }
+    if (!skvm_load_png(pc->pv, REG_GOLD, path)) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to read %s: %s!\n",
+        pModule, path, skvm_reason(pc->pv));
+    }
+    
+    if (status) {
+      skvm_compare(pc->pv, REG_DST, REG_GOLD, &cmp);
+      *pPass = check(pc, &cmp, (c == 0) ? 4 : c);
+      report(pc, "golden", &cmp, (c == 0) ? 4 : c);
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Run a single case.
+ * 
+ * If the case name does not contain the filter text, the case is
+ * skipped and the function succeeds.  A failing comparison is counted
+ * and reported, but does not make the function fail.
+ * 
+ * Parameters:
+ * 
+ *   pc - the conformance run
+ * 
+ *   xform - one of the XFORM_ constants, which must already be set up
+ *   in MAT_XFORM
+ * 
+ *   sc - the channel count of the source
+ * 
+ *   dc - the channel count of the target, or zero for a float target
+ * 
+ *   v - one of the VAR_ constants
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if a golden image could not be read
+ *   or written
+ */
+static int conf_case(
+    CONF        * pc,
+    int           xform,
+    int           sc,
+    int           dc,
+    int           v) {
+  
+  int status = 1;
+  int pass = 0;
+  int gpass = 1;
+  int c = 0;
+  int32_t src = 0;
+  char name[MAX_NAME];
+  SKVM_SAMPLE_PARAM sp;
+  SKVM_COMPARE cmp;
+  
+  /* Initialize structures */
+  memset(name, 0, MAX_NAME);
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  memset(&cmp, 0, sizeof(SKVM_COMPARE));
+  
+  /* Check parameters */
+  if ((pc == NULL) || (xform < 0) || (xform >= XFORM_COUNT) ||
+      (v < 0) || (v >= VAR_COUNT)) {
+    abort();
+  }
+  if (sc == 1) {
+    src = REG_SRC1;
+  } else if (sc == 3) {
+    src = REG_SRC3;
+  } else if (sc == 4) {
+    src = REG_SRC4;
+  } else {
+    abort();
+  }
+  if ((dc != 0) && (dc != 1) && (dc != 3) && (dc != 4)) {
+    abort();
+  }
+  c = (dc == 0) ? 4 : dc;
+  
+  /* Name the case and skip it if filtered out */
+  if (dc == 0) {
+    sprintf(name, "%s/%d-f/%s", m_xform_name[xform], sc, m_var_name[v]);
+  } else {
+    sprintf(name, "%s/%d-%d/%s",
+      m_xform_name[xform], sc, dc, m_var_name[v]);
+  }
+  if (pc->pFilter != NULL) {
+    if (strstr(name, pc->pFilter) == NULL) {
+      return 1;
+    }
+  }
+  
+  /* Render with the reference renderer and with the fast paths, using
+   * a fresh copy of the parameters each time since skvm_sample() may
+   * modify them */
+  setup_target(pc->pv, REG_REF, dc);
+  setup_target(pc->pv, REG_DST, dc);
+  
+  skvm_reference(SKVM_REF_ON);
+  sample_init(&sp, src, REG_REF);
+  setup_variant(&sp, v);
+  skvm_sample(pc->pv, &sp);
+  
+  skvm_reference(SKVM_REF_OFF);
+  sample_init(&sp, src, REG_DST);
+  setup_variant(&sp, v);
+  skvm_sample(pc->pv, &sp);
+  skvm_reference(SKVM_REF_DEFAULT);
+  
+  /* Compare the fast rendering with the reference rendering */
+  skvm_compare(pc->pv, REG_DST, REG_REF, &cmp);
+  pass = check(pc, &cmp, c);
+  
+  if (pc->pOut != NULL) {
+    fprintf(pc->pOut, "{\"name\":\"%s\"", name);
+  }
+  report(pc, "reference", &cmp, c);
+    
+  /* Write or compare the golden image */
+  if (pc->pGold != NULL) {
+    status = golden(pc, name, dc, &gpass);
+  }
+    
+  /* Finish the report line */
+  if (!gpass) {
+    pass = 0;
+  }
+  if (pc->pOut != NULL) {
+    fprintf(pc->pOut, ",\"pass\":%s}\n",
+      (status && pass) ? "true" : "false");
+  }
+  
+  /* Count the case and report a failure */
+  (pc->count)++;
+  if (status && (!pass)) {
+    (pc->failed)++;
+    fprintf(stderr, "%s: FAIL %s\n", pModule, name);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Count and report the result of an exact case.
+ * 
+ * Exact cases check results themselves rather than comparing them
+ * against the thresholds, so the report line only has the pass flag.
+ * 
+ * Parameters:
+ * 
+ *   pc - the conformance run
+ * 
+ *   pName - the name of the case
+ * 
+ *   pass - non-zero if the case passed
+ */
+static void exact_case(CONF *pc, const char *pName, int pass) {
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pName == NULL)) {
+    abort();
+  }
+  
+  /* Write the report line */
+  if (pc->pOut != NULL) {
+    fprintf(pc->pOut, "{\"name\":\"%s\",\"pass\":%s}\n",
+      pName, pass ? "true" : "false");
+  }
+  
+  /* Count the case and report a failure */
+  (pc->count)++;
+  if (!pass) {
+    (pc->failed)++;
+    fprintf(stderr, "%s: FAIL %s\n", pModule, pName);
+  }
+}
+
+/*
+ * Run the store/alpha case.
+ * 
+ * Translucent colors are composited over a transparent ARGB target
+ * with the reference renderer and with the fast paths, and the alpha
+ * channel of every stored pixel must be exactly the alpha of the
+ * color.  Only the alpha channel is checked, because the color
+ * channels go through premultiplication and are not exact.
+ * 
+ * If the case name does not contain the filter text, the case is
+ * skipped.
+ * 
+ * Parameters:
+ * 
+ *   pc - the conformance run
+ */
+static void store_case(CONF *pc) {
+  
+  static const int alpha[5] = {1, 64, 128, 200, 254};
+  static const int mode[2] = {SKVM_REF_ON, SKVM_REF_OFF};
+  
+  const char *pName = "store/alpha";
+  int pass = 1;
+  int k = 0;
+  int m = 0;
+  SKVM_STATS st;
+  
+  /* Initialize structures */
+  memset(&st, 0, sizeof(SKVM_STATS));
+  
+  /* Check parameters */
+  if (pc == NULL) {
+    abort();
+  }
+  
+  /* Skip if filtered out */
+  if (pc->pFilter != NULL) {
+    if (strstr(pName, pc->pFilter) == NULL) {
+      return;
+    }
+  }
+  
+  /* Composite each color with each renderer */
+  for(m = 0; m < 2; m++) {
+    skvm_reference(mode[m]);
+    for(k = 0; k < 5; k++) {
+      skvm_reset(pc->pv, REG_DST, TGT_W, TGT_H, 4);
+      skvm_load_fill(pc->pv, REG_DST, 0, 0, 0, 0);
+      layer(pc->pv, REG_DST, alpha[k], 200, 100, 50,
+            SKVM_BLEND_OVER, SKVM_SHAPE_NONE, NULL);
+      
+      skvm_stats(pc->pv, REG_DST, &st);
+      if (((st.min)[0] != alpha[k]) || ((st.max)[0] != alpha[k])) {
+        pass = 0;
+      }
+    }
+  }
+  skvm_reference(SKVM_REF_DEFAULT);
+  
+  /* Count and report the case */
+  exact_case(pc, pName, pass);
+}
+
+/*
+ * Run the paths/src case.
+ * 
+ * The source is the opaque painted image with its green channel copied
+ * into alpha by a color matrix, so that its translucent pixels hold
+ * arbitrary channel bytes rather than bytes that the renderer already
+ * stored.  It is copied into a transparent ARGB target of the same size
+ * with the SRC blend through the exact kernel, the general kernel, and
+ * the reference renderer.  All three renderings must be identical, so
+ * that the result does not depend on which kernel the transform
+ * selects.
+ * 
+ * If the case name does not contain the filter text, the case is
+ * skipped.  MAT_LAYER is changed.
+ * 
+ * Parameters:
+ * 
+ *   pc - the conformance run
+ */
+static void src_case(CONF *pc) {
+  
+  const char *pName = "paths/src";
+  int pass = 1;
+  int k = 0;
+  int m = 0;
+  double cmat[20];
+  SKVM_SAMPLE_PARAM sp;
+  SKVM_COMPARE cmp;
+  
+  /* Initialize structures */
+  memset(cmat, 0, sizeof(double) * 20);
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  memset(&cmp, 0, sizeof(SKVM_COMPARE));
+  
+  /* Check parameters */
+  if (pc == NULL) {
+    abort();
+  }
+  
+  /* Skip if filtered out */
+  if (pc->pFilter != NULL) {
+    if (strstr(pName, pc->pFilter) == NULL) {
+      return;
+    }
+  }
+  
+  /* Build the source, with alpha taken from green and the color
+   * channels unchanged */
+  skvm_reference(SKVM_REF_ON);
+  skvm_reset(pc->pv, REG_RAW, SRC_W, SRC_H, 4);
+  paint(pc->pv, REG_RAW, 1);
+  
+  cmat[2] = 1.0;
+  cmat[6] = 1.0;
+  cmat[12] = 1.0;
+  cmat[18] = 1.0;
+  skvm_color_matrix(pc->pv, REG_RAW, cmat);
+  
+  /* Copy through the exact kernel with an identity transform */
+  skvm_reset(pc->pv, REG_DST, SRC_W, SRC_H, 4);
+  skvm_load_fill(pc->pv, REG_DST, 0, 0, 0, 0);
+  skvm_matrix_reset(pc->pv, MAT_LAYER);
+  
+  skvm_reference(SKVM_REF_OFF);
+  sample_init(&sp, REG_RAW, REG_DST);
+  sp.t_matrix = MAT_LAYER;
+  sp.blend = SKVM_BLEND_SRC;
+  skvm_sample(pc->pv, &sp);
+  
+  /* Copy through the general kernel and then through the reference
+   * renderer, comparing each with the exact kernel */
+  for(m = 0; m < 2; m++) {
+    skvm_reset(pc->pv, REG_REF, SRC_W, SRC_H, 4);
+    skvm_load_fill(pc->pv, REG_REF, 0, 0, 0, 0);
+    skvm_matrix_reset(pc->pv, MAT_LAYER);
+    if (m == 0) {
+      skvm_matrix_translate(pc->pv, MAT_LAYER, -0.25, -0.25);
+    } else {
+      skvm_reference(SKVM_REF_ON);
+    }
+    
+    sample_init(&sp, REG_RAW, REG_REF);
+    sp.t_matrix = MAT_LAYER;
+    sp.blend = SKVM_BLEND_SRC;
+    skvm_sample(pc->pv, &sp);
+    
+    skvm_compare(pc->pv, REG_DST, REG_REF, &cmp);
+    for(k = 0; k < 4; k++) {
+      if ((cmp.maxerr)[k] != 0) {
+        pass = 0;
+      }
+    }
+  }
+  skvm_reference(SKVM_REF_DEFAULT);
+  
+  /* Count and report the case */
+  exact_case(pc, pName, pass);
+}
+
+/*
+ * Run the store/round case.
+ * 
+ * Sixty white layers with an alpha of 3 are composited over opaque
+ * black in a grayscale, an RGB, an ARGB, and a float target, with both
+ * renderers.  Each layer moves a channel by less than three steps, so
+ * an 8-bit store that truncates instead of rounding drifts far below
+ * the float result, which is about 130.  The 8-bit targets must be
+ * within one step of each other and within two steps of the float
+ * target.
+ * 
+ * If the case name does not contain the filter text, the case is
+ * skipped.
+ * 
+ * Parameters:
+ * 
+ *   pc - the conformance run
+ */
+static void round_case(CONF *pc) {
+  
+  static const int chan[4] = {1, 3, 4, 0};
+  static const int mode[2] = {SKVM_REF_ON, SKVM_REF_OFF};
+  
+  const char *pName = "store/round";
+  int pass = 1;
+  int i = 0;
+  int k = 0;
+  int m = 0;
+  double v[4];
+  SKVM_STATS st;
+  
+  /* Initialize structures */
+  memset(v, 0, sizeof(double) * 4);
+  memset(&st, 0, sizeof(SKVM_STATS));
+  
+  /* Check parameters */
+  if (pc == NULL) {
+    abort();
+  }
+  
+  /* Skip if filtered out */
+  if (pc->pFilter != NULL) {
+    if (strstr(pName, pc->pFilter) == NULL) {
+      return;
+    }
+  }
+  
+  /* Composite the layers into each kind of target with each
+   * renderer, where a channel count of zero selects a float target */
+  for(m = 0; m < 2; m++) {
+    skvm_reference(mode[m]);
+    for(i = 0; i < 4; i++) {
+      if (chan[i] > 0) {
+        skvm_reset(pc->pv, REG_DST, 16, 16, chan[i]);
+      } else {
+        skvm_reset_float(pc->pv, REG_DST, 16, 16);
+      }
+      skvm_load_fill(pc->pv, REG_DST, 255, 0, 0, 0);
+      
+      for(k = 0; k < 60; k++) {
+        layer(pc->pv, REG_DST, 3, 255, 255, 255,
+              SKVM_BLEND_OVER, SKVM_SHAPE_NONE, NULL);
+      }
+      
+      /* The last channel is blue, or gray for grayscale targets */
+      skvm_stats(pc->pv, REG_DST, &st);
+      v[i] = (st.mean)[st.c - 1];
+    }
+    
+    for(i = 0; i < 3; i++) {
+      if (fabs(v[i] - v[(i + 1) % 3]) > 1.0) {
+        pass = 0;
+      }
+      if (fabs(v[i] - v[3]) > 2.0) {
+        pass = 0;
+      }
+    }
+  }
+  skvm_reference(SKVM_REF_DEFAULT);
+  
+  /* Count and report the case */
+  exact_case(pc, pName, pass);
+}
+
+/*
+ * Run all the cases.
+ * 
+ * Parameters:
+ * 
+ *   pOutPath - the path of the report, or NULL for no report
+ * 
+ *   pGold - the golden image directory, or NULL for none
+ * 
+ *   pFilter - the text that case names must contain, or NULL
+ * 
+ *   bless - non-zero to write golden images instead of comparing them
+ * 
+ *   threads - the thread count to pass to skvm_threads()
+ * 
+ *   max_err - the largest channel difference allowed
+ * 
+ *   min_psnr - the lowest PSNR allowed
+ * 
+ * Return:
+ * 
+ *   non-zero if every case ran and passed, zero otherwise
+ */
+static int run_conf(
+    const char  * pOutPath,
+    const char  * pGold,
+    const char  * pFilter,
+    int           bless,
+    int32_t       threads,
+    int32_t       max_err,
+    double        min_psnr) {
+  
+  static const int chan[4] = {1, 3, 4, 0};
+  
+  int status = 1;
+  int x = 0;
+  int s = 0;
+  int d = 0;
+  int v = 0;
+  CONF conf;
+  
+  /* Initialize structures */
+  memset(&conf, 0, sizeof(CONF));
+  
+  /* Check parameters */
+  if ((bless && (pGold == NULL)) || (max_err < 0) || (max_err > 255) ||
+      (!isfinite(min_psnr))) {
+    abort();
+  }
+  conf.pGold = pGold;
+  conf.pFilter = pFilter;
+  conf.bless = bless;
+  conf.max_err = max_err;
+  conf.min_psnr = min_psnr;
+  
+  /* Open the report */
+  if (pOutPath != NULL) {
+    conf.pOut = fopen(pOutPath, "w");
+    if (conf.pOut == NULL) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to create report file!\n", pModule);
+    }
+  }
+  
+  /* Set the threads, allocate the context, and set up the inputs */
+  if (status) {
+    skvm_threads(threads);
+    conf.pv = skvm_alloc(REG_COUNT, MAT_COUNT);
+    setup_sources(conf.pv);
+  }
+  
+  /* Go through all transforms */
+  for(x = 0; status && (x < XFORM_COUNT); x++) {
+    setup_xform(conf.pv, x);
+    
+    /* Every channel combination with the plain variant */
+    for(d = 0; status && (d < 4); d++) {
+      for(s = 0; status && (s < 3); s++) {
+        status = conf_case(&conf, x, chan[s], chan[d], VAR_PLAIN);
+      }
+    }
+    
+    /* Every other variant into ARGB and float targets */
+    for(v = VAR_PLAIN + 1; status && (v < VAR_COUNT); v++) {
+      for(d = 2; status && (d < 4); d++) {
+        status = conf_case(&conf, x, 4, chan[d], v);
+      }
+    }
+  }
+  
+  /* Exact cases */
+  if (status) {
+    store_case(&conf);
+    src_case(&conf);
+    round_case(&conf);
+  }
+  
+  /* Write the summary */
+  if (status) {
+    if (bless) {
+      fprintf(stderr,
+        "%s: %ld cases, %ld golden images written, %ld failed\n",
+        pModule, (long) conf.count, (long) conf.written,
+        (long) conf.failed);
+    } else {
+      fprintf(stderr, "%s: %ld cases, %ld failed\n",
+        pModule, (long) conf.count, (long) conf.failed);
+    }
+    if (conf.failed > 0) {
+      status = 0;
+    }
+  }
+  
+  /* Free the context and close the report */
+  skvm_free(conf.pv);
+  conf.pv = NULL;
+  
+  if (conf.pOut != NULL) {
+    if (fclose(conf.pOut)) {
+      if (status) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to close report file!\n", pModule);
+      }
+    }
+    conf.pOut = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Program entrypoint
+ * ==================
+ */
+
+int main(int argc, char *argv[]) {
+  
+  int status = 1;
+  int i = 0;
+  int bless = 0;
+  int32_t threads = 0;
+  int32_t max_err = DEF_MAX_ERR;
+  double min_psnr = DEF_MIN_PSNR;
+  const char *pOutPath = NULL;
+  const char *pGold = DEF_GOLD;
+  const char *pFilter = NULL;
+  
+  /* Set module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "skconform";
+  }
+  
+  /* Parse the options */
+  for(i = 1; status && (i < argc); i++) {
+    if (strcmp(argv[i], "-bless") == 0) {
+      bless = 1;
+      
+    } else if (strcmp(argv[i], "-nogold") == 0) {
+      pGold = NULL;
+      
+    } else if ((strcmp(argv[i], "-g") == 0) ||
+                (strcmp(argv[i], "-o") == 0) ||
+                (strcmp(argv[i], "-t") == 0) ||
+                (strcmp(argv[i], "-f") == 0) ||
+                (strcmp(argv[i], "-e") == 0) ||
+                (strcmp(argv[i], "-p") == 0)) {
+      if (i + 1 >= argc) {
+        status = 0;
+        fprintf(stderr, "%s: Missing option value!\n", pModule);
+        break;
+      }
+      
+      if (strcmp(argv[i], "-g") == 0) {
+        pGold = argv[i + 1];
+        
+      } else if (strcmp(argv[i], "-o") == 0) {
+        pOutPath = argv[i + 1];
+        
+      } else if (strcmp(argv[i], "-t") == 0) {
+        if (!parse_int(argv[i + 1], &threads)) {
+          status = 0;
+        } else if ((threads < 0) || (threads > SKVM_MAX_THREADS)) {
+          status = 0;
+        }
+        if (!status) {
+          fprintf(stderr, "%s: Invalid thread count!\n", pModule);
+        }
+        
+      } else if (strcmp(argv[i], "-f") == 0) {
+        pFilter = argv[i + 1];
+        
+      } else if (strcmp(argv[i], "-e") == 0) {
+        if (!parse_int(argv[i + 1], &max_err)) {
+          status = 0;
+        } else if ((max_err < 0) || (max_err > 255)) {
+          status = 0;
+        }
+        if (!status) {
+          fprintf(stderr, "%s: Invalid maximum error!\n", pModule);
+        }
+        
+      } else {
+        if (!parse_double(argv[i + 1], &min_psnr)) {
+          status = 0;
+          fprintf(stderr, "%s: Invalid minimum PSNR!\n", pModule);
+        }
+      }
+      i++;
+      
+    } else {
+      status = 0;
+      fprintf(stderr, "%s: Unrecognized arguments!\n", pModule);
+    }
+  }
+  
+  /* Blessing needs a golden directory */
+  if (status && bless && (pGold == NULL)) {
+    status = 0;
+    fprintf(stderr, "%s: -bless can't be used with -nogold!\n",
+      pModule);
+  }
+  
+  /* Run the cases */
+  if (status) {
+    status = run_conf(pOutPath, pGold, pFilter, bless,
+                      threads, max_err, min_psnr);
+  }
+  
+  /* Invert status and return */
+  if (status) {
+    status = 0;
+  } else {
+    status = 1;
+  }
+  return status;
+}
@@ -9,11 +9,276 @@
 
 #include "skcore.h"
 
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "sparkle.h"
 #include "skvm.h"
 
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * The maximum height of the current transform stack, including the
+ * current transform itself.
+ */
+#define CT_STACK_HEIGHT (32)
+
+/*
+ * The maximum number of points in a color_curve operation.
+ * 
+ * Each point takes two interpreter stack cells, and the operation also
+ * needs cells for the register, the channel mask, and the point count.
+ */
+#define CURVE_MAX_POINTS (14)
+
+/*
+ * The luminance weights of red, green, and blue used by the saturation
+ * and hue rotation operations.
+ * 
+ * These are the same weights used for the saturate and hueRotate color
+ * matrices of SVG filter effects.
+ */
+#define LUMA_R (0.213)
+#define LUMA_G (0.715)
+#define LUMA_B (0.072)
+
+/*
+ * Channel mask bits for the color lookup operations.
+ */
+#define CHMASK_B (1)
+#define CHMASK_G (2)
+#define CHMASK_R (4)
+#define CHMASK_A (8)
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * The current transform state of an interpreter.
+ * 
+ * Each transform is an array of six matrix values a b c d e f, in the
+ * same order as used by skvm_matrix_get() and skvm_matrix_set().
+ * 
+ * ct[depth] is the current transform, and the elements below it are
+ * the transforms saved by matrix_push.  depth is in range
+ * [0, CT_STACK_HEIGHT - 1].
+ */
+typedef struct {
+  
+  int32_t depth;
+  double ct[CT_STACK_HEIGHT][6];
+  
+} SKCORE_STATE;
+
+/*
+ * Local data
+ * ==========
+ */
+
+/*
+ * The state slot of the current transform state, as returned by
+ * register_state().
+ */
+static int32_t m_slot = -1;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/*
+ * Set a transform to the identity.
+ * 
+ * Parameters:
+ * 
+ *   pMat - the six matrix values to set
+ */
+static void ct_identity(double *pMat) {
+  
+  /* Check parameter */
+  if (pMat == NULL) {
+    abort();
+  }
+  
+  /* Set identity */
+  pMat[0] = 1.0;  pMat[1] = 0.0;  pMat[2] = 0.0;
+  pMat[3] = 0.0;  pMat[4] = 1.0;  pMat[5] = 0.0;
+}
+
+/*
+ * Postmultiply a transform by another transform.
+ * 
+ * The operation performed is:
+ * 
+ *   pMat = pMat * pOp
+ * 
+ * so the operand transform is applied before the original transform.
+ * 
+ * Parameters:
+ * 
+ *   pMat - the six matrix values to update
+ * 
+ *   pOp - the six matrix values of the operand
+ */
+static void ct_concat(double *pMat, const double *pOp) {
+  
+  double r[6];
+  
+  /* Check parameters */
+  if ((pMat == NULL) || (pOp == NULL)) {
+    abort();
+  }
+  
+  /* Compute the product */
+  r[0] = (pMat[0] * pOp[0]) + (pMat[1] * pOp[3]);
+  r[1] = (pMat[0] * pOp[1]) + (pMat[1] * pOp[4]);
+  r[2] = (pMat[0] * pOp[2]) + (pMat[1] * pOp[5]) + pMat[2];
+  
+  r[3] = (pMat[3] * pOp[0]) + (pMat[4] * pOp[3]);
+  r[4] = (pMat[3] * pOp[1]) + (pMat[4] * pOp[4]);
+  r[5] = (pMat[3] * pOp[2]) + (pMat[4] * pOp[5]) + pMat[5];
+  
+  /* Store the result */
+  memcpy(pMat, r, sizeof(double) * 6);
+}
+
+/*
+ * Apply a 256-entry lookup table to selected channels of a buffer.
+ * 
+ * ch is a combination of the CHMASK_ bits selecting the channels that
+ * the table applies to.  The other channels are left alone.  For
+ * grayscale buffers, the table applies to the gray channel if any of
+ * the color channels are selected.
+ * 
+ * The buffer must be loaded.
+ * 
+ * Parameters:
+ * 
+ *   pi - the interpreter
+ * 
+ *   i - the buffer register
+ * 
+ *   ch - the channel mask
+ * 
+ *   pTable - the 256-entry lookup table
+ */
+static void color_table(
+          INTERP  * pi,
+          int32_t   i,
+          int32_t   ch,
+    const uint8_t * pTable) {
+  
+  int32_t j = 0;
+  uint8_t lut[1024];
+  
+  /* Check parameters */
+  if ((pi == NULL) || (pTable == NULL)) {
+    abort();
+  }
+  
+  /* Grayscale buffers use the green table for the gray channel */
+  if (skvm_get_channels(interp_vm(pi), i) == 1) {
+    if (ch & (CHMASK_R | CHMASK_G | CHMASK_B)) {
+      ch = CHMASK_G;
+    }
+  }
+  
+  /* Start with identity tables for alpha, red, green, and blue */
+  for(j = 0; j < 1024; j++) {
+    lut[j] = (uint8_t) (j & 0xff);
+  }
+  
+  /* Copy the table into the selected channels */
+  if (ch & CHMASK_A) {
+    memcpy(&(lut[0]), pTable, 256);
+  }
+  if (ch & CHMASK_R) {
+    memcpy(&(lut[256]), pTable, 256);
+  }
+  if (ch & CHMASK_G) {
+    memcpy(&(lut[512]), pTable, 256);
+  }
+  if (ch & CHMASK_B) {
+    memcpy(&(lut[768]), pTable, 256);
+  }
+  
+  /* Apply the lookup */
+  skvm_color_lut(interp_vm(pi), i, lut);
+}
+
+/*
+ * Apply a 3x3 matrix to the color channels of a buffer.
+ * 
+ * pRGB holds three rows of three coefficients each, computing red,
+ * green, and blue from red, green, and blue.  Alpha is left alone and
+ * no offsets are added.
+ * 
+ * The buffer must be loaded, and the coefficients must be within the
+ * limits of skvm_color_matrix().
+ * 
+ * Parameters:
+ * 
+ *   pi - the interpreter
+ * 
+ *   i - the buffer register
+ * 
+ *   pRGB - the nine matrix coefficients
+ */
+static void color_rgb(INTERP *pi, int32_t i, const double *pRGB) {
+  
+  int32_t row = 0;
+  int32_t col = 0;
+  double m[20];
+  
+  /* Check parameters */
+  if ((pi == NULL) || (pRGB == NULL)) {
+    abort();
+  }
+  
+  /* Build the full matrix with an identity alpha row */
+  memset(m, 0, sizeof(double) * 20);
+  m[0] = 1.0;
+  for(row = 0; row < 3; row++) {
+    for(col = 0; col < 3; col++) {
+      m[((row + 1) * 5) + col + 1] = pRGB[(row * 3) + col];
+    }
+  }
+  
+  /* Apply the matrix */
+  skvm_color_matrix(interp_vm(pi), i, m);
+}
+
+/*
+ * Initialize a new current transform state block.
+ * 
+ * The stack holds only the current transform, which is the identity.
+ * 
+ * Parameters:
+ * 
+ *   pState - the SKCORE_STATE block to initialize
+ */
+static void core_state_reset(void *pState) {
+  
+  SKCORE_STATE *pst = NULL;
+  
+  /* Check parameter */
+  if (pState == NULL) {
+    abort();
+  }
+  pst = (SKCORE_STATE *) pState;
+  
+  /* Reset the stack */
+  pst->depth = 0;
+  ct_identity(pst->ct[0]);
+}
+
 /*
  * Operator functions
  * ==================
@@ -22,12 +287,12 @@
 /*
  * [message : string] print -
  */
-static int op_print(const char *pModule, long line_num) {
+static int op_print(INTERP *pi, const char *pModule, long line_num) {
   
   int status = 1;
   
   /* Check at least one parameter on stack */
-  if (stack_count() < 1) {
+  if (stack_count(pi) < 1) {
     status = 0;
     fprintf(stderr, "%s: [Line %ld] Stack underflow on print!\n",
       pModule, line_num);
@@ -35,7 +300,7 @@ static int op_print(const char *pModule, long line_num) {
   
   /* Check parameter type */
   if (status) {
-    if (cell_type(stack_index(0)) != CELLTYPE_STRING) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] print expecting string!\n",
         pModule, line_num);
@@ -45,12 +310,12 @@ static int op_print(const char *pModule, long line_num) {
   /* Print message */
   if (status) {
     fprintf(stderr, "%s: [Script at line %ld] %s\n",
-      pModule, line_num, cell_string_ptr(stack_index(0)));
+      pModule, line_num, cell_string_ptr(stack_index(pi, 0)));
   }
   
   /* Remove parameters from stack */
   if (status) {
-    stack_pop(1);
+    stack_pop(pi, 1);
   }
   
   /* Return status */
@@ -60,7 +325,7 @@ static int op_print(const char *pModule, long line_num) {
 /*
  * [i] [w] [h] [c] reset -
  */
-static int op_reset(const char *pModule, long line_num) {
+static int op_reset(INTERP *pi, const char *pModule, long line_num) {
   
   int status = 1;
   
@@ -70,7 +335,7 @@ static int op_reset(const char *pModule, long line_num) {
   int32_t c = 0;
   
   /* Check at least four parameters on stack */
-  if (stack_count() < 4) {
+  if (stack_count(pi) < 4) {
     status = 0;
     fprintf(stderr, "%s: [Line %ld] Stack underflow on reset!\n",
       pModule, line_num);
@@ -78,10 +343,10 @@ static int op_reset(const char *pModule, long line_num) {
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(3)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(2)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(1)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(0)) != CELLTYPE_INTEGER)) {
+    if ((cell_type(stack_index(pi, 3)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Wrong param types for reset!\n",
         pModule, line_num);
@@ -90,15 +355,15 @@ static int op_reset(const char *pModule, long line_num) {
   
   /* Get the parameters */
   if (status) {
-    i = cell_get_int(stack_index(3));
-    w = cell_get_int(stack_index(2));
-    h = cell_get_int(stack_index(1));
-    c = cell_get_int(stack_index(0));
+    i = cell_get_int(stack_index(pi, 3));
+    w = cell_get_int(stack_index(pi, 2));
+    h = cell_get_int(stack_index(pi, 1));
+    c = cell_get_int(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((i < 0) || (i >= skvm_bufc())) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
         pModule, line_num);
@@ -126,12 +391,12 @@ static int op_reset(const char *pModule, long line_num) {
   
   /* Perform operation */
   if (status) {
-    skvm_reset(i, w, h, c);
+    skvm_reset(interp_vm(pi), i, w, h, c);
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(4);
+    stack_pop(pi, 4);
   }
   
   /* Return status */
@@ -139,61 +404,72 @@ static int op_reset(const char *pModule, long line_num) {
 }
 
 /*
- * [i] [path] load_png -
+ * [i] [w] [h] reset_float -
  */
-static int op_load_png(const char *pModule, long line_num) {
+static int op_reset_float(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   
   int32_t i = 0;
-  const char *pPath = NULL;
+  int32_t w = 0;
+  int32_t h = 0;
   
-  /* Check at least two parameters on stack */
-  if (stack_count() < 2) {
+  /* Check at least three parameters on stack */
+  if (stack_count(pi) < 3) {
     status = 0;
-    fprintf(stderr, "%s: [Line %ld] Stack underflow on load_png!\n",
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on reset_float!\n",
       pModule, line_num);
   }
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(1)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(0)) != CELLTYPE_STRING)) {
+    if ((cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
       status = 0;
       fprintf(stderr,
-        "%s: [Line %ld] Wrong param types for load_png!\n",
+        "%s: [Line %ld] Wrong param types for reset_float!\n",
         pModule, line_num);
     }
   }
   
   /* Get the parameters */
   if (status) {
-    i = cell_get_int(stack_index(1));
-    pPath = cell_string_ptr(stack_index(0));
+    i = cell_get_int(stack_index(pi, 2));
+    w = cell_get_int(stack_index(pi, 1));
+    h = cell_get_int(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((i < 0) || (i >= skvm_bufc())) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
         pModule, line_num);
     }
   }
   
-  /* Perform operation */
+  /* Check dimensions */
   if (status) {
-    if (!skvm_load_png(i, pPath)) {
+    if ((w < 1) || (w > SKVM_MAX_DIM) ||
+        (h < 1) || (h > SKVM_MAX_DIM)) {
       status = 0;
-      fprintf(stderr, "%s: [Line %ld] load_png fail: %s\n",
-        pModule, line_num,
-        skvm_reason());
+      fprintf(stderr, "%s: [Line %ld] Dimensions out of range!\n",
+        pModule, line_num);
     }
   }
   
+  /* Perform operation */
+  if (status) {
+    skvm_reset_float(interp_vm(pi), i, w, h);
+  }
+  
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(2);
+    stack_pop(pi, 3);
   }
   
   /* Return status */
@@ -201,9 +477,9 @@ static int op_load_png(const char *pModule, long line_num) {
 }
 
 /*
- * [i] [path] load_jpeg -
+ * [i] [path] load_png -
  */
-static int op_load_jpeg(const char *pModule, long line_num) {
+static int op_load_png(INTERP *pi, const char *pModule, long line_num) {
   
   int status = 1;
   
@@ -211,51 +487,60 @@ static int op_load_jpeg(const char *pModule, long line_num) {
   const char *pPath = NULL;
   
   /* Check at least two parameters on stack */
-  if (stack_count() < 2) {
+  if (stack_count(pi) < 2) {
     status = 0;
-    fprintf(stderr, "%s: [Line %ld] Stack underflow on load_jpeg!\n",
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on load_png!\n",
       pModule, line_num);
   }
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(1)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(0)) != CELLTYPE_STRING)) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING)) {
       status = 0;
       fprintf(stderr,
-        "%s: [Line %ld] Wrong param types for load_jpeg!\n",
+        "%s: [Line %ld] Wrong param types for load_png!\n",
         pModule, line_num);
     }
   }
   
   /* Get the parameters */
   if (status) {
-    i = cell_get_int(stack_index(1));
-    pPath = cell_string_ptr(stack_index(0));
+    i = cell_get_int(stack_index(pi, 1));
+    pPath = cell_string_ptr(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((i < 0) || (i >= skvm_bufc())) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
         pModule, line_num);
     }
   }
   
+  /* Check that register is not a float buffer */
+  if (status) {
+    if (skvm_is_float(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is a float buffer!\n",
+        pModule, line_num);
+    }
+  }
+  
   /* Perform operation */
   if (status) {
-    if (!skvm_load_jpeg(i, pPath)) {
+    if (!skvm_load_png(interp_vm(pi), i, pPath)) {
       status = 0;
-      fprintf(stderr, "%s: [Line %ld] load_jpeg fail: %s\n",
+      fprintf(stderr, "%s: [Line %ld] load_png fail: %s\n",
         pModule, line_num,
-        skvm_reason());
+        skvm_reason(interp_vm(pi)));
     }
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(2);
+    stack_pop(pi, 2);
   }
   
   /* Return status */
@@ -263,64 +548,73 @@ static int op_load_jpeg(const char *pModule, long line_num) {
 }
 
 /*
- * [i] [path] load_frame -
+ * [i] [path] load_jpeg -
  */
-static int op_load_frame(const char *pModule, long line_num) {
+static int op_load_jpeg(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   
   int32_t i = 0;
-  int32_t f = 0;
   const char *pPath = NULL;
   
-  /* Check at least three parameters on stack */
-  if (stack_count() < 3) {
+  /* Check at least two parameters on stack */
+  if (stack_count(pi) < 2) {
     status = 0;
-    fprintf(stderr, "%s: [Line %ld] Stack underflow on load_frame!\n",
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on load_jpeg!\n",
       pModule, line_num);
   }
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(2)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(1)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(0)) != CELLTYPE_STRING)) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING)) {
       status = 0;
       fprintf(stderr,
-        "%s: [Line %ld] Wrong param types for load_frame!\n",
+        "%s: [Line %ld] Wrong param types for load_jpeg!\n",
         pModule, line_num);
     }
   }
   
   /* Get the parameters */
   if (status) {
-    i = cell_get_int(stack_index(2));
-    f = cell_get_int(stack_index(1));
-    pPath = cell_string_ptr(stack_index(0));
+    i = cell_get_int(stack_index(pi, 1));
+    pPath = cell_string_ptr(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((i < 0) || (i >= skvm_bufc())) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
         pModule, line_num);
     }
   }
   
+  /* Check that register is not a float buffer */
+  if (status) {
+    if (skvm_is_float(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is a float buffer!\n",
+        pModule, line_num);
+    }
+  }
+  
   /* Perform operation */
   if (status) {
-    if (!skvm_load_mjpg(i, f, pPath)) {
+    if (!skvm_load_jpeg(interp_vm(pi), i, pPath)) {
       status = 0;
-      fprintf(stderr, "%s: [Line %ld] load_frame fail: %s\n",
+      fprintf(stderr, "%s: [Line %ld] load_jpeg fail: %s\n",
         pModule, line_num,
-        skvm_reason());
+        skvm_reason(interp_vm(pi)));
     }
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(3);
+    stack_pop(pi, 2);
   }
   
   /* Return status */
@@ -328,76 +622,76 @@ static int op_load_frame(const char *pModule, long line_num) {
 }
 
 /*
- * [i] [a] [r] [g] [b] fill -
+ * [i] [path] load_frame -
  */
-static int op_fill(const char *pModule, long line_num) {
+static int op_load_frame(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   
   int32_t i = 0;
-  int32_t a = 0;
-  int32_t r = 0;
-  int32_t g = 0;
-  int32_t b = 0;
+  int32_t f = 0;
+  const char *pPath = NULL;
   
-  /* Check at least five parameters on stack */
-  if (stack_count() < 5) {
+  /* Check at least three parameters on stack */
+  if (stack_count(pi) < 3) {
     status = 0;
-    fprintf(stderr, "%s: [Line %ld] Stack underflow on fill!\n",
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on load_frame!\n",
       pModule, line_num);
   }
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(4)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(3)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(2)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(1)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(0)) != CELLTYPE_INTEGER)) {
+    if ((cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING)) {
       status = 0;
-      fprintf(stderr, "%s: [Line %ld] Wrong param types for fill!\n",
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for load_frame!\n",
         pModule, line_num);
     }
   }
   
   /* Get the parameters */
   if (status) {
-    i = cell_get_int(stack_index(4));
-    a = cell_get_int(stack_index(3));
-    r = cell_get_int(stack_index(2));
-    g = cell_get_int(stack_index(1));
-    b = cell_get_int(stack_index(0));
+    i = cell_get_int(stack_index(pi, 2));
+    f = cell_get_int(stack_index(pi, 1));
+    pPath = cell_string_ptr(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((i < 0) || (i >= skvm_bufc())) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
         pModule, line_num);
     }
   }
   
-  /* Check channel ranges */
+  /* Check that register is not a float buffer */
   if (status) {
-    if ((a < 0) || (a > 255) ||
-        (r < 0) || (r > 255) ||
-        (g < 0) || (g > 255) ||
-        (b < 0) || (b > 255)) {
+    if (skvm_is_float(interp_vm(pi), i)) {
       status = 0;
-      fprintf(stderr, "%s: [Line %ld] Channel values out of range!\n",
+      fprintf(stderr, "%s: [Line %ld] Register is a float buffer!\n",
         pModule, line_num);
     }
   }
   
   /* Perform operation */
   if (status) {
-    skvm_load_fill(i, (int) a, (int) r, (int) g, (int) b);
+    if (!skvm_load_mjpg(interp_vm(pi), i, f, pPath)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] load_frame fail: %s\n",
+        pModule, line_num,
+        skvm_reason(interp_vm(pi)));
+    }
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(5);
+    stack_pop(pi, 3);
   }
   
   /* Return status */
@@ -405,9 +699,12 @@ static int op_fill(const char *pModule, long line_num) {
 }
 
 /*
- * [i] [path] store_png -
+ * [i] [path] load_atlas -
  */
-static int op_store_png(const char *pModule, long line_num) {
+static int op_load_atlas(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   
@@ -415,32 +712,32 @@ static int op_store_png(const char *pModule, long line_num) {
   const char *pPath = NULL;
   
   /* Check at least two parameters on stack */
-  if (stack_count() < 2) {
+  if (stack_count(pi) < 2) {
     status = 0;
-    fprintf(stderr, "%s: [Line %ld] Stack underflow on store_png!\n",
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on load_atlas!\n",
       pModule, line_num);
   }
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(1)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(0)) != CELLTYPE_STRING)) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING)) {
       status = 0;
       fprintf(stderr,
-        "%s: [Line %ld] Wrong param types for store_png!\n",
+        "%s: [Line %ld] Wrong param types for load_atlas!\n",
         pModule, line_num);
     }
   }
   
   /* Get the parameters */
   if (status) {
-    i = cell_get_int(stack_index(1));
-    pPath = cell_string_ptr(stack_index(0));
+    i = cell_get_int(stack_index(pi, 1));
+    pPath = cell_string_ptr(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((i < 0) || (i >= skvm_bufc())) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
         pModule, line_num);
@@ -449,17 +746,17 @@ static int op_store_png(const char *pModule, long line_num) {
   
   /* Perform operation */
   if (status) {
-    if (!skvm_store_png(i, pPath)) {
+    if (!skvm_load_atlas(interp_vm(pi), i, pPath)) {
       status = 0;
-      fprintf(stderr, "%s: [Line %ld] store_png fail: %s\n",
+      fprintf(stderr, "%s: [Line %ld] load_atlas fail: %s\n",
         pModule, line_num,
-        skvm_reason());
+        skvm_reason(interp_vm(pi)));
     }
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(2);
+    stack_pop(pi, 2);
   }
   
   /* Return status */
@@ -467,73 +764,64 @@ static int op_store_png(const char *pModule, long line_num) {
 }
 
 /*
- * [i] [path] [q] store_jpeg -
+ * [i] [path] load_font -
  */
-static int op_store_jpeg(const char *pModule, long line_num) {
+static int op_load_font(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   
   int32_t i = 0;
   const char *pPath = NULL;
-  int32_t q = 0;
   
-  /* Check at least three parameters on stack */
-  if (stack_count() < 3) {
+  /* Check at least two parameters on stack */
+  if (stack_count(pi) < 2) {
     status = 0;
-    fprintf(stderr, "%s: [Line %ld] Stack underflow on store_jpeg!\n",
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on load_font!\n",
       pModule, line_num);
   }
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(2)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(1)) != CELLTYPE_STRING) ||
-        (cell_type(stack_index(0)) != CELLTYPE_INTEGER)) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING)) {
       status = 0;
       fprintf(stderr,
-        "%s: [Line %ld] Wrong param types for store_jpeg!\n",
+        "%s: [Line %ld] Wrong param types for load_font!\n",
         pModule, line_num);
     }
   }
   
   /* Get the parameters */
   if (status) {
-    i = cell_get_int(stack_index(2));
-    pPath = cell_string_ptr(stack_index(1));
-    q = cell_get_int(stack_index(0));
+    i = cell_get_int(stack_index(pi, 1));
+    pPath = cell_string_ptr(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((i < 0) || (i >= skvm_bufc())) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
         pModule, line_num);
     }
   }
   
-  /* Clamp quality */
-  if (status) {
-    if (q < 0) {
-      q = 0;
-    } else if (q > 100) {
-      q = 100;
-    }
-  }
-  
   /* Perform operation */
   if (status) {
-    if (!skvm_store_jpeg(i, pPath, 0, q)) {
+    if (!skvm_load_font(interp_vm(pi), i, pPath)) {
       status = 0;
-      fprintf(stderr, "%s: [Line %ld] store_jpeg fail: %s\n",
+      fprintf(stderr, "%s: [Line %ld] load_font fail: %s\n",
         pModule, line_num,
-        skvm_reason());
+        skvm_reason(interp_vm(pi)));
     }
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(3);
+    stack_pop(pi, 2);
   }
   
   /* Return status */
@@ -541,73 +829,77 @@ static int op_store_jpeg(const char *pModule, long line_num) {
 }
 
 /*
- * [i] [path] [q] store_mjpg -
+ * [i] [a] [r] [g] [b] fill -
  */
-static int op_store_mjpg(const char *pModule, long line_num) {
+static int op_fill(INTERP *pi, const char *pModule, long line_num) {
   
   int status = 1;
   
   int32_t i = 0;
-  const char *pPath = NULL;
-  int32_t q = 0;
+  int32_t a = 0;
+  int32_t r = 0;
+  int32_t g = 0;
+  int32_t b = 0;
   
-  /* Check at least three parameters on stack */
-  if (stack_count() < 3) {
+  /* Check at least five parameters on stack */
+  if (stack_count(pi) < 5) {
     status = 0;
-    fprintf(stderr, "%s: [Line %ld] Stack underflow on store_mjpg!\n",
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on fill!\n",
       pModule, line_num);
   }
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(2)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(1)) != CELLTYPE_STRING) ||
-        (cell_type(stack_index(0)) != CELLTYPE_INTEGER)) {
+    if ((cell_type(stack_index(pi, 4)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 3)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
       status = 0;
-      fprintf(stderr,
-        "%s: [Line %ld] Wrong param types for store_mjpg!\n",
+      fprintf(stderr, "%s: [Line %ld] Wrong param types for fill!\n",
         pModule, line_num);
     }
   }
   
   /* Get the parameters */
   if (status) {
-    i = cell_get_int(stack_index(2));
-    pPath = cell_string_ptr(stack_index(1));
-    q = cell_get_int(stack_index(0));
+    i = cell_get_int(stack_index(pi, 4));
+    a = cell_get_int(stack_index(pi, 3));
+    r = cell_get_int(stack_index(pi, 2));
+    g = cell_get_int(stack_index(pi, 1));
+    b = cell_get_int(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((i < 0) || (i >= skvm_bufc())) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
         pModule, line_num);
     }
   }
   
-  /* Clamp quality */
+  /* Check channel ranges */
   if (status) {
-    if (q < 0) {
-      q = 0;
-    } else if (q > 100) {
-      q = 100;
+    if ((a < 0) || (a > 255) ||
+        (r < 0) || (r > 255) ||
+        (g < 0) || (g > 255) ||
+        (b < 0) || (b > 255)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Channel values out of range!\n",
+        pModule, line_num);
     }
   }
   
   /* Perform operation */
   if (status) {
-    if (!skvm_store_jpeg(i, pPath, 1, q)) {
-      status = 0;
-      fprintf(stderr, "%s: [Line %ld] store_mjpg fail: %s\n",
-        pModule, line_num,
-        skvm_reason());
-    }
+    skvm_load_fill(interp_vm(pi),
+      i, (int) a, (int) r, (int) g, (int) b);
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(3);
+    stack_pop(pi, 5);
   }
   
   /* Return status */
@@ -615,52 +907,271 @@ static int op_store_mjpg(const char *pModule, long line_num) {
 }
 
 /*
- * [m] identity -
+ * [i] [path] store_png -
  */
-static int op_identity(const char *pModule, long line_num) {
+static int op_store_png(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
-  int32_t m = 0;
   
-  /* Check at least one parameter on stack */
-  if (stack_count() < 1) {
+  int32_t i = 0;
+  const char *pPath = NULL;
+  
+  /* Check at least two parameters on stack */
+  if (stack_count(pi) < 2) {
     status = 0;
-    fprintf(stderr, "%s: [Line %ld] Stack underflow on identity!\n",
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on store_png!\n",
       pModule, line_num);
   }
   
   /* Check parameter types */
   if (status) {
-    if (cell_type(stack_index(0)) != CELLTYPE_INTEGER) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING)) {
       status = 0;
       fprintf(stderr,
-        "%s: [Line %ld] Wrong param types for identity!\n",
+        "%s: [Line %ld] Wrong param types for store_png!\n",
         pModule, line_num);
     }
   }
   
   /* Get the parameters */
   if (status) {
-    m = cell_get_int(stack_index(0));
+    i = cell_get_int(stack_index(pi, 1));
+    pPath = cell_string_ptr(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((m < 0) || (m >= skvm_matc())) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
       status = 0;
-      fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
         pModule, line_num);
     }
   }
   
   /* Perform operation */
   if (status) {
-    skvm_matrix_reset(m);
+    if (!skvm_store_png(interp_vm(pi), i, pPath)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] store_png fail: %s\n",
+        pModule, line_num,
+        skvm_reason(interp_vm(pi)));
+    }
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 2);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [path] [q] store_jpeg -
+ */
+static int op_store_jpeg(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  
+  int32_t i = 0;
+  const char *pPath = NULL;
+  int32_t q = 0;
+  
+  /* Check at least three parameters on stack */
+  if (stack_count(pi) < 3) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on store_jpeg!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_STRING) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for store_jpeg!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 2));
+    pPath = cell_string_ptr(stack_index(pi, 1));
+    q = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Clamp quality */
+  if (status) {
+    if (q < 0) {
+      q = 0;
+    } else if (q > 100) {
+      q = 100;
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    if (!skvm_store_jpeg(interp_vm(pi), i, pPath, 0, q)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] store_jpeg fail: %s\n",
+        pModule, line_num,
+        skvm_reason(interp_vm(pi)));
+    }
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 3);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [path] [q] store_mjpg -
+ */
+static int op_store_mjpg(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  
+  int32_t i = 0;
+  const char *pPath = NULL;
+  int32_t q = 0;
+  
+  /* Check at least three parameters on stack */
+  if (stack_count(pi) < 3) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on store_mjpg!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_STRING) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for store_mjpg!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 2));
+    pPath = cell_string_ptr(stack_index(pi, 1));
+    q = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Clamp quality */
+  if (status) {
+    if (q < 0) {
+      q = 0;
+    } else if (q > 100) {
+      q = 100;
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    if (!skvm_store_jpeg(interp_vm(pi), i, pPath, 1, q)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] store_mjpg fail: %s\n",
+        pModule, line_num,
+        skvm_reason(interp_vm(pi)));
+    }
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(1);
+    stack_pop(pi, 3);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [m] identity -
+ */
+static int op_identity(INTERP *pi, const char *pModule, long line_num) {
+  
+  int status = 1;
+  int32_t m = 0;
+  
+  /* Check at least one parameter on stack */
+  if (stack_count(pi) < 1) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on identity!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for identity!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    m = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((m < 0) || (m >= skvm_matc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    skvm_matrix_reset(interp_vm(pi), m);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 1);
   }
   
   /* Return status */
@@ -670,7 +1181,7 @@ static int op_identity(const char *pModule, long line_num) {
 /*
  * [m] [a] [b] multiply -
  */
-static int op_multiply(const char *pModule, long line_num) {
+static int op_multiply(INTERP *pi, const char *pModule, long line_num) {
   
   int status = 1;
   int32_t m = 0;
@@ -678,7 +1189,7 @@ static int op_multiply(const char *pModule, long line_num) {
   int32_t b = 0;
   
   /* Check at least three parameters on stack */
-  if (stack_count() < 3) {
+  if (stack_count(pi) < 3) {
     status = 0;
     fprintf(stderr, "%s: [Line %ld] Stack underflow on multiply!\n",
       pModule, line_num);
@@ -686,9 +1197,9 @@ static int op_multiply(const char *pModule, long line_num) {
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(2)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(1)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(0)) != CELLTYPE_INTEGER)) {
+    if ((cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Wrong param types for multiply!\n",
@@ -698,28 +1209,28 @@ static int op_multiply(const char *pModule, long line_num) {
   
   /* Get the parameters */
   if (status) {
-    m = cell_get_int(stack_index(2));
-    a = cell_get_int(stack_index(1));
-    b = cell_get_int(stack_index(0));
+    m = cell_get_int(stack_index(pi, 2));
+    a = cell_get_int(stack_index(pi, 1));
+    b = cell_get_int(stack_index(pi, 0));
   }
   
   /* Check register ranges */
   if (status) {
-    if ((m < 0) || (m >= skvm_matc())) {
+    if ((m < 0) || (m >= skvm_matc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
         pModule, line_num);
     }
   }
   if (status) {
-    if ((a < 0) || (a >= skvm_matc())) {
+    if ((a < 0) || (a >= skvm_matc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
         pModule, line_num);
     }
   }
   if (status) {
-    if ((b < 0) || (b >= skvm_matc())) {
+    if ((b < 0) || (b >= skvm_matc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
         pModule, line_num);
@@ -738,12 +1249,12 @@ static int op_multiply(const char *pModule, long line_num) {
   
   /* Perform operation */
   if (status) {
-    skvm_matrix_multiply(m, a, b);
+    skvm_matrix_multiply(interp_vm(pi), m, a, b);
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(3);
+    stack_pop(pi, 3);
   }
   
   /* Return status */
@@ -753,7 +1264,10 @@ static int op_multiply(const char *pModule, long line_num) {
 /*
  * [m] [tx] [ty] translate -
  */
-static int op_translate(const char *pModule, long line_num) {
+static int op_translate(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   
@@ -762,7 +1276,7 @@ static int op_translate(const char *pModule, long line_num) {
   double ty = 0.0;
   
   /* Check at least three parameters on stack */
-  if (stack_count() < 3) {
+  if (stack_count(pi) < 3) {
     status = 0;
     fprintf(stderr, "%s: [Line %ld] Stack underflow on translate!\n",
       pModule, line_num);
@@ -770,9 +1284,9 @@ static int op_translate(const char *pModule, long line_num) {
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(2)) != CELLTYPE_INTEGER) ||
-        (!cell_canfloat(stack_index(1))) ||
-        (!cell_canfloat(stack_index(0)))) {
+    if ((cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 1))) ||
+        (!cell_canfloat(stack_index(pi, 0)))) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Wrong param types for translate!\n",
@@ -782,14 +1296,14 @@ static int op_translate(const char *pModule, long line_num) {
   
   /* Get the parameters */
   if (status) {
-    m = cell_get_int(stack_index(2));
-    tx = cell_get_float(stack_index(1));
-    ty = cell_get_float(stack_index(0));
+    m = cell_get_int(stack_index(pi, 2));
+    tx = cell_get_float(stack_index(pi, 1));
+    ty = cell_get_float(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((m < 0) || (m >= skvm_matc())) {
+    if ((m < 0) || (m >= skvm_matc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
         pModule, line_num);
@@ -798,12 +1312,12 @@ static int op_translate(const char *pModule, long line_num) {
   
   /* Perform operation */
   if (status) {
-    skvm_matrix_translate(m, tx, ty);
+    skvm_matrix_translate(interp_vm(pi), m, tx, ty);
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(3);
+    stack_pop(pi, 3);
   }
   
   /* Return status */
@@ -813,7 +1327,7 @@ static int op_translate(const char *pModule, long line_num) {
 /*
  * [m] [sx] [sy] scale -
  */
-static int op_scale(const char *pModule, long line_num) {
+static int op_scale(INTERP *pi, const char *pModule, long line_num) {
   
   int status = 1;
   
@@ -822,7 +1336,7 @@ static int op_scale(const char *pModule, long line_num) {
   double sy = 0.0;
   
   /* Check at least three parameters on stack */
-  if (stack_count() < 3) {
+  if (stack_count(pi) < 3) {
     status = 0;
     fprintf(stderr, "%s: [Line %ld] Stack underflow on scale!\n",
       pModule, line_num);
@@ -830,9 +1344,9 @@ static int op_scale(const char *pModule, long line_num) {
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(2)) != CELLTYPE_INTEGER) ||
-        (!cell_canfloat(stack_index(1))) ||
-        (!cell_canfloat(stack_index(0)))) {
+    if ((cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 1))) ||
+        (!cell_canfloat(stack_index(pi, 0)))) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Wrong param types for scale!\n",
@@ -842,14 +1356,14 @@ static int op_scale(const char *pModule, long line_num) {
   
   /* Get the parameters */
   if (status) {
-    m = cell_get_int(stack_index(2));
-    sx = cell_get_float(stack_index(1));
-    sy = cell_get_float(stack_index(0));
+    m = cell_get_int(stack_index(pi, 2));
+    sx = cell_get_float(stack_index(pi, 1));
+    sy = cell_get_float(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((m < 0) || (m >= skvm_matc())) {
+    if ((m < 0) || (m >= skvm_matc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
         pModule, line_num);
@@ -865,12 +1379,12 @@ static int op_scale(const char *pModule, long line_num) {
   
   /* Perform operation */
   if (status) {
-    skvm_matrix_scale(m, sx, sy);
+    skvm_matrix_scale(interp_vm(pi), m, sx, sy);
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(3);
+    stack_pop(pi, 3);
   }
   
   /* Return status */
@@ -880,7 +1394,7 @@ static int op_scale(const char *pModule, long line_num) {
 /*
  * [m] [deg] rotate -
  */
-static int op_rotate(const char *pModule, long line_num) {
+static int op_rotate(INTERP *pi, const char *pModule, long line_num) {
   
   int status = 1;
   
@@ -888,7 +1402,7 @@ static int op_rotate(const char *pModule, long line_num) {
   double deg = 0.0;
   
   /* Check at least two parameters on stack */
-  if (stack_count() < 2) {
+  if (stack_count(pi) < 2) {
     status = 0;
     fprintf(stderr, "%s: [Line %ld] Stack underflow on rotate!\n",
       pModule, line_num);
@@ -896,8 +1410,8 @@ static int op_rotate(const char *pModule, long line_num) {
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(1)) != CELLTYPE_INTEGER) ||
-        (!cell_canfloat(stack_index(0)))) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 0)))) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Wrong param types for rotate!\n",
@@ -907,13 +1421,13 @@ static int op_rotate(const char *pModule, long line_num) {
   
   /* Get the parameters */
   if (status) {
-    m = cell_get_int(stack_index(1));
-    deg = cell_get_float(stack_index(0));
+    m = cell_get_int(stack_index(pi, 1));
+    deg = cell_get_float(stack_index(pi, 0));
   }
   
   /* Check register range */
   if (status) {
-    if ((m < 0) || (m >= skvm_matc())) {
+    if ((m < 0) || (m >= skvm_matc(interp_vm(pi)))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
         pModule, line_num);
@@ -922,12 +1436,12 @@ static int op_rotate(const char *pModule, long line_num) {
   
   /* Perform operation */
   if (status) {
-    skvm_matrix_rotate(m, deg);
+    skvm_matrix_rotate(interp_vm(pi), m, deg);
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(2);
+    stack_pop(pi, 2);
   }
   
   /* Return status */
@@ -935,61 +1449,136 @@ static int op_rotate(const char *pModule, long line_num) {
 }
 
 /*
- * [i] color_invert -
+ * - matrix_push -
  */
-static int op_color_invert(const char *pModule, long line_num) {
+static int op_matrix_push(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
-  int32_t i = 0;
+  SKCORE_STATE *pst = NULL;
   
-  /* Check at least one parameter on stack */
-  if (stack_count() < 1) {
+  /* Get state */
+  pst = (SKCORE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check for room on the transform stack */
+  if (pst->depth >= CT_STACK_HEIGHT - 1) {
     status = 0;
-    fprintf(stderr, "%s: [Line %ld] Stack underflow on invert!\n",
+    fprintf(stderr, "%s: [Line %ld] Matrix stack overflow!\n",
       pModule, line_num);
   }
   
-  /* Check parameter types */
+  /* Push a copy of the current transform */
   if (status) {
-    if (cell_type(stack_index(0)) != CELLTYPE_INTEGER) {
-      status = 0;
-      fprintf(stderr,
-        "%s: [Line %ld] Wrong param types for invert!\n",
-        pModule, line_num);
-    }
+    memcpy(pst->ct[pst->depth + 1], pst->ct[pst->depth],
+            sizeof(double) * 6);
+    (pst->depth)++;
   }
   
-  /* Get the parameters */
-  if (status) {
-    i = cell_get_int(stack_index(0));
+  /* Return status */
+  return status;
+}
+
+/*
+ * - matrix_pop -
+ */
+static int op_matrix_pop(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  SKCORE_STATE *pst = NULL;
+  
+  /* Get state */
+  pst = (SKCORE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check that a transform was pushed */
+  if (pst->depth < 1) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Matrix stack underflow!\n",
+      pModule, line_num);
   }
   
-  /* Check register range */
+  /* Restore the saved transform */
   if (status) {
-    if ((i < 0) || (i >= skvm_bufc())) {
-      status = 0;
-      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
-        pModule, line_num);
-    }
+    (pst->depth)--;
   }
   
-  /* Check that register is loaded */
+  /* Return status */
+  return status;
+}
+
+/*
+ * - ct_identity -
+ */
+static int op_ct_identity(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKCORE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get state */
+  pst = (SKCORE_STATE *) interp_state(pi, m_slot);
+  
+  /* Reset the current transform */
+  ct_identity(pst->ct[pst->depth]);
+  
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * [tx] [ty] ct_translate -
+ */
+static int op_ct_translate(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  double mt[6];
+  SKCORE_STATE *pst = NULL;
+  
+  /* Get state */
+  pst = (SKCORE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check at least two parameters on stack */
+  if (stack_count(pi) < 2) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on ct_translate!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
   if (status) {
-    if (!skvm_is_loaded(i)) {
+    if ((!cell_canfloat(stack_index(pi, 1))) ||
+        (!cell_canfloat(stack_index(pi, 0)))) {
       status = 0;
-      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for ct_translate!\n",
         pModule, line_num);
     }
   }
   
-  /* Perform operation */
+  /* Build the translation and apply it to the current transform */
   if (status) {
-    skvm_color_invert(i);
+    ct_identity(mt);
+    mt[2] = cell_get_float(stack_index(pi, 1));
+    mt[5] = cell_get_float(stack_index(pi, 0));
+    
+    ct_concat(pst->ct[pst->depth], mt);
   }
   
   /* Remove arguments from stack */
   if (status) {
-    stack_pop(1);
+    stack_pop(pi, 2);
   }
   
   /* Return status */
@@ -997,31 +1586,1715 @@ static int op_color_invert(const char *pModule, long line_num) {
 }
 
 /*
- * Registration function
- * =====================
+ * [sx] [sy] ct_scale -
  */
-
-void skcore_register(void) {
-  /* Diagnostic ops */
-  register_operator("print", &op_print);
+static int op_ct_scale(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
-  /* Load/store ops */
-  register_operator("reset", &op_reset);
-  register_operator("load_png", &op_load_png);
-  register_operator("load_jpeg", &op_load_jpeg);
-  register_operator("load_frame", &op_load_frame);
-  register_operator("fill", &op_fill);
-  register_operator("store_png", &op_store_png);
-  register_operator("store_jpeg", &op_store_jpeg);
-  register_operator("store_mjpg", &op_store_mjpg);
+  int status = 1;
+  double mt[6];
+  SKCORE_STATE *pst = NULL;
   
-  /* Matrix ops */
-  register_operator("identity", &op_identity);
-  register_operator("multiply", &op_multiply);
-  register_operator("translate", &op_translate);
-  register_operator("scale", &op_scale);
-  register_operator("rotate", &op_rotate);
+  /* Get state */
+  pst = (SKCORE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check at least two parameters on stack */
+  if (stack_count(pi) < 2) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on ct_scale!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((!cell_canfloat(stack_index(pi, 1))) ||
+        (!cell_canfloat(stack_index(pi, 0)))) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for ct_scale!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Build the scaling transform */
+  if (status) {
+    ct_identity(mt);
+    mt[0] = cell_get_float(stack_index(pi, 1));
+    mt[4] = cell_get_float(stack_index(pi, 0));
+  }
+  
+  /* Check that scaling values are non-zero */
+  if (status && ((mt[0] == 0.0) || (mt[4] == 0.0))) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Scaling value may not be zero!\n",
+      pModule, line_num);
+  }
+  
+  /* Apply it to the current transform */
+  if (status) {
+    ct_concat(pst->ct[pst->depth], mt);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 2);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [deg] ct_rotate -
+ */
+static int op_ct_rotate(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  double deg = 0.0;
+  double mt[6];
+  SKCORE_STATE *pst = NULL;
+  
+  /* Get state */
+  pst = (SKCORE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check at least one parameter on stack */
+  if (stack_count(pi) < 1) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on ct_rotate!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if (!cell_canfloat(stack_index(pi, 0))) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for ct_rotate!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the angle reduced to range (-360.0, 360.0) */
+  if (status) {
+    deg = fmod(cell_get_float(stack_index(pi, 0)), 360.0);
+  }
+  
+  /* Build the rotation transform, using exact values for quarter turns
+   * just like the rotate operator */
+  if (status) {
+    ct_identity(mt);
+    if ((deg == 90.0) || (deg == -270.0)) {
+      mt[0] = 0.0;   mt[1] = -1.0;
+      mt[3] = 1.0;   mt[4] = 0.0;
+      
+    } else if ((deg == 180.0) || (deg == -180.0)) {
+      mt[0] = -1.0;  mt[1] = 0.0;
+      mt[3] = 0.0;   mt[4] = -1.0;
+      
+    } else if ((deg == 270.0) || (deg == -90.0)) {
+      mt[0] = 0.0;   mt[1] = 1.0;
+      mt[3] = -1.0;  mt[4] = 0.0;
+      
+    } else if (deg != 0.0) {
+      deg = (deg * M_PI) / 180.0;
+      mt[0] = cos(deg);   mt[1] = -(sin(deg));
+      mt[3] = sin(deg);   mt[4] = cos(deg);
+    }
+  }
+  
+  /* Apply it to the current transform */
+  if (status) {
+    ct_concat(pst->ct[pst->depth], mt);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 1);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [m] ct_concat -
+ */
+static int op_ct_concat(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t m = 0;
+  double mt[6];
+  SKCORE_STATE *pst = NULL;
+  
+  /* Get state */
+  pst = (SKCORE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check at least one parameter on stack */
+  if (stack_count(pi) < 1) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on ct_concat!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for ct_concat!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    m = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((m < 0) || (m >= skvm_matc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    skvm_matrix_get(interp_vm(pi), m, mt);
+    ct_concat(pst->ct[pst->depth], mt);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 1);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [m] ct_load -
+ */
+static int op_ct_load(INTERP *pi, const char *pModule, long line_num) {
+  
+  int status = 1;
+  int32_t m = 0;
+  SKCORE_STATE *pst = NULL;
+  
+  /* Get state */
+  pst = (SKCORE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check at least one parameter on stack */
+  if (stack_count(pi) < 1) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on ct_load!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for ct_load!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    m = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((m < 0) || (m >= skvm_matc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    skvm_matrix_get(interp_vm(pi), m, pst->ct[pst->depth]);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 1);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [m] ct_store -
+ */
+static int op_ct_store(INTERP *pi, const char *pModule, long line_num) {
+  
+  int status = 1;
+  int32_t m = 0;
+  SKCORE_STATE *pst = NULL;
+  
+  /* Get state */
+  pst = (SKCORE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check at least one parameter on stack */
+  if (stack_count(pi) < 1) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on ct_store!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for ct_store!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    m = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((m < 0) || (m >= skvm_matc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    if (!skvm_matrix_set(interp_vm(pi), m, pst->ct[pst->depth])) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] ct_store fail: %s\n",
+        pModule, line_num,
+        skvm_reason(interp_vm(pi)));
+    }
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 1);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] color_invert -
+ */
+static int op_color_invert(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  
+  /* Check at least one parameter on stack */
+  if (stack_count(pi) < 1) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on invert!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for invert!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is loaded */
+  if (status) {
+    if (!skvm_is_loaded(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is not a float buffer */
+  if (status) {
+    if (skvm_is_float(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is a float buffer!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    skvm_color_invert(interp_vm(pi), i);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 1);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [ch] [in_lo] [in_hi] [gamma] [out_lo] [out_hi] color_levels -
+ */
+static int op_color_levels(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  int32_t ch = 0;
+  int32_t in_lo = 0;
+  int32_t in_hi = 0;
+  int32_t out_lo = 0;
+  int32_t out_hi = 0;
+  int32_t j = 0;
+  double gamma = 0.0;
+  double x = 0.0;
+  uint8_t table[256];
+  
+  /* Check at least seven parameters on stack */
+  if (stack_count(pi) < 7) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on color_levels!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 6)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 5)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 4)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 3)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 2))) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for color_levels!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 6));
+    ch = cell_get_int(stack_index(pi, 5));
+    in_lo = cell_get_int(stack_index(pi, 4));
+    in_hi = cell_get_int(stack_index(pi, 3));
+    gamma = cell_get_float(stack_index(pi, 2));
+    out_lo = cell_get_int(stack_index(pi, 1));
+    out_hi = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is loaded */
+  if (status) {
+    if (!skvm_is_loaded(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is not a float buffer */
+  if (status) {
+    if (skvm_is_float(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is a float buffer!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check channel mask */
+  if (status) {
+    if ((ch < 0) || (ch > 15)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Channel mask out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check levels */
+  if (status) {
+    if ((in_lo < 0) || (in_hi > 255) || (in_lo >= in_hi) ||
+        (out_lo < 0) || (out_lo > 255) ||
+        (out_hi < 0) || (out_hi > 255)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Levels out of range!\n",
+        pModule, line_num);
+    }
+  }
+  if (status) {
+    if ((!isfinite(gamma)) || (!(gamma > 0.0))) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Gamma must be greater than zero!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Build the table */
+  if (status) {
+    for(j = 0; j < 256; j++) {
+      x = ((double) (j - in_lo)) / ((double) (in_hi - in_lo));
+      if (x < 0.0) {
+        x = 0.0;
+      } else if (x > 1.0) {
+        x = 1.0;
+      }
+      
+      if (gamma != 1.0) {
+        x = pow(x, 1.0 / gamma);
+      }
+      
+      x = floor(((double) out_lo) +
+                  (x * ((double) (out_hi - out_lo))) + 0.5);
+      if (x < 0.0) {
+        x = 0.0;
+      } else if (x > 255.0) {
+        x = 255.0;
+      }
+      
+      table[j] = (uint8_t) x;
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    color_table(pi, i, ch, table);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 7);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [ch] [t] color_threshold -
+ */
+static int op_color_threshold(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  int32_t ch = 0;
+  int32_t t = 0;
+  int32_t j = 0;
+  uint8_t table[256];
+  
+  /* Check at least three parameters on stack */
+  if (stack_count(pi) < 3) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Stack underflow on color_threshold!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for color_threshold!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 2));
+    ch = cell_get_int(stack_index(pi, 1));
+    t = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is loaded */
+  if (status) {
+    if (!skvm_is_loaded(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is not a float buffer */
+  if (status) {
+    if (skvm_is_float(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is a float buffer!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check channel mask */
+  if (status) {
+    if ((ch < 0) || (ch > 15)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Channel mask out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check threshold */
+  if (status) {
+    if ((t < 0) || (t > 256)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Threshold out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Build the table */
+  if (status) {
+    for(j = 0; j < 256; j++) {
+      if (j < t) {
+        table[j] = (uint8_t) 0;
+      } else {
+        table[j] = (uint8_t) 255;
+      }
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    color_table(pi, i, ch, table);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 3);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [ch] [x1] [y1] ... [xn] [yn] [n] color_curve -
+ */
+static int op_color_curve(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  int32_t ch = 0;
+  int32_t n = 0;
+  int32_t j = 0;
+  int32_t k = 0;
+  int32_t px[CURVE_MAX_POINTS];
+  int32_t py[CURVE_MAX_POINTS];
+  uint8_t table[256];
+  
+  /* Check at least one parameter on stack */
+  if (stack_count(pi) < 1) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on color_curve!\n",
+      pModule, line_num);
+  }
+  
+  /* Get the point count */
+  if (status) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for color_curve!\n",
+        pModule, line_num);
+    }
+  }
+  if (status) {
+    n = cell_get_int(stack_index(pi, 0));
+    if ((n < 2) || (n > CURVE_MAX_POINTS)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Curve point count out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check the rest of the parameters are on the stack */
+  if (status) {
+    if (stack_count(pi) < (n * 2) + 3) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Stack underflow on color_curve!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    for(j = 1; j < (n * 2) + 3; j++) {
+      if (cell_type(stack_index(pi, j)) != CELLTYPE_INTEGER) {
+        status = 0;
+        fprintf(stderr,
+          "%s: [Line %ld] Wrong param types for color_curve!\n",
+          pModule, line_num);
+        break;
+      }
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, (n * 2) + 2));
+    ch = cell_get_int(stack_index(pi, (n * 2) + 1));
+    for(j = 0; j < n; j++) {
+      px[j] = cell_get_int(stack_index(pi, (n - j) * 2));
+      py[j] = cell_get_int(stack_index(pi, ((n - j) * 2) - 1));
+    }
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is loaded */
+  if (status) {
+    if (!skvm_is_loaded(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is not a float buffer */
+  if (status) {
+    if (skvm_is_float(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is a float buffer!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check channel mask */
+  if (status) {
+    if ((ch < 0) || (ch > 15)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Channel mask out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check points are in range and in strictly ascending X order */
+  if (status) {
+    for(j = 0; j < n; j++) {
+      if ((px[j] < 0) || (px[j] > 255) ||
+          (py[j] < 0) || (py[j] > 255) ||
+          ((j > 0) && (px[j] <= px[j - 1]))) {
+        status = 0;
+        fprintf(stderr, "%s: [Line %ld] Invalid curve points!\n",
+          pModule, line_num);
+        break;
+      }
+    }
+  }
+  
+  /* Build the table, holding the end points outside of the curve and
+   * interpolating linearly between points */
+  if (status) {
+    k = 0;
+    for(j = 0; j < 256; j++) {
+      if (j <= px[0]) {
+        table[j] = (uint8_t) py[0];
+        
+      } else if (j >= px[n - 1]) {
+        table[j] = (uint8_t) py[n - 1];
+        
+      } else {
+        while (px[k + 1] < j) {
+          k++;
+        }
+        table[j] = (uint8_t) floor(
+          ((double) py[k]) +
+          (((double) (py[k + 1] - py[k])) *
+            ((double) (j - px[k])) /
+            ((double) (px[k + 1] - px[k]))) + 0.5);
+      }
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    color_table(pi, i, ch, table);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, (n * 2) + 3);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [aa] [ar] [ag] [ab] [ao] ... [ba] [br] [bg] [bb] [bo]
+ * color_matrix -
+ */
+static int op_color_matrix(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  int32_t j = 0;
+  double m[20];
+  
+  /* Check at least 21 parameters on stack */
+  if (stack_count(pi) < 21) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on color_matrix!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if (cell_type(stack_index(pi, 20)) != CELLTYPE_INTEGER) {
+      status = 0;
+    }
+    for(j = 0; j < 20; j++) {
+      if (!cell_canfloat(stack_index(pi, j))) {
+        status = 0;
+      }
+    }
+    if (!status) {
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for color_matrix!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 20));
+    for(j = 0; j < 20; j++) {
+      m[j] = cell_get_float(stack_index(pi, 19 - j));
+    }
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is loaded */
+  if (status) {
+    if (!skvm_is_loaded(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is not a float buffer */
+  if (status) {
+    if (skvm_is_float(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is a float buffer!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check matrix values */
+  if (status) {
+    for(j = 0; j < 20; j++) {
+      if ((j % 5) == 4) {
+        if (!(fabs(m[j]) <= SKVM_CMAT_MAX_OFFSET)) {
+          status = 0;
+        }
+      } else {
+        if (!(fabs(m[j]) <= SKVM_CMAT_MAX_COEF)) {
+          status = 0;
+        }
+      }
+    }
+    if (!status) {
+      fprintf(stderr,
+        "%s: [Line %ld] Color matrix value out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    skvm_color_matrix(interp_vm(pi), i, m);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 21);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [s] color_saturate -
+ */
+static int op_color_saturate(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  double v = 0.0;
+  double m[9];
+  
+  /* Check at least two parameters on stack */
+  if (stack_count(pi) < 2) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Stack underflow on color_saturate!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 0)))) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for color_saturate!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 1));
+    v = cell_get_float(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is loaded */
+  if (status) {
+    if (!skvm_is_loaded(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is not a float buffer */
+  if (status) {
+    if (skvm_is_float(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is a float buffer!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check saturation */
+  if (status) {
+    if (!((v >= 0.0) && (v <= SKVM_CMAT_MAX_COEF))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Saturation out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Build the matrix and perform operation */
+  if (status) {
+    m[0] = LUMA_R + ((1.0 - LUMA_R) * v);
+    m[1] = LUMA_G - (LUMA_G * v);
+    m[2] = LUMA_B - (LUMA_B * v);
+    
+    m[3] = LUMA_R - (LUMA_R * v);
+    m[4] = LUMA_G + ((1.0 - LUMA_G) * v);
+    m[5] = LUMA_B - (LUMA_B * v);
+    
+    m[6] = LUMA_R - (LUMA_R * v);
+    m[7] = LUMA_G - (LUMA_G * v);
+    m[8] = LUMA_B + ((1.0 - LUMA_B) * v);
+    
+    color_rgb(pi, i, m);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 2);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [deg] color_hue -
+ */
+static int op_color_hue(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  double deg = 0.0;
+  double cv = 0.0;
+  double sv = 0.0;
+  double m[9];
+  
+  /* Check at least two parameters on stack */
+  if (stack_count(pi) < 2) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on color_hue!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 0)))) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for color_hue!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 1));
+    deg = cell_get_float(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is loaded */
+  if (status) {
+    if (!skvm_is_loaded(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is not a float buffer */
+  if (status) {
+    if (skvm_is_float(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is a float buffer!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Build the matrix and perform operation */
+  if (status) {
+    deg = fmod(deg, 360.0);
+    deg = (deg * M_PI) / 180.0;
+    cv = cos(deg);
+    sv = sin(deg);
+    
+    m[0] = LUMA_R + (cv * (1.0 - LUMA_R)) - (sv * LUMA_R);
+    m[1] = LUMA_G - (cv * LUMA_G) - (sv * LUMA_G);
+    m[2] = LUMA_B - (cv * LUMA_B) + (sv * (1.0 - LUMA_B));
+    
+    m[3] = LUMA_R - (cv * LUMA_R) + (sv * 0.143);
+    m[4] = LUMA_G + (cv * (1.0 - LUMA_G)) + (sv * 0.140);
+    m[5] = LUMA_B - (cv * LUMA_B) - (sv * 0.283);
+    
+    m[6] = LUMA_R - (cv * LUMA_R) - (sv * (1.0 - LUMA_R));
+    m[7] = LUMA_G - (cv * LUMA_G) + (sv * LUMA_G);
+    m[8] = LUMA_B + (cv * (1.0 - LUMA_B)) + (sv * LUMA_B);
+    
+    color_rgb(pi, i, m);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 2);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [sigma] blur -
+ */
+static int op_blur(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  double sigma = 0.0;
+  
+  /* Check at least two parameters on stack */
+  if (stack_count(pi) < 2) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on blur!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 0)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Wrong param types for blur!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 1));
+    sigma = cell_get_float(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is loaded */
+  if (status) {
+    if (!skvm_is_loaded(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is not a float buffer */
+  if (status) {
+    if (skvm_is_float(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is a float buffer!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check blur radius */
+  if (status) {
+    if (!isfinite(sigma)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Blur radius must be finite!\n",
+        pModule, line_num);
+    }
+  }
+  if (status) {
+    if (!((sigma >= 0.0) && (sigma <= SKVM_BLUR_MAX_SIGMA))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Blur radius out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    skvm_blur(interp_vm(pi), i, sigma);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 2);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] mask_compress -
+ */
+static int op_mask_compress(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  
+  /* Check at least one parameter on stack */
+  if (stack_count(pi) < 1) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Stack underflow on mask_compress!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter type */
+  if (status) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for mask_compress!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameter */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is loaded and grayscale */
+  if (status) {
+    if (!skvm_is_loaded(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+        pModule, line_num);
+    }
+  }
+  if (status) {
+    if (skvm_get_channels(interp_vm(pi), i) != 1) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Mask register must be grayscale!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    skvm_mask_compress(interp_vm(pi), i);
+  }
+  
+  /* Remove argument from stack */
+  if (status) {
+    stack_pop(pi, 1);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [path] load_mask -
+ */
+static int op_load_mask(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  
+  int32_t i = 0;
+  const char *pPath = NULL;
+  
+  /* Check at least two parameters on stack */
+  if (stack_count(pi) < 2) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on load_mask!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for load_mask!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 1));
+    pPath = cell_string_ptr(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is grayscale */
+  if (status) {
+    if (skvm_get_channels(interp_vm(pi), i) != 1) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Mask register must be grayscale!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    if (!skvm_load_mask(interp_vm(pi), i, pPath)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] load_mask fail: %s\n",
+        pModule, line_num,
+        skvm_reason(interp_vm(pi)));
+    }
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 2);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [path] stats -
+ */
+static int op_stats(INTERP *pi, const char *pModule, long line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  int32_t w = 0;
+  int32_t h = 0;
+  int k = 0;
+  int v = 0;
+  const char *pPath = NULL;
+  FILE *pf = NULL;
+  SKVM_STATS st;
+  
+  /* Initialize structures */
+  memset(&st, 0, sizeof(SKVM_STATS));
+  
+  /* Check at least two parameters on stack */
+  if (stack_count(pi) < 2) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on stats!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Wrong param types for stats!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 1));
+    pPath = cell_string_ptr(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((i < 0) || (i >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that register is loaded */
+  if (status) {
+    if (!skvm_is_loaded(interp_vm(pi), i)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Compute the statistics */
+  if (status) {
+    skvm_stats(interp_vm(pi), i, &st);
+    skvm_get_dim(interp_vm(pi), i, &w, &h);
+  }
+  
+  /* Open the report file for appending */
+  if (status) {
+    pf = fopen(pPath, "ab");
+    if (pf == NULL) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Can't open report file!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Append the statistics as a single line of JSON */
+  if (status) {
+    fprintf(pf, "{\"op\":\"stats\",\"line\":%ld,\"buffer\":%ld,",
+      line_num, (long) i);
+    fprintf(pf, "\"width\":%ld,\"height\":%ld,\"channels\":%d,",
+      (long) w, (long) h, st.c);
+    
+    fprintf(pf, "\"mean\":[");
+    for(k = 0; k < st.c; k++) {
+      fprintf(pf, "%s%.6f", (k > 0) ? "," : "", (st.mean)[k]);
+    }
+    fprintf(pf, "],\"min\":[");
+    for(k = 0; k < st.c; k++) {
+      fprintf(pf, "%s%d", (k > 0) ? "," : "", (st.min)[k]);
+    }
+    fprintf(pf, "],\"max\":[");
+    for(k = 0; k < st.c; k++) {
+      fprintf(pf, "%s%d", (k > 0) ? "," : "", (st.max)[k]);
+    }
+    
+    fprintf(pf, "],\"hist\":[");
+    for(k = 0; k < st.c; k++) {
+      fprintf(pf, "%s[", (k > 0) ? "," : "");
+      for(v = 0; v < 256; v++) {
+        fprintf(pf, "%s%lu", (v > 0) ? "," : "",
+          (unsigned long) (st.hist)[k][v]);
+      }
+      fprintf(pf, "]");
+    }
+    fprintf(pf, "]}\n");
+  }
+  
+  /* Close the report file if open */
+  if (pf != NULL) {
+    if (fclose(pf)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Can't write report file!\n",
+        pModule, line_num);
+    }
+    pf = NULL;
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 2);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [a] [b] [min_psnr] [min_ssim] [path] compare -
+ */
+static int op_compare(INTERP *pi, const char *pModule, long line_num) {
+  
+  int status = 1;
+  int pass = 0;
+  int k = 0;
+  int32_t a = 0;
+  int32_t b = 0;
+  int32_t aw = 0;
+  int32_t ah = 0;
+  int32_t bw = 0;
+  int32_t bh = 0;
+  double min_psnr = 0.0;
+  double min_ssim = 0.0;
+  const char *pPath = NULL;
+  FILE *pf = NULL;
+  SKVM_COMPARE cmp;
+  
+  /* Initialize structures */
+  memset(&cmp, 0, sizeof(SKVM_COMPARE));
+  
+  /* Check at least five parameters on stack */
+  if (stack_count(pi) < 5) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on compare!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 4)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 3)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 2))) ||
+        (!cell_canfloat(stack_index(pi, 1))) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for compare!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    a = cell_get_int(stack_index(pi, 4));
+    b = cell_get_int(stack_index(pi, 3));
+    min_psnr = cell_get_float(stack_index(pi, 2));
+    min_ssim = cell_get_float(stack_index(pi, 1));
+    pPath = cell_string_ptr(stack_index(pi, 0));
+  }
+  
+  /* Check register range */
+  if (status) {
+    if ((a < 0) || (a >= skvm_bufc(interp_vm(pi))) ||
+        (b < 0) || (b >= skvm_bufc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check the thresholds */
+  if (status) {
+    if ((!isfinite(min_psnr)) || (!isfinite(min_ssim))) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Compare thresholds must be finite!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that registers are loaded */
+  if (status) {
+    if ((!skvm_is_loaded(interp_vm(pi), a)) ||
+        (!skvm_is_loaded(interp_vm(pi), b))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Register is not loaded!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that registers have the same dimensions and channels */
+  if (status) {
+    skvm_get_dim(interp_vm(pi), a, &aw, &ah);
+    skvm_get_dim(interp_vm(pi), b, &bw, &bh);
+    if ((aw != bw) || (ah != bh) ||
+        (skvm_get_channels(interp_vm(pi), a) !=
+          skvm_get_channels(interp_vm(pi), b))) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Compared registers must match in size!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Compare the buffers and check against the thresholds */
+  if (status) {
+    skvm_compare(interp_vm(pi), a, b, &cmp);
+    if ((cmp.psnr >= min_psnr) && (cmp.ssim >= min_ssim)) {
+      pass = 1;
+    } else {
+      pass = 0;
+    }
+  }
+  
+  /* Open the report file for appending */
+  if (status) {
+    pf = fopen(pPath, "ab");
+    if (pf == NULL) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Can't open report file!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Append the comparison as a single line of JSON, where an infinite
+   * PSNR for identical buffers is written as null */
+  if (status) {
+    fprintf(pf, "{\"op\":\"compare\",\"line\":%ld,\"a\":%ld,\"b\":%ld,",
+      line_num, (long) a, (long) b);
+    fprintf(pf, "\"mse\":%.6f,", cmp.mse);
+    if (isfinite(cmp.psnr)) {
+      fprintf(pf, "\"psnr\":%.6f,", cmp.psnr);
+    } else {
+      fprintf(pf, "\"psnr\":null,");
+    }
+    fprintf(pf, "\"ssim\":%.6f,\"maxerr\":[", cmp.ssim);
+    for(k = 0; k < skvm_get_channels(interp_vm(pi), a); k++) {
+      fprintf(pf, "%s%ld", (k > 0) ? "," : "", (long) cmp.maxerr[k]);
+    }
+    fprintf(pf, "],\"pass\":%s}\n", pass ? "true" : "false");
+  }
+  
+  /* Close the report file if open */
+  if (pf != NULL) {
+    if (fclose(pf)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Can't write report file!\n",
+        pModule, line_num);
+    }
+    pf = NULL;
+  }
+  
+  /* Fail if a threshold was not met */
+  if (status && (!pass)) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Compare below threshold: PSNR %.3f SSIM %.6f!\n",
+      pModule, line_num, cmp.psnr, cmp.ssim);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 5);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Registration function
+ * =====================
+ */
+
+void skcore_register(void) {
+  /* State */
+  m_slot = register_state(sizeof(SKCORE_STATE), &core_state_reset, NULL);
+  
+  /* Diagnostic ops */
+  register_operator("print", &op_print);
+  
+  /* Load/store ops */
+  register_operator("reset", &op_reset);
+  register_operator("reset_float", &op_reset_float);
+  register_operator("load_png", &op_load_png);
+  register_operator("load_jpeg", &op_load_jpeg);
+  register_operator("load_frame", &op_load_frame);
+  register_operator("load_atlas", &op_load_atlas);
+  register_operator("load_font", &op_load_font);
+  register_operator("fill", &op_fill);
+  register_operator("store_png", &op_store_png);
+  register_operator("store_jpeg", &op_store_jpeg);
+  register_operator("store_mjpg", &op_store_mjpg);
+  
+  /* Matrix ops */
+  register_operator("identity", &op_identity);
+  register_operator("multiply", &op_multiply);
+  register_operator("translate", &op_translate);
+  register_operator("scale", &op_scale);
+  register_operator("rotate", &op_rotate);
+  
+  /* Current transform ops */
+  register_operator("matrix_push", &op_matrix_push);
+  register_operator("matrix_pop", &op_matrix_pop);
+  register_operator("ct_identity", &op_ct_identity);
+  register_operator("ct_translate", &op_ct_translate);
+  register_operator("ct_scale", &op_ct_scale);
+  register_operator("ct_rotate", &op_ct_rotate);
+  register_operator("ct_concat", &op_ct_concat);
+  register_operator("ct_load", &op_ct_load);
+  register_operator("ct_store", &op_ct_store);
   
   /* Color ops */
   register_operator("color_invert", &op_color_invert);
+  register_operator("color_levels", &op_color_levels);
+  register_operator("color_threshold", &op_color_threshold);
+  register_operator("color_curve", &op_color_curve);
+  register_operator("color_matrix", &op_color_matrix);
+  register_operator("color_saturate", &op_color_saturate);
+  register_operator("color_hue", &op_color_hue);
+  
+  /* Filter ops */
+  register_operator("blur", &op_blur);
+  
+  /* Mask ops */
+  register_operator("mask_compress", &op_mask_compress);
+  register_operator("load_mask", &op_load_mask);
+  
+  /* Analysis ops */
+  register_operator("stats", &op_stats);
+  register_operator("compare", &op_compare);
 }
@@ -11,139 +11,551 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "sparkle.h"
 #include "skvm.h"
 
 /*
- * Local data
- * ==========
+ * Constants
+ * =========
  */
 
 /*
- * The sample source.
- * 
- * If not yet configured, m_src will be -1 and all other fields are
- * invalid.
- * 
- * Otherwise, m_src is the buffer index that is used as the source to
- * sample from.
- * 
- * If the m_src_subarea flag is set to zero, then the rest of the fields
- * are ignored and the full source buffer will be used as the source
- * area.
- * 
- * If the m_src_subarea flag is set to non-zero, then the fields
- * m_src_buf_w and m_src_buf_h store the buffer width and the buffer
- * height at the time that the source subarea was defined, and
- * m_src_x, m_src_y, m_src_w, and m_src_h define the source subarea.
- * 
- * If a source subarea is defined, when the sample operation occurs, the
- * m_src_buf_w and m_src_buf_h values must match the current dimensions
- * of the source buffer.
+ * Channel mask bits for sample_color_levels.
  */
-static int32_t m_src = -1;
+#define CHMASK_B (1)
+#define CHMASK_G (2)
+#define CHMASK_R (4)
+#define CHMASK_A (8)
 
-static int m_src_subarea;
-static int32_t m_src_buf_w;
-static int32_t m_src_buf_h;
+/*
+ * Type declarations
+ * =================
+ */
 
-static int32_t m_src_x;
-static int32_t m_src_y;
-static int32_t m_src_w;
-static int32_t m_src_h;
+/*
+ * The sticky sampling state of an interpreter.
+ */
+typedef struct {
+  
+  /*
+   * The sample source.
+   * 
+   * If not yet configured, src will be -1 and all other fields are
+   * invalid.
+   * 
+   * Otherwise, src is the buffer index that is used as the source to
+   * sample from.
+   * 
+   * If the src_subarea flag is set to zero, then the rest of the fields
+   * are ignored and the full source buffer will be used as the source
+   * area.
+   * 
+   * If the src_subarea flag is set to non-zero, then the fields
+   * src_buf_w and src_buf_h store the buffer width and the buffer
+   * height at the time that the source subarea was defined, and src_x,
+   * src_y, src_w, and src_h define the source subarea.
+   * 
+   * If a source subarea is defined, when the sample operation occurs,
+   * the src_buf_w and src_buf_h values must match the current
+   * dimensions of the source buffer.
+   */
+  int32_t src;
+  
+  int src_subarea;
+  int32_t src_buf_w;
+  int32_t src_buf_h;
+  
+  int32_t src_x;
+  int32_t src_y;
+  int32_t src_w;
+  int32_t src_h;
+  
+  /*
+   * The sample target.
+   * 
+   * If not yet configured, target will be -1.  Otherwise, it is the
+   * buffer index that is used as the target to draw into.
+   */
+  int32_t target;
+  
+  /*
+   * The transformation matrix.
+   * 
+   * If not yet configured, matrix will be -1.  Otherwise, it is the
+   * matrix index that selects the transformation matrix.
+   */
+  int32_t matrix;
+  
+  /*
+   * The masking state.
+   * 
+   * If mask_buf is -1 then procedural masking is in effect and the
+   * other fields define the procedural mask.  Otherwise, mask_buf is
+   * the buffer index for the raster mask and the other fields are
+   * ignored.
+   * 
+   * For raster masking, mask_x and mask_y are the target pixel covered
+   * by the top-left pixel of the mask buffer.  The default is (0, 0).
+   * 
+   * For procedural masking, x_boundary and y_boundary store the
+   * normalized X and Y boundary coordinates.  right is non-zero for
+   * right mode and zero for left mode.  below is non-zero for below
+   * mode and zero and above mode.
+   * 
+   * The default is a procedural mask that doesn't mask anything.
+   * 
+   * The procedural mask may also have a shape.  shape is one of the
+   * SKVM_SHAPE_ constants, and the shape_ fields hold the shape
+   * parameters in the format of SKVM_SAMPLE_PARAM.  shape_invert is
+   * non-zero if the shape coverage is inverted.  The default is
+   * SKVM_SHAPE_NONE without inversion.
+   */
+  int32_t mask_buf;
+  int32_t mask_x;
+  int32_t mask_y;
+  double x_boundary;
+  double y_boundary;
+  int right;
+  int below;
+  
+  int shape;
+  double shape_x0;
+  double shape_y0;
+  double shape_x1;
+  double shape_y1;
+  double shape_r;
+  double shape_f;
+  int shape_invert;
+  
+  /*
+   * The sampling algorithm.
+   * 
+   * This is one of the SKVM_ALG_ constants, by default selecting
+   * bilinear interpolation.
+   */
+  int alg;
+  
+  /*
+   * The blend mode.
+   * 
+   * This is one of the SKVM_BLEND_ constants, by default selecting
+   * SKVM_BLEND_OVER.
+   */
+  int blend;
+  
+  /*
+   * The color transform applied to sampled pixels.
+   * 
+   * If use_lut is non-zero, lut holds the alpha, red, green, and blue
+   * lookup tables, in the format of skvm_color_lut().  If use_cmat is
+   * non-zero, cmat holds the 4x5 color matrix, in the format of
+   * skvm_color_matrix().  The default is no color transform.
+   */
+  int use_lut;
+  uint8_t lut[1024];
+  int use_cmat;
+  double cmat[20];
+  
+  /*
+   * The color of text drawn with the text operator.
+   * 
+   * These are the non-premultiplied alpha, red, green, and blue
+   * channels, each in range [0, 255].  The default is opaque white.
+   */
+  int text_a;
+  int text_r;
+  int text_g;
+  int text_b;
+  
+} SKSAMPLE_STATE;
 
 /*
- * The sample target.
- * 
- * If not yet configured, m_target will be -1.  Otherwise, it is the
- * buffer index that is used as the target to draw into.
+ * Local data
+ * ==========
  */
-static int32_t m_target = -1;
 
 /*
- * The transformation matrix.
- * 
- * If not yet configured, m_matrix will be -1.  Otherwise, it is the
- * matrix index that selects the transformation matrix.
+ * The state slot of the sticky sampling state, as returned by
+ * register_state().
  */
-static int32_t m_matrix = -1;
+static int32_t m_slot = -1;
 
 /*
- * The masking state.
- * 
- * If m_mask_buf is -1 then procedural masking is in effect and the
- * other fields define the procedural mask.  Otherwise, m_mask_buf is
- * the buffer index for the raster mask and the other fields are
- * ignored.
- * 
- * For procedural masking, m_x_boundary and m_y_boundary store the
- * normalized X and Y boundary coordinates.  m_right is non-zero for
- * right mode and zero for left mode.  m_below is non-zero for below
- * mode and zero and above mode.
- * 
- * The default is a procedural mask that doesn't mask anything.
+ * Local functions
+ * ===============
  */
-static int32_t m_mask_buf = -1;
-static double m_x_boundary = 0.0;
-static double m_y_boundary = 0.0;
-static int m_right = 0;
-static int m_below = 0;
 
 /*
- * The sampling algorithm.
+ * Initialize a new sticky sampling state block to the defaults.
  * 
- * This is one of the SKVM_ALG_ constants, by default selecting bilinear
- * interpolation.
+ * Parameters:
+ * 
+ *   pState - the SKSAMPLE_STATE block to initialize
  */
-static int m_alg = SKVM_ALG_BILINEAR;
+static void sample_state_reset(void *pState) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Check parameter */
+  if (pState == NULL) {
+    abort();
+  }
+  pst = (SKSAMPLE_STATE *) pState;
+  
+  /* Set the defaults */
+  pst->src = -1;
+  pst->src_subarea = 0;
+  pst->src_buf_w = 0;
+  pst->src_buf_h = 0;
+  pst->src_x = 0;
+  pst->src_y = 0;
+  pst->src_w = 0;
+  pst->src_h = 0;
+  
+  pst->target = -1;
+  pst->matrix = -1;
+  
+  pst->mask_buf = -1;
+  pst->mask_x = 0;
+  pst->mask_y = 0;
+  pst->x_boundary = 0.0;
+  pst->y_boundary = 0.0;
+  pst->right = 0;
+  pst->below = 0;
+  
+  pst->shape = SKVM_SHAPE_NONE;
+  pst->shape_x0 = 0.0;
+  pst->shape_y0 = 0.0;
+  pst->shape_x1 = 0.0;
+  pst->shape_y1 = 0.0;
+  pst->shape_r = 0.0;
+  pst->shape_f = 0.0;
+  pst->shape_invert = 0;
+  
+  pst->alg = SKVM_ALG_BILINEAR;
+  pst->blend = SKVM_BLEND_OVER;
+  
+  pst->use_lut = 0;
+  pst->use_cmat = 0;
+  
+  pst->text_a = 255;
+  pst->text_r = 255;
+  pst->text_g = 255;
+  pst->text_b = 255;
+}
 
 /*
- * Operator functions
- * ==================
+ * Compose a lookup table onto the color transform of a sticky sampling
+ * state.
+ * 
+ * The table is applied to the channels selected by ch, which is a
+ * combination of the CHMASK_ bits, after any lookup that the state
+ * already has.
+ * 
+ * Parameters:
+ * 
+ *   pst - the sampling state
+ * 
+ *   ch - the channel mask
+ * 
+ *   pTable - the 256-entry lookup table
  */
+static void sample_lut_add(
+          SKSAMPLE_STATE  * pst,
+          int32_t           ch,
+    const uint8_t         * pTable) {
+  
+  int32_t j = 0;
+  
+  /* Check parameters */
+  if ((pst == NULL) || (pTable == NULL)) {
+    abort();
+  }
+  
+  /* Start with identity tables if there is no lookup yet */
+  if (!(pst->use_lut)) {
+    for(j = 0; j < 1024; j++) {
+      (pst->lut)[j] = (uint8_t) (j & 0xff);
+    }
+    pst->use_lut = 1;
+  }
+  
+  /* Compose the table onto the selected channels */
+  for(j = 0; j < 256; j++) {
+    if (ch & CHMASK_A) {
+      (pst->lut)[j] = pTable[(pst->lut)[j]];
+    }
+    if (ch & CHMASK_R) {
+      (pst->lut)[256 + j] = pTable[(pst->lut)[256 + j]];
+    }
+    if (ch & CHMASK_G) {
+      (pst->lut)[512 + j] = pTable[(pst->lut)[512 + j]];
+    }
+    if (ch & CHMASK_B) {
+      (pst->lut)[768 + j] = pTable[(pst->lut)[768 + j]];
+    }
+  }
+}
 
 /*
- * - sample -
+ * Shared implementation of the operators that set the shape of the
+ * procedural mask.
+ * 
+ * The number of parameters taken from the stack depends on the kind
+ * of shape.  The rectangle and ellipse take the box corners and the
+ * feather width, the rounded rectangle takes the box corners, the
+ * corner radius, and the feather width, the linear ramp takes its two
+ * endpoints, and the radial ramp takes its center, radius, and
+ * feather width.
+ * 
+ * Parameters:
+ * 
+ *   pi - the interpreter
+ * 
+ *   pModule - the module name for error reports
+ * 
+ *   line_num - the line number for error reports
+ * 
+ *   kind - the SKVM_SHAPE_ constant of the shape
+ * 
+ *   pName - the operator name for error reports
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
  */
-static int op_sample(const char *pModule, long line_num) {
+static int sample_shape_set(
+          INTERP      * pi,
+    const char        * pModule,
+          long          line_num,
+          int           kind,
+    const char        * pName) {
   
   int status = 1;
-  int32_t w = 0;
-  int32_t h = 0;
-  int32_t w2 = 0;
-  int32_t h2 = 0;
-  
-  SKVM_SAMPLE_PARAM sp;
+  int argc = 0;
+  int i = 0;
+  double v[6];
+  double x0 = 0.0;
+  double y0 = 0.0;
+  double x1 = 0.0;
+  double y1 = 0.0;
+  double r = 0.0;
+  double f = 0.0;
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Check parameters */
+  if ((pi == NULL) || (pName == NULL)) {
+    abort();
+  }
+  
+  /* Initialize arrays */
+  memset(v, 0, sizeof(double) * 6);
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Get the number of parameters */
+  if ((kind == SKVM_SHAPE_RECT) || (kind == SKVM_SHAPE_ELLIPSE)) {
+    argc = 5;
+  } else if (kind == SKVM_SHAPE_RRECT) {
+    argc = 6;
+  } else if ((kind == SKVM_SHAPE_LINEAR) ||
+              (kind == SKVM_SHAPE_RADIAL)) {
+    argc = 4;
+  } else {
+    abort();
+  }
+  
+  /* Check that enough parameters */
+  if (stack_count(pi) < argc) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Stack underflow on %s!\n",
+      pModule, line_num, pName);
+  }
   
-  /* Initialize structures */
-  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  /* Check parameter types and get parameters */
+  for(i = 0; status && (i < argc); i++) {
+    if (!cell_canfloat(stack_index(pi, argc - 1 - i))) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong types for %s!\n",
+        pModule, line_num, pName);
+    }
+    if (status) {
+      v[i] = cell_get_float(stack_index(pi, argc - 1 - i));
+    }
+  }
   
-  /* Make sure that source, target, and matrix have been configured */
-  if (m_src < 0) {
+  /* Check that raster masking is not in effect */
+  if (status && (pst->mask_buf >= 0)) {
     status = 0;
     fprintf(stderr,
-      "%s: [Line %ld] source must be configured before sample!\n",
+      "%s: [Line %ld] Can't adjust procedural mask when raster mask!\n",
       pModule, line_num);
   }
   
-  if (status && (m_target < 0)) {
+  /* Check that parameters are finite and in range */
+  for(i = 0; status && (i < argc); i++) {
+    if (!isfinite(v[i])) {
+      status = 0;
+    } else if (!(fabs(v[i]) <= SKVM_SHAPE_MAX_COORD)) {
+      status = 0;
+    }
+    if (!status) {
+      fprintf(stderr,
+        "%s: [Line %ld] Mask shape parameter out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Sort the parameters into fields */
+  if (status) {
+    x0 = v[0];
+    y0 = v[1];
+    if (kind == SKVM_SHAPE_RADIAL) {
+      r = v[2];
+      f = v[3];
+    } else {
+      x1 = v[2];
+      y1 = v[3];
+      if (kind == SKVM_SHAPE_RRECT) {
+        r = v[4];
+        f = v[5];
+      } else if (kind != SKVM_SHAPE_LINEAR) {
+        f = v[4];
+      }
+    }
+  }
+  
+  /* Check the shape geometry */
+  if (status && ((r < 0.0) || (f < 0.0))) {
     status = 0;
     fprintf(stderr,
-      "%s: [Line %ld] target must be configured before sample!\n",
+    "%s: [Line %ld] Mask shape radius or feather is negative!\n",
       pModule, line_num);
   }
   
-  if (status && (m_matrix < 0)) {
+  if (status && ((kind == SKVM_SHAPE_RECT) ||
+                  (kind == SKVM_SHAPE_ELLIPSE) ||
+                  (kind == SKVM_SHAPE_RRECT))) {
+    if (!((x0 < x1) && (y0 < y1))) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Mask shape box is empty!\n",
+        pModule, line_num);
+    }
+  }
+  
+  if (status && (kind == SKVM_SHAPE_RRECT)) {
+    if ((r * 2.0 > x1 - x0) || (r * 2.0 > y1 - y0)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Mask corner radius too large for box!\n",
+        pModule, line_num);
+    }
+  }
+  
+  if (status && (kind == SKVM_SHAPE_LINEAR)) {
+    if ((x0 == x1) && (y0 == y1)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Mask ramp endpoints must be different!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Update state */
+  if (status) {
+    pst->shape = kind;
+    pst->shape_x0 = x0;
+    pst->shape_y0 = y0;
+    pst->shape_x1 = x1;
+    pst->shape_y1 = y1;
+    pst->shape_r = r;
+    pst->shape_f = f;
+  }
+  
+  /* Remove parameters from stack */
+  if (status) {
+    stack_pop(pi, argc);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Check the sticky sampling state for drawing from a given source
+ * buffer, and fill in a sampling parameter structure from it.
+ * 
+ * The target, matrix, and masking state must be configured and
+ * consistent with the source.  Everything except the source subarea
+ * and the color transform is filled in, which are left for the caller
+ * to add.
+ * 
+ * Parameters:
+ * 
+ *   pi - the interpreter
+ * 
+ *   pModule - the module name for error reports
+ * 
+ *   line_num - the line number for error reports
+ * 
+ *   pName - the operator name for error reports
+ * 
+ *   src - the source buffer
+ * 
+ *   ps - the sampling parameters to fill in
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int sample_param_fill(
+          INTERP            * pi,
+    const char              * pModule,
+          long                line_num,
+    const char              * pName,
+          int32_t             src,
+          SKVM_SAMPLE_PARAM * ps) {
+  
+  int status = 1;
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Check parameters */
+  if ((pi == NULL) || (pName == NULL) || (ps == NULL)) {
+    abort();
+  }
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Initialize structures */
+  memset(ps, 0, sizeof(SKVM_SAMPLE_PARAM));
+  
+  /* Make sure that target and matrix have been configured */
+  if (pst->target < 0) {
     status = 0;
     fprintf(stderr,
-      "%s: [Line %ld] matrix must be configured before sample!\n",
-      pModule, line_num);
+      "%s: [Line %ld] target must be configured before %s!\n",
+      pModule, line_num, pName);
+  }
+  
+  if (status && (pst->matrix < 0)) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] matrix must be configured before %s!\n",
+      pModule, line_num, pName);
   }
   
   /* Make sure that source and target are not the same */
-  if (status && (m_src == m_target)) {
+  if (status && (src == pst->target)) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Sample source and target must be different!\n",
@@ -151,15 +563,15 @@ static int op_sample(const char *pModule, long line_num) {
   }
   
   /* If raster mask defined, make sure not same as source nor target */
-  if (status && (m_mask_buf >= 0)) {
-    if (status && (m_src == m_mask_buf)) {
+  if (status && (pst->mask_buf >= 0)) {
+    if (status && (src == pst->mask_buf)) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Sample source and mask must be different!\n",
         pModule, line_num);
     }
     
-    if (status && (m_target == m_mask_buf)) {
+    if (status && (pst->target == pst->mask_buf)) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Sample target and mask must be different!\n",
@@ -169,7 +581,7 @@ static int op_sample(const char *pModule, long line_num) {
   
   /* Make sure source and target are loaded */
   if (status) {
-    if (!skvm_is_loaded(m_src)) {
+    if (!skvm_is_loaded(interp_vm(pi), src)) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Sample source buffer is not loaded!\n",
@@ -178,7 +590,7 @@ static int op_sample(const char *pModule, long line_num) {
   }
   
   if (status) {
-    if (!skvm_is_loaded(m_target)) {
+    if (!skvm_is_loaded(interp_vm(pi), pst->target)) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Sample target buffer is not loaded!\n",
@@ -186,149 +598,160 @@ static int op_sample(const char *pModule, long line_num) {
     }
   }
   
-  /* If raster mask is configured, make sure loaded, grayscale, and
-   * same dimensions as target */
-  if (status && (m_mask_buf >= 0)) {
-    if (!skvm_is_loaded(m_mask_buf)) {
+  /* If raster mask is configured, make sure loaded or compressed, and
+   * grayscale or ARGB but not float */
+  if (status && (pst->mask_buf >= 0)) {
+    if ((!skvm_is_loaded(interp_vm(pi), pst->mask_buf)) &&
+        (!skvm_is_compressed(interp_vm(pi), pst->mask_buf))) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Mask buffer is not loaded!\n",
         pModule, line_num);
     }
     
-    if (status && (skvm_get_channels(m_mask_buf) != 1)) {
+    if (status &&
+        (skvm_get_channels(interp_vm(pi), pst->mask_buf) != 1) &&
+        (skvm_get_channels(interp_vm(pi), pst->mask_buf) != 4)) {
       status = 0;
       fprintf(stderr,
-        "%s: [Line %ld] Mask buffer must be grayscale!\n",
+        "%s: [Line %ld] Mask buffer must be grayscale or ARGB!\n",
         pModule, line_num);
     }
     
-    if (status) {
-      skvm_get_dim(m_mask_buf, &w, &h);
-      skvm_get_dim(m_target, &w2, &h2);
-      if ((w != w2) || (h != h2)) {
-        status = 0;
-        fprintf(stderr,
-          "%s: [Line %ld] Mask buffer must match target dimensions!\n",
-          pModule, line_num);
-      }
-    }
-  }
-  
-  /* If subarea, make sure source still same size */
-  if (status && m_src_subarea) {
-    skvm_get_dim(m_src, &w, &h);
-    if ((w != m_src_buf_w) || (h != m_src_buf_h)) {
+    if (status && skvm_is_float(interp_vm(pi), pst->mask_buf)) {
       status = 0;
       fprintf(stderr,
-        "%s: [Line %ld] Subarea no longer valid for source!\n",
+        "%s: [Line %ld] Mask buffer may not be a float buffer!\n",
         pModule, line_num);
     }
   }
   
   /* Now fill in the sample operation structure */
   if (status) {
-    sp.src_buf = m_src;
-    sp.target_buf = m_target;
+    ps->src_buf = src;
+    ps->target_buf = pst->target;
     
-    if (m_mask_buf >= 0) {
-      sp.mask_buf = m_mask_buf;
+    if (pst->mask_buf >= 0) {
+      ps->mask_buf = pst->mask_buf;
+      ps->mask_x = pst->mask_x;
+      ps->mask_y = pst->mask_y;
     }
     
-    if (m_src_subarea) {
-      sp.src_x = m_src_x;
-      sp.src_y = m_src_y;
-      sp.src_w = m_src_w;
-      sp.src_h = m_src_h;
-    }
-    
-    sp.t_matrix = m_matrix;
+    ps->t_matrix = pst->matrix;
     
-    if (m_mask_buf < 0) {
-      sp.x_boundary = m_x_boundary;
-      sp.y_boundary = m_y_boundary;
+    if (pst->mask_buf < 0) {
+      ps->x_boundary = pst->x_boundary;
+      ps->y_boundary = pst->y_boundary;
+      
+      ps->mask_shape = pst->shape;
+      ps->shape_x0 = pst->shape_x0;
+      ps->shape_y0 = pst->shape_y0;
+      ps->shape_x1 = pst->shape_x1;
+      ps->shape_y1 = pst->shape_y1;
+      ps->shape_r = pst->shape_r;
+      ps->shape_f = pst->shape_f;
     }
     
-    sp.sample_alg = m_alg;
+    ps->sample_alg = pst->alg;
+    ps->blend = pst->blend;
     
-    sp.flags = 0;
-    if (m_src_subarea) {
-      sp.flags |= SKVM_FLAG_SUBAREA;
-    }
-    if (m_mask_buf >= 0) {
-      sp.flags |= SKVM_FLAG_RASTERMASK;
+    ps->flags = 0;
+    if (pst->mask_buf >= 0) {
+      ps->flags |= SKVM_FLAG_RASTERMASK;
     } else {
-      sp.flags |= SKVM_FLAG_PROCMASK;
-      if (m_right) {
-        sp.flags |= SKVM_FLAG_RIGHTMODE;
+      ps->flags |= SKVM_FLAG_PROCMASK;
+      if (pst->right) {
+        ps->flags |= SKVM_FLAG_RIGHTMODE;
       } else {
-        sp.flags |= SKVM_FLAG_LEFTMODE;
+        ps->flags |= SKVM_FLAG_LEFTMODE;
       }
-      if (m_below) {
-        sp.flags |= SKVM_FLAG_BELOWMODE;
+      if (pst->below) {
+        ps->flags |= SKVM_FLAG_BELOWMODE;
       } else {
-        sp.flags |= SKVM_FLAG_ABOVEMODE;
+        ps->flags |= SKVM_FLAG_ABOVEMODE;
+      }
+      if (pst->shape_invert) {
+        ps->flags |= SKVM_FLAG_SHAPEINVERT;
       }
     }
   }
   
-  /* Finally, invoke the sample operation */
-  if (status) {
-    skvm_sample(&sp);
-  }
-  
   /* Return status */
   return status;
 }
 
 /*
- * [i] sample_source -
+ * Operator functions
+ * ==================
  */
-static int op_sample_source(const char *pModule, long line_num) {
+
+/*
+ * - sample -
+ */
+static int op_sample(INTERP *pi, const char *pModule, long line_num) {
   
   int status = 1;
-  int32_t i = 0;
+  int32_t w = 0;
+  int32_t h = 0;
   
-  /* Check that at least one parameter */
-  if (stack_count() < 1) {
+  SKVM_SAMPLE_PARAM sp;
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Initialize structures */
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  
+  /* Make sure that source has been configured */
+  if (pst->src < 0) {
     status = 0;
     fprintf(stderr,
-      "%s: [Line %ld] Stack underflow on sample_source!\n",
+      "%s: [Line %ld] source must be configured before sample!\n",
       pModule, line_num);
   }
   
-  /* Check parameter types */
+  /* Check the rest of the state and fill in the sample operation
+   * structure */
   if (status) {
-    if (cell_type(stack_index(0)) != CELLTYPE_INTEGER) {
+    status = sample_param_fill(pi, pModule, line_num, "sample",
+                                pst->src, &sp);
+  }
+  
+  /* If subarea, make sure source still same size */
+  if (status && pst->src_subarea) {
+    skvm_get_dim(interp_vm(pi), pst->src, &w, &h);
+    if ((w != pst->src_buf_w) || (h != pst->src_buf_h)) {
       status = 0;
       fprintf(stderr,
-        "%s: [Line %ld] Wrong types for sample_source!\n",
+        "%s: [Line %ld] Subarea no longer valid for source!\n",
         pModule, line_num);
     }
   }
   
-  /* Get parameters */
-  if (status) {
-    i = cell_get_int(stack_index(0));
-  }
-  
-  /* Check that register is valid */
-  if (status && ((i < 0) || (i >= skvm_bufc()))) {
-    status = 0;
-    fprintf(stderr,
-      "%s: [Line %ld] Invalid buffer index!\n",
-      pModule, line_num);
-  }
-  
-  /* Update state */
+  /* Add the source subarea and the color transform */
   if (status) {
-    m_src = i;
-    m_src_subarea = 0;
+    if (pst->src_subarea) {
+      sp.flags |= SKVM_FLAG_SUBAREA;
+      sp.src_x = pst->src_x;
+      sp.src_y = pst->src_y;
+      sp.src_w = pst->src_w;
+      sp.src_h = pst->src_h;
+    }
+    if (pst->use_lut) {
+      sp.flags |= SKVM_FLAG_COLORLUT;
+      sp.pLut = pst->lut;
+    }
+    if (pst->use_cmat) {
+      sp.flags |= SKVM_FLAG_COLORMATRIX;
+      sp.pCMat = pst->cmat;
+    }
   }
   
-  /* Remove parameters from stack */
+  /* Finally, invoke the sample operation */
   if (status) {
-    stack_pop(1);
+    skvm_sample(interp_vm(pi), &sp);
   }
   
   /* Return status */
@@ -336,108 +759,97 @@ static int op_sample_source(const char *pModule, long line_num) {
 }
 
 /*
- * [i] [x] [y] [width] [height] sample_source_area -
+ * [f] [size] [string] text -
  */
-static int op_sample_source_area(const char *pModule, long line_num) {
+static int op_text(INTERP *pi, const char *pModule, long line_num) {
   
   int status = 1;
-  int32_t i = 0;
-  int32_t x = 0;
-  int32_t y = 0;
-  int32_t w = 0;
-  int32_t h = 0;
-  int32_t buf_w = 0;
-  int32_t buf_h = 0;
+  int32_t f = 0;
+  double size = 0.0;
+  const char *pText = NULL;
   
-  /* Check that at least five parameters */
-  if (stack_count() < 5) {
+  SKVM_SAMPLE_PARAM sp;
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Initialize structures */
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  
+  /* Check at least three parameters on stack */
+  if (stack_count(pi) < 3) {
     status = 0;
-    fprintf(stderr,
-      "%s: [Line %ld] Stack underflow on sample_source_area!\n",
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on text!\n",
       pModule, line_num);
   }
   
   /* Check parameter types */
   if (status) {
-    if ((cell_type(stack_index(4)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(3)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(2)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(1)) != CELLTYPE_INTEGER) ||
-        (cell_type(stack_index(0)) != CELLTYPE_INTEGER)) {
+    if ((cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 1))) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING)) {
       status = 0;
-      fprintf(stderr,
-        "%s: [Line %ld] Wrong types for sample_source_area!\n",
+      fprintf(stderr, "%s: [Line %ld] Wrong param types for text!\n",
         pModule, line_num);
     }
   }
   
-  /* Get parameters */
+  /* Get the parameters */
   if (status) {
-    i = cell_get_int(stack_index(4));
-    x = cell_get_int(stack_index(3));
-    y = cell_get_int(stack_index(2));
-    w = cell_get_int(stack_index(1));
-    h = cell_get_int(stack_index(0));
-  }
-  
-  /* Check that register is valid */
-  if (status && ((i < 0) || (i >= skvm_bufc()))) {
-    status = 0;
-    fprintf(stderr,
-      "%s: [Line %ld] Invalid buffer index!\n",
-      pModule, line_num);
+    f = cell_get_int(stack_index(pi, 2));
+    size = cell_get_float(stack_index(pi, 1));
+    pText = cell_string_ptr(stack_index(pi, 0));
   }
   
-  /* Check that width and height are at least one */
+  /* Check register range and font size */
   if (status) {
-    if ((w < 1) || (h < 1)) {
+    if ((f < 0) || (f >= skvm_bufc(interp_vm(pi)))) {
       status = 0;
-      fprintf(stderr,
-        "%s: [Line %ld] Subarea dimensions must be positive!\n",
+      fprintf(stderr, "%s: [Line %ld] Register index out of range!\n",
         pModule, line_num);
     }
   }
   
-  /* Get dimensions of buffer register */
-  if (status) {
-    skvm_get_dim(i, &buf_w, &buf_h);
-  }
-  
-  /* Check that (x, y) is within buffer register area */
   if (status) {
-    if ((x < 0) || (x >= buf_w) || (y < 0) || (y >= buf_h)) {
+    if (!((size > 0.0) && (size <= SKVM_FONT_MAX_SIZE))) {
       status = 0;
-      fprintf(stderr,
-        "%s: [Line %ld] Subarea outside of buffer boundaries!\n",
+      fprintf(stderr, "%s: [Line %ld] Font size out of range!\n",
         pModule, line_num);
     }
   }
   
-  /* Check that full extent of subarea is within buffer register area */
+  /* Make sure the buffer has a font */
   if (status) {
-    if ((x > buf_w - w) || (y > buf_h - h)) {
+    if (!skvm_has_font(interp_vm(pi), f)) {
       status = 0;
-      fprintf(stderr,
-        "%s: [Line %ld] Subarea extent outside of buffer boundaries!\n",
+      fprintf(stderr, "%s: [Line %ld] Buffer has no font!\n",
         pModule, line_num);
     }
   }
   
-  /* Update state */
+  /* Check the rest of the state and fill in the sample operation
+   * structure, without any color transform, which text does not use */
   if (status) {
-    m_src = i;
-    m_src_subarea = 1;
-    m_src_buf_w = buf_w;
-    m_src_buf_h = buf_h;
-    m_src_x = x;
-    m_src_y = y;
-    m_src_w = w;
-    m_src_h = h;
+    status = sample_param_fill(pi, pModule, line_num, "text", f, &sp);
   }
   
-  /* Remove parameters from stack */
+  /* Draw the text */
+  if (status) {
+    if (!skvm_text(interp_vm(pi), &sp, size,
+            pst->text_a, pst->text_r, pst->text_g, pst->text_b,
+            pText)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] text fail: %s\n",
+        pModule, line_num,
+        skvm_reason(interp_vm(pi)));
+    }
+  }
+  
+  /* Remove arguments from stack */
   if (status) {
-    stack_pop(5);
+    stack_pop(pi, 3);
   }
   
   /* Return status */
@@ -445,15 +857,318 @@ static int op_sample_source_area(const char *pModule, long line_num) {
 }
 
 /*
- * [i] sample_target -
+ * [i] sample_source -
  */
-static int op_sample_target(const char *pModule, long line_num) {
+static int op_sample_source(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   int32_t i = 0;
   
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
   /* Check that at least one parameter */
-  if (stack_count() < 1) {
+  if (stack_count(pi) < 1) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Stack underflow on sample_source!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong types for sample_source!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check that register is valid */
+  if (status && ((i < 0) || (i >= skvm_bufc(interp_vm(pi))))) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Invalid buffer index!\n",
+      pModule, line_num);
+  }
+  
+  /* Update state */
+  if (status) {
+    pst->src = i;
+    pst->src_subarea = 0;
+  }
+  
+  /* Remove parameters from stack */
+  if (status) {
+    stack_pop(pi, 1);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [x] [y] [width] [height] sample_source_area -
+ */
+static int op_sample_source_area(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t w = 0;
+  int32_t h = 0;
+  int32_t buf_w = 0;
+  int32_t buf_h = 0;
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check that at least five parameters */
+  if (stack_count(pi) < 5) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Stack underflow on sample_source_area!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 4)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 3)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong types for sample_source_area!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get parameters */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 4));
+    x = cell_get_int(stack_index(pi, 3));
+    y = cell_get_int(stack_index(pi, 2));
+    w = cell_get_int(stack_index(pi, 1));
+    h = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check that register is valid */
+  if (status && ((i < 0) || (i >= skvm_bufc(interp_vm(pi))))) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Invalid buffer index!\n",
+      pModule, line_num);
+  }
+  
+  /* Check that width and height are at least one */
+  if (status) {
+    if ((w < 1) || (h < 1)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Subarea dimensions must be positive!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get dimensions of buffer register */
+  if (status) {
+    skvm_get_dim(interp_vm(pi), i, &buf_w, &buf_h);
+  }
+  
+  /* Check that (x, y) is within buffer register area */
+  if (status) {
+    if ((x < 0) || (x >= buf_w) || (y < 0) || (y >= buf_h)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Subarea outside of buffer boundaries!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Check that full extent of subarea is within buffer register area */
+  if (status) {
+    if ((x > buf_w - w) || (y > buf_h - h)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Subarea extent outside of buffer boundaries!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Update state */
+  if (status) {
+    pst->src = i;
+    pst->src_subarea = 1;
+    pst->src_buf_w = buf_w;
+    pst->src_buf_h = buf_h;
+    pst->src_x = x;
+    pst->src_y = y;
+    pst->src_w = w;
+    pst->src_h = h;
+  }
+  
+  /* Remove parameters from stack */
+  if (status) {
+    stack_pop(pi, 5);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] [k] sample_source_atlas -
+ */
+static int op_sample_source_atlas(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  int32_t k = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t w = 0;
+  int32_t h = 0;
+  int32_t buf_w = 0;
+  int32_t buf_h = 0;
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check that at least two parameters */
+  if (stack_count(pi) < 2) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Stack underflow on sample_source_atlas!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types, where the sub-image may be given by index
+   * or by name */
+  if (status) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        ((cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) &&
+          (cell_type(stack_index(pi, 0)) != CELLTYPE_STRING))) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong types for sample_source_atlas!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the buffer parameter */
+  if (status) {
+    i = cell_get_int(stack_index(pi, 1));
+  }
+  
+  /* Check that register is valid and holds an atlas */
+  if (status && ((i < 0) || (i >= skvm_bufc(interp_vm(pi))))) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Invalid buffer index!\n",
+      pModule, line_num);
+  }
+  if (status) {
+    if (skvm_atlas_count(interp_vm(pi), i) < 1) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Buffer has no atlas table!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the sub-image index, looking it up if given by name */
+  if (status) {
+    if (cell_type(stack_index(pi, 0)) == CELLTYPE_STRING) {
+      k = skvm_atlas_find(interp_vm(pi), i,
+            cell_string_ptr(stack_index(pi, 0)));
+      if (k < 0) {
+        status = 0;
+        fprintf(stderr,
+          "%s: [Line %ld] Atlas has no sub-image named %s!\n",
+          pModule, line_num, cell_string_ptr(stack_index(pi, 0)));
+      }
+      
+    } else {
+      k = cell_get_int(stack_index(pi, 0));
+      if ((k < 0) || (k >= skvm_atlas_count(interp_vm(pi), i))) {
+        status = 0;
+        fprintf(stderr,
+          "%s: [Line %ld] Atlas sub-image index out of range!\n",
+          pModule, line_num);
+      }
+    }
+  }
+  
+  /* Get the sub-image rectangle and the sheet dimensions; the table
+   * guarantees that the rectangle is within the sheet */
+  if (status) {
+    skvm_atlas_get(interp_vm(pi), i, k, &x, &y, &w, &h);
+    skvm_get_dim(interp_vm(pi), i, &buf_w, &buf_h);
+  }
+  
+  /* Update state exactly as sample_source_area would */
+  if (status) {
+    pst->src = i;
+    pst->src_subarea = 1;
+    pst->src_buf_w = buf_w;
+    pst->src_buf_h = buf_h;
+    pst->src_x = x;
+    pst->src_y = y;
+    pst->src_w = w;
+    pst->src_h = h;
+  }
+  
+  /* Remove parameters from stack */
+  if (status) {
+    stack_pop(pi, 2);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [i] sample_target -
+ */
+static int op_sample_target(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check that at least one parameter */
+  if (stack_count(pi) < 1) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Stack underflow on sample_target!\n",
@@ -462,7 +1177,7 @@ static int op_sample_target(const char *pModule, long line_num) {
   
   /* Check parameter types */
   if (status) {
-    if (cell_type(stack_index(0)) != CELLTYPE_INTEGER) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Wrong types for sample_target!\n",
@@ -472,11 +1187,11 @@ static int op_sample_target(const char *pModule, long line_num) {
   
   /* Get parameters */
   if (status) {
-    i = cell_get_int(stack_index(0));
+    i = cell_get_int(stack_index(pi, 0));
   }
   
   /* Check that register is valid */
-  if (status && ((i < 0) || (i >= skvm_bufc()))) {
+  if (status && ((i < 0) || (i >= skvm_bufc(interp_vm(pi))))) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Invalid buffer index!\n",
@@ -485,12 +1200,12 @@ static int op_sample_target(const char *pModule, long line_num) {
   
   /* Update state */
   if (status) {
-    m_target = i;
+    pst->target = i;
   }
   
   /* Remove parameters from stack */
   if (status) {
-    stack_pop(1);
+    stack_pop(pi, 1);
   }
   
   /* Return status */
@@ -500,13 +1215,21 @@ static int op_sample_target(const char *pModule, long line_num) {
 /*
  * [m] sample_matrix -
  */
-static int op_sample_matrix(const char *pModule, long line_num) {
+static int op_sample_matrix(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   int32_t m = 0;
   
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
   /* Check that at least one parameter */
-  if (stack_count() < 1) {
+  if (stack_count(pi) < 1) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Stack underflow on sample_matrix!\n",
@@ -515,7 +1238,7 @@ static int op_sample_matrix(const char *pModule, long line_num) {
   
   /* Check parameter types */
   if (status) {
-    if (cell_type(stack_index(0)) != CELLTYPE_INTEGER) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Wrong types for sample_matrix!\n",
@@ -525,11 +1248,11 @@ static int op_sample_matrix(const char *pModule, long line_num) {
   
   /* Get parameters */
   if (status) {
-    m = cell_get_int(stack_index(0));
+    m = cell_get_int(stack_index(pi, 0));
   }
   
   /* Check that register is valid */
-  if (status && ((m < 0) || (m >= skvm_matc()))) {
+  if (status && ((m < 0) || (m >= skvm_matc(interp_vm(pi))))) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Invalid matrix index!\n",
@@ -538,12 +1261,12 @@ static int op_sample_matrix(const char *pModule, long line_num) {
   
   /* Update state */
   if (status) {
-    m_matrix = m;
+    pst->matrix = m;
   }
   
   /* Remove parameters from stack */
   if (status) {
-    stack_pop(1);
+    stack_pop(pi, 1);
   }
   
   /* Return status */
@@ -553,18 +1276,30 @@ static int op_sample_matrix(const char *pModule, long line_num) {
 /*
  * - sample_mask_none -
  */
-static int op_sample_mask_none(const char *pModule, long line_num) {
+static int op_sample_mask_none(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
   
   /* Ignore parameters */
   (void) pModule;
   (void) line_num;
   
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
   /* Update state */
-  m_mask_buf = -1;
-  m_x_boundary = 0.0;
-  m_y_boundary = 0.0;
-  m_right = 0;
-  m_below = 0;
+  pst->mask_buf = -1;
+  pst->mask_x = 0;
+  pst->mask_y = 0;
+  pst->x_boundary = 0.0;
+  pst->y_boundary = 0.0;
+  pst->right = 0;
+  pst->below = 0;
+  pst->shape = SKVM_SHAPE_NONE;
+  pst->shape_invert = 0;
 
   /* Return successful */
   return 1;
@@ -573,13 +1308,21 @@ static int op_sample_mask_none(const char *pModule, long line_num) {
 /*
  * [x] sample_mask_x -
  */
-static int op_sample_mask_x(const char *pModule, long line_num) {
+static int op_sample_mask_x(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   double v = 0.0;
   
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
   /* Check that at least one parameter */
-  if (stack_count() < 1) {
+  if (stack_count(pi) < 1) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Stack underflow on sample_mask_x!\n",
@@ -588,7 +1331,7 @@ static int op_sample_mask_x(const char *pModule, long line_num) {
   
   /* Check parameter types */
   if (status) {
-    if (!cell_canfloat(stack_index(0))) {
+    if (!cell_canfloat(stack_index(pi, 0))) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Wrong types for sample_mask_x\n",
@@ -598,11 +1341,11 @@ static int op_sample_mask_x(const char *pModule, long line_num) {
   
   /* Get parameters */
   if (status) {
-    v = cell_get_float(stack_index(0));
+    v = cell_get_float(stack_index(pi, 0));
   }
   
   /* Check that raster masking is not in effect */
-  if (status && (m_mask_buf >= 0)) {
+  if (status && (pst->mask_buf >= 0)) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Can't adjust procedural mask when raster mask!\n",
@@ -625,12 +1368,12 @@ static int op_sample_mask_x(const char *pModule, long line_num) {
   
   /* Update state */
   if (status) {
-    m_x_boundary = v;
+    pst->x_boundary = v;
   }
   
   /* Remove parameters from stack */
   if (status) {
-    stack_pop(1);
+    stack_pop(pi, 1);
   }
   
   /* Return status */
@@ -640,13 +1383,21 @@ static int op_sample_mask_x(const char *pModule, long line_num) {
 /*
  * [x] sample_mask_y -
  */
-static int op_sample_mask_y(const char *pModule, long line_num) {
+static int op_sample_mask_y(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   double v = 0.0;
   
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
   /* Check that at least one parameter */
-  if (stack_count() < 1) {
+  if (stack_count(pi) < 1) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Stack underflow on sample_mask_y!\n",
@@ -655,7 +1406,7 @@ static int op_sample_mask_y(const char *pModule, long line_num) {
   
   /* Check parameter types */
   if (status) {
-    if (!cell_canfloat(stack_index(0))) {
+    if (!cell_canfloat(stack_index(pi, 0))) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Wrong types for sample_mask_y\n",
@@ -665,11 +1416,11 @@ static int op_sample_mask_y(const char *pModule, long line_num) {
   
   /* Get parameters */
   if (status) {
-    v = cell_get_float(stack_index(0));
+    v = cell_get_float(stack_index(pi, 0));
   }
   
   /* Check that raster masking is not in effect */
-  if (status && (m_mask_buf >= 0)) {
+  if (status && (pst->mask_buf >= 0)) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Can't adjust procedural mask when raster mask!\n",
@@ -692,12 +1443,12 @@ static int op_sample_mask_y(const char *pModule, long line_num) {
   
   /* Update state */
   if (status) {
-    m_y_boundary = v;
+    pst->y_boundary = v;
   }
   
   /* Remove parameters from stack */
   if (status) {
-    stack_pop(1);
+    stack_pop(pi, 1);
   }
   
   /* Return status */
@@ -707,12 +1458,20 @@ static int op_sample_mask_y(const char *pModule, long line_num) {
 /*
  * - sample_mask_left -
  */
-static int op_sample_mask_left(const char *pModule, long line_num) {
+static int op_sample_mask_left(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
   /* Check that raster masking is not in effect */
-  if (status && (m_mask_buf >= 0)) {
+  if (status && (pst->mask_buf >= 0)) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Can't adjust procedural mask when raster mask!\n",
@@ -721,7 +1480,7 @@ static int op_sample_mask_left(const char *pModule, long line_num) {
   
   /* Update state */
   if (status) {
-    m_right = 0;
+    pst->right = 0;
   }
 
   /* Return status */
@@ -731,12 +1490,20 @@ static int op_sample_mask_left(const char *pModule, long line_num) {
 /*
  * - sample_mask_right -
  */
-static int op_sample_mask_right(const char *pModule, long line_num) {
+static int op_sample_mask_right(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
   /* Check that raster masking is not in effect */
-  if (status && (m_mask_buf >= 0)) {
+  if (status && (pst->mask_buf >= 0)) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Can't adjust procedural mask when raster mask!\n",
@@ -745,7 +1512,7 @@ static int op_sample_mask_right(const char *pModule, long line_num) {
   
   /* Update state */
   if (status) {
-    m_right = 1;
+    pst->right = 1;
   }
 
   /* Return status */
@@ -755,12 +1522,20 @@ static int op_sample_mask_right(const char *pModule, long line_num) {
 /*
  * - sample_mask_above -
  */
-static int op_sample_mask_above(const char *pModule, long line_num) {
+static int op_sample_mask_above(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
   /* Check that raster masking is not in effect */
-  if (status && (m_mask_buf >= 0)) {
+  if (status && (pst->mask_buf >= 0)) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Can't adjust procedural mask when raster mask!\n",
@@ -769,7 +1544,7 @@ static int op_sample_mask_above(const char *pModule, long line_num) {
   
   /* Update state */
   if (status) {
-    m_below = 0;
+    pst->below = 0;
   }
 
   /* Return status */
@@ -779,12 +1554,20 @@ static int op_sample_mask_above(const char *pModule, long line_num) {
 /*
  * - sample_mask_below -
  */
-static int op_sample_mask_below(const char *pModule, long line_num) {
+static int op_sample_mask_below(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
   /* Check that raster masking is not in effect */
-  if (status && (m_mask_buf >= 0)) {
+  if (status && (pst->mask_buf >= 0)) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Can't adjust procedural mask when raster mask!\n",
@@ -793,7 +1576,7 @@ static int op_sample_mask_below(const char *pModule, long line_num) {
   
   /* Update state */
   if (status) {
-    m_below = 1;
+    pst->below = 1;
   }
 
   /* Return status */
@@ -803,13 +1586,21 @@ static int op_sample_mask_below(const char *pModule, long line_num) {
 /*
  * [i] sample_mask_raster -
  */
-static int op_sample_mask_raster(const char *pModule, long line_num) {
+static int op_sample_mask_raster(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
   int status = 1;
   int32_t i = 0;
   
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
   /* Check that at least one parameter */
-  if (stack_count() < 1) {
+  if (stack_count(pi) < 1) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Stack underflow on sample_mask_raster!\n",
@@ -818,7 +1609,7 @@ static int op_sample_mask_raster(const char *pModule, long line_num) {
   
   /* Check parameter types */
   if (status) {
-    if (cell_type(stack_index(0)) != CELLTYPE_INTEGER) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
       status = 0;
       fprintf(stderr,
         "%s: [Line %ld] Wrong types for sample_mask_raster!\n",
@@ -828,11 +1619,11 @@ static int op_sample_mask_raster(const char *pModule, long line_num) {
   
   /* Get parameters */
   if (status) {
-    i = cell_get_int(stack_index(0));
+    i = cell_get_int(stack_index(pi, 0));
   }
   
   /* Check that register is valid */
-  if (status && ((i < 0) || (i >= skvm_bufc()))) {
+  if (status && ((i < 0) || (i >= skvm_bufc(interp_vm(pi))))) {
     status = 0;
     fprintf(stderr,
       "%s: [Line %ld] Invalid buffer index!\n",
@@ -841,12 +1632,12 @@ static int op_sample_mask_raster(const char *pModule, long line_num) {
   
   /* Update state */
   if (status) {
-    m_mask_buf = i;
+    pst->mask_buf = i;
   }
   
   /* Remove parameters from stack */
   if (status) {
-    stack_pop(1);
+    stack_pop(pi, 1);
   }
   
   /* Return status */
@@ -854,62 +1645,756 @@ static int op_sample_mask_raster(const char *pModule, long line_num) {
 }
 
 /*
- * - sample_nearest -
+ * [x] [y] sample_mask_offset -
  */
-static int op_sample_nearest(const char *pModule, long line_num) {
+static int op_sample_mask_offset(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
   
-  /* Ignore parameters */
-  (void) pModule;
-  (void) line_num;
+  int status = 1;
+  int32_t x = 0;
+  int32_t y = 0;
   
-  /* Update state */
-  m_alg = SKVM_ALG_NEAREST;
-
-  /* Return successful */
-  return 1;
-}
-
-/*
- * - sample_bilinear -
- */
-static int op_sample_bilinear(const char *pModule, long line_num) {
+  SKSAMPLE_STATE *pst = NULL;
   
-  /* Ignore parameters */
-  (void) pModule;
-  (void) line_num;
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
   
-  /* Update state */
-  m_alg = SKVM_ALG_BILINEAR;
-
-  /* Return successful */
-  return 1;
-}
-
-/*
- * - sample_bicubic -
- */
-static int op_sample_bicubic(const char *pModule, long line_num) {
+  /* Check that at least two parameters */
+  if (stack_count(pi) < 2) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Stack underflow on sample_mask_offset!\n",
+      pModule, line_num);
+  }
   
-  /* Ignore parameters */
-  (void) pModule;
-  (void) line_num;
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong types for sample_mask_offset!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get parameters */
+  if (status) {
+    x = cell_get_int(stack_index(pi, 1));
+    y = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check that raster masking is in effect */
+  if (status && (pst->mask_buf < 0)) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Can't offset mask unless raster mask!\n",
+      pModule, line_num);
+  }
+  
+  /* Check that offset is in range */
+  if (status && ((x < -SKVM_MAX_DIM) || (x > SKVM_MAX_DIM) ||
+                  (y < -SKVM_MAX_DIM) || (y > SKVM_MAX_DIM))) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Mask offset out of range!\n",
+      pModule, line_num);
+  }
+  
+  /* Update state */
+  if (status) {
+    pst->mask_x = x;
+    pst->mask_y = y;
+  }
+  
+  /* Remove parameters from stack */
+  if (status) {
+    stack_pop(pi, 2);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [x0] [y0] [x1] [y1] [f] sample_mask_rect -
+ */
+static int op_sample_mask_rect(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  return sample_shape_set(pi, pModule, line_num,
+                          SKVM_SHAPE_RECT, "sample_mask_rect");
+}
+
+/*
+ * [x0] [y0] [x1] [y1] [f] sample_mask_ellipse -
+ */
+static int op_sample_mask_ellipse(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  return sample_shape_set(pi, pModule, line_num,
+                          SKVM_SHAPE_ELLIPSE, "sample_mask_ellipse");
+}
+
+/*
+ * [x0] [y0] [x1] [y1] [r] [f] sample_mask_rrect -
+ */
+static int op_sample_mask_rrect(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  return sample_shape_set(pi, pModule, line_num,
+                          SKVM_SHAPE_RRECT, "sample_mask_rrect");
+}
+
+/*
+ * [x0] [y0] [x1] [y1] sample_mask_linear -
+ */
+static int op_sample_mask_linear(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  return sample_shape_set(pi, pModule, line_num,
+                          SKVM_SHAPE_LINEAR, "sample_mask_linear");
+}
+
+/*
+ * [x] [y] [r] [f] sample_mask_radial -
+ */
+static int op_sample_mask_radial(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  return sample_shape_set(pi, pModule, line_num,
+                          SKVM_SHAPE_RADIAL, "sample_mask_radial");
+}
+
+/*
+ * - sample_mask_invert -
+ */
+static int op_sample_mask_invert(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check that raster masking is not in effect */
+  if (status && (pst->mask_buf >= 0)) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Can't adjust procedural mask when raster mask!\n",
+      pModule, line_num);
+  }
+  
+  /* Update state */
+  if (status) {
+    if (pst->shape_invert) {
+      pst->shape_invert = 0;
+    } else {
+      pst->shape_invert = 1;
+    }
+  }
+
+  /* Return status */
+  return status;
+}
+
+/*
+ * - sample_nearest -
+ */
+static int op_sample_nearest(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Update state */
+  pst->alg = SKVM_ALG_NEAREST;
+
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * - sample_bilinear -
+ */
+static int op_sample_bilinear(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Update state */
+  pst->alg = SKVM_ALG_BILINEAR;
+
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * - sample_bicubic -
+ */
+static int op_sample_bicubic(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Update state */
+  pst->alg = SKVM_ALG_BICUBIC;
+
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * - sample_blend_over -
+ */
+static int op_sample_blend_over(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Update state */
+  pst->blend = SKVM_BLEND_OVER;
+
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * - sample_blend_add -
+ */
+static int op_sample_blend_add(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Update state */
+  pst->blend = SKVM_BLEND_ADD;
+
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * - sample_blend_multiply -
+ */
+static int op_sample_blend_multiply(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Update state */
+  pst->blend = SKVM_BLEND_MULTIPLY;
+
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * - sample_blend_screen -
+ */
+static int op_sample_blend_screen(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Update state */
+  pst->blend = SKVM_BLEND_SCREEN;
+
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * - sample_blend_src -
+ */
+static int op_sample_blend_src(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Update state */
+  pst->blend = SKVM_BLEND_SRC;
+
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * - sample_blend_dst_in -
+ */
+static int op_sample_blend_dst_in(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Update state */
+  pst->blend = SKVM_BLEND_DSTIN;
+
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * - sample_blend_dst_out -
+ */
+static int op_sample_blend_dst_out(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Update state */
+  pst->blend = SKVM_BLEND_DSTOUT;
+
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * - sample_color_none -
+ */
+static int op_sample_color_none(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Update state */
+  pst->use_lut = 0;
+  pst->use_cmat = 0;
+
+  /* Return successful */
+  return 1;
+}
+
+/*
+ * - sample_color_invert -
+ */
+static int op_sample_color_invert(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int32_t j = 0;
+  uint8_t table[256];
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Ignore parameters */
+  (void) pModule;
+  (void) line_num;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
   
   /* Update state */
-  m_alg = SKVM_ALG_BICUBIC;
+  for(j = 0; j < 256; j++) {
+    table[j] = (uint8_t) (255 - j);
+  }
+  sample_lut_add(pst, CHMASK_R | CHMASK_G | CHMASK_B, table);
 
   /* Return successful */
   return 1;
 }
 
+/*
+ * [ch] [in_lo] [in_hi] [gamma] [out_lo] [out_hi] sample_color_levels -
+ */
+static int op_sample_color_levels(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t ch = 0;
+  int32_t in_lo = 0;
+  int32_t in_hi = 0;
+  int32_t out_lo = 0;
+  int32_t out_hi = 0;
+  int32_t j = 0;
+  double gamma = 0.0;
+  double x = 0.0;
+  uint8_t table[256];
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check that at least six parameters */
+  if (stack_count(pi) < 6) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Stack underflow on sample_color_levels!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 5)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 4)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 3)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 2))) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong types for sample_color_levels!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get parameters */
+  if (status) {
+    ch = cell_get_int(stack_index(pi, 5));
+    in_lo = cell_get_int(stack_index(pi, 4));
+    in_hi = cell_get_int(stack_index(pi, 3));
+    gamma = cell_get_float(stack_index(pi, 2));
+    out_lo = cell_get_int(stack_index(pi, 1));
+    out_hi = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check parameters */
+  if (status && ((ch < 0) || (ch > 15))) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Channel mask out of range!\n",
+      pModule, line_num);
+  }
+  
+  if (status && ((in_lo < 0) || (in_hi > 255) || (in_lo >= in_hi) ||
+                  (out_lo < 0) || (out_lo > 255) ||
+                  (out_hi < 0) || (out_hi > 255))) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Levels out of range!\n",
+      pModule, line_num);
+  }
+  
+  if (status && ((!isfinite(gamma)) || (!(gamma > 0.0)))) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Gamma must be greater than zero!\n",
+      pModule, line_num);
+  }
+  
+  /* Build the table, in the same way as color_levels */
+  if (status) {
+    for(j = 0; j < 256; j++) {
+      x = ((double) (j - in_lo)) / ((double) (in_hi - in_lo));
+      if (x < 0.0) {
+        x = 0.0;
+      } else if (x > 1.0) {
+        x = 1.0;
+      }
+      
+      if (gamma != 1.0) {
+        x = pow(x, 1.0 / gamma);
+      }
+      
+      x = floor(((double) out_lo) +
+                  (x * ((double) (out_hi - out_lo))) + 0.5);
+      if (x < 0.0) {
+        x = 0.0;
+      } else if (x > 255.0) {
+        x = 255.0;
+      }
+      
+      table[j] = (uint8_t) x;
+    }
+  }
+  
+  /* Update state */
+  if (status) {
+    sample_lut_add(pst, ch, table);
+  }
+  
+  /* Remove parameters from stack */
+  if (status) {
+    stack_pop(pi, 6);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [aa] [ar] [ag] [ab] [ao] ... [ba] [br] [bg] [bb] [bo]
+ * sample_color_matrix -
+ */
+static int op_sample_color_matrix(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t j = 0;
+  double m[20];
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check that at least twenty parameters */
+  if (stack_count(pi) < 20) {
+    status = 0;
+    fprintf(stderr,
+      "%s: [Line %ld] Stack underflow on sample_color_matrix!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    for(j = 0; j < 20; j++) {
+      if (!cell_canfloat(stack_index(pi, j))) {
+        status = 0;
+        fprintf(stderr,
+          "%s: [Line %ld] Wrong types for sample_color_matrix!\n",
+          pModule, line_num);
+        break;
+      }
+    }
+  }
+  
+  /* Get parameters */
+  if (status) {
+    for(j = 0; j < 20; j++) {
+      m[j] = cell_get_float(stack_index(pi, 19 - j));
+    }
+  }
+  
+  /* Check matrix values */
+  if (status) {
+    for(j = 0; j < 20; j++) {
+      if ((j % 5) == 4) {
+        if (!(fabs(m[j]) <= SKVM_CMAT_MAX_OFFSET)) {
+          status = 0;
+        }
+      } else {
+        if (!(fabs(m[j]) <= SKVM_CMAT_MAX_COEF)) {
+          status = 0;
+        }
+      }
+    }
+    if (!status) {
+      fprintf(stderr,
+        "%s: [Line %ld] Color matrix value out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Update state */
+  if (status) {
+    memcpy(pst->cmat, m, sizeof(double) * 20);
+    pst->use_cmat = 1;
+  }
+  
+  /* Remove parameters from stack */
+  if (status) {
+    stack_pop(pi, 20);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [a] [r] [g] [b] text_color -
+ */
+static int op_text_color(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  
+  int32_t a = 0;
+  int32_t r = 0;
+  int32_t g = 0;
+  int32_t b = 0;
+  
+  SKSAMPLE_STATE *pst = NULL;
+  
+  /* Get the sampling state */
+  pst = (SKSAMPLE_STATE *) interp_state(pi, m_slot);
+  
+  /* Check at least four parameters on stack */
+  if (stack_count(pi) < 4) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on text_color!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 3)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for text_color!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    a = cell_get_int(stack_index(pi, 3));
+    r = cell_get_int(stack_index(pi, 2));
+    g = cell_get_int(stack_index(pi, 1));
+    b = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Check channel ranges */
+  if (status) {
+    if ((a < 0) || (a > 255) ||
+        (r < 0) || (r > 255) ||
+        (g < 0) || (g > 255) ||
+        (b < 0) || (b > 255)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Channel values out of range!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Update state */
+  if (status) {
+    pst->text_a = (int) a;
+    pst->text_r = (int) r;
+    pst->text_g = (int) g;
+    pst->text_b = (int) b;
+  }
+  
+  /* Remove parameters from stack */
+  if (status) {
+    stack_pop(pi, 4);
+  }
+  
+  /* Return status */
+  return status;
+}
+
 /*
  * Registration function
  * =====================
  */
 
 void sksample_register(void) {
+  m_slot = register_state(sizeof(SKSAMPLE_STATE), &sample_state_reset, NULL);
+  
   register_operator("sample", &op_sample);
   register_operator("sample_source", &op_sample_source);
   register_operator("sample_source_area", &op_sample_source_area);
+  register_operator("sample_source_atlas", &op_sample_source_atlas);
   register_operator("sample_target", &op_sample_target);
   register_operator("sample_matrix", &op_sample_matrix);
   register_operator("sample_mask_none", &op_sample_mask_none);
@@ -920,7 +2405,27 @@ void sksample_register(void) {
   register_operator("sample_mask_above", &op_sample_mask_above);
   register_operator("sample_mask_below", &op_sample_mask_below);
   register_operator("sample_mask_raster", &op_sample_mask_raster);
+  register_operator("sample_mask_offset", &op_sample_mask_offset);
+  register_operator("sample_mask_rect", &op_sample_mask_rect);
+  register_operator("sample_mask_ellipse", &op_sample_mask_ellipse);
+  register_operator("sample_mask_rrect", &op_sample_mask_rrect);
+  register_operator("sample_mask_linear", &op_sample_mask_linear);
+  register_operator("sample_mask_radial", &op_sample_mask_radial);
+  register_operator("sample_mask_invert", &op_sample_mask_invert);
   register_operator("sample_nearest", &op_sample_nearest);
   register_operator("sample_bilinear", &op_sample_bilinear);
   register_operator("sample_bicubic", &op_sample_bilinear);
+  register_operator("sample_blend_over", &op_sample_blend_over);
+  register_operator("sample_blend_add", &op_sample_blend_add);
+  register_operator("sample_blend_multiply", &op_sample_blend_multiply);
+  register_operator("sample_blend_screen", &op_sample_blend_screen);
+  register_operator("sample_blend_src", &op_sample_blend_src);
+  register_operator("sample_blend_dst_in", &op_sample_blend_dst_in);
+  register_operator("sample_blend_dst_out", &op_sample_blend_dst_out);
+  register_operator("sample_color_none", &op_sample_color_none);
+  register_operator("sample_color_invert", &op_sample_color_invert);
+  register_operator("sample_color_levels", &op_sample_color_levels);
+  register_operator("sample_color_matrix", &op_sample_color_matrix);
+  register_operator("text", &op_text);
+  register_operator("text_color", &op_text_color);
 }
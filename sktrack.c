@@ -0,0 +1,617 @@
+/*
+ * sktrack.c
+ * =========
+ * 
+ * Implementation of sktrack.h
+ * 
+ * See the header for further information.
+ */
+
+#include "sktrack.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sparkle.h"
+#include "skvm.h"
+
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * The maximum number of keys in a single track.
+ */
+#define TRACK_KEYS (64)
+
+/*
+ * Easing constants, used for the ease member of TRACK_KEY.
+ */
+#define EASE_LINEAR (0) /* Linear interpolation */
+#define EASE_CUBIC  (1) /* Cubic ease-in ease-out interpolation */
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * A single key within a track.
+ */
+typedef struct {
+  
+  /*
+   * The time of the key.
+   */
+  double t;
+  
+  /*
+   * The translation, the rotation in degrees, and the scaling at this
+   * key.
+   */
+  double tx;
+  double ty;
+  double rot;
+  double sx;
+  double sy;
+  
+  /*
+   * The easing used for interpolating from this key to the next one.
+   * 
+   * This is one of the EASE_ constants.
+   */
+  int ease;
+  
+} TRACK_KEY;
+
+/*
+ * A track register.
+ * 
+ * keys holds key_count keys, sorted in strictly ascending order of
+ * time.
+ */
+typedef struct {
+  
+  int32_t key_count;
+  TRACK_KEY keys[TRACK_KEYS];
+  
+} TRACK;
+
+/*
+ * The track state of an interpreter.
+ * 
+ * pTracks holds track_count tracks, where track_count is the value of
+ * the %trackcount header.  The tracks are allocated the first time the
+ * script uses a track, so pTracks is NULL until then.
+ */
+typedef struct {
+  
+  int32_t track_count;
+  TRACK *pTracks;
+  
+} SKTRACK_STATE;
+
+/*
+ * Local data
+ * ==========
+ */
+
+/*
+ * The state slot of the track state, as returned by register_state().
+ */
+static int32_t m_slot = -1;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/*
+ * Initialize a new track state block.
+ * 
+ * No tracks are allocated yet.
+ * 
+ * Parameters:
+ * 
+ *   pState - the SKTRACK_STATE block to initialize
+ */
+static void track_state_reset(void *pState) {
+  
+  SKTRACK_STATE *pst = NULL;
+  
+  /* Check parameter */
+  if (pState == NULL) {
+    abort();
+  }
+  pst = (SKTRACK_STATE *) pState;
+  
+  /* Start without tracks */
+  pst->track_count = 0;
+  pst->pTracks = NULL;
+}
+
+/*
+ * Release the tracks of a track state block.
+ * 
+ * Parameters:
+ * 
+ *   pState - the SKTRACK_STATE block to release
+ */
+static void track_state_release(void *pState) {
+  
+  SKTRACK_STATE *pst = NULL;
+  
+  /* Check parameter */
+  if (pState == NULL) {
+    abort();
+  }
+  pst = (SKTRACK_STATE *) pState;
+  
+  /* Free the tracks */
+  free(pst->pTracks);
+  pst->pTracks = NULL;
+  pst->track_count = 0;
+}
+
+/*
+ * Get a track of an interpreter.
+ * 
+ * The first call on an interpreter allocates as many empty tracks as
+ * the %trackcount header declared.  If the track index is out of
+ * range, an error message that names the operator and the track count
+ * is printed.
+ * 
+ * Parameters:
+ * 
+ *   pi - the interpreter
+ * 
+ *   pModule - the name of this executable
+ * 
+ *   line_num - the current line number
+ * 
+ *   pOpName - the name of the operator, for the error message
+ * 
+ *   k - the track index
+ * 
+ * Return:
+ * 
+ *   the track, or NULL if the index is out of range
+ */
+static TRACK *track_get(
+          INTERP  * pi,
+    const char    * pModule,
+          long      line_num,
+    const char    * pOpName,
+          int32_t   k) {
+  
+  SKTRACK_STATE *pst = NULL;
+  
+  /* Check parameters */
+  if ((pi == NULL) || (pModule == NULL) || (pOpName == NULL)) {
+    abort();
+  }
+  
+  /* Get state */
+  pst = (SKTRACK_STATE *) interp_state(pi, m_slot);
+  
+  /* Allocate the tracks on first use */
+  if (pst->pTracks == NULL) {
+    pst->track_count = interp_trackc(pi);
+    if (pst->track_count > 0) {
+      pst->pTracks = (TRACK *) calloc(
+                        (size_t) pst->track_count, sizeof(TRACK));
+      if (pst->pTracks == NULL) {
+        abort();
+      }
+    }
+  }
+  
+  /* Check track range */
+  if ((k < 0) || (k >= pst->track_count)) {
+    fprintf(stderr,
+      "%s: [Line %ld] Track index out of range for %s, "
+      "%%trackcount is %ld!\n",
+      pModule, line_num, pOpName, (long) pst->track_count);
+    return NULL;
+  }
+  
+  /* Return the track */
+  return &((pst->pTracks)[k]);
+}
+
+/*
+ * Interpolate between two values.
+ * 
+ * Parameters:
+ * 
+ *   a - the value at the start
+ * 
+ *   b - the value at the end
+ * 
+ *   u - the interpolation parameter in range [0.0, 1.0]
+ * 
+ * Return:
+ * 
+ *   the interpolated value
+ */
+static double lerp(double a, double b, double u) {
+  
+  /* Return the endpoints exactly so that keys are reproduced exactly */
+  if (u <= 0.0) {
+    return a;
+  } else if (u >= 1.0) {
+    return b;
+  }
+  
+  return a + ((b - a) * u);
+}
+
+/*
+ * Evaluate a track at a given time.
+ * 
+ * The track must have at least one key.  Before the first key and
+ * after the last key, the track holds the values of that key.
+ * 
+ * Parameters:
+ * 
+ *   pt - the track
+ * 
+ *   t - the time
+ * 
+ *   pk - receives the evaluated values; the t and ease members are
+ *   undefined
+ */
+static void track_eval(const TRACK *pt, double t, TRACK_KEY *pk) {
+  
+  int32_t lo = 0;
+  int32_t hi = 0;
+  int32_t mid = 0;
+  double u = 0.0;
+  
+  const TRACK_KEY *pa = NULL;
+  const TRACK_KEY *pb = NULL;
+  
+  /* Check parameters */
+  if ((pt == NULL) || (pk == NULL)) {
+    abort();
+  }
+  if (pt->key_count < 1) {
+    abort();
+  }
+  
+  /* Handle times outside of the keys */
+  if (t <= (pt->keys[0]).t) {
+    memcpy(pk, &(pt->keys[0]), sizeof(TRACK_KEY));
+    return;
+  }
+  if (t >= (pt->keys[pt->key_count - 1]).t) {
+    memcpy(pk, &(pt->keys[pt->key_count - 1]), sizeof(TRACK_KEY));
+    return;
+  }
+  
+  /* Binary search for the last key at or before the given time, which
+   * exists and is not the last key because of the checks above */
+  lo = 0;
+  hi = pt->key_count - 1;
+  while (hi - lo > 1) {
+    mid = lo + ((hi - lo) / 2);
+    if ((pt->keys[mid]).t <= t) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  pa = &(pt->keys[lo]);
+  pb = &(pt->keys[lo + 1]);
+  
+  /* Get the normalized position between the two keys and apply
+   * easing */
+  u = (t - pa->t) / (pb->t - pa->t);
+  if (pa->ease == EASE_CUBIC) {
+    u = u * u * (3.0 - (2.0 * u));
+  }
+  
+  /* Interpolate all the values */
+  pk->tx = lerp(pa->tx, pb->tx, u);
+  pk->ty = lerp(pa->ty, pb->ty, u);
+  pk->rot = lerp(pa->rot, pb->rot, u);
+  pk->sx = lerp(pa->sx, pb->sx, u);
+  pk->sy = lerp(pa->sy, pb->sy, u);
+}
+
+/*
+ * Operator functions
+ * ==================
+ */
+
+/*
+ * [k] track_clear -
+ */
+static int op_track_clear(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t k = 0;
+  TRACK *pt = NULL;
+  
+  /* Check at least one parameter on stack */
+  if (stack_count(pi) < 1) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on track_clear!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for track_clear!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    k = cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Get the track */
+  if (status) {
+    pt = track_get(pi, pModule, line_num, "track_clear", k);
+    if (pt == NULL) {
+      status = 0;
+    }
+  }
+  
+  /* Perform operation */
+  if (status) {
+    pt->key_count = 0;
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 1);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [k] [t] [tx] [ty] [rot] [sx] [sy] [ease] track_key -
+ */
+static int op_track_key(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t i = 0;
+  int32_t j = 0;
+  int32_t k = 0;
+  TRACK *pt = NULL;
+  TRACK_KEY key;
+  
+  /* Initialize structures */
+  memset(&key, 0, sizeof(TRACK_KEY));
+  
+  /* Check at least eight parameters on stack */
+  if (stack_count(pi) < 8) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on track_key!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 7)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 6))) ||
+        (!cell_canfloat(stack_index(pi, 5))) ||
+        (!cell_canfloat(stack_index(pi, 4))) ||
+        (!cell_canfloat(stack_index(pi, 3))) ||
+        (!cell_canfloat(stack_index(pi, 2))) ||
+        (!cell_canfloat(stack_index(pi, 1))) ||
+        (cell_type(stack_index(pi, 0)) != CELLTYPE_INTEGER)) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for track_key!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    k = cell_get_int(stack_index(pi, 7));
+    key.t = cell_get_float(stack_index(pi, 6));
+    key.tx = cell_get_float(stack_index(pi, 5));
+    key.ty = cell_get_float(stack_index(pi, 4));
+    key.rot = cell_get_float(stack_index(pi, 3));
+    key.sx = cell_get_float(stack_index(pi, 2));
+    key.sy = cell_get_float(stack_index(pi, 1));
+    key.ease = (int) cell_get_int(stack_index(pi, 0));
+  }
+  
+  /* Get the track */
+  if (status) {
+    pt = track_get(pi, pModule, line_num, "track_key", k);
+    if (pt == NULL) {
+      status = 0;
+    }
+  }
+  
+  /* Check easing */
+  if (status) {
+    if ((key.ease != EASE_LINEAR) && (key.ease != EASE_CUBIC)) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Unknown easing for track_key!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Find the position of the key within the track, which is the index
+   * of the first key that is not before it */
+  if (status) {
+    for(i = 0; i < pt->key_count; i++) {
+      if ((pt->keys[i]).t >= key.t) {
+        break;
+      }
+    }
+  }
+  
+  /* Insert the key, unless it replaces a key at the same time */
+  if (status) {
+    if ((i < pt->key_count) && ((pt->keys[i]).t == key.t)) {
+      memcpy(&(pt->keys[i]), &key, sizeof(TRACK_KEY));
+      
+    } else if (pt->key_count >= TRACK_KEYS) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Too many keys in track!\n",
+        pModule, line_num);
+      
+    } else {
+      for(j = pt->key_count; j > i; j--) {
+        memcpy(&(pt->keys[j]), &(pt->keys[j - 1]), sizeof(TRACK_KEY));
+      }
+      memcpy(&(pt->keys[i]), &key, sizeof(TRACK_KEY));
+      (pt->key_count)++;
+    }
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 8);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * [m] [k] [t] track_eval -
+ */
+static int op_track_eval(
+    INTERP      * pi,
+    const char  * pModule,
+    long          line_num) {
+  
+  int status = 1;
+  int32_t m = 0;
+  int32_t k = 0;
+  double t = 0.0;
+  TRACK *pt = NULL;
+  TRACK_KEY key;
+  
+  /* Initialize structures */
+  memset(&key, 0, sizeof(TRACK_KEY));
+  
+  /* Check at least three parameters on stack */
+  if (stack_count(pi) < 3) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Stack underflow on track_eval!\n",
+      pModule, line_num);
+  }
+  
+  /* Check parameter types */
+  if (status) {
+    if ((cell_type(stack_index(pi, 2)) != CELLTYPE_INTEGER) ||
+        (cell_type(stack_index(pi, 1)) != CELLTYPE_INTEGER) ||
+        (!cell_canfloat(stack_index(pi, 0)))) {
+      status = 0;
+      fprintf(stderr,
+        "%s: [Line %ld] Wrong param types for track_eval!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Get the parameters */
+  if (status) {
+    m = cell_get_int(stack_index(pi, 2));
+    k = cell_get_int(stack_index(pi, 1));
+    t = cell_get_float(stack_index(pi, 0));
+  }
+  
+  /* Check the register range and get the track */
+  if (status) {
+    if ((m < 0) || (m >= skvm_matc(interp_vm(pi)))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Matrix index out of range!\n",
+        pModule, line_num);
+    }
+  }
+  if (status) {
+    pt = track_get(pi, pModule, line_num, "track_eval", k);
+    if (pt == NULL) {
+      status = 0;
+    }
+  }
+  
+  /* Make sure the track has keys */
+  if (status) {
+    if (pt->key_count < 1) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Track has no keys!\n",
+        pModule, line_num);
+    }
+  }
+  
+  /* Evaluate the track */
+  if (status) {
+    track_eval(pt, t, &key);
+  }
+  
+  /* Check that the evaluated values are usable */
+  if (status) {
+    if ((!isfinite(key.tx)) || (!isfinite(key.ty)) ||
+        (!isfinite(key.rot)) ||
+        (!isfinite(key.sx)) || (!isfinite(key.sy))) {
+      status = 0;
+      fprintf(stderr, "%s: [Line %ld] Track values must be finite!\n",
+        pModule, line_num);
+    }
+  }
+  if (status && ((key.sx == 0.0) || (key.sy == 0.0))) {
+    status = 0;
+    fprintf(stderr, "%s: [Line %ld] Scaling value may not be zero!\n",
+      pModule, line_num);
+  }
+  
+  /* Build the matrix with the same operations a script would use, so
+   * that the result is identical to identity, scale, rotate, and
+   * translate */
+  if (status) {
+    skvm_matrix_reset(interp_vm(pi), m);
+    skvm_matrix_scale(interp_vm(pi), m, key.sx, key.sy);
+    skvm_matrix_rotate(interp_vm(pi), m, key.rot);
+    skvm_matrix_translate(interp_vm(pi), m, key.tx, key.ty);
+  }
+  
+  /* Remove arguments from stack */
+  if (status) {
+    stack_pop(pi, 3);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Registration function
+ * =====================
+ */
+
+void sktrack_register(void) {
+  m_slot = register_state(
+            sizeof(SKTRACK_STATE),
+            &track_state_reset,
+            &track_state_release);
+  
+  register_operator("track_clear", &op_track_clear);
+  register_operator("track_key", &op_track_key);
+  register_operator("track_eval", &op_track_eval);
+}
@@ -0,0 +1,29 @@
+#ifndef SKTRACK_H_INCLUDED
+#define SKTRACK_H_INCLUDED
+
+/*
+ * sktrack.h
+ * =========
+ * 
+ * Keyframe track operator module for Sparkle renderer.
+ * 
+ * To install:
+ * 
+ *   (1) #include this header in the sparkle.c source file near the top
+ *       in the section "Operator modules"
+ * 
+ *   (2) Invoke sktrack_register(); in the register_modules() function
+ *       in the sparkle.c source file.
+ * 
+ *   (3) Compile sktrack.c together with the rest of the renderer.
+ */
+
+/*
+ * The registration function.
+ * 
+ * Call exactly once from the register_modules() function in the
+ * sparkle.c source file.
+ */
+void sktrack_register(void);
+
+#endif
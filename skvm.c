@@ -13,15 +13,277 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
 
 #include "sophistry.h"
 #include "sophistry_jpeg.h"
 
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * Limits on the warm state that is kept across scripts while
+ * skvm_keep_warm() is enabled.
+ * 
+ * POOL_MAX_COUNT and POOL_MAX_BYTES bound the released pixel buffers
+ * that are held for reuse.  ASSET_MAX_COUNT and ASSET_MAX_BYTES bound
+ * the cache of decoded images.  MJPG_MAX_COUNT bounds the number of
+ * Motion-JPEG sequences that are held open.
+ */
+#define POOL_MAX_COUNT  (64)
+#define POOL_MAX_BYTES  (((size_t) 256) * 1024 * 1024)
+#define ASSET_MAX_COUNT (256)
+#define ASSET_MAX_BYTES (((size_t) 1024) * 1024 * 1024)
+#define MJPG_MAX_COUNT  (16)
+
+/*
+ * The width and height of the square tiles that the exact sampling
+ * kernel works through.
+ * 
+ * Quarter turns read the source buffer column by column while writing
+ * the target row by row.  Working through the target in tiles keeps
+ * the source pixels of each tile in the cache until they are used up.
+ */
+#define SAMPLE_TILE (64)
+
+/*
+ * The largest magnitude of an inverse matrix offset for which the exact
+ * sampling kernel is used, so that its integer source coordinates can
+ * not overflow.
+ */
+#define SAMPLE_EXACT_MAX (1073741824.0)
+
+/*
+ * The number of bytes in a color lookup table, which holds four tables
+ * of 256 entries each for alpha, red, green, and blue, in that order.
+ */
+#define LUT_SIZE (1024)
+
+/*
+ * The environment variable that selects the default number of threads
+ * for skvm_threads().
+ */
+#define THREADS_ENV "SPARKLE_THREADS"
+
+/*
+ * The environment variable that selects the default for
+ * skvm_reference().
+ */
+#define REFERENCE_ENV "SPARKLE_REFERENCE"
+
+/*
+ * The states of a task in the worker pool.
+ */
+#define TASK_QUEUED   (0)   /* Not started yet */
+#define TASK_RUNNING  (1)   /* Running on a worker thread */
+#define TASK_DONE     (2)   /* Finished */
+
+/*
+ * The minimum number of bytes each thread processing a buffer should
+ * handle.  Buffers smaller than twice this are processed on the calling
+ * thread alone.
+ */
+#define PAR_GRAIN (262144)
+
+/*
+ * The width and height of the tiles that skvm_sample() splits its
+ * rendering area into when it renders on several threads.
+ * 
+ * This is a multiple of SAMPLE_TILE, so that the exact sampling kernel
+ * still works through whole cache tiles.
+ */
+#define PAR_TILE (128)
+
+/*
+ * The number of points along each side of a tile that are probed to
+ * estimate how much of the tile is actually rendered.
+ */
+#define TILE_PROBE (4)
+
+/*
+ * The number of fractional bits in fixed-point color matrix
+ * coefficients.
+ * 
+ * With coefficients limited to SKVM_CMAT_MAX_COEF and offsets limited
+ * to SKVM_CMAT_MAX_OFFSET, the sum of a matrix row always fits in a
+ * signed 32-bit integer.
+ */
+#define CMAT_SHIFT (12)
+
+/*
+ * The number of box blur passes in each direction used to approximate
+ * a Gaussian blur.
+ */
+#define BLUR_PASSES (3)
+
+/*
+ * The width and height of the tiles used when transposing blur data.
+ */
+#define BLUR_TILE (32)
+
+/*
+ * The constants that stabilize the division in the structural
+ * similarity of two windows, which are (0.01 * 255)^2 and
+ * (0.03 * 255)^2 as in the original definition of SSIM.
+ */
+#define SSIM_C1 (6.5025)
+#define SSIM_C2 (58.5225)
+
+/*
+ * Run kinds of compressed masks.
+ * 
+ * Each run of a compressed mask scanline starts with a 16-bit code,
+ * stored low byte first.  The top two bits of the code are one of these
+ * kinds and the low 14 bits are the length of the run minus one, which
+ * always fits because SKVM_MAX_DIM is 16384.  Zero runs are fully
+ * masked out and full runs are not masked at all.  Literal runs are
+ * followed by one mask value for each pixel in the run.
+ */
+#define RLE_ZERO    (0)
+#define RLE_FULL    (1)
+#define RLE_LITERAL (2)
+
+/*
+ * The shortest run of zero or full mask values that is stored as its
+ * own run when compressing a mask.  Shorter runs are stored within
+ * literal runs, since the run code would cost more than it saves.
+ */
+#define RLE_MIN_RUN (4)
+
+/*
+ * The initial capacity in bytes of the run codes of a compressed mask.
+ */
+#define RLE_INIT_CAP (4096)
+
+/*
+ * The maximum length of a line in an atlas or font table, including the
+ * line break and the terminating nul.
+ */
+#define ATLAS_MAX_LINE (1024)
+
+/*
+ * The maximum number of bytes of rasterized glyphs that the glyph cache
+ * of a font holds.  When a new glyph would exceed this, the cache is
+ * emptied first.
+ */
+#define FONT_CACHE_MAX (16777216)
+
+/*
+ * The kinds of files that a pipelined store writes.
+ */
+#define STORE_PNG   (0)   /* PNG file */
+#define STORE_JPEG  (1)   /* JPEG file, overwritten */
+#define STORE_MJPG  (2)   /* JPEG frame appended to an M-JPEG file */
+
 /*
  * Type declarations
  * =================
  */
 
+/*
+ * Structure holding pixel data that is shared between the asset cache,
+ * pipelined stores, and any number of buffer registers.
+ * 
+ * Shared pixel data is immutable.  The reference count may only be
+ * accessed while m_warm_lock is held, and the structure and its pixel
+ * data are freed when the reference count drops to zero.
+ */
+typedef struct {
+  
+  /*
+   * The dynamically allocated pixel data.
+   */
+  uint8_t *pData;
+  
+  /*
+   * The number of references to this structure.
+   */
+  int32_t refs;
+  
+} SKSHARE;
+
+/*
+ * Structure holding a run-length compressed mask.
+ * 
+ * See RLE_ZERO for the format of the run codes.  The runs of each
+ * scanline cover exactly the width of the mask.
+ */
+typedef struct {
+  
+  /*
+   * The offset in pCode of the runs of each scanline.  There is one
+   * more entry than there are scanlines, holding the total length of
+   * the run codes.
+   */
+  size_t *pRow;
+  
+  /*
+   * The dynamically allocated run codes, with the number of bytes in
+   * use and the number of bytes allocated.
+   */
+  uint8_t *pCode;
+  size_t len;
+  size_t cap;
+  
+} SKRLE;
+
+/*
+ * Structure holding one sub-image of an atlas.
+ */
+typedef struct {
+  
+  /*
+   * The rectangle of the sub-image within the atlas sheet.
+   */
+  int32_t x;
+  int32_t y;
+  int32_t w;
+  int32_t h;
+  
+  /*
+   * The nul-terminated name of the sub-image.
+   */
+  char name[SKVM_ATLAS_MAX_NAME + 1];
+  
+} SKSPRITE;
+
+/*
+ * Structure holding the sub-image table of an atlas.
+ */
+typedef struct {
+  
+  /*
+   * The number of sub-images, in range [1, SKVM_ATLAS_MAX_COUNT].
+   */
+  int32_t count;
+  
+  /*
+   * The dynamically allocated array of sub-images, in index order.
+   */
+  SKSPRITE *pSprite;
+  
+  /*
+   * The dynamically allocated array of pointers into pSprite, sorted in
+   * ascending strcmp() order of name, for looking up sub-images by
+   * name.
+   */
+  const SKSPRITE **ppName;
+  
+} SKATLAS;
+
+/*
+ * Structure holding a font, declared with the font types below.
+ */
+typedef struct SKFONT_TAG SKFONT;
+
 /*
  * Structure used to represent a buffer register.
  */
@@ -42,6 +304,57 @@ typedef struct {
    */
   uint8_t *pData;
   
+  /*
+   * If the pixel data is shared with the asset cache or with pipelined
+   * stores, the share that pData points into, else NULL.
+   * 
+   * Shared pixel data must not be modified.  Use buf_writable() to get
+   * a private copy before modifying the pixel data in place.
+   */
+  SKSHARE *pShare;
+  
+  /*
+   * Pointer to a dynamically allocated color lookup table of LUT_SIZE
+   * bytes, or NULL if this register has never had one.
+   * 
+   * If lut_pending is non-zero, the table holds color lookups that have
+   * been requested but not yet applied to the pixel data.  Consecutive
+   * lookups are composed into this single table, so that they are all
+   * applied in one pass.  Use buf_settle() to apply the pending table
+   * before reading the pixel data.
+   */
+  uint8_t *pLut;
+  
+  /*
+   * If the buffer register holds a compressed mask, the mask, else
+   * NULL.
+   * 
+   * A compressed mask is always grayscale.  While a register holds a
+   * compressed mask, pData is NULL, so the register counts as not
+   * loaded and may only be used as a raster mask.  Releasing the
+   * register or allocating pixel data for it frees the compressed
+   * mask.
+   */
+  SKRLE *pRle;
+  
+  /*
+   * If the buffer register was loaded with skvm_load_atlas(), the
+   * sub-image table of the atlas, else NULL.
+   * 
+   * The table stays with the register while its pixel data changes,
+   * since the dimensions of the register can only change by resetting
+   * it.  Releasing the register frees the table.
+   */
+  SKATLAS *pAtlas;
+  
+  /*
+   * If the buffer register was loaded with skvm_load_font(), the font
+   * along with its glyph cache, else NULL.
+   * 
+   * Releasing the register frees the font.
+   */
+  SKFONT *pFont;
+  
   /*
    * The width of the buffer in pixels.
    * 
@@ -63,8 +376,155 @@ typedef struct {
    */
   uint8_t c;
   
+  /*
+   * Non-zero if the buffer is a float buffer.
+   * 
+   * The pixel data of a float buffer holds four floats for each pixel,
+   * which are the alpha, red, green, and blue channels in
+   * **PREMULTIPLIED** form, each in range [0.0, 1.0].  A float buffer
+   * always has four channels.  Float buffers never share pixel data
+   * with the asset cache, although they may share it with pipelined
+   * stores, and they never have pending color lookups.
+   */
+  uint8_t fp;
+  
+  /*
+   * Non-zero if pLut holds a color lookup table that still needs to be
+   * applied to the pixel data.
+   */
+  uint8_t lut_pending;
+  
 } SKBUF;
 
+/*
+ * Structure holding one glyph of a font rasterized at one size in the
+ * glyph cache of the font.
+ */
+typedef struct SKGLYPHIMG_TAG SKGLYPHIMG;
+struct SKGLYPHIMG_TAG {
+  
+  /*
+   * The next rasterization of the same glyph at another size, or NULL.
+   */
+  SKGLYPHIMG *pNext;
+  
+  /*
+   * The font size in pixels that the glyph was rasterized at.
+   */
+  double size;
+  
+  /*
+   * The grayscale buffer holding the coverage of the glyph, which owns
+   * its pixel data.
+   */
+  SKBUF buf;
+  
+};
+
+/*
+ * Structure holding one glyph of a font.
+ */
+typedef struct {
+  
+  /*
+   * The Unicode codepoint of the glyph.
+   */
+  int32_t code;
+  
+  /*
+   * The rectangle of the glyph within the font sheet, which is empty if
+   * the glyph draws nothing.
+   */
+  int32_t x;
+  int32_t y;
+  int32_t w;
+  int32_t h;
+  
+  /*
+   * The offset of the top-left corner of the glyph from the pen
+   * position, and the advance of the pen, in sheet pixels.
+   */
+  int32_t xoff;
+  int32_t yoff;
+  int32_t adv;
+  
+  /*
+   * The rasterizations of the glyph in the glyph cache, or NULL if the
+   * glyph has not been rasterized yet.
+   */
+  SKGLYPHIMG *pImg;
+  
+} SKGLYPH;
+
+/*
+ * Structure holding a font.
+ */
+struct SKFONT_TAG {
+  
+  /*
+   * Non-zero if the sheet holds a signed distance field, zero if it
+   * holds coverage.
+   */
+  int sdf;
+  
+  /*
+   * The font size in pixels that the sheet was made for, the distance
+   * between baselines, and for an SDF font the range of the distance
+   * field, all in sheet pixels.
+   */
+  int32_t size;
+  int32_t line;
+  int32_t range;
+  
+  /*
+   * The number of glyphs, in range [1, SKVM_FONT_MAX_GLYPHS], and the
+   * dynamically allocated array of glyphs, sorted by codepoint.
+   */
+  int32_t count;
+  SKGLYPH *pGlyph;
+  
+  /*
+   * The dimensions of the sheet, and the dynamically allocated coverage
+   * or distance value of each sheet pixel.
+   */
+  int32_t w;
+  int32_t h;
+  uint8_t *pCov;
+  
+  /*
+   * The total number of bytes of rasterized glyphs in the glyph cache.
+   */
+  size_t cached;
+  
+};
+
+/*
+ * Matrix classification constants, used for the "mclass" member of the
+ * SKMAT structure.
+ * 
+ * MCLASS_IDENTITY is the identity matrix.
+ * 
+ * MCLASS_ITRANSLATE is a translation by integer offsets, and
+ * MCLASS_FTRANSLATE is a translation where at least one offset is not
+ * an integer.
+ * 
+ * MCLASS_SCALE is an axis-aligned scaling followed by any translation,
+ * which is not a translation or a quarter turn.
+ * 
+ * MCLASS_QUARTER is a rotation by a multiple of 90 degrees, optionally
+ * combined with mirror flips, followed by any translation.  In other
+ * words, each of the first two matrix rows has exactly one non-zero
+ * entry among a b and d e, which is either 1 or -1.
+ * 
+ * MCLASS_AFFINE is any other matrix.
+ */
+#define MCLASS_IDENTITY   (0)
+#define MCLASS_ITRANSLATE (1)
+#define MCLASS_FTRANSLATE (2)
+#define MCLASS_SCALE      (3)
+#define MCLASS_QUARTER    (4)
+#define MCLASS_AFFINE     (5)
+
 /*
  * Structure used to represent a matrix:
  * 
@@ -74,14 +534,15 @@ typedef struct {
  * 
  * The third row is always 0 0 1 so it is not stored in the structure.
  * 
- * Additionally, this structure can cache the inversion of the matrix.
- * If the inversion is available, the "cached" member will be set to
- * a non-zero value, and then the following members will also be
- * available:
+ * Additionally, this structure stores the inversion of the matrix:
  * 
  * | iva ivb ivc |
  * | ivd ive ivf |
  * |  0   0   1  |
+ * 
+ * The inversion, the classification, and the scale factors are derived
+ * from the matrix values.  They are recomputed with matrix_update()
+ * whenever the matrix values change.
  */
 typedef struct {
   
@@ -96,7 +557,7 @@ typedef struct {
   double f;
   
   /*
-   * The cached inverse matrix values, only if "cached" is non-zero.
+   * The inverse matrix values.
    */
   double iva;
   double ivb;
@@ -106,9 +567,20 @@ typedef struct {
   double ivf;
   
   /*
-   * Flag that is set to non-zero if the inverse matrix is cached.
+   * The factors by which the matrix scales lengths along the X and Y
+   * axes of source space.
+   * 
+   * These are the lengths of the transformed unit vectors, so they are
+   * always positive and do not reflect mirror flips.
+   */
+  double sx;
+  double sy;
+  
+  /*
+   * The classification of the matrix, which is one of the MCLASS_
+   * constants.
    */
-  uint8_t cached;
+  uint8_t mclass;
   
 } SKMAT;
 
@@ -135,765 +607,9893 @@ typedef struct {
 } SKARGB;
 
 /*
- * Static data
- * ===========
- */
-
-/*
- * The error message from the most recent operation that can fail, or
- * NULL if there was no error.
- */
-static const char *m_perr = NULL;
-
-/*
- * Flag indicating whether this module has been initialized yet.
+ * Function pointer type for blending a sampled color into a target
+ * color, both premultiplied.
+ * 
+ * mv is the coverage of the pixel by the mask, in range (0.0, 1.0].
+ * Partial coverage moves the result proportionally back towards the
+ * target color.
+ * 
+ * Parameters:
+ * 
+ *   ps - the sampled color
+ * 
+ *   pd - the target color
+ * 
+ *   mv - the mask coverage
+ * 
+ *   pf - receives the blended color
  */
-static int m_init = 0;
+typedef void (*fp_blend)(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf);
 
 /*
- * The number of buffer and matrix registers declared.
- * 
- * Only if m_init.
- * 
- * Range of bufc is [0, SKVM_MAX_BUFC].
- * Range of matc is [0, SKVM_MAX_MATC].
+ * Structure used to hold a released pixel buffer in the buffer pool.
  */
-static int32_t m_bufc;
-static int32_t m_matc;
+typedef struct {
+  
+  /*
+   * The dynamically allocated pixel data.
+   */
+  uint8_t *pData;
+  
+  /*
+   * The size in bytes of the pixel data.
+   */
+  size_t len;
+  
+} SKBLOCK;
 
 /*
- * The pointers to the buffer and matrix register arrays.
+ * Structure used to identify a version of a file on disk, so that warm
+ * state can tell whether the file has changed.
  * 
- * Only if m_init.
- * 
- * Size of arrays indicated by m_bufc and m_matc above.  For zero-size,
- * a NULL pointer is given.
+ * The modification time has nanosecond resolution where the file
+ * system provides it, because a file rewritten within the same second
+ * as a previous version would otherwise look unchanged.  The device
+ * and inode numbers catch files that were replaced by renaming another
+ * file over them.
  */
-static SKBUF *m_pbuf;
-static SKMAT *m_pmat;
+typedef struct {
+  
+  off_t size;
+  time_t mtime;
+  long mtime_ns;
+  dev_t dev;
+  ino_t ino;
+  
+} SKSTAMP;
 
 /*
- * Local functions
- * ===============
+ * Structure used to record a decoded image in the asset cache.
  */
-
-/* Prototypes */
-static void source2target(SKMAT *pt, SKPOINT *pp);
-static void target2source(SKMAT *pt, SKPOINT *pp);
-
-static void sample_nearest(
-    const SKBUF   * pb,
-    const SKPOINT * pp,
-          SKARGB  * pr);
-static void sample_bilinear(
-    const SKBUF   * pb,
-    const SKPOINT * pp,
-          SKARGB  * pr);
-static void sample_bicubic(
-    const SKBUF   * pb,
-    const SKPOINT * pp,
-          SKARGB  * pr);
-    
-static void matrix_mul(SKMAT *pm, const SKMAT *pa, const SKMAT *pb);
-
-/*
- * Given a transformation matrix and a point, convert the point from
- * source space to target space.
- * 
- * Parameters:
- * 
- *   pt - the transformation matrix
- * 
- *   pp - the point to convert
- */
-static void source2target(SKMAT *pt, SKPOINT *pp) {
-  
-  double rx = 0.0;
-  double ry = 0.0;
+typedef struct {
   
-  /* Check parameters */
-  if ((pt == NULL) || (pp == NULL)) {
-    abort();
-  }
+  /*
+   * Dynamically allocated copy of the path the image was loaded from.
+   * 
+   * For Motion-JPEG frames, this is the path to the index file.
+   */
+  char *pPath;
   
-  /* Multiply the matrix by the expanded vector to get the result */
-  rx = (pt->a * pp->x) + (pt->b * pp->y) + pt->c;
-  ry = (pt->d * pp->x) + (pt->e * pp->y) + pt->f;
+  /*
+   * The frame index within a Motion-JPEG sequence, or -1 for PNG and
+   * JPEG files.
+   */
+  int32_t frame;
   
-  /* Write result to point */
-  pp->x = rx;
-  pp->y = ry;
-}
-
-/*
- * Given a transformation matrix and a point, convert the point from
- * target space to source space.
- * 
- * Parameters:
- * 
- *   pt - the transformation matrix
- * 
- *   pp - the point to convert
- */
-static void target2source(SKMAT *pt, SKPOINT *pp) {
+  /*
+   * The dimensions and channel count of the decoded image.
+   */
+  int16_t w;
+  int16_t h;
+  uint8_t c;
   
-  double denom = 0.0;
-  double rx = 0.0;
-  double ry = 0.0;
+  /*
+   * The version of the image file when it was decoded.  For Motion-JPEG
+   * frames, this refers to the raw Motion-JPEG sequence file rather
+   * than the index file.
+   */
+  SKSTAMP fst;
   
-  /* Check parameters */
-  if ((pt == NULL) || (pp == NULL)) {
-    abort();
-  }
+  /*
+   * Non-zero if the entry is pending and a store to the same path was
+   * made while the image was being decoded, so that the decoded image
+   * must not be cached.
+   */
+  int stale;
   
-  /* If inversion is not yet cached, compute it and cache it */
-  if (!(pt->cached)) {
-    denom = (pt->a * pt->e) - (pt->b * pt->d);
-    
-    pt->iva = pt->e / denom;
-    pt->ivb = -(pt->b / denom);
-    pt->ivc = ((pt->b * pt->f) - (pt->c * pt->e)) / denom;
-    
-    pt->ivd = -(pt->d / denom);
-    pt->ive = pt->a / denom;
-    pt->ivf = ((pt->c * pt->d) - (pt->a * pt->f)) / denom;
-    
-    pt->cached = (uint8_t) 1;
-  }
+  /*
+   * The shared decoded pixel data, in the same format as the pixel data
+   * of a buffer register with the dimensions and channel count given
+   * above.
+   * 
+   * This is NULL if the entry is pending, which means that some context
+   * is currently decoding the image.  Other contexts that want the same
+   * image wait on m_warm_cond until the entry is no longer pending.
+   */
+  SKSHARE *pShare;
   
-  /* Multiply the inverted matrix by the expanded vector to get the
-   * result */
-  rx = (pt->iva * pp->x) + (pt->ivb * pp->y) + pt->ivc;
-  ry = (pt->ivd * pp->x) + (pt->ive * pp->y) + pt->ivf;
+  /*
+   * The value of the use counter the last time this entry was used.
+   */
+  uint32_t stamp;
   
-  /* Write result to point */
-  pp->x = rx;
-  pp->y = ry;
-}
+} SKASSET;
 
 /*
- * Perform nearest-neighbor interpolation.
- * 
- * pb is the buffer to sample from.  It must be loaded.
- * 
- * pp is the point within the buffer to sample.  It must be somewhere
- * within the boundaries of the buffer.
- * 
- * pr receives the sampled, premultiplied ARGB value.
- * 
- * Parameters:
- * 
- *   pb - the buffer
- * 
- *   pp - the point
- * 
- *   pr - receives the sampled color
+ * Structure used to hold a Motion-JPEG sequence open.
  */
-static void sample_nearest(
-    const SKBUF   * pb,
-    const SKPOINT * pp,
-          SKARGB  * pr) {
-  
-  int32_t x = 0;
-  int32_t y = 0;
-  uint8_t *pt = NULL;
-  
-  /* Check parameters */
-  if ((pb == NULL) || (pp == NULL) || (pr == NULL)) {
-    abort();
-  }
+typedef struct {
   
-  /* Make sure that buffer is loaded */
-  if (pb->pData == NULL) {
-    abort();
-  }
+  /*
+   * Dynamically allocated copy of the path to the index file.
+   */
+  char *pIndexPath;
   
-  /* For nearest neighbor, we just have to floor both coordinates and
-   * then clamp them to the allowable range */
-  x = (int32_t) floor(pp->x);
-  y = (int32_t) floor(pp->y);
+  /*
+   * The versions of the index file and the raw Motion-JPEG sequence
+   * file when they were opened.
+   */
+  SKSTAMP ist;
+  SKSTAMP dst;
   
-  if (x < 0) {
-    x = 0;
-  } else if (x > pb->w - 1) {
-    x = pb->w - 1;
-  }
+  /*
+   * The open raw Motion-JPEG sequence file.
+   */
+  FILE *pf;
   
-  if (y < 0) {
-    y = 0;
-  } else if (y > pb->h - 1) {
-    y = pb->h - 1;
-  }
+  /*
+   * The number of frames and the dynamically allocated array of frame
+   * offsets read from the index file.
+   * 
+   * If there are no frames, pOffs is NULL.
+   */
+  int32_t count;
+  uint64_t *pOffs;
   
-  /* Now seek to the pixel within the source data */
-  pt = pb->pData;
-  pt += (y * (pb->w * pb->c));
-  pt += (x * pb->c);
+  /*
+   * The value of the use counter the last time this entry was used.
+   */
+  uint32_t stamp;
   
-  /* Load depending on number of channels */
-  if (pb->c == 1) {
-    /* Grayscale */
-    pr->a = 1.0;
-    pr->r = ((double) *pt) / 255.0;
-    pr->g = pr->r;
-    pr->b = pr->r;
-    
-  } else if (pb->c == 3) {
-    /* RGB */
-    pr->a = 1.0;
-    pr->r = ((double) pt[0]) / 255.0;
-    pr->g = ((double) pt[1]) / 255.0;
-    pr->b = ((double) pt[2]) / 255.0;
-    
-  } else if (pb->c == 4) {
-    /* ARGB, so first load non-premultiplied */
-    pr->a = ((double) pt[0]) / 255.0;
-    pr->r = ((double) pt[1]) / 255.0;
-    pr->g = ((double) pt[2]) / 255.0;
-    pr->b = ((double) pt[3]) / 255.0;
-    
-    /* Now perform premultiplication */
-    pr->r = pr->r * pr->a;
-    pr->g = pr->g * pr->a;
-    pr->b = pr->b * pr->a;
-    
-  } else {
-    /* Shouldn't happen */
-    abort();
-  }
-}
+} SKMJPG;
 
 /*
- * Perform bilinear interpolation.
- * 
- * pb is the buffer to sample from.  It must be loaded.
- * 
- * pp is the point within the buffer to sample.  It must be somewhere
- * within the boundaries of the buffer.
+ * Function pointer type for processing a band of scanlines.
  * 
- * pr receives the sampled, premultiplied ARGB value.
+ * pArg is the job argument that was passed to par_rows().  The band
+ * starts at scanline y0 (inclusive) and ends at scanline y1
+ * (exclusive).  Bands handed out for the same job never overlap, and
+ * they may be processed on different threads at the same time.
  * 
  * Parameters:
  * 
- *   pb - the buffer
+ *   pArg - the job argument
  * 
- *   pp - the point
+ *   y0 - the first scanline of the band
  * 
- *   pr - receives the sampled color
+ *   y1 - one past the last scanline of the band
  */
-static void sample_bilinear(
-    const SKBUF   * pb,
-    const SKPOINT * pp,
-          SKARGB  * pr) {
-  /* @@TODO: */
-  fprintf(stderr, "Bilinear interpolation not implemented yet!\n");
-  abort();
-}
+typedef void (*fp_band)(void *pArg, int32_t y0, int32_t y1);
 
 /*
- * Perform bicubic interpolation.
- * 
- * pb is the buffer to sample from.  It must be loaded.
- * 
- * pp is the point within the buffer to sample.  It must be somewhere
- * within the boundaries of the buffer.
- * 
- * pr receives the sampled, premultiplied ARGB value.
+ * Function pointer type for a task run by the worker pool.
  * 
  * Parameters:
  * 
- *   pb - the buffer
- * 
- *   pp - the point
- * 
- *   pr - receives the sampled color
+ *   pArg - the task argument
  */
-static void sample_bicubic(
-    const SKBUF   * pb,
-    const SKPOINT * pp,
-          SKARGB  * pr) {
-  /* @@TODO: */
-  fprintf(stderr, "Bicubic interpolation not implemented yet!\n");
-  abort();
-}
+typedef void (*fp_task)(void *pArg);
 
 /*
- * Multiply two matrices together and store their result in a third
- * matrix.
- * 
- * The operation performed is:
- * 
- *   (*pm) = (*pa) * (*pb)
- * 
- * pm may not point to the same matrix structure as pa or pb, but pa and
- * pb may point to the same structure.
- * 
- * This does not check that the results are finite, nor does it cache an
- * inverse matrix.
- * 
- * Parameters:
- * 
- *   pm - the matrix to store the result in
+ * Structure describing a task of the worker pool.
  * 
- *   pa - the first matrix operand
- * 
- *   pb - the second matrix operand
+ * The structure is owned by whoever starts the task with task_start(),
+ * and it serves as the future of the task.  It must remain valid until
+ * task_finish() returns.
  */
-static void matrix_mul(SKMAT *pm, const SKMAT *pa, const SKMAT *pb) {
+typedef struct SKTASK_TAG SKTASK;
+struct SKTASK_TAG {
   
-  /* Check parameters */
-  if ((pm == NULL) || (pa == NULL) || (pb == NULL)) {
-    abort();
-  }
-  if ((pm == pa) || (pm == pb)) {
-    abort();
-  }
+  /*
+   * The task function and its argument.
+   */
+  fp_task fn;
+  void *pArg;
   
-  /* Perform multiplication */
-  pm->a = (pa->a * pb->a) + (pa->b * pb->d);
-  pm->b = (pa->a * pb->b) + (pa->b * pb->e);
-  pm->c = (pa->a * pb->c) + (pa->b * pb->f) + pa->c;
+  /*
+   * One of the TASK_ constants, protected by m_work_lock.
+   */
+  int state;
   
-  pm->d = (pa->d * pb->a) + (pa->e * pb->d);
-  pm->e = (pa->d * pb->b) + (pa->e * pb->e);
-  pm->f = (pa->d * pb->c) + (pa->e * pb->f) + pa->f;
+  /*
+   * The next task in the queue, protected by m_work_lock.
+   */
+  SKTASK *pNext;
   
-  /* Clear the cache flag on the result */
-  pm->cached = (uint8_t) 0;
-}
-
-/*
- * Public function implementations
- * ===============================
- * 
- * See the header for specifications.
- */
+};
 
 /*
- * skvm_init function.
+ * Structure describing a job of par_rows(), which is shared by all the
+ * tasks that work on it.
  */
-void skvm_init(int32_t bufc, int32_t matc) {
+typedef struct {
   
-  int32_t i = 0;
-  SKBUF *ps = NULL;
-  SKMAT *pm = NULL;
+  /*
+   * The band function and its job argument.
+   */
+  fp_band fn;
+  void *pArg;
   
-  /* Check state */
-  if (m_init) {
-    abort();
-  }
+  /*
+   * The number of scanlines and the number of bands they are split
+   * into.
+   */
+  int32_t h;
+  int32_t n;
   
-  /* Check parameters */
-  if ((bufc < 0) || (bufc > SKVM_MAX_BUFC) ||
-      (matc < 0) || (matc > SKVM_MAX_MATC)) {
-    abort();
-  }
+  /*
+   * The next band that has not been claimed yet, protected by
+   * m_work_lock.
+   */
+  int32_t next;
   
-  /* Store counts */
-  m_bufc = bufc;
-  m_matc = matc;
+} SKPARJOB;
+
+/*
+ * Structure holding the state of each thread that uses skvm.
+ */
+typedef struct {
   
-  /* Allocate registers */
-  if (bufc > 0) {
-    m_pbuf = (SKBUF *) calloc(bufc, sizeof(SKBUF));
-    if (m_pbuf == NULL) {
-      abort();
-    }
-    
-  } else {
-    m_pbuf = NULL;
-  }
+  /*
+   * The number of threads that work started on this thread may use,
+   * as set by skvm_threads(), or zero for the default.
+   */
+  int32_t limit;
   
-  if (matc > 0) {
-    m_pmat = (SKMAT *) calloc(matc, sizeof(SKMAT));
-    if (m_pmat == NULL) {
-      abort();
-    }
-    
-  } else {
-    m_pmat = NULL;
-  }
+  /*
+   * The rendering mode set by skvm_reference(), as one of the
+   * SKVM_REF_ constants.
+   */
+  int ref;
   
-  /* Initialize all buffer registers to 1x1 grayscale, unloaded */
-  for(i = 0; i < bufc; i++) {
-    ps = &(m_pbuf[i]);
-    
-    ps->pData = NULL;
-    ps->w = 1;
-    ps->h = 1;
-    ps->c = (uint8_t) 1;
-  }
+  /*
+   * The scratch arena of the thread and its capacity in bytes.
+   */
+  uint8_t *pScratch;
+  size_t cap;
   
-  /* Initialize all matrices to identity with cached inverse, which is
-   * also the identity */
-  for(i = 0; i < matc; i++) {
-    pm = &(m_pmat[i]);
-    
-    pm->a = 1.0;    pm->b = 0.0;    pm->c = 0.0;
-    pm->d = 0.0;    pm->e = 1.0;    pm->f = 0.0;
-    
-    pm->cached = (uint8_t) 1;
-    
-    pm->iva = 1.0;  pm->ivb = 0.0;  pm->ivc = 0.0;
-    pm->ivd = 0.0;  pm->ive = 1.0;  pm->ivf = 0.0;
-  }
+  /*
+   * How the work of the most recent skvm_sample() call on this thread
+   * was balanced, for skvm_balance().
+   */
+  SKVM_BALANCE bal;
   
-  /* Set the initialized flag */
-  m_init = 1;
-}
+} SKTHREAD;
 
 /*
- * skvm_reason function.
+ * Structure describing a color lookup job for lut_band().
  */
-const char *skvm_reason(void) {
+typedef struct {
   
-  const char *pResult = NULL;
+  /*
+   * The pixel data to read from and the pixel data to write to.
+   * 
+   * These may be the same pointer to apply the lookup in place.
+   */
+  const uint8_t *pSrc;
+  uint8_t *pDst;
   
-  if (m_perr != NULL) {
-    pResult = m_perr;
-  } else {
-    pResult = "No error";
-  }
+  /*
+   * The color lookup table of LUT_SIZE bytes.
+   */
+  const uint8_t *pLut;
   
-  return pResult;
-}
+  /*
+   * The width in pixels and the number of channels of the pixel data.
+   */
+  int32_t w;
+  int c;
+  
+} SKLUTJOB;
 
 /*
- * skvm_bufc function.
+ * Structure describing a color matrix job for cmat_band().
  */
-int32_t skvm_bufc(void) {
+typedef struct {
   
-  /* Check state */
-  if (!m_init) {
-    abort();
-  }
+  /*
+   * The pixel data to modify in place.
+   */
+  uint8_t *pData;
   
-  /* Return value */
-  return m_bufc;
-}
+  /*
+   * The fixed-point matrix.
+   * 
+   * For ARGB, this has four rows of five values each, in the same order
+   * as the matrix passed to skvm_color_matrix().  For RGB, this has
+   * three rows for red, green, and blue, each with four values for red,
+   * green, blue, and offset, where the constant alpha input has been
+   * folded into the offset.
+   */
+  int32_t k[20];
+  
+  /*
+   * The width in pixels and the number of channels of the pixel data,
+   * which is either 3 or 4.
+   */
+  int32_t w;
+  int c;
+  
+} SKCMJOB;
 
 /*
- * skvm_matc function.
+ * Structure describing a blur job for the blur band functions.
+ * 
+ * Blurring works on 16-bit channels holding channel values in range
+ * [0, 255] multiplied by 256, premultiplied for ARGB.  The data is
+ * blurred along its rows, transposed so that columns become rows,
+ * blurred along its rows again, and transposed back.
  */
-int32_t skvm_matc(void) {
+typedef struct {
   
-  /* Check state */
-  if (!m_init) {
-    abort();
-  }
+  /*
+   * The pixel data of the buffer register.
+   */
+  uint8_t *pData;
   
-  /* Return value */
-  return m_matc;
-}
+  /*
+   * The 16-bit data that the band functions work on, and the 16-bit
+   * data that transposition writes into.
+   */
+  uint16_t *pWork;
+  uint16_t *pFlip;
+  
+  /*
+   * The width and height in pixels of the 16-bit data in pWork, and
+   * the number of channels.
+   */
+  int32_t w;
+  int32_t h;
+  int c;
+  
+  /*
+   * The radius of each box blur pass.
+   */
+  int32_t r[BLUR_PASSES];
+  
+} SKBLURJOB;
 
 /*
- * skvm_get_dim function.
+ * Structure describing a statistics job for stats_band().
  */
-void skvm_get_dim(int32_t i, int32_t *pw, int32_t *ph) {
+typedef struct {
   
-  /* Check state */
-  if (!m_init) {
-    abort();
-  }
+  /*
+   * The buffer to measure.
+   */
+  const SKBUF *pBuf;
   
-  /* Check parameters */
-  if ((i < 0) || (i >= m_bufc) || (pw == NULL) || (ph == NULL)) {
-    abort();
-  }
+  /*
+   * The histograms of all the bands added together so far, protected
+   * by the lock.
+   */
+  pthread_mutex_t lock;
+  uint32_t hist[4][256];
   
-  /* Return the requested information */
-  *pw = (m_pbuf[i]).w;
-  *ph = (m_pbuf[i]).h;
-}
+} SKSTATJOB;
 
 /*
- * skvm_get_channels function.
+ * Structure describing a comparison job for cmp_band().
+ * 
+ * The bands of a comparison job are counted in rows of SSIM windows
+ * rather than in scanlines.  Each window row records its own sums, and
+ * they are added up in order once all the bands are done, so that the
+ * result does not depend on how the window rows were split into bands.
  */
-int skvm_get_channels(int32_t i) {
+typedef struct {
   
-  /* Check state */
-  if (!m_init) {
-    abort();
-  }
+  /*
+   * The buffers to compare.
+   */
+  const SKBUF *pA;
+  const SKBUF *pB;
   
-  /* Check parameters */
-  if ((i < 0) || (i >= m_bufc)) {
-    abort();
-  }
+  /*
+   * The sum of the squared errors and the sum of the SSIM of all
+   * windows, for each window row.
+   */
+  uint64_t *pErr;
+  double *pSsim;
   
-  /* Return the requested information */
-  return (m_pbuf[i]).c;
-}
+  /*
+   * The largest absolute difference of each channel, for each window
+   * row.  Window row r uses the four entries starting at r * 4.
+   */
+  uint8_t *pMax;
+  
+} SKCMPJOB;
 
 /*
- * skvm_is_loaded function.
+ * Structure holding the color transform that skvm_sample() applies to
+ * sampled pixels.
  */
-int skvm_is_loaded(int32_t i) {
-  
-  int result = 0;
-  
-  /* Check state */
-  if (!m_init) {
-    abort();
-  }
+typedef struct {
   
-  /* Check parameters */
-  if ((i < 0) || (i >= m_bufc)) {
-    abort();
-  }
+  /*
+   * The color lookup table of LUT_SIZE bytes, or NULL if there is no
+   * lookup.
+   */
+  const uint8_t *pLut;
   
-  /* Determine if loaded */
-  if ((m_pbuf[i]).pData != NULL) {
-    result = 1;
-  } else {
-    result = 0;
-  }
+  /*
+   * Non-zero if there is a color matrix, in which case k holds the
+   * full 4x5 matrix in fixed point.
+   */
+  int cmat;
+  int32_t k[20];
   
-  /* Return the requested information */
-  return result;
-}
+} SKXFORM;
 
 /*
- * skvm_reset function.
+ * Structure holding the shape mask that skvm_sample() applies on top
+ * of the procedural boundary lines.
  */
-void skvm_reset(int32_t i, int32_t w, int32_t h, int c) {
+typedef struct {
   
-  SKBUF *ps = NULL;
+  /*
+   * One of the SKVM_SHAPE_ constants other than SKVM_SHAPE_NONE.
+   */
+  int kind;
   
-  /* Check state */
-  if (!m_init) {
-    abort();
-  }
+  /*
+   * Non-zero if coverage is inverted.
+   */
+  int invert;
   
-  /* Check parameters */
-  if ((i < 0) || (i >= m_bufc) ||
-      (w < 1) || (w > SKVM_MAX_DIM) ||
-      (h < 1) || (h > SKVM_MAX_DIM) ||
-      ((c != 1) && (c != 3) && (c != 4))) {
-    abort();
-  }
+  /*
+   * The shape parameters from the sampling parameters.
+   */
+  double x0;
+  double y0;
+  double x1;
+  double y1;
+  double r;
   
-  /* Get buffer register */
-  ps = &(m_pbuf[i]);
+  /*
+   * The feather width, which is at least 1.0.
+   */
+  double fe;
   
-  /* If buffer currently loaded, release it */
-  if (ps->pData != NULL) {
-    free(ps->pData);
-    ps->pData = NULL;
-  }
+  /*
+   * The center, and the half width and half height of the rectangle.
+   * For the radial ramp, the center is (x0, y0) and the half sizes are
+   * unused.
+   */
+  double cx;
+  double cy;
+  double hx;
+  double hy;
   
-  /* Load buffer dimensions */
-  ps->w = w;
-  ps->h = h;
-  ps->c = (uint8_t) c;
-}
+  /*
+   * For the linear ramp, the vector from (x0, y0) to (x1, y1) divided
+   * by its squared length, so that its dot product with an offset from
+   * (x0, y0) gives the coverage.
+   */
+  double ux;
+  double uy;
+  
+} SKSHAPE;
 
 /*
- * skvm_load_png function.
+ * Structure selecting a mask that skvm_sample() computes one scanline
+ * at a time.
+ * 
+ * Exactly one of the pointers is non-NULL.
  */
-int skvm_load_png(int32_t i, const char *pPath) {
+typedef struct {
   
-  int status = 1;
-  int errn = 0;
-  int32_t x = 0;
-  int32_t y = 0;
+  /*
+   * The shape mask, or NULL.
+   */
+  const SKSHAPE *pShape;
   
-  SKBUF *ps = NULL;
-  SPH_IMAGE_READER *pr = NULL;
+  /*
+   * The compressed raster mask, or NULL.
+   * 
+   * ox and oy are the target pixel covered by the top-left pixel of the
+   * compressed mask.  The scanlines asked of it must be within the
+   * mask.
+   */
+  const SKRLE *pRle;
+  int32_t ox;
+  int32_t oy;
   
-  uint8_t  *pi = NULL;
-  uint32_t *psl = NULL;
+} SKROWMASK;
+
+/*
+ * Structure holding the run of tiles assigned to one worker of a tile
+ * job.
+ */
+typedef struct {
   
-  SPH_ARGB argb;
+  /*
+   * The tiles not taken yet are those from head up to but excluding
+   * tail, and rem is their total estimated cost.  The worker takes
+   * tiles from the head, while other workers steal from the tail.
+   * These are protected by m_work_lock.
+   */
+  int32_t head;
+  int32_t tail;
+  double rem;
   
-  /* Initialize structures */
-  memset(&argb, 0, sizeof(SPH_ARGB));
+  /*
+   * The number of tiles this worker rendered, their estimated cost,
+   * and the seconds spent rendering them.  These are only written by
+   * the worker itself.
+   */
+  int32_t count;
+  double cost;
+  double busy;
   
-  /* Check state */
-  if (!m_init) {
-    abort();
-  }
+} SKTILEQ;
+
+/*
+ * Structure describing a tiled sampling job for tile_task().
+ * 
+ * The rendering area is split into PAR_TILE tiles, which are numbered
+ * left to right and then top to bottom.
+ */
+typedef struct {
   
-  /* Check parameters */
-  if ((i < 0) || (i >= m_bufc) || (pPath == NULL)) {
-    abort();
-  }
+  /*
+   * The parameters of the sampling kernel, which are the same as for
+   * sample_exact(), and non-zero in exact to use sample_exact() rather
+   * than sample_general().
+   */
+  const SKVM_SAMPLE_PARAM *ps;
+  const SKXFORM *px;
+  const SKBUF *pSrc;
+  const SKBUF *pMask;
+  const SKROWMASK *pRows;
+  const SKMAT *pMatrix;
+  SKBUF *pTarget;
+  int exact;
   
-  /* Get buffer register */
-  ps = &(m_pbuf[i]);
+  /*
+   * The rendering area and the number of tile columns.
+   */
+  int32_t min_x;
+  int32_t min_y;
+  int32_t max_x;
+  int32_t max_y;
+  int32_t cols;
   
-  /* Allocate a buffer for the register, if we don't already have one */
-  if (ps->pData == NULL) {
-    ps->pData = (uint8_t *) malloc((size_t)
-                              (ps->w * ps->h * ((int32_t) ps->c)));
-    if (ps->pData == NULL) {
-      abort();
-    }
-  }
+  /*
+   * The estimated cost of each tile.
+   */
+  const double *pCost;
   
-  /* Allocate PNG image reader on file */
-  pr = sph_image_reader_newFromPath(pPath, &errn);
-  if (pr == NULL) {
-    status = 0;
-    m_perr = sph_image_errorString(errn);
-  }
+  /*
+   * The number of workers and the tiles of each worker.
+   */
+  int32_t n;
+  SKTILEQ q[SKVM_MAX_THREADS];
   
-  /* Make sure dimensions of PNG image match dimensions of buffer */
-  if (status) {
-    if ((ps->w != sph_image_reader_width(pr)) ||
-        (ps->h != sph_image_reader_height(pr))) {
+  /*
+   * The next worker slot that has not been claimed by a task yet, and
+   * the number of tiles stolen, protected by m_work_lock.
+   */
+  int32_t next;
+  int32_t steals;
+  
+} SKTILEJOB;
+
+/*
+ * Structure describing a pipelined store, which writes a snapshot of a
+ * buffer register to a file on the worker pool.
+ */
+typedef struct SKSTORE_TAG SKSTORE;
+struct SKSTORE_TAG {
+  
+  /*
+   * The task that runs store_task() on this store.
+   */
+  SKTASK task;
+  
+  /*
+   * The context the store belongs to.
+   */
+  SKVM_CTX *pv;
+  
+  /*
+   * The snapshot of the buffer register to write.
+   * 
+   * The pixel data is always shared, and this structure holds one
+   * reference to the share until the store is retired.  There is never
+   * a pending color lookup or a compressed mask.
+   */
+  SKBUF buf;
+  
+  /*
+   * One of the STORE_ constants, the quality for JPEG files, and the
+   * dynamically allocated copy of the path to write to.
+   */
+  int kind;
+  int q;
+  char *pPath;
+  
+  /*
+   * The error message if the store failed, or NULL if it succeeded,
+   * which is set by store_task().
+   */
+  const char *pErr;
+  
+  /*
+   * The next store of the context in the order they were made, or
+   * NULL, protected by the store_lock of the context.
+   */
+  SKSTORE *pNext;
+  
+};
+
+/*
+ * SKVM_CTX structure.
+ * 
+ * Prototype given in header.
+ */
+struct SKVM_CTX_TAG {
+  
+  /*
+   * The error message from the most recent operation that can fail, or
+   * NULL if there was no error.
+   */
+  const char *pErr;
+  
+  /*
+   * The number of buffer and matrix registers declared.
+   * 
+   * Range of bufc is [0, SKVM_MAX_BUFC].
+   * Range of matc is [0, SKVM_MAX_MATC].
+   */
+  int32_t bufc;
+  int32_t matc;
+  
+  /*
+   * The pointers to the buffer and matrix register arrays.
+   * 
+   * Size of arrays indicated by bufc and matc above.  For zero-size, a
+   * NULL pointer is given.
+   */
+  SKBUF *pbuf;
+  SKMAT *pmat;
+  
+  /*
+   * The pipeline depth set with skvm_pipeline(), which is the number of
+   * stores that may be pending at the same time, or zero if stores are
+   * written right away.
+   */
+  int32_t depth;
+  
+  /*
+   * The pending stores, from the oldest to the most recent, and the
+   * number of them.
+   * 
+   * Stores are retired in order by the thread using the context.  The
+   * stores themselves run one after another on the worker pool, each
+   * starting the next when it is done.  store_busy is non-zero while a
+   * store task has been started that has not yet found the end of the
+   * list, and it is protected by store_lock.
+   */
+  SKSTORE *pStoreHead;
+  SKSTORE *pStoreTail;
+  int32_t store_count;
+  int store_busy;
+  pthread_mutex_t store_lock;
+  
+  /*
+   * The error message of the oldest pipelined store that failed and
+   * has not been reported yet, or NULL if none.
+   */
+  const char *pStoreErr;
+  
+};
+
+/*
+ * Static data
+ * ===========
+ * 
+ * Except for the worker pool at the end, all static data is warm state
+ * shared between all contexts, and it may only be accessed while
+ * m_warm_lock is held.
+ */
+
+/*
+ * Lock protecting all the static data below.
+ */
+static pthread_mutex_t m_warm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Condition signalled whenever a pending asset cache entry is resolved.
+ */
+static pthread_cond_t m_warm_cond = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Flag indicating whether warm state is kept, as set by
+ * skvm_keep_warm().
+ * 
+ * The warm state survives skvm_free() and consists of the buffer pool,
+ * the asset cache, and the open Motion-JPEG sequences.  When m_warm is
+ * zero, all of these are empty.
+ */
+static int m_warm = 0;
+
+/*
+ * The buffer pool.
+ * 
+ * Released pixel buffers are placed here instead of being freed, so
+ * that a later allocation of the same size can reuse them.  The total
+ * size of all pooled buffers is tracked in m_pool_bytes.
+ */
+static int32_t m_pool_count = 0;
+static size_t m_pool_bytes = 0;
+static SKBLOCK m_pool[POOL_MAX_COUNT];
+
+/*
+ * The asset cache.
+ * 
+ * Holds decoded image files, so that loading the same file again only
+ * requires sharing the decoded pixel data.  The total size of all
+ * cached pixel data is tracked in m_asset_bytes.
+ */
+static int32_t m_asset_count = 0;
+static size_t m_asset_bytes = 0;
+static SKASSET m_asset[ASSET_MAX_COUNT];
+
+/*
+ * The open Motion-JPEG sequences.
+ */
+static int32_t m_mjpg_count = 0;
+static SKMJPG m_mjpg[MJPG_MAX_COUNT];
+
+/*
+ * Use counter that is incremented each time an asset cache entry or
+ * open Motion-JPEG sequence is used, so that the least recently used
+ * entry can be evicted.
+ */
+static uint32_t m_use = 0;
+
+/*
+ * The worker pool.
+ * 
+ * Worker threads take tasks from the queue that starts at m_work_head
+ * and ends at m_work_tail.  m_work_cond is signalled when tasks are
+ * queued, and m_work_done is broadcast when a task finishes.  Worker
+ * threads are started as needed and are never stopped, and
+ * m_work_count is the number that have been started.  m_work_default
+ * is the default thread count, or zero until it has been determined.
+ * m_work_ref is the default rendering mode of skvm_sample(), or
+ * SKVM_REF_DEFAULT until it has been determined.  All of this may only
+ * be accessed while m_work_lock is held.
+ */
+static pthread_mutex_t m_work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t m_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t m_work_done = PTHREAD_COND_INITIALIZER;
+static SKTASK *m_work_head = NULL;
+static SKTASK *m_work_tail = NULL;
+static int32_t m_work_count = 0;
+static int32_t m_work_default = 0;
+static int m_work_ref = SKVM_REF_DEFAULT;
+
+/*
+ * The key of the SKTHREAD state of each thread, which is created once.
+ */
+static pthread_once_t m_thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t m_thread_key;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Prototypes */
+static void source2target(const SKMAT *pt, SKPOINT *pp);
+static void target2source(const SKMAT *pt, SKPOINT *pp);
+
+static void sample_nearest(
+    const SKBUF   * pb,
+    const SKPOINT * pp,
+          SKARGB  * pr);
+static void sample_bilinear(
+    const SKBUF   * pb,
+    const SKPOINT * pp,
+          SKARGB  * pr);
+static void sample_bicubic(
+    const SKBUF   * pb,
+    const SKPOINT * pp,
+          SKARGB  * pr);
+static void load_pixel(
+    const SKBUF   * pb,
+          int32_t   x,
+          int32_t   y,
+          SKARGB  * pr);
+
+static void blend_cover(const SKARGB *pd, double mv, SKARGB *pf);
+static void blend_over(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf);
+static void blend_add(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf);
+static void blend_multiply(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf);
+static void blend_screen(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf);
+static void blend_src(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf);
+static void blend_dstin(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf);
+static void blend_dstout(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf);
+static fp_blend blend_select(int blend);
+static void store_argb(const SKARGB *pc, uint8_t *pt);
+static void store_float(const SKARGB *pc, float *pt);
+
+static void render_pixel(
+    const SKBUF   * pTarget,
+          uint8_t * pt,
+    const uint8_t * pm,
+          fp_blend  fb,
+    const SKARGB  * pr);
+static void store_opaque(
+    const SKBUF   * pTarget,
+          uint8_t * pt,
+          int       r,
+          int       g,
+          int       b);
+static void xform_bytes(const SKXFORM *px, int32_t *pc);
+static void xform_color(const SKXFORM *px, SKARGB *pr);
+static void bytes_color(const int32_t *pc, SKARGB *pr);
+static double shape_unit(double v);
+static double shape_cover(const SKSHAPE *pShape, double px, double py);
+static int shape_chord(
+    const SKSHAPE * pShape,
+          double    py,
+          double  * pLo,
+          double  * pHi);
+static void shape_row(
+    const SKSHAPE * pShape,
+          int32_t   y,
+          int32_t   x0,
+          int32_t   x1,
+          uint8_t * pRow,
+          int32_t * pFirst,
+          int32_t * pLast);
+static void rle_row(
+    const SKRLE   * pr,
+          int32_t   y,
+          int32_t   x0,
+          int32_t   x1,
+          uint8_t * pRow,
+          int32_t * pFirst,
+          int32_t * pLast);
+static void rowmask_fill(
+    const SKROWMASK * pRows,
+          int32_t     y,
+          int32_t     x0,
+          int32_t     x1,
+          uint8_t   * pRow,
+          int32_t   * pFirst,
+          int32_t   * pLast);
+static void sample_exact(
+    const SKVM_SAMPLE_PARAM * ps,
+    const SKXFORM           * px,
+    const SKBUF             * pSrc,
+    const SKBUF             * pMask,
+    const SKROWMASK         * pRows,
+    const SKMAT             * pMatrix,
+          SKBUF             * pTarget,
+          int32_t             min_x,
+          int32_t             min_y,
+          int32_t             max_x,
+          int32_t             max_y);
+static void sample_general(
+    const SKVM_SAMPLE_PARAM * ps,
+    const SKXFORM           * px,
+    const SKBUF             * pSrc,
+    const SKBUF             * pMask,
+    const SKROWMASK         * pRows,
+    const SKMAT             * pMatrix,
+          SKBUF             * pTarget,
+          int32_t             min_x,
+          int32_t             min_y,
+          int32_t             max_x,
+          int32_t             max_y);
+static void sample_reference(
+    const SKVM_SAMPLE_PARAM * ps,
+    const SKXFORM           * px,
+    const SKBUF             * pSrc,
+    const SKBUF             * pMask,
+    const SKSHAPE           * pShape,
+    const SKMAT             * pMatrix,
+          SKBUF             * pTarget);
+static double clock_secs(void);
+static void tile_bounds(
+    const SKTILEJOB * pj,
+          int32_t     t,
+          int32_t   * px0,
+          int32_t   * py0,
+          int32_t   * px1,
+          int32_t   * py1);
+static double tile_cost(const SKTILEJOB *pj, int32_t t, uint8_t *pRow);
+static void tile_task(void *pArg);
+static void sample_tiles(
+    const SKVM_SAMPLE_PARAM * ps,
+    const SKXFORM           * px,
+    const SKBUF             * pSrc,
+    const SKBUF             * pMask,
+    const SKROWMASK         * pRows,
+    const SKMAT             * pMatrix,
+          SKBUF             * pTarget,
+          int                 exact,
+          int32_t             min_x,
+          int32_t             min_y,
+          int32_t             max_x,
+          int32_t             max_y);
+static void sample_run(
+          SKVM_CTX          * pv,
+          SKVM_SAMPLE_PARAM * ps,
+    const SKBUF             * pAltSrc,
+    const SKMAT             * pAltMat);
+    
+static void matrix_identity(SKMAT *pm);
+static void matrix_update(SKMAT *pm);
+static void matrix_mul(SKMAT *pm, const SKMAT *pa, const SKMAT *pb);
+
+static int is_warm(void);
+
+static size_t buf_size(const SKBUF *ps);
+static int32_t buf_pixel(const SKBUF *ps);
+static void float_row(const SKBUF *ps, int32_t y, uint8_t *pRow);
+static void share_drop(SKSHARE *psh);
+static void buf_alloc(SKBUF *ps);
+static void buf_writable(SKBUF *ps);
+static void buf_release(SKBUF *ps);
+static void buf_settle(SKBUF *ps);
+
+static SKRLE *rle_new(int32_t h);
+static void rle_free(SKRLE *pr);
+static void rle_put(
+          SKRLE   * pr,
+          int       kind,
+          int32_t   n,
+    const uint8_t * pLit);
+static void rle_add_row(
+          SKRLE   * pr,
+          int32_t   y,
+    const uint8_t * pRow,
+          int32_t   w);
+
+static void atlas_free(SKATLAS *pa);
+static int atlas_cmp(const void *pA, const void *pB);
+static int atlas_parse(
+    SKVM_CTX  * pv,
+    FILE      * pf,
+    SKATLAS   * pa,
+    char      * pSheet,
+    int32_t   * pw,
+    int32_t   * ph);
+
+static char *sheet_path(const char *pPath, const char *pSheet);
+
+static void font_flush(SKFONT *pf);
+static void font_free(SKFONT *pf);
+static int font_cmp(const void *pA, const void *pB);
+static int font_parse(
+    SKVM_CTX  * pv,
+    FILE      * pf,
+    SKFONT    * pFont,
+    char      * pSheet);
+static void font_cover(SKFONT *pf, const SKBUF *pb);
+static SKGLYPH *font_find(SKFONT *pf, int32_t code);
+static int font_dim(
+    const SKGLYPH * pg,
+          double    scale,
+          int32_t * pw,
+          int32_t * ph);
+static const SKGLYPHIMG *font_render(
+    SKFONT  * pf,
+    SKGLYPH * pg,
+    double    size);
+static int utf8_next(const char **ppc, int32_t *pCode);
+
+static void thread_key_make(void);
+static void thread_free(void *pArg);
+static SKTHREAD *thread_state(void);
+static int32_t thread_limit(void);
+static int thread_reference(void);
+static uint8_t *scratch_get(size_t len);
+static void *work_thread(void *pArg);
+static void work_grow(int32_t n);
+static void task_start(SKTASK *pt, fp_task fn, void *pArg);
+static void task_finish(SKTASK *pt);
+static void par_task(void *pArg);
+static void par_rows(
+    int32_t   h,
+    size_t    row_bytes,
+    fp_band   fn,
+    void    * pArg);
+static void lut_band(void *pArg, int32_t y0, int32_t y1);
+static int32_t cmat_fixed(double v);
+static int cmat_clamp(int32_t v);
+static void cmat_band(void *pArg, int32_t y0, int32_t y1);
+static void blur_load_band(void *pArg, int32_t y0, int32_t y1);
+static void blur_store_band(void *pArg, int32_t y0, int32_t y1);
+static void blur_box(
+    const uint16_t  * pSrc,
+          uint16_t  * pDst,
+          int32_t     n,
+          int         c,
+          int32_t     r);
+static void blur_rows_band(void *pArg, int32_t y0, int32_t y1);
+static void blur_flip_band(void *pArg, int32_t y0, int32_t y1);
+static const uint8_t *buf_row(
+    const SKBUF   * ps,
+          int32_t   y,
+          uint8_t * pConv);
+static void stats_band(void *pArg, int32_t y0, int32_t y1);
+static void cmp_band(void *pArg, int32_t r0, int32_t r1);
+
+static int file_stamp(const char *pPath, SKSTAMP *pst);
+static int stamp_equal(const SKSTAMP *pa, const SKSTAMP *pb);
+static void asset_evict(int32_t i);
+static int32_t asset_lru(void);
+static int32_t asset_find(const char *pPath, int32_t frame);
+static int asset_fetch(
+          SKBUF   * ps,
+    const char    * pPath,
+          int32_t   frame,
+    const SKSTAMP * pfst);
+static void asset_store(
+    SKBUF       * ps,
+    const char  * pPath,
+    int32_t       frame);
+static void asset_abandon(const char *pPath, int32_t frame);
+static void asset_forget(const char *pPath);
+
+static void mjpg_close(int32_t i);
+static SKMJPG *mjpg_source(
+    SKVM_CTX    * pv,
+    const char  * pIndexPath,
+    const char  * pJPEGPath);
+static int mjpg_frame(
+    SKVM_CTX    * pv,
+    const char  * pIndexPath,
+    const char  * pJPEGPath,
+    int32_t       f,
+    uint64_t    * poffs,
+    SKSTAMP     * pdst,
+    FILE       ** ppf);
+static void mjpg_return(
+    const char    * pIndexPath,
+          FILE    * pf,
+    const SKSTAMP * pdst);
+
+static int jpeg_decode(SKVM_CTX *pv, SKBUF *ps, FILE *pf);
+
+static const char *encode_png(const SKBUF *ps, const char *pPath);
+static const char *encode_jpeg(
+    const SKBUF * ps,
+    const char  * pPath,
+          int     mjpg,
+          int     q);
+static const char *store_encode(
+    const SKBUF * ps,
+          int     kind,
+    const char  * pPath,
+          int     q);
+static void store_task(void *pArg);
+static void store_finish(SKVM_CTX *pv, int32_t keep);
+static int store_submit(
+          SKVM_CTX  * pv,
+          SKBUF     * ps,
+          int         kind,
+    const char      * pPath,
+          int         q);
+
+/*
+ * Given a transformation matrix and a point, convert the point from
+ * source space to target space.
+ * 
+ * Parameters:
+ * 
+ *   pt - the transformation matrix
+ * 
+ *   pp - the point to convert
+ */
+static void source2target(const SKMAT *pt, SKPOINT *pp) {
+  
+  double rx = 0.0;
+  double ry = 0.0;
+  
+  /* Check parameters */
+  if ((pt == NULL) || (pp == NULL)) {
+    abort();
+  }
+  
+  /* Multiply the matrix by the expanded vector to get the result */
+  rx = (pt->a * pp->x) + (pt->b * pp->y) + pt->c;
+  ry = (pt->d * pp->x) + (pt->e * pp->y) + pt->f;
+  
+  /* Write result to point */
+  pp->x = rx;
+  pp->y = ry;
+}
+
+/*
+ * Given a transformation matrix and a point, convert the point from
+ * target space to source space.
+ * 
+ * Parameters:
+ * 
+ *   pt - the transformation matrix
+ * 
+ *   pp - the point to convert
+ */
+static void target2source(const SKMAT *pt, SKPOINT *pp) {
+  
+  double rx = 0.0;
+  double ry = 0.0;
+  
+  /* Check parameters */
+  if ((pt == NULL) || (pp == NULL)) {
+    abort();
+  }
+  
+  /* Multiply the inverted matrix by the expanded vector to get the
+   * result */
+  rx = (pt->iva * pp->x) + (pt->ivb * pp->y) + pt->ivc;
+  ry = (pt->ivd * pp->x) + (pt->ive * pp->y) + pt->ivf;
+  
+  /* Write result to point */
+  pp->x = rx;
+  pp->y = ry;
+}
+
+/*
+ * Perform nearest-neighbor interpolation.
+ * 
+ * pb is the buffer to sample from.  It must be loaded.
+ * 
+ * pp is the point within the buffer to sample.  It must be somewhere
+ * within the boundaries of the buffer.
+ * 
+ * pr receives the sampled, premultiplied ARGB value.
+ * 
+ * Parameters:
+ * 
+ *   pb - the buffer
+ * 
+ *   pp - the point
+ * 
+ *   pr - receives the sampled color
+ */
+static void sample_nearest(
+    const SKBUF   * pb,
+    const SKPOINT * pp,
+          SKARGB  * pr) {
+  
+  int32_t x = 0;
+  int32_t y = 0;
+  
+  /* Check parameters */
+  if ((pb == NULL) || (pp == NULL) || (pr == NULL)) {
+    abort();
+  }
+  
+  /* Make sure that buffer is loaded */
+  if (pb->pData == NULL) {
+    abort();
+  }
+  
+  /* For nearest neighbor, we just have to floor both coordinates and
+   * then clamp them to the allowable range */
+  x = (int32_t) floor(pp->x);
+  y = (int32_t) floor(pp->y);
+  
+  if (x < 0) {
+    x = 0;
+  } else if (x > pb->w - 1) {
+    x = pb->w - 1;
+  }
+  
+  if (y < 0) {
+    y = 0;
+  } else if (y > pb->h - 1) {
+    y = pb->h - 1;
+  }
+  
+  /* Load the pixel */
+  load_pixel(pb, x, y, pr);
+}
+
+/*
+ * Load a pixel from a buffer as premultiplied ARGB.
+ * 
+ * pb is the buffer to load from.  It must be loaded.  x and y must be
+ * the coordinates of a pixel within the buffer.
+ * 
+ * Parameters:
+ * 
+ *   pb - the buffer
+ * 
+ *   x - the X coordinate of the pixel
+ * 
+ *   y - the Y coordinate of the pixel
+ * 
+ *   pr - receives the pixel color
+ */
+static void load_pixel(
+    const SKBUF   * pb,
+          int32_t   x,
+          int32_t   y,
+          SKARGB  * pr) {
+  
+  const uint8_t *pt = NULL;
+  
+  /* Check parameters */
+  if ((pb == NULL) || (pr == NULL)) {
+    abort();
+  }
+  if ((x < 0) || (x >= pb->w) || (y < 0) || (y >= pb->h)) {
+    abort();
+  }
+  
+  /* Seek to the pixel within the source data */
+  pt = pb->pData;
+  pt += (((size_t) y) * (pb->w * buf_pixel(pb)));
+  pt += (x * buf_pixel(pb));
+  
+  /* Load depending on number of channels */
+  if (pb->fp) {
+    /* Float, which is already premultiplied */
+    pr->a = (double) ((const float *) pt)[0];
+    pr->r = (double) ((const float *) pt)[1];
+    pr->g = (double) ((const float *) pt)[2];
+    pr->b = (double) ((const float *) pt)[3];
+    
+  } else if (pb->c == 1) {
+    /* Grayscale */
+    pr->a = 1.0;
+    pr->r = ((double) *pt) / 255.0;
+    pr->g = pr->r;
+    pr->b = pr->r;
+    
+  } else if (pb->c == 3) {
+    /* RGB */
+    pr->a = 1.0;
+    pr->r = ((double) pt[0]) / 255.0;
+    pr->g = ((double) pt[1]) / 255.0;
+    pr->b = ((double) pt[2]) / 255.0;
+    
+  } else if (pb->c == 4) {
+    /* ARGB, so first load non-premultiplied */
+    pr->a = ((double) pt[0]) / 255.0;
+    pr->r = ((double) pt[1]) / 255.0;
+    pr->g = ((double) pt[2]) / 255.0;
+    pr->b = ((double) pt[3]) / 255.0;
+    
+    /* Now perform premultiplication */
+    pr->r = pr->r * pr->a;
+    pr->g = pr->g * pr->a;
+    pr->b = pr->b * pr->a;
+    
+  } else {
+    /* Shouldn't happen */
+    abort();
+  }
+}
+
+/*
+ * Perform bilinear interpolation.
+ * 
+ * pb is the buffer to sample from.  It must be loaded.
+ * 
+ * pp is the point within the buffer to sample.  It must be somewhere
+ * within the boundaries of the buffer.
+ * 
+ * pr receives the sampled, premultiplied ARGB value.
+ * 
+ * Parameters:
+ * 
+ *   pb - the buffer
+ * 
+ *   pp - the point
+ * 
+ *   pr - receives the sampled color
+ */
+static void sample_bilinear(
+    const SKBUF   * pb,
+    const SKPOINT * pp,
+          SKARGB  * pr) {
+  /* @@TODO: */
+  fprintf(stderr, "Bilinear interpolation not implemented yet!\n");
+  abort();
+}
+
+/*
+ * Perform bicubic interpolation.
+ * 
+ * pb is the buffer to sample from.  It must be loaded.
+ * 
+ * pp is the point within the buffer to sample.  It must be somewhere
+ * within the boundaries of the buffer.
+ * 
+ * pr receives the sampled, premultiplied ARGB value.
+ * 
+ * Parameters:
+ * 
+ *   pb - the buffer
+ * 
+ *   pp - the point
+ * 
+ *   pr - receives the sampled color
+ */
+static void sample_bicubic(
+    const SKBUF   * pb,
+    const SKPOINT * pp,
+          SKARGB  * pr) {
+  /* @@TODO: */
+  fprintf(stderr, "Bicubic interpolation not implemented yet!\n");
+  abort();
+}
+
+/*
+ * Move a blended color back towards the target color according to the
+ * mask coverage.
+ * 
+ * Parameters:
+ * 
+ *   pd - the target color
+ * 
+ *   mv - the mask coverage
+ * 
+ *   pf - the blended color, which is updated
+ */
+static void blend_cover(const SKARGB *pd, double mv, SKARGB *pf) {
+  if (mv != 1.0) {
+    pf->a = pd->a + ((pf->a - pd->a) * mv);
+    pf->r = pd->r + ((pf->r - pd->r) * mv);
+    pf->g = pd->g + ((pf->g - pd->g) * mv);
+    pf->b = pd->b + ((pf->b - pd->b) * mv);
+  }
+}
+
+/*
+ * Blend a sampled color OVER a target color.
+ * 
+ * This is the default blend.  The mask coverage scales the sampled
+ * color before compositing, which is the same as moving the result
+ * back towards the target color.
+ * 
+ * See fp_blend for the parameters.
+ */
+static void blend_over(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf) {
+  
+  SKARGB rcol;
+  
+  /* Scale the sampled color by the mask coverage */
+  memcpy(&rcol, ps, sizeof(SKARGB));
+  if (mv != 1.0) {
+    rcol.a *= mv;
+    rcol.r *= mv;
+    rcol.g *= mv;
+    rcol.b *= mv;
+  }
+  
+  /* Composite rcol OVER the target color */
+  pf->a = rcol.a + (pd->a * (1.0 - rcol.a));
+  pf->r = rcol.r + (pd->r * (1.0 - rcol.a));
+  pf->g = rcol.g + (pd->g * (1.0 - rcol.a));
+  pf->b = rcol.b + (pd->b * (1.0 - rcol.a));
+}
+
+/*
+ * Blend a sampled color into a target color by adding all channels,
+ * saturating at full intensity.
+ * 
+ * See fp_blend for the parameters.
+ */
+static void blend_add(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf) {
+  
+  pf->a = ps->a + pd->a;
+  pf->r = ps->r + pd->r;
+  pf->g = ps->g + pd->g;
+  pf->b = ps->b + pd->b;
+  
+  if (pf->a > 1.0) {
+    pf->a = 1.0;
+  }
+  if (pf->r > 1.0) {
+    pf->r = 1.0;
+  }
+  if (pf->g > 1.0) {
+    pf->g = 1.0;
+  }
+  if (pf->b > 1.0) {
+    pf->b = 1.0;
+  }
+  
+  blend_cover(pd, mv, pf);
+}
+
+/*
+ * Blend a sampled color into a target color by multiplying the color
+ * channels where both are present, and compositing over where only one
+ * is present.
+ * 
+ * See fp_blend for the parameters.
+ */
+static void blend_multiply(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf) {
+  
+  double sc = 1.0 - ps->a;
+  double dc = 1.0 - pd->a;
+  
+  pf->a = ps->a + pd->a - (ps->a * pd->a);
+  pf->r = (ps->r * pd->r) + (ps->r * dc) + (pd->r * sc);
+  pf->g = (ps->g * pd->g) + (ps->g * dc) + (pd->g * sc);
+  pf->b = (ps->b * pd->b) + (ps->b * dc) + (pd->b * sc);
+  
+  blend_cover(pd, mv, pf);
+}
+
+/*
+ * Blend a sampled color into a target color by screening all channels,
+ * which is the inverse of multiplying the inverted channels.
+ * 
+ * See fp_blend for the parameters.
+ */
+static void blend_screen(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf) {
+  
+  pf->a = ps->a + pd->a - (ps->a * pd->a);
+  pf->r = ps->r + pd->r - (ps->r * pd->r);
+  pf->g = ps->g + pd->g - (ps->g * pd->g);
+  pf->b = ps->b + pd->b - (ps->b * pd->b);
+  
+  blend_cover(pd, mv, pf);
+}
+
+/*
+ * Blend a sampled color into a target color by replacing the target
+ * color.
+ * 
+ * See fp_blend for the parameters.
+ */
+static void blend_src(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf) {
+  
+  memcpy(pf, ps, sizeof(SKARGB));
+  blend_cover(pd, mv, pf);
+}
+
+/*
+ * Blend a sampled color into a target color by keeping the target color
+ * only as far as the sampled color is opaque.
+ * 
+ * See fp_blend for the parameters.
+ */
+static void blend_dstin(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf) {
+  
+  pf->a = pd->a * ps->a;
+  pf->r = pd->r * ps->a;
+  pf->g = pd->g * ps->a;
+  pf->b = pd->b * ps->a;
+  
+  blend_cover(pd, mv, pf);
+}
+
+/*
+ * Blend a sampled color into a target color by keeping the target color
+ * only as far as the sampled color is transparent.
+ * 
+ * See fp_blend for the parameters.
+ */
+static void blend_dstout(
+    const SKARGB * ps,
+    const SKARGB * pd,
+          double   mv,
+          SKARGB * pf) {
+  
+  pf->a = pd->a * (1.0 - ps->a);
+  pf->r = pd->r * (1.0 - ps->a);
+  pf->g = pd->g * (1.0 - ps->a);
+  pf->b = pd->b * (1.0 - ps->a);
+  
+  blend_cover(pd, mv, pf);
+}
+
+/*
+ * Get the blend function for a blend mode.
+ * 
+ * Parameters:
+ * 
+ *   blend - one of the SKVM_BLEND_ constants
+ * 
+ * Return:
+ * 
+ *   the blend function
+ */
+static fp_blend blend_select(int blend) {
+  
+  fp_blend fb = NULL;
+  
+  switch (blend) {
+    case SKVM_BLEND_OVER:
+      fb = &blend_over;
+      break;
+    
+    case SKVM_BLEND_ADD:
+      fb = &blend_add;
+      break;
+    
+    case SKVM_BLEND_MULTIPLY:
+      fb = &blend_multiply;
+      break;
+    
+    case SKVM_BLEND_SCREEN:
+      fb = &blend_screen;
+      break;
+    
+    case SKVM_BLEND_SRC:
+      fb = &blend_src;
+      break;
+    
+    case SKVM_BLEND_DSTIN:
+      fb = &blend_dstin;
+      break;
+    
+    case SKVM_BLEND_DSTOUT:
+      fb = &blend_dstout;
+      break;
+    
+    default:
+      abort();
+  }
+  
+  return fb;
+}
+
+/*
+ * Store a premultiplied color into an ARGB pixel.
+ * 
+ * Parameters:
+ * 
+ *   pc - the premultiplied color
+ * 
+ *   pt - the four bytes of the pixel
+ */
+static void store_argb(const SKARGB *pc, uint8_t *pt) {
+  
+  SKARGB fcol;
+  SPH_ARGB argb;
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pt == NULL)) {
+    abort();
+  }
+  
+  /* Initialize structures */
+  memcpy(&fcol, pc, sizeof(SKARGB));
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  
+  /* Convert back to non-premultiplied before storing; first of all,
+   * get the integer value for the alpha channel, which is the same in
+   * both representations */
+  argb.a = (int) floor((fcol.a * 255.0) + 0.5);
+  
+  /* Clamp alpha */
+  if (argb.a < 0) {
+    argb.a = 0;
+  } else if (argb.a > 255) {
+    argb.a = 255;
+  }
+  
+  /* Conversion depends on whether alpha channel is zero */
+  if (argb.a < 1) {
+    /* Alpha channel is zero, so store transparent black */
+    pt[0] = (uint8_t) 0;
+    pt[1] = (uint8_t) 0;
+    pt[2] = (uint8_t) 0;
+    pt[3] = (uint8_t) 0;
+    
+  } else {
+    /* Alpha channel is non-zero, and we know it's not so close
+     * to zero that it would cause numeric problems, so convert
+     * the other channels to non-premultiplied */
+    fcol.r = fcol.r / fcol.a;
+    fcol.g = fcol.g / fcol.a;
+    fcol.b = fcol.b / fcol.a;
+    
+    /* Finite check */
+    if ((!isfinite(fcol.r)) ||
+        (!isfinite(fcol.g)) ||
+        (!isfinite(fcol.b))) {
+      fprintf(stderr,
+        "Numeric problem during sparkle sampling!\n");
+      abort();
+    }
+    
+    /* Clamp to range in float */
+    if (!(fcol.r <= 1.0)) {
+      fcol.r = 1.0;
+    } else if (!(fcol.r >= 0.0)) {
+      fcol.r = 0.0;
+    }
+    
+    if (!(fcol.g <= 1.0)) {
+      fcol.g = 1.0;
+    } else if (!(fcol.g >= 0.0)) {
+      fcol.g = 0.0;
+    }
+    
+    if (!(fcol.b <= 1.0)) {
+      fcol.b = 1.0;
+    } else if (!(fcol.b >= 0.0)) {
+      fcol.b = 0.0;
+    }
+    
+    /* Convert to integer channels, rounding to nearest so that an
+     * ARGB pixel that was premultiplied by load_pixel() is stored back
+     * unchanged */
+    argb.a = (int) floor((fcol.a * 255.0) + 0.5);
+    argb.r = (int) floor((fcol.r * 255.0) + 0.5);
+    argb.g = (int) floor((fcol.g * 255.0) + 0.5);
+    argb.b = (int) floor((fcol.b * 255.0) + 0.5);
+    
+    /* Clamp channels */
+    if (argb.a < 0) {
+      argb.a = 0;
+    } else if (argb.a > 255) {
+      argb.a = 255;
+    }
+    
+    if (argb.r < 0) {
+      argb.r = 0;
+    } else if (argb.r > 255) {
+      argb.r = 255;
+    }
+    
+    if (argb.g < 0) {
+      argb.g = 0;
+    } else if (argb.g > 255) {
+      argb.g = 255;
+    }
+    
+    if (argb.b < 0) {
+      argb.b = 0;
+    } else if (argb.b > 255) {
+      argb.b = 255;
+    }
+    
+    /* Store the ARGB value */
+    pt[0] = (uint8_t) argb.a;
+    pt[1] = (uint8_t) argb.r;
+    pt[2] = (uint8_t) argb.g;
+    pt[3] = (uint8_t) argb.b;
+  }
+}
+
+/*
+ * Store a premultiplied color into a float pixel.
+ * 
+ * Each channel is clamped to range [0.0, 1.0], and the color channels
+ * are also clamped to at most the alpha channel, so that the color
+ * stays a valid premultiplied color.
+ * 
+ * Parameters:
+ * 
+ *   pc - the premultiplied color
+ * 
+ *   pt - the four floats of the pixel
+ */
+static void store_float(const SKARGB *pc, float *pt) {
+  
+  double a = 0.0;
+  double v[3];
+  int i = 0;
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pt == NULL)) {
+    abort();
+  }
+  
+  /* Clamp alpha */
+  a = pc->a;
+  if (!(a >= 0.0)) {
+    a = 0.0;
+  } else if (!(a <= 1.0)) {
+    a = 1.0;
+  }
+  
+  /* Clamp the color channels to alpha */
+  v[0] = pc->r;
+  v[1] = pc->g;
+  v[2] = pc->b;
+  for(i = 0; i < 3; i++) {
+    if (!(v[i] >= 0.0)) {
+      v[i] = 0.0;
+    } else if (!(v[i] <= a)) {
+      v[i] = a;
+    }
+  }
+  
+  /* Store the channels */
+  pt[0] = (float) a;
+  pt[1] = (float) v[0];
+  pt[2] = (float) v[1];
+  pt[3] = (float) v[2];
+}
+
+/*
+ * Blend a sampled color into a target pixel.
+ * 
+ * pTarget is the target buffer, which must be loaded, and pt points to
+ * the pixel within it.
+ * 
+ * pm points to the raster mask value for the pixel, or it is NULL if
+ * there is no raster masking.  The caller should skip pixels where the
+ * mask value is zero.
+ * 
+ * fb is the blend function, which the caller selects once for the
+ * whole sampling operation with blend_select().
+ * 
+ * pr is the sampled color in premultiplied ARGB.
+ * 
+ * Parameters:
+ * 
+ *   pTarget - the target buffer
+ * 
+ *   pt - the target pixel
+ * 
+ *   pm - the mask value, or NULL
+ * 
+ *   fb - the blend function
+ * 
+ *   pr - the sampled color
+ */
+static void render_pixel(
+    const SKBUF   * pTarget,
+          uint8_t * pt,
+    const uint8_t * pm,
+          fp_blend  fb,
+    const SKARGB  * pr) {
+  
+  double mv = 1.0;
+  
+  SKARGB  tcol;
+  SKARGB  fcol;
+  SPH_ARGB argb;
+  
+  /* Check parameters */
+  if ((pTarget == NULL) || (pt == NULL) || (fb == NULL) ||
+      (pr == NULL)) {
+    abort();
+  }
+  
+  /* Initialize structures */
+  memset(&tcol, 0, sizeof(SKARGB));
+  memset(&fcol, 0, sizeof(SKARGB));
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  
+  /* If raster masking is in effect and the current mask value is
+   * not full white, get the normalized mask value as the coverage */
+  if (pm != NULL) {
+    if (*pm != 255) {
+      mv = ((double) *pm) / 255.0;
+    }
+  }
+
+  /* Get the current target pixel color and convert it to
+   * premultiplied ARGB */
+  if (pTarget->fp) {
+    /* Float buffers are already premultiplied */
+    tcol.a = (double) ((const float *) pt)[0];
+    tcol.r = (double) ((const float *) pt)[1];
+    tcol.g = (double) ((const float *) pt)[2];
+    tcol.b = (double) ((const float *) pt)[3];
+    
+  } else if (pTarget->c == 1) {
+    /* Grayscale conversion */
+    tcol.a = 1.0;
+    tcol.r = ((double) *pt) / 255.0;
+    tcol.g = tcol.r;
+    tcol.b = tcol.r;
+    
+  } else if (pTarget->c == 3) {
+    /* RGB conversion */
+    tcol.a = 1.0;
+    tcol.r = ((double) pt[0]) / 255.0;
+    tcol.g = ((double) pt[1]) / 255.0;
+    tcol.b = ((double) pt[2]) / 255.0;
+    
+  } else if (pTarget->c == 4) {
+    /* Non-premultiplied ARGB to premultiplied ARGB conversion */
+    tcol.a = ((double) pt[0]) / 255.0;
+    tcol.r = ((double) pt[1]) / 255.0;
+    tcol.g = ((double) pt[2]) / 255.0;
+    tcol.b = ((double) pt[3]) / 255.0;
+    
+    tcol.r = tcol.r * tcol.a;
+    tcol.g = tcol.g * tcol.a;
+    tcol.b = tcol.b * tcol.a;
+    
+  } else {
+    /* Shouldn't happen */
+    abort();
+  }
+
+  /* Blend the sampled color into tcol and store result in fcol */
+  fb(pr, &tcol, mv, &fcol);
+
+  /* Check for finite results */
+  if ((!isfinite(fcol.a)) ||
+      (!isfinite(fcol.r)) ||
+      (!isfinite(fcol.g)) |
+      (!isfinite(fcol.b))) {
+    fprintf(stderr, "Numeric problem during sparkle sampling!\n");
+    abort();
+  }
+
+  /* Store to target buffer depending on channel count */
+  if (pTarget->fp) {
+    /* Float, so store the premultiplied channels without quantizing
+     * them, only keeping them in range */
+    store_float(&fcol, (float *) pt);
+    
+  } else if (pTarget->c == 1) {
+    /* Grayscale, so we know alpha channel should be fully opaque
+     * since background pixel was fully opaque; begin by writing
+     * each of the color channels into the integer ARGB structure
+     * with the opacity set to 255, rounding to nearest like
+     * store_argb() */
+    argb.a = 255;
+    argb.r = (int) floor((fcol.r * 255.0) + 0.5);
+    argb.g = (int) floor((fcol.g * 255.0) + 0.5);
+    argb.b = (int) floor((fcol.b * 255.0) + 0.5);
+    
+    /* Clamp channels */
+    if (argb.r < 0) {
+      argb.r = 0;
+    } else if (argb.r > 255) {
+      argb.r = 255;
+    }
+    
+    if (argb.g < 0) {
+      argb.g = 0;
+    } else if (argb.g > 255) {
+      argb.g = 255;
+    }
+    
+    if (argb.b < 0) {
+      argb.b = 0;
+    } else if (argb.b > 255) {
+      argb.b = 255;
+    }
+    
+    /* Down-convert to grayscale */
+    sph_argb_downGray(&argb);
+    
+    /* Store the resulting grayscale value */
+    *pt = (uint8_t) argb.g;
+    
+  } else if (pTarget->c == 3) {
+    /* RGB, so we know alpha channel should be fully opaque since
+     * background pixel was fully opaque; begin by writing each of
+     * the color channels into the integer ARGB structure with the
+     * opacity set to 255, rounding to nearest like store_argb() */
+    argb.a = 255;
+    argb.r = (int) floor((fcol.r * 255.0) + 0.5);
+    argb.g = (int) floor((fcol.g * 255.0) + 0.5);
+    argb.b = (int) floor((fcol.b * 255.0) + 0.5);
+    
+    /* Clamp channels */
+    if (argb.r < 0) {
+      argb.r = 0;
+    } else if (argb.r > 255) {
+      argb.r = 255;
+    }
+    
+    if (argb.g < 0) {
+      argb.g = 0;
+    } else if (argb.g > 255) {
+      argb.g = 255;
+    }
+    
+    if (argb.b < 0) {
+      argb.b = 0;
+    } else if (argb.b > 255) {
+      argb.b = 255;
+    }
+    
+    /* Store the RGB value */
+    pt[0] = (uint8_t) argb.r;
+    pt[1] = (uint8_t) argb.g;
+    pt[2] = (uint8_t) argb.b;
+    
+  } else if (pTarget->c == 4) {
+    /* ARGB, so convert back to non-premultiplied */
+    store_argb(&fcol, pt);
+    
+  } else {
+    /* Shouldn't happen */
+    abort();
+  }
+}
+
+/*
+ * Store an opaque color into a target pixel.
+ * 
+ * This gives exactly the same result as render_pixel() with a fully
+ * opaque color, no raster masking, and the OVER or SRC blend, but it
+ * works entirely on integer channel values.  Opaque colors completely
+ * replace the target pixel in that case, and the conversions between
+ * integer and floating-point channels round-trip exactly.
+ * 
+ * Parameters:
+ * 
+ *   pTarget - the target buffer
+ * 
+ *   pt - the target pixel
+ * 
+ *   r - the red channel
+ * 
+ *   g - the green channel
+ * 
+ *   b - the blue channel
+ */
+static void store_opaque(
+    const SKBUF   * pTarget,
+          uint8_t * pt,
+          int       r,
+          int       g,
+          int       b) {
+  
+  SPH_ARGB argb;
+  
+  /* Check parameters */
+  if ((pTarget == NULL) || (pt == NULL)) {
+    abort();
+  }
+  
+  /* Store depending on channel count */
+  if (pTarget->fp) {
+    /* Float, which is premultiplied, but opaque colors are the same
+     * either way */
+    ((float *) pt)[0] = 1.0f;
+    ((float *) pt)[1] = (float) (((double) r) / 255.0);
+    ((float *) pt)[2] = (float) (((double) g) / 255.0);
+    ((float *) pt)[3] = (float) (((double) b) / 255.0);
+    
+  } else if (pTarget->c == 1) {
+    /* Grayscale, using the same down-conversion as render_pixel() */
+    memset(&argb, 0, sizeof(SPH_ARGB));
+    argb.a = 255;
+    argb.r = r;
+    argb.g = g;
+    argb.b = b;
+    sph_argb_downGray(&argb);
+    *pt = (uint8_t) argb.g;
+    
+  } else if (pTarget->c == 3) {
+    /* RGB */
+    pt[0] = (uint8_t) r;
+    pt[1] = (uint8_t) g;
+    pt[2] = (uint8_t) b;
+    
+  } else if (pTarget->c == 4) {
+    /* ARGB */
+    pt[0] = (uint8_t) 255;
+    pt[1] = (uint8_t) r;
+    pt[2] = (uint8_t) g;
+    pt[3] = (uint8_t) b;
+    
+  } else {
+    /* Shouldn't happen */
+    abort();
+  }
+}
+
+/*
+ * Apply a color transform to a non-premultiplied ARGB pixel.
+ * 
+ * pc holds the alpha, red, green, and blue channels, in that order,
+ * each in range [0, 255].  The channels are replaced by the transformed
+ * channels, which are also in range [0, 255].
+ * 
+ * The lookup table is applied first, followed by the color matrix.
+ * The results are exactly the same as applying skvm_color_lut() and
+ * skvm_color_matrix() to an ARGB buffer holding the pixel.
+ * 
+ * Parameters:
+ * 
+ *   px - the color transform
+ * 
+ *   pc - the pixel channels to transform
+ */
+static void xform_bytes(const SKXFORM *px, int32_t *pc) {
+  
+  int32_t a = 0;
+  int32_t r = 0;
+  int32_t g = 0;
+  int32_t b = 0;
+  const int32_t *k = NULL;
+  
+  /* Check parameters */
+  if ((px == NULL) || (pc == NULL)) {
+    abort();
+  }
+  
+  /* Apply the lookup */
+  if (px->pLut != NULL) {
+    pc[0] = (px->pLut)[      pc[0]];
+    pc[1] = (px->pLut)[256 + pc[1]];
+    pc[2] = (px->pLut)[512 + pc[2]];
+    pc[3] = (px->pLut)[768 + pc[3]];
+  }
+  
+  /* Apply the matrix */
+  if (px->cmat) {
+    k = px->k;
+    a = pc[0];
+    r = pc[1];
+    g = pc[2];
+    b = pc[3];
+    
+    pc[0] = cmat_clamp(
+      (k[ 0] * a) + (k[ 1] * r) + (k[ 2] * g) + (k[ 3] * b) + k[ 4]);
+    pc[1] = cmat_clamp(
+      (k[ 5] * a) + (k[ 6] * r) + (k[ 7] * g) + (k[ 8] * b) + k[ 9]);
+    pc[2] = cmat_clamp(
+      (k[10] * a) + (k[11] * r) + (k[12] * g) + (k[13] * b) + k[14]);
+    pc[3] = cmat_clamp(
+      (k[15] * a) + (k[16] * r) + (k[17] * g) + (k[18] * b) + k[19]);
+  }
+}
+
+/*
+ * Apply a color transform to a sampled premultiplied ARGB color.
+ * 
+ * The color is converted to non-premultiplied channels in range
+ * [0, 255], transformed with xform_bytes(), and then converted back
+ * the same way as load_pixel().  A fully transparent color has no
+ * color information, so its color channels are taken as zero.
+ * 
+ * Parameters:
+ * 
+ *   px - the color transform
+ * 
+ *   pr - the color to transform
+ */
+static void xform_color(const SKXFORM *px, SKARGB *pr) {
+  
+  int32_t c[4];
+  double v[4];
+  int i = 0;
+  
+  /* Check parameters */
+  if ((px == NULL) || (pr == NULL)) {
+    abort();
+  }
+  
+  /* Get the non-premultiplied channels */
+  v[0] = pr->a;
+  if (pr->a > 0.0) {
+    v[1] = pr->r / pr->a;
+    v[2] = pr->g / pr->a;
+    v[3] = pr->b / pr->a;
+  } else {
+    v[1] = 0.0;
+    v[2] = 0.0;
+    v[3] = 0.0;
+  }
+  
+  /* Round them to channel values */
+  for(i = 0; i < 4; i++) {
+    c[i] = (int32_t) floor((v[i] * 255.0) + 0.5);
+    if (c[i] < 0) {
+      c[i] = 0;
+    } else if (c[i] > 255) {
+      c[i] = 255;
+    }
+  }
+  
+  /* Transform and convert back */
+  xform_bytes(px, c);
+  bytes_color(c, pr);
+}
+
+/*
+ * Convert non-premultiplied ARGB channels to a premultiplied color, in
+ * the same way as load_pixel().
+ * 
+ * Parameters:
+ * 
+ *   pc - the alpha, red, green, and blue channels in range [0, 255]
+ * 
+ *   pr - receives the premultiplied color
+ */
+static void bytes_color(const int32_t *pc, SKARGB *pr) {
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pr == NULL)) {
+    abort();
+  }
+  
+  /* Load non-premultiplied */
+  pr->a = ((double) pc[0]) / 255.0;
+  pr->r = ((double) pc[1]) / 255.0;
+  pr->g = ((double) pc[2]) / 255.0;
+  pr->b = ((double) pc[3]) / 255.0;
+  
+  /* Now perform premultiplication */
+  pr->r = pr->r * pr->a;
+  pr->g = pr->g * pr->a;
+  pr->b = pr->b * pr->a;
+}
+
+/*
+ * Clamp a shape coverage value to the range [0.0, 1.0].
+ * 
+ * Parameters:
+ * 
+ *   v - the value to clamp
+ * 
+ * Return:
+ * 
+ *   the clamped value
+ */
+static double shape_unit(double v) {
+  if (!(v > 0.0)) {
+    v = 0.0;
+  } else if (v > 1.0) {
+    v = 1.0;
+  }
+  return v;
+}
+
+/*
+ * Compute the coverage of a shape mask at a point.
+ * 
+ * For the rectangle, coverage is the product of the horizontal and
+ * vertical edge ramps.  The rounded rectangle uses its exact signed
+ * distance.  The ellipse uses the distance to the edge estimated from
+ * the gradient of its implicit function, which is exact along the
+ * axes.  This does not apply inversion nor the clipping of
+ * shape_chord().
+ * 
+ * Parameters:
+ * 
+ *   pShape - the shape
+ * 
+ *   px - the X coordinate in target pixel space
+ * 
+ *   py - the Y coordinate in target pixel space
+ * 
+ * Return:
+ * 
+ *   the coverage in range [0.0, 1.0]
+ */
+static double shape_cover(const SKSHAPE *pShape, double px, double py) {
+  
+  double c = 0.0;
+  double d = 0.0;
+  double u = 0.0;
+  double v = 0.0;
+  double k = 0.0;
+  double g = 0.0;
+  double qx = 0.0;
+  double qy = 0.0;
+  
+  /* Check parameters */
+  if (pShape == NULL) {
+    abort();
+  }
+  
+  /* Compute coverage according to the kind of shape */
+  if (pShape->kind == SKVM_SHAPE_RECT) {
+    u = px - pShape->x0;
+    if (pShape->x1 - px < u) {
+      u = pShape->x1 - px;
+    }
+    v = py - pShape->y0;
+    if (pShape->y1 - py < v) {
+      v = pShape->y1 - py;
+    }
+    c = shape_unit((u / pShape->fe) + 0.5) *
+          shape_unit((v / pShape->fe) + 0.5);
+    
+  } else if (pShape->kind == SKVM_SHAPE_ELLIPSE) {
+    u = (px - pShape->cx) / pShape->hx;
+    v = (py - pShape->cy) / pShape->hy;
+    k = sqrt((u * u) + (v * v));
+    g = sqrt(((u * u) / (pShape->hx * pShape->hx)) +
+              ((v * v) / (pShape->hy * pShape->hy)));
+    if (g > 0.0) {
+      d = ((1.0 - k) * k) / g;
+      c = shape_unit((d / pShape->fe) + 0.5);
+    } else {
+      c = 1.0;
+    }
+    
+  } else if (pShape->kind == SKVM_SHAPE_RRECT) {
+    qx = fabs(px - pShape->cx) - pShape->hx + pShape->r;
+    qy = fabs(py - pShape->cy) - pShape->hy + pShape->r;
+    
+    if ((qx > 0.0) && (qy > 0.0)) {
+      d = sqrt((qx * qx) + (qy * qy));
+    } else if (qx > qy) {
+      d = qx;
+    } else {
+      d = qy;
+    }
+    d = d - pShape->r;
+    
+    c = shape_unit(0.5 - (d / pShape->fe));
+    
+  } else if (pShape->kind == SKVM_SHAPE_LINEAR) {
+    c = shape_unit(((px - pShape->x0) * pShape->ux) +
+                    ((py - pShape->y0) * pShape->uy));
+    
+  } else if (pShape->kind == SKVM_SHAPE_RADIAL) {
+    u = px - pShape->cx;
+    v = py - pShape->cy;
+    d = sqrt((u * u) + (v * v));
+    c = shape_unit((pShape->r + pShape->fe - d) / pShape->fe);
+    
+  } else {
+    /* Unrecognized shape */
+    abort();
+  }
+  
+  /* Return coverage */
+  return c;
+}
+
+/*
+ * Determine the horizontal range of a scanline that a shape mask may
+ * cover.
+ * 
+ * Coverage is defined to be zero outside this range, even for the
+ * ellipse, where it clips the estimated distance to an ellipse with
+ * radii one feather width larger.  The range may be unbounded on
+ * either side.
+ * 
+ * Parameters:
+ * 
+ *   pShape - the shape
+ * 
+ *   py - the Y coordinate of the scanline in target pixel space
+ * 
+ *   pLo - receives the low end of the range
+ * 
+ *   pHi - receives the high end of the range
+ * 
+ * Return:
+ * 
+ *   non-zero if the range is not empty, zero if the shape does not
+ *   cover the scanline at all
+ */
+static int shape_chord(
+    const SKSHAPE * pShape,
+          double    py,
+          double  * pLo,
+          double  * pHi) {
+  
+  int result = 1;
+  double hf = 0.0;
+  double v = 0.0;
+  double t = 0.0;
+  double rad = 0.0;
+  
+  /* Check parameters */
+  if ((pShape == NULL) || (pLo == NULL) || (pHi == NULL)) {
+    abort();
+  }
+  
+  /* Compute the range according to the kind of shape */
+  hf = pShape->fe / 2.0;
+  
+  if ((pShape->kind == SKVM_SHAPE_RECT) ||
+      (pShape->kind == SKVM_SHAPE_RRECT)) {
+    if ((py > pShape->y0 - hf) && (py < pShape->y1 + hf)) {
+      *pLo = pShape->x0 - hf;
+      *pHi = pShape->x1 + hf;
+    } else {
+      result = 0;
+    }
+    
+  } else if (pShape->kind == SKVM_SHAPE_ELLIPSE) {
+    v = (py - pShape->cy) / (pShape->hy + pShape->fe);
+    if (fabs(v) < 1.0) {
+      rad = (pShape->hx + pShape->fe) * sqrt(1.0 - (v * v));
+      *pLo = pShape->cx - rad;
+      *pHi = pShape->cx + rad;
+    } else {
+      result = 0;
+    }
+    
+  } else if (pShape->kind == SKVM_SHAPE_LINEAR) {
+    t = (py - pShape->y0) * pShape->uy;
+    if (pShape->ux > 0.0) {
+      *pLo = pShape->x0 - (t / pShape->ux);
+      *pHi = HUGE_VAL;
+    } else if (pShape->ux < 0.0) {
+      *pLo = -HUGE_VAL;
+      *pHi = pShape->x0 - (t / pShape->ux);
+    } else if (t > 0.0) {
+      *pLo = -HUGE_VAL;
+      *pHi = HUGE_VAL;
+    } else {
+      result = 0;
+    }
+    
+  } else if (pShape->kind == SKVM_SHAPE_RADIAL) {
+    rad = pShape->r + pShape->fe;
+    v = py - pShape->cy;
+    if (fabs(v) < rad) {
+      rad = sqrt((rad * rad) - (v * v));
+      *pLo = pShape->cx - rad;
+      *pHi = pShape->cx + rad;
+    } else {
+      result = 0;
+    }
+    
+  } else {
+    /* Unrecognized shape */
+    abort();
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Compute the mask values of a shape mask along part of a target
+ * scanline.
+ * 
+ * pRow receives one byte for each pixel from x0 to x1 inclusive, in the
+ * same format as a raster mask.  Only the edges of the shape are
+ * evaluated pixel by pixel.  Along any scanline, the pixels that the
+ * shape fully covers form a single run, so evaluation proceeds inwards
+ * from both ends of the range given by shape_chord() until it reaches
+ * full coverage, and the run between is filled without evaluating it.
+ * 
+ * pFirst and pLast receive the first and last pixels in the scanline
+ * that might not be masked out.  If all the pixels are masked out,
+ * pFirst will be greater than pLast.
+ * 
+ * Parameters:
+ * 
+ *   pShape - the shape
+ * 
+ *   y - the target scanline
+ * 
+ *   x0 - the first target pixel to compute
+ * 
+ *   x1 - the last target pixel to compute
+ * 
+ *   pRow - the buffer to receive the mask values
+ * 
+ *   pFirst - receives the first pixel that may be drawn
+ * 
+ *   pLast - receives the last pixel that may be drawn
+ */
+static void shape_row(
+    const SKSHAPE * pShape,
+          int32_t   y,
+          int32_t   x0,
+          int32_t   x1,
+          uint8_t * pRow,
+          int32_t * pFirst,
+          int32_t * pLast) {
+  
+  double py = 0.0;
+  double lo = 0.0;
+  double hi = 0.0;
+  double f = 0.0;
+  int32_t xl = 0;
+  int32_t xh = 0;
+  int32_t a = 0;
+  int32_t b = 0;
+  int32_t i = 0;
+  
+  /* Check parameters */
+  if ((pShape == NULL) || (pRow == NULL) ||
+      (pFirst == NULL) || (pLast == NULL) || (x0 > x1)) {
+    abort();
+  }
+  
+  /* Start with everything masked out */
+  memset(pRow, 0, (size_t) (x1 - x0 + 1));
+  xl = x1 + 1;
+  xh = x0 - 1;
+  
+  /* Get the range of pixels whose centers are strictly inside the
+   * range of the scanline that the shape may cover */
+  py = ((double) y) + 0.5;
+  if (shape_chord(pShape, py, &lo, &hi)) {
+    f = floor(lo - 0.5) + 1.0;
+    if (f <= (double) x0) {
+      xl = x0;
+    } else if (f <= (double) x1) {
+      xl = (int32_t) f;
+    }
+    
+    f = ceil(hi - 0.5) - 1.0;
+    if (f >= (double) x1) {
+      xh = x1;
+    } else if (f >= (double) x0) {
+      xh = (int32_t) f;
+    }
+  }
+  
+  /* Evaluate inwards from both ends until full coverage, then fill the
+   * run between */
+  if (xl <= xh) {
+    for(a = xl; a <= xh; a++) {
+      f = shape_cover(pShape, ((double) a) + 0.5, py);
+      pRow[a - x0] = (uint8_t) floor((f * 255.0) + 0.5);
+      if (pRow[a - x0] == 255) {
+        break;
+      }
+    }
+    
+    for(b = xh; b > a; b--) {
+      f = shape_cover(pShape, ((double) b) + 0.5, py);
+      pRow[b - x0] = (uint8_t) floor((f * 255.0) + 0.5);
+      if (pRow[b - x0] == 255) {
+        break;
+      }
+    }
+    
+    if (b - a > 1) {
+      memset(pRow + (a + 1 - x0), 255, (size_t) (b - a - 1));
+    }
+  }
+  
+  /* Invert coverage if requested */
+  if (pShape->invert) {
+    for(i = 0; i <= x1 - x0; i++) {
+      pRow[i] = (uint8_t) (255 - pRow[i]);
+    }
+    xl = x0;
+    xh = x1;
+  }
+  
+  /* Report the range that may be drawn */
+  *pFirst = xl;
+  *pLast = xh;
+}
+
+/*
+ * Decode part of a scanline of a compressed mask.
+ * 
+ * pRow receives one mask value for each pixel from x0 to x1 inclusive.
+ * Each run is filled or copied as a whole.  pFirst and pLast receive
+ * the first and last pixels in that range that are not in zero runs.
+ * If all the pixels are in zero runs, pFirst will be greater than
+ * pLast.
+ * 
+ * Parameters:
+ * 
+ *   pr - the compressed mask
+ * 
+ *   y - the scanline
+ * 
+ *   x0 - the first pixel to decode
+ * 
+ *   x1 - the last pixel to decode
+ * 
+ *   pRow - the buffer to receive the mask values
+ * 
+ *   pFirst - receives the first pixel that may be drawn
+ * 
+ *   pLast - receives the last pixel that may be drawn
+ */
+static void rle_row(
+    const SKRLE   * pr,
+          int32_t   y,
+          int32_t   x0,
+          int32_t   x1,
+          uint8_t * pRow,
+          int32_t * pFirst,
+          int32_t * pLast) {
+  
+  const uint8_t *pc = NULL;
+  const uint8_t *pe = NULL;
+  int kind = 0;
+  int32_t n = 0;
+  int32_t x = 0;
+  int32_t a = 0;
+  int32_t b = 0;
+  
+  /* Check parameters */
+  if ((pr == NULL) || (pRow == NULL) ||
+      (pFirst == NULL) || (pLast == NULL) || (x0 > x1)) {
+    abort();
+  }
+  
+  /* Start with nothing drawn */
+  *pFirst = x1 + 1;
+  *pLast = x0 - 1;
+  
+  /* Walk the runs of the scanline until past the end of the range */
+  pc = pr->pCode + (pr->pRow)[y];
+  pe = pr->pCode + (pr->pRow)[y + 1];
+  x = 0;
+  while ((pc < pe) && (x <= x1)) {
+    /* Decode the run code */
+    kind = pc[1] >> 6;
+    n = ((((int32_t) pc[1]) & 0x3f) << 8) + ((int32_t) pc[0]) + 1;
+    pc += 2;
+    
+    /* Get the part of the run within the range */
+    a = x;
+    if (a < x0) {
+      a = x0;
+    }
+    b = x + n - 1;
+    if (b > x1) {
+      b = x1;
+    }
+    
+    /* Fill or copy that part */
+    if (a <= b) {
+      if (kind == RLE_ZERO) {
+        memset(pRow + (a - x0), 0, (size_t) (b - a + 1));
+        
+      } else {
+        if (kind == RLE_FULL) {
+          memset(pRow + (a - x0), 255, (size_t) (b - a + 1));
+        } else if (kind == RLE_LITERAL) {
+          memcpy(pRow + (a - x0), pc + (a - x), (size_t) (b - a + 1));
+        } else {
+          abort();
+        }
+        
+        if (*pFirst > x1) {
+          *pFirst = a;
+        }
+        *pLast = b;
+      }
+    }
+    
+    /* Move to the next run */
+    if (kind == RLE_LITERAL) {
+      pc += n;
+    }
+    x += n;
+  }
+}
+
+/*
+ * Compute part of a scanline of a mask that skvm_sample() computes by
+ * scanline.
+ * 
+ * This dispatches to shape_row() or rle_row(), which have the same
+ * parameters.
+ * 
+ * Parameters:
+ * 
+ *   pRows - the mask
+ * 
+ *   y - the scanline
+ * 
+ *   x0 - the first pixel to compute
+ * 
+ *   x1 - the last pixel to compute
+ * 
+ *   pRow - the buffer to receive the mask values
+ * 
+ *   pFirst - receives the first pixel that may be drawn
+ * 
+ *   pLast - receives the last pixel that may be drawn
+ */
+static void rowmask_fill(
+    const SKROWMASK * pRows,
+          int32_t     y,
+          int32_t     x0,
+          int32_t     x1,
+          uint8_t   * pRow,
+          int32_t   * pFirst,
+          int32_t   * pLast) {
+  
+  /* Check parameters */
+  if (pRows == NULL) {
+    abort();
+  }
+  
+  /* Dispatch to the kind of mask */
+  if (pRows->pShape != NULL) {
+    shape_row(pRows->pShape, y, x0, x1, pRow, pFirst, pLast);
+  } else if (pRows->pRle != NULL) {
+    rle_row(pRows->pRle, y - pRows->oy,
+            x0 - pRows->ox, x1 - pRows->ox, pRow, pFirst, pLast);
+    *pFirst += pRows->ox;
+    *pLast += pRows->ox;
+  } else {
+    abort();
+  }
+}
+
+/*
+ * Exact sampling kernel for matrices that map target pixels exactly
+ * onto source pixels.
+ * 
+ * This is used instead of the general rendering loop of skvm_sample()
+ * for nearest-neighbor sampling when the matrix is the identity, a
+ * translation by whole pixels, or a quarter turn or mirror flip with
+ * whole-pixel offsets.  The inverse matrix then has entries of 0, 1,
+ * and -1 and integer offsets, so source coordinates can be computed
+ * incrementally with integer arithmetic.  The results are exactly the
+ * same as the general rendering loop.
+ * 
+ * The rendering area is worked through in SAMPLE_TILE tiles so that
+ * the source pixels read by quarter turns stay in the cache.  Opaque
+ * source pixels without partial masking are copied with store_opaque()
+ * when the blend allows it, while all other pixels are composited with
+ * render_pixel().  If there is a color transform, it is applied to the
+ * source pixel bytes before deciding whether the pixel is opaque.
+ * 
+ * The rendering bounds must already be clipped to the target buffer,
+ * to any procedural mask, and to the area covered by any raster mask.
+ * 
+ * Parameters:
+ * 
+ *   ps - the sampling parameters
+ * 
+ *   px - the color transform, or NULL if none
+ * 
+ *   pSrc - the source buffer
+ * 
+ *   pMask - the grayscale or ARGB raster mask buffer, or NULL if no
+ *   raster masking
+ * 
+ *   pRows - the mask computed by scanline, or NULL if none
+ * 
+ *   pMatrix - the transformation matrix
+ * 
+ *   pTarget - the target buffer
+ * 
+ *   min_x - the minimum X coordinate to render in the target
+ * 
+ *   min_y - the minimum Y coordinate to render in the target
+ * 
+ *   max_x - the maximum X coordinate to render in the target
+ * 
+ *   max_y - the maximum Y coordinate to render in the target
+ */
+static void sample_exact(
+    const SKVM_SAMPLE_PARAM * ps,
+    const SKXFORM           * px,
+    const SKBUF             * pSrc,
+    const SKBUF             * pMask,
+    const SKROWMASK         * pRows,
+    const SKMAT             * pMatrix,
+          SKBUF             * pTarget,
+          int32_t             min_x,
+          int32_t             min_y,
+          int32_t             max_x,
+          int32_t             max_y) {
+  
+  int32_t ia = 0;
+  int32_t ib = 0;
+  int32_t ic = 0;
+  int32_t id = 0;
+  int32_t ie = 0;
+  int32_t iff = 0;
+  
+  int32_t tx = 0;
+  int32_t ty = 0;
+  int32_t ex = 0;
+  int32_t ey = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t sx = 0;
+  int32_t sy = 0;
+  int32_t cx = 0;
+  int32_t cy = 0;
+  
+  int32_t src_stride = 0;
+  int32_t stride = 0;
+  int32_t band_w = 0;
+  int32_t mstep = 1;
+  int copy = 0;
+  fp_blend fb = NULL;
+  
+  const uint8_t * psp = NULL;
+  const uint8_t * pm = NULL;
+        uint8_t * pt = NULL;
+        uint8_t * pBand = NULL;
+  
+  int32_t pc[4];
+  int32_t first[SAMPLE_TILE];
+  int32_t last[SAMPLE_TILE];
+  SKARGB rcol;
+  
+  /* Initialize structures */
+  memset(&rcol, 0, sizeof(SKARGB));
+  memset(pc, 0, sizeof(int32_t) * 4);
+  memset(first, 0, sizeof(int32_t) * SAMPLE_TILE);
+  memset(last, 0, sizeof(int32_t) * SAMPLE_TILE);
+  
+  /* Check parameters */
+  if ((ps == NULL) || (pSrc == NULL) || (pMatrix == NULL) ||
+      (pTarget == NULL)) {
+    abort();
+  }
+  if ((min_x > max_x) || (min_y > max_y)) {
+    abort();
+  }
+  if ((pMask != NULL) && (pRows != NULL)) {
+    abort();
+  }
+  
+  /* Select the blend, and determine whether it lets opaque source
+   * pixels simply replace target pixels */
+  fb = blend_select(ps->blend);
+  if ((ps->blend == SKVM_BLEND_OVER) || (ps->blend == SKVM_BLEND_SRC)) {
+    copy = 1;
+  }
+  
+  /* Raster mask values are read in place, which for an ARGB mask means
+   * reading the alpha channel at the start of each pixel */
+  if (pMask != NULL) {
+    mstep = pMask->c;
+  }
+  
+  /* If there is a mask computed by scanline, get a band of mask
+   * scanlines the height of a tile spanning the rendering area from the
+   * scratch arena */
+  if (pRows != NULL) {
+    band_w = max_x - min_x + 1;
+    pBand = scratch_get(((size_t) band_w) * SAMPLE_TILE);
+  }
+  
+  /* Get the inverse matrix as integers */
+  ia = (int32_t) pMatrix->iva;
+  ib = (int32_t) pMatrix->ivb;
+  ic = (int32_t) pMatrix->ivc;
+  id = (int32_t) pMatrix->ivd;
+  ie = (int32_t) pMatrix->ive;
+  iff = (int32_t) pMatrix->ivf;
+  
+  /* Compute the scanline strides */
+  src_stride = pSrc->w * buf_pixel(pSrc);
+  stride = pTarget->w * buf_pixel(pTarget);
+  
+  /* Work through the rendering area tile by tile */
+  for(ty = min_y; ty <= max_y; ty += SAMPLE_TILE) {
+    ey = ty + (SAMPLE_TILE - 1);
+    if (ey > max_y) {
+      ey = max_y;
+    }
+    
+    /* Compute the mask for the scanlines of this row of tiles */
+    if (pRows != NULL) {
+      for(y = ty; y <= ey; y++) {
+        rowmask_fill(pRows, y, min_x, max_x,
+                  pBand + (((size_t) (y - ty)) * band_w),
+                  &(first[y - ty]), &(last[y - ty]));
+      }
+    }
+    
+    for(tx = min_x; tx <= max_x; tx += SAMPLE_TILE) {
+      ex = tx + (SAMPLE_TILE - 1);
+      if (ex > max_x) {
+        ex = max_x;
+      }
+      
+      for(y = ty; y <= ey; y++) {
+        /* Get pointers to the first target pixel and mask value of this
+         * tile scanline */
+        pt = pTarget->pData + (((size_t) y) * stride)
+                + (tx * buf_pixel(pTarget));
+        if (pMask != NULL) {
+          pm = pMask->pData + (((y - ps->mask_y) * pMask->w) +
+                                (tx - ps->mask_x)) * mstep;
+        }
+        
+        /* Skip this tile scanline if the mask leaves nothing to draw in
+         * it, else point to its mask values */
+        if (pRows != NULL) {
+          if ((first[y - ty] > ex) || (last[y - ty] < tx)) {
+            continue;
+          }
+          pm = pBand + (((size_t) (y - ty)) * band_w) + (tx - min_x);
+        }
+        
+        /* Project the first pixel into source space */
+        sx = (ia * tx) + (ib * y) + ic;
+        sy = (id * tx) + (ie * y) + iff;
+        
+        for(x = tx; x <= ex; x++) {
+          
+          /* Only proceed if not fully masked and the projected point
+           * is within the source area */
+          if (((pm == NULL) || (*pm != 0)) &&
+              (sx >= ps->src_x) && (sx <= ps->src_x + ps->src_w) &&
+              (sy >= ps->src_y) && (sy <= ps->src_y + ps->src_h)) {
+            
+            /* Clamp to the source buffer, like sample_nearest() */
+            cx = sx;
+            if (cx < 0) {
+              cx = 0;
+            } else if (cx > pSrc->w - 1) {
+              cx = pSrc->w - 1;
+            }
+            
+            cy = sy;
+            if (cy < 0) {
+              cy = 0;
+            } else if (cy > pSrc->h - 1) {
+              cy = pSrc->h - 1;
+            }
+            
+            psp = pSrc->pData + (((size_t) cy) * src_stride)
+                    + (cx * buf_pixel(pSrc));
+            
+            /* Copy opaque pixels directly, composite everything else;
+             * float sources are already premultiplied colors, so they
+             * are always composited */
+            if (pSrc->fp) {
+              load_pixel(pSrc, cx, cy, &rcol);
+              if (px != NULL) {
+                xform_color(px, &rcol);
+              }
+              render_pixel(pTarget, pt, pm, fb, &rcol);
+              
+            } else if (px != NULL) {
+              /* Get the source pixel as ARGB and transform it */
+              if (pSrc->c == 4) {
+                pc[0] = psp[0];
+                pc[1] = psp[1];
+                pc[2] = psp[2];
+                pc[3] = psp[3];
+              } else if (pSrc->c == 3) {
+                pc[0] = 255;
+                pc[1] = psp[0];
+                pc[2] = psp[1];
+                pc[3] = psp[2];
+              } else {
+                pc[0] = 255;
+                pc[1] = psp[0];
+                pc[2] = psp[0];
+                pc[3] = psp[0];
+              }
+              xform_bytes(px, pc);
+              
+              if (copy && (pc[0] == 255) &&
+                  ((pm == NULL) || (*pm == 255))) {
+                store_opaque(pTarget, pt, pc[1], pc[2], pc[3]);
+              } else {
+                bytes_color(pc, &rcol);
+                render_pixel(pTarget, pt, pm, fb, &rcol);
+              }
+              
+            } else if ((!copy) || ((pm != NULL) && (*pm != 255))) {
+              load_pixel(pSrc, cx, cy, &rcol);
+              render_pixel(pTarget, pt, pm, fb, &rcol);
+              
+            } else if (pSrc->c == 1) {
+              store_opaque(pTarget, pt, psp[0], psp[0], psp[0]);
+              
+            } else if (pSrc->c == 3) {
+              store_opaque(pTarget, pt, psp[0], psp[1], psp[2]);
+              
+            } else if (psp[0] == 255) {
+              store_opaque(pTarget, pt, psp[1], psp[2], psp[3]);
+              
+            } else {
+              load_pixel(pSrc, cx, cy, &rcol);
+              render_pixel(pTarget, pt, pm, fb, &rcol);
+            }
+          }
+          
+          /* Move to the next pixel */
+          pt += buf_pixel(pTarget);
+          if (pm != NULL) {
+            pm += mstep;
+          }
+          sx += ia;
+          sy += id;
+        }
+      }
+    }
+  }
+}
+
+/*
+ * General sampling kernel.
+ * 
+ * This renders with any sampling algorithm and any matrix, projecting
+ * each target pixel into source space.  It has the same parameters as
+ * sample_exact(), and the rendering bounds must be clipped in the same
+ * way.
+ * 
+ * Parameters:
+ * 
+ *   ps - the sampling parameters
+ * 
+ *   px - the color transform, or NULL if none
+ * 
+ *   pSrc - the source buffer
+ * 
+ *   pMask - the grayscale or ARGB raster mask buffer, or NULL if no
+ *   raster masking
+ * 
+ *   pRows - the mask computed by scanline, or NULL if none
+ * 
+ *   pMatrix - the transformation matrix
+ * 
+ *   pTarget - the target buffer
+ * 
+ *   min_x - the minimum X coordinate to render in the target
+ * 
+ *   min_y - the minimum Y coordinate to render in the target
+ * 
+ *   max_x - the maximum X coordinate to render in the target
+ * 
+ *   max_y - the maximum Y coordinate to render in the target
+ */
+static void sample_general(
+    const SKVM_SAMPLE_PARAM * ps,
+    const SKXFORM           * px,
+    const SKBUF             * pSrc,
+    const SKBUF             * pMask,
+    const SKROWMASK         * pRows,
+    const SKMAT             * pMatrix,
+          SKBUF             * pTarget,
+          int32_t             min_x,
+          int32_t             min_y,
+          int32_t             max_x,
+          int32_t             max_y) {
+  
+  int     separable = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t x0 = 0;
+  int32_t x1 = 0;
+  int32_t stride = 0;
+  int32_t mstep = 1;
+  double  scan_y = 0.0;
+  fp_blend fb = NULL;
+  
+        uint8_t * pt = NULL;
+  const uint8_t * pm = NULL;
+        uint8_t * pscan = NULL;
+  const uint8_t * pscan_m = NULL;
+        uint8_t * pRowMask = NULL;
+  
+  SKPOINT pnt;
+  SKARGB  rcol;
+  
+  /* Initialize structures */
+  memset(&pnt, 0, sizeof(SKPOINT));
+  memset(&rcol, 0, sizeof(SKARGB));
+  
+  /* Check parameters */
+  if ((ps == NULL) || (pSrc == NULL) || (pMatrix == NULL) ||
+      (pTarget == NULL)) {
+    abort();
+  }
+  if ((min_x > max_x) || (min_y > max_y)) {
+    abort();
+  }
+  if ((pMask != NULL) && (pRows != NULL)) {
+    abort();
+  }
+  
+  /* Select the blend */
+  fb = blend_select(ps->blend);
+  
+  /* Compute the stride between scanlines within the target pixel data,
+   * and also establish pt as a pointer to the start of the first pixel
+   * to render in the target buffer */
+  stride = pTarget->w * buf_pixel(pTarget);
+  pt = pTarget->pData;
+  pt += (((size_t) stride) * min_y);
+  pt += (min_x * buf_pixel(pTarget));
+  
+  /* Establish pm as a pointer to the first pixel mask value in the
+   * raster mask, if raster masking is enabled; for an ARGB mask, this
+   * is the alpha channel of the pixel */
+  if (pMask != NULL) {
+    mstep = pMask->c;
+    pm = pMask->pData;
+    pm += (pMask->w * (min_y - ps->mask_y) * mstep);
+    pm += ((min_x - ps->mask_x) * mstep);
+  }
+  
+  /* If there is a mask computed by scanline, get a scanline of mask
+   * values from the scratch arena */
+  if (pRows != NULL) {
+    pRowMask = scratch_get((size_t) (max_x - min_x + 1));
+  }
+  
+  /* If the matrix does not rotate or shear, the projection into source
+   * space is separable, so the source Y coordinate only needs to be
+   * computed once per scanline */
+  if ((pMatrix->mclass == MCLASS_IDENTITY) ||
+      (pMatrix->mclass == MCLASS_ITRANSLATE) ||
+      (pMatrix->mclass == MCLASS_FTRANSLATE) ||
+      (pMatrix->mclass == MCLASS_SCALE)) {
+    separable = 1;
+  }
+  
+  /* We will now iterate over every pixel in the rendering boundaries of
+   * the target in order to perform the rendering operation */
+  for(y = min_y; y <= max_y; y++) {
+    /* Save the pointer to the start of this rendering scanline */
+    pscan = pt;
+    if (pMask != NULL) {
+      pscan_m = pm;
+    }
+    
+    /* If the projection is separable, project the scanline into source
+     * space */
+    if (separable) {
+      scan_y = (pMatrix->ive * ((double) y)) + pMatrix->ivf;
+    }
+    
+    /* If there is a mask computed by scanline, compute its mask values
+     * for this scanline and narrow the scanline to the pixels it may
+     * draw */
+    x0 = min_x;
+    x1 = max_x;
+    if (pRows != NULL) {
+      rowmask_fill(pRows, y, min_x, max_x, pRowMask, &x0, &x1);
+      pt = pscan + ((x0 - min_x) * buf_pixel(pTarget));
+      pm = pRowMask + (x0 - min_x);
+    }
+    
+    for(x = x0; x <= x1; x++) {
+      /* If raster masking or a shape mask is on, proceed to next pixel
+       * without rendering if this mask value is zero */
+      if (pm != NULL) {
+        if (*pm == 0) {
+          /* Move to the next pixel to render */
+          pt = pt + buf_pixel(pTarget);
+          pm += mstep;
+         
+          /* Continue loop */
+          continue;
+        }
+      }
+      
+      /* Project the current target location into source space; in
+       * the separable case, the terms that would be multiplied by the
+       * zero entries of the inverse matrix are simply left out */
+      if (separable) {
+        pnt.x = (pMatrix->iva * ((double) x)) + pMatrix->ivc;
+        pnt.y = scan_y;
+        
+      } else {
+        pnt.x = (double) x;
+        pnt.y = (double) y;
+        
+        target2source(pMatrix, &pnt);
+      }
+      
+      if ((!isfinite(pnt.x)) || (!isfinite(pnt.y))) {
+        fprintf(stderr, "Numeric problem during sparkle sampling!\n");
+        abort();
+      }
+      
+      /* Only proceed if projected point is within the source area */
+      if ((pnt.x >= (double) ps->src_x) &&
+          (pnt.x <= (double) (ps->src_x + ps->src_w)) &&
+          (pnt.y >= (double) ps->src_y) &&
+          (pnt.y <= (double) (ps->src_y + ps->src_h))) {
+      
+        /* Sample the point within the source */
+        if (ps->sample_alg == SKVM_ALG_NEAREST) {
+          sample_nearest(pSrc, &pnt, &rcol);
+          
+        } else if (ps->sample_alg == SKVM_ALG_BILINEAR) {
+          sample_bilinear(pSrc, &pnt, &rcol);
+          
+        } else if (ps->sample_alg == SKVM_ALG_BICUBIC) {
+          sample_bicubic(pSrc, &pnt, &rcol);
+          
+        } else {
+          /* Shouldn't happen */
+          abort();
+        }
+        
+        /* Apply any color transform */
+        if (px != NULL) {
+          xform_color(px, &rcol);
+        }
+      
+        /* Composite the sampled color onto the target pixel */
+        render_pixel(pTarget, pt, pm, fb, &rcol);
+      }
+      
+      /* Move to the next pixel to render */
+      pt = pt + buf_pixel(pTarget);
+      if (pm != NULL) {
+        pm += mstep;
+      }
+    }
+    
+    /* If this is not the last rendering iteration, move to the next
+     * rendering scanline using the pointer we saved at the start of
+     * this loop iteration */
+    if (y < max_y) {
+      pt = pscan + stride;
+      if (pMask != NULL) {
+        pm = pscan_m + (pMask->w * mstep);
+      }
+    }
+  }
+}
+
+/*
+ * Reference sampling kernel.
+ * 
+ * This renders the same result as the other kernels straight from the
+ * definition of sampling, for checking the fast paths against.  Every
+ * pixel of the target is visited on the calling thread.  Its
+ * procedural mask, shape mask, and compressed mask values are computed
+ * for that pixel alone, and it is projected into source space with the
+ * full inverse matrix.  Nothing is clipped to a bounding box, the
+ * projection is never split, and shape interiors are not filled
+ * without evaluating them.
+ * 
+ * Parameters:
+ * 
+ *   ps - the sampling parameters
+ * 
+ *   px - the color transform, or NULL if none
+ * 
+ *   pSrc - the source buffer
+ * 
+ *   pMask - the raster mask buffer, which may hold pixel data or a
+ *   compressed mask, or NULL if no raster masking
+ * 
+ *   pShape - the shape mask, or NULL if none
+ * 
+ *   pMatrix - the transformation matrix
+ * 
+ *   pTarget - the target buffer
+ */
+static void sample_reference(
+    const SKVM_SAMPLE_PARAM * ps,
+    const SKXFORM           * px,
+    const SKBUF             * pSrc,
+    const SKBUF             * pMask,
+    const SKSHAPE           * pShape,
+    const SKMAT             * pMatrix,
+          SKBUF             * pTarget) {
+  
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t bound_x = 0;
+  int32_t bound_y = 0;
+  int32_t mx = 0;
+  int32_t my = 0;
+  int32_t first = 0;
+  int32_t last = 0;
+  int32_t visits = 0;
+  double lo = 0.0;
+  double hi = 0.0;
+  double f = 0.0;
+  double t0 = 0.0;
+  fp_blend fb = NULL;
+  uint8_t mv = 0;
+  uint8_t *pt = NULL;
+  SKVM_BALANCE *pb = NULL;
+  
+  SKPOINT pnt;
+  SKARGB  rcol;
+  
+  /* Initialize structures */
+  memset(&pnt, 0, sizeof(SKPOINT));
+  memset(&rcol, 0, sizeof(SKARGB));
+  
+  /* Check parameters */
+  if ((ps == NULL) || (pSrc == NULL) || (pMatrix == NULL) ||
+      (pTarget == NULL)) {
+    abort();
+  }
+  if ((pMask != NULL) && (pShape != NULL)) {
+    abort();
+  }
+  
+  /* Select the blend and start timing */
+  fb = blend_select(ps->blend);
+  t0 = clock_secs();
+  
+  /* Get integer versions of any procedural bounds */
+  if (ps->flags & SKVM_FLAG_PROCMASK) {
+    if (ps->x_boundary == 0.0) {
+      bound_x = 0;
+    } else if (ps->x_boundary == 1.0) {
+      bound_x = pTarget->w - 1;
+    } else {
+      bound_x = (int32_t) floor(ps->x_boundary *
+                                  ((double) (pTarget->w - 1)));
+    }
+    
+    if (ps->y_boundary == 0.0) {
+      bound_y = 0;
+    } else if (ps->y_boundary == 1.0) {
+      bound_y = pTarget->h - 1;
+    } else {
+      bound_y = (int32_t) floor(ps->y_boundary *
+                                  ((double) (pTarget->h - 1)));
+    }
+  }
+  
+  for(y = 0; y < pTarget->h; y++) {
+    for(x = 0; x < pTarget->w; x++) {
+      /* Skip pixels on the masked side of the procedural bounds */
+      if (ps->flags & SKVM_FLAG_PROCMASK) {
+        if ((ps->flags & SKVM_FLAG_LEFTMODE) && (x < bound_x)) {
+          continue;
+        }
+        if ((ps->flags & SKVM_FLAG_RIGHTMODE) && (x > bound_x)) {
+          continue;
+        }
+        if ((ps->flags & SKVM_FLAG_ABOVEMODE) && (y < bound_y)) {
+          continue;
+        }
+        if ((ps->flags & SKVM_FLAG_BELOWMODE) && (y > bound_y)) {
+          continue;
+        }
+      }
+      
+      /* Get the mask value of this pixel, where everything outside a
+       * raster mask is masked out */
+      mv = 255;
+      if (pMask != NULL) {
+        mx = x - ps->mask_x;
+        my = y - ps->mask_y;
+        if ((mx < 0) || (my < 0) || (mx >= pMask->w) ||
+            (my >= pMask->h)) {
+          continue;
+        }
+        
+        if (pMask->pData != NULL) {
+          mv = (pMask->pData)[((((size_t) my) * pMask->w) + mx) *
+                                pMask->c];
+        } else {
+          rle_row(pMask->pRle, my, mx, mx, &mv, &first, &last);
+        }
+        
+      } else if (pShape != NULL) {
+        mv = 0;
+        if (shape_chord(pShape, ((double) y) + 0.5, &lo, &hi)) {
+          if ((((double) x) + 0.5 > lo) && (((double) x) + 0.5 < hi)) {
+            f = shape_cover(pShape, ((double) x) + 0.5,
+                              ((double) y) + 0.5);
+            mv = (uint8_t) floor((f * 255.0) + 0.5);
+          }
+        }
+        if (pShape->invert) {
+          mv = (uint8_t) (255 - mv);
+        }
+      }
+      if (mv == 0) {
+        continue;
+      }
+      visits++;
+      
+      /* Project the pixel into source space */
+      pnt.x = (double) x;
+      pnt.y = (double) y;
+      target2source(pMatrix, &pnt);
+      
+      if ((!isfinite(pnt.x)) || (!isfinite(pnt.y))) {
+        fprintf(stderr, "Numeric problem during sparkle sampling!\n");
+        abort();
+      }
+      
+      /* Skip pixels that project outside the source area */
+      if ((pnt.x < (double) ps->src_x) ||
+          (pnt.x > (double) (ps->src_x + ps->src_w)) ||
+          (pnt.y < (double) ps->src_y) ||
+          (pnt.y > (double) (ps->src_y + ps->src_h))) {
+        continue;
+      }
+      
+      /* Sample the point within the source */
+      if (ps->sample_alg == SKVM_ALG_NEAREST) {
+        sample_nearest(pSrc, &pnt, &rcol);
+      } else if (ps->sample_alg == SKVM_ALG_BILINEAR) {
+        sample_bilinear(pSrc, &pnt, &rcol);
+      } else if (ps->sample_alg == SKVM_ALG_BICUBIC) {
+        sample_bicubic(pSrc, &pnt, &rcol);
+      } else {
+        /* Shouldn't happen */
+        abort();
+      }
+      
+      /* Apply any color transform */
+      if (px != NULL) {
+        xform_color(px, &rcol);
+      }
+      
+      /* Composite the sampled color onto the target pixel */
+      pt = pTarget->pData;
+      pt += ((((size_t) y) * pTarget->w) + x) * buf_pixel(pTarget);
+      render_pixel(pTarget, pt,
+                    ((pMask != NULL) || (pShape != NULL)) ? &mv : NULL,
+                    fb, &rcol);
+    }
+  }
+  
+  /* Record the whole target as a single tile on this thread */
+  pb = &(thread_state()->bal);
+  pb->workers = 1;
+  pb->tiles = 1;
+  pb->count[0] = 1;
+  pb->cost[0] = (double) visits;
+  pb->busy[0] = clock_secs() - t0;
+}
+
+/*
+ * Get the current time of the monotonic clock in seconds.
+ * 
+ * Return:
+ * 
+ *   the current monotonic time
+ */
+static double clock_secs(void) {
+  
+  struct timespec ts;
+  
+  /* Initialize structures */
+  memset(&ts, 0, sizeof(struct timespec));
+  
+  /* Read the clock */
+  if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+    abort();
+  }
+  
+  /* Return the time in seconds */
+  return ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0);
+}
+
+/*
+ * Get the target area covered by a tile of a tiled sampling job.
+ * 
+ * Tiles along the right and bottom edges of the rendering area may be
+ * smaller than PAR_TILE.
+ * 
+ * Parameters:
+ * 
+ *   pj - the tile job
+ * 
+ *   t - the tile number
+ * 
+ *   px0 - receives the minimum X coordinate of the tile
+ * 
+ *   py0 - receives the minimum Y coordinate of the tile
+ * 
+ *   px1 - receives the maximum X coordinate of the tile
+ * 
+ *   py1 - receives the maximum Y coordinate of the tile
+ */
+static void tile_bounds(
+    const SKTILEJOB * pj,
+          int32_t     t,
+          int32_t   * px0,
+          int32_t   * py0,
+          int32_t   * px1,
+          int32_t   * py1) {
+  
+  /* Check parameters */
+  if ((pj == NULL) || (t < 0) ||
+      (px0 == NULL) || (py0 == NULL) ||
+      (px1 == NULL) || (py1 == NULL)) {
+    abort();
+  }
+  
+  /* Compute the tile area, clipped to the rendering area */
+  *px0 = pj->min_x + ((t % pj->cols) * PAR_TILE);
+  *py0 = pj->min_y + ((t / pj->cols) * PAR_TILE);
+  
+  *px1 = *px0 + (PAR_TILE - 1);
+  if (*px1 > pj->max_x) {
+    *px1 = pj->max_x;
+  }
+  
+  *py1 = *py0 + (PAR_TILE - 1);
+  if (*py1 > pj->max_y) {
+    *py1 = pj->max_y;
+  }
+}
+
+/*
+ * Estimate the cost of rendering a tile of a tiled sampling job.
+ * 
+ * A grid of TILE_PROBE by TILE_PROBE points spread evenly over the
+ * tile is probed.  A point counts as drawn if the mask does not hide
+ * it and it projects into the source area.  For a mask computed by
+ * scanline, the mask runs of each probed scanline are decoded across
+ * the tile.  Pixels that are visited but not drawn are counted at an
+ * eighth of the cost of a drawn pixel.
+ * 
+ * Parameters:
+ * 
+ *   pj - the tile job
+ * 
+ *   t - the tile number
+ * 
+ *   pRow - a buffer of at least PAR_TILE bytes to decode mask runs into
+ * 
+ * Return:
+ * 
+ *   the estimated cost, in pixels, which is always greater than zero
+ */
+static double tile_cost(const SKTILEJOB *pj, int32_t t, uint8_t *pRow) {
+  
+  int32_t x0 = 0;
+  int32_t y0 = 0;
+  int32_t x1 = 0;
+  int32_t y1 = 0;
+  int32_t i = 0;
+  int32_t j = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t first = 0;
+  int32_t last = 0;
+  int32_t hits = 0;
+  double area = 0.0;
+  
+  const SKVM_SAMPLE_PARAM * ps = NULL;
+  const SKBUF * pMask = NULL;
+  SKPOINT pnt;
+  
+  /* Initialize structures */
+  memset(&pnt, 0, sizeof(SKPOINT));
+  
+  /* Check parameters */
+  if ((pj == NULL) || (pRow == NULL)) {
+    abort();
+  }
+  ps = pj->ps;
+  pMask = pj->pMask;
+  
+  /* Get the tile area */
+  tile_bounds(pj, t, &x0, &y0, &x1, &y1);
+  area = ((double) (x1 - x0 + 1)) * ((double) (y1 - y0 + 1));
+  
+  /* Probe the grid of points */
+  for(j = 0; j < TILE_PROBE; j++) {
+    y = y0 + ((((2 * j) + 1) * (y1 - y0 + 1)) / (2 * TILE_PROBE));
+    
+    /* Decode the mask runs of this scanline across the tile */
+    if (pj->pRows != NULL) {
+      rowmask_fill(pj->pRows, y, x0, x1, pRow, &first, &last);
+    }
+    
+    for(i = 0; i < TILE_PROBE; i++) {
+      x = x0 + ((((2 * i) + 1) * (x1 - x0 + 1)) / (2 * TILE_PROBE));
+      
+      /* Skip points that the mask hides */
+      if (pj->pRows != NULL) {
+        if ((x < first) || (x > last) || (pRow[x - x0] == 0)) {
+          continue;
+        }
+        
+      } else if (pMask != NULL) {
+        if (pMask->pData[((((size_t) (y - ps->mask_y)) * pMask->w) +
+                            (x - ps->mask_x)) * pMask->c] == 0) {
+          continue;
+        }
+      }
+      
+      /* Count the point if it projects into the source area */
+      pnt.x = (double) x;
+      pnt.y = (double) y;
+      target2source(pj->pMatrix, &pnt);
+      
+      if ((pnt.x >= (double) ps->src_x) &&
+          (pnt.x <= (double) (ps->src_x + ps->src_w)) &&
+          (pnt.y >= (double) ps->src_y) &&
+          (pnt.y <= (double) (ps->src_y + ps->src_h))) {
+        hits++;
+      }
+    }
+  }
+  
+  /* Scale the fraction of drawn points to the tile */
+  return area * (0.125 +
+          (((double) hits) / ((double) (TILE_PROBE * TILE_PROBE))));
+}
+
+/*
+ * Task function that renders tiles of a tiled sampling job.
+ * 
+ * Each time the function runs, it claims the next worker slot of the
+ * job.  It renders the tiles of that worker from the head of its run.
+ * When the run is used up, it steals tiles from the tail of the run of
+ * the worker with the most estimated cost left, until no tiles are
+ * left anywhere.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKTILEJOB
+ */
+static void tile_task(void *pArg) {
+  
+  SKTILEJOB *pj = NULL;
+  SKTILEQ *pq = NULL;
+  int32_t w = 0;
+  int32_t v = 0;
+  int32_t k = 0;
+  int32_t t = 0;
+  int32_t x0 = 0;
+  int32_t y0 = 0;
+  int32_t x1 = 0;
+  int32_t y1 = 0;
+  double c = 0.0;
+  double secs = 0.0;
+  
+  /* Check parameter */
+  if (pArg == NULL) {
+    abort();
+  }
+  pj = (SKTILEJOB *) pArg;
+  
+  /* Claim a worker slot */
+  if (pthread_mutex_lock(&m_work_lock)) {
+    abort();
+  }
+  w = pj->next;
+  if (w < pj->n) {
+    (pj->next)++;
+  }
+  if (pthread_mutex_unlock(&m_work_lock)) {
+    abort();
+  }
+  
+  if (w >= pj->n) {
+    abort();
+  }
+  pq = &((pj->q)[w]);
+  
+  for( ; ; ) {
+    /* Take the next tile of this worker, or else steal one */
+    if (pthread_mutex_lock(&m_work_lock)) {
+      abort();
+    }
+    
+    t = -1;
+    if (pq->head < pq->tail) {
+      t = pq->head;
+      (pq->head)++;
+      pq->rem -= (pj->pCost)[t];
+      
+    } else {
+      v = -1;
+      for(k = 0; k < pj->n; k++) {
+        if ((pj->q)[k].head < (pj->q)[k].tail) {
+          if ((v < 0) || ((pj->q)[k].rem > (pj->q)[v].rem)) {
+            v = k;
+          }
+        }
+      }
+      
+      if (v >= 0) {
+        ((pj->q)[v].tail)--;
+        t = (pj->q)[v].tail;
+        (pj->q)[v].rem -= (pj->pCost)[t];
+        (pj->steals)++;
+      }
+    }
+    
+    if (pthread_mutex_unlock(&m_work_lock)) {
+      abort();
+    }
+    
+    /* Stop if no tiles are left */
+    if (t < 0) {
+      break;
+    }
+    
+    /* Render the tile */
+    tile_bounds(pj, t, &x0, &y0, &x1, &y1);
+    c = clock_secs();
+    if (pj->exact) {
+      sample_exact(pj->ps, pj->px, pj->pSrc, pj->pMask, pj->pRows,
+                    pj->pMatrix, pj->pTarget, x0, y0, x1, y1);
+    } else {
+      sample_general(pj->ps, pj->px, pj->pSrc, pj->pMask, pj->pRows,
+                    pj->pMatrix, pj->pTarget, x0, y0, x1, y1);
+    }
+    secs = clock_secs() - c;
+    
+    /* Only this worker updates its own totals */
+    (pq->count)++;
+    pq->cost += (pj->pCost)[t];
+    pq->busy += secs;
+  }
+}
+
+/*
+ * Render the area of a sampling operation, splitting it into tiles
+ * that are rendered on the worker pool when it is large enough to be
+ * worth it.
+ * 
+ * The number of threads is chosen the same way as for par_rows(),
+ * based on the number of target bytes in the rendering area.  The
+ * rendering area is split into PAR_TILE tiles, the cost of each tile is
+ * estimated with tile_cost(), and the tiles are divided among the
+ * threads in runs of about equal total cost, so that each thread
+ * renders an area of adjoining tiles.  Threads that finish their run
+ * early steal tiles from the others (see tile_task).  Since every
+ * target pixel is rendered independently, the result does not depend
+ * on how the tiles end up being divided.
+ * 
+ * The balance of the work is recorded in the state of the calling
+ * thread for skvm_balance().
+ * 
+ * The parameters are the same as for sample_exact(), except for exact.
+ * 
+ * Parameters:
+ * 
+ *   exact - non-zero to render with sample_exact(), zero to render
+ *   with sample_general()
+ */
+static void sample_tiles(
+    const SKVM_SAMPLE_PARAM * ps,
+    const SKXFORM           * px,
+    const SKBUF             * pSrc,
+    const SKBUF             * pMask,
+    const SKROWMASK         * pRows,
+    const SKMAT             * pMatrix,
+          SKBUF             * pTarget,
+          int                 exact,
+          int32_t             min_x,
+          int32_t             min_y,
+          int32_t             max_x,
+          int32_t             max_y) {
+  
+  int32_t n = 0;
+  int32_t i = 0;
+  int32_t k = 0;
+  int32_t t = 0;
+  int32_t limit = 0;
+  int32_t count = 0;
+  size_t total = 0;
+  double sum = 0.0;
+  double acc = 0.0;
+  double c = 0.0;
+  double *pCost = NULL;
+  
+  SKVM_BALANCE *pb = NULL;
+  SKTILEJOB job;
+  SKTASK task[SKVM_MAX_THREADS];
+  uint8_t row[PAR_TILE];
+  
+  /* Initialize structures */
+  memset(&job, 0, sizeof(SKTILEJOB));
+  memset(row, 0, PAR_TILE);
+  
+  /* Check parameters */
+  if ((ps == NULL) || (pSrc == NULL) || (pMatrix == NULL) ||
+      (pTarget == NULL)) {
+    abort();
+  }
+  if ((min_x > max_x) || (min_y > max_y)) {
+    abort();
+  }
+  
+  /* Get the balance record of this thread */
+  pb = &(thread_state()->bal);
+  memset(pb, 0, sizeof(SKVM_BALANCE));
+  
+  /* Fill in the job */
+  job.ps = ps;
+  job.px = px;
+  job.pSrc = pSrc;
+  job.pMask = pMask;
+  job.pRows = pRows;
+  job.pMatrix = pMatrix;
+  job.pTarget = pTarget;
+  job.exact = exact;
+  
+  job.min_x = min_x;
+  job.min_y = min_y;
+  job.max_x = max_x;
+  job.max_y = max_y;
+  job.cols = ((max_x - min_x) / PAR_TILE) + 1;
+  count = job.cols * (((max_y - min_y) / PAR_TILE) + 1);
+  
+  /* Determine how many threads to use */
+  limit = thread_limit();
+  total = ((size_t) (max_x - min_x + 1)) *
+            ((size_t) (max_y - min_y + 1)) * buf_pixel(pTarget);
+  if (total / PAR_GRAIN >= (size_t) limit) {
+    n = limit;
+  } else {
+    n = (int32_t) (total / PAR_GRAIN);
+  }
+  if (n > count) {
+    n = count;
+  }
+  
+  /* If there is not enough to split, render everything here */
+  if (n < 2) {
+    c = clock_secs();
+    if (exact) {
+      sample_exact(ps, px, pSrc, pMask, pRows, pMatrix, pTarget,
+                    min_x, min_y, max_x, max_y);
+    } else {
+      sample_general(ps, px, pSrc, pMask, pRows, pMatrix, pTarget,
+                    min_x, min_y, max_x, max_y);
+    }
+    
+    pb->workers = 1;
+    pb->tiles = 1;
+    (pb->count)[0] = 1;
+    (pb->cost)[0] = ((double) (max_x - min_x + 1)) *
+                      ((double) (max_y - min_y + 1));
+    (pb->busy)[0] = clock_secs() - c;
+    return;
+  }
+  
+  /* Estimate the cost of each tile */
+  pCost = (double *) malloc(((size_t) count) * sizeof(double));
+  if (pCost == NULL) {
+    abort();
+  }
+  for(t = 0; t < count; t++) {
+    pCost[t] = tile_cost(&job, t, row);
+    sum += pCost[t];
+  }
+  job.pCost = pCost;
+  
+  /* Divide the tiles into runs of about equal cost, ending each run
+   * once the cost of the runs so far reaches its share of the total */
+  job.n = n;
+  k = 0;
+  acc = 0.0;
+  for(t = 0; t < count; t++) {
+    while ((k < n - 1) && (acc >= (sum * (k + 1)) / n)) {
+      (job.q)[k].tail = t;
+      k++;
+      (job.q)[k].head = t;
+    }
+    (job.q)[k].rem += pCost[t];
+    acc += pCost[t];
+  }
+  (job.q)[k].tail = count;
+  for(k++; k < n; k++) {
+    (job.q)[k].head = count;
+    (job.q)[k].tail = count;
+  }
+  
+  /* Start a task for each worker except the one this thread is, then
+   * render tiles here too and wait for the tasks */
+  work_grow(limit);
+  
+  for(i = 1; i < n; i++) {
+    task_start(&(task[i]), &tile_task, &job);
+  }
+  tile_task(&job);
+  for(i = 1; i < n; i++) {
+    task_finish(&(task[i]));
+  }
+  
+  /* Record the balance */
+  pb->workers = n;
+  pb->tiles = count;
+  pb->steals = job.steals;
+  for(k = 0; k < n; k++) {
+    (pb->count)[k] = (job.q)[k].count;
+    (pb->cost)[k] = (job.q)[k].cost;
+    (pb->busy)[k] = (job.q)[k].busy;
+  }
+  
+  /* Release the tile costs */
+  free(pCost);
+}
+
+/*
+ * Set a matrix to the identity matrix.
+ * 
+ * The inverse, classification, and scale factors are set accordingly.
+ * 
+ * Parameters:
+ * 
+ *   pm - the matrix to set
+ */
+static void matrix_identity(SKMAT *pm) {
+  
+  /* Check parameters */
+  if (pm == NULL) {
+    abort();
+  }
+  
+  /* Set the identity, which is its own inverse */
+  memset(pm, 0, sizeof(SKMAT));
+  
+  pm->a = 1.0;    pm->b = 0.0;    pm->c = 0.0;
+  pm->d = 0.0;    pm->e = 1.0;    pm->f = 0.0;
+  
+  pm->iva = 1.0;  pm->ivb = 0.0;  pm->ivc = 0.0;
+  pm->ivd = 0.0;  pm->ive = 1.0;  pm->ivf = 0.0;
+  
+  pm->sx = 1.0;
+  pm->sy = 1.0;
+  
+  pm->mclass = (uint8_t) MCLASS_IDENTITY;
+}
+
+/*
+ * Recompute the inverse, classification, and scale factors of a matrix
+ * from its matrix values.
+ * 
+ * This does not check that the results are finite.
+ * 
+ * Parameters:
+ * 
+ *   pm - the matrix to update
+ */
+static void matrix_update(SKMAT *pm) {
+  
+  double denom = 0.0;
+  
+  /* Check parameters */
+  if (pm == NULL) {
+    abort();
+  }
+  
+  /* Compute the inverse */
+  denom = (pm->a * pm->e) - (pm->b * pm->d);
+  
+  pm->iva = pm->e / denom;
+  pm->ivb = -(pm->b / denom);
+  pm->ivc = ((pm->b * pm->f) - (pm->c * pm->e)) / denom;
+  
+  pm->ivd = -(pm->d / denom);
+  pm->ive = pm->a / denom;
+  pm->ivf = ((pm->c * pm->d) - (pm->a * pm->f)) / denom;
+  
+  /* Compute the scale factors */
+  pm->sx = hypot(pm->a, pm->d);
+  pm->sy = hypot(pm->b, pm->e);
+  
+  /* Classify the matrix */
+  if ((pm->b == 0.0) && (pm->d == 0.0)) {
+    if ((pm->a == 1.0) && (pm->e == 1.0)) {
+      if ((pm->c == 0.0) && (pm->f == 0.0)) {
+        pm->mclass = (uint8_t) MCLASS_IDENTITY;
+        
+      } else if ((floor(pm->c) == pm->c) && (floor(pm->f) == pm->f)) {
+        pm->mclass = (uint8_t) MCLASS_ITRANSLATE;
+        
+      } else {
+        pm->mclass = (uint8_t) MCLASS_FTRANSLATE;
+      }
+      
+    } else if ((fabs(pm->a) == 1.0) && (fabs(pm->e) == 1.0)) {
+      pm->mclass = (uint8_t) MCLASS_QUARTER;
+      
+    } else {
+      pm->mclass = (uint8_t) MCLASS_SCALE;
+    }
+    
+  } else if ((pm->a == 0.0) && (pm->e == 0.0) &&
+              (fabs(pm->b) == 1.0) && (fabs(pm->d) == 1.0)) {
+    pm->mclass = (uint8_t) MCLASS_QUARTER;
+    
+  } else {
+    pm->mclass = (uint8_t) MCLASS_AFFINE;
+  }
+}
+
+/*
+ * Multiply two matrices together and store their result in a third
+ * matrix.
+ * 
+ * The operation performed is:
+ * 
+ *   (*pm) = (*pa) * (*pb)
+ * 
+ * pm may not point to the same matrix structure as pa or pb, but pa and
+ * pb may point to the same structure.
+ * 
+ * This does not check that the results are finite.  The inverse,
+ * classification, and scale factors of the result are updated.
+ * 
+ * Parameters:
+ * 
+ *   pm - the matrix to store the result in
+ * 
+ *   pa - the first matrix operand
+ * 
+ *   pb - the second matrix operand
+ */
+static void matrix_mul(SKMAT *pm, const SKMAT *pa, const SKMAT *pb) {
+  
+  /* Check parameters */
+  if ((pm == NULL) || (pa == NULL) || (pb == NULL)) {
+    abort();
+  }
+  if ((pm == pa) || (pm == pb)) {
+    abort();
+  }
+  
+  /* Perform multiplication */
+  pm->a = (pa->a * pb->a) + (pa->b * pb->d);
+  pm->b = (pa->a * pb->b) + (pa->b * pb->e);
+  pm->c = (pa->a * pb->c) + (pa->b * pb->f) + pa->c;
+  
+  pm->d = (pa->d * pb->a) + (pa->e * pb->d);
+  pm->e = (pa->d * pb->b) + (pa->e * pb->e);
+  pm->f = (pa->d * pb->c) + (pa->e * pb->f) + pa->f;
+  
+  /* Update the derived values of the result */
+  matrix_update(pm);
+}
+
+/*
+ * Check whether warm state is currently being kept.
+ * 
+ * Return:
+ * 
+ *   non-zero if warm state is kept, zero if not
+ */
+static int is_warm(void) {
+  
+  int result = 0;
+  
+  if (pthread_mutex_lock(&m_warm_lock)) {
+    abort();
+  }
+  result = m_warm;
+  if (pthread_mutex_unlock(&m_warm_lock)) {
+    abort();
+  }
+  
+  return result;
+}
+
+/*
+ * Compute the size in bytes of the pixel data of a buffer register.
+ * 
+ * Parameters:
+ * 
+ *   ps - the buffer register
+ * 
+ * Return:
+ * 
+ *   the size in bytes of the pixel data
+ */
+static size_t buf_size(const SKBUF *ps) {
+  
+  /* Check parameter */
+  if (ps == NULL) {
+    abort();
+  }
+  
+  /* Compute size */
+  return ((size_t) ps->w) * ((size_t) ps->h) * ((size_t) buf_pixel(ps));
+}
+
+/*
+ * Get the number of bytes used for each pixel of a buffer register.
+ * 
+ * Parameters:
+ * 
+ *   ps - the buffer register
+ * 
+ * Return:
+ * 
+ *   the number of bytes in each pixel
+ */
+static int32_t buf_pixel(const SKBUF *ps) {
+  
+  /* Check parameter */
+  if (ps == NULL) {
+    abort();
+  }
+  
+  /* Float buffers have a float for each channel */
+  if (ps->fp) {
+    return ((int32_t) ps->c) * ((int32_t) sizeof(float));
+  }
+  return (int32_t) ps->c;
+}
+
+/*
+ * Convert a scanline of a loaded float buffer to non-premultiplied ARGB
+ * bytes.
+ * 
+ * This is the same conversion that render_pixel() makes when it stores
+ * into an ARGB buffer, so sampling into a float buffer and storing it
+ * gives the same result as sampling into an ARGB buffer once.
+ * 
+ * Parameters:
+ * 
+ *   ps - the float buffer
+ * 
+ *   y - the scanline to convert
+ * 
+ *   pRow - receives four bytes for each pixel in the scanline
+ */
+static void float_row(const SKBUF *ps, int32_t y, uint8_t *pRow) {
+  
+  int32_t x = 0;
+  const float *pf = NULL;
+  SKARGB fcol;
+  
+  /* Check parameters */
+  if ((ps == NULL) || (pRow == NULL)) {
+    abort();
+  }
+  if ((!(ps->fp)) || (ps->pData == NULL) || (y < 0) || (y >= ps->h)) {
+    abort();
+  }
+  
+  /* Convert each pixel */
+  pf = ((const float *) ps->pData) + (((size_t) y) * ps->w * 4);
+  for(x = 0; x < ps->w; x++) {
+    fcol.a = (double) pf[0];
+    fcol.r = (double) pf[1];
+    fcol.g = (double) pf[2];
+    fcol.b = (double) pf[3];
+    store_argb(&fcol, pRow);
+    
+    pf += 4;
+    pRow += 4;
+  }
+}
+
+/*
+ * Drop a reference to shared pixel data.
+ * 
+ * If this was the last reference, the shared pixel data is freed.  The
+ * caller must hold m_warm_lock.
+ * 
+ * Parameters:
+ * 
+ *   psh - the share
+ */
+static void share_drop(SKSHARE *psh) {
+  
+  /* Check parameter */
+  if (psh == NULL) {
+    abort();
+  }
+  if (psh->refs < 1) {
+    abort();
+  }
+  
+  /* Drop the reference and free if it was the last */
+  psh->refs--;
+  if (psh->refs < 1) {
+    free(psh->pData);
+    psh->pData = NULL;
+    free(psh);
+  }
+}
+
+/*
+ * Make sure a buffer register has private pixel data, without
+ * preserving its contents.
+ * 
+ * If the buffer register is sharing pixel data, the share is dropped.
+ * Then, if the buffer register does not have pixel data, it is
+ * allocated.  If the buffer pool holds a released buffer of exactly the
+ * right size, it is reused.  Otherwise, a new buffer is allocated.  The
+ * contents of the pixel data are undefined.
+ * 
+ * Parameters:
+ * 
+ *   ps - the buffer register
+ */
+static void buf_alloc(SKBUF *ps) {
+  
+  int32_t i = 0;
+  size_t len = 0;
+  
+  /* Check parameter */
+  if (ps == NULL) {
+    abort();
+  }
+  
+  /* Any pending color lookup or compressed mask no longer applies,
+   * since the pixel data is about to be replaced */
+  ps->lut_pending = 0;
+  if (ps->pRle != NULL) {
+    rle_free(ps->pRle);
+    ps->pRle = NULL;
+  }
+  
+  /* Drop any share */
+  if (ps->pShare != NULL) {
+    if (pthread_mutex_lock(&m_warm_lock)) {
+      abort();
+    }
+    share_drop(ps->pShare);
+    if (pthread_mutex_unlock(&m_warm_lock)) {
+      abort();
+    }
+    ps->pShare = NULL;
+    ps->pData = NULL;
+  }
+  
+  /* Only proceed if not already allocated */
+  if (ps->pData == NULL) {
+    
+    /* Get the required size */
+    len = buf_size(ps);
+    
+    /* Look for a pooled buffer of the same size, searching from the
+     * most recently released */
+    if (pthread_mutex_lock(&m_warm_lock)) {
+      abort();
+    }
+    for(i = m_pool_count - 1; i >= 0; i--) {
+      if ((m_pool[i]).len == len) {
+        break;
+      }
+    }
+    
+    if (i >= 0) {
+      /* Take the pooled buffer and fill its slot with the last pooled
+       * buffer */
+      ps->pData = (m_pool[i]).pData;
+      m_pool_bytes -= len;
+      m_pool_count--;
+      if (i < m_pool_count) {
+        memcpy(&(m_pool[i]), &(m_pool[m_pool_count]), sizeof(SKBLOCK));
+      }
+    }
+    if (pthread_mutex_unlock(&m_warm_lock)) {
+      abort();
+    }
+    
+    if (ps->pData == NULL) {
+      /* Nothing pooled, so allocate a new buffer */
+      ps->pData = (uint8_t *) malloc(len);
+      if (ps->pData == NULL) {
+        abort();
+      }
+    }
+  }
+}
+
+/*
+ * Make sure the pixel data of a loaded buffer register may be modified
+ * in place.
+ * 
+ * If the buffer register is sharing pixel data, it is given a private
+ * copy of the pixel data and the share is dropped.  Otherwise, nothing
+ * is done.
+ * 
+ * Parameters:
+ * 
+ *   ps - the buffer register, which must be loaded
+ */
+static void buf_writable(SKBUF *ps) {
+  
+  SKSHARE *psh = NULL;
+  
+  /* Check parameter */
+  if (ps == NULL) {
+    abort();
+  }
+  if (ps->pData == NULL) {
+    abort();
+  }
+  
+  /* Apply any pending color lookup, which also gives the register
+   * private pixel data */
+  buf_settle(ps);
+  
+  /* Only proceed if shared */
+  if (ps->pShare != NULL) {
+    
+    /* Detach the share and allocate private pixel data */
+    psh = ps->pShare;
+    ps->pShare = NULL;
+    ps->pData = NULL;
+    buf_alloc(ps);
+    
+    /* Copy the shared pixel data */
+    memcpy(ps->pData, psh->pData, buf_size(ps));
+    
+    /* Drop the share */
+    if (pthread_mutex_lock(&m_warm_lock)) {
+      abort();
+    }
+    share_drop(psh);
+    if (pthread_mutex_unlock(&m_warm_lock)) {
+      abort();
+    }
+  }
+}
+
+/*
+ * Release the pixel data of a buffer register, if it has any.
+ * 
+ * If the pixel data is shared, the share is dropped.  Otherwise, if
+ * warm state is being kept and the buffer pool has room, the pixel data
+ * is placed into the buffer pool, or else it is freed.
+ * 
+ * Parameters:
+ * 
+ *   ps - the buffer register
+ */
+static void buf_release(SKBUF *ps) {
+  
+  size_t len = 0;
+  
+  /* Check parameter */
+  if (ps == NULL) {
+    abort();
+  }
+  
+  /* Any pending color lookup is discarded with the pixel data, and any
+   * compressed mask, atlas table, and font are freed */
+  ps->lut_pending = 0;
+  if (ps->pRle != NULL) {
+    rle_free(ps->pRle);
+    ps->pRle = NULL;
+  }
+  if (ps->pAtlas != NULL) {
+    atlas_free(ps->pAtlas);
+    ps->pAtlas = NULL;
+  }
+  if (ps->pFont != NULL) {
+    font_free(ps->pFont);
+    ps->pFont = NULL;
+  }
+  
+  /* Only proceed if allocated */
+  if (ps->pData != NULL) {
+    
+    /* Get the size */
+    len = buf_size(ps);
+    
+    if (pthread_mutex_lock(&m_warm_lock)) {
+      abort();
+    }
+    
+    if (ps->pShare != NULL) {
+      /* Drop the share */
+      share_drop(ps->pShare);
+      ps->pShare = NULL;
+      
+    } else if (m_warm && (m_pool_count < POOL_MAX_COUNT) &&
+        (len <= POOL_MAX_BYTES - m_pool_bytes)) {
+      /* Pool the buffer */
+      (m_pool[m_pool_count]).pData = ps->pData;
+      (m_pool[m_pool_count]).len = len;
+      m_pool_count++;
+      m_pool_bytes += len;
+      
+    } else {
+      /* Free the buffer */
+      free(ps->pData);
+    }
+    
+    if (pthread_mutex_unlock(&m_warm_lock)) {
+      abort();
+    }
+    
+    ps->pData = NULL;
+  }
+}
+
+/*
+ * Apply any pending color lookup to the pixel data of a loaded buffer
+ * register.
+ * 
+ * This must be called before reading the pixel data of a register.  If
+ * there is no pending lookup, nothing is done.  If the pixel data is
+ * shared, the lookup is applied while copying it into private pixel
+ * data, so that the share is only read once.
+ * 
+ * Parameters:
+ * 
+ *   ps - the buffer register, which must be loaded
+ */
+static void buf_settle(SKBUF *ps) {
+  
+  SKSHARE *psh = NULL;
+  SKLUTJOB job;
+  
+  /* Initialize structures */
+  memset(&job, 0, sizeof(SKLUTJOB));
+  
+  /* Check parameter */
+  if (ps == NULL) {
+    abort();
+  }
+  if (ps->pData == NULL) {
+    abort();
+  }
+  
+  /* Only proceed if a lookup is pending */
+  if (!(ps->lut_pending)) {
+    return;
+  }
+  
+  /* Determine where to read from, detaching any share and allocating
+   * private pixel data to write to */
+  if (ps->pShare != NULL) {
+    psh = ps->pShare;
+    ps->pShare = NULL;
+    ps->pData = NULL;
+    buf_alloc(ps);
+    job.pSrc = psh->pData;
+    
+  } else {
+    job.pSrc = ps->pData;
+  }
+  
+  /* Apply the lookup */
+  job.pDst = ps->pData;
+  job.pLut = ps->pLut;
+  job.w = ps->w;
+  job.c = ps->c;
+  par_rows(ps->h, ((size_t) ps->w) * ((size_t) ps->c), &lut_band, &job);
+  ps->lut_pending = 0;
+  
+  /* Drop the share if we detached one */
+  if (psh != NULL) {
+    if (pthread_mutex_lock(&m_warm_lock)) {
+      abort();
+    }
+    share_drop(psh);
+    if (pthread_mutex_unlock(&m_warm_lock)) {
+      abort();
+    }
+  }
+}
+
+/*
+ * Allocate a new, empty compressed mask.
+ * 
+ * Parameters:
+ * 
+ *   h - the number of scanlines in the mask
+ * 
+ * Return:
+ * 
+ *   the new compressed mask
+ */
+static SKRLE *rle_new(int32_t h) {
+  
+  SKRLE *pr = NULL;
+  
+  /* Check parameter */
+  if ((h < 1) || (h > SKVM_MAX_DIM)) {
+    abort();
+  }
+  
+  /* Allocate the structure, the scanline table, and initial codes */
+  pr = (SKRLE *) calloc(1, sizeof(SKRLE));
+  if (pr == NULL) {
+    abort();
+  }
+  
+  pr->pRow = (size_t *) calloc((size_t) (h + 1), sizeof(size_t));
+  if (pr->pRow == NULL) {
+    abort();
+  }
+  
+  pr->cap = RLE_INIT_CAP;
+  pr->len = 0;
+  pr->pCode = (uint8_t *) malloc(pr->cap);
+  if (pr->pCode == NULL) {
+    abort();
+  }
+  
+  /* Return the new mask */
+  return pr;
+}
+
+/*
+ * Free a compressed mask.
+ * 
+ * Parameters:
+ * 
+ *   pr - the compressed mask, or NULL
+ */
+static void rle_free(SKRLE *pr) {
+  if (pr != NULL) {
+    free(pr->pRow);
+    free(pr->pCode);
+    free(pr);
+  }
+}
+
+/*
+ * Append a run to a compressed mask.
+ * 
+ * Parameters:
+ * 
+ *   pr - the compressed mask
+ * 
+ *   kind - one of the RLE_ kinds
+ * 
+ *   n - the length of the run, in range [1, SKVM_MAX_DIM]
+ * 
+ *   pLit - the mask values of a literal run, ignored otherwise
+ */
+static void rle_put(
+          SKRLE   * pr,
+          int       kind,
+          int32_t   n,
+    const uint8_t * pLit) {
+  
+  size_t need = 0;
+  uint8_t *pNew = NULL;
+  
+  /* Check parameters */
+  if ((pr == NULL) || (n < 1) || (n > SKVM_MAX_DIM)) {
+    abort();
+  }
+  if ((kind != RLE_ZERO) && (kind != RLE_FULL) &&
+      (kind != RLE_LITERAL)) {
+    abort();
+  }
+  if ((kind == RLE_LITERAL) && (pLit == NULL)) {
+    abort();
+  }
+  
+  /* Grow the codes if necessary, doubling the capacity */
+  need = 2;
+  if (kind == RLE_LITERAL) {
+    need += (size_t) n;
+  }
+  while (pr->cap - pr->len < need) {
+    pNew = (uint8_t *) realloc(pr->pCode, pr->cap * 2);
+    if (pNew == NULL) {
+      abort();
+    }
+    pr->pCode = pNew;
+    pr->cap = pr->cap * 2;
+  }
+  
+  /* Append the run code and any literal values */
+  (pr->pCode)[pr->len] = (uint8_t) ((n - 1) & 0xff);
+  (pr->pCode)[pr->len + 1] = (uint8_t) ((kind << 6) | ((n - 1) >> 8));
+  pr->len += 2;
+  
+  if (kind == RLE_LITERAL) {
+    memcpy(pr->pCode + pr->len, pLit, (size_t) n);
+    pr->len += (size_t) n;
+  }
+}
+
+/*
+ * Compress a scanline of mask values onto the end of a compressed
+ * mask.
+ * 
+ * Scanlines must be added in order, starting with scanline zero.
+ * 
+ * Parameters:
+ * 
+ *   pr - the compressed mask
+ * 
+ *   y - the scanline being added
+ * 
+ *   pRow - the mask values of the scanline
+ * 
+ *   w - the number of mask values in the scanline
+ */
+static void rle_add_row(
+          SKRLE   * pr,
+          int32_t   y,
+    const uint8_t * pRow,
+          int32_t   w) {
+  
+  int32_t x = 0;
+  int32_t n = 0;
+  int32_t lit = -1;
+  uint8_t v = 0;
+  
+  /* Check parameters */
+  if ((pr == NULL) || (pRow == NULL) || (y < 0) ||
+      (w < 1) || (w > SKVM_MAX_DIM)) {
+    abort();
+  }
+  if ((pr->pRow)[y] != pr->len) {
+    abort();
+  }
+  
+  /* Store runs of zero and full values that are long enough, with
+   * everything between them in literal runs */
+  x = 0;
+  while (x < w) {
+    v = pRow[x];
+    n = 1;
+    if ((v == 0) || (v == 255)) {
+      while ((x + n < w) && (pRow[x + n] == v)) {
+        n++;
+      }
+    }
+    
+    if (((v == 0) || (v == 255)) && (n >= RLE_MIN_RUN)) {
+      if (lit >= 0) {
+        rle_put(pr, RLE_LITERAL, x - lit, pRow + lit);
+        lit = -1;
+      }
+      if (v == 0) {
+        rle_put(pr, RLE_ZERO, n, NULL);
+      } else {
+        rle_put(pr, RLE_FULL, n, NULL);
+      }
+      
+    } else if (lit < 0) {
+      lit = x;
+    }
+    
+    x += n;
+  }
+  
+  if (lit >= 0) {
+    rle_put(pr, RLE_LITERAL, w - lit, pRow + lit);
+  }
+  
+  /* Record where the next scanline starts */
+  (pr->pRow)[y + 1] = pr->len;
+}
+
+/*
+ * Free an atlas table.
+ * 
+ * Parameters:
+ * 
+ *   pa - the atlas table, or NULL
+ */
+static void atlas_free(SKATLAS *pa) {
+  if (pa != NULL) {
+    free(pa->pSprite);
+    free((void *) pa->ppName);
+    free(pa);
+  }
+}
+
+/*
+ * Compare two sub-image pointers by name, for qsort() and bsearch().
+ * 
+ * Parameters:
+ * 
+ *   pA - pointer to the first SKSPRITE pointer
+ * 
+ *   pB - pointer to the second SKSPRITE pointer
+ * 
+ * Return:
+ * 
+ *   less than, equal to, or greater than zero as the first name sorts
+ *   before, equal to, or after the second name
+ */
+static int atlas_cmp(const void *pA, const void *pB) {
+  
+  const SKSPRITE *psa = NULL;
+  const SKSPRITE *psb = NULL;
+  
+  /* Check parameters */
+  if ((pA == NULL) || (pB == NULL)) {
+    abort();
+  }
+  
+  /* Compare the names */
+  psa = *((const SKSPRITE * const *) pA);
+  psb = *((const SKSPRITE * const *) pB);
+  return strcmp(psa->name, psb->name);
+}
+
+/*
+ * Parse an atlas table.
+ * 
+ * See skvm_load_atlas() for the format.  The table is read from the
+ * current position of pf to the end of the file.
+ * 
+ * pa must be zero-initialized.  If successful, it receives the
+ * sub-images along with the name index.  If the function fails, pa
+ * may hold partial results that must still be freed.
+ * 
+ * pSheet must have room for SKVM_ATLAS_MAX_NAME + 1 characters.  It
+ * receives the file name of the atlas sheet.
+ * 
+ * If the function fails, the reason is set on the context.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   pf - the atlas table file
+ * 
+ *   pa - receives the sub-image table
+ * 
+ *   pSheet - receives the file name of the sheet
+ * 
+ *   pw - receives the width of the sheet
+ * 
+ *   ph - receives the height of the sheet
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int atlas_parse(
+    SKVM_CTX  * pv,
+    FILE      * pf,
+    SKATLAS   * pa,
+    char      * pSheet,
+    int32_t   * pw,
+    int32_t   * ph) {
+  
+  int status = 1;
+  int have_sheet = 0;
+  int32_t i = 0;
+  int32_t cap = 0;
+  long v[4];
+  char name[SKVM_ATLAS_MAX_NAME + 2];
+  char line[ATLAS_MAX_LINE];
+  char extra = 0;
+  SKSPRITE *pSprite = NULL;
+  
+  /* Initialize structures */
+  memset(v, 0, sizeof(long) * 4);
+  memset(name, 0, SKVM_ATLAS_MAX_NAME + 2);
+  memset(line, 0, ATLAS_MAX_LINE);
+  
+  /* Check parameters */
+  if ((pv == NULL) || (pf == NULL) || (pa == NULL) ||
+      (pSheet == NULL) || (pw == NULL) || (ph == NULL)) {
+    abort();
+  }
+  
+  /* Read each line */
+  while (fgets(line, ATLAS_MAX_LINE, pf) != NULL) {
+    
+    /* Check that the whole line was read */
+    if ((strchr(line, '\n') == NULL) && (!feof(pf))) {
+      status = 0;
+      pv->pErr = "Atlas table line is too long";
+      break;
+    }
+    
+    /* Skip blank lines and comments */
+    name[0] = 0;
+    if (sscanf(line, " %1s", name) != 1) {
+      continue;
+    }
+    if (name[0] == '#') {
+      continue;
+    }
+    
+    /* The first line names the sheet and gives its dimensions */
+    if (!have_sheet) {
+      if (sscanf(line, " %64s %ld %ld %c",
+            name, &(v[0]), &(v[1]), &extra) != 3) {
+        status = 0;
+        pv->pErr = "Invalid sheet line in atlas table";
+        break;
+      }
+      if ((strlen(name) > SKVM_ATLAS_MAX_NAME) ||
+          (v[0] < 1) || (v[0] > SKVM_MAX_DIM) ||
+          (v[1] < 1) || (v[1] > SKVM_MAX_DIM)) {
+        status = 0;
+        pv->pErr = "Invalid sheet line in atlas table";
+        break;
+      }
+      strcpy(pSheet, name);
+      *pw = (int32_t) v[0];
+      *ph = (int32_t) v[1];
+      have_sheet = 1;
+      continue;
+    }
+    
+    /* Other lines give a sub-image name and its rectangle */
+    if (sscanf(line, " %64s %ld %ld %ld %ld %c",
+          name, &(v[0]), &(v[1]), &(v[2]), &(v[3]), &extra) != 5) {
+      status = 0;
+      pv->pErr = "Invalid sub-image line in atlas table";
+      break;
+    }
+    if (strlen(name) > SKVM_ATLAS_MAX_NAME) {
+      status = 0;
+      pv->pErr = "Sub-image name in atlas table is too long";
+      break;
+    }
+    if ((v[0] < 0) || (v[1] < 0) || (v[2] < 1) || (v[3] < 1) ||
+        (v[0] > *pw - v[2]) || (v[1] > *ph - v[3])) {
+      status = 0;
+      pv->pErr = "Sub-image in atlas table is outside of sheet";
+      break;
+    }
+    
+    /* Grow the sub-image array if necessary */
+    if (pa->count >= cap) {
+      if (cap >= SKVM_ATLAS_MAX_COUNT) {
+        status = 0;
+        pv->pErr = "Too many sub-images in atlas table";
+        break;
+      }
+      if (cap < 1) {
+        cap = 64;
+      } else {
+        cap *= 2;
+      }
+      if (cap > SKVM_ATLAS_MAX_COUNT) {
+        cap = SKVM_ATLAS_MAX_COUNT;
+      }
+      pSprite = (SKSPRITE *) realloc(
+                  pa->pSprite, ((size_t) cap) * sizeof(SKSPRITE));
+      if (pSprite == NULL) {
+        abort();
+      }
+      pa->pSprite = pSprite;
+      pSprite = NULL;
+    }
+    
+    /* Add the sub-image */
+    pSprite = &((pa->pSprite)[pa->count]);
+    memset(pSprite, 0, sizeof(SKSPRITE));
+    pSprite->x = (int32_t) v[0];
+    pSprite->y = (int32_t) v[1];
+    pSprite->w = (int32_t) v[2];
+    pSprite->h = (int32_t) v[3];
+    strcpy(pSprite->name, name);
+    pSprite = NULL;
+    (pa->count)++;
+  }
+  if (status && ferror(pf)) {
+    status = 0;
+    pv->pErr = "Failed to read atlas table";
+  }
+  
+  /* Make sure there is a sheet and at least one sub-image */
+  if (status && (pa->count < 1)) {
+    status = 0;
+    pv->pErr = "Atlas table has no sub-images";
+  }
+  
+  /* Build the name index and make sure names are unique */
+  if (status) {
+    pa->ppName = (const SKSPRITE **) calloc(
+                  (size_t) pa->count, sizeof(const SKSPRITE *));
+    if (pa->ppName == NULL) {
+      abort();
+    }
+    for(i = 0; i < pa->count; i++) {
+      (pa->ppName)[i] = &((pa->pSprite)[i]);
+    }
+    qsort((void *) pa->ppName, (size_t) pa->count,
+          sizeof(const SKSPRITE *), &atlas_cmp);
+    
+    for(i = 1; i < pa->count; i++) {
+      if (strcmp(((pa->ppName)[i - 1])->name,
+                  ((pa->ppName)[i])->name) == 0) {
+        status = 0;
+        pv->pErr = "Duplicate sub-image name in atlas table";
+        break;
+      }
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Get the path of the sheet named in an atlas or font table.
+ * 
+ * The sheet is in the same directory as the table.  The returned path
+ * is dynamically allocated and must be freed by the caller.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the table
+ * 
+ *   pSheet - the file name of the sheet
+ * 
+ * Return:
+ * 
+ *   the path to the sheet
+ */
+static char *sheet_path(const char *pPath, const char *pSheet) {
+  
+  size_t dir_len = 0;
+  const char *pc = NULL;
+  char *pResult = NULL;
+  
+  /* Check parameters */
+  if ((pPath == NULL) || (pSheet == NULL)) {
+    abort();
+  }
+  
+  /* Get the length of the directory part of the table path, including
+   * the last separator */
+  pc = strrchr(pPath, '/');
+  if (pc != NULL) {
+    dir_len = ((size_t) (pc - pPath)) + 1;
+  } else {
+    dir_len = 0;
+  }
+  
+  /* Build the sheet path */
+  pResult = (char *) malloc(dir_len + strlen(pSheet) + 1);
+  if (pResult == NULL) {
+    abort();
+  }
+  memcpy(pResult, pPath, dir_len);
+  strcpy(pResult + dir_len, pSheet);
+  
+  return pResult;
+}
+
+/*
+ * Empty the glyph cache of a font.
+ * 
+ * Parameters:
+ * 
+ *   pf - the font
+ */
+static void font_flush(SKFONT *pf) {
+  
+  int32_t i = 0;
+  SKGLYPHIMG *pImg = NULL;
+  SKGLYPHIMG *pNext = NULL;
+  
+  /* Check parameters */
+  if (pf == NULL) {
+    abort();
+  }
+  
+  /* Free every rasterization of every glyph */
+  for(i = 0; i < pf->count; i++) {
+    pImg = (pf->pGlyph)[i].pImg;
+    while (pImg != NULL) {
+      pNext = pImg->pNext;
+      free((pImg->buf).pData);
+      free(pImg);
+      pImg = pNext;
+    }
+    (pf->pGlyph)[i].pImg = NULL;
+  }
+  pf->cached = 0;
+}
+
+/*
+ * Free a font along with its glyph cache.
+ * 
+ * Parameters:
+ * 
+ *   pf - the font, or NULL
+ */
+static void font_free(SKFONT *pf) {
+  if (pf != NULL) {
+    font_flush(pf);
+    free(pf->pGlyph);
+    free(pf->pCov);
+    free(pf);
+  }
+}
+
+/*
+ * Compare two glyphs by codepoint, for qsort() and bsearch().
+ * 
+ * Parameters:
+ * 
+ *   pA - the first SKGLYPH
+ * 
+ *   pB - the second SKGLYPH
+ * 
+ * Return:
+ * 
+ *   less than, equal to, or greater than zero as the first codepoint is
+ *   less than, equal to, or greater than the second
+ */
+static int font_cmp(const void *pA, const void *pB) {
+  
+  const SKGLYPH *pga = NULL;
+  const SKGLYPH *pgb = NULL;
+  
+  /* Check parameters */
+  if ((pA == NULL) || (pB == NULL)) {
+    abort();
+  }
+  
+  /* Compare the codepoints */
+  pga = (const SKGLYPH *) pA;
+  pgb = (const SKGLYPH *) pB;
+  if (pga->code < pgb->code) {
+    return -1;
+  } else if (pga->code > pgb->code) {
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Parse a font table.
+ * 
+ * See skvm_load_font() for the format.  The table is read from the
+ * current position of pf to the end of the file.
+ * 
+ * pFont must be zero-initialized.  If successful, it receives the font
+ * parameters and the glyphs, sorted by codepoint.  If the function
+ * fails, pFont may hold partial results that must still be freed.
+ * 
+ * pSheet must have room for SKVM_ATLAS_MAX_NAME + 1 characters.  It
+ * receives the file name of the font sheet.  The sheet dimensions are
+ * stored in pFont.
+ * 
+ * If the function fails, the reason is set on the context.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   pf - the font table file
+ * 
+ *   pFont - receives the font
+ * 
+ *   pSheet - receives the file name of the sheet
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int font_parse(
+    SKVM_CTX  * pv,
+    FILE      * pf,
+    SKFONT    * pFont,
+    char      * pSheet) {
+  
+  int status = 1;
+  int state = 0;
+  int32_t i = 0;
+  int32_t cap = 0;
+  long v[8];
+  char name[SKVM_ATLAS_MAX_NAME + 2];
+  char line[ATLAS_MAX_LINE];
+  char extra = 0;
+  SKGLYPH *pGlyph = NULL;
+  
+  /* Initialize structures */
+  memset(v, 0, sizeof(long) * 8);
+  memset(name, 0, SKVM_ATLAS_MAX_NAME + 2);
+  memset(line, 0, ATLAS_MAX_LINE);
+  
+  /* Check parameters */
+  if ((pv == NULL) || (pf == NULL) || (pFont == NULL) ||
+      (pSheet == NULL)) {
+    abort();
+  }
+  
+  /* Read each line, where state is zero before the sheet line, one
+   * before the font kind line, and two for glyph lines */
+  while (fgets(line, ATLAS_MAX_LINE, pf) != NULL) {
+    
+    /* Check that the whole line was read */
+    if ((strchr(line, '\n') == NULL) && (!feof(pf))) {
+      status = 0;
+      pv->pErr = "Font table line is too long";
+      break;
+    }
+    
+    /* Skip blank lines and comments */
+    name[0] = 0;
+    if (sscanf(line, " %1s", name) != 1) {
+      continue;
+    }
+    if (name[0] == '#') {
+      continue;
+    }
+    
+    /* The first line names the sheet and gives its dimensions */
+    if (state == 0) {
+      if (sscanf(line, " %64s %ld %ld %c",
+            name, &(v[0]), &(v[1]), &extra) != 3) {
+        status = 0;
+        pv->pErr = "Invalid sheet line in font table";
+        break;
+      }
+      if ((strlen(name) > SKVM_ATLAS_MAX_NAME) ||
+          (v[0] < 1) || (v[0] > SKVM_MAX_DIM) ||
+          (v[1] < 1) || (v[1] > SKVM_MAX_DIM)) {
+        status = 0;
+        pv->pErr = "Invalid sheet line in font table";
+        break;
+      }
+      strcpy(pSheet, name);
+      pFont->w = (int32_t) v[0];
+      pFont->h = (int32_t) v[1];
+      state = 1;
+      continue;
+    }
+    
+    /* The second line selects the kind of font */
+    if (state == 1) {
+      v[2] = 1;
+      if (sscanf(line, " %64s", name) != 1) {
+        abort();
+      }
+      if (strcmp(name, "bitmap") == 0) {
+        if (sscanf(line, " %*s %ld %ld %c",
+              &(v[0]), &(v[1]), &extra) != 2) {
+          status = 0;
+        }
+      } else if (strcmp(name, "sdf") == 0) {
+        pFont->sdf = 1;
+        if (sscanf(line, " %*s %ld %ld %ld %c",
+              &(v[0]), &(v[1]), &(v[2]), &extra) != 3) {
+          status = 0;
+        }
+      } else {
+        status = 0;
+      }
+      if (status) {
+        if ((v[0] < 1) || (v[0] > SKVM_MAX_DIM) ||
+            (v[1] < 1) || (v[1] > SKVM_MAX_DIM) ||
+            (v[2] < 1) || (v[2] > SKVM_MAX_DIM)) {
+          status = 0;
+        }
+      }
+      if (!status) {
+        pv->pErr = "Invalid font kind line in font table";
+        break;
+      }
+      pFont->size = (int32_t) v[0];
+      pFont->line = (int32_t) v[1];
+      pFont->range = (int32_t) v[2];
+      state = 2;
+      continue;
+    }
+    
+    /* Other lines describe a glyph */
+    if (sscanf(line, " %ld %ld %ld %ld %ld %ld %ld %ld %c",
+          &(v[0]), &(v[1]), &(v[2]), &(v[3]),
+          &(v[4]), &(v[5]), &(v[6]), &(v[7]), &extra) != 8) {
+      status = 0;
+      pv->pErr = "Invalid glyph line in font table";
+      break;
+    }
+    if ((v[0] < 0) || (v[0] > 0x10ffffL)) {
+      status = 0;
+      pv->pErr = "Invalid codepoint in font table";
+      break;
+    }
+    if ((v[1] < 0) || (v[2] < 0) || (v[3] < 0) || (v[4] < 0) ||
+        ((v[3] < 1) != (v[4] < 1)) ||
+        (v[1] > pFont->w - v[3]) || (v[2] > pFont->h - v[4])) {
+      status = 0;
+      pv->pErr = "Glyph in font table is outside of sheet";
+      break;
+    }
+    if ((v[5] < -SKVM_MAX_DIM) || (v[5] > SKVM_MAX_DIM) ||
+        (v[6] < -SKVM_MAX_DIM) || (v[6] > SKVM_MAX_DIM) ||
+        (v[7] < -SKVM_MAX_DIM) || (v[7] > SKVM_MAX_DIM)) {
+      status = 0;
+      pv->pErr = "Glyph metrics in font table out of range";
+      break;
+    }
+    
+    /* Grow the glyph array if necessary */
+    if (pFont->count >= cap) {
+      if (cap >= SKVM_FONT_MAX_GLYPHS) {
+        status = 0;
+        pv->pErr = "Too many glyphs in font table";
+        break;
+      }
+      if (cap < 1) {
+        cap = 128;
+      } else {
+        cap *= 2;
+      }
+      if (cap > SKVM_FONT_MAX_GLYPHS) {
+        cap = SKVM_FONT_MAX_GLYPHS;
+      }
+      pGlyph = (SKGLYPH *) realloc(
+                  pFont->pGlyph, ((size_t) cap) * sizeof(SKGLYPH));
+      if (pGlyph == NULL) {
+        abort();
+      }
+      pFont->pGlyph = pGlyph;
+      pGlyph = NULL;
+    }
+    
+    /* Add the glyph */
+    pGlyph = &((pFont->pGlyph)[pFont->count]);
+    memset(pGlyph, 0, sizeof(SKGLYPH));
+    pGlyph->code = (int32_t) v[0];
+    pGlyph->x = (int32_t) v[1];
+    pGlyph->y = (int32_t) v[2];
+    pGlyph->w = (int32_t) v[3];
+    pGlyph->h = (int32_t) v[4];
+    pGlyph->xoff = (int32_t) v[5];
+    pGlyph->yoff = (int32_t) v[6];
+    pGlyph->adv = (int32_t) v[7];
+    pGlyph->pImg = NULL;
+    pGlyph = NULL;
+    (pFont->count)++;
+  }
+  if (status && ferror(pf)) {
+    status = 0;
+    pv->pErr = "Failed to read font table";
+  }
+  
+  /* Make sure there is a sheet, a font kind, and at least one glyph */
+  if (status && (pFont->count < 1)) {
+    status = 0;
+    pv->pErr = "Font table has no glyphs";
+  }
+  
+  /* Sort the glyphs by codepoint and make sure codepoints are unique */
+  if (status) {
+    qsort(pFont->pGlyph, (size_t) pFont->count, sizeof(SKGLYPH),
+          &font_cmp);
+    for(i = 1; i < pFont->count; i++) {
+      if ((pFont->pGlyph)[i - 1].code == (pFont->pGlyph)[i].code) {
+        status = 0;
+        pv->pErr = "Duplicate codepoint in font table";
+        break;
+      }
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Build the coverage values of a font from its sheet.
+ * 
+ * The coverage or distance value of each sheet pixel is its alpha
+ * channel multiplied by its gray level.  pb is the loaded ARGB buffer
+ * holding the sheet, which must have the dimensions recorded in the
+ * font.
+ * 
+ * Parameters:
+ * 
+ *   pf - the font
+ * 
+ *   pb - the sheet
+ */
+static void font_cover(SKFONT *pf, const SKBUF *pb) {
+  
+  int32_t i = 0;
+  int32_t n = 0;
+  const uint8_t *ps = NULL;
+  SPH_ARGB argb;
+  
+  /* Initialize structures */
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  
+  /* Check parameters */
+  if ((pf == NULL) || (pb == NULL)) {
+    abort();
+  }
+  if ((pb->pData == NULL) || (pb->c != 4) || pb->fp ||
+      (pb->w != pf->w) || (pb->h != pf->h)) {
+    abort();
+  }
+  
+  /* Allocate the coverage values */
+  n = pf->w * pf->h;
+  pf->pCov = (uint8_t *) malloc((size_t) n);
+  if (pf->pCov == NULL) {
+    abort();
+  }
+  
+  /* Convert each pixel */
+  ps = pb->pData;
+  for(i = 0; i < n; i++) {
+    argb.a = 255;
+    argb.r = ps[1];
+    argb.g = ps[2];
+    argb.b = ps[3];
+    sph_argb_downGray(&argb);
+    (pf->pCov)[i] = (uint8_t) (((((int32_t) ps[0]) * argb.g) + 127) / 255);
+    ps += 4;
+  }
+}
+
+/*
+ * Find the glyph of a codepoint in a font.
+ * 
+ * Parameters:
+ * 
+ *   pf - the font
+ * 
+ *   code - the codepoint
+ * 
+ * Return:
+ * 
+ *   the glyph, or NULL if the font has no glyph for the codepoint
+ */
+static SKGLYPH *font_find(SKFONT *pf, int32_t code) {
+  
+  SKGLYPH key;
+  
+  /* Check parameters */
+  if (pf == NULL) {
+    abort();
+  }
+  
+  /* Binary search the glyphs */
+  memset(&key, 0, sizeof(SKGLYPH));
+  key.code = code;
+  return (SKGLYPH *) bsearch(&key, pf->pGlyph, (size_t) pf->count,
+                              sizeof(SKGLYPH), &font_cmp);
+}
+
+/*
+ * Get the dimensions of a glyph rasterized at a given scale.
+ * 
+ * The dimensions do not include the transparent border that
+ * font_render() adds around the glyph.  The glyph must not be empty.
+ * 
+ * Parameters:
+ * 
+ *   pg - the glyph
+ * 
+ *   scale - the scale from sheet pixels to rasterized pixels
+ * 
+ *   pw - receives the width
+ * 
+ *   ph - receives the height
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the glyph and its border would be
+ *   larger than SKVM_MAX_DIM
+ */
+static int font_dim(
+    const SKGLYPH * pg,
+          double    scale,
+          int32_t * pw,
+          int32_t * ph) {
+  
+  double fw = 0.0;
+  double fh = 0.0;
+  
+  /* Check parameters */
+  if ((pg == NULL) || (pw == NULL) || (ph == NULL)) {
+    abort();
+  }
+  if ((pg->w < 1) || (pg->h < 1) || (!(scale > 0.0))) {
+    abort();
+  }
+  
+  /* Scale the dimensions, covering every partial pixel */
+  fw = ceil(((double) pg->w) * scale);
+  fh = ceil(((double) pg->h) * scale);
+  if ((fw > (double) (SKVM_MAX_DIM - 2)) ||
+      (fh > (double) (SKVM_MAX_DIM - 2))) {
+    return 0;
+  }
+  
+  *pw = (int32_t) fw;
+  *ph = (int32_t) fh;
+  if (*pw < 1) {
+    *pw = 1;
+  }
+  if (*ph < 1) {
+    *ph = 1;
+  }
+  return 1;
+}
+
+/*
+ * Get a glyph rasterized at a given font size from the glyph cache,
+ * rasterizing it if it is not there yet.
+ * 
+ * Each pixel of the rasterized glyph is mapped back to the sheet and
+ * the coverage or distance values around it are interpolated
+ * bilinearly.  At the font size of the sheet, pixel centers fall
+ * exactly on sheet pixel centers, so the coverage of a bitmap font is
+ * copied exactly.  The distance of an SDF font is scaled to rasterized
+ * pixels and turned into coverage with a one-pixel ramp across the
+ * edge, which anti-aliases the edge at any size.
+ * 
+ * The rasterized glyph has a transparent border of one pixel, so that
+ * sampling does not smear the edges of the glyph outwards when it
+ * clamps to the edges of the buffer.  Its top-left pixel is therefore
+ * one pixel above and to the left of the top-left corner of the glyph.
+ * 
+ * The glyph must not be empty, and font_dim() must succeed for it at
+ * the scale of the font size.
+ * 
+ * Parameters:
+ * 
+ *   pf - the font
+ * 
+ *   pg - the glyph within the font
+ * 
+ *   size - the font size in pixels
+ * 
+ * Return:
+ * 
+ *   the rasterized glyph
+ */
+static const SKGLYPHIMG *font_render(
+    SKFONT  * pf,
+    SKGLYPH * pg,
+    double    size) {
+  
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t w = 0;
+  int32_t h = 0;
+  int32_t x0 = 0;
+  int32_t y0 = 0;
+  int32_t x1 = 0;
+  int32_t y1 = 0;
+  size_t len = 0;
+  double scale = 0.0;
+  double u = 0.0;
+  double v = 0.0;
+  double fu = 0.0;
+  double fv = 0.0;
+  double cv = 0.0;
+  const uint8_t *pc = NULL;
+  uint8_t *pt = NULL;
+  SKGLYPHIMG *pImg = NULL;
+  
+  /* Check parameters */
+  if ((pf == NULL) || (pg == NULL)) {
+    abort();
+  }
+  
+  /* Return the glyph from the cache if it is there */
+  for(pImg = pg->pImg; pImg != NULL; pImg = pImg->pNext) {
+    if (pImg->size == size) {
+      return pImg;
+    }
+  }
+  
+  /* Get the rasterized dimensions */
+  scale = size / ((double) pf->size);
+  if (!font_dim(pg, scale, &w, &h)) {
+    abort();
+  }
+  len = ((size_t) (w + 2)) * ((size_t) (h + 2));
+  
+  /* Empty the cache first if the glyph would overflow it */
+  if (pf->cached + len > FONT_CACHE_MAX) {
+    font_flush(pf);
+  }
+  
+  /* Allocate the rasterized glyph as a grayscale buffer, with the
+   * border cleared */
+  pImg = (SKGLYPHIMG *) calloc(1, sizeof(SKGLYPHIMG));
+  if (pImg == NULL) {
+    abort();
+  }
+  pImg->size = size;
+  (pImg->buf).w = (int16_t) (w + 2);
+  (pImg->buf).h = (int16_t) (h + 2);
+  (pImg->buf).c = (uint8_t) 1;
+  (pImg->buf).pData = (uint8_t *) calloc(len, 1);
+  if ((pImg->buf).pData == NULL) {
+    abort();
+  }
+  
+  /* Rasterize each pixel, clamping the interpolation to the glyph
+   * rectangle in the sheet */
+  pc = pf->pCov;
+  for(y = 0; y < h; y++) {
+    pt = (pImg->buf).pData + (((size_t) (y + 1)) * ((size_t) (w + 2))) + 1;
+    v = ((((double) y) + 0.5) / scale) - 0.5;
+    if (v < 0.0) {
+      v = 0.0;
+    } else if (v > (double) (pg->h - 1)) {
+      v = (double) (pg->h - 1);
+    }
+    y0 = (int32_t) floor(v);
+    y1 = y0 + 1;
+    if (y1 > pg->h - 1) {
+      y1 = pg->h - 1;
+    }
+    fv = v - ((double) y0);
+    y0 = (pg->y + y0) * pf->w;
+    y1 = (pg->y + y1) * pf->w;
+    
+    for(x = 0; x < w; x++) {
+      u = ((((double) x) + 0.5) / scale) - 0.5;
+      if (u < 0.0) {
+        u = 0.0;
+      } else if (u > (double) (pg->w - 1)) {
+        u = (double) (pg->w - 1);
+      }
+      x0 = (int32_t) floor(u);
+      x1 = x0 + 1;
+      if (x1 > pg->w - 1) {
+        x1 = pg->w - 1;
+      }
+      fu = u - ((double) x0);
+      x0 += pg->x;
+      x1 += pg->x;
+      
+      cv = (((double) pc[y0 + x0]) * (1.0 - fu) * (1.0 - fv)) +
+            (((double) pc[y0 + x1]) * fu * (1.0 - fv)) +
+            (((double) pc[y1 + x0]) * (1.0 - fu) * fv) +
+            (((double) pc[y1 + x1]) * fu * fv);
+      
+      if (pf->sdf) {
+        /* Convert the distance to rasterized pixels, and then to
+         * coverage with the edge in the middle of the ramp */
+        cv = ((cv - 127.5) / 127.5) * ((double) pf->range) * scale;
+        cv = (cv + 0.5) * 255.0;
+      }
+      
+      cv = floor(cv + 0.5);
+      if (!(cv >= 0.0)) {
+        cv = 0.0;
+      } else if (cv > 255.0) {
+        cv = 255.0;
+      }
+      *pt = (uint8_t) cv;
+      pt++;
+    }
+  }
+  
+  /* Add the glyph to the cache */
+  pImg->pNext = pg->pImg;
+  pg->pImg = pImg;
+  pf->cached += len;
+  
+  return pImg;
+}
+
+/*
+ * Decode the next codepoint of a UTF-8 string.
+ * 
+ * *ppc points to the next character of the string, which must not be
+ * the terminating nul.  It is advanced past the decoded character.
+ * Overlong encodings, surrogates, and codepoints beyond the Unicode
+ * range are not valid.
+ * 
+ * Parameters:
+ * 
+ *   ppc - pointer to the string pointer
+ * 
+ *   pCode - receives the codepoint
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the string is not valid UTF-8
+ */
+static int utf8_next(const char **ppc, int32_t *pCode) {
+  
+  const uint8_t *pc = NULL;
+  int32_t code = 0;
+  int32_t min = 0;
+  int n = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if ((ppc == NULL) || (pCode == NULL)) {
+    abort();
+  }
+  if (*ppc == NULL) {
+    abort();
+  }
+  pc = (const uint8_t *) *ppc;
+  if (*pc == 0) {
+    abort();
+  }
+  
+  /* Decode the leading byte */
+  if (*pc < 0x80) {
+    code = *pc;
+    n = 0;
+  } else if ((*pc & 0xe0) == 0xc0) {
+    code = *pc & 0x1f;
+    n = 1;
+    min = 0x80;
+  } else if ((*pc & 0xf0) == 0xe0) {
+    code = *pc & 0x0f;
+    n = 2;
+    min = 0x800;
+  } else if ((*pc & 0xf8) == 0xf0) {
+    code = *pc & 0x07;
+    n = 3;
+    min = 0x10000;
+  } else {
+    return 0;
+  }
+  pc++;
+  
+  /* Decode the continuation bytes */
+  for(i = 0; i < n; i++) {
+    if ((*pc & 0xc0) != 0x80) {
+      return 0;
+    }
+    code = (code << 6) | (*pc & 0x3f);
+    pc++;
+  }
+  
+  /* Check the codepoint */
+  if ((n > 0) && (code < min)) {
+    return 0;
+  }
+  if ((code > 0x10ffff) || ((code >= 0xd800) && (code <= 0xdfff))) {
+    return 0;
+  }
+  
+  *ppc = (const char *) pc;
+  *pCode = code;
+  return 1;
+}
+
+/*
+ * Create the key of the per-thread state.
+ * 
+ * This is called once through pthread_once().
+ */
+static void thread_key_make(void) {
+  if (pthread_key_create(&m_thread_key, &thread_free)) {
+    abort();
+  }
+}
+
+/*
+ * Free the state of a thread when the thread exits.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKTHREAD to free
+ */
+static void thread_free(void *pArg) {
+  
+  SKTHREAD *pt = NULL;
+  
+  /* Ignore if nothing to free */
+  if (pArg == NULL) {
+    return;
+  }
+  pt = (SKTHREAD *) pArg;
+  
+  /* Free the scratch arena and the state */
+  if (pt->pScratch != NULL) {
+    free(pt->pScratch);
+    pt->pScratch = NULL;
+  }
+  free(pt);
+}
+
+/*
+ * Get the state of the calling thread, allocating it if this thread
+ * does not have any state yet.
+ * 
+ * Return:
+ * 
+ *   the state of the calling thread
+ */
+static SKTHREAD *thread_state(void) {
+  
+  SKTHREAD *pt = NULL;
+  
+  /* Make sure the key exists */
+  if (pthread_once(&m_thread_once, &thread_key_make)) {
+    abort();
+  }
+  
+  /* Get the state, allocating it if necessary */
+  pt = (SKTHREAD *) pthread_getspecific(m_thread_key);
+  if (pt == NULL) {
+    pt = (SKTHREAD *) calloc(1, sizeof(SKTHREAD));
+    if (pt == NULL) {
+      abort();
+    }
+    if (pthread_setspecific(m_thread_key, pt)) {
+      abort();
+    }
+  }
+  
+  return pt;
+}
+
+/*
+ * Get the number of threads that work started on the calling thread
+ * may use, including the calling thread itself.
+ * 
+ * This is the limit set with skvm_threads() on the calling thread, or
+ * else the default.  The default is determined the first time it is
+ * needed, from the THREADS_ENV environment variable if it holds a
+ * valid thread count, or else from the number of online processors.
+ * 
+ * Return:
+ * 
+ *   the thread count, in range [1, SKVM_MAX_THREADS]
+ */
+static int32_t thread_limit(void) {
+  
+  SKTHREAD *pt = NULL;
+  const char *pEnv = NULL;
+  char *pEnd = NULL;
+  long n = 0;
+  
+  /* Use the limit of the thread if it was set */
+  pt = thread_state();
+  if (pt->limit > 0) {
+    return pt->limit;
+  }
+  
+  /* Otherwise, use the default, determining it if necessary */
+  if (pthread_mutex_lock(&m_work_lock)) {
+    abort();
+  }
+  if (m_work_default < 1) {
+    n = 0;
+    pEnv = getenv(THREADS_ENV);
+    if (pEnv != NULL) {
+      n = strtol(pEnv, &pEnd, 10);
+      if ((pEnd == pEnv) || (*pEnd != 0)) {
+        n = 0;
+      }
+    }
+    if ((n < 1) || (n > SKVM_MAX_THREADS)) {
+      n = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (n < 1) {
+      n = 1;
+    } else if (n > SKVM_MAX_THREADS) {
+      n = SKVM_MAX_THREADS;
+    }
+    m_work_default = (int32_t) n;
+  }
+  n = m_work_default;
+  if (pthread_mutex_unlock(&m_work_lock)) {
+    abort();
+  }
+  
+  return (int32_t) n;
+}
+
+/*
+ * Check whether skvm_sample() calls on the calling thread should use
+ * the reference renderer.
+ * 
+ * This is the mode set with skvm_reference() on the calling thread, or
+ * else the default.  The default is determined the first time it is
+ * needed, and it is on if the REFERENCE_ENV environment variable is
+ * set to anything other than an empty string or "0".
+ * 
+ * Return:
+ * 
+ *   non-zero for reference rendering, zero for the fast paths
+ */
+static int thread_reference(void) {
+  
+  SKTHREAD *pt = NULL;
+  const char *pEnv = NULL;
+  int ref = SKVM_REF_DEFAULT;
+  
+  /* Use the mode of the thread if it was set */
+  pt = thread_state();
+  if (pt->ref != SKVM_REF_DEFAULT) {
+    return (pt->ref == SKVM_REF_ON);
+  }
+  
+  /* Otherwise, use the default, determining it if necessary */
+  if (pthread_mutex_lock(&m_work_lock)) {
+    abort();
+  }
+  if (m_work_ref == SKVM_REF_DEFAULT) {
+    m_work_ref = SKVM_REF_OFF;
+    pEnv = getenv(REFERENCE_ENV);
+    if (pEnv != NULL) {
+      if ((*pEnv != 0) && (strcmp(pEnv, "0") != 0)) {
+        m_work_ref = SKVM_REF_ON;
+      }
+    }
+  }
+  ref = m_work_ref;
+  if (pthread_mutex_unlock(&m_work_lock)) {
+    abort();
+  }
+  
+  return (ref == SKVM_REF_ON);
+}
+
+/*
+ * Get the scratch arena of the calling thread.
+ * 
+ * The arena is grown if it is smaller than len bytes.  Its contents are
+ * undefined, and it remains valid until the next call to this function
+ * on the same thread.  Band and task functions may use it for their
+ * temporary data instead of allocating memory each time they run, but
+ * they must not call anything else that uses the arena while they hold
+ * it.  The arena is freed when the thread exits.
+ * 
+ * Parameters:
+ * 
+ *   len - the number of bytes needed
+ * 
+ * Return:
+ * 
+ *   the scratch arena
+ */
+static uint8_t *scratch_get(size_t len) {
+  
+  SKTHREAD *pt = NULL;
+  
+  /* Get the state of this thread */
+  pt = thread_state();
+  
+  /* Grow the arena if necessary */
+  if ((pt->pScratch == NULL) || (pt->cap < len)) {
+    if (pt->pScratch != NULL) {
+      free(pt->pScratch);
+      pt->pScratch = NULL;
+      pt->cap = 0;
+    }
+    
+    pt->pScratch = (uint8_t *) malloc((len > 0) ? len : 1);
+    if (pt->pScratch == NULL) {
+      abort();
+    }
+    pt->cap = len;
+  }
+  
+  return pt->pScratch;
+}
+
+/*
+ * Thread start routine for the worker threads of the worker pool.
+ * 
+ * Worker threads run queued tasks forever.
+ * 
+ * Parameters:
+ * 
+ *   pArg - ignored
+ * 
+ * Return:
+ * 
+ *   never returns
+ */
+static void *work_thread(void *pArg) {
+  
+  SKTASK *pt = NULL;
+  
+  /* Ignore parameter */
+  (void) pArg;
+  
+  if (pthread_mutex_lock(&m_work_lock)) {
+    abort();
+  }
+  for( ; ; ) {
+    /* Wait for a task and take it off the queue */
+    while (m_work_head == NULL) {
+      if (pthread_cond_wait(&m_work_cond, &m_work_lock)) {
+        abort();
+      }
+    }
+    pt = m_work_head;
+    m_work_head = pt->pNext;
+    if (m_work_head == NULL) {
+      m_work_tail = NULL;
+    }
+    pt->pNext = NULL;
+    pt->state = TASK_RUNNING;
+    
+    /* Run the task without holding the lock */
+    if (pthread_mutex_unlock(&m_work_lock)) {
+      abort();
+    }
+    (pt->fn)(pt->pArg);
+    if (pthread_mutex_lock(&m_work_lock)) {
+      abort();
+    }
+    
+    /* Report that the task is done */
+    pt->state = TASK_DONE;
+    if (pthread_cond_broadcast(&m_work_done)) {
+      abort();
+    }
+  }
+  
+  return NULL;
+}
+
+/*
+ * Make sure the worker pool has enough worker threads for n threads to
+ * work together, counting the thread that starts the work.
+ * 
+ * If a worker thread can not be started, the pool simply stays
+ * smaller.  Worker threads are detached, and they are never stopped.
+ * 
+ * Parameters:
+ * 
+ *   n - the number of threads, in range [1, SKVM_MAX_THREADS]
+ */
+static void work_grow(int32_t n) {
+  
+  pthread_t thread;
+  pthread_attr_t attr;
+  
+  /* Check parameter */
+  if ((n < 1) || (n > SKVM_MAX_THREADS)) {
+    abort();
+  }
+  
+  if (pthread_mutex_lock(&m_work_lock)) {
+    abort();
+  }
+  
+  /* Start worker threads until there are enough */
+  if (m_work_count < n - 1) {
+    if (pthread_attr_init(&attr)) {
+      abort();
+    }
+    if (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
+      abort();
+    }
+    while (m_work_count < n - 1) {
+      if (pthread_create(&thread, &attr, &work_thread, NULL)) {
+        break;
+      }
+      m_work_count++;
+    }
+    if (pthread_attr_destroy(&attr)) {
+      abort();
+    }
+  }
+  
+  if (pthread_mutex_unlock(&m_work_lock)) {
+    abort();
+  }
+}
+
+/*
+ * Start a task on the worker pool.
+ * 
+ * pt is the task structure, which the caller provides and which serves
+ * as the future of the task.  It must remain valid until task_finish()
+ * has been called on it, and task_finish() must be called on every
+ * started task.
+ * 
+ * The task is queued for a worker thread.  If the pool has no worker
+ * threads, the task is run by task_finish() instead.
+ * 
+ * Parameters:
+ * 
+ *   pt - the task structure
+ * 
+ *   fn - the task function
+ * 
+ *   pArg - the argument to pass to the task function
+ */
+static void task_start(SKTASK *pt, fp_task fn, void *pArg) {
+  
+  /* Check parameters */
+  if ((pt == NULL) || (fn == NULL)) {
+    abort();
+  }
+  
+  /* Initialize the task */
+  pt->fn = fn;
+  pt->pArg = pArg;
+  pt->state = TASK_QUEUED;
+  pt->pNext = NULL;
+  
+  /* Queue the task if there are worker threads */
+  if (pthread_mutex_lock(&m_work_lock)) {
+    abort();
+  }
+  if (m_work_count > 0) {
+    if (m_work_tail != NULL) {
+      m_work_tail->pNext = pt;
+    } else {
+      m_work_head = pt;
+    }
+    m_work_tail = pt;
+    
+    if (pthread_cond_signal(&m_work_cond)) {
+      abort();
+    }
+  }
+  if (pthread_mutex_unlock(&m_work_lock)) {
+    abort();
+  }
+}
+
+/*
+ * Wait for a task started with task_start() to finish.
+ * 
+ * If no worker thread has taken the task yet, it is taken off the
+ * queue and run on the calling thread, so waiting never depends on a
+ * worker thread being free.
+ * 
+ * Parameters:
+ * 
+ *   pt - the task structure
+ */
+static void task_finish(SKTASK *pt) {
+  
+  SKTASK *pp = NULL;
+  int run = 0;
+  
+  /* Check parameter */
+  if (pt == NULL) {
+    abort();
+  }
+  
+  if (pthread_mutex_lock(&m_work_lock)) {
+    abort();
+  }
+  
+  if (pt->state == TASK_QUEUED) {
+    /* Not taken yet, so remove it from the queue if it is there */
+    if (m_work_head == pt) {
+      m_work_head = pt->pNext;
+      if (m_work_head == NULL) {
+        m_work_tail = NULL;
+      }
+      
+    } else if (m_work_head != NULL) {
+      for(pp = m_work_head; pp->pNext != NULL; pp = pp->pNext) {
+        if (pp->pNext == pt) {
+          pp->pNext = pt->pNext;
+          if (m_work_tail == pt) {
+            m_work_tail = pp;
+          }
+          break;
+        }
+      }
+    }
+    pt->pNext = NULL;
+    pt->state = TASK_RUNNING;
+    run = 1;
+    
+  } else {
+    /* Taken by a worker thread, so wait for it to finish */
+    while (pt->state != TASK_DONE) {
+      if (pthread_cond_wait(&m_work_done, &m_work_lock)) {
+        abort();
+      }
+    }
+  }
+  
+  if (pthread_mutex_unlock(&m_work_lock)) {
+    abort();
+  }
+  
+  /* Run the task here if it was never taken */
+  if (run) {
+    (pt->fn)(pt->pArg);
+    pt->state = TASK_DONE;
+  }
+}
+
+/*
+ * Task function that processes bands of a par_rows() job until no
+ * bands are left.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKPARJOB
+ */
+static void par_task(void *pArg) {
+  
+  SKPARJOB *pj = NULL;
+  int32_t b = 0;
+  
+  /* Check parameter */
+  if (pArg == NULL) {
+    abort();
+  }
+  pj = (SKPARJOB *) pArg;
+  
+  for( ; ; ) {
+    /* Claim the next band */
+    if (pthread_mutex_lock(&m_work_lock)) {
+      abort();
+    }
+    b = pj->next;
+    if (b < pj->n) {
+      (pj->next)++;
+    }
+    if (pthread_mutex_unlock(&m_work_lock)) {
+      abort();
+    }
+    
+    /* Stop if no bands are left */
+    if (b >= pj->n) {
+      break;
+    }
+    
+    /* Process the band */
+    (pj->fn)(pj->pArg,
+      (int32_t) ((((int64_t) pj->h) * b) / pj->n),
+      (int32_t) ((((int64_t) pj->h) * (b + 1)) / pj->n));
+  }
+}
+
+/*
+ * Process all the scanlines of a buffer, splitting them into bands
+ * that are processed on the worker pool when the buffer is large enough
+ * to be worth it.
+ * 
+ * row_bytes is the number of bytes that are processed in each
+ * scanline, which determines how many bands are used.  Buffers with
+ * less than PAR_GRAIN bytes per band are split into fewer bands, and
+ * small buffers are processed entirely on the calling thread.  There
+ * are never more bands than the thread limit of the calling thread
+ * (see skvm_threads).  The calling thread processes bands as well, and
+ * bands that no worker thread is free to take are processed on the
+ * calling thread, so this works even when the pool is busy.
+ * 
+ * The split of the scanlines into bands does not depend on which
+ * threads end up processing them.  This function returns only after
+ * all scanlines have been processed.
+ * 
+ * Parameters:
+ * 
+ *   h - the number of scanlines
+ * 
+ *   row_bytes - the number of bytes processed per scanline
+ * 
+ *   fn - the band function
+ * 
+ *   pArg - the job argument to pass to the band function
+ */
+static void par_rows(
+    int32_t   h,
+    size_t    row_bytes,
+    fp_band   fn,
+    void    * pArg) {
+  
+  int32_t n = 0;
+  int32_t i = 0;
+  int32_t limit = 0;
+  size_t total = 0;
+  
+  SKPARJOB job;
+  SKTASK task[SKVM_MAX_THREADS];
+  
+  /* Initialize structures */
+  memset(&job, 0, sizeof(SKPARJOB));
+  
+  /* Check parameters */
+  if ((h < 0) || (fn == NULL)) {
+    abort();
+  }
+  
+  /* Determine how many bands to split the scanlines into */
+  limit = thread_limit();
+  total = ((size_t) h) * row_bytes;
+  if (total / PAR_GRAIN >= (size_t) limit) {
+    n = limit;
+  } else {
+    n = (int32_t) (total / PAR_GRAIN);
+  }
+  if (n > h) {
+    n = h;
+  }
+  
+  /* If there is not enough to split, process everything here */
+  if (n < 2) {
+    fn(pArg, 0, h);
+    return;
+  }
+  
+  /* Start a task for each band except the one this thread takes */
+  work_grow(limit);
+  
+  job.fn = fn;
+  job.pArg = pArg;
+  job.h = h;
+  job.n = n;
+  job.next = 0;
+  
+  for(i = 1; i < n; i++) {
+    task_start(&(task[i]), &par_task, &job);
+  }
+  
+  /* Process bands on this thread too, then wait for the tasks, which
+   * also runs any tasks that no worker thread took */
+  par_task(&job);
+  for(i = 1; i < n; i++) {
+    task_finish(&(task[i]));
+  }
+}
+
+/*
+ * Band function that applies a color lookup.
+ * 
+ * For ARGB, each channel is looked up in its own table.  For RGB, the
+ * alpha table is ignored.  For grayscale, the gray channel is looked up
+ * in the green table.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKLUTJOB
+ * 
+ *   y0 - the first scanline of the band
+ * 
+ *   y1 - one past the last scanline of the band
+ */
+static void lut_band(void *pArg, int32_t y0, int32_t y1) {
+  
+  const SKLUTJOB *pj = NULL;
+  const uint8_t *ps = NULL;
+  const uint8_t *pe = NULL;
+  uint8_t *pd = NULL;
+  const uint8_t *la = NULL;
+  const uint8_t *lr = NULL;
+  const uint8_t *lg = NULL;
+  const uint8_t *lb = NULL;
+  size_t offs = 0;
+  size_t len = 0;
+  
+  /* Check parameters */
+  if (pArg == NULL) {
+    abort();
+  }
+  pj = (const SKLUTJOB *) pArg;
+  
+  /* Get the byte range of the band */
+  offs = ((size_t) y0) * ((size_t) pj->w) * ((size_t) pj->c);
+  len = ((size_t) (y1 - y0)) * ((size_t) pj->w) * ((size_t) pj->c);
+  
+  ps = pj->pSrc + offs;
+  pe = ps + len;
+  pd = pj->pDst + offs;
+  
+  /* Get the individual tables */
+  la = pj->pLut;
+  lr = la + 256;
+  lg = lr + 256;
+  lb = lg + 256;
+  
+  /* Look up all pixels */
+  if (pj->c == 4) {
+    for( ; ps < pe; ps += 4) {
+      pd[0] = la[ps[0]];
+      pd[1] = lr[ps[1]];
+      pd[2] = lg[ps[2]];
+      pd[3] = lb[ps[3]];
+      pd += 4;
+    }
+    
+  } else if (pj->c == 3) {
+    for( ; ps < pe; ps += 3) {
+      pd[0] = lr[ps[0]];
+      pd[1] = lg[ps[1]];
+      pd[2] = lb[ps[2]];
+      pd += 3;
+    }
+    
+  } else if (pj->c == 1) {
+    for( ; ps < pe; ps++) {
+      *pd = lg[*ps];
+      pd++;
+    }
+    
+  } else {
+    abort();
+  }
+}
+
+/*
+ * Convert a color matrix value to fixed point.
+ * 
+ * Parameters:
+ * 
+ *   v - the value
+ * 
+ * Return:
+ * 
+ *   the value in fixed point with CMAT_SHIFT fractional bits
+ */
+static int32_t cmat_fixed(double v) {
+  return (int32_t) floor((v * ((double) (1 << CMAT_SHIFT))) + 0.5);
+}
+
+/*
+ * Round a fixed-point color matrix result and clamp it to a channel
+ * value.
+ * 
+ * Parameters:
+ * 
+ *   v - the fixed-point result
+ * 
+ * Return:
+ * 
+ *   the channel value in range [0, 255]
+ */
+static int cmat_clamp(int32_t v) {
+  
+  if (v <= 0) {
+    return 0;
+  }
+  
+  v = (v + (1 << (CMAT_SHIFT - 1))) >> CMAT_SHIFT;
+  if (v > 255) {
+    v = 255;
+  }
+  
+  return (int) v;
+}
+
+/*
+ * Band function that applies a color matrix in place.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKCMJOB
+ * 
+ *   y0 - the first scanline of the band
+ * 
+ *   y1 - one past the last scanline of the band
+ */
+static void cmat_band(void *pArg, int32_t y0, int32_t y1) {
+  
+  const SKCMJOB *pj = NULL;
+  const int32_t *k = NULL;
+  uint8_t *pd = NULL;
+  uint8_t *pe = NULL;
+  int32_t a = 0;
+  int32_t r = 0;
+  int32_t g = 0;
+  int32_t b = 0;
+  size_t row_bytes = 0;
+  
+  /* Check parameters */
+  if (pArg == NULL) {
+    abort();
+  }
+  pj = (const SKCMJOB *) pArg;
+  k = pj->k;
+  
+  /* Get the byte range of the band */
+  row_bytes = ((size_t) pj->w) * ((size_t) pj->c);
+  pd = pj->pData + (((size_t) y0) * row_bytes);
+  pe = pj->pData + (((size_t) y1) * row_bytes);
+  
+  /* Transform all pixels */
+  if (pj->c == 4) {
+    for( ; pd < pe; pd += 4) {
+      a = pd[0];
+      r = pd[1];
+      g = pd[2];
+      b = pd[3];
+      
+      pd[0] = (uint8_t) cmat_clamp(
+        (k[ 0] * a) + (k[ 1] * r) + (k[ 2] * g) + (k[ 3] * b) + k[ 4]);
+      pd[1] = (uint8_t) cmat_clamp(
+        (k[ 5] * a) + (k[ 6] * r) + (k[ 7] * g) + (k[ 8] * b) + k[ 9]);
+      pd[2] = (uint8_t) cmat_clamp(
+        (k[10] * a) + (k[11] * r) + (k[12] * g) + (k[13] * b) + k[14]);
+      pd[3] = (uint8_t) cmat_clamp(
+        (k[15] * a) + (k[16] * r) + (k[17] * g) + (k[18] * b) + k[19]);
+    }
+    
+  } else if (pj->c == 3) {
+    for( ; pd < pe; pd += 3) {
+      r = pd[0];
+      g = pd[1];
+      b = pd[2];
+      
+      pd[0] = (uint8_t) cmat_clamp(
+        (k[ 0] * r) + (k[ 1] * g) + (k[ 2] * b) + k[ 3]);
+      pd[1] = (uint8_t) cmat_clamp(
+        (k[ 4] * r) + (k[ 5] * g) + (k[ 6] * b) + k[ 7]);
+      pd[2] = (uint8_t) cmat_clamp(
+        (k[ 8] * r) + (k[ 9] * g) + (k[10] * b) + k[11]);
+    }
+    
+  } else {
+    abort();
+  }
+}
+
+/*
+ * Band function that converts pixel data into 16-bit blur data.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKBLURJOB
+ * 
+ *   y0 - the first scanline of the band
+ * 
+ *   y1 - one past the last scanline of the band
+ */
+static void blur_load_band(void *pArg, int32_t y0, int32_t y1) {
+  
+  const SKBLURJOB *pj = NULL;
+  const uint8_t *ps = NULL;
+  const uint8_t *pe = NULL;
+  uint16_t *pd = NULL;
+  uint32_t a = 0;
+  size_t row_len = 0;
+  
+  /* Check parameters */
+  if (pArg == NULL) {
+    abort();
+  }
+  pj = (const SKBLURJOB *) pArg;
+  
+  /* Get the range of the band */
+  row_len = ((size_t) pj->w) * ((size_t) pj->c);
+  ps = pj->pData + (((size_t) y0) * row_len);
+  pe = pj->pData + (((size_t) y1) * row_len);
+  pd = pj->pWork + (((size_t) y0) * row_len);
+  
+  /* Convert the pixels, premultiplying ARGB */
+  if (pj->c == 4) {
+    for( ; ps < pe; ps += 4) {
+      a = ps[0];
+      pd[0] = (uint16_t) (a << 8);
+      pd[1] = (uint16_t) (((((uint32_t) ps[1]) * a) * 256 + 127) / 255);
+      pd[2] = (uint16_t) (((((uint32_t) ps[2]) * a) * 256 + 127) / 255);
+      pd[3] = (uint16_t) (((((uint32_t) ps[3]) * a) * 256 + 127) / 255);
+      pd += 4;
+    }
+    
+  } else {
+    for( ; ps < pe; ps++) {
+      *pd = (uint16_t) (((uint32_t) *ps) << 8);
+      pd++;
+    }
+  }
+}
+
+/*
+ * Band function that converts 16-bit blur data back into pixel data.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKBLURJOB
+ * 
+ *   y0 - the first scanline of the band
+ * 
+ *   y1 - one past the last scanline of the band
+ */
+static void blur_store_band(void *pArg, int32_t y0, int32_t y1) {
+  
+  const SKBLURJOB *pj = NULL;
+  const uint16_t *ps = NULL;
+  const uint16_t *pe = NULL;
+  uint8_t *pd = NULL;
+  uint32_t a = 0;
+  uint32_t v = 0;
+  size_t row_len = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if (pArg == NULL) {
+    abort();
+  }
+  pj = (const SKBLURJOB *) pArg;
+  
+  /* Get the range of the band */
+  row_len = ((size_t) pj->w) * ((size_t) pj->c);
+  ps = pj->pWork + (((size_t) y0) * row_len);
+  pe = pj->pWork + (((size_t) y1) * row_len);
+  pd = pj->pData + (((size_t) y0) * row_len);
+  
+  /* Convert the pixels, undoing premultiplication for ARGB */
+  if (pj->c == 4) {
+    for( ; ps < pe; ps += 4) {
+      a = ps[0];
+      
+      v = (a + 128) >> 8;
+      if (v > 255) {
+        v = 255;
+      }
+      pd[0] = (uint8_t) v;
+      
+      for(i = 1; i < 4; i++) {
+        if (a > 0) {
+          v = ((((uint32_t) ps[i]) * 255) + (a / 2)) / a;
+          if (v > 255) {
+            v = 255;
+          }
+        } else {
+          v = 0;
+        }
+        pd[i] = (uint8_t) v;
+      }
+      
+      pd += 4;
+    }
+    
+  } else {
+    for( ; ps < pe; ps++) {
+      v = (((uint32_t) *ps) + 128) >> 8;
+      if (v > 255) {
+        v = 255;
+      }
+      *pd = (uint8_t) v;
+      pd++;
+    }
+  }
+}
+
+/*
+ * Box blur a single row of 16-bit blur data.
+ * 
+ * Each output pixel is the average of the 2r + 1 input pixels centered
+ * on it, where input pixels beyond the ends of the row are copies of
+ * the end pixels.  A running sum is kept for each channel, so the time
+ * per pixel does not depend on the radius.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the input row
+ * 
+ *   pDst - the output row, which must not overlap the input
+ * 
+ *   n - the number of pixels in the row
+ * 
+ *   c - the number of channels
+ * 
+ *   r - the radius of the box, which must be at least one
+ */
+static void blur_box(
+    const uint16_t  * pSrc,
+          uint16_t  * pDst,
+          int32_t     n,
+          int         c,
+          int32_t     r) {
+  
+  uint32_t sum[4];
+  uint32_t d = 0;
+  int32_t x = 0;
+  int32_t xa = 0;
+  int32_t xr = 0;
+  int32_t k = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if ((pSrc == NULL) || (pDst == NULL) || (n < 1) ||
+      (c < 1) || (c > 4) || (r < 1)) {
+    abort();
+  }
+  
+  /* Get the box width */
+  d = (uint32_t) ((2 * r) + 1);
+  
+  /* Compute the sums of the box around the first pixel */
+  for(i = 0; i < c; i++) {
+    sum[i] = ((uint32_t) (r + 1)) * ((uint32_t) pSrc[i]);
+  }
+  for(k = 1; k <= r; k++) {
+    xa = k;
+    if (xa > n - 1) {
+      xa = n - 1;
+    }
+    for(i = 0; i < c; i++) {
+      sum[i] += (uint32_t) pSrc[(xa * c) + i];
+    }
+  }
+  
+  /* Slide the box along the row */
+  for(x = 0; x < n; x++) {
+    for(i = 0; i < c; i++) {
+      pDst[(x * c) + i] = (uint16_t) ((sum[i] + (d / 2)) / d);
+    }
+    
+    xa = x + r + 1;
+    if (xa > n - 1) {
+      xa = n - 1;
+    }
+    xr = x - r;
+    if (xr < 0) {
+      xr = 0;
+    }
+    
+    for(i = 0; i < c; i++) {
+      sum[i] = sum[i] + ((uint32_t) pSrc[(xa * c) + i])
+                - ((uint32_t) pSrc[(xr * c) + i]);
+    }
+  }
+}
+
+/*
+ * Band function that applies the box blur passes along rows of the
+ * 16-bit blur data in pWork.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKBLURJOB
+ * 
+ *   y0 - the first row of the band
+ * 
+ *   y1 - one past the last row of the band
+ */
+static void blur_rows_band(void *pArg, int32_t y0, int32_t y1) {
+  
+  const SKBLURJOB *pj = NULL;
+  uint16_t *pRow = NULL;
+  uint16_t *pTemp = NULL;
+  uint16_t *pa = NULL;
+  uint16_t *pb = NULL;
+  uint16_t *px = NULL;
+  size_t row_len = 0;
+  int32_t y = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if (pArg == NULL) {
+    abort();
+  }
+  pj = (const SKBLURJOB *) pArg;
+  
+  /* Allocate a temporary row for this band */
+  row_len = ((size_t) pj->w) * ((size_t) pj->c);
+  pTemp = (uint16_t *) malloc(row_len * sizeof(uint16_t));
+  if (pTemp == NULL) {
+    abort();
+  }
+  
+  /* Blur each row, alternating between the row and the temporary
+   * row */
+  for(y = y0; y < y1; y++) {
+    pRow = pj->pWork + (((size_t) y) * row_len);
+    pa = pRow;
+    pb = pTemp;
+    
+    for(i = 0; i < BLUR_PASSES; i++) {
+      if ((pj->r)[i] > 0) {
+        blur_box(pa, pb, pj->w, pj->c, (pj->r)[i]);
+        px = pa;
+        pa = pb;
+        pb = px;
+      }
+    }
+    
+    if (pa != pRow) {
+      memcpy(pRow, pa, row_len * sizeof(uint16_t));
+    }
+  }
+  
+  /* Release the temporary row */
+  free(pTemp);
+}
+
+/*
+ * Band function that transposes the 16-bit blur data in pWork into
+ * pFlip.
+ * 
+ * The band is a range of rows in pFlip, which are columns in pWork.
+ * The data is copied in BLUR_TILE tiles, so that both the reads and the
+ * writes stay within a small number of cache lines.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKBLURJOB
+ * 
+ *   y0 - the first row of the band in pFlip
+ * 
+ *   y1 - one past the last row of the band in pFlip
+ */
+static void blur_flip_band(void *pArg, int32_t y0, int32_t y1) {
+  
+  const SKBLURJOB *pj = NULL;
+  const uint16_t *ps = NULL;
+  uint16_t *pd = NULL;
+  int32_t tx = 0;
+  int32_t ty = 0;
+  int32_t ex = 0;
+  int32_t ey = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if (pArg == NULL) {
+    abort();
+  }
+  pj = (const SKBLURJOB *) pArg;
+  
+  /* Rows y0 to y1 of the output are columns y0 to y1 of the input;
+   * work through tiles of the input */
+  for(ty = 0; ty < pj->h; ty += BLUR_TILE) {
+    ey = ty + BLUR_TILE;
+    if (ey > pj->h) {
+      ey = pj->h;
+    }
+    
+    for(tx = y0; tx < y1; tx += BLUR_TILE) {
+      ex = tx + BLUR_TILE;
+      if (ex > y1) {
+        ex = y1;
+      }
+      
+      for(x = tx; x < ex; x++) {
+        pd = pj->pFlip + (((((size_t) x) * pj->h) + ty) * pj->c);
+        ps = pj->pWork + (((((size_t) ty) * pj->w) + x) * pj->c);
+        for(y = ty; y < ey; y++) {
+          for(i = 0; i < pj->c; i++) {
+            pd[i] = ps[i];
+          }
+          pd += pj->c;
+          ps += ((size_t) pj->w) * pj->c;
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Get a scanline of a loaded buffer as bytes.
+ * 
+ * For a float buffer, the scanline is converted to non-premultiplied
+ * ARGB bytes with float_row() and stored in pConv, which must have
+ * room for four bytes for each pixel.  For other buffers, the pixel
+ * data is returned directly and pConv is ignored.
+ * 
+ * Parameters:
+ * 
+ *   ps - the buffer
+ * 
+ *   y - the scanline
+ * 
+ *   pConv - the conversion scanline for float buffers
+ * 
+ * Return:
+ * 
+ *   the channels of the scanline, ps->c bytes for each pixel
+ */
+static const uint8_t *buf_row(
+    const SKBUF   * ps,
+          int32_t   y,
+          uint8_t * pConv) {
+  
+  /* Check parameters */
+  if ((ps == NULL) || (ps->pData == NULL) || (y < 0) || (y >= ps->h)) {
+    abort();
+  }
+  
+  /* Convert float scanlines, and return other scanlines directly */
+  if (ps->fp) {
+    if (pConv == NULL) {
+      abort();
+    }
+    float_row(ps, y, pConv);
+    return pConv;
+  }
+  return ps->pData + (((size_t) y) * ps->w * ps->c);
+}
+
+/*
+ * Band function that computes channel histograms.
+ * 
+ * The histograms of the band are computed separately and then added
+ * into the histograms of the job while holding its lock.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKSTATJOB
+ * 
+ *   y0 - the first scanline of the band
+ * 
+ *   y1 - one past the last scanline of the band
+ */
+static void stats_band(void *pArg, int32_t y0, int32_t y1) {
+  
+  SKSTATJOB *pj = NULL;
+  const SKBUF *ps = NULL;
+  const uint8_t *pr = NULL;
+  const uint8_t *pe = NULL;
+  uint8_t *pConv = NULL;
+  int32_t y = 0;
+  int k = 0;
+  int v = 0;
+  
+  uint32_t hist[4][256];
+  
+  /* Initialize structures */
+  memset(hist, 0, sizeof(hist));
+  
+  /* Check parameters */
+  if (pArg == NULL) {
+    abort();
+  }
+  pj = (SKSTATJOB *) pArg;
+  ps = pj->pBuf;
+  
+  /* Use the scratch arena for a conversion scanline for float
+   * buffers */
+  if (ps->fp) {
+    pConv = scratch_get(((size_t) ps->w) * 4);
+  }
+  
+  /* Count the channel values of each scanline */
+  for(y = y0; y < y1; y++) {
+    pr = buf_row(ps, y, pConv);
+    pe = pr + (((size_t) ps->w) * ps->c);
+    
+    if (ps->c == 1) {
+      for( ; pr < pe; pr++) {
+        hist[0][pr[0]]++;
+      }
+      
+    } else if (ps->c == 3) {
+      for( ; pr < pe; pr += 3) {
+        hist[0][pr[0]]++;
+        hist[1][pr[1]]++;
+        hist[2][pr[2]]++;
+      }
+      
+    } else if (ps->c == 4) {
+      for( ; pr < pe; pr += 4) {
+        hist[0][pr[0]]++;
+        hist[1][pr[1]]++;
+        hist[2][pr[2]]++;
+        hist[3][pr[3]]++;
+      }
+      
+    } else {
+      /* Shouldn't happen */
+      abort();
+    }
+  }
+  
+  /* Add the histograms into the job */
+  if (pthread_mutex_lock(&(pj->lock))) {
+    abort();
+  }
+  for(k = 0; k < ps->c; k++) {
+    for(v = 0; v < 256; v++) {
+      (pj->hist)[k][v] += hist[k][v];
+    }
+  }
+  if (pthread_mutex_unlock(&(pj->lock))) {
+    abort();
+  }
+}
+
+/*
+ * Band function that compares two buffers.
+ * 
+ * The band is given in rows of SSIM windows rather than scanlines.  For
+ * each window row, the squared error and the SSIM of every window and
+ * channel are summed and stored in the job, along with the largest
+ * difference of each channel.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKCMPJOB
+ * 
+ *   r0 - the first window row of the band
+ * 
+ *   r1 - one past the last window row of the band
+ */
+static void cmp_band(void *pArg, int32_t r0, int32_t r1) {
+  
+  const SKCMPJOB *pj = NULL;
+  const SKBUF *pa = NULL;
+  const SKBUF *pb = NULL;
+  uint8_t *pConv = NULL;
+  size_t row_len = 0;
+  
+  int32_t r = 0;
+  int32_t y0 = 0;
+  int32_t n = 0;
+  int32_t wx = 0;
+  int32_t x0 = 0;
+  int32_t x1 = 0;
+  int32_t i = 0;
+  int32_t j = 0;
+  int c = 0;
+  int k = 0;
+  int32_t d = 0;
+  
+  uint64_t err = 0;
+  uint32_t sa = 0;
+  uint32_t sb = 0;
+  uint32_t saa = 0;
+  uint32_t sbb = 0;
+  uint32_t sab = 0;
+  uint32_t va = 0;
+  uint32_t vb = 0;
+  double ssim = 0.0;
+  double cnt = 0.0;
+  double ma = 0.0;
+  double mb = 0.0;
+  double da = 0.0;
+  double db = 0.0;
+  double cov = 0.0;
+  uint8_t *pm = NULL;
+  
+  const uint8_t *pra[SKVM_SSIM_WIN];
+  const uint8_t *prb[SKVM_SSIM_WIN];
+  
+  /* Check parameters */
+  if (pArg == NULL) {
+    abort();
+  }
+  pj = (const SKCMPJOB *) pArg;
+  pa = pj->pA;
+  pb = pj->pB;
+  c = pa->c;
+  row_len = ((size_t) pa->w) * c;
+  
+  /* Use the scratch arena for conversion scanlines for a window row of
+   * each float buffer */
+  if (pa->fp || pb->fp) {
+    pConv = scratch_get(row_len * SKVM_SSIM_WIN * 2);
+  }
+  
+  for(r = r0; r < r1; r++) {
+    /* Get the scanlines of this window row */
+    y0 = r * SKVM_SSIM_WIN;
+    n = pa->h - y0;
+    if (n > SKVM_SSIM_WIN) {
+      n = SKVM_SSIM_WIN;
+    }
+    for(j = 0; j < n; j++) {
+      if (pConv != NULL) {
+        pra[j] = buf_row(pa, y0 + j, pConv + (row_len * j));
+        prb[j] = buf_row(pb, y0 + j,
+                  pConv + (row_len * (SKVM_SSIM_WIN + j)));
+      } else {
+        pra[j] = buf_row(pa, y0 + j, NULL);
+        prb[j] = buf_row(pb, y0 + j, NULL);
+      }
+    }
+    
+    /* Sum each channel of each window in the row */
+    err = 0;
+    ssim = 0.0;
+    pm = pj->pMax + (((size_t) r) * 4);
+    for(wx = 0; wx < pa->w; wx += SKVM_SSIM_WIN) {
+      x0 = wx * c;
+      x1 = wx + SKVM_SSIM_WIN;
+      if (x1 > pa->w) {
+        x1 = pa->w;
+      }
+      x1 = x1 * c;
+      cnt = (double) ((x1 - x0) / c) * n;
+      
+      for(k = 0; k < c; k++) {
+        sa = 0;
+        sb = 0;
+        saa = 0;
+        sbb = 0;
+        sab = 0;
+        for(j = 0; j < n; j++) {
+          for(i = x0 + k; i < x1; i += c) {
+            va = (pra[j])[i];
+            vb = (prb[j])[i];
+            sa += va;
+            sb += vb;
+            saa += va * va;
+            sbb += vb * vb;
+            sab += va * vb;
+            if (va > vb) {
+              if (va - vb > pm[k]) {
+                pm[k] = (uint8_t) (va - vb);
+              }
+            } else if (vb - va > pm[k]) {
+              pm[k] = (uint8_t) (vb - va);
+            }
+          }
+        }
+        
+        /* The squared error follows from the sums */
+        d = (int32_t) (saa + sbb - (2 * sab));
+        err += (uint64_t) d;
+        
+        /* Structural similarity of this window */
+        ma = ((double) sa) / cnt;
+        mb = ((double) sb) / cnt;
+        da = (((double) saa) / cnt) - (ma * ma);
+        db = (((double) sbb) / cnt) - (mb * mb);
+        cov = (((double) sab) / cnt) - (ma * mb);
+        ssim += (((2.0 * ma * mb) + SSIM_C1) *
+                  ((2.0 * cov) + SSIM_C2)) /
+                (((ma * ma) + (mb * mb) + SSIM_C1) *
+                  (da + db + SSIM_C2));
+      }
+    }
+    
+    /* Record the sums of this window row */
+    (pj->pErr)[r] = err;
+    (pj->pSsim)[r] = ssim;
+  }
+}
+
+/*
+ * Get the current version of a file.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the file
+ * 
+ *   pst - receives the version of the file
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the file could not be queried
+ */
+static int file_stamp(const char *pPath, SKSTAMP *pst) {
+  
+  int status = 1;
+  struct stat st;
+  
+  /* Initialize structures */
+  memset(&st, 0, sizeof(struct stat));
+  
+  /* Check parameters */
+  if ((pPath == NULL) || (pst == NULL)) {
+    abort();
+  }
+  
+  /* Query the file */
+  if (stat(pPath, &st)) {
+    status = 0;
+  }
+  
+  /* Return the requested information */
+  if (status) {
+    memset(pst, 0, sizeof(SKSTAMP));
+    pst->size = st.st_size;
+    pst->mtime = st.st_mtim.tv_sec;
+    pst->mtime_ns = (long) st.st_mtim.tv_nsec;
+    pst->dev = st.st_dev;
+    pst->ino = st.st_ino;
+  }
+  
+  return status;
+}
+
+/*
+ * Check whether two file versions are the same.
+ * 
+ * Parameters:
+ * 
+ *   pa - the first version
+ * 
+ *   pb - the second version
+ * 
+ * Return:
+ * 
+ *   non-zero if the versions are the same, zero if the file changed
+ */
+static int stamp_equal(const SKSTAMP *pa, const SKSTAMP *pb) {
+  
+  /* Check parameters */
+  if ((pa == NULL) || (pb == NULL)) {
+    abort();
+  }
+  
+  return ((pa->size == pb->size) &&
+          (pa->mtime == pb->mtime) &&
+          (pa->mtime_ns == pb->mtime_ns) &&
+          (pa->dev == pb->dev) &&
+          (pa->ino == pb->ino));
+}
+
+/*
+ * Remove an entry from the asset cache.
+ * 
+ * The last entry in the cache is moved into the vacated slot.  The
+ * caller must hold m_warm_lock.  Buffer registers that are sharing the
+ * pixel data of the entry keep their own references to it.
+ * 
+ * Parameters:
+ * 
+ *   i - the index of the entry to remove
+ */
+static void asset_evict(int32_t i) {
+  
+  SKASSET *pa = NULL;
+  
+  /* Check parameter */
+  if ((i < 0) || (i >= m_asset_count)) {
+    abort();
+  }
+  
+  /* Release the entry */
+  pa = &(m_asset[i]);
+  if (pa->pShare != NULL) {
+    m_asset_bytes -= ((size_t) pa->w) * ((size_t) pa->h) *
+                        ((size_t) pa->c);
+    share_drop(pa->pShare);
+    pa->pShare = NULL;
+  }
+  free(pa->pPath);
+  
+  /* Fill the slot with the last entry */
+  m_asset_count--;
+  if (i < m_asset_count) {
+    memcpy(pa, &(m_asset[m_asset_count]), sizeof(SKASSET));
+  }
+  memset(&(m_asset[m_asset_count]), 0, sizeof(SKASSET));
+}
+
+/*
+ * Find the least recently used asset cache entry that is not pending.
+ * 
+ * The caller must hold m_warm_lock.
+ * 
+ * Return:
+ * 
+ *   the index of the entry, or -1 if there are no such entries
+ */
+static int32_t asset_lru(void) {
+  
+  int32_t i = 0;
+  int32_t lru = -1;
+  
+  for(i = 0; i < m_asset_count; i++) {
+    if ((m_asset[i]).pShare != NULL) {
+      if (lru < 0) {
+        lru = i;
+      } else if ((m_asset[i]).stamp < (m_asset[lru]).stamp) {
+        lru = i;
+      }
+    }
+  }
+  
+  return lru;
+}
+
+/*
+ * Find the asset cache entry for a given image.
+ * 
+ * The caller must hold m_warm_lock.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path of the image
+ * 
+ *   frame - the Motion-JPEG frame, or -1
+ * 
+ * Return:
+ * 
+ *   the index of the entry, or -1 if there is no such entry
+ */
+static int32_t asset_find(const char *pPath, int32_t frame) {
+  
+  int32_t i = 0;
+  int32_t result = -1;
+  
+  for(i = 0; i < m_asset_count; i++) {
+    if (((m_asset[i]).frame == frame) &&
+        (strcmp((m_asset[i]).pPath, pPath) == 0)) {
+      result = i;
+      break;
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Load a buffer register from the asset cache.
+ * 
+ * The cache entry must match the path, frame, and file version, as well
+ * as the dimensions and channel count of the buffer register.  A cache entry for the same image that is stale or
+ * has a different format is evicted.  If another context is currently
+ * decoding the same image, this function waits for it to finish.
+ * 
+ * If there is a matching cache entry, any pixel data the buffer
+ * register has is released, and the buffer register is set to share
+ * the cached pixel data.
+ * 
+ * If there is no matching cache entry, a pending entry is added and the
+ * caller must decode the image itself.  Afterwards, the caller must
+ * call asset_store() if decoding succeeded or asset_abandon() if
+ * decoding failed, so that other contexts waiting on the pending entry
+ * can proceed.
+ * 
+ * Parameters:
+ * 
+ *   ps - the buffer register to load
+ * 
+ *   pPath - the path of the image
+ * 
+ *   frame - the Motion-JPEG frame, or -1
+ * 
+ *   pfst - the current version of the image file
+ * 
+ * Return:
+ * 
+ *   non-zero if the buffer was loaded from the cache, zero if the
+ *   caller must decode the image
+ */
+static int asset_fetch(
+          SKBUF   * ps,
+    const char    * pPath,
+          int32_t   frame,
+    const SKSTAMP * pfst) {
+  
+  int32_t i = 0;
+  SKASSET *pa = NULL;
+  SKSHARE *psh = NULL;
+  
+  /* Check parameters */
+  if ((ps == NULL) || (pPath == NULL) || (pfst == NULL)) {
+    abort();
+  }
+  
+  /* Look for an entry with the same path and frame, waiting while it
+   * is pending */
+  if (pthread_mutex_lock(&m_warm_lock)) {
+    abort();
+  }
+  for(i = asset_find(pPath, frame);
+      i >= 0;
+      i = asset_find(pPath, frame)) {
+    pa = &(m_asset[i]);
+    if ((pa->pShare != NULL) && (!stamp_equal(&(pa->fst), pfst))) {
+      /* File has changed since the entry was made, so evict it; a
+       * pending entry is waited on first, because evicting it would
+       * let its decoder resolve the pending entry added below */
+      asset_evict(i);
+      
+    } else if (pa->pShare == NULL) {
+      /* Another context is decoding the image, so wait for it */
+      if (pthread_cond_wait(&m_warm_cond, &m_warm_lock)) {
+        abort();
+      }
+      
+    } else if ((pa->w == ps->w) && (pa->h == ps->h) &&
+                (pa->c == ps->c)) {
+      /* Hit, so take a reference to the shared pixel data */
+      psh = pa->pShare;
+      psh->refs++;
+      m_use++;
+      pa->stamp = m_use;
+      break;
+      
+    } else {
+      /* Different format, so evict the entry */
+      asset_evict(i);
+    }
+  }
+  
+  /* If there was no hit, add a pending entry, making room if
+   * necessary */
+  if (psh == NULL) {
+    if (m_asset_count >= ASSET_MAX_COUNT) {
+      i = asset_lru();
+      if (i >= 0) {
+        asset_evict(i);
+      }
+    }
+    if (m_asset_count < ASSET_MAX_COUNT) {
+      pa = &(m_asset[m_asset_count]);
+      memset(pa, 0, sizeof(SKASSET));
+      
+      pa->pPath = (char *) malloc(strlen(pPath) + 1);
+      if (pa->pPath == NULL) {
+        abort();
+      }
+      strcpy(pa->pPath, pPath);
+      
+      pa->frame = frame;
+      pa->w = ps->w;
+      pa->h = ps->h;
+      pa->c = ps->c;
+      memcpy(&(pa->fst), pfst, sizeof(SKSTAMP));
+      pa->stale = 0;
+      pa->pShare = NULL;
+      
+      m_use++;
+      pa->stamp = m_use;
+      
+      m_asset_count++;
+    }
+  }
+  
+  if (pthread_mutex_unlock(&m_warm_lock)) {
+    abort();
+  }
+  
+  /* If there was a hit, replace any pixel data of the buffer register
+   * with the shared pixel data */
+  if (psh != NULL) {
+    buf_release(ps);
+    ps->pData = psh->pData;
+    ps->pShare = psh;
+  }
+  
+  return (psh != NULL);
+}
+
+/*
+ * Store a freshly decoded buffer register in the asset cache.
+ * 
+ * This resolves the pending entry added by asset_fetch().  The pixel
+ * data of the buffer register becomes shared between the buffer
+ * register and the cache, so no copy is made.
+ * 
+ * Least recently used entries are evicted as necessary to stay within
+ * the cache limits.  Images too large to fit in the cache are not
+ * stored, and neither are images whose pending entry was evicted in
+ * the meantime or that were made stale by asset_forget().
+ * 
+ * Parameters:
+ * 
+ *   ps - the decoded buffer register, with private pixel data
+ * 
+ *   pPath - the path of the image
+ * 
+ *   frame - the Motion-JPEG frame, or -1
+ */
+static void asset_store(
+    SKBUF       * ps,
+    const char  * pPath,
+    int32_t       frame) {
+  
+  int32_t i = 0;
+  int32_t lru = 0;
+  size_t len = 0;
+  SKASSET *pa = NULL;
+  SKSHARE *psh = NULL;
+  
+  /* Check parameters */
+  if ((ps == NULL) || (pPath == NULL)) {
+    abort();
+  }
+  if ((ps->pData == NULL) || (ps->pShare != NULL)) {
+    abort();
+  }
+  
+  /* Get the size */
+  len = buf_size(ps);
+  
+  if (pthread_mutex_lock(&m_warm_lock)) {
+    abort();
+  }
+  
+  /* Evict least recently used entries until there is room, unless the
+   * image would take up more than a quarter of the cache */
+  if (len <= ASSET_MAX_BYTES / 4) {
+    while (len > ASSET_MAX_BYTES - m_asset_bytes) {
+      lru = asset_lru();
+      if (lru < 0) {
+        break;
+      }
+      asset_evict(lru);
+    }
+  }
+  
+  /* Find the pending entry */
+  i = asset_find(pPath, frame);
+  if (i >= 0) {
+    pa = &(m_asset[i]);
+    if (pa->pShare != NULL) {
+      pa = NULL;
+    }
+  }
+  
+  /* Resolve the pending entry, either by sharing the decoded pixel data
+   * with it or by removing it if there is no room or the file was
+   * stored to while it was being decoded */
+  if (pa != NULL) {
+    if ((!(pa->stale)) &&
+        (len <= ASSET_MAX_BYTES / 4) &&
+        (len <= ASSET_MAX_BYTES - m_asset_bytes) &&
+        (pa->w == ps->w) && (pa->h == ps->h) && (pa->c == ps->c)) {
+      psh = (SKSHARE *) malloc(sizeof(SKSHARE));
+      if (psh == NULL) {
+        abort();
+      }
+      psh->pData = ps->pData;
+      psh->refs = 2;
+      
+      ps->pShare = psh;
+      pa->pShare = psh;
+      
+      m_use++;
+      pa->stamp = m_use;
+      m_asset_bytes += len;
+      
+    } else {
+      asset_evict(i);
+    }
+  }
+  
+  /* Wake up any contexts waiting on the pending entry */
+  if (pthread_cond_broadcast(&m_warm_cond)) {
+    abort();
+  }
+  
+  if (pthread_mutex_unlock(&m_warm_lock)) {
+    abort();
+  }
+}
+
+/*
+ * Remove the pending entry added by asset_fetch() after decoding the
+ * image failed.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path of the image
+ * 
+ *   frame - the Motion-JPEG frame, or -1
+ */
+static void asset_abandon(const char *pPath, int32_t frame) {
+  
+  int32_t i = 0;
+  
+  /* Check parameters */
+  if (pPath == NULL) {
+    abort();
+  }
+  
+  if (pthread_mutex_lock(&m_warm_lock)) {
+    abort();
+  }
+  
+  /* Remove the pending entry if it is still there */
+  i = asset_find(pPath, frame);
+  if (i >= 0) {
+    if ((m_asset[i]).pShare == NULL) {
+      asset_evict(i);
+    }
+  }
+  
+  /* Wake up any contexts waiting on the pending entry */
+  if (pthread_cond_broadcast(&m_warm_cond)) {
+    abort();
+  }
+  
+  if (pthread_mutex_unlock(&m_warm_lock)) {
+    abort();
+  }
+}
+
+/*
+ * Drop every asset cache entry for a given path, because a store to
+ * that path is about to change the file.
+ * 
+ * File versions alone can not be relied on to notice the change, since
+ * some file systems only record modification times to the second.
+ * Pending entries can not be removed while another context is decoding
+ * them, so they are marked stale instead, and asset_store() then drops
+ * them rather than caching what may be the old image.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path that is stored to
+ */
+static void asset_forget(const char *pPath) {
+  
+  int32_t i = 0;
+  
+  /* Check parameters */
+  if (pPath == NULL) {
+    abort();
+  }
+  
+  if (pthread_mutex_lock(&m_warm_lock)) {
+    abort();
+  }
+  
+  /* Evict every decoded entry for the path and mark pending ones, going
+   * backwards because evicting moves the last entry into the slot */
+  for(i = m_asset_count - 1; i >= 0; i--) {
+    if (strcmp((m_asset[i]).pPath, pPath) == 0) {
+      if ((m_asset[i]).pShare != NULL) {
+        asset_evict(i);
+      } else {
+        (m_asset[i]).stale = 1;
+      }
+    }
+  }
+  
+  if (pthread_mutex_unlock(&m_warm_lock)) {
+    abort();
+  }
+}
+
+/*
+ * Close an open Motion-JPEG sequence.
+ * 
+ * The last open sequence is moved into the vacated slot.  The caller
+ * must hold m_warm_lock.
+ * 
+ * Parameters:
+ * 
+ *   i - the index of the open sequence to close
+ */
+static void mjpg_close(int32_t i) {
+  
+  SKMJPG *pm = NULL;
+  
+  /* Check parameter */
+  if ((i < 0) || (i >= m_mjpg_count)) {
+    abort();
+  }
+  
+  /* Release the sequence */
+  pm = &(m_mjpg[i]);
+  free(pm->pIndexPath);
+  if (pm->pOffs != NULL) {
+    free(pm->pOffs);
+  }
+  if (pm->pf != NULL) {
+    fclose(pm->pf);
+  }
+  
+  /* Fill the slot with the last sequence */
+  m_mjpg_count--;
+  if (i < m_mjpg_count) {
+    memcpy(pm, &(m_mjpg[m_mjpg_count]), sizeof(SKMJPG));
+  }
+  memset(&(m_mjpg[m_mjpg_count]), 0, sizeof(SKMJPG));
+}
+
+/*
+ * Get an open Motion-JPEG sequence, opening it if necessary.
+ * 
+ * If the sequence is already open and neither its index file nor its
+ * raw Motion-JPEG file has changed, the open sequence is returned.
+ * Otherwise, the index file is read in its entirety and the raw
+ * Motion-JPEG file is opened.  The least recently used sequence is
+ * closed if there are too many open.  The caller must hold
+ * m_warm_lock.
+ * 
+ * If this function fails, the error message of the context is set.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   pIndexPath - the path to the index file
+ * 
+ *   pJPEGPath - the path to the raw Motion-JPEG file
+ * 
+ * Return:
+ * 
+ *   the open sequence, or NULL if it could not be opened
+ */
+static SKMJPG *mjpg_source(
+    SKVM_CTX    * pv,
+    const char  * pIndexPath,
+    const char  * pJPEGPath) {
+  
+  int status = 1;
+  int c = 0;
+  int32_t i = 0;
+  int32_t lru = 0;
+  uint64_t total_frames = 0;
+  uint64_t v = 0;
+  
+  FILE *pIndex = NULL;
+  SKMJPG *pm = NULL;
+  SKMJPG ms;
+  SKSTAMP ist;
+  SKSTAMP dst;
+  
+  /* Initialize structures */
+  memset(&ms, 0, sizeof(SKMJPG));
+  memset(&ist, 0, sizeof(SKSTAMP));
+  memset(&dst, 0, sizeof(SKSTAMP));
+  
+  /* Check parameters */
+  if ((pv == NULL) || (pIndexPath == NULL) || (pJPEGPath == NULL)) {
+    abort();
+  }
+  
+  /* Get the current state of both files */
+  if (!file_stamp(pIndexPath, &ist)) {
+    status = 0;
+    pv->pErr = "Failed to open index file";
+  }
+  if (status) {
+    if (!file_stamp(pJPEGPath, &dst)) {
+      status = 0;
+      pv->pErr = "Failed to open JPEG file";
+    }
+  }
+  
+  /* Look for the sequence among the open sequences, closing it if it
+   * has changed */
+  if (status) {
+    for(i = 0; i < m_mjpg_count; i++) {
+      if (strcmp((m_mjpg[i]).pIndexPath, pIndexPath) == 0) {
+        if (stamp_equal(&((m_mjpg[i]).ist), &ist) &&
+            stamp_equal(&((m_mjpg[i]).dst), &dst)) {
+          pm = &(m_mjpg[i]);
+        } else {
+          mjpg_close(i);
+        }
+        break;
+      }
+    }
+  }
+  
+  /* If we found an open sequence, update its use and return it */
+  if (status && (pm != NULL)) {
+    m_use++;
+    pm->stamp = m_use;
+    return pm;
+  }
+  
+  /* Open the index file */
+  if (status) {
+    pIndex = fopen(pIndexPath, "rb");
+    if (pIndex == NULL) {
+      status = 0;
+      pv->pErr = "Failed to open index file";
+    }
+  }
+  
+  /* Read the frame count as a big-endian integer and check that the
+   * frame offsets can be held in memory */
+  if (status) {
+    for(i = 0; i < 8; i++) {
+      c = getc(pIndex);
+      if (c == EOF) {
+        status = 0;
+        pv->pErr = "Invalid index file";
+        break;
+      }
+      total_frames = (total_frames << 8) | ((uint64_t) c);
+    }
+  }
+  if (status && (total_frames > INT32_MAX)) {
+    status = 0;
+    pv->pErr = "Invalid index file";
+  }
+  
+  /* Read all the frame offsets */
+  if (status && (total_frames > 0)) {
+    ms.pOffs = (uint64_t *) calloc(
+                  (size_t) total_frames, sizeof(uint64_t));
+    if (ms.pOffs == NULL) {
+      abort();
+    }
+  }
+  if (status) {
+    ms.count = (int32_t) total_frames;
+    for(i = 0; i < ms.count; i++) {
+      v = 0;
+      for(c = 0; c < 8; c++) {
+        lru = getc(pIndex);
+        if (lru == EOF) {
+          status = 0;
+          pv->pErr = "Invalid index file";
+          break;
+        }
+        v = (v << 8) | ((uint64_t) lru);
+      }
+      if (!status) {
+        break;
+      }
+      
+      /* If the offset is beyond signed 32-bit range, make sure off_t
+       * is eight bytes, indicating 64-bit file mode */
+      if ((v > INT32_MAX) && (sizeof(off_t) < 8)) {
+        status = 0;
+        pv->pErr = "64-bit file mode required";
+        break;
+      }
+      
+      (ms.pOffs)[i] = v;
+    }
+  }
+  
+  /* Close the index file */
+  if (pIndex != NULL) {
+    fclose(pIndex);
+    pIndex = NULL;
+  }
+  
+  /* Open the raw Motion-JPEG file */
+  if (status) {
+    ms.pf = fopen(pJPEGPath, "rb");
+    if (ms.pf == NULL) {
+      status = 0;
+      pv->pErr = "Failed to open JPEG file";
+    }
+  }
+  
+  /* Copy the index path */
+  if (status) {
+    ms.pIndexPath = (char *) malloc(strlen(pIndexPath) + 1);
+    if (ms.pIndexPath == NULL) {
+      abort();
+    }
+    strcpy(ms.pIndexPath, pIndexPath);
+  }
+  
+  /* Close the least recently used sequence if there are too many open,
+   * and then add the new sequence */
+  if (status) {
+    if (m_mjpg_count >= MJPG_MAX_COUNT) {
+      lru = 0;
+      for(i = 1; i < m_mjpg_count; i++) {
+        if ((m_mjpg[i]).stamp < (m_mjpg[lru]).stamp) {
+          lru = i;
+        }
+      }
+      mjpg_close(lru);
+    }
+    
+    memcpy(&(ms.ist), &ist, sizeof(SKSTAMP));
+    memcpy(&(ms.dst), &dst, sizeof(SKSTAMP));
+    
+    m_use++;
+    ms.stamp = m_use;
+    
+    pm = &(m_mjpg[m_mjpg_count]);
+    memcpy(pm, &ms, sizeof(SKMJPG));
+    m_mjpg_count++;
+  }
+  
+  /* Clean up on failure */
+  if (!status) {
+    if (ms.pOffs != NULL) {
+      free(ms.pOffs);
+      ms.pOffs = NULL;
+    }
+    if (ms.pf != NULL) {
+      fclose(ms.pf);
+      ms.pf = NULL;
+    }
+    pm = NULL;
+  }
+  
+  /* Return the sequence */
+  return pm;
+}
+
+/*
+ * Look up a frame of a Motion-JPEG sequence in warm state.
+ * 
+ * The sequence is opened with mjpg_source() if necessary.  The frame
+ * index f is checked against the frame count of the sequence, and then
+ * the byte offset of the frame and the version of the raw Motion-JPEG
+ * file are returned.
+ * 
+ * The open file handle of the sequence is also checked out and returned
+ * in *ppf, so that it can not be used by any other context until it is
+ * given back with mjpg_return().  If another context already has the
+ * file handle checked out, *ppf is set to NULL and the caller should
+ * open the raw Motion-JPEG file itself.
+ * 
+ * If this function fails, the error message of the context is set.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   pIndexPath - the path to the index file
+ * 
+ *   pJPEGPath - the path to the raw Motion-JPEG file
+ * 
+ *   f - the frame index
+ * 
+ *   poffs - receives the byte offset of the frame
+ * 
+ *   pdst - receives the version of the raw Motion-JPEG file
+ * 
+ *   ppf - receives the checked-out file handle or NULL
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int mjpg_frame(
+    SKVM_CTX    * pv,
+    const char  * pIndexPath,
+    const char  * pJPEGPath,
+    int32_t       f,
+    uint64_t    * poffs,
+    SKSTAMP     * pdst,
+    FILE       ** ppf) {
+  
+  int status = 1;
+  SKMJPG *pm = NULL;
+  
+  /* Check parameters */
+  if ((pv == NULL) || (pIndexPath == NULL) || (pJPEGPath == NULL) ||
+      (poffs == NULL) || (pdst == NULL) || (ppf == NULL)) {
+    abort();
+  }
+  
+  /* Get the sequence */
+  if (pthread_mutex_lock(&m_warm_lock)) {
+    abort();
+  }
+  pm = mjpg_source(pv, pIndexPath, pJPEGPath);
+  if (pm == NULL) {
+    status = 0;
+  }
+  
+  /* Check the frame index */
+  if (status) {
+    if ((f < 0) || (f >= pm->count)) {
+      status = 0;
+      pv->pErr = "Invalid frame index";
+    }
+  }
+  
+  /* Return the frame information and check out the file handle */
+  if (status) {
+    *poffs = (pm->pOffs)[f];
+    memcpy(pdst, &(pm->dst), sizeof(SKSTAMP));
+    *ppf = pm->pf;
+    pm->pf = NULL;
+  }
+  
+  if (pthread_mutex_unlock(&m_warm_lock)) {
+    abort();
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Give back a file handle checked out with mjpg_frame().
+ * 
+ * If the sequence is still open, hasn't changed, and doesn't have a
+ * file handle, the file handle is returned to it.  Otherwise, the file
+ * handle is closed.
+ * 
+ * Parameters:
+ * 
+ *   pIndexPath - the path to the index file
+ * 
+ *   pf - the file handle
+ * 
+ *   pdst - the version of the raw Motion-JPEG file when checked out
+ */
+static void mjpg_return(
+    const char    * pIndexPath,
+          FILE    * pf,
+    const SKSTAMP * pdst) {
+  
+  int32_t i = 0;
+  SKMJPG *pm = NULL;
+  
+  /* Check parameters */
+  if ((pIndexPath == NULL) || (pf == NULL) || (pdst == NULL)) {
+    abort();
+  }
+  
+  /* Find the sequence */
+  if (pthread_mutex_lock(&m_warm_lock)) {
+    abort();
+  }
+  for(i = 0; i < m_mjpg_count; i++) {
+    if (strcmp((m_mjpg[i]).pIndexPath, pIndexPath) == 0) {
+      if (stamp_equal(&((m_mjpg[i]).dst), pdst) &&
+          ((m_mjpg[i]).pf == NULL)) {
+        pm = &(m_mjpg[i]);
+      }
+      break;
+    }
+  }
+  
+  /* Give the file handle back if possible */
+  if (pm != NULL) {
+    pm->pf = pf;
+    pf = NULL;
+  }
+  
+  if (pthread_mutex_unlock(&m_warm_lock)) {
+    abort();
+  }
+  
+  /* Close the file handle if it wasn't given back */
+  if (pf != NULL) {
+    fclose(pf);
+    pf = NULL;
+  }
+}
+
+/*
+ * Decode a JPEG image from a file into a buffer register.
+ * 
+ * The buffer register must already have pixel data allocated.  pf must
+ * be positioned at the start of the JPEG image.  The JPEG image must
+ * have the same dimensions as the buffer register, but the channel
+ * count is automatically converted.
+ * 
+ * If this function fails, the error message of the context is set and
+ * the buffer contents are undefined.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   ps - the buffer register to load
+ * 
+ *   pf - the file to read the JPEG image from
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int jpeg_decode(SKVM_CTX *pv, SKBUF *ps, FILE *pf) {
+  
+  int status = 1;
+  int32_t x = 0;
+  int32_t y = 0;
+  int src_c = 0;
+  
+  SPH_JPEG_READER *pr = NULL;
+  
+  uint8_t *pi = NULL;
+  uint8_t *pj = NULL;
+  uint8_t *psl = NULL;
+  
+  SPH_ARGB argb;
+  
+  /* Initialize structures */
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  
+  /* Check parameters */
+  if ((pv == NULL) || (ps == NULL) || (pf == NULL)) {
+    abort();
+  }
+  if (ps->pData == NULL) {
+    abort();
+  }
+  
+  /* Allocate JPEG reader on file */
+  pr = sph_jpeg_reader_new(pf);
+  if (sph_jpeg_reader_status(pr) != SPH_JPEG_ERR_OK) {
+    status = 0;
+    pv->pErr = sph_jpeg_errstr(sph_jpeg_reader_status(pr));
+  }
+  
+  /* Make sure dimensions of JPEG image match dimensions of buffer */
+  if (status) {
+    if ((ps->w != sph_jpeg_reader_width(pr)) ||
+        (ps->h != sph_jpeg_reader_height(pr))) {
+      status = 0;
+      pv->pErr = "JPEG file mismatches dimensions of buffer";
+    }
+  }
+  
+  /* Get the JPEG channel count */
+  if (status) {
+    src_c = sph_jpeg_reader_channels(pr);
+  }
+  
+  /* Allocate scanline buffer */
+  if (status) {
+    psl = (uint8_t *) calloc((size_t) ps->w, (size_t) src_c);
+    if (psl == NULL) {
+      abort();
+    }
+  }
+  
+  /* Read each scanline into the buffer */
+  if (status) {
+    pi = ps->pData;
+    for(y = 0; y < ps->h; y++) {
+      /* Read a scanline */
+      if (!sph_jpeg_reader_get(pr, psl)) {
+        status = 0;
+        pv->pErr = sph_jpeg_errstr(sph_jpeg_reader_status(pr));
+      }
+      
+      /* Transfer each pixel into the buffer */
+      if (status) {
+        pj = psl;
+        for(x = 0; x < ps->w; x++) {
+          /* Transfer appropriately */
+          if (ps->c == 4) {
+            if (src_c == 3) {
+              /* Expand RGB->ARGB */
+              pi[0] = (uint8_t) 255;
+              pi[1] = pj[0];
+              pi[2] = pj[1];
+              pi[3] = pj[2];
+              
+              pi += 4;
+              pj += 3;
+              
+            } else if (src_c == 1) {
+              /* Expand gray->ARGB */
+              pi[0] = (uint8_t) 255;
+              pi[1] = *pj;
+              pi[2] = *pj;
+              pi[3] = *pj;
+              
+              pi += 4;
+              pj++;
+              
+            } else {
+              /* Shouldn't happen */
+              abort();
+            }
+            
+          } else if (ps->c == 3) {
+            if (src_c == 3) {
+              /* RGB -> RGB */
+              pi[0] = pj[0];
+              pi[1] = pj[1];
+              pi[2] = pj[2];
+              
+              pi += 3;
+              pj += 3;
+              
+            } else if (src_c == 1) {
+              /* Expand gray->RGB */
+              pi[0] = *pj;
+              pi[1] = *pj;
+              pi[2] = *pj;
+              
+              pi += 3;
+              pj++;
+              
+            } else {
+              /* Shouldn't happen */
+              abort();
+            }
+            
+          } else if (ps->c == 1) {
+            if (src_c == 3) {
+              /* Downconvert RGB->gray */
+              argb.a = 255;
+              argb.r = pj[0];
+              argb.g = pj[1];
+              argb.b = pj[2];
+              sph_argb_downGray(&argb);
+              
+              *pi = (uint8_t) argb.g;
+              
+              pi++;
+              pj += 3;
+              
+            } else if (src_c == 1) {
+              /* Gray -> gray */
+              *pi = *pj;
+              
+              pi++;
+              pj++;
+              
+            } else {
+              /* Shouldn't happen */
+              abort();
+            }
+            
+          } else {
+            /* Shouldn't happen */
+            abort();
+          }
+        }
+      }
+      
+      /* Leave loop if error */
+      if (!status) {
+        break;
+      }
+    }
+  }
+  
+  /* Release scanline buffer if allocated */
+  if (psl != NULL) {
+    free(psl);
+    psl = NULL;
+  }
+  
+  /* Release image reader object */
+  sph_jpeg_reader_free(pr);
+  pr = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Encode the pixel data of a buffer register into a PNG file.
+ * 
+ * The buffer register must be loaded and may not have a pending color
+ * lookup.  Its pixel data is only read, so this may run on a worker
+ * thread while other threads read the same pixel data.
+ * 
+ * Parameters:
+ * 
+ *   ps - the buffer register to store
+ * 
+ *   pPath - path to the PNG file to store to
+ * 
+ * Return:
+ * 
+ *   NULL if successful, or else the error message
+ */
+static const char *encode_png(const SKBUF *ps, const char *pPath) {
+  
+  int errn = 0;
+  int dconv = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  const char *pErr = NULL;
+  
+  SPH_IMAGE_WRITER *pw = NULL;
+  uint32_t *psl = NULL;
+  const uint8_t *pi = NULL;
+  uint8_t *pRow = NULL;
+  uint32_t *pj = NULL;
+  
+  SPH_ARGB argb;
+  
+  /* Initialize structures */
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  
+  /* Check parameters */
+  if ((ps == NULL) || (pPath == NULL)) {
+    abort();
+  }
+  if ((ps->pData == NULL) || ps->lut_pending) {
+    abort();
+  }
+  
+  /* Based on number of channels, determine down-conversion setting */
+  if (ps->c == 4) {
+    /* ARGB buffer, so no down-conversion */
+    dconv = SPH_IMAGE_DOWN_NONE;
+    
+  } else if (ps->c == 3) {
+    /* RGB buffer, so RGB down-conversion */
+    dconv = SPH_IMAGE_DOWN_RGB;
+    
+  } else if (ps->c == 1) {
+    /* Grayscale buffer, so grayscale down-conversion */
+    dconv = SPH_IMAGE_DOWN_GRAY;
+    
+  } else {
+    /* Shouldn't happen */
+    abort();
+  }
+  
+  /* Create the writer object */
+  pw = sph_image_writer_newFromPath(
+        pPath, ps->w, ps->h, dconv, 0, &errn);
+  if (pw == NULL) {
+    pErr = sph_image_errorString(errn);
+  }
+  
+  /* Get the scanline buffer */
+  if (pErr == NULL) {
+    psl = sph_image_writer_ptr(pw);
+  }
+  
+  /* For a float buffer, allocate a scanline of ARGB bytes to convert
+   * each scanline into */
+  if ((pErr == NULL) && ps->fp) {
+    pRow = (uint8_t *) calloc((size_t) ps->w, 4);
+    if (pRow == NULL) {
+      abort();
+    }
+  }
+  
+  /* Write each scanline */
+  if (pErr == NULL) {
+    pi = ps->pData;
+    for(y = 0; y < ps->h; y++) {
+      /* Convert a float scanline to ARGB */
+      if (ps->fp) {
+        float_row(ps, y, pRow);
+        pi = pRow;
+      }
+      
+      /* Write all data to the scanline */
+      pj = psl;
+      for(x = 0; x < ps->w; x++) {
+        /* Fill the ARGB structure */
+        if (ps->c == 4) {
+          argb.a = pi[0];
+          argb.r = pi[1];
+          argb.g = pi[2];
+          argb.b = pi[3];
+          
+          pi += 4;
+          
+        } else if (ps->c == 3) {
+          argb.a = 255;
+          argb.r = pi[0];
+          argb.g = pi[1];
+          argb.b = pi[2];
+          
+          pi += 3;
+          
+        } else if (ps->c == 1) {
+          argb.a = 255;
+          argb.r = *pi;
+          argb.g = *pi;
+          argb.b = *pi;
+          
+          pi++;
+          
+        } else {
+          /* Shouldn't happen */
+          abort();
+        }
+        
+        /* Write the packed color */
+        *pj = sph_argb_pack(&argb);
+        pj++;
+      }
+      
+      /* Write the scanline to the file */
+      sph_image_writer_write(pw);
+    }
+  }
+  
+  /* Free writer if allocated */
+  sph_image_writer_close(pw);
+  pw = NULL;
+  
+  /* Free float conversion scanline if allocated */
+  if (pRow != NULL) {
+    free(pRow);
+    pRow = NULL;
+  }
+  
+  /* Return the error, if any */
+  return pErr;
+}
+
+/*
+ * Encode the pixel data of a buffer register into a (M-)JPEG file.
+ * 
+ * The buffer register must be loaded and may not have a pending color
+ * lookup.  Its pixel data is only read, so this may run on a worker
+ * thread while other threads read the same pixel data.
+ * 
+ * Parameters:
+ * 
+ *   ps - the buffer register to store
+ * 
+ *   pPath - path to the JPEG file to store to
+ * 
+ *   mjpg - non-zero to append to file if it already exists; zero to
+ *   overwrite
+ * 
+ *   q - the compression quality
+ * 
+ * Return:
+ * 
+ *   NULL if successful, or else the error message
+ */
+static const char *encode_jpeg(
+    const SKBUF * ps,
+    const char  * pPath,
+          int     mjpg,
+          int     q) {
+  
+  int chcount = 0;
+  const char *pMode = NULL;
+  const char *pErr = NULL;
+  int32_t x = 0;
+  int32_t y = 0;
+  
+  SPH_JPEG_WRITER *pw = NULL;
+  FILE *pf = NULL;
+  
+  uint8_t *psl = NULL;
+  const uint8_t *pi = NULL;
+  uint8_t *pRow = NULL;
+  uint8_t *pj = NULL;
+  
+  SPH_ARGB argb;
+  
+  /* Initialize structures */
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  
+  /* Check parameters */
+  if ((ps == NULL) || (pPath == NULL)) {
+    abort();
+  }
+  if ((ps->pData == NULL) || ps->lut_pending) {
+    abort();
+  }
+  
+  /* Based on number of channels, determine JPEG channels */
+  if (ps->c == 4) {
+    /* ARGB buffer, but JPEG only supports RGB, so set to three */
+    chcount = 3;
+    
+  } else if (ps->c == 3) {
+    /* RGB buffer, so three channels */
+    chcount = 3;
+    
+  } else if (ps->c == 1) {
+    /* Grayscale buffer, so one channel */
+    chcount = 1;
+    
+  } else {
+    /* Shouldn't happen */
+    abort();
+  }
+  
+  /* Based on the mjpg flag, determine opening mode for file */
+  if (mjpg) {
+    pMode = "ab";
+  } else {
+    pMode = "wb";
+  }
+  
+  /* Open the file */
+  pf = fopen(pPath, pMode);
+  if (pf == NULL) {
+    pErr = "Failed to create JPEG file";
+  }
+  
+  /* Create the writer object */
+  if (pErr == NULL) {
+    pw = sph_jpeg_writer_new(pf, ps->w, ps->h, chcount, q);
+  }
+  
+  /* Allocate the scanline buffer */
+  if (pErr == NULL) {
+    psl = (uint8_t *) calloc((size_t) ps->w, (size_t) chcount);
+    if (psl == NULL) {
+      abort();
+    }
+  }
+  
+  /* For a float buffer, allocate a scanline of ARGB bytes to convert
+   * each scanline into */
+  if ((pErr == NULL) && ps->fp) {
+    pRow = (uint8_t *) calloc((size_t) ps->w, 4);
+    if (pRow == NULL) {
+      abort();
+    }
+  }
+  
+  /* Write each scanline */
+  if (pErr == NULL) {
+    pi = ps->pData;
+    for(y = 0; y < ps->h; y++) {
+      /* Convert a float scanline to ARGB */
+      if (ps->fp) {
+        float_row(ps, y, pRow);
+        pi = pRow;
+      }
+      
+      /* Write all data to the scanline */
+      pj = psl;
+      for(x = 0; x < ps->w; x++) {
+        /* Different handling depending on buffer channels */
+        if (ps->c == 4) {
+          /* ARGB, so we need to down-convert to RGB */
+          argb.a = pi[0];
+          argb.r = pi[1];
+          argb.g = pi[2];
+          argb.b = pi[3];
+          
+          sph_argb_downRGB(&argb);
+          
+          pj[0] = (uint8_t) argb.r;
+          pj[1] = (uint8_t) argb.g;
+          pj[2] = (uint8_t) argb.b;
+          
+          pi += 4;
+          pj += 3;
+          
+        } else if (ps->c == 3) {
+          /* RGB -> RGB */
+          pj[0] = pi[0];
+          pj[1] = pi[1];
+          pj[2] = pi[2];
+          
+          pi += 3;
+          pj += 3;
+          
+        } else if (ps->c == 1) {
+          /* Gray -> gray */
+          *pj = *pi;
+          
+          pi++;
+          pj++;
+          
+        } else {
+          /* Shouldn't happen */
+          abort();
+        }
+      }
+      
+      /* Write the scanline to the file */
+      sph_jpeg_writer_put(pw, psl);
+    }
+  }
+  
+  /* Free writer if allocated */
+  sph_jpeg_writer_free(pw);
+  pw = NULL;
+  
+  /* Free scanline buffer if allocated */
+  if (psl != NULL) {
+    free(psl);
+    psl = NULL;
+  }
+  
+  /* Free float conversion scanline if allocated */
+  if (pRow != NULL) {
+    free(pRow);
+    pRow = NULL;
+  }
+  
+  /* Close file if open */
+  if (pf != NULL) {
+    fclose(pf);
+    pf = NULL;
+  }
+  
+  /* Return the error, if any */
+  return pErr;
+}
+
+/*
+ * Encode the pixel data of a buffer register into a file of one of the
+ * STORE_ kinds.
+ * 
+ * Parameters:
+ * 
+ *   ps - the buffer register to store
+ * 
+ *   kind - one of the STORE_ constants
+ * 
+ *   pPath - path to the file to store to
+ * 
+ *   q - the compression quality, ignored for PNG files
+ * 
+ * Return:
+ * 
+ *   NULL if successful, or else the error message
+ */
+static const char *store_encode(
+    const SKBUF * ps,
+          int     kind,
+    const char  * pPath,
+          int     q) {
+  
+  const char *pErr = NULL;
+  
+  /* Dispatch to the encoder */
+  if (kind == STORE_PNG) {
+    pErr = encode_png(ps, pPath);
+    
+  } else if (kind == STORE_JPEG) {
+    pErr = encode_jpeg(ps, pPath, 0, q);
+    
+  } else if (kind == STORE_MJPG) {
+    pErr = encode_jpeg(ps, pPath, 1, q);
+    
+  } else {
+    /* Shouldn't happen */
+    abort();
+  }
+  
+  return pErr;
+}
+
+/*
+ * Task function that writes a pipelined store.
+ * 
+ * When the store is written, the next store of the context is started
+ * if there is one, so that the stores of a context are written one at
+ * a time in the order they were made.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SKSTORE
+ */
+static void store_task(void *pArg) {
+  
+  SKSTORE *pst = NULL;
+  SKVM_CTX *pv = NULL;
+  
+  /* Check parameter */
+  if (pArg == NULL) {
+    abort();
+  }
+  pst = (SKSTORE *) pArg;
+  pv = pst->pv;
+  
+  /* Write the file, and drop anything another context cached from the
+   * path while the store was pending */
+  pst->pErr = store_encode(&(pst->buf), pst->kind, pst->pPath, pst->q);
+  asset_forget(pst->pPath);
+  
+  /* Start the next store, or note that none is running */
+  if (pthread_mutex_lock(&(pv->store_lock))) {
+    abort();
+  }
+  if (pst->pNext != NULL) {
+    task_start(&(pst->pNext->task), &store_task, pst->pNext);
+  } else {
+    pv->store_busy = 0;
+  }
+  if (pthread_mutex_unlock(&(pv->store_lock))) {
+    abort();
+  }
+}
+
+/*
+ * Retire the oldest pipelined stores of a context until no more than a
+ * given number are pending.
+ * 
+ * Retiring a store waits for it to be written and then drops its
+ * snapshot.  If a retired store failed and no earlier failure is
+ * waiting to be reported, its error message is recorded in the
+ * pStoreErr field of the context.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   keep - the number of stores that may remain pending
+ */
+static void store_finish(SKVM_CTX *pv, int32_t keep) {
+  
+  SKSTORE *pst = NULL;
+  
+  /* Check parameters */
+  if ((pv == NULL) || (keep < 0)) {
+    abort();
+  }
+  
+  /* Retire stores from the oldest */
+  while (pv->store_count > keep) {
+    pst = pv->pStoreHead;
+    task_finish(&(pst->task));
+    
+    pv->pStoreHead = pst->pNext;
+    if (pv->pStoreHead == NULL) {
+      pv->pStoreTail = NULL;
+    }
+    (pv->store_count)--;
+    
+    if ((pst->pErr != NULL) && (pv->pStoreErr == NULL)) {
+      pv->pStoreErr = pst->pErr;
+    }
+    
+    /* Drop the snapshot and free the store */
+    if (pthread_mutex_lock(&m_warm_lock)) {
+      abort();
+    }
+    share_drop(pst->buf.pShare);
+    if (pthread_mutex_unlock(&m_warm_lock)) {
+      abort();
+    }
+    
+    free(pst->pPath);
+    free(pst);
+  }
+}
+
+/*
+ * Store a loaded buffer register to a file, pipelining the store if
+ * the context has a pipeline depth.
+ * 
+ * Pending stores are first retired until there is room for this one,
+ * which is all of them if the store is not pipelined, so that files
+ * are always written in the order the stores were made.  If a store
+ * that was retired earlier failed, this store is not made, and the
+ * failure is reported instead.
+ * 
+ * Stores are only pipelined if the calling thread may use more than
+ * one thread (see skvm_threads).  A pipelined store takes a snapshot of
+ * the buffer register by sharing its pixel data, so the pixel data is
+ * copied only if the register is modified in place while the store is
+ * pending.  Resetting or filling the register gives it new pixel data
+ * instead, so that the register is simply double-buffered.
+ * 
+ * Any asset cache entries for the path are dropped when the store is
+ * made and again when the file is written (see asset_forget).
+ * 
+ * If the function fails, the error message of the context is set.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   ps - the buffer register to store, which must be loaded
+ * 
+ *   kind - one of the STORE_ constants
+ * 
+ *   pPath - path to the file to store to
+ * 
+ *   q - the compression quality, ignored for PNG files
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int store_submit(
+          SKVM_CTX  * pv,
+          SKBUF     * ps,
+          int         kind,
+    const char      * pPath,
+          int         q) {
+  
+  int status = 1;
+  int pipe = 0;
+  SKSTORE *pst = NULL;
+  SKSHARE *psh = NULL;
+  
+  /* Check parameters */
+  if ((pv == NULL) || (ps == NULL) || (pPath == NULL)) {
+    abort();
+  }
+  if (ps->pData == NULL) {
+    abort();
+  }
+  
+  /* Apply any pending color lookup */
+  buf_settle(ps);
+  
+  /* Determine whether to pipeline the store */
+  if ((pv->depth > 0) && (thread_limit() > 1)) {
+    pipe = 1;
+  }
+  
+  /* Retire pending stores until there is room for this one */
+  if (pipe) {
+    store_finish(pv, pv->depth - 1);
+  } else {
+    store_finish(pv, 0);
+  }
+  
+  /* Report any earlier store that failed */
+  if (pv->pStoreErr != NULL) {
+    status = 0;
+    pv->pErr = pv->pStoreErr;
+    pv->pStoreErr = NULL;
+  }
+  
+  /* Drop any cached decoding of the file that is about to change */
+  if (status) {
+    asset_forget(pPath);
+  }
+  
+  /* If not pipelining, just write the file now */
+  if (status && (!pipe)) {
+    pv->pErr = store_encode(ps, kind, pPath, q);
+    asset_forget(pPath);
+    if (pv->pErr != NULL) {
       status = 0;
-      m_perr = "PNG file mismatches dimensions of buffer";
     }
+    return status;
+  }
+  
+  /* Allocate the store, with a copy of the path */
+  if (status) {
+    pst = (SKSTORE *) calloc(1, sizeof(SKSTORE));
+    if (pst == NULL) {
+      abort();
+    }
+    
+    pst->pPath = (char *) malloc(strlen(pPath) + 1);
+    if (pst->pPath == NULL) {
+      abort();
+    }
+    strcpy(pst->pPath, pPath);
+    
+    pst->pv = pv;
+    pst->kind = kind;
+    pst->q = q;
+  }
+  
+  /* Share the pixel data of the register with the store, turning
+   * private pixel data into a share first */
+  if (status) {
+    if (ps->pShare == NULL) {
+      psh = (SKSHARE *) calloc(1, sizeof(SKSHARE));
+      if (psh == NULL) {
+        abort();
+      }
+      psh->pData = ps->pData;
+      psh->refs = 1;
+      ps->pShare = psh;
+    }
+    
+    if (pthread_mutex_lock(&m_warm_lock)) {
+      abort();
+    }
+    (ps->pShare->refs)++;
+    if (pthread_mutex_unlock(&m_warm_lock)) {
+      abort();
+    }
+    
+    pst->buf.pData = ps->pData;
+    pst->buf.pShare = ps->pShare;
+    pst->buf.w = ps->w;
+    pst->buf.h = ps->h;
+    pst->buf.c = ps->c;
+    pst->buf.fp = ps->fp;
+  }
+  
+  /* Add the store to the end of the pending stores, and start it if no
+   * store is running */
+  if (status) {
+    work_grow(thread_limit());
+    
+    if (pthread_mutex_lock(&(pv->store_lock))) {
+      abort();
+    }
+    
+    if (pv->pStoreTail != NULL) {
+      pv->pStoreTail->pNext = pst;
+    } else {
+      pv->pStoreHead = pst;
+    }
+    pv->pStoreTail = pst;
+    (pv->store_count)++;
+    
+    if (!(pv->store_busy)) {
+      pv->store_busy = 1;
+      task_start(&(pst->task), &store_task, pst);
+    }
+    
+    if (pthread_mutex_unlock(&(pv->store_lock))) {
+      abort();
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Perform a sampling operation.
+ * 
+ * This is the implementation of skvm_sample().  If pAltSrc is not NULL,
+ * it is sampled instead of the source buffer register, which is then
+ * only used for the parameter checks.  pAltSrc must be loaded and have
+ * no pending color lookup.  If pAltMat is not NULL, it is used instead
+ * of the transformation matrix register.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   ps - the sampling parameters
+ * 
+ *   pAltSrc - the buffer to sample instead of the source register, or
+ *   NULL
+ * 
+ *   pAltMat - the matrix to use instead of the matrix register, or NULL
+ */
+static void sample_run(
+          SKVM_CTX          * pv,
+          SKVM_SAMPLE_PARAM * ps,
+    const SKBUF             * pAltSrc,
+    const SKMAT             * pAltMat) {
+  
+  int     i = 0;
+  double  len2 = 0.0;
+  double  sv[6];
+  
+  const SKBUF * pSrc = NULL;
+  const SKBUF * pMask = NULL;
+  const SKMAT * pMatrix = NULL;
+        SKBUF * pTarget = NULL;
+  
+  SKPOINT corners[4];
+  SKXFORM xf;
+  SKSHAPE shape;
+  SKROWMASK rows;
+  const SKXFORM * px = NULL;
+  const SKROWMASK * pRows = NULL;
+  int raster = 0;
+  int exact = 0;
+  
+  double f_min_x = 0.0;
+  double f_min_y = 0.0;
+  double f_max_x = 0.0;
+  double f_max_y = 0.0;
+  
+  int32_t bound_x = 0;
+  int32_t bound_y = 0;
+  int32_t min_x = 0;
+  int32_t min_y = 0;
+  int32_t max_x = 0;
+  int32_t max_y = 0;
+  
+  /* Initialize arrays and structures */
+  memset(corners, 0, sizeof(SKPOINT) * 4);
+  memset(&xf, 0, sizeof(SKXFORM));
+  memset(&shape, 0, sizeof(SKSHAPE));
+  memset(sv, 0, sizeof(double) * 6);
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameter */
+  if (ps == NULL) {
+    abort();
+  }
+  
+  /* ===================================== *
+   *                                       *
+   * INTERNAL PARAMETER CONSISTENCY CHECKS *
+   *                                       *
+   * ===================================== */
+  
+  /* Check that either procedural masking or raster masking mode
+   * selected, but not both */
+  if ((ps->flags & SKVM_FLAG_PROCMASK) &&
+      (ps->flags & SKVM_FLAG_RASTERMASK)) {
+    abort();
+  }
+  if (((ps->flags & SKVM_FLAG_PROCMASK) == 0) &&
+      ((ps->flags & SKVM_FLAG_RASTERMASK) == 0)) {
+    abort();
+  }
+  
+  /* If procedural mode, check that exactly one flag from each mode
+   * group is selected */
+  if (ps->flags & SKVM_FLAG_PROCMASK) {
+    if ((ps->flags & SKVM_FLAG_LEFTMODE) &&
+        (ps->flags & SKVM_FLAG_RIGHTMODE)) {
+      abort();
+    }
+    if (((ps->flags & SKVM_FLAG_LEFTMODE) == 0) &&
+        ((ps->flags & SKVM_FLAG_RIGHTMODE) == 0)) {
+      abort();
+    }
+    
+    if ((ps->flags & SKVM_FLAG_ABOVEMODE) &&
+        (ps->flags & SKVM_FLAG_BELOWMODE)) {
+      abort();
+    }
+    if (((ps->flags & SKVM_FLAG_ABOVEMODE) == 0) &&
+        ((ps->flags & SKVM_FLAG_BELOWMODE) == 0)) {
+      abort();
+    }
+  }
+  
+  /* Check that the buffer indices are valid */
+  if ((ps->src_buf < 0) || (ps->src_buf >= pv->bufc) ||
+      (ps->target_buf < 0) || (ps->target_buf >= pv->bufc)) {
+    abort();
+  }
+  if (ps->flags & SKVM_FLAG_RASTERMASK) {
+    if ((ps->mask_buf < 0) || (ps->mask_buf >= pv->bufc)) {
+      abort();
+    }
+    if ((ps->mask_x < -SKVM_MAX_DIM) || (ps->mask_x > SKVM_MAX_DIM) ||
+        (ps->mask_y < -SKVM_MAX_DIM) || (ps->mask_y > SKVM_MAX_DIM)) {
+      abort();
+    }
+  }
+  
+  /* Check that buffer indices are unique */
+  if (ps->src_buf == ps->target_buf) {
+    abort();
+  }
+  if (ps->flags & SKVM_FLAG_RASTERMASK) {
+    if ((ps->src_buf == ps->mask_buf) ||
+        (ps->target_buf == ps->mask_buf)) {
+      abort();
+    }
+  }
+  
+  /* Check that matrix buffer is valid */
+  if ((ps->t_matrix < 0) || (ps->t_matrix >= pv->matc)) {
+    abort();
+  }
+  
+  /* If procedural masking, check that boundary fields are finite and
+   * in normalized range */
+  if (ps->flags & SKVM_FLAG_PROCMASK) {
+    if ((!isfinite(ps->x_boundary)) || (!isfinite(ps->y_boundary))) {
+      abort();
+    }
+    if ((!((ps->x_boundary >= 0.0) && (ps->x_boundary <= 1.0))) ||
+        (!((ps->y_boundary >= 0.0) && (ps->y_boundary <= 1.0)))) {
+      abort();
+    }
+  }
+  
+  /* If procedural masking with a shape mask, check the shape
+   * parameters and compile the shape */
+  if ((ps->flags & SKVM_FLAG_PROCMASK) &&
+      (ps->mask_shape != SKVM_SHAPE_NONE)) {
+    
+    if ((ps->mask_shape != SKVM_SHAPE_RECT) &&
+        (ps->mask_shape != SKVM_SHAPE_ELLIPSE) &&
+        (ps->mask_shape != SKVM_SHAPE_RRECT) &&
+        (ps->mask_shape != SKVM_SHAPE_LINEAR) &&
+        (ps->mask_shape != SKVM_SHAPE_RADIAL)) {
+      abort();
+    }
+    
+    sv[0] = ps->shape_x0;
+    sv[1] = ps->shape_y0;
+    sv[2] = ps->shape_x1;
+    sv[3] = ps->shape_y1;
+    sv[4] = ps->shape_r;
+    sv[5] = ps->shape_f;
+    for(i = 0; i < 6; i++) {
+      if (!isfinite(sv[i])) {
+        abort();
+      }
+      if (!(fabs(sv[i]) <= SKVM_SHAPE_MAX_COORD)) {
+        abort();
+      }
+    }
+    if ((ps->shape_r < 0.0) || (ps->shape_f < 0.0)) {
+      abort();
+    }
+    
+    shape.kind = ps->mask_shape;
+    if (ps->flags & SKVM_FLAG_SHAPEINVERT) {
+      shape.invert = 1;
+    }
+    
+    shape.x0 = ps->shape_x0;
+    shape.y0 = ps->shape_y0;
+    shape.x1 = ps->shape_x1;
+    shape.y1 = ps->shape_y1;
+    shape.r = ps->shape_r;
+    
+    shape.fe = ps->shape_f;
+    if (shape.fe < 1.0) {
+      shape.fe = 1.0;
+    }
+    
+    if (ps->mask_shape == SKVM_SHAPE_LINEAR) {
+      shape.ux = shape.x1 - shape.x0;
+      shape.uy = shape.y1 - shape.y0;
+      len2 = (shape.ux * shape.ux) + (shape.uy * shape.uy);
+      if (!(len2 > 0.0)) {
+        abort();
+      }
+      shape.ux = shape.ux / len2;
+      shape.uy = shape.uy / len2;
+      
+    } else if (ps->mask_shape == SKVM_SHAPE_RADIAL) {
+      shape.cx = shape.x0;
+      shape.cy = shape.y0;
+      
+    } else {
+      if (!((shape.x0 < shape.x1) && (shape.y0 < shape.y1))) {
+        abort();
+      }
+      shape.cx = (shape.x0 + shape.x1) / 2.0;
+      shape.cy = (shape.y0 + shape.y1) / 2.0;
+      shape.hx = (shape.x1 - shape.x0) / 2.0;
+      shape.hy = (shape.y1 - shape.y0) / 2.0;
+      
+      if (ps->mask_shape == SKVM_SHAPE_RRECT) {
+        if ((shape.r > shape.hx) || (shape.r > shape.hy)) {
+          abort();
+        }
+      }
+    }
+    
+    memset(&rows, 0, sizeof(SKROWMASK));
+    rows.pShape = &shape;
+    pRows = &rows;
+  }
+  
+  /* Check that sampling algorithm is valid */
+  if ((ps->sample_alg != SKVM_ALG_NEAREST) &&
+      (ps->sample_alg != SKVM_ALG_BILINEAR) &&
+      (ps->sample_alg != SKVM_ALG_BICUBIC)) {
+    abort();
+  }
+  
+  /* Check the blend mode, which blend_select() faults on if it is not
+   * valid */
+  blend_select(ps->blend);
+  
+  /* Check and compile any color transform */
+  if (ps->flags & SKVM_FLAG_COLORLUT) {
+    if (ps->pLut == NULL) {
+      abort();
+    }
+    xf.pLut = ps->pLut;
+    px = &xf;
+  }
+  
+  if (ps->flags & SKVM_FLAG_COLORMATRIX) {
+    if (ps->pCMat == NULL) {
+      abort();
+    }
+    for(i = 0; i < 20; i++) {
+      if (!isfinite((ps->pCMat)[i])) {
+        abort();
+      }
+      if ((i % 5) == 4) {
+        if (!(fabs((ps->pCMat)[i]) <= SKVM_CMAT_MAX_OFFSET)) {
+          abort();
+        }
+      } else {
+        if (!(fabs((ps->pCMat)[i]) <= SKVM_CMAT_MAX_COEF)) {
+          abort();
+        }
+      }
+      xf.k[i] = cmat_fixed((ps->pCMat)[i]);
+    }
+    xf.cmat = 1;
+    px = &xf;
+  }
+  
+  /* ======================================= *
+   *                                         *
+   * GET BUFFERS AND FINISH PARAMETER CHECKS *
+   *                                         *
+   * ======================================= */
+  
+  /* Get the buffers */
+  if (pAltSrc != NULL) {
+    pSrc  = pAltSrc;
+  } else {
+    pSrc  = &(pv->pbuf[ps->src_buf   ]);
+  }
+  pTarget = &(pv->pbuf[ps->target_buf]);
+  if (ps->flags & SKVM_FLAG_RASTERMASK) {
+    pMask = &(pv->pbuf[ps->mask_buf  ]);
+  }
+  
+  /* If subarea mode, check that subarea is within the source buffer,
+   * else set the subarea fields to encompass the whole source buffer */
+  if (ps->flags & SKVM_FLAG_SUBAREA) {
+    /* Subarea specified, so first check that (x,y) coordinates are
+     * within buffer */
+    if ((ps->src_x < 0) || (ps->src_x >= pSrc->w)) {
+      abort();
+    }
+    if ((ps->src_y < 0) || (ps->src_y >= pSrc->h)) {
+      abort();
+    }
+    
+    /* Next, check that width and height are greater than zero */
+    if ((ps->src_w < 1) || (ps->src_h < 1)) {
+      abort();
+    }
+    
+    /* Finally, check that (x + width) <= src_width and also that
+     * (y + height) <= src_height */
+    if ((ps->src_x > pSrc->w - ps->src_w) ||
+        (ps->src_y > pSrc->h - ps->src_h)) {
+      abort();
+    }
+    
+  } else {
+    /* No subarea specified, so set to whole source buffer */
+    ps->src_x = 0;
+    ps->src_y = 0;
+    ps->src_w = pSrc->w;
+    ps->src_h = pSrc->h;
+  }
+  
+  /* If raster masking is in effect, mask buffer must be grayscale or
+   * ARGB, and not a float buffer */
+  if (ps->flags & SKVM_FLAG_RASTERMASK) {
+    if (((pMask->c != 1) && (pMask->c != 4)) || pMask->fp) {
+      abort();
+    }
+  }
+  
+  /* All buffers must be loaded */
+  if ((pSrc->pData == NULL) || (pTarget->pData == NULL)) {
+    abort();
+  }
+  if (ps->flags & SKVM_FLAG_RASTERMASK) {
+    if ((pMask->pData == NULL) && (pMask->pRle == NULL)) {
+      abort();
+    }
+  }
+  
+  /* Apply any pending color lookups to the buffers that are read */
+  if (pAltSrc == NULL) {
+    buf_settle(&(pv->pbuf[ps->src_buf]));
+  }
+  if (ps->flags & SKVM_FLAG_RASTERMASK) {
+    if (pMask->pData != NULL) {
+      buf_settle(&(pv->pbuf[ps->mask_buf]));
+    }
+  }
+  
+  /* A raster mask holding pixel data is read directly, while a
+   * compressed raster mask is decoded one scanline at a time like a
+   * shape mask */
+  if (ps->flags & SKVM_FLAG_RASTERMASK) {
+    if (pMask->pData != NULL) {
+      raster = 1;
+    } else {
+      memset(&rows, 0, sizeof(SKROWMASK));
+      rows.pRle = pMask->pRle;
+      rows.ox = ps->mask_x;
+      rows.oy = ps->mask_y;
+      pRows = &rows;
+    }
+  }
+  
+  /* Make sure the target may be modified, in case it is sharing pixel
+   * data with the asset cache */
+  buf_writable(pTarget);
+  
+  /* ========================== *
+   *                            *
+   * DETERMINE RENDERING BOUNDS *
+   *                            *
+   * ========================== */
+  
+  /* Clear the balance record of this thread, so that it shows that
+   * nothing was rendered if the rendering area turns out to be empty */
+  memset(&(thread_state()->bal), 0, sizeof(SKVM_BALANCE));
+  
+  /* Get the transformation matrix */
+  if (pAltMat != NULL) {
+    pMatrix = pAltMat;
+  } else {
+    pMatrix = &(pv->pmat[ps->t_matrix]);
+  }
+  
+  /* In reference mode, render straight from the definition instead of
+   * determining bounds and choosing a kernel */
+  if (thread_reference()) {
+    sample_reference(ps, px, pSrc, pMask,
+                      (pRows != NULL) ? pRows->pShape : NULL,
+                      pMatrix, pTarget);
+    return;
+  }
+  
+  /* Write the corners of the source area into the corner array */
+  corners[0].x = ps->src_x;
+  corners[0].y = ps->src_y;
+  
+  corners[1].x = ps->src_x + ps->src_w;
+  corners[1].y = ps->src_y;
+  
+  corners[2].x = ps->src_x;
+  corners[2].y = ps->src_y + ps->src_h;
+  
+  corners[3].x = ps->src_x + ps->src_w;
+  corners[3].y = ps->src_y + ps->src_h;
+  
+  /* Transform all the corners from source space to target space */
+  source2target(pMatrix, &(corners[0]));
+  source2target(pMatrix, &(corners[1]));
+  source2target(pMatrix, &(corners[2]));
+  source2target(pMatrix, &(corners[3]));
+  
+  /* Figure out the bounding box around the transformed corner
+   * coordinates */
+  f_min_x = corners[0].x;
+  f_max_x = corners[0].x;
+  
+  f_min_y = corners[0].y;
+  f_max_y = corners[0].y;
+  
+  for(i = 1; i < 4; i++) {
+    if (corners[i].x > f_max_x) {
+      f_max_x = corners[i].x;
+    } else if (corners[i].x < f_min_x) {
+      f_min_x = corners[i].x;
+    }
+    
+    if (corners[i].y > f_max_y) {
+      f_max_y = corners[i].y;
+    } else if (corners[i].y < f_min_y) {
+      f_min_y = corners[i].y;
+    }
+  }
+
+  /* Take the floor of the minimums and the ceiling of the maximums to
+   * expand the bounding box outward to encompass whole pixels */
+  f_min_x = floor(f_min_x);
+  f_min_y = floor(f_min_y);
+  
+  f_max_x = ceil(f_max_x);
+  f_max_y = ceil(f_max_y);
+  
+  /* Make sure these boundary coordinates are finite and within range of
+   * signed 32-bit integers */
+  if ((!isfinite(f_min_x)) || (!isfinite(f_min_y)) ||
+      (!isfinite(f_max_x)) || (!isfinite(f_max_y))) {
+    fprintf(stderr, "Numeric problem during sparkle sampling!\n");
+    abort();
+  }
+  
+  if ((f_min_x < (double) INT32_MIN) ||
+        (f_max_x > (double) INT32_MAX) ||
+        (f_min_y < (double) INT32_MIN) ||
+        (f_max_y > (double) INT32_MAX)) {
+    abort();
+  }
+  
+  /* Now convert to integers */
+  min_x = (int32_t) f_min_x;
+  min_y = (int32_t) f_min_y;
+  
+  max_x = (int32_t) f_max_x;
+  max_y = (int32_t) f_max_y;
+
+  /* Consistency check */
+  if ((min_x > max_x) || (min_y > max_y)) {
+    fprintf(stderr, "Numeric problem during sparkle sampling!\n");
+    abort();
+  }
+  
+  /* If the maximum X is negative or the maximum Y is negative, then
+   * the intersection with the target area is empty so we can leave */
+  if ((max_x < 0) || (max_y < 0)) {
+    return;
+  }
+  
+  /* If the minimum X is greater than or equal to the width or the
+   * minimum Y is greater than or equal to the height, then the
+   * intersection with the target area is empty so we can leave */
+  if ((min_x >= pTarget->w) || (min_y >= pTarget->h)) {
+    return;
+  }
+  
+  /* If we got here, maximum X and maximum Y are at least zero, so clamp
+   * them so that they are at most one less than the width or height */
+  if (max_x > pTarget->w - 1) {
+    max_x = pTarget->w - 1;
+  }
+  if (max_y > pTarget->h - 1) {
+    max_y = pTarget->h - 1;
+  }
+  
+  /* If we got here, minimum X and minimum Y are less than the width or
+   * height respectively, so clamp them so that they are at least
+   * zero */
+  if (min_x < 0) {
+    min_x = 0;
+  }
+  if (min_y < 0) {
+    min_y = 0;
+  }
+  
+  /* If we are in procedural masking mode, intersect the rendering area
+   * with the part of the target that is not masked */
+  if (ps->flags & SKVM_FLAG_PROCMASK) {
+    
+    /* Get integer versions of the bounds */
+    if (ps->x_boundary == 0.0) {
+      bound_x = 0;
+      
+    } else if (ps->x_boundary == 1.0) {
+      bound_x = pTarget->w - 1;
+      
+    } else {
+      bound_x = (int32_t) floor(ps->x_boundary *
+                                  ((double) (pTarget->w - 1)));
+    }
+    
+    if (ps->y_boundary == 0.0) {
+      bound_y = 0;
+      
+    } else if (ps->y_boundary == 1.0) {
+      bound_y = pTarget->h - 1;
+      
+    } else {
+      bound_y = (int32_t) floor(ps->y_boundary *
+                                  ((double) (pTarget->h - 1)));
+    }
+
+    /* Handle the X boundary based on left or right mode */
+    if (ps->flags & SKVM_FLAG_LEFTMODE) {
+      /* Left mode, so only draw area where x >= boundary; if max_x is
+       * less than boundary, nothing to draw so leave */
+      if (max_x < bound_x) {
+        return;
+      }
+      
+      /* If we got here, max_x is in bounds, so now just clamp min_x to
+       * boundary */
+      if (min_x < bound_x) {
+        min_x = bound_x;
+      }
+      
+    } else if (ps->flags & SKVM_FLAG_RIGHTMODE) {
+      /* Right mode, so only draw area where x <= boundary; if min_x is
+       * greater than boundary, nothing to draw so leave */
+      if (min_x > bound_x) {
+        return;
+      }
+      
+      /* If we got here, min_x is in bounds, so now just clamp max_x to
+       * boundary */
+      if (max_x > bound_x) {
+        max_x = bound_x;
+      }
+      
+    } else {
+      /* Shouldn't happen */
+      abort();
+    }
+    
+    /* Handle the Y boundary based on above or below mode */
+    if (ps->flags & SKVM_FLAG_BELOWMODE) {
+      /* Below mode, so only draw area where y <= boundary; if min_y is
+       * greater than boundary, nothing to draw so leave */
+      if (min_y > bound_y) {
+        return;
+      }
+      
+      /* If we got here, min_y is in bounds, so now just clamp max_y to
+       * boundary */
+      if (max_y > bound_y) {
+        max_y = bound_y;
+      }
+      
+    } else if (ps->flags & SKVM_FLAG_ABOVEMODE) {
+      /* Above mode, so only draw area where y >= boundary; if max_y is
+       * less than boundary, nothing to draw so leave */
+      if (max_y < bound_y) {
+        return;
+      }
+      
+      /* If we got here, max_y is in bounds, so now just clamp min_y to
+       * boundary */
+      if (min_y < bound_y) {
+        min_y = bound_y;
+      }
+      
+    } else {
+      /* Shouldn't happen */
+      abort();
+    }
+  }
+  
+  /* If we are in raster masking mode, intersect the rendering area
+   * with the part of the target covered by the mask, since everything
+   * else is masked out */
+  if (ps->flags & SKVM_FLAG_RASTERMASK) {
+    if ((max_x < ps->mask_x) || (max_y < ps->mask_y) ||
+        (min_x > ps->mask_x + pMask->w - 1) ||
+        (min_y > ps->mask_y + pMask->h - 1)) {
+      return;
+    }
+    
+    if (min_x < ps->mask_x) {
+      min_x = ps->mask_x;
+    }
+    if (min_y < ps->mask_y) {
+      min_y = ps->mask_y;
+    }
+    if (max_x > ps->mask_x + pMask->w - 1) {
+      max_x = ps->mask_x + pMask->w - 1;
+    }
+    if (max_y > ps->mask_y + pMask->h - 1) {
+      max_y = ps->mask_y + pMask->h - 1;
+    }
+  }
+  
+  /* ============== *
+   *                *
+   * RENDERING LOOP *
+   *                *
+   * ============== */
+  
+  /* If nearest-neighbor sampling is used with a matrix that maps target
+   * pixels exactly onto source pixels, use the exact kernel instead of
+   * the general one */
+  if ((ps->sample_alg == SKVM_ALG_NEAREST) &&
+      ((pMatrix->mclass == MCLASS_IDENTITY) ||
+        (pMatrix->mclass == MCLASS_ITRANSLATE) ||
+        (pMatrix->mclass == MCLASS_QUARTER)) &&
+      (floor(pMatrix->ivc) == pMatrix->ivc) &&
+      (floor(pMatrix->ivf) == pMatrix->ivf) &&
+      (fabs(pMatrix->ivc) <= SAMPLE_EXACT_MAX) &&
+      (fabs(pMatrix->ivf) <= SAMPLE_EXACT_MAX)) {
+    exact = 1;
+  }
+  
+  /* A compressed raster mask is read through the scanline mask rather
+   * than the raster mask buffer */
+  if (!raster) {
+    pMask = NULL;
+  }
+  
+  /* Render the area, on several threads if it is large enough */
+  sample_tiles(ps, px, pSrc, pMask, pRows, pMatrix, pTarget, exact,
+                min_x, min_y, max_x, max_y);
+}
+
+/*
+ * Public function implementations
+ * ===============================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * skvm_alloc function.
+ */
+SKVM_CTX *skvm_alloc(int32_t bufc, int32_t matc) {
+  
+  int32_t i = 0;
+  SKVM_CTX *pv = NULL;
+  SKBUF *ps = NULL;
+  
+  /* Check parameters */
+  if ((bufc < 0) || (bufc > SKVM_MAX_BUFC) ||
+      (matc < 0) || (matc > SKVM_MAX_MATC)) {
+    abort();
+  }
+  
+  /* Allocate context */
+  pv = (SKVM_CTX *) calloc(1, sizeof(SKVM_CTX));
+  if (pv == NULL) {
+    abort();
+  }
+  pv->pErr = NULL;
+  
+  /* Initialize the store pipeline, which is off by default */
+  if (pthread_mutex_init(&(pv->store_lock), NULL)) {
+    abort();
+  }
+  pv->depth = 0;
+  
+  /* Store counts */
+  pv->bufc = bufc;
+  pv->matc = matc;
+  
+  /* Allocate registers */
+  if (bufc > 0) {
+    pv->pbuf = (SKBUF *) calloc(bufc, sizeof(SKBUF));
+    if (pv->pbuf == NULL) {
+      abort();
+    }
+    
+  } else {
+    pv->pbuf = NULL;
+  }
+  
+  if (matc > 0) {
+    pv->pmat = (SKMAT *) calloc(matc, sizeof(SKMAT));
+    if (pv->pmat == NULL) {
+      abort();
+    }
+    
+  } else {
+    pv->pmat = NULL;
+  }
+  
+  /* Initialize all buffer registers to 1x1 grayscale, unloaded */
+  for(i = 0; i < bufc; i++) {
+    ps = &(pv->pbuf[i]);
+    
+    ps->pData = NULL;
+    ps->w = 1;
+    ps->h = 1;
+    ps->c = (uint8_t) 1;
+    ps->fp = 0;
+  }
+  
+  /* Initialize all matrices to identity */
+  for(i = 0; i < matc; i++) {
+    matrix_identity(&(pv->pmat[i]));
+  }
+  
+  /* Return the new context */
+  return pv;
+}
+
+/*
+ * skvm_free function.
+ */
+void skvm_free(SKVM_CTX *pv) {
+  
+  int32_t i = 0;
+  
+  /* Ignore if NULL passed */
+  if (pv == NULL) {
+    return;
+  }
+  
+  /* Wait for any pending stores, ignoring any errors */
+  store_finish(pv, 0);
+  
+  /* Release all buffer registers and their lookup tables */
+  for(i = 0; i < pv->bufc; i++) {
+    buf_release(&(pv->pbuf[i]));
+    if ((pv->pbuf[i]).pLut != NULL) {
+      free((pv->pbuf[i]).pLut);
+      (pv->pbuf[i]).pLut = NULL;
+    }
+  }
+  
+  /* Release register arrays */
+  if (pv->pbuf != NULL) {
+    free(pv->pbuf);
+    pv->pbuf = NULL;
+  }
+  if (pv->pmat != NULL) {
+    free(pv->pmat);
+    pv->pmat = NULL;
+  }
+  
+  /* Destroy the store lock */
+  if (pthread_mutex_destroy(&(pv->store_lock))) {
+    abort();
+  }
+  
+  /* Release the context */
+  free(pv);
+}
+
+/*
+ * skvm_keep_warm function.
+ */
+void skvm_keep_warm(int enable) {
+  
+  int32_t i = 0;
+  
+  if (pthread_mutex_lock(&m_warm_lock)) {
+    abort();
+  }
+  
+  if (enable) {
+    /* Enable warm state */
+    m_warm = 1;
+    
+  } else {
+    /* Disable warm state and release everything it holds */
+    m_warm = 0;
+    
+    for(i = 0; i < m_pool_count; i++) {
+      free((m_pool[i]).pData);
+      (m_pool[i]).pData = NULL;
+    }
+    m_pool_count = 0;
+    m_pool_bytes = 0;
+    
+    while (m_asset_count > 0) {
+      asset_evict(m_asset_count - 1);
+    }
+    while (m_mjpg_count > 0) {
+      mjpg_close(m_mjpg_count - 1);
+    }
+  }
+  
+  if (pthread_mutex_unlock(&m_warm_lock)) {
+    abort();
+  }
+}
+
+/*
+ * skvm_threads function.
+ */
+void skvm_threads(int32_t n) {
+  
+  /* Check parameter */
+  if ((n < 0) || (n > SKVM_MAX_THREADS)) {
+    abort();
+  }
+  
+  /* Set the limit of the calling thread */
+  (thread_state())->limit = n;
+}
+
+/*
+ * skvm_reference function.
+ */
+void skvm_reference(int mode) {
+  
+  /* Check parameter */
+  if ((mode != SKVM_REF_DEFAULT) && (mode != SKVM_REF_OFF) &&
+      (mode != SKVM_REF_ON)) {
+    abort();
+  }
+  
+  /* Set the mode of the calling thread */
+  (thread_state())->ref = mode;
+}
+
+/*
+ * skvm_pipeline function.
+ */
+void skvm_pipeline(SKVM_CTX *pv, int32_t depth) {
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameter */
+  if ((depth < 0) || (depth > SKVM_MAX_PIPELINE)) {
+    abort();
+  }
+  
+  /* Set the depth, which takes effect with the next store */
+  pv->depth = depth;
+}
+
+/*
+ * skvm_sync function.
+ */
+int skvm_sync(SKVM_CTX *pv) {
+  
+  int status = 1;
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Wait for all pending stores */
+  store_finish(pv, 0);
+  
+  /* Report any store that failed */
+  if (pv->pStoreErr != NULL) {
+    status = 0;
+    pv->pErr = pv->pStoreErr;
+    pv->pStoreErr = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * skvm_reason function.
+ */
+const char *skvm_reason(SKVM_CTX *pv) {
+  
+  const char *pResult = NULL;
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  if (pv->pErr != NULL) {
+    pResult = pv->pErr;
+  } else {
+    pResult = "No error";
+  }
+  
+  return pResult;
+}
+
+/*
+ * skvm_bufc function.
+ */
+int32_t skvm_bufc(SKVM_CTX *pv) {
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Return value */
+  return pv->bufc;
+}
+
+/*
+ * skvm_matc function.
+ */
+int32_t skvm_matc(SKVM_CTX *pv) {
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Return value */
+  return pv->matc;
+}
+
+/*
+ * skvm_get_dim function.
+ */
+void skvm_get_dim(SKVM_CTX *pv, int32_t i, int32_t *pw, int32_t *ph) {
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) || (pw == NULL) || (ph == NULL)) {
+    abort();
+  }
+  
+  /* Return the requested information */
+  *pw = (pv->pbuf[i]).w;
+  *ph = (pv->pbuf[i]).h;
+}
+
+/*
+ * skvm_get_channels function.
+ */
+int skvm_get_channels(SKVM_CTX *pv, int32_t i) {
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc)) {
+    abort();
+  }
+  
+  /* Return the requested information */
+  return (pv->pbuf[i]).c;
+}
+
+/*
+ * skvm_is_loaded function.
+ */
+int skvm_is_loaded(SKVM_CTX *pv, int32_t i) {
+  
+  int result = 0;
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc)) {
+    abort();
+  }
+  
+  /* Determine if loaded */
+  if ((pv->pbuf[i]).pData != NULL) {
+    result = 1;
+  } else {
+    result = 0;
+  }
+  
+  /* Return the requested information */
+  return result;
+}
+
+/*
+ * skvm_is_compressed function.
+ */
+int skvm_is_compressed(SKVM_CTX *pv, int32_t i) {
+  
+  int result = 0;
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc)) {
+    abort();
+  }
+  
+  /* Determine if holding a compressed mask */
+  if ((pv->pbuf[i]).pRle != NULL) {
+    result = 1;
+  } else {
+    result = 0;
   }
   
-  /* Read each scanline into the buffer */
-  if (status) {
-    pi = ps->pData;
-    for(y = 0; y < ps->h; y++) {
-      /* Read a scanline */
-      psl = sph_image_reader_read(pr, &errn);
-      if (psl == NULL) {
-        status = 0;
-        m_perr = sph_image_errorString(errn);
-      }
-      
-      /* Transfer each pixel into the buffer */
-      if (status) {
-        for(x = 0; x < ps->w; x++) {
-          /* Read a pixel and unpack it */
-          sph_argb_unpack(psl[x], &argb);
-          
-          /* Transfer with possible down-conversion */
-          if (ps->c == 4) {
-            pi[0] = (uint8_t) argb.a;
-            pi[1] = (uint8_t) argb.r;
-            pi[2] = (uint8_t) argb.g;
-            pi[3] = (uint8_t) argb.b;
-            pi += 4;
-            
-          } else if (ps->c == 3) {
-            sph_argb_downRGB(&argb);
-            pi[0] = (uint8_t) argb.r;
-            pi[1] = (uint8_t) argb.g;
-            pi[2] = (uint8_t) argb.b;
-            pi += 3;
-            
-          } else if (ps->c == 1) {
-            sph_argb_downGray(&argb);
-            *pi = (uint8_t) argb.g;
-            pi++;
-            
-          } else {
-            /* Shouldn't happen */
-            abort();
-          }          
-        }
-      }
-      
-      /* Leave loop if error */
-      if (!status) {
-        break;
-      }
-    }
+  /* Return the requested information */
+  return result;
+}
+
+/*
+ * skvm_is_float function.
+ */
+int skvm_is_float(SKVM_CTX *pv, int32_t i) {
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
   }
   
-  /* Release image reader object if allocated */
-  sph_image_reader_close(pr);
-  pr = NULL;
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc)) {
+    abort();
+  }
   
-  /* If we failed, unload register if loaded */
-  if (!status) {
-    if (ps->pData != NULL) {
-      free(ps->pData);
-      ps->pData = NULL;
-    }
+  /* Return whether this is a float buffer */
+  if ((pv->pbuf[i]).fp) {
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * skvm_reset function.
+ */
+void skvm_reset(SKVM_CTX *pv, int32_t i, int32_t w, int32_t h, int c) {
+  
+  SKBUF *ps = NULL;
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
   }
   
-  /* Return status */
-  return status;
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) ||
+      (w < 1) || (w > SKVM_MAX_DIM) ||
+      (h < 1) || (h > SKVM_MAX_DIM) ||
+      ((c != 1) && (c != 3) && (c != 4))) {
+    abort();
+  }
+  
+  /* Get buffer register */
+  ps = &(pv->pbuf[i]);
+  
+  /* If buffer currently loaded, release it */
+  buf_release(ps);
+  
+  /* Load buffer dimensions */
+  ps->w = w;
+  ps->h = h;
+  ps->c = (uint8_t) c;
+  ps->fp = 0;
 }
 
 /*
- * skvm_load_jpeg function.
+ * skvm_reset_float function.
  */
-int skvm_load_jpeg(int32_t i, const char *pPath) {
+void skvm_reset_float(SKVM_CTX *pv, int32_t i, int32_t w, int32_t h) {
+  
+  SKBUF *ps = NULL;
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) ||
+      (w < 1) || (w > SKVM_MAX_DIM) ||
+      (h < 1) || (h > SKVM_MAX_DIM)) {
+    abort();
+  }
+  
+  /* Get buffer register */
+  ps = &(pv->pbuf[i]);
+  
+  /* If buffer currently loaded, release it */
+  buf_release(ps);
+  
+  /* Load buffer dimensions for premultiplied ARGB floats */
+  ps->w = w;
+  ps->h = h;
+  ps->c = 4;
+  ps->fp = 1;
+}
+
+/*
+ * skvm_load_png function.
+ */
+int skvm_load_png(SKVM_CTX *pv, int32_t i, const char *pPath) {
   
   int status = 1;
+  int warm = 0;
+  int cached = 0;
+  int errn = 0;
   int32_t x = 0;
   int32_t y = 0;
-  int src_c = 0;
   
-  FILE *pf = NULL;
+  SKSTAMP fst;
+  
   SKBUF *ps = NULL;
-  SPH_JPEG_READER *pr = NULL;
+  SPH_IMAGE_READER *pr = NULL;
   
-  uint8_t *pi = NULL;
-  uint8_t *pj = NULL;
-  uint8_t *psl = NULL;
+  uint8_t  *pi = NULL;
+  uint32_t *psl = NULL;
   
   SPH_ARGB argb;
   
   /* Initialize structures */
+  memset(&fst, 0, sizeof(SKSTAMP));
   memset(&argb, 0, sizeof(SPH_ARGB));
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
   /* Check parameters */
-  if ((i < 0) || (i >= m_bufc) || (pPath == NULL)) {
+  if ((i < 0) || (i >= pv->bufc) || (pPath == NULL)) {
     abort();
   }
   
-  /* Get buffer register */
-  ps = &(m_pbuf[i]);
+  /* Wait for any pending stores, in case one of them writes the file
+   * to be loaded */
+  store_finish(pv, 0);
   
-  /* Allocate a buffer for the register, if we don't already have one */
-  if (ps->pData == NULL) {
-    ps->pData = (uint8_t *) malloc((size_t)
-                              (ps->w * ps->h * ((int32_t) ps->c)));
-    if (ps->pData == NULL) {
-      abort();
-    }
+  /* Float buffers are not supported */
+  if ((pv->pbuf[i]).fp) {
+    abort();
   }
   
-  /* Open JPEG file */
-  pf = fopen(pPath, "rb");
-  if (pf == NULL) {
-    status = 0;
-    m_perr = "Failed to open JPEG file";
-  }
+  /* Get buffer register */
+  ps = &(pv->pbuf[i]);
   
-  /* Allocate JPEG reader on file */
-  if (status) {
-    pr = sph_jpeg_reader_new(pf);
-    if (sph_jpeg_reader_status(pr) != SPH_JPEG_ERR_OK) {
-      status = 0;
-      m_perr = sph_jpeg_errstr(sph_jpeg_reader_status(pr));
+  /* If keeping warm state, try to load from the asset cache */
+  warm = is_warm();
+  if (warm) {
+    if (file_stamp(pPath, &fst)) {
+      cached = asset_fetch(ps, pPath, -1, &fst);
+    } else {
+      warm = 0;
     }
   }
-  
-  /* Make sure dimensions of JPEG image match dimensions of buffer */
-  if (status) {
-    if ((ps->w != sph_jpeg_reader_width(pr)) ||
-        (ps->h != sph_jpeg_reader_height(pr))) {
-      status = 0;
-      m_perr = "JPEG file mismatches dimensions of buffer";
-    }
+  if (cached) {
+    return status;
   }
   
-  /* Get the JPEG channel count */
-  if (status) {
-    src_c = sph_jpeg_reader_channels(pr);
+  /* Allocate a private buffer for the register, if we don't already
+   * have one */
+  buf_alloc(ps);
+  
+  /* Allocate PNG image reader on file */
+  pr = sph_image_reader_newFromPath(pPath, &errn);
+  if (pr == NULL) {
+    status = 0;
+    pv->pErr = sph_image_errorString(errn);
   }
   
-  /* Allocate scanline buffer */
+  /* Make sure dimensions of PNG image match dimensions of buffer */
   if (status) {
-    psl = (uint8_t *) calloc((size_t) ps->w, (size_t) src_c);
-    if (psl == NULL) {
-      abort();
+    if ((ps->w != sph_image_reader_width(pr)) ||
+        (ps->h != sph_image_reader_height(pr))) {
+      status = 0;
+      pv->pErr = "PNG file mismatches dimensions of buffer";
     }
   }
   
@@ -902,96 +10502,42 @@ int skvm_load_jpeg(int32_t i, const char *pPath) {
     pi = ps->pData;
     for(y = 0; y < ps->h; y++) {
       /* Read a scanline */
-      if (!sph_jpeg_reader_get(pr, psl)) {
+      psl = sph_image_reader_read(pr, &errn);
+      if (psl == NULL) {
         status = 0;
-        m_perr = sph_jpeg_errstr(sph_jpeg_reader_status(pr));
+        pv->pErr = sph_image_errorString(errn);
       }
       
       /* Transfer each pixel into the buffer */
       if (status) {
-        pj = psl;
         for(x = 0; x < ps->w; x++) {
-          /* Transfer appropriately */
+          /* Read a pixel and unpack it */
+          sph_argb_unpack(psl[x], &argb);
+          
+          /* Transfer with possible down-conversion */
           if (ps->c == 4) {
-            if (src_c == 3) {
-              /* Expand RGB->ARGB */
-              pi[0] = (uint8_t) 255;
-              pi[1] = pj[0];
-              pi[2] = pj[1];
-              pi[3] = pj[2];
-              
-              pi += 4;
-              pj += 3;
-              
-            } else if (src_c == 1) {
-              /* Expand gray->ARGB */
-              pi[0] = (uint8_t) 255;
-              pi[1] = *pj;
-              pi[2] = *pj;
-              pi[3] = *pj;
-              
-              pi += 4;
-              pj++;
-              
-            } else {
-              /* Shouldn't happen */
-              abort();
-            }
-            
-          } else if (ps->c == 3) {
-            if (src_c == 3) {
-              /* RGB -> RGB */
-              pi[0] = pj[0];
-              pi[1] = pj[1];
-              pi[2] = pj[2];
-              
-              pi += 3;
-              pj += 3;
-              
-            } else if (src_c == 1) {
-              /* Expand gray->RGB */
-              pi[0] = *pj;
-              pi[1] = *pj;
-              pi[2] = *pj;
-              
-              pi += 3;
-              pj++;
-              
-            } else {
-              /* Shouldn't happen */
-              abort();
-            }
+            pi[0] = (uint8_t) argb.a;
+            pi[1] = (uint8_t) argb.r;
+            pi[2] = (uint8_t) argb.g;
+            pi[3] = (uint8_t) argb.b;
+            pi += 4;
             
-          } else if (ps->c == 1) {
-            if (src_c == 3) {
-              /* Downconvert RGB->gray */
-              argb.a = 255;
-              argb.r = pj[0];
-              argb.g = pj[1];
-              argb.b = pj[2];
-              sph_argb_downGray(&argb);
-              
-              *pi = (uint8_t) argb.g;
-              
-              pi++;
-              pj += 3;
-              
-            } else if (src_c == 1) {
-              /* Gray -> gray */
-              *pi = *pj;
-              
-              pi++;
-              pj++;
-              
-            } else {
-              /* Shouldn't happen */
-              abort();
-            }
+          } else if (ps->c == 3) {
+            sph_argb_downRGB(&argb);
+            pi[0] = (uint8_t) argb.r;
+            pi[1] = (uint8_t) argb.g;
+            pi[2] = (uint8_t) argb.b;
+            pi += 3;
+            
+          } else if (ps->c == 1) {
+            sph_argb_downGray(&argb);
+            *pi = (uint8_t) argb.g;
+            pi++;
             
           } else {
             /* Shouldn't happen */
             abort();
-          }
+          }          
         }
       }
       
@@ -1002,28 +10548,116 @@ int skvm_load_jpeg(int32_t i, const char *pPath) {
     }
   }
   
-  /* Release scanline buffer if allocated */
-  if (psl != NULL) {
-    free(psl);
-    psl = NULL;
-  }
-  
   /* Release image reader object if allocated */
-  sph_jpeg_reader_free(pr);
+  sph_image_reader_close(pr);
   pr = NULL;
   
+  /* If keeping warm state, add the decoded image to the asset cache, or
+   * abandon its pending cache entry if decoding failed */
+  if (warm) {
+    if (status) {
+      asset_store(ps, pPath, -1);
+    } else {
+      asset_abandon(pPath, -1);
+    }
+  }
+  
+  /* If we failed, unload register if loaded */
+  if (!status) {
+    buf_release(ps);
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * skvm_load_jpeg function.
+ */
+int skvm_load_jpeg(SKVM_CTX *pv, int32_t i, const char *pPath) {
+  
+  int status = 1;
+  int warm = 0;
+  int cached = 0;
+  
+  SKSTAMP fst;
+  
+  FILE *pf = NULL;
+  SKBUF *ps = NULL;
+  
+  /* Initialize structures */
+  memset(&fst, 0, sizeof(SKSTAMP));
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) || (pPath == NULL)) {
+    abort();
+  }
+  
+  /* Wait for any pending stores, in case one of them writes the file
+   * to be loaded */
+  store_finish(pv, 0);
+  
+  /* Float buffers are not supported */
+  if ((pv->pbuf[i]).fp) {
+    abort();
+  }
+  
+  /* Get buffer register */
+  ps = &(pv->pbuf[i]);
+  
+  /* If keeping warm state, try to load from the asset cache */
+  warm = is_warm();
+  if (warm) {
+    if (file_stamp(pPath, &fst)) {
+      cached = asset_fetch(ps, pPath, -1, &fst);
+    } else {
+      warm = 0;
+    }
+  }
+  if (cached) {
+    return status;
+  }
+  
+  /* Allocate a private buffer for the register, if we don't already
+   * have one */
+  buf_alloc(ps);
+  
+  /* Open JPEG file */
+  pf = fopen(pPath, "rb");
+  if (pf == NULL) {
+    status = 0;
+    pv->pErr = "Failed to open JPEG file";
+  }
+  
+  /* Decode the image into the buffer */
+  if (status) {
+    status = jpeg_decode(pv, ps, pf);
+  }
+  
   /* Close file handle if open */
   if (pf != NULL) {
     fclose(pf);
     pf = NULL;
   }
   
+  /* If keeping warm state, add the decoded image to the asset cache, or
+   * abandon its pending cache entry if decoding failed */
+  if (warm) {
+    if (status) {
+      asset_store(ps, pPath, -1);
+    } else {
+      asset_abandon(pPath, -1);
+    }
+  }
+  
   /* If we failed, unload register if loaded */
   if (!status) {
-    if (ps->pData != NULL) {
-      free(ps->pData);
-      ps->pData = NULL;
-    }
+    buf_release(ps);
   }
   
   /* Return status */
@@ -1033,53 +10667,54 @@ int skvm_load_jpeg(int32_t i, const char *pPath) {
 /*
  * skvm_load_mjpg function.
  */
-int skvm_load_mjpg(int32_t i, int32_t f, const char *pIndexPath) {
+int skvm_load_mjpg(
+    SKVM_CTX    * pv,
+    int32_t       i,
+    int32_t       f,
+    const char  * pIndexPath) {
   
   int status = 1;
+  int warm = 0;
+  int cached = 0;
   int32_t x = 0;
   int32_t y = 0;
-  int src_c = 0;
   int32_t last_dot = 0;
   int32_t last_sep = 0;
   uint64_t total_frames = 0;
   uint64_t frame_offs = 0;
   
+  SKSTAMP dst;
+  
   FILE *pf = NULL;
   SKBUF *ps = NULL;
-  SPH_JPEG_READER *pr = NULL;
   
   char *pJPEGPath = NULL;
-  uint8_t *pi = NULL;
-  uint8_t *pj = NULL;
-  uint8_t *psl = NULL;
-  
-  SPH_ARGB argb;
   
   /* Initialize structures */
-  memset(&argb, 0, sizeof(SPH_ARGB));
+  memset(&dst, 0, sizeof(SKSTAMP));
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
   /* Check parameters, except f */
-  if ((i < 0) || (i >= m_bufc) || (pIndexPath == NULL)) {
+  if ((i < 0) || (i >= pv->bufc) || (pIndexPath == NULL)) {
     abort();
   }
   
-  /* Get buffer register */
-  ps = &(m_pbuf[i]);
+  /* Wait for any pending stores, in case one of them writes the file
+   * to be loaded */
+  store_finish(pv, 0);
   
-  /* Allocate a buffer for the register, if we don't already have one */
-  if (ps->pData == NULL) {
-    ps->pData = (uint8_t *) malloc((size_t)
-                              (ps->w * ps->h * ((int32_t) ps->c)));
-    if (ps->pData == NULL) {
-      abort();
-    }
+  /* Float buffers are not supported */
+  if ((pv->pbuf[i]).fp) {
+    abort();
   }
   
+  /* Get buffer register */
+  ps = &(pv->pbuf[i]);
+  
   /* Find the index of the last dot and the last forward or backslash in
    * the index file path */
   last_dot = -1;
@@ -1102,12 +10737,12 @@ int skvm_load_mjpg(int32_t i, int32_t f, const char *pIndexPath) {
    * not the first character */
   if (last_dot <= 0) {
     status = 0;
-    m_perr = "Invalid index file path";
+    pv->pErr = "Invalid index file path";
   }
   if (status && (last_sep >= 0)) {
     if (last_sep > last_dot) {
       status = 0;
-      m_perr = "Invalid index file path";
+      pv->pErr = "Invalid index file path";
     }
   }
   
@@ -1121,23 +10756,37 @@ int skvm_load_mjpg(int32_t i, int32_t f, const char *pIndexPath) {
     memcpy(pJPEGPath, pIndexPath, (size_t) last_dot);
   }
   
+  /* If keeping warm state, look up the frame in the open sequence and
+   * try to load the frame from the asset cache; otherwise, read the
+   * frame offset from the index file */
+  if (status && is_warm()) {
+    warm = 1;
+    if (!mjpg_frame(pv, pIndexPath, pJPEGPath, f,
+            &frame_offs, &dst, &pf)) {
+      status = 0;
+    }
+    if (status) {
+      cached = asset_fetch(ps, pIndexPath, f, &dst);
+    }
+  }
+  
   /* Open index file */
-  if (status) {
+  if (status && (!warm)) {
     pf = fopen(pIndexPath, "rb");
     if (pf == NULL) {
       status = 0;
-      m_perr = "Failed to open index file";
+      pv->pErr = "Failed to open index file";
     }
   }
   
   /* Read first eight bytes as big-endian integer to get count of
    * frames */
-  if (status) {
+  if (status && (!warm)) {
     for(x = 0; x < 8; x++) {
       y = getc(pf);
       if (y == EOF) {
         status = 0;
-        m_perr = "Invalid index file";
+        pv->pErr = "Invalid index file";
         break;
       }
       total_frames = (total_frames << 8) | y;
@@ -1145,51 +10794,51 @@ int skvm_load_mjpg(int32_t i, int32_t f, const char *pIndexPath) {
   }
   
   /* Check that given frame index is in range */
-  if (status) {
+  if (status && (!warm)) {
     if ((f < 0) || (f >= total_frames)) {
       status = 0;
-      m_perr = "Invalid frame index";
+      pv->pErr = "Invalid frame index";
     }
   }
   
   /* Add one to the frame index, watching for overflow, so that it is
    * the integer offset within the index file */
-  if (status) {
+  if (status && (!warm)) {
     if (f < INT32_MAX) {
       f++;
     } else {
       status = 0;
-      m_perr = "Frame index overflow";
+      pv->pErr = "Frame index overflow";
     }
   }
   
   /* Multiply the adjusted frame index by eight, watching for overflow,
    * so that it is the byte offset of the appropriate record within the
    * index file */
-  if (status) {
+  if (status && (!warm)) {
     if (f <= INT32_MAX / 8) {
       f *= 8;
     } else {
       status = 0;
-      m_perr = "Frame index overflow";
+      pv->pErr = "Frame index overflow";
     }
   }
   
   /* Seek to the appropriate location in the index file */
-  if (status) {
+  if (status && (!warm)) {
     if (fseeko(pf, (off_t) f, SEEK_SET)) {
       status = 0;
-      m_perr = "Index seek error";
+      pv->pErr = "Index seek error";
     }
   }
   
   /* Read eight bytes as big-endian integer to get offset of frame */
-  if (status) {
+  if (status && (!warm)) {
     for(x = 0; x < 8; x++) {
       y = getc(pf);
       if (y == EOF) {
         status = 0;
-        m_perr = "Invalid index file";
+        pv->pErr = "Invalid index file";
         break;
       }
       frame_offs = (frame_offs << 8) | y;
@@ -1197,201 +10846,78 @@ int skvm_load_mjpg(int32_t i, int32_t f, const char *pIndexPath) {
   }
   
   /* Close index file */
-  if (status) {
+  if (status && (!warm)) {
     fclose(pf);
     pf = NULL;
   }
   
   /* If frame offset is beyond signed 32-bit range, make sure off_t is
    * eight bytes, indicating 64-bit file mode */
-  if (status && (frame_offs > INT32_MAX)) {
-    if (sizeof(off_t) < 8) {
-      status = 0;
-      m_perr = "64-bit file mode required";
-    }
-  }
-  
-  /* Open JPEG file */
-  if (status) {
-    pf = fopen(pJPEGPath, "rb");
-    if (pf == NULL) {
-      status = 0;
-      m_perr = "Failed to open JPEG file";
-    }
-  }
-  
-  /* Seek to start of frame */
-  if (status) {
-    if (fseeko(pf, (off_t) frame_offs, SEEK_SET)) {
-      status = 0;
-      m_perr = "MJPEG seek error";
-    }
-  }
-  
-  /* Allocate JPEG reader on file */
-  if (status) {
-    pr = sph_jpeg_reader_new(pf);
-    if (sph_jpeg_reader_status(pr) != SPH_JPEG_ERR_OK) {
-      status = 0;
-      m_perr = sph_jpeg_errstr(sph_jpeg_reader_status(pr));
-    }
-  }
-  
-  /* Make sure dimensions of JPEG image match dimensions of buffer */
-  if (status) {
-    if ((ps->w != sph_jpeg_reader_width(pr)) ||
-        (ps->h != sph_jpeg_reader_height(pr))) {
-      status = 0;
-      m_perr = "JPEG file mismatches dimensions of buffer";
-    }
-  }
-  
-  /* Get the JPEG channel count */
-  if (status) {
-    src_c = sph_jpeg_reader_channels(pr);
-  }
-  
-  /* Allocate scanline buffer */
-  if (status) {
-    psl = (uint8_t *) calloc((size_t) ps->w, (size_t) src_c);
-    if (psl == NULL) {
-      abort();
-    }
-  }
-  
-  /* Read each scanline into the buffer */
-  if (status) {
-    pi = ps->pData;
-    for(y = 0; y < ps->h; y++) {
-      /* Read a scanline */
-      if (!sph_jpeg_reader_get(pr, psl)) {
-        status = 0;
-        m_perr = sph_jpeg_errstr(sph_jpeg_reader_status(pr));
-      }
-      
-      /* Transfer each pixel into the buffer */
-      if (status) {
-        pj = psl;
-        for(x = 0; x < ps->w; x++) {
-          /* Transfer appropriately */
-          if (ps->c == 4) {
-            if (src_c == 3) {
-              /* Expand RGB->ARGB */
-              pi[0] = (uint8_t) 255;
-              pi[1] = pj[0];
-              pi[2] = pj[1];
-              pi[3] = pj[2];
-              
-              pi += 4;
-              pj += 3;
-              
-            } else if (src_c == 1) {
-              /* Expand gray->ARGB */
-              pi[0] = (uint8_t) 255;
-              pi[1] = *pj;
-              pi[2] = *pj;
-              pi[3] = *pj;
-              
-              pi += 4;
-              pj++;
-              
-            } else {
-              /* Shouldn't happen */
-              abort();
-            }
-            
-          } else if (ps->c == 3) {
-            if (src_c == 3) {
-              /* RGB -> RGB */
-              pi[0] = pj[0];
-              pi[1] = pj[1];
-              pi[2] = pj[2];
-              
-              pi += 3;
-              pj += 3;
-              
-            } else if (src_c == 1) {
-              /* Expand gray->RGB */
-              pi[0] = *pj;
-              pi[1] = *pj;
-              pi[2] = *pj;
-              
-              pi += 3;
-              pj++;
-              
-            } else {
-              /* Shouldn't happen */
-              abort();
-            }
-            
-          } else if (ps->c == 1) {
-            if (src_c == 3) {
-              /* Downconvert RGB->gray */
-              argb.a = 255;
-              argb.r = pj[0];
-              argb.g = pj[1];
-              argb.b = pj[2];
-              sph_argb_downGray(&argb);
-              
-              *pi = (uint8_t) argb.g;
-              
-              pi++;
-              pj += 3;
-              
-            } else if (src_c == 1) {
-              /* Gray -> gray */
-              *pi = *pj;
-              
-              pi++;
-              pj++;
-              
-            } else {
-              /* Shouldn't happen */
-              abort();
-            }
-            
-          } else {
-            /* Shouldn't happen */
-            abort();
-          }
-        }
-      }
-      
-      /* Leave loop if error */
-      if (!status) {
-        break;
+  if (status && (!warm) &&
+      (frame_offs > INT32_MAX)) {
+    if (sizeof(off_t) < 8) {
+      status = 0;
+      pv->pErr = "64-bit file mode required";
+    }
+  }
+  
+  /* Open JPEG file, unless we already checked out the open file of the
+   * sequence */
+  if (status && (!cached)) {
+    if (pf == NULL) {
+      pf = fopen(pJPEGPath, "rb");
+      if (pf == NULL) {
+        status = 0;
+        pv->pErr = "Failed to open JPEG file";
       }
     }
   }
   
+  /* Seek to start of frame */
+  if (status && (!cached)) {
+    if (fseeko(pf, (off_t) frame_offs, SEEK_SET)) {
+      status = 0;
+      pv->pErr = "MJPEG seek error";
+    }
+  }
+  
+  /* Allocate a private buffer for the register, if we don't already
+   * have one, and decode the frame into it */
+  if (status && (!cached)) {
+    buf_alloc(ps);
+    status = jpeg_decode(pv, ps, pf);
+  }
+  
+  /* If keeping warm state, add the decoded frame to the asset cache, or
+   * abandon its pending cache entry if decoding failed */
+  if (warm && (!cached)) {
+    if (status) {
+      asset_store(ps, pIndexPath, f);
+    } else {
+      asset_abandon(pIndexPath, f);
+    }
+  }
+  
   /* Release JPEG path if allocated */
   if (pJPEGPath != NULL) {
     free(pJPEGPath);
     pJPEGPath = NULL;
   }
   
-  /* Release scanline buffer if allocated */
-  if (psl != NULL) {
-    free(psl);
-    psl = NULL;
-  }
-  
-  /* Release image reader object if allocated */
-  sph_jpeg_reader_free(pr);
-  pr = NULL;
-  
-  /* Close file handle if open */
+  /* Give the file handle back to the open sequence if keeping warm
+   * state, else close it if open */
   if (pf != NULL) {
-    fclose(pf);
+    if (warm) {
+      mjpg_return(pIndexPath, pf, &dst);
+    } else {
+      fclose(pf);
+    }
     pf = NULL;
   }
   
   /* If we failed, unload register if loaded */
   if (!status) {
-    if (ps->pData != NULL) {
-      free(ps->pData);
-      ps->pData = NULL;
-    }
+    buf_release(ps);
   }
   
   /* Return status */
@@ -1401,26 +10927,37 @@ int skvm_load_mjpg(int32_t i, int32_t f, const char *pIndexPath) {
 /*
  * skvm_load_fill function.
  */
-void skvm_load_fill(int32_t i, int a, int r, int g, int b) {
+void skvm_load_fill(
+    SKVM_CTX    * pv,
+    int32_t       i,
+    int           a,
+    int           r,
+    int           g,
+    int           b) {
   
   int32_t x = 0;
   int32_t y = 0;
   
   SKBUF *ps = NULL;
   uint8_t  *pi = NULL;
+  float    *pf = NULL;
   
   SPH_ARGB argb;
+  SKARGB fcol;
+  float fill[4];
   
   /* Initialize structures */
   memset(&argb, 0, sizeof(SPH_ARGB));
+  memset(&fcol, 0, sizeof(SKARGB));
+  memset(fill, 0, sizeof(float) * 4);
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
   /* Check parameters */
-  if ((i < 0) || (i >= m_bufc) ||
+  if ((i < 0) || (i >= pv->bufc) ||
       (a < 0) || (a > 255) ||
       (r < 0) || (r > 255) ||
       (g < 0) || (g > 255) ||
@@ -1429,15 +10966,27 @@ void skvm_load_fill(int32_t i, int a, int r, int g, int b) {
   }
   
   /* Get buffer register */
-  ps = &(m_pbuf[i]);
+  ps = &(pv->pbuf[i]);
   
   /* Allocate a buffer for the register, if we don't already have one */
-  if (ps->pData == NULL) {
-    ps->pData = (uint8_t *) malloc((size_t)
-                              (ps->w * ps->h * ((int32_t) ps->c)));
-    if (ps->pData == NULL) {
-      abort();
+  buf_alloc(ps);
+  
+  /* Float buffers are filled with the premultiplied color */
+  if (ps->fp) {
+    fcol.a = ((double) a) / 255.0;
+    fcol.r = (((double) r) / 255.0) * fcol.a;
+    fcol.g = (((double) g) / 255.0) * fcol.a;
+    fcol.b = (((double) b) / 255.0) * fcol.a;
+    store_float(&fcol, fill);
+    
+    pf = (float *) ps->pData;
+    for(y = 0; y < ps->h; y++) {
+      for(x = 0; x < ps->w; x++) {
+        memcpy(pf, fill, sizeof(float) * 4);
+        pf += 4;
+      }
     }
+    return;
   }
   
   /* Store color in structure */
@@ -1460,326 +11009,570 @@ void skvm_load_fill(int32_t i, int a, int r, int g, int b) {
     }
   }
   
-  /* Fill the buffer with the color */
-  pi = ps->pData;
-  for(y = 0; y < ps->h; y++) {
-    for(x = 0; x < ps->w; x++) {
-      /* Copy pixel fill color */
-      if (ps->c == 4) {
-        pi[0] = (uint8_t) argb.a;
-        pi[1] = (uint8_t) argb.r;
-        pi[2] = (uint8_t) argb.g;
-        pi[3] = (uint8_t) argb.b;
-        pi += 4;
-        
-      } else if (ps->c == 3) {
-        pi[0] = (uint8_t) argb.r;
-        pi[1] = (uint8_t) argb.g;
-        pi[2] = (uint8_t) argb.b;
-        pi += 3;
-        
-      } else if (ps->c == 1) {
-        *pi = (uint8_t) argb.g;
-        pi++;
-        
-      } else {
-        /* Shouldn't happen */
-        abort();
-      }          
-    }
+  /* Fill the buffer with the color */
+  pi = ps->pData;
+  for(y = 0; y < ps->h; y++) {
+    for(x = 0; x < ps->w; x++) {
+      /* Copy pixel fill color */
+      if (ps->c == 4) {
+        pi[0] = (uint8_t) argb.a;
+        pi[1] = (uint8_t) argb.r;
+        pi[2] = (uint8_t) argb.g;
+        pi[3] = (uint8_t) argb.b;
+        pi += 4;
+        
+      } else if (ps->c == 3) {
+        pi[0] = (uint8_t) argb.r;
+        pi[1] = (uint8_t) argb.g;
+        pi[2] = (uint8_t) argb.b;
+        pi += 3;
+        
+      } else if (ps->c == 1) {
+        *pi = (uint8_t) argb.g;
+        pi++;
+        
+      } else {
+        /* Shouldn't happen */
+        abort();
+      }          
+    }
+  }
+}
+
+/*
+ * skvm_load_mask function.
+ */
+int skvm_load_mask(SKVM_CTX *pv, int32_t i, const char *pPath) {
+  
+  int status = 1;
+  int errn = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  
+  SKBUF *ps = NULL;
+  SKRLE *pRle = NULL;
+  SPH_IMAGE_READER *pr = NULL;
+  
+  uint8_t  *pRow = NULL;
+  uint32_t *psl = NULL;
+  
+  SPH_ARGB argb;
+  
+  /* Initialize structures */
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) || (pPath == NULL)) {
+    abort();
+  }
+  
+  /* Wait for any pending stores, in case one of them writes the file
+   * to be loaded */
+  store_finish(pv, 0);
+  
+  /* Get buffer register and check that it is grayscale */
+  ps = &(pv->pbuf[i]);
+  if (ps->c != 1) {
+    abort();
+  }
+  
+  /* Release anything currently in the register */
+  buf_release(ps);
+  
+  /* Allocate PNG image reader on file */
+  pr = sph_image_reader_newFromPath(pPath, &errn);
+  if (pr == NULL) {
+    status = 0;
+    pv->pErr = sph_image_errorString(errn);
+  }
+  
+  /* Make sure dimensions of PNG image match dimensions of buffer */
+  if (status) {
+    if ((ps->w != sph_image_reader_width(pr)) ||
+        (ps->h != sph_image_reader_height(pr))) {
+      status = 0;
+      pv->pErr = "PNG file mismatches dimensions of buffer";
+    }
+  }
+  
+  /* Allocate the compressed mask and a scanline of mask values */
+  if (status) {
+    pRle = rle_new(ps->h);
+    pRow = (uint8_t *) malloc((size_t) ps->w);
+    if (pRow == NULL) {
+      abort();
+    }
+  }
+  
+  /* Read and compress each scanline */
+  if (status) {
+    for(y = 0; y < ps->h; y++) {
+      /* Read a scanline */
+      psl = sph_image_reader_read(pr, &errn);
+      if (psl == NULL) {
+        status = 0;
+        pv->pErr = sph_image_errorString(errn);
+        break;
+      }
+      
+      /* Convert each pixel to grayscale */
+      for(x = 0; x < ps->w; x++) {
+        sph_argb_unpack(psl[x], &argb);
+        sph_argb_downGray(&argb);
+        pRow[x] = (uint8_t) argb.g;
+      }
+      
+      /* Compress the scanline */
+      rle_add_row(pRle, y, pRow, ps->w);
+    }
+  }
+  
+  /* Release image reader object and scanline if allocated */
+  sph_image_reader_close(pr);
+  pr = NULL;
+  
+  free(pRow);
+  pRow = NULL;
+  
+  /* If successful, place the compressed mask in the register, else
+   * free it */
+  if (status) {
+    ps->pRle = pRle;
+  } else {
+    rle_free(pRle);
+  }
+  pRle = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * skvm_probe_png function.
+ */
+int skvm_probe_png(
+          SKVM_CTX  * pv,
+    const char      * pPath,
+          int32_t   * pw,
+          int32_t   * ph) {
+  
+  int status = 1;
+  int errn = 0;
+  int32_t w = 0;
+  int32_t h = 0;
+  SPH_IMAGE_READER *pr = NULL;
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((pPath == NULL) || (pw == NULL) || (ph == NULL)) {
+    abort();
+  }
+  
+  /* Wait for any pending stores, in case one of them writes the file */
+  store_finish(pv, 0);
+  
+  /* Open a PNG image reader on the file, which reads the header */
+  pr = sph_image_reader_newFromPath(pPath, &errn);
+  if (pr == NULL) {
+    status = 0;
+    pv->pErr = sph_image_errorString(errn);
+  }
+  
+  /* Get the dimensions and check that a buffer can hold them */
+  if (status) {
+    w = sph_image_reader_width(pr);
+    h = sph_image_reader_height(pr);
+    if ((w < 1) || (w > SKVM_MAX_DIM) || (h < 1) || (h > SKVM_MAX_DIM)) {
+      status = 0;
+      pv->pErr = "PNG file dimensions out of range";
+    }
+  }
+  
+  /* Release the reader */
+  sph_image_reader_close(pr);
+  pr = NULL;
+  
+  /* Return the dimensions if successful */
+  if (status) {
+    *pw = w;
+    *ph = h;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * skvm_load_atlas function.
+ */
+int skvm_load_atlas(SKVM_CTX *pv, int32_t i, const char *pPath) {
+  
+  int status = 1;
+  int32_t w = 0;
+  int32_t h = 0;
+  char *pSheetPath = NULL;
+  char sheet[SKVM_ATLAS_MAX_NAME + 1];
+  
+  FILE *pf = NULL;
+  SKATLAS *pa = NULL;
+  
+  /* Initialize structures */
+  memset(sheet, 0, SKVM_ATLAS_MAX_NAME + 1);
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) || (pPath == NULL)) {
+    abort();
+  }
+  
+  /* Wait for any pending stores, in case one of them writes the sheet
+   * or the table */
+  store_finish(pv, 0);
+  
+  /* Read the atlas table */
+  pa = (SKATLAS *) calloc(1, sizeof(SKATLAS));
+  if (pa == NULL) {
+    abort();
+  }
+  
+  pf = fopen(pPath, "r");
+  if (pf == NULL) {
+    status = 0;
+    pv->pErr = "Failed to open atlas table";
+  }
+  if (status) {
+    status = atlas_parse(pv, pf, pa, sheet, &w, &h);
+  }
+  if (pf != NULL) {
+    fclose(pf);
+    pf = NULL;
+  }
+  
+  /* The sheet file is in the same directory as the table */
+  if (status) {
+    pSheetPath = sheet_path(pPath, sheet);
+  }
+  
+  /* Reset the register to the sheet dimensions and load the sheet */
+  skvm_reset(pv, i, 1, 1, 4);
+  if (status) {
+    skvm_reset(pv, i, w, h, 4);
+    status = skvm_load_png(pv, i, pSheetPath);
+  }
+  
+  /* If successful, attach the table to the register, else release the
+   * register along with anything partially loaded */
+  if (status) {
+    (pv->pbuf[i]).pAtlas = pa;
+    pa = NULL;
+  } else {
+    skvm_reset(pv, i, 1, 1, 4);
+  }
+  
+  /* Release anything left over */
+  atlas_free(pa);
+  pa = NULL;
+  
+  free(pSheetPath);
+  pSheetPath = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * skvm_atlas_count function.
+ */
+int32_t skvm_atlas_count(SKVM_CTX *pv, int32_t i) {
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc)) {
+    abort();
+  }
+  
+  /* Return the number of sub-images, if any */
+  if ((pv->pbuf[i]).pAtlas == NULL) {
+    return 0;
+  }
+  return ((pv->pbuf[i]).pAtlas)->count;
+}
+
+/*
+ * skvm_atlas_find function.
+ */
+int32_t skvm_atlas_find(SKVM_CTX *pv, int32_t i, const char *pName) {
+  
+  const SKATLAS *pa = NULL;
+  const SKSPRITE * const *ppFound = NULL;
+  SKSPRITE key;
+  const SKSPRITE *pKey = NULL;
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) || (pName == NULL)) {
+    abort();
+  }
+  
+  /* No match if there is no table or the name is too long */
+  pa = (pv->pbuf[i]).pAtlas;
+  if ((pa == NULL) || (strlen(pName) > SKVM_ATLAS_MAX_NAME)) {
+    return -1;
+  }
+  
+  /* Binary search the name index */
+  memset(&key, 0, sizeof(SKSPRITE));
+  strcpy(key.name, pName);
+  pKey = &key;
+  ppFound = (const SKSPRITE * const *) bsearch(
+              &pKey, (const void *) pa->ppName, (size_t) pa->count,
+              sizeof(const SKSPRITE *), &atlas_cmp);
+  if (ppFound == NULL) {
+    return -1;
   }
+  
+  /* Return the index of the sub-image */
+  return (int32_t) (*ppFound - pa->pSprite);
 }
 
 /*
- * skvm_store_png function.
+ * skvm_atlas_get function.
+ */
+void skvm_atlas_get(
+    SKVM_CTX  * pv,
+    int32_t     i,
+    int32_t     k,
+    int32_t   * px,
+    int32_t   * py,
+    int32_t   * pw,
+    int32_t   * ph) {
+  
+  const SKSPRITE *ps = NULL;
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) ||
+      (px == NULL) || (py == NULL) || (pw == NULL) || (ph == NULL)) {
+    abort();
+  }
+  if ((pv->pbuf[i]).pAtlas == NULL) {
+    abort();
+  }
+  if ((k < 0) || (k >= ((pv->pbuf[i]).pAtlas)->count)) {
+    abort();
+  }
+  
+  /* Return the rectangle */
+  ps = &((((pv->pbuf[i]).pAtlas)->pSprite)[k]);
+  *px = ps->x;
+  *py = ps->y;
+  *pw = ps->w;
+  *ph = ps->h;
+}
+
+/*
+ * skvm_load_font function.
  */
-int skvm_store_png(int32_t i, const char *pPath) {
+int skvm_load_font(SKVM_CTX *pv, int32_t i, const char *pPath) {
   
   int status = 1;
-  int errn = 0;
-  int dconv = 0;
-  int32_t x = 0;
-  int32_t y = 0;
-  
-  SKBUF *ps = NULL;
-  SPH_IMAGE_WRITER *pw = NULL;
-  uint32_t *psl = NULL;
-  uint8_t *pi = NULL;
-  uint32_t *pj = NULL;
+  char *pSheetPath = NULL;
+  char sheet[SKVM_ATLAS_MAX_NAME + 1];
   
-  SPH_ARGB argb;
+  FILE *pf = NULL;
+  SKFONT *pFont = NULL;
   
   /* Initialize structures */
-  memset(&argb, 0, sizeof(SPH_ARGB));
+  memset(sheet, 0, SKVM_ATLAS_MAX_NAME + 1);
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
   /* Check parameters */
-  if ((i < 0) || (i >= m_bufc) || (pPath == NULL)) {
+  if ((i < 0) || (i >= pv->bufc) || (pPath == NULL)) {
     abort();
   }
   
-  /* Get buffer register */
-  ps = &(m_pbuf[i]);
+  /* Wait for any pending stores, in case one of them writes the sheet
+   * or the table */
+  store_finish(pv, 0);
   
-  /* Fail if buffer is not loaded */
-  if (ps->pData == NULL) {
-    status = 0;
-    m_perr = "Buffer must be full to store";
+  /* Read the font table */
+  pFont = (SKFONT *) calloc(1, sizeof(SKFONT));
+  if (pFont == NULL) {
+    abort();
   }
   
-  /* Based on number of channels, determine down-conversion setting */
+  pf = fopen(pPath, "r");
+  if (pf == NULL) {
+    status = 0;
+    pv->pErr = "Failed to open font table";
+  }
   if (status) {
-    if (ps->c == 4) {
-      /* ARGB buffer, so no down-conversion */
-      dconv = SPH_IMAGE_DOWN_NONE;
-      
-    } else if (ps->c == 3) {
-      /* RGB buffer, so RGB down-conversion */
-      dconv = SPH_IMAGE_DOWN_RGB;
-      
-    } else if (ps->c == 1) {
-      /* Grayscale buffer, so grayscale down-conversion */
-      dconv = SPH_IMAGE_DOWN_GRAY;
-      
-    } else {
-      /* Shouldn't happen */
-      abort();
-    }
+    status = font_parse(pv, pf, pFont, sheet);
+  }
+  if (pf != NULL) {
+    fclose(pf);
+    pf = NULL;
   }
   
-  /* Create the writer object */
+  /* The sheet file is in the same directory as the table */
   if (status) {
-    pw = sph_image_writer_newFromPath(
-          pPath, ps->w, ps->h, dconv, 0, &errn);
-    if (pw == NULL) {
-      status = 0;
-      m_perr = sph_image_errorString(errn);
-    }
+    pSheetPath = sheet_path(pPath, sheet);
   }
   
-  /* Get the scanline buffer */
+  /* Reset the register to the sheet dimensions and load the sheet */
+  skvm_reset(pv, i, 1, 1, 4);
   if (status) {
-    psl = sph_image_writer_ptr(pw);
+    skvm_reset(pv, i, pFont->w, pFont->h, 4);
+    status = skvm_load_png(pv, i, pSheetPath);
   }
   
-  /* Write each scanline */
+  /* If successful, take the glyph coverage from the sheet and attach
+   * the font to the register, else release the register along with
+   * anything partially loaded */
   if (status) {
-    pi = ps->pData;
-    for(y = 0; y < ps->h; y++) {
-      /* Write all data to the scanline */
-      pj = psl;
-      for(x = 0; x < ps->w; x++) {
-        /* Fill the ARGB structure */
-        if (ps->c == 4) {
-          argb.a = pi[0];
-          argb.r = pi[1];
-          argb.g = pi[2];
-          argb.b = pi[3];
-          
-          pi += 4;
-          
-        } else if (ps->c == 3) {
-          argb.a = 255;
-          argb.r = pi[0];
-          argb.g = pi[1];
-          argb.b = pi[2];
-          
-          pi += 3;
-          
-        } else if (ps->c == 1) {
-          argb.a = 255;
-          argb.r = *pi;
-          argb.g = *pi;
-          argb.b = *pi;
-          
-          pi++;
-          
-        } else {
-          /* Shouldn't happen */
-          abort();
-        }
-        
-        /* Write the packed color */
-        *pj = sph_argb_pack(&argb);
-        pj++;
-      }
-      
-      /* Write the scanline to the file */
-      sph_image_writer_write(pw);
-    }
+    buf_settle(&(pv->pbuf[i]));
+    font_cover(pFont, &(pv->pbuf[i]));
+    (pv->pbuf[i]).pFont = pFont;
+    pFont = NULL;
+  } else {
+    skvm_reset(pv, i, 1, 1, 4);
   }
   
-  /* Free writer if allocated */
-  sph_image_writer_close(pw);
-  pw = NULL;
+  /* Release anything left over */
+  font_free(pFont);
+  pFont = NULL;
+  
+  free(pSheetPath);
+  pSheetPath = NULL;
   
   /* Return status */
   return status;
 }
 
 /*
- * skvm_store_jpeg function.
+ * skvm_has_font function.
  */
-int skvm_store_jpeg(int32_t i, const char *pPath, int mjpg, int q) {
-  
-  int status = 1;
-  int chcount = 0;
-  const char *pMode = NULL;
-  int32_t x = 0;
-  int32_t y = 0;
+int skvm_has_font(SKVM_CTX *pv, int32_t i) {
   
-  SKBUF *ps = NULL;
-  SPH_JPEG_WRITER *pw = NULL;
-  FILE *pf = NULL;
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
   
-  uint8_t *psl = NULL;
-  uint8_t *pi = NULL;
-  uint8_t *pj = NULL;
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc)) {
+    abort();
+  }
   
-  SPH_ARGB argb;
+  /* Check for a font */
+  if ((pv->pbuf[i]).pFont == NULL) {
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * skvm_store_png function.
+ */
+int skvm_store_png(SKVM_CTX *pv, int32_t i, const char *pPath) {
   
-  /* Initialize structures */
-  memset(&argb, 0, sizeof(SPH_ARGB));
+  int status = 1;
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
   /* Check parameters */
-  if ((i < 0) || (i >= m_bufc) || (pPath == NULL)) {
+  if ((i < 0) || (i >= pv->bufc) || (pPath == NULL)) {
     abort();
   }
   
-  /* Get buffer register */
-  ps = &(m_pbuf[i]);
-  
   /* Fail if buffer is not loaded */
-  if (ps->pData == NULL) {
+  if ((pv->pbuf[i]).pData == NULL) {
     status = 0;
-    m_perr = "Buffer must be full to store";
-  }
-  
-  /* Based on number of channels, determine JPEG channels */
-  if (status) {
-    if (ps->c == 4) {
-      /* ARGB buffer, but JPEG only supports RGB, so set to three */
-      chcount = 3;
-      
-    } else if (ps->c == 3) {
-      /* RGB buffer, so three channels */
-      chcount = 3;
-      
-    } else if (ps->c == 1) {
-      /* Grayscale buffer, so one channel */
-      chcount = 1;
-      
-    } else {
-      /* Shouldn't happen */
-      abort();
-    }
+    pv->pErr = "Buffer must be full to store";
   }
   
-  /* Based on the mjpg flag, determine opening mode for file */
-  if (status) {
-    if (mjpg) {
-      pMode = "ab";
-    } else {
-      pMode = "wb";
-    }
-  }
-  
-  /* Open the file */
+  /* Store the buffer */
   if (status) {
-    pf = fopen(pPath, pMode);
-    if (pf == NULL) {
-      status = 0;
-      m_perr = "Failed to create JPEG file";
-    }
+    status = store_submit(pv, &(pv->pbuf[i]), STORE_PNG, pPath, 0);
   }
   
-  /* Create the writer object */
-  if (status) {
-    pw = sph_jpeg_writer_new(pf, ps->w, ps->h, chcount, q);
-  }
+  /* Return status */
+  return status;
+}
+
+/*
+ * skvm_store_jpeg function.
+ */
+int skvm_store_jpeg(
+    SKVM_CTX    * pv,
+    int32_t       i,
+    const char  * pPath,
+    int           mjpg,
+    int           q) {
   
-  /* Allocate the scanline buffer */
-  if (status) {
-    psl = (uint8_t *) calloc((size_t) ps->w, (size_t) chcount);
-    if (psl == NULL) {
-      abort();
-    }
-  }
+  int status = 1;
+  int kind = 0;
   
-  /* Write each scanline */
-  if (status) {
-    pi = ps->pData;
-    for(y = 0; y < ps->h; y++) {
-      /* Write all data to the scanline */
-      pj = psl;
-      for(x = 0; x < ps->w; x++) {
-        /* Different handling depending on buffer channels */
-        if (ps->c == 4) {
-          /* ARGB, so we need to down-convert to RGB */
-          argb.a = pi[0];
-          argb.r = pi[1];
-          argb.g = pi[2];
-          argb.b = pi[3];
-          
-          sph_argb_downRGB(&argb);
-          
-          pj[0] = (uint8_t) argb.r;
-          pj[1] = (uint8_t) argb.g;
-          pj[2] = (uint8_t) argb.b;
-          
-          pi += 4;
-          pj += 3;
-          
-        } else if (ps->c == 3) {
-          /* RGB -> RGB */
-          pj[0] = pi[0];
-          pj[1] = pi[1];
-          pj[2] = pi[2];
-          
-          pi += 3;
-          pj += 3;
-          
-        } else if (ps->c == 1) {
-          /* Gray -> gray */
-          *pj = *pi;
-          
-          pi++;
-          pj++;
-          
-        } else {
-          /* Shouldn't happen */
-          abort();
-        }
-      }
-      
-      /* Write the scanline to the file */
-      sph_jpeg_writer_put(pw, psl);
-    }
+  /* Check context */
+  if (pv == NULL) {
+    abort();
   }
   
-  /* Free writer if allocated */
-  sph_jpeg_writer_free(pw);
-  pw = NULL;
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) || (pPath == NULL)) {
+    abort();
+  }
   
-  /* Free scanline buffer if allocated */
-  if (psl != NULL) {
-    free(psl);
-    psl = NULL;
+  /* Fail if buffer is not loaded */
+  if ((pv->pbuf[i]).pData == NULL) {
+    status = 0;
+    pv->pErr = "Buffer must be full to store";
   }
   
-  /* Close file if open */
-  if (pf != NULL) {
-    fclose(pf);
-    pf = NULL;
+  /* Based on the mjpg flag, determine the kind of store */
+  if (status) {
+    if (mjpg) {
+      kind = STORE_MJPG;
+    } else {
+      kind = STORE_JPEG;
+    }
+  }
+  
+  /* Store the buffer */
+  if (status) {
+    status = store_submit(pv, &(pv->pbuf[i]), kind, pPath, q);
   }
   
   /* Return status */
@@ -1789,54 +11582,49 @@ int skvm_store_jpeg(int32_t i, const char *pPath, int mjpg, int q) {
 /*
  * skvm_matrix_reset function.
  */
-void skvm_matrix_reset(int32_t m) {
+void skvm_matrix_reset(SKVM_CTX *pv, int32_t m) {
   
   SKMAT *pm = NULL;
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
   /* Check parameters */
-  if ((m < 0) || (m >= m_matc)) {
+  if ((m < 0) || (m >= pv->matc)) {
     abort();
   }
   
   /* Get the selected matrix */
-  pm = &(m_pmat[m]);
-  
-  /* Reset to identity, with a cached inversion which is also the
-   * identity matrix */
-  memset(pm, 0, sizeof(SKMAT));
-  
-  pm->a = 1.0;    pm->b = 0.0;    pm->c = 0.0;
-  pm->d = 0.0;    pm->e = 1.0;    pm->f = 0.0;
+  pm = &(pv->pmat[m]);
   
-  pm->cached = (uint8_t) 1;
-  
-  pm->iva = 1.0;  pm->ivb = 0.0;  pm->ivc = 0.0;
-  pm->ivd = 0.0;  pm->ive = 1.0;  pm->ivf = 0.0;
+  /* Reset to identity */
+  matrix_identity(pm);
 }
 
 /*
  * skvm_matrix_multiply function.
  */
-void skvm_matrix_multiply(int32_t m, int32_t a, int32_t b) {
+void skvm_matrix_multiply(
+    SKVM_CTX    * pv,
+    int32_t       m,
+    int32_t       a,
+    int32_t       b) {
   
   SKMAT *pm = NULL;
   SKMAT *pa = NULL;
   SKMAT *pb = NULL;
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
   /* Check parameters */
-  if ((m < 0) || (m >= m_matc) ||
-      (a < 0) || (a >= m_matc) ||
-      (b < 0) || (b >= m_matc)) {
+  if ((m < 0) || (m >= pv->matc) ||
+      (a < 0) || (a >= pv->matc) ||
+      (b < 0) || (b >= pv->matc)) {
     abort();
   }
   if ((m == a) || (m == b)) {
@@ -1844,9 +11632,9 @@ void skvm_matrix_multiply(int32_t m, int32_t a, int32_t b) {
   }
   
   /* Get the selected matrices */
-  pm = &(m_pmat[m]);
-  pa = &(m_pmat[a]);
-  pb = &(m_pmat[b]);
+  pm = &(pv->pmat[m]);
+  pa = &(pv->pmat[a]);
+  pb = &(pv->pmat[b]);
   
   /* Perform multiplication */
   matrix_mul(pm, pa, pb);
@@ -1855,7 +11643,11 @@ void skvm_matrix_multiply(int32_t m, int32_t a, int32_t b) {
 /*
  * skvm_matrix_translate function.
  */
-void skvm_matrix_translate(int32_t m, double tx, double ty) {
+void skvm_matrix_translate(
+    SKVM_CTX    * pv,
+    int32_t       m,
+    double        tx,
+    double        ty) {
   
   SKMAT *pm = NULL;
   SKMAT ma;
@@ -1865,13 +11657,13 @@ void skvm_matrix_translate(int32_t m, double tx, double ty) {
   memset(&ma, 0, sizeof(SKMAT));
   memset(&mb, 0, sizeof(SKMAT));
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
   /* Check parameters */
-  if ((m < 0) || (m >= m_matc) ||
+  if ((m < 0) || (m >= pv->matc) ||
       (!isfinite(tx)) ||
       (!isfinite(ty))) {
     abort();
@@ -1881,16 +11673,13 @@ void skvm_matrix_translate(int32_t m, double tx, double ty) {
   if ((tx != 0.0) || (ty != 0.0)) {
   
     /* Get the selected matrix */
-    pm = &(m_pmat[m]);
+    pm = &(pv->pmat[m]);
     
     /* Copy the matrix to a local variable */
     memcpy(&mb, pm, sizeof(SKMAT));
     
-    /* Initialize transform matrix to identity with nothing cached */
-    ma.a = 1.0; ma.b = 0.0; ma.c = 0.0;
-    ma.d = 0.0; ma.e = 1.0; ma.f = 0.0;
-    
-    ma.cached = (uint8_t) 0;
+    /* Initialize transform matrix to identity */
+    matrix_identity(&ma);
     
     /* Set up the translation transform */
     ma.c = tx;
@@ -1904,7 +11693,7 @@ void skvm_matrix_translate(int32_t m, double tx, double ty) {
 /*
  * skvm_matrix_scale function.
  */
-void skvm_matrix_scale(int32_t m, double sx, double sy) {
+void skvm_matrix_scale(SKVM_CTX *pv, int32_t m, double sx, double sy) {
   
   SKMAT *pm = NULL;
   SKMAT ma;
@@ -1914,13 +11703,13 @@ void skvm_matrix_scale(int32_t m, double sx, double sy) {
   memset(&ma, 0, sizeof(SKMAT));
   memset(&mb, 0, sizeof(SKMAT));
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
   /* Check parameters */
-  if ((m < 0) || (m >= m_matc) ||
+  if ((m < 0) || (m >= pv->matc) ||
       (!isfinite(sx)) ||
       (!isfinite(sy)) ||
       (sx == 0.0) || (sy == 0.0)) {
@@ -1931,16 +11720,13 @@ void skvm_matrix_scale(int32_t m, double sx, double sy) {
   if ((sx != 1.0) || (sy != 1.0)) {
   
     /* Get the selected matrix */
-    pm = &(m_pmat[m]);
+    pm = &(pv->pmat[m]);
     
     /* Copy the matrix to a local variable */
     memcpy(&mb, pm, sizeof(SKMAT));
     
-    /* Initialize scaling matrix to identity with nothing cached */
-    ma.a = 1.0; ma.b = 0.0; ma.c = 0.0;
-    ma.d = 0.0; ma.e = 1.0; ma.f = 0.0;
-    
-    ma.cached = (uint8_t) 0;
+    /* Initialize scaling matrix to identity */
+    matrix_identity(&ma);
     
     /* Set up the scaling transform */
     ma.a = sx;
@@ -1954,8 +11740,9 @@ void skvm_matrix_scale(int32_t m, double sx, double sy) {
 /*
  * skvm_matrix_rotate function.
  */
-void skvm_matrix_rotate(int32_t m, double deg) {
+void skvm_matrix_rotate(SKVM_CTX *pv, int32_t m, double deg) {
   
+  int quarter = 0;
   SKMAT *pm = NULL;
   SKMAT ma;
   SKMAT mb;
@@ -1964,20 +11751,32 @@ void skvm_matrix_rotate(int32_t m, double deg) {
   memset(&ma, 0, sizeof(SKMAT));
   memset(&mb, 0, sizeof(SKMAT));
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
   /* Check parameters */
-  if ((m < 0) || (m >= m_matc) || (!isfinite(deg))) {
+  if ((m < 0) || (m >= pv->matc) || (!isfinite(deg))) {
     abort();
   }
   
-  /* Reduce angle to range (-360.0, 360.0) and convert to radians */
+  /* Reduce angle to range (-360.0, 360.0) */
   if (deg != 0.0) {
     deg = fmod(deg, 360.0);
   }
+  
+  /* Determine whether this is an exact quarter turn, and if so how
+   * many quarter turns clockwise */
+  if ((deg == 90.0) || (deg == -270.0)) {
+    quarter = 1;
+  } else if ((deg == 180.0) || (deg == -180.0)) {
+    quarter = 2;
+  } else if ((deg == 270.0) || (deg == -90.0)) {
+    quarter = 3;
+  }
+  
+  /* Convert to radians */
   if (deg != 0.0) {
     deg = (deg * M_PI) / 180.0;
   }
@@ -1986,24 +11785,36 @@ void skvm_matrix_rotate(int32_t m, double deg) {
   if (deg != 0.0) {
   
     /* Get the selected matrix */
-    pm = &(m_pmat[m]);
+    pm = &(pv->pmat[m]);
     
     /* Copy the matrix to a local variable */
     memcpy(&mb, pm, sizeof(SKMAT));
     
-    /* Initialize rotation matrix to identity with nothing cached */
-    ma.a = 1.0; ma.b = 0.0; ma.c = 0.0;
-    ma.d = 0.0; ma.e = 1.0; ma.f = 0.0;
-    
-    ma.cached = (uint8_t) 0;
+    /* Initialize rotation matrix to identity */
+    matrix_identity(&ma);
     
     /* Set up the rotation transform (deg has been converted to radians
-     * already) */
-    ma.a = cos(deg);
-    ma.b = -(sin(deg));
-    
-    ma.d = sin(deg);
-    ma.e = cos(deg);
+     * already), using exact values for quarter turns so that they are
+     * classified as such */
+    if (quarter == 1) {
+      ma.a = 0.0;   ma.b = -1.0;
+      ma.d = 1.0;   ma.e = 0.0;
+      
+    } else if (quarter == 2) {
+      ma.a = -1.0;  ma.b = 0.0;
+      ma.d = 0.0;   ma.e = -1.0;
+      
+    } else if (quarter == 3) {
+      ma.a = 0.0;   ma.b = 1.0;
+      ma.d = -1.0;  ma.e = 0.0;
+      
+    } else {
+      ma.a = cos(deg);
+      ma.b = -(sin(deg));
+      
+      ma.d = sin(deg);
+      ma.e = cos(deg);
+    }
     
     /* Premultiply by transform and store result in register */
     matrix_mul(pm, &ma, &mb);
@@ -2011,801 +11822,856 @@ void skvm_matrix_rotate(int32_t m, double deg) {
 }
 
 /*
- * skvm_sample function.
+ * skvm_matrix_get function.
  */
-void skvm_sample(SKVM_SAMPLE_PARAM *ps) {
-  
-  int     i = 0;
-  int32_t x = 0;
-  int32_t y = 0;
-  int32_t stride = 0;
-  double  mv = 0.0;
-  
-        uint8_t * pt = NULL;
-  const uint8_t * pm = NULL;
-        uint8_t * pscan = NULL;
-  const uint8_t * pscan_m = NULL;
-  
-  const SKBUF * pSrc = NULL;
-  const SKBUF * pMask = NULL;
-        SKMAT * pMatrix = NULL;
-        SKBUF * pTarget = NULL;
-  
-  SKPOINT pnt;
-  SKARGB  rcol;
-  SKARGB  tcol;
-  SKARGB  fcol;
-  SKPOINT corners[4];
-  SPH_ARGB argb;
-  
-  double f_min_x = 0.0;
-  double f_min_y = 0.0;
-  double f_max_x = 0.0;
-  double f_max_y = 0.0;
-  
-  int32_t bound_x = 0;
-  int32_t bound_y = 0;
-  int32_t min_x = 0;
-  int32_t min_y = 0;
-  int32_t max_x = 0;
-  int32_t max_y = 0;
+void skvm_matrix_get(SKVM_CTX *pv, int32_t m, double *pMat) {
   
-  /* Initialize arrays and structures */
-  memset(&pnt, 0, sizeof(SKPOINT));
-  memset(&rcol, 0, sizeof(SKARGB));
-  memset(&tcol, 0, sizeof(SKARGB));
-  memset(&fcol, 0, sizeof(SKARGB));
-  memset(&argb, 0, sizeof(SPH_ARGB));
-  memset(corners, 0, sizeof(SKPOINT) * 4);
+  const SKMAT *pm = NULL;
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
-  /* Check parameter */
-  if (ps == NULL) {
+  /* Check parameters */
+  if ((m < 0) || (m >= pv->matc) || (pMat == NULL)) {
     abort();
   }
   
-  /* ===================================== *
-   *                                       *
-   * INTERNAL PARAMETER CONSISTENCY CHECKS *
-   *                                       *
-   * ===================================== */
+  /* Get the selected matrix */
+  pm = &(pv->pmat[m]);
+  
+  /* Copy the values */
+  pMat[0] = pm->a;
+  pMat[1] = pm->b;
+  pMat[2] = pm->c;
+  pMat[3] = pm->d;
+  pMat[4] = pm->e;
+  pMat[5] = pm->f;
+}
+
+/*
+ * skvm_matrix_set function.
+ */
+int skvm_matrix_set(SKVM_CTX *pv, int32_t m, const double *pMat) {
   
-  /* Check that either procedural masking or raster masking mode
-   * selected, but not both */
-  if ((ps->flags & SKVM_FLAG_PROCMASK) &&
-      (ps->flags & SKVM_FLAG_RASTERMASK)) {
+  int status = 1;
+  int i = 0;
+  SKMAT mt;
+  
+  /* Initialize structures */
+  memset(&mt, 0, sizeof(SKMAT));
+  
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
-  if (((ps->flags & SKVM_FLAG_PROCMASK) == 0) &&
-      ((ps->flags & SKVM_FLAG_RASTERMASK) == 0)) {
+  
+  /* Check parameters */
+  if ((m < 0) || (m >= pv->matc) || (pMat == NULL)) {
     abort();
   }
   
-  /* If procedural mode, check that exactly one flag from each mode
-   * group is selected */
-  if (ps->flags & SKVM_FLAG_PROCMASK) {
-    if ((ps->flags & SKVM_FLAG_LEFTMODE) &&
-        (ps->flags & SKVM_FLAG_RIGHTMODE)) {
-      abort();
-    }
-    if (((ps->flags & SKVM_FLAG_LEFTMODE) == 0) &&
-        ((ps->flags & SKVM_FLAG_RIGHTMODE) == 0)) {
-      abort();
-    }
-    
-    if ((ps->flags & SKVM_FLAG_ABOVEMODE) &&
-        (ps->flags & SKVM_FLAG_BELOWMODE)) {
-      abort();
-    }
-    if (((ps->flags & SKVM_FLAG_ABOVEMODE) == 0) &&
-        ((ps->flags & SKVM_FLAG_BELOWMODE) == 0)) {
-      abort();
+  /* Check that the values are finite */
+  for(i = 0; i < 6; i++) {
+    if (!isfinite(pMat[i])) {
+      status = 0;
+      pv->pErr = "Matrix values must be finite";
+      break;
     }
   }
   
-  /* Check that the buffer indices are valid */
-  if ((ps->src_buf < 0) || (ps->src_buf >= m_bufc) ||
-      (ps->target_buf < 0) || (ps->target_buf >= m_bufc)) {
-    abort();
+  /* Build the matrix and its derived values in a local copy */
+  if (status) {
+    mt.a = pMat[0];
+    mt.b = pMat[1];
+    mt.c = pMat[2];
+    mt.d = pMat[3];
+    mt.e = pMat[4];
+    mt.f = pMat[5];
+    
+    matrix_update(&mt);
   }
-  if (ps->flags & SKVM_FLAG_RASTERMASK) {
-    if ((ps->mask_buf < 0) || (ps->mask_buf >= m_bufc)) {
-      abort();
+  
+  /* Check that the inverse is finite */
+  if (status) {
+    if ((!isfinite(mt.iva)) || (!isfinite(mt.ivb)) ||
+        (!isfinite(mt.ivc)) || (!isfinite(mt.ivd)) ||
+        (!isfinite(mt.ive)) || (!isfinite(mt.ivf))) {
+      status = 0;
+      pv->pErr = "Matrix is not invertible";
     }
   }
   
-  /* Check that buffer indices are unique */
-  if (ps->src_buf == ps->target_buf) {
-    abort();
-  }
-  if (ps->flags & SKVM_FLAG_RASTERMASK) {
-    if ((ps->src_buf == ps->mask_buf) ||
-        (ps->target_buf == ps->mask_buf)) {
-      abort();
-    }
+  /* Store the matrix in the register */
+  if (status) {
+    memcpy(&(pv->pmat[m]), &mt, sizeof(SKMAT));
   }
   
-  /* Check that matrix buffer is valid */
-  if ((ps->t_matrix < 0) || (ps->t_matrix >= m_matc)) {
+  /* Return status */
+  return status;
+}
+
+/*
+ * skvm_sample function.
+ */
+void skvm_sample(SKVM_CTX *pv, SKVM_SAMPLE_PARAM *ps) {
+  
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
-  /* If procedural masking, check that boundary fields are finite and
-   * in normalized range */
-  if (ps->flags & SKVM_FLAG_PROCMASK) {
-    if ((!isfinite(ps->x_boundary)) || (!isfinite(ps->y_boundary))) {
-      abort();
-    }
-    if ((!((ps->x_boundary >= 0.0) && (ps->x_boundary <= 1.0))) ||
-        (!((ps->y_boundary >= 0.0) && (ps->y_boundary <= 1.0)))) {
-      abort();
-    }
+  /* Check parameter */
+  if (ps == NULL) {
+    abort();
   }
   
-  /* Check that sampling algorithm is valid */
-  if ((ps->sample_alg != SKVM_ALG_NEAREST) &&
-      (ps->sample_alg != SKVM_ALG_BILINEAR) &&
-      (ps->sample_alg != SKVM_ALG_BICUBIC)) {
+  /* Sample from the registers */
+  sample_run(pv, ps, NULL, NULL);
+}
+
+/*
+ * skvm_text function.
+ */
+int skvm_text(
+          SKVM_CTX          * pv,
+    const SKVM_SAMPLE_PARAM * ps,
+          double              size,
+          int                 a,
+          int                 r,
+          int                 g,
+          int                 b,
+    const char              * pText) {
+  
+  int status = 1;
+  int32_t code = 0;
+  int32_t w = 0;
+  int32_t h = 0;
+  double scale = 0.0;
+  double pen_x = 0.0;
+  double pen_y = 0.0;
+  double cmat[20];
+  const char *pc = NULL;
+  
+  SKFONT *pf = NULL;
+  SKGLYPH *pg = NULL;
+  const SKGLYPHIMG *pImg = NULL;
+  const SKMAT *pUser = NULL;
+  SKVM_SAMPLE_PARAM sp;
+  SKMAT mt;
+  SKMAT mg;
+  
+  /* Initialize structures */
+  memset(cmat, 0, sizeof(double) * 20);
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  memset(&mt, 0, sizeof(SKMAT));
+  memset(&mg, 0, sizeof(SKMAT));
+  
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
-  /* ======================================= *
-   *                                         *
-   * GET BUFFERS AND FINISH PARAMETER CHECKS *
-   *                                         *
-   * ======================================= */
+  /* Check parameters */
+  if ((ps == NULL) || (pText == NULL)) {
+    abort();
+  }
+  if (ps->flags & (SKVM_FLAG_SUBAREA | SKVM_FLAG_COLORLUT |
+                    SKVM_FLAG_COLORMATRIX)) {
+    abort();
+  }
+  if ((ps->src_buf < 0) || (ps->src_buf >= pv->bufc) ||
+      (ps->t_matrix < 0) || (ps->t_matrix >= pv->matc)) {
+    abort();
+  }
+  if (!((size > 0.0) && (size <= SKVM_FONT_MAX_SIZE))) {
+    abort();
+  }
+  if ((a < 0) || (a > 255) || (r < 0) || (r > 255) ||
+      (g < 0) || (g > 255) || (b < 0) || (b > 255)) {
+    abort();
+  }
   
-  /* Get the buffers */
-  pSrc    = &(m_pbuf[ps->src_buf   ]);
-  pTarget = &(m_pbuf[ps->target_buf]);
-  if (ps->flags & SKVM_FLAG_RASTERMASK) {
-    pMask = &(m_pbuf[ps->mask_buf  ]);
+  /* Get the font */
+  pf = (pv->pbuf[ps->src_buf]).pFont;
+  if (pf == NULL) {
+    status = 0;
+    pv->pErr = "Buffer has no font";
+  }
+  if (status) {
+    scale = size / ((double) pf->size);
   }
   
-  /* If subarea mode, check that subarea is within the source buffer,
-   * else set the subarea fields to encompass the whole source buffer */
-  if (ps->flags & SKVM_FLAG_SUBAREA) {
-    /* Subarea specified, so first check that (x,y) coordinates are
-     * within buffer */
-    if ((ps->src_x < 0) || (ps->src_x >= pSrc->w)) {
-      abort();
-    }
-    if ((ps->src_y < 0) || (ps->src_y >= pSrc->h)) {
-      abort();
+  /* Check every character before drawing anything, so that nothing is
+   * drawn if the text can not be drawn completely */
+  if (status) {
+    pc = pText;
+    while (*pc != 0) {
+      if (!utf8_next(&pc, &code)) {
+        status = 0;
+        pv->pErr = "Text is not valid UTF-8";
+        break;
+      }
+      if (code == '\n') {
+        continue;
+      }
+      pg = font_find(pf, code);
+      if (pg == NULL) {
+        status = 0;
+        pv->pErr = "Font has no glyph for character";
+        break;
+      }
+      if ((pg->w > 0) && (pg->h > 0)) {
+        if (!font_dim(pg, scale, &w, &h)) {
+          status = 0;
+          pv->pErr = "Glyph too large at font size";
+          break;
+        }
+      }
     }
+  }
+  
+  /* The glyphs are grayscale coverage, which sampling expands to ARGB
+   * with the coverage in each color channel, so a color matrix turns
+   * the coverage into alpha and replaces the color */
+  if (status) {
+    cmat[2] = ((double) a) / 255.0;
+    cmat[9] = (double) r;
+    cmat[14] = (double) g;
+    cmat[19] = (double) b;
     
-    /* Next, check that width and height are greater than zero */
-    if ((ps->src_w < 1) || (ps->src_h < 1)) {
-      abort();
-    }
+    memcpy(&sp, ps, sizeof(SKVM_SAMPLE_PARAM));
+    sp.flags |= SKVM_FLAG_COLORMATRIX;
+    sp.pCMat = cmat;
     
-    /* Finally, check that (x + width) <= src_width and also that
-     * (y + height) <= src_height */
-    if ((ps->src_x > pSrc->w - ps->src_w) ||
-        (ps->src_y > pSrc->h - ps->src_h)) {
-      abort();
+    pUser = &(pv->pmat[ps->t_matrix]);
+    matrix_identity(&mt);
+  }
+  
+  /* Draw each glyph */
+  if (status) {
+    pc = pText;
+    while (*pc != 0) {
+      if (!utf8_next(&pc, &code)) {
+        abort();
+      }
+      
+      /* A line feed returns the pen to the start of the next line */
+      if (code == '\n') {
+        pen_x = 0.0;
+        pen_y += ((double) pf->line) * scale;
+        continue;
+      }
+      
+      pg = font_find(pf, code);
+      if (pg == NULL) {
+        abort();
+      }
+      
+      /* Blit non-empty glyphs from the glyph cache, placing the
+       * top-left corner of the glyph at the nearest whole pixel of text
+       * space, with the border of the rasterized glyph around it */
+      if ((pg->w > 0) && (pg->h > 0)) {
+        pImg = font_render(pf, pg, size);
+        
+        mt.c = floor(pen_x + (((double) pg->xoff) * scale) + 0.5) - 1.0;
+        mt.f = floor(pen_y + (((double) pg->yoff) * scale) + 0.5) - 1.0;
+        matrix_mul(&mg, pUser, &mt);
+        
+        /* A whole-pixel translation maps glyph pixels exactly onto
+         * target pixels, so blit them without resampling */
+        sp.sample_alg = ps->sample_alg;
+        if (((mg.mclass == MCLASS_IDENTITY) ||
+              (mg.mclass == MCLASS_ITRANSLATE)) &&
+            (fabs(mg.ivc) <= SAMPLE_EXACT_MAX) &&
+            (fabs(mg.ivf) <= SAMPLE_EXACT_MAX)) {
+          sp.sample_alg = SKVM_ALG_NEAREST;
+        }
+        
+        sample_run(pv, &sp, &(pImg->buf), &mg);
+      }
+      
+      pen_x += ((double) pg->adv) * scale;
     }
-    
-  } else {
-    /* No subarea specified, so set to whole source buffer */
-    ps->src_x = 0;
-    ps->src_y = 0;
-    ps->src_w = pSrc->w;
-    ps->src_h = pSrc->h;
   }
   
-  /* If raster masking is in effect, mask buffer must have exact same
-   * dimensions as target buffer, and mask buffer must be grayscale */
-  if (ps->flags & SKVM_FLAG_RASTERMASK) {
-    if ((pMask->w != pTarget->w) || (pMask->h != pTarget->h)) {
-      abort();
-    }
-    if (pMask->c != 1) {
-      abort();
-    }
-  }
+  /* Return status */
+  return status;
+}
+
+/*
+ * skvm_balance function.
+ */
+void skvm_balance(SKVM_BALANCE *pb) {
   
-  /* All buffers must be loaded */
-  if ((pSrc->pData == NULL) || (pTarget->pData == NULL)) {
+  /* Check parameter */
+  if (pb == NULL) {
     abort();
   }
-  if (ps->flags & SKVM_FLAG_RASTERMASK) {
-    if (pMask->pData == NULL) {
-      abort();
-    }
-  }
   
-  /* ========================== *
-   *                            *
-   * DETERMINE RENDERING BOUNDS *
-   *                            *
-   * ========================== */
+  /* Copy the balance record of this thread */
+  memcpy(pb, &(thread_state()->bal), sizeof(SKVM_BALANCE));
+}
+
+/*
+ * skvm_color_lut function.
+ */
+void skvm_color_lut(SKVM_CTX *pv, int32_t i, const uint8_t *pLut) {
   
-  /* Get the transformation matrix */
-  pMatrix = &(m_pmat[ps->t_matrix]);
+  SKBUF *ps = NULL;
+  int32_t j = 0;
   
-  /* Write the corners of the source area into the corner array */
-  corners[0].x = ps->src_x;
-  corners[0].y = ps->src_y;
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
   
-  corners[1].x = ps->src_x + ps->src_w;
-  corners[1].y = ps->src_y;
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) || (pLut == NULL)) {
+    abort();
+  }
   
-  corners[2].x = ps->src_x;
-  corners[2].y = ps->src_y + ps->src_h;
+  /* Float buffers are not supported */
+  if ((pv->pbuf[i]).fp) {
+    abort();
+  }
   
-  corners[3].x = ps->src_x + ps->src_w;
-  corners[3].y = ps->src_y + ps->src_h;
+  /* Get buffer register */
+  ps = &(pv->pbuf[i]);
   
-  /* Transform all the corners from source space to target space */
-  source2target(pMatrix, &(corners[0]));
-  source2target(pMatrix, &(corners[1]));
-  source2target(pMatrix, &(corners[2]));
-  source2target(pMatrix, &(corners[3]));
+  /* Fault if buffer is not loaded */
+  if (ps->pData == NULL) {
+    abort();
+  }
   
-  /* Figure out the bounding box around the transformed corner
-   * coordinates */
-  f_min_x = corners[0].x;
-  f_max_x = corners[0].x;
+  /* Ignore the lookup if it changes nothing */
+  for(j = 0; j < LUT_SIZE; j++) {
+    if (pLut[j] != (uint8_t) (j & 0xff)) {
+      break;
+    }
+  }
+  if (j >= LUT_SIZE) {
+    return;
+  }
   
-  f_min_y = corners[0].y;
-  f_max_y = corners[0].y;
+  /* Allocate a lookup table for the register if necessary */
+  if (ps->pLut == NULL) {
+    ps->pLut = (uint8_t *) malloc(LUT_SIZE);
+    if (ps->pLut == NULL) {
+      abort();
+    }
+  }
   
-  for(i = 1; i < 4; i++) {
-    if (corners[i].x > f_max_x) {
-      f_max_x = corners[i].x;
-    } else if (corners[i].x < f_min_x) {
-      f_min_x = corners[i].x;
+  /* Compose the lookup with any pending lookup, so that the pixel data
+   * only needs to be processed once when it is settled */
+  if (ps->lut_pending) {
+    for(j = 0; j < LUT_SIZE; j++) {
+      (ps->pLut)[j] = pLut[(j & ~0xff) | (ps->pLut)[j]];
     }
     
-    if (corners[i].y > f_max_y) {
-      f_max_y = corners[i].y;
-    } else if (corners[i].y < f_min_y) {
-      f_min_y = corners[i].y;
-    }
+  } else {
+    memcpy(ps->pLut, pLut, LUT_SIZE);
+    ps->lut_pending = 1;
   }
+}
 
-  /* Take the floor of the minimums and the ceiling of the maximums to
-   * expand the bounding box outward to encompass whole pixels */
-  f_min_x = floor(f_min_x);
-  f_min_y = floor(f_min_y);
+/*
+ * skvm_color_matrix function.
+ */
+void skvm_color_matrix(SKVM_CTX *pv, int32_t i, const double *pMat) {
   
-  f_max_x = ceil(f_max_x);
-  f_max_y = ceil(f_max_y);
+  SKBUF *ps = NULL;
+  SKCMJOB job;
+  int32_t j = 0;
+  int32_t row = 0;
+  int32_t col = 0;
+  int32_t v = 0;
+  uint8_t lut[LUT_SIZE];
   
-  /* Make sure these boundary coordinates are finite and within range of
-   * signed 32-bit integers */
-  if ((!isfinite(f_min_x)) || (!isfinite(f_min_y)) ||
-      (!isfinite(f_max_x)) || (!isfinite(f_max_y))) {
-    fprintf(stderr, "Numeric problem during sparkle sampling!\n");
+  /* Initialize structures */
+  memset(&job, 0, sizeof(SKCMJOB));
+  
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
-  if ((f_min_x < (double) INT32_MIN) ||
-        (f_max_x > (double) INT32_MAX) ||
-        (f_min_y < (double) INT32_MIN) ||
-        (f_max_y > (double) INT32_MAX)) {
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) || (pMat == NULL)) {
     abort();
   }
   
-  /* Now convert to integers */
-  min_x = (int32_t) f_min_x;
-  min_y = (int32_t) f_min_y;
-  
-  max_x = (int32_t) f_max_x;
-  max_y = (int32_t) f_max_y;
-
-  /* Consistency check */
-  if ((min_x > max_x) || (min_y > max_y)) {
-    fprintf(stderr, "Numeric problem during sparkle sampling!\n");
+  /* Float buffers are not supported */
+  if ((pv->pbuf[i]).fp) {
     abort();
   }
-  
-  /* If the maximum X is negative or the maximum Y is negative, then
-   * the intersection with the target area is empty so we can leave */
-  if ((max_x < 0) || (max_y < 0)) {
-    return;
+  for(j = 0; j < 20; j++) {
+    if (!isfinite(pMat[j])) {
+      abort();
+    }
+    if ((j % 5) == 4) {
+      if (!(fabs(pMat[j]) <= SKVM_CMAT_MAX_OFFSET)) {
+        abort();
+      }
+    } else {
+      if (!(fabs(pMat[j]) <= SKVM_CMAT_MAX_COEF)) {
+        abort();
+      }
+    }
   }
   
-  /* If the minimum X is greater than or equal to the width or the
-   * minimum Y is greater than or equal to the height, then the
-   * intersection with the target area is empty so we can leave */
-  if ((min_x >= pTarget->w) || (min_y >= pTarget->h)) {
-    return;
+  /* Get buffer register */
+  ps = &(pv->pbuf[i]);
+  
+  /* Fault if buffer is not loaded */
+  if (ps->pData == NULL) {
+    abort();
   }
   
-  /* If we got here, maximum X and maximum Y are at least zero, so clamp
-   * them so that they are at most one less than the width or height */
-  if (max_x > pTarget->w - 1) {
-    max_x = pTarget->w - 1;
+  /* Ignore the matrix if it is the identity */
+  for(j = 0; j < 20; j++) {
+    if ((j % 5) == (j / 5)) {
+      if (pMat[j] != 1.0) {
+        break;
+      }
+    } else {
+      if (pMat[j] != 0.0) {
+        break;
+      }
+    }
   }
-  if (max_y > pTarget->h - 1) {
-    max_y = pTarget->h - 1;
+  if (j >= 20) {
+    return;
   }
   
-  /* If we got here, minimum X and minimum Y are less than the width or
-   * height respectively, so clamp them so that they are at least
-   * zero */
-  if (min_x < 0) {
-    min_x = 0;
-  }
-  if (min_y < 0) {
-    min_y = 0;
+  /* Convert the matrix to fixed point */
+  for(j = 0; j < 20; j++) {
+    job.k[j] = cmat_fixed(pMat[j]);
   }
   
-  /* If we are in procedural masking mode, intersect the rendering area
-   * with the part of the target that is not masked */
-  if (ps->flags & SKVM_FLAG_PROCMASK) {
-    
-    /* Get integer versions of the bounds */
-    if (ps->x_boundary == 0.0) {
-      bound_x = 0;
-      
-    } else if (ps->x_boundary == 1.0) {
-      bound_x = pTarget->w - 1;
-      
-    } else {
-      bound_x = (int32_t) floor(ps->x_boundary *
-                                  ((double) (pTarget->w - 1)));
+  /* A grayscale channel only has 256 possible values, so a grayscale
+   * matrix is just a lookup on the green row, which may then be
+   * combined with other lookups */
+  if (ps->c == 1) {
+    for(j = 0; j < LUT_SIZE; j++) {
+      lut[j] = (uint8_t) (j & 0xff);
     }
-    
-    if (ps->y_boundary == 0.0) {
-      bound_y = 0;
-      
-    } else if (ps->y_boundary == 1.0) {
-      bound_y = pTarget->h - 1;
-      
-    } else {
-      bound_y = (int32_t) floor(ps->y_boundary *
-                                  ((double) (pTarget->h - 1)));
+    for(j = 0; j < 256; j++) {
+      lut[512 + j] = (uint8_t) cmat_clamp(
+        (job.k[10] * 255) +
+        ((job.k[11] + job.k[12] + job.k[13]) * j) +
+        job.k[14]);
     }
-
-    /* Handle the X boundary based on left or right mode */
-    if (ps->flags & SKVM_FLAG_LEFTMODE) {
-      /* Left mode, so only draw area where x >= boundary; if max_x is
-       * less than boundary, nothing to draw so leave */
-      if (max_x < bound_x) {
-        return;
-      }
-      
-      /* If we got here, max_x is in bounds, so now just clamp min_x to
-       * boundary */
-      if (min_x < bound_x) {
-        min_x = bound_x;
-      }
-      
-    } else if (ps->flags & SKVM_FLAG_RIGHTMODE) {
-      /* Right mode, so only draw area where x <= boundary; if min_x is
-       * greater than boundary, nothing to draw so leave */
-      if (min_x > bound_x) {
-        return;
-      }
-      
-      /* If we got here, min_x is in bounds, so now just clamp max_x to
-       * boundary */
-      if (max_x > bound_x) {
-        max_x = bound_x;
+    skvm_color_lut(pv, i, lut);
+    return;
+  }
+  
+  /* For RGB, drop the alpha row and fold the constant alpha input into
+   * the offsets */
+  if (ps->c == 3) {
+    for(row = 0; row < 3; row++) {
+      for(col = 0; col < 3; col++) {
+        job.k[(row * 4) + col] =
+          cmat_fixed(pMat[((row + 1) * 5) + col + 1]);
       }
-      
-    } else {
-      /* Shouldn't happen */
-      abort();
+      v = cmat_fixed(pMat[((row + 1) * 5) + 4]);
+      v += cmat_fixed(pMat[(row + 1) * 5]) * 255;
+      job.k[(row * 4) + 3] = v;
     }
-    
-    /* Handle the Y boundary based on above or below mode */
-    if (ps->flags & SKVM_FLAG_BELOWMODE) {
-      /* Below mode, so only draw area where y <= boundary; if min_y is
-       * greater than boundary, nothing to draw so leave */
-      if (min_y > bound_y) {
-        return;
-      }
-      
-      /* If we got here, min_y is in bounds, so now just clamp max_y to
-       * boundary */
-      if (max_y > bound_y) {
-        max_y = bound_y;
-      }
-      
-    } else if (ps->flags & SKVM_FLAG_ABOVEMODE) {
-      /* Above mode, so only draw area where y >= boundary; if max_y is
-       * less than boundary, nothing to draw so leave */
-      if (max_y < bound_y) {
-        return;
-      }
-      
-      /* If we got here, max_y is in bounds, so now just clamp min_y to
-       * boundary */
-      if (min_y < bound_y) {
-        min_y = bound_y;
-      }
-      
+    for(j = 12; j < 20; j++) {
+      job.k[j] = 0;
+    }
+  }
+  
+  /* Make sure the buffer may be modified, which also applies any
+   * pending lookup */
+  buf_writable(ps);
+  
+  /* Apply the matrix */
+  job.pData = ps->pData;
+  job.w = ps->w;
+  job.c = ps->c;
+  par_rows(ps->h, ((size_t) ps->w) * ((size_t) ps->c),
+            &cmat_band, &job);
+}
+
+/*
+ * skvm_blur function.
+ */
+void skvm_blur(SKVM_CTX *pv, int32_t i, double sigma) {
+  
+  SKBUF *ps = NULL;
+  SKBLURJOB job;
+  uint16_t *px = NULL;
+  size_t len = 0;
+  double w_ideal = 0.0;
+  int32_t wl = 0;
+  int32_t m = 0;
+  int32_t j = 0;
+  int32_t t = 0;
+  
+  /* Initialize structures */
+  memset(&job, 0, sizeof(SKBLURJOB));
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc)) {
+    abort();
+  }
+  
+  /* Float buffers are not supported */
+  if ((pv->pbuf[i]).fp) {
+    abort();
+  }
+  if (!isfinite(sigma)) {
+    abort();
+  }
+  if (!((sigma >= 0.0) && (sigma <= SKVM_BLUR_MAX_SIGMA))) {
+    abort();
+  }
+  
+  /* Get buffer register */
+  ps = &(pv->pbuf[i]);
+  
+  /* Fault if buffer is not loaded */
+  if (ps->pData == NULL) {
+    abort();
+  }
+  
+  /* Choose the box widths so that the passes together have the
+   * variance of the Gaussian; the first m passes use the odd width wl
+   * and the rest use wl + 2 */
+  w_ideal = sqrt(((12.0 * sigma * sigma) / BLUR_PASSES) + 1.0);
+  wl = (int32_t) floor(w_ideal);
+  if ((wl % 2) == 0) {
+    wl--;
+  }
+  m = (int32_t) floor(
+        (((12.0 * sigma * sigma)
+          - (BLUR_PASSES * wl * wl)
+          - (4.0 * BLUR_PASSES * wl)
+          - (3.0 * BLUR_PASSES))
+        / ((-4.0 * wl) - 4.0)) + 0.5);
+  if (m < 0) {
+    m = 0;
+  } else if (m > BLUR_PASSES) {
+    m = BLUR_PASSES;
+  }
+  
+  t = 0;
+  for(j = 0; j < BLUR_PASSES; j++) {
+    if (j < m) {
+      (job.r)[j] = (wl - 1) / 2;
     } else {
-      /* Shouldn't happen */
-      abort();
+      (job.r)[j] = ((wl + 2) - 1) / 2;
     }
+    t += (job.r)[j];
   }
   
-  /* ============== *
-   *                *
-   * RENDERING LOOP *
-   *                *
-   * ============== */
+  /* If all the boxes are a single pixel, the blur does nothing */
+  if (t < 1) {
+    return;
+  }
   
-  /* Compute the stride between scanlines within the target pixel data,
-   * and also establish pt as a pointer to the start of the first pixel
-   * to render in the target buffer */
-  stride = pTarget->w * ((int32_t) pTarget->c);
-  pt = pTarget->pData;
-  pt += (stride * min_y);
-  pt += (min_x * ((int32_t) pTarget->c));
+  /* Make sure the buffer may be modified, which also applies any
+   * pending lookup */
+  buf_writable(ps);
   
-  /* Establish pm as a pointer to the first pixel mask value in the
-   * raster mask, if raster masking is enabled */
-  if (ps->flags & SKVM_FLAG_RASTERMASK) {
-    pm = pMask->pData;
-    pm += (pMask->w * min_y);
-    pm += min_x;
+  /* Allocate the 16-bit work buffers */
+  len = ((size_t) ps->w) * ((size_t) ps->h) * ((size_t) ps->c);
+  job.pWork = (uint16_t *) malloc(len * sizeof(uint16_t));
+  job.pFlip = (uint16_t *) malloc(len * sizeof(uint16_t));
+  if ((job.pWork == NULL) || (job.pFlip == NULL)) {
+    abort();
   }
   
-  /* We will now iterate over every pixel in the rendering boundaries of
-   * the target, which we just computed in order to perform the
-   * rendering operation */
-  for(y = min_y; y <= max_y; y++) {
-    /* Save the pointer to the start of this rendering scanline */
-    pscan = pt;
-    if (ps->flags & SKVM_FLAG_RASTERMASK) {
-      pscan_m = pm;
+  job.pData = ps->pData;
+  job.w = ps->w;
+  job.h = ps->h;
+  job.c = ps->c;
+  
+  /* Convert to 16-bit and blur horizontally */
+  par_rows(job.h, ((size_t) job.w) * ((size_t) job.c),
+            &blur_load_band, &job);
+  par_rows(job.h, ((size_t) job.w) * ((size_t) job.c) * 2,
+            &blur_rows_band, &job);
+  
+  /* Transpose and blur vertically */
+  par_rows(job.w, ((size_t) job.h) * ((size_t) job.c) * 2,
+            &blur_flip_band, &job);
+  px = job.pWork;
+  job.pWork = job.pFlip;
+  job.pFlip = px;
+  job.w = ps->h;
+  job.h = ps->w;
+  par_rows(job.h, ((size_t) job.w) * ((size_t) job.c) * 2,
+            &blur_rows_band, &job);
+  
+  /* Transpose back and convert to pixel data */
+  par_rows(job.w, ((size_t) job.h) * ((size_t) job.c) * 2,
+            &blur_flip_band, &job);
+  px = job.pWork;
+  job.pWork = job.pFlip;
+  job.pFlip = px;
+  job.w = ps->w;
+  job.h = ps->h;
+  par_rows(job.h, ((size_t) job.w) * ((size_t) job.c),
+            &blur_store_band, &job);
+  
+  /* Release the work buffers */
+  free(job.pWork);
+  free(job.pFlip);
+}
+
+/*
+ * skvm_color_invert function.
+ */
+void skvm_color_invert(SKVM_CTX *pv, int32_t i) {
+  
+  int32_t j = 0;
+  uint8_t lut[LUT_SIZE];
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc)) {
+    abort();
+  }
+  
+  /* Float buffers are not supported */
+  if ((pv->pbuf[i]).fp) {
+    abort();
+  }
+  
+  /* Build a lookup that inverts all the color channels, but leaves
+   * the alpha channel alone */
+  for(j = 0; j < 256; j++) {
+    lut[j] = (uint8_t) j;
+  }
+  for(j = 256; j < LUT_SIZE; j++) {
+    lut[j] = (uint8_t) (255 - (j & 0xff));
+  }
+  
+  /* Apply the lookup */
+  skvm_color_lut(pv, i, lut);
+}
+
+/*
+ * skvm_mask_compress function.
+ */
+void skvm_mask_compress(SKVM_CTX *pv, int32_t i) {
+  
+  int32_t y = 0;
+  SKBUF *ps = NULL;
+  SKRLE *pRle = NULL;
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc)) {
+    abort();
+  }
+  
+  /* Get buffer register and check that it is loaded and grayscale */
+  ps = &(pv->pbuf[i]);
+  if ((ps->pData == NULL) || (ps->c != 1)) {
+    abort();
+  }
+  
+  /* Apply any pending color lookup so the mask values are current */
+  buf_settle(ps);
+  
+  /* Compress each scanline */
+  pRle = rle_new(ps->h);
+  for(y = 0; y < ps->h; y++) {
+    rle_add_row(pRle, y, ps->pData + (((size_t) y) * ps->w), ps->w);
+  }
+  
+  /* Replace the pixel data with the compressed mask */
+  buf_release(ps);
+  ps->pRle = pRle;
+}
+
+/*
+ * skvm_stats function.
+ */
+void skvm_stats(SKVM_CTX *pv, int32_t i, SKVM_STATS *ps) {
+  
+  SKBUF *pb = NULL;
+  SKSTATJOB job;
+  int k = 0;
+  int v = 0;
+  uint64_t sum = 0;
+  uint64_t total = 0;
+  
+  /* Initialize structures */
+  memset(&job, 0, sizeof(SKSTATJOB));
+  
+  /* Check context */
+  if (pv == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= pv->bufc) || (ps == NULL)) {
+    abort();
+  }
+  
+  /* Get buffer register and check that it is loaded */
+  pb = &(pv->pbuf[i]);
+  if (pb->pData == NULL) {
+    abort();
+  }
+  
+  /* Apply any pending color lookup so the values are current */
+  buf_settle(pb);
+  
+  /* Compute the histograms */
+  job.pBuf = pb;
+  if (pthread_mutex_init(&(job.lock), NULL)) {
+    abort();
+  }
+  par_rows(pb->h, ((size_t) pb->w) * ((size_t) pb->c),
+            &stats_band, &job);
+  if (pthread_mutex_destroy(&(job.lock))) {
+    abort();
+  }
+  
+  /* Derive the other statistics from the histograms */
+  memset(ps, 0, sizeof(SKVM_STATS));
+  ps->c = pb->c;
+  total = ((uint64_t) pb->w) * ((uint64_t) pb->h);
+  for(k = 0; k < ps->c; k++) {
+    memcpy((ps->hist)[k], (job.hist)[k], sizeof(uint32_t) * 256);
+    
+    sum = 0;
+    for(v = 0; v < 256; v++) {
+      sum += ((uint64_t) v) * (job.hist)[k][v];
     }
+    (ps->mean)[k] = ((double) sum) / ((double) total);
     
-    for(x = min_x; x <= max_x; x++) {
-      /* If raster masking mode is on, proceed to next pixel without
-       * rendering if this mask value is zero */
-      if (ps->flags & SKVM_FLAG_RASTERMASK) {
-        if (*pm == 0) {
-          /* Move to the next pixel to render */
-          pt = pt + pTarget->c;
-          pm++;
-         
-          /* Continue loop */
-          continue;
-        }
-      }
-      
-      /* Project the current target location into source space */
-      pnt.x = (double) x;
-      pnt.y = (double) y;
-      
-      target2source(pMatrix, &pnt);
-      
-      if ((!isfinite(pnt.x)) || (!isfinite(pnt.y))) {
-        fprintf(stderr, "Numeric problem during sparkle sampling!\n");
-        abort();
-      }
-      
-      /* Only proceed if projected point is within the source area */
-      if ((pnt.x >= (double) ps->src_x) &&
-          (pnt.x <= (double) (ps->src_x + ps->src_w)) &&
-          (pnt.y >= (double) ps->src_y) &&
-          (pnt.y <= (double) (ps->src_y + ps->src_h))) {
-      
-        /* Sample the point within the source */
-        if (ps->sample_alg == SKVM_ALG_NEAREST) {
-          sample_nearest(pSrc, &pnt, &rcol);
-          
-        } else if (ps->sample_alg == SKVM_ALG_BILINEAR) {
-          sample_bilinear(pSrc, &pnt, &rcol);
-          
-        } else if (ps->sample_alg == SKVM_ALG_BICUBIC) {
-          sample_bicubic(pSrc, &pnt, &rcol);
-          
-        } else {
-          /* Shouldn't happen */
-          abort();
-        }
-      
-        /* If raster masking is in effect and the current mask value is
-         * not full white, then multiply all of the (premultiplied)
-         * channels by the normalized mask value to make them more
-         * transparent */
-        if (ps->flags & SKVM_FLAG_RASTERMASK) {
-          if (*pm != 255) {
-            mv = ((double) *pm) / 255.0;
-            rcol.a *= mv;
-            rcol.r *= mv;
-            rcol.g *= mv;
-            rcol.b *= mv;
-          }
-        }
-      
-        /* Get the current target pixel color and convert it to
-         * premultiplied ARGB */
-        if (pTarget->c == 1) {
-          /* Grayscale conversion */
-          tcol.a = 1.0;
-          tcol.r = ((double) *pt) / 255.0;
-          tcol.g = tcol.r;
-          tcol.b = tcol.r;
-          
-        } else if (pTarget->c == 3) {
-          /* RGB conversion */
-          tcol.a = 1.0;
-          tcol.r = ((double) pt[0]) / 255.0;
-          tcol.g = ((double) pt[1]) / 255.0;
-          tcol.b = ((double) pt[2]) / 255.0;
-          
-        } else if (pTarget->c == 4) {
-          /* Non-premultiplied ARGB to premultiplied ARGB conversion */
-          tcol.a = ((double) pt[0]) / 255.0;
-          tcol.r = ((double) pt[1]) / 255.0;
-          tcol.g = ((double) pt[2]) / 255.0;
-          tcol.b = ((double) pt[3]) / 255.0;
-          
-          tcol.r = tcol.r * tcol.a;
-          tcol.g = tcol.g * tcol.a;
-          tcol.b = tcol.b * tcol.a;
-          
-        } else {
-          /* Shouldn't happen */
-          abort();
-        }
-      
-        /* Composite rcol OVER tcol and store result in fcol */
-        fcol.a = rcol.a + (tcol.a * (1.0 - rcol.a));
-        fcol.r = rcol.r + (tcol.r * (1.0 - rcol.a));
-        fcol.g = rcol.g + (tcol.g * (1.0 - rcol.a));
-        fcol.b = rcol.b + (tcol.b * (1.0 - rcol.a));
-      
-        /* Check for finite results */
-        if ((!isfinite(fcol.a)) ||
-            (!isfinite(fcol.r)) ||
-            (!isfinite(fcol.g)) |
-            (!isfinite(fcol.b))) {
-          fprintf(stderr, "Numeric problem during sparkle sampling!\n");
-          abort();
-        }
-      
-        /* Store to target buffer depending on channel count */
-        if (pTarget->c == 1) {
-          /* Grayscale, so we know alpha channel should be fully opaque
-           * since background pixel was fully opaque; begin by writing
-           * each of the color channels into the integer ARGB structure
-           * with the opacity set to 255 */
-          argb.a = 255;
-          argb.r = (int) floor(fcol.r * 255.0);
-          argb.g = (int) floor(fcol.g * 255.0);
-          argb.b = (int) floor(fcol.b * 255.0);
-          
-          /* Clamp channels */
-          if (argb.r < 0) {
-            argb.r = 0;
-          } else if (argb.r > 255) {
-            argb.r = 255;
-          }
-          
-          if (argb.g < 0) {
-            argb.g = 0;
-          } else if (argb.g > 255) {
-            argb.g = 255;
-          }
-          
-          if (argb.b < 0) {
-            argb.b = 0;
-          } else if (argb.b > 255) {
-            argb.b = 255;
-          }
-          
-          /* Down-convert to grayscale */
-          sph_argb_downGray(&argb);
-          
-          /* Store the resulting grayscale value */
-          *pt = (uint8_t) argb.g;
-          
-        } else if (pTarget->c == 3) {
-          /* RGB, so we know alpha channel should be fully opaque since
-           * background pixel was fully opaque; begin by writing each of
-           * the color channels into the integer ARGB structure with the
-           * opacity set to 255 */
-          argb.a = 255;
-          argb.r = (int) floor(fcol.r * 255.0);
-          argb.g = (int) floor(fcol.g * 255.0);
-          argb.b = (int) floor(fcol.b * 255.0);
-          
-          /* Clamp channels */
-          if (argb.r < 0) {
-            argb.r = 0;
-          } else if (argb.r > 255) {
-            argb.r = 255;
-          }
-          
-          if (argb.g < 0) {
-            argb.g = 0;
-          } else if (argb.g > 255) {
-            argb.g = 255;
-          }
-          
-          if (argb.b < 0) {
-            argb.b = 0;
-          } else if (argb.b > 255) {
-            argb.b = 255;
-          }
-          
-          /* Store the RGB value */
-          pt[0] = (uint8_t) argb.r;
-          pt[1] = (uint8_t) argb.g;
-          pt[2] = (uint8_t) argb.b;
-          
-        } else if (pTarget->c == 4) {
-          /* ARGB, so we need to convert back to non-premultiplied
-           * before storing; first of all, get the integer value for the
-           * alpha channel, which is the same in both representations */
-          argb.a = (int) floor(fcol.a);
-          
-          /* Clamp alpha */
-          if (argb.a < 0) {
-            argb.a = 0;
-          } else if (argb.a > 255) {
-            argb.a = 255;
-          }
-          
-          /* Conversion depends on whether alpha channel is zero */
-          if (argb.a < 1) {
-            /* Alpha channel is zero, so store transparent black */
-            pt[0] = (uint8_t) 0;
-            pt[1] = (uint8_t) 0;
-            pt[2] = (uint8_t) 0;
-            pt[3] = (uint8_t) 0;
-            
-          } else {
-            /* Alpha channel is non-zero, and we know it's not so close
-             * to zero that it would cause numeric problems, so convert
-             * the other channels to non-premultiplied */
-            fcol.r = fcol.r / fcol.a;
-            fcol.g = fcol.g / fcol.a;
-            fcol.b = fcol.b / fcol.a;
-            
-            /* Finite check */
-            if ((!isfinite(fcol.r)) ||
-                (!isfinite(fcol.g)) ||
-                (!isfinite(fcol.b))) {
-              fprintf(stderr,
-                "Numeric problem during sparkle sampling!\n");
-              abort();
-            }
-            
-            /* Clamp to range in float */
-            if (!(fcol.r <= 1.0)) {
-              fcol.r = 1.0;
-            } else if (!(fcol.r >= 0.0)) {
-              fcol.r = 0.0;
-            }
-            
-            if (!(fcol.g <= 1.0)) {
-              fcol.g = 1.0;
-            } else if (!(fcol.g >= 0.0)) {
-              fcol.g = 0.0;
-            }
-            
-            if (!(fcol.b <= 1.0)) {
-              fcol.b = 1.0;
-            } else if (!(fcol.b >= 0.0)) {
-              fcol.b = 0.0;
-            }
-            
-            /* Convert to integer channels */
-            argb.a = (int) floor(fcol.a * 255.0);
-            argb.r = (int) floor(fcol.r * 255.0);
-            argb.g = (int) floor(fcol.g * 255.0);
-            argb.b = (int) floor(fcol.b * 255.0);
-            
-            /* Clamp channels */
-            if (argb.a < 0) {
-              argb.a = 0;
-            } else if (argb.a > 255) {
-              argb.a = 255;
-            }
-            
-            if (argb.r < 0) {
-              argb.r = 0;
-            } else if (argb.r > 255) {
-              argb.r = 255;
-            }
-            
-            if (argb.g < 0) {
-              argb.g = 0;
-            } else if (argb.g > 255) {
-              argb.g = 255;
-            }
-            
-            if (argb.b < 0) {
-              argb.b = 0;
-            } else if (argb.b > 255) {
-              argb.b = 255;
-            }
-            
-            /* Store the ARGB value */
-            pt[0] = (uint8_t) argb.a;
-            pt[1] = (uint8_t) argb.r;
-            pt[2] = (uint8_t) argb.g;
-            pt[3] = (uint8_t) argb.b;
-          }
-          
-        } else {
-          /* Shouldn't happen */
-          abort();
-        }
-      }
-      
-      /* Move to the next pixel to render */
-      pt = pt + pTarget->c;
-      if (ps->flags & SKVM_FLAG_RASTERMASK) {
-        pm++;
+    for(v = 0; v < 255; v++) {
+      if ((job.hist)[k][v] > 0) {
+        break;
       }
     }
+    (ps->min)[k] = v;
     
-    /* If this is not the last rendering iteration, move to the next
-     * rendering scanline using the pointer we saved at the start of
-     * this loop iteration */
-    if (y < max_y) {
-      pt = pscan + stride;
-      if (ps->flags & SKVM_FLAG_RASTERMASK) {
-        pm = pscan_m + pMask->w;
+    for(v = 255; v > 0; v--) {
+      if ((job.hist)[k][v] > 0) {
+        break;
       }
     }
+    (ps->max)[k] = v;
   }
 }
 
 /*
- * skvm_color_invert function.
+ * skvm_compare function.
  */
-void skvm_color_invert(int32_t i) {
+void skvm_compare(
+    SKVM_CTX      * pv,
+    int32_t         a,
+    int32_t         b,
+    SKVM_COMPARE  * pc) {
+  
+  SKBUF *pa = NULL;
+  SKBUF *pb = NULL;
+  SKCMPJOB job;
+  int32_t rows = 0;
+  int32_t cols = 0;
+  int32_t r = 0;
+  int k = 0;
+  uint64_t err = 0;
+  double ssim = 0.0;
   
-  SKBUF *ps = NULL;
-  int32_t total_comp = 0;
-  int32_t j = 0;
-  int c = 0;
+  /* Initialize structures */
+  memset(&job, 0, sizeof(SKCMPJOB));
   
-  /* Check state */
-  if (!m_init) {
+  /* Check context */
+  if (pv == NULL) {
     abort();
   }
   
   /* Check parameters */
-  if ((i < 0) || (i >= m_bufc)) {
+  if ((a < 0) || (a >= pv->bufc) || (b < 0) || (b >= pv->bufc) ||
+      (pc == NULL)) {
     abort();
   }
   
-  /* Get buffer register */
-  ps = &(m_pbuf[i]);
+  /* Get buffer registers and check that they are loaded and have the
+   * same dimensions and channels */
+  pa = &(pv->pbuf[a]);
+  pb = &(pv->pbuf[b]);
+  if ((pa->pData == NULL) || (pb->pData == NULL)) {
+    abort();
+  }
+  if ((pa->w != pb->w) || (pa->h != pb->h) || (pa->c != pb->c)) {
+    abort();
+  }
   
-  /* Fault if buffer is not loaded */
-  if (ps->pData == NULL) {
+  /* Apply any pending color lookups so the values are current */
+  buf_settle(pa);
+  buf_settle(pb);
+  
+  /* Allocate the sums of each window row */
+  rows = (pa->h + (SKVM_SSIM_WIN - 1)) / SKVM_SSIM_WIN;
+  cols = (pa->w + (SKVM_SSIM_WIN - 1)) / SKVM_SSIM_WIN;
+  job.pA = pa;
+  job.pB = pb;
+  job.pErr = (uint64_t *) calloc((size_t) rows, sizeof(uint64_t));
+  job.pSsim = (double *) calloc((size_t) rows, sizeof(double));
+  job.pMax = (uint8_t *) calloc(((size_t) rows) * 4, 1);
+  if ((job.pErr == NULL) || (job.pSsim == NULL) ||
+      (job.pMax == NULL)) {
     abort();
   }
   
-  /* Calculate the total number of components */
-  total_comp = ps->w * ps->h * ps->c;
+  /* Compute the sums, with each band a range of window rows */
+  par_rows(rows,
+            ((size_t) pa->w) * ((size_t) pa->c) * (SKVM_SSIM_WIN * 2),
+            &cmp_band, &job);
   
-  /* Invert all components, except not the alpha channel in ARGB */
-  for(j = 0; j < total_comp; j++) {
+  /* Add up the window rows in order */
+  for(r = 0; r < rows; r++) {
+    err += (job.pErr)[r];
+    ssim += (job.pSsim)[r];
+  }
   
-    /* If we are in ARGB mode and this is an alpha channel, skip it */
-    if (ps->c == 4) {
-      if ((j % 4) == 0) {
-        continue;
+  /* Compute the results */
+  memset(pc, 0, sizeof(SKVM_COMPARE));
+  pc->mse = ((double) err) /
+    (((double) pa->w) * ((double) pa->h) * ((double) pa->c));
+  if (err > 0) {
+    pc->psnr = 10.0 * log10((255.0 * 255.0) / pc->mse);
+  } else {
+    pc->psnr = INFINITY;
+  }
+  pc->ssim = ssim / (((double) rows) * ((double) cols) * pa->c);
+  for(r = 0; r < rows; r++) {
+    for(k = 0; k < pa->c; k++) {
+      if ((job.pMax)[(r * 4) + k] > pc->maxerr[k]) {
+        pc->maxerr[k] = (job.pMax)[(r * 4) + k];
       }
     }
-    
-    /* Get current component */
-    c = (ps->pData)[j];
-    
-    /* Invert it */
-    c = 255 - c;
-    
-    /* Update current component */
-    (ps->pData)[j] = (uint8_t) c;
   }
+  
+  /* Free the sums */
+  free(job.pErr);
+  free(job.pSsim);
+  free(job.pMax);
+  job.pErr = NULL;
+  job.pSsim = NULL;
+  job.pMax = NULL;
 }
@@ -15,7 +15,7 @@
 
 /*
  * The maximum number of buffers and matrices that can be declared to
- * skvm_init().
+ * skvm_alloc().
  */
 #define SKVM_MAX_BUFC   (4096)
 #define SKVM_MAX_MATC   (4096)
@@ -26,6 +26,65 @@
  */
 #define SKVM_MAX_DIM    (16384)
 
+/*
+ * The maximum number of threads that may be passed to skvm_threads().
+ */
+#define SKVM_MAX_THREADS (64)
+
+/*
+ * The maximum depth that may be passed to skvm_pipeline().
+ */
+#define SKVM_MAX_PIPELINE (16)
+
+/*
+ * The maximum magnitude of the channel coefficients and offsets that
+ * may be passed to skvm_color_matrix().
+ */
+#define SKVM_CMAT_MAX_COEF    (64.0)
+#define SKVM_CMAT_MAX_OFFSET  (16384.0)
+
+/*
+ * The maximum standard deviation that may be passed to skvm_blur().
+ */
+#define SKVM_BLUR_MAX_SIGMA   (2048.0)
+
+/*
+ * The maximum number of sub-images in an atlas table loaded with
+ * skvm_load_atlas(), and the maximum length of a sub-image name or of
+ * the sheet file name, not including the terminating nul.
+ */
+#define SKVM_ATLAS_MAX_COUNT  (65536)
+#define SKVM_ATLAS_MAX_NAME   (63)
+
+/*
+ * The maximum number of glyphs in a font table loaded with
+ * skvm_load_font(), and the largest font size in pixels that may be
+ * passed to skvm_text().
+ */
+#define SKVM_FONT_MAX_GLYPHS  (65536)
+#define SKVM_FONT_MAX_SIZE    (4096.0)
+
+/*
+ * The maximum magnitude of the coordinates, radii, and feather widths
+ * of a shape mask in the sample operation.
+ */
+#define SKVM_SHAPE_MAX_COORD  (1048576.0)
+
+/*
+ * The width and height in pixels of the windows that skvm_compare()
+ * computes structural similarity over.
+ */
+#define SKVM_SSIM_WIN (8)
+
+/*
+ * SKVM_CTX structure prototype.
+ * 
+ * The actual structure is defined in the implementation file.  Use
+ * skvm_alloc() and skvm_free() to manage contexts.
+ */
+struct SKVM_CTX_TAG;
+typedef struct SKVM_CTX_TAG SKVM_CTX;
+
 /*
  * Constants for selecting a sampling algorithm.
  */
@@ -43,6 +102,37 @@
 #define SKVM_FLAG_RIGHTMODE   (16)
 #define SKVM_FLAG_ABOVEMODE   (32)
 #define SKVM_FLAG_BELOWMODE   (64)
+#define SKVM_FLAG_COLORLUT    (128)
+#define SKVM_FLAG_COLORMATRIX (256)
+#define SKVM_FLAG_SHAPEINVERT (512)
+
+/*
+ * Shape masks for the sample operation.
+ */
+#define SKVM_SHAPE_NONE     (0)   /* No shape mask */
+#define SKVM_SHAPE_RECT     (1)   /* Rectangle */
+#define SKVM_SHAPE_ELLIPSE  (2)   /* Ellipse inscribed in rectangle */
+#define SKVM_SHAPE_RRECT    (3)   /* Rounded rectangle */
+#define SKVM_SHAPE_LINEAR   (4)   /* Linear ramp */
+#define SKVM_SHAPE_RADIAL   (5)   /* Radial ramp */
+
+/*
+ * Blend modes for the sample operation.
+ */
+#define SKVM_BLEND_OVER     (0)   /* Source over target */
+#define SKVM_BLEND_ADD      (1)   /* Saturating sum */
+#define SKVM_BLEND_MULTIPLY (2)   /* Multiply */
+#define SKVM_BLEND_SCREEN   (3)   /* Screen */
+#define SKVM_BLEND_SRC      (4)   /* Source replaces target */
+#define SKVM_BLEND_DSTIN    (5)   /* Target kept inside source */
+#define SKVM_BLEND_DSTOUT   (6)   /* Target kept outside source */
+
+/*
+ * Rendering modes for skvm_reference().
+ */
+#define SKVM_REF_DEFAULT  (0)   /* Use the default */
+#define SKVM_REF_OFF      (1)   /* Fast paths */
+#define SKVM_REF_ON       (2)   /* Reference rendering */
 
 /*
  * Structure storing all the parameters necessary for a sampling
@@ -71,9 +161,26 @@ typedef struct {
    * 
    * Only relevant if raster masking is in effect, otherwise ignored.
    * If in effect, may not be the same as src_buf or target_buf.
+   * 
+   * The buffer must be grayscale, ARGB, or a compressed mask.  The mask
+   * values of an ARGB buffer are its alpha channel, which is read in
+   * place.
    */
   int32_t mask_buf;
   
+  /*
+   * The position of the raster mask within the target buffer.
+   * 
+   * Only relevant if raster masking is in effect, otherwise ignored.
+   * The top-left pixel of the mask buffer covers target pixel
+   * (mask_x, mask_y).  Both must be in range [-SKVM_MAX_DIM,
+   * SKVM_MAX_DIM].  The mask buffer need not have the same dimensions
+   * as the target buffer.  Target pixels it does not cover are masked
+   * out.
+   */
+  int32_t mask_x;
+  int32_t mask_y;
+  
   /*
    * The subarea of the source buffer to sample.
    * 
@@ -111,6 +218,56 @@ typedef struct {
    */
   double y_boundary;
   
+  /*
+   * The shape mask, if procedural masking is in effect.
+   * 
+   * mask_shape is one of the SKVM_SHAPE_ constants.  Ignored if raster
+   * masking is in effect.  SKVM_SHAPE_NONE means that only the boundary
+   * lines mask pixels.  Otherwise, the shape is applied on top of the
+   * boundary lines, and it gives each target pixel a coverage that
+   * scales the alpha of sampled pixels in the same way as a raster
+   * mask would.
+   * 
+   * All coordinates are in target pixel space, where the target pixel
+   * at (x, y) covers the area from (x, y) to (x + 1, y + 1).  All
+   * values must be finite and have a magnitude of at most
+   * SKVM_SHAPE_MAX_COORD.
+   * 
+   * For SKVM_SHAPE_RECT, SKVM_SHAPE_ELLIPSE, and SKVM_SHAPE_RRECT, the
+   * (shape_x0, shape_y0) and (shape_x1, shape_y1) points are the
+   * top-left and bottom-right corners of the rectangle, which may not
+   * be empty.  The ellipse is inscribed in this rectangle.  For the
+   * rounded rectangle, shape_r is the corner radius, which must be
+   * zero or greater and at most half the width and half the height.
+   * shape_f is the feather width, which must be zero or greater.  The
+   * edge of the shape fades out over this width, centered on the
+   * edge.  Feather widths below 1.0 are treated as 1.0, which
+   * anti-aliases the edge.
+   * 
+   * For SKVM_SHAPE_LINEAR, coverage is zero at (shape_x0, shape_y0) and
+   * full at (shape_x1, shape_y1), which must be different points.
+   * Coverage ramps linearly between the two points, and is constant
+   * along lines perpendicular to the line through them.  shape_r and
+   * shape_f are ignored.
+   * 
+   * For SKVM_SHAPE_RADIAL, (shape_x0, shape_y0) is the center.
+   * Coverage is full within a distance of shape_r from the center,
+   * which must be zero or greater, and then ramps down to zero over a
+   * further distance of shape_f, which is treated as 1.0 if it is
+   * less than that.  shape_x1 and shape_y1 are ignored.
+   * 
+   * If the SKVM_FLAG_SHAPEINVERT flag is set, the coverage of the shape
+   * is inverted, so that it masks the inside of the shape instead of
+   * the outside.
+   */
+  int mask_shape;
+  double shape_x0;
+  double shape_y0;
+  double shape_x1;
+  double shape_y1;
+  double shape_r;
+  double shape_f;
+  
   /*
    * The sampling algorithm to use.
    * 
@@ -118,6 +275,20 @@ typedef struct {
    */
   int sample_alg;
   
+  /*
+   * The blend mode, which determines how sampled pixels are combined
+   * with target pixels.
+   * 
+   * Must be one of the SKVM_BLEND_ constants.  Zero selects
+   * SKVM_BLEND_OVER.  All blending is done with premultiplied alpha.
+   * Target buffers without an alpha channel are treated as opaque, and
+   * only the color channels of the result are stored.  Where a mask
+   * partially covers a target pixel, the result is moved back towards
+   * the target pixel in proportion.  Only target pixels that the
+   * source area projects onto are blended.
+   */
+  int blend;
+  
   /*
    * Various flags, this is a combination of SKVM_FLAG_ constants,
    * combined together with |
@@ -134,7 +305,9 @@ typedef struct {
    * selecting procedural masking mode, one selecting either left or
    * right mode, and one selecting either above or below mode.  The
    * x_boundary and y_boundary fields will in this case determine where
-   * the boundary lines are for the procedural mask.
+   * the boundary lines are for the procedural mask.  The mask_shape
+   * field may add a shape to the procedural mask, which is inverted if
+   * SKVM_FLAG_SHAPEINVERT is also given.
    * 
    * If you are using raster masking, use the SKVM_FLAG_RASTERMASK flag.
    * In this case, mask_buf selects the buffer that will be used as a
@@ -145,17 +318,157 @@ typedef struct {
    * 
    *   SKVM_FLAG_PROCMASK | SKVM_FLAG_LEFTMODE | SKVM_FLAG_ABOVEMODE
    * 
-   * and then set both x_boundary and y_boundary to 0.0.
+   * and then set both x_boundary and y_boundary to 0.0, with mask_shape
+   * set to SKVM_SHAPE_NONE.
+   * 
+   * To transform the colors of sampled pixels before they are
+   * composited, add SKVM_FLAG_COLORLUT and/or SKVM_FLAG_COLORMATRIX,
+   * and set the pLut and/or pCMat fields.
    */
   int flags;
   
+  /*
+   * The color lookup table applied to each sampled pixel, if the
+   * SKVM_FLAG_COLORLUT flag is set, else ignored.
+   * 
+   * This has the same format as for skvm_color_lut(), except that all
+   * four tables are used, because sampled pixels are always ARGB.
+   */
+  const uint8_t *pLut;
+  
+  /*
+   * The color matrix applied to each sampled pixel, if the
+   * SKVM_FLAG_COLORMATRIX flag is set, else ignored.
+   * 
+   * This has the same format and limits as for skvm_color_matrix(),
+   * except that all four rows are used, because sampled pixels are
+   * always ARGB.  If a lookup table is also given, the lookup is
+   * applied first.
+   */
+  const double *pCMat;
+  
 } SKVM_SAMPLE_PARAM;
 
 /*
- * Initialize the Sparkle virtual machine.
+ * Structure that receives the statistics of a buffer from skvm_stats().
+ */
+typedef struct {
+  
+  /*
+   * The number of channels measured, which is the channel count of the
+   * buffer.
+   * 
+   * Channels are in the same order as within the buffer, so 1 is gray,
+   * 3 is red, green, and blue, and 4 is alpha, red, green, and blue.
+   * Alpha is non-premultiplied, and float buffers are measured as the
+   * ARGB values they would be stored as.
+   */
+  int c;
+  
+  /*
+   * The mean, minimum, and maximum of each channel, in range [0, 255].
+   * 
+   * Only the first c entries are used.
+   */
+  double mean[4];
+  int min[4];
+  int max[4];
+  
+  /*
+   * The histogram of each channel.
+   * 
+   * hist[k][v] is the number of pixels where channel k has value v.
+   * Only the first c histograms are used.
+   */
+  uint32_t hist[4][256];
+  
+} SKVM_STATS;
+
+/*
+ * Structure that receives the result of comparing two buffers with
+ * skvm_compare().
+ */
+typedef struct {
+  
+  /*
+   * The mean squared error over all channels of all pixels, with
+   * channels in range [0, 255].
+   */
+  double mse;
+  
+  /*
+   * The peak signal-to-noise ratio in decibels.
+   * 
+   * This is infinite if mse is zero.
+   */
+  double psnr;
+  
+  /*
+   * The structural similarity index, which is 1.0 for identical
+   * buffers and lower the more they differ.
+   * 
+   * This is the mean over all channels of all windows of
+   * SKVM_SSIM_WIN by SKVM_SSIM_WIN pixels.  Windows along the right
+   * and bottom edges may be smaller.
+   */
+  double ssim;
+  
+  /*
+   * The largest absolute difference of each channel over all pixels,
+   * in range [0, 255].
+   * 
+   * Channels are in the order they are stored in the buffers, and
+   * only the first c values are used.
+   */
+  int32_t maxerr[4];
+  
+} SKVM_COMPARE;
+
+/*
+ * Structure that receives how the work of the most recent sampling
+ * operation was balanced across threads, from skvm_balance().
+ */
+typedef struct {
+  
+  /*
+   * The number of threads that the rendering area was split among.
+   * 
+   * This is 1 if the whole rendering area was rendered on the calling
+   * thread, and 0 if there was nothing to render.
+   */
+  int32_t workers;
+  
+  /*
+   * The number of tiles the rendering area was split into, and the
+   * number of tiles that were stolen by a thread other than the one
+   * they were first assigned to.
+   * 
+   * If the rendering area was not split, tiles is 1.
+   */
+  int32_t tiles;
+  int32_t steals;
+  
+  /*
+   * For each thread, the number of tiles it rendered, the estimated
+   * cost of those tiles in pixels, and the seconds it spent rendering
+   * them.
+   * 
+   * Only the first workers entries are used.
+   */
+  int32_t count[SKVM_MAX_THREADS];
+  double cost[SKVM_MAX_THREADS];
+  double busy[SKVM_MAX_THREADS];
+  
+} SKVM_BALANCE;
+
+/*
+ * Allocate a new Sparkle virtual machine context.
  * 
- * You must call this function before using any of the other functions
- * in this module.  You may only call this function once.
+ * Each context has its own buffer and matrix registers and its own
+ * error message, so independent contexts may be used concurrently from
+ * different threads.  However, a single context may only be used by one
+ * thread at a time.  The warm state (see skvm_keep_warm) is shared
+ * between all contexts.
  * 
  * bufc must be in range [0, SKVM_MAX_BUFC] and matc must be in range
  * [0, SKVM_MAX_MATC].
@@ -168,8 +481,156 @@ typedef struct {
  *   bufc - the maximum number of buffer objects
  * 
  *   matc - the maximum number of matrix objects
+ * 
+ * Return:
+ * 
+ *   a new context
+ */
+SKVM_CTX *skvm_alloc(int32_t bufc, int32_t matc);
+
+/*
+ * Release a Sparkle virtual machine context.
+ * 
+ * All buffer and matrix registers are released.  If warm state is being
+ * kept (see skvm_keep_warm), the pixel data of released buffers is
+ * pooled for reuse by later contexts rather than freed.
+ * 
+ * Any pending pipelined stores (see skvm_pipeline) are waited for
+ * before the context is released, and any errors they report are
+ * ignored.  Call skvm_sync() first if those errors matter.
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context to release, or NULL
+ */
+void skvm_free(SKVM_CTX *pv);
+
+/*
+ * Enable or disable keeping warm state across scripts.
+ * 
+ * Warm state is intended for daemon mode, where many scripts are run
+ * within a single process.  It consists of three parts.  First, a pool
+ * of released buffer memory that is reused for buffers of exactly the
+ * same size.  Second, an asset cache of decoded PNG and JPEG images and
+ * Motion-JPEG frames, keyed by path, frame, buffer format, and the size
+ * and modification time of the file, with least recently used entries
+ * evicted when the cache is full.  Third, the frame index tables and
+ * open file handles of recently used Motion-JPEG sequences.
+ * 
+ * Warm state is disabled by default.  Disabling it releases everything
+ * currently held in warm state.  This function may be called at any
+ * time, but disabling warm state while other threads are using
+ * contexts only releases what is not currently in use.
+ * 
+ * Parameters:
+ * 
+ *   enable - non-zero to keep warm state, zero to release it
+ */
+void skvm_keep_warm(int enable);
+
+/*
+ * Set how many threads the operations started on the calling thread
+ * may use.
+ * 
+ * n counts the calling thread itself, so 1 means that operations run
+ * only on the calling thread.  n must be in range [0, SKVM_MAX_THREADS]
+ * or a fault occurs.  Zero selects the default, which is the value of
+ * the SPARKLE_THREADS environment variable if it holds a number in
+ * that range, or else the number of online processors.
+ * 
+ * Operations that split their work among threads take the threads from
+ * a single worker pool shared by the whole process, so contexts running
+ * on different threads do not each start their own threads.  The pool
+ * grows as needed to give the calling thread n threads, and its worker
+ * threads are never stopped.  When all worker threads are busy,
+ * operations do more of their work on the calling thread.  The results
+ * of operations never depend on the number of threads.
+ * 
+ * The setting only applies to the calling thread, so each thread that
+ * runs scripts may have its own setting.
+ * 
+ * Parameters:
+ * 
+ *   n - the number of threads, or zero for the default
+ */
+void skvm_threads(int32_t n);
+
+/*
+ * Set whether skvm_sample() on the calling thread uses the reference
+ * renderer.
+ * 
+ * mode is one of the SKVM_REF_ constants, or a fault occurs.  The
+ * reference renderer evaluates every target pixel on its own, straight
+ * from the definition of sampling in double precision, on the calling
+ * thread only.  It skips all the fast paths: the bounding box of the
+ * source area, the exact kernel for whole-pixel matrices, the split
+ * projection for matrices that do not rotate, the interior fill of
+ * shape masks, and tiling across threads.  Its output is what the fast
+ * paths are checked against, so it is much slower and should only be
+ * used for conformance checks.
+ * 
+ * SKVM_REF_DEFAULT selects the default, which is reference rendering
+ * if the SPARKLE_REFERENCE environment variable is set to anything
+ * other than an empty string or "0", and the fast paths otherwise.
+ * 
+ * The setting only applies to the calling thread.
+ * 
+ * Parameters:
+ * 
+ *   mode - the rendering mode
  */
-void skvm_init(int32_t bufc, int32_t matc);
+void skvm_reference(int mode);
+
+/*
+ * Set how many stores may be pending on a context at once.
+ * 
+ * With a depth of zero, which is the default, skvm_store_png() and
+ * skvm_store_jpeg() encode and write the file before they return.
+ * With a greater depth, the stores hand the buffer to the worker pool
+ * (see skvm_threads) and return at once, so that encoding one frame
+ * overlaps with computing the next.  At most depth stores are pending
+ * at any time; a store beyond that first waits for the oldest pending
+ * store to finish.  Stores to the same context are always written in
+ * the order they were made.
+ * 
+ * A pending store holds a copy-on-write share of the buffer, so the
+ * buffer may be modified or reset right after the store returns.  Each
+ * pending store therefore may hold up to one extra copy of a buffer.
+ * 
+ * Loading any file waits for all pending stores first, so a file that
+ * was just stored may be loaded again.  Errors of pending stores are
+ * reported by a later store or by skvm_sync().
+ * 
+ * If the calling thread may only use one thread, stores are always
+ * written before they return.  depth must be in range
+ * [0, SKVM_MAX_PIPELINE] or a fault occurs.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   depth - the maximum number of pending stores
+ */
+void skvm_pipeline(SKVM_CTX *pv, int32_t depth);
+
+/*
+ * Wait for all pending stores on a context to finish.
+ * 
+ * See skvm_pipeline() for which stores may be pending.  If any of
+ * them failed, the function fails and skvm_reason() can retrieve the
+ * reason of the first one that failed.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if a pending store failed
+ */
+int skvm_sync(SKVM_CTX *pv);
 
 /*
  * Return an error message from the last operation.
@@ -181,56 +642,72 @@ void skvm_init(int32_t bufc, int32_t matc);
  * 
  * The returned message is statically allocated and should not be freed.
  * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
  * Return:
  * 
  *   the error message from the last operation
  */
-const char *skvm_reason(void);
+const char *skvm_reason(SKVM_CTX *pv);
 
 /*
- * Return the bufc value that was used to initialize skvm_init().
+ * Return the bufc value that was used to allocate the context.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
  * 
  * Return:
  * 
  *   the bufc value
  */
-int32_t skvm_bufc(void);
+int32_t skvm_bufc(SKVM_CTX *pv);
 
 /*
- * Return the matc value that was used to initialize skvm_init().
+ * Return the matc value that was used to allocate the context.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
  * 
  * Return:
  * 
  *   the matc value
  */
-int32_t skvm_matc(void);
+int32_t skvm_matc(SKVM_CTX *pv);
 
 /*
  * Get the current pixel dimensions of a given buffer object.
  * 
  * i is the index of the buffer object to query.  It must be at least
- * zero and less than the bufc value passed to skvm_init().
+ * zero and less than the bufc value passed to skvm_alloc().
  * 
  * The width and height of the buffer is written to *pw and *ph.
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   i - the buffer to query
  * 
  *   pw - pointer to variable to receive the width
  * 
  *   ph - pointer to variable to receive the height
  */
-void skvm_get_dim(int32_t i, int32_t *pw, int32_t *ph);
+void skvm_get_dim(SKVM_CTX *pv, int32_t i, int32_t *pw, int32_t *ph);
 
 /*
  * Get the current number of channels of a given buffer object.
  * 
  * i is the index of the buffer object to query.  It must be at least
- * zero and less than the bufc value passed to skvm_init().
+ * zero and less than the bufc value passed to skvm_alloc().
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   i - the buffer to query
  * 
  * Return:
@@ -238,29 +715,72 @@ void skvm_get_dim(int32_t i, int32_t *pw, int32_t *ph);
  *   the current number of color channels in the buffer, which is either
  *   1 (grayscale), 3 (RGB), or 4 (ARGB)
  */
-int skvm_get_channels(int32_t i);
+int skvm_get_channels(SKVM_CTX *pv, int32_t i);
 
 /*
  * Check whether a given buffer object is currently loaded.
  * 
  * i is the index of the buffer object to query.  It must be at least
- * zero and less than the bufc value passed to skvm_init().
+ * zero and less than the bufc value passed to skvm_alloc().
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   i - the buffer to query
  * 
  * Return:
  * 
  *   non-zero if buffer is currently loaded, zero if not
  */
-int skvm_is_loaded(int32_t i);
+int skvm_is_loaded(SKVM_CTX *pv, int32_t i);
+
+/*
+ * Check whether a specific buffer object holds a compressed mask.
+ * 
+ * i is the index of the buffer object to query.  It must be at least
+ * zero and less than the bufc value passed to skvm_alloc().
+ * 
+ * A buffer object holding a compressed mask is not loaded, and it may
+ * only be used as a raster mask.  See skvm_mask_compress().
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer to query
+ * 
+ * Return:
+ * 
+ *   non-zero if buffer holds a compressed mask, zero if not
+ */
+int skvm_is_compressed(SKVM_CTX *pv, int32_t i);
+
+/*
+ * Check whether a specific buffer object is a float buffer.
+ * 
+ * i is the index of the buffer object to query.  It must be at least
+ * zero and less than the bufc value passed to skvm_alloc().
+ * 
+ * See skvm_reset_float() for how float buffers work.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer to query
+ * 
+ * Return:
+ * 
+ *   non-zero if buffer is a float buffer, zero if not
+ */
+int skvm_is_float(SKVM_CTX *pv, int32_t i);
 
 /*
  * Reset a specific buffer object.
  * 
  * i is the index of the buffer object to reset.  It must be at least
- * zero and less than the bufc value passed to skvm_init().
+ * zero and less than the bufc value passed to skvm_alloc().
  * 
  * w and h are the width and height of the buffer object, in pixels.
  * They must both be at least one and at most SKVM_MAX_DIM.
@@ -276,6 +796,8 @@ int skvm_is_loaded(int32_t i);
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   i - the buffer to reset
  * 
  *   w - the width of the buffer
@@ -284,13 +806,43 @@ int skvm_is_loaded(int32_t i);
  * 
  *   c - the number of channels in the buffer
  */
-void skvm_reset(int32_t i, int32_t w, int32_t h, int c);
+void skvm_reset(SKVM_CTX *pv, int32_t i, int32_t w, int32_t h, int c);
+
+/*
+ * Reset a specific buffer object to a float buffer.
+ * 
+ * This is like skvm_reset() with four channels, except the buffer
+ * object holds each channel as a float rather than a byte, and the
+ * color channels are stored premultiplied.  Float buffers are meant
+ * for accumulating many sampling operations, since results are not
+ * rounded to eight bits each time a pixel is composited.  They take
+ * four times as much memory as ARGB buffers.
+ * 
+ * A float buffer may only be filled with skvm_load_fill(), used as the
+ * source or target of skvm_sample(), and stored with skvm_store_png()
+ * or skvm_store_jpeg().  Storing converts to eight bits exactly the
+ * same way that sampling into an ARGB buffer does.  Using a float
+ * buffer with any other buffer function, or as a raster mask, causes a
+ * fault.  Calling skvm_reset() on the buffer object makes it an
+ * ordinary buffer again.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer to reset
+ * 
+ *   w - the width of the buffer
+ * 
+ *   h - the height of the buffer
+ */
+void skvm_reset_float(SKVM_CTX *pv, int32_t i, int32_t w, int32_t h);
 
 /*
  * Read a PNG file and load its contents into a buffer object.
  * 
  * i is the index of the buffer object to load.  It must be at least
- * zero and less than the bufc value passed to skvm_init().
+ * zero and less than the bufc value passed to skvm_alloc().
  * 
  * pPath is the path to the PNG file to load.
  * 
@@ -306,6 +858,8 @@ void skvm_reset(int32_t i, int32_t w, int32_t h, int c);
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   i - the buffer to load
  * 
  *   pPath - the path to the PNG file to read
@@ -314,13 +868,13 @@ void skvm_reset(int32_t i, int32_t w, int32_t h, int c);
  * 
  *   non-zero if successful, zero if error
  */
-int skvm_load_png(int32_t i, const char *pPath);
+int skvm_load_png(SKVM_CTX *pv, int32_t i, const char *pPath);
 
 /*
  * Read a JPEG file and load its contents into a buffer object.
  * 
  * i is the index of the buffer object to load.  It must be at least
- * zero and less than the bufc value passed to skvm_init().
+ * zero and less than the bufc value passed to skvm_alloc().
  * 
  * pPath is the path to the JPEG file to load.
  * 
@@ -336,6 +890,8 @@ int skvm_load_png(int32_t i, const char *pPath);
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   i - the buffer to load
  * 
  *   pPath - the path to the JPEG file to read
@@ -344,14 +900,14 @@ int skvm_load_png(int32_t i, const char *pPath);
  * 
  *   non-zero if successful, zero if error
  */
-int skvm_load_jpeg(int32_t i, const char *pPath);
+int skvm_load_jpeg(SKVM_CTX *pv, int32_t i, const char *pPath);
 
 /*
  * Read a JPEG frame from within a raw Motion-JPEG sequence and load its
  * contents into a buffer object.
  * 
  * i is the index of the buffer object to load.  It must be at least
- * zero and less than the bufc value passed to skvm_init().
+ * zero and less than the bufc value passed to skvm_alloc().
  * 
  * f is the frame number within the Motion-JPEG sequence, where zero is
  * the first frame.  The function will fail if the frame index is out of
@@ -384,6 +940,8 @@ int skvm_load_jpeg(int32_t i, const char *pPath);
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   i - the buffer to load
  * 
  *   pPath - the path to the JPEG file to read
@@ -392,19 +950,24 @@ int skvm_load_jpeg(int32_t i, const char *pPath);
  * 
  *   non-zero if successful, zero if error
  */
-int skvm_load_mjpg(int32_t i, int32_t f, const char *pIndexPath);
+int skvm_load_mjpg(
+    SKVM_CTX    * pv,
+    int32_t       i,
+    int32_t       f,
+    const char  * pIndexPath);
 
 /*
  * Load a buffer object with a solid color.
  * 
  * i is the index of the buffer object to load.  It must be at least
- * zero and less than the bufc value passed to skvm_init().
+ * zero and less than the bufc value passed to skvm_alloc().
  * 
  * a, r, g, b are the alpha, red, green, and blue channel values of the
  * color to use as a fill color.  All must be in the range 0-255.  If
  * the color channels in the buffer are less than four, this ARGB color
  * is automatically down-converted.  Alpha is non-premultiplied, and
- * zero means fully transparent.
+ * zero means fully transparent.  Float buffers store the color
+ * premultiplied without any rounding.
  * 
  * If the buffer is already loaded, this function overwrites all the
  * data currently in the buffer.  If the buffer is not currently loaded,
@@ -412,6 +975,8 @@ int skvm_load_mjpg(int32_t i, int32_t f, const char *pIndexPath);
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   i - the buffer to fill
  * 
  *   a - the alpha value (0-255)
@@ -422,23 +987,300 @@ int skvm_load_mjpg(int32_t i, int32_t f, const char *pIndexPath);
  * 
  *   b - the blue value (0-255)
  */
-void skvm_load_fill(int32_t i, int a, int r, int g, int b);
+void skvm_load_fill(
+    SKVM_CTX    * pv,
+    int32_t       i,
+    int           a,
+    int           r,
+    int           g,
+    int           b);
+
+/*
+ * Read a PNG file and load its contents into a buffer object as a
+ * compressed mask.
+ * 
+ * i is the index of the buffer object to load.  It must be at least
+ * zero and less than the bufc value passed to skvm_alloc().  The buffer
+ * object must be grayscale or a fault occurs.
+ * 
+ * pPath is the path to the PNG file to load.
+ * 
+ * The PNG file must have the exact same dimensions as the buffer object
+ * or the operation fails.  Colors in the PNG file are converted to
+ * grayscale.  The image is compressed one scanline at a time, so the
+ * whole mask is never held uncompressed.  The result is the same as
+ * loading the PNG file with skvm_load_png() and then calling
+ * skvm_mask_compress(), except that the asset cache is not used.
+ * 
+ * Anything the buffer object holds is released first.  If this
+ * operation fails, skvm_reason() can return an error message, and the
+ * buffer object is left unloaded.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer to load
+ * 
+ *   pPath - the path to the PNG file to read
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int skvm_load_mask(SKVM_CTX *pv, int32_t i, const char *pPath);
+
+/*
+ * Get the dimensions of a PNG file without loading it.
+ * 
+ * Only the header of the PNG file is read.  The dimensions must be in
+ * range [1, SKVM_MAX_DIM] or the operation fails.
+ * 
+ * If this operation fails, skvm_reason() can return an error message.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   pPath - the path to the PNG file to read
+ * 
+ *   pw - receives the width of the image
+ * 
+ *   ph - receives the height of the image
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int skvm_probe_png(
+          SKVM_CTX  * pv,
+    const char      * pPath,
+          int32_t   * pw,
+          int32_t   * ph);
+
+/*
+ * Load an atlas sheet and its sub-image table into a buffer.
+ * 
+ * i is the index of the buffer object to load.  It must be at least
+ * zero and less than the bufc value passed to skvm_alloc().
+ * 
+ * pPath is the path to the atlas table.  This is a text file.  Blank
+ * lines and lines whose first non-whitespace character is "#" are
+ * ignored.  The first other line holds the file name of the sheet,
+ * followed by its width and height.  The sheet is a PNG file in the
+ * same directory as the table.  Each following line describes one
+ * sub-image, with its name followed by the X and Y coordinates of its
+ * top-left corner in the sheet and its width and height.  Fields are
+ * separated by whitespace.  Sub-images are numbered from zero in the
+ * order they appear.  Names may not contain whitespace, may be at most
+ * SKVM_ATLAS_MAX_NAME characters, and must be unique within the table.
+ * Each sub-image must be entirely within the sheet, and there must be
+ * between one and SKVM_ATLAS_MAX_COUNT sub-images.
+ * 
+ * The buffer object is reset to an ARGB buffer with the dimensions of
+ * the sheet, the sheet is loaded into it as if by skvm_load_png(), and
+ * the table is attached to the buffer object.  The table can then be
+ * queried with skvm_atlas_count(), skvm_atlas_find(), and
+ * skvm_atlas_get().  The table stays attached until the buffer object
+ * is reset, even if its pixel data is modified.
+ * 
+ * If this operation fails, skvm_reason() can return an error message,
+ * and the buffer object is left unloaded.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer to load
+ * 
+ *   pPath - the path to the atlas table
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int skvm_load_atlas(SKVM_CTX *pv, int32_t i, const char *pPath);
+
+/*
+ * Get the number of sub-images in the atlas table of a buffer.
+ * 
+ * i is the index of the buffer object.  It must be at least zero and
+ * less than the bufc value passed to skvm_alloc().
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer
+ * 
+ * Return:
+ * 
+ *   the number of sub-images, or zero if the buffer has no atlas table
+ */
+int32_t skvm_atlas_count(SKVM_CTX *pv, int32_t i);
+
+/*
+ * Look up a sub-image by name in the atlas table of a buffer.
+ * 
+ * i is the index of the buffer object.  It must be at least zero and
+ * less than the bufc value passed to skvm_alloc().
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer
+ * 
+ *   pName - the name of the sub-image
+ * 
+ * Return:
+ * 
+ *   the index of the sub-image, or -1 if the buffer has no atlas table
+ *   or the table has no sub-image of that name
+ */
+int32_t skvm_atlas_find(SKVM_CTX *pv, int32_t i, const char *pName);
+
+/*
+ * Get the rectangle of a sub-image in the atlas table of a buffer.
+ * 
+ * i is the index of the buffer object.  It must be at least zero and
+ * less than the bufc value passed to skvm_alloc(), and the buffer must
+ * have an atlas table.  k is the index of the sub-image, which must be
+ * at least zero and less than skvm_atlas_count().
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer
+ * 
+ *   k - the sub-image index
+ * 
+ *   px - receives the X coordinate of the top-left corner
+ * 
+ *   py - receives the Y coordinate of the top-left corner
+ * 
+ *   pw - receives the width
+ * 
+ *   ph - receives the height
+ */
+void skvm_atlas_get(
+    SKVM_CTX  * pv,
+    int32_t     i,
+    int32_t     k,
+    int32_t   * px,
+    int32_t   * py,
+    int32_t   * pw,
+    int32_t   * ph);
+
+/*
+ * Load a font sheet and its glyph table into a buffer.
+ * 
+ * i is the index of the buffer object to load.  It must be at least
+ * zero and less than the bufc value passed to skvm_alloc().
+ * 
+ * pPath is the path to the font table.  This is a text file with the
+ * same layout as the atlas tables of skvm_load_atlas(), starting with
+ * the line that names the sheet and gives its dimensions.  The next
+ * line selects the kind of font, and is either of the following:
+ * 
+ *   bitmap [size] [line]
+ *   sdf [size] [line] [range]
+ * 
+ * [size] is the font size in pixels that the sheet was made for, and
+ * [line] is the distance between baselines at that size.  The sheet of
+ * a bitmap font holds the coverage of each glyph.  The sheet of an SDF
+ * font holds a signed distance field, where a value v is at a distance
+ * of ((v - 127.5) / 127.5) * [range] sheet pixels from the edge of the
+ * glyph, positive inside.  All three values must be at least one.
+ * 
+ * Each following line describes one glyph:
+ * 
+ *   [code] [x] [y] [w] [h] [xoff] [yoff] [advance]
+ * 
+ * [code] is the Unicode codepoint of the glyph, which may appear only
+ * once.  [x] [y] [w] [h] is the rectangle of the glyph in the sheet,
+ * which must be entirely within the sheet.  The width and height may
+ * both be zero for glyphs that draw nothing, such as the space.
+ * [xoff] [yoff] is the offset of the top-left corner of the rectangle
+ * from the pen position on the baseline, and [advance] is how far the
+ * pen moves to the right after the glyph.  All values are integers in
+ * sheet pixels.  There must be between one and SKVM_FONT_MAX_GLYPHS
+ * glyphs.
+ * 
+ * The coverage or distance value of a sheet pixel is its alpha channel
+ * multiplied by its gray level, so glyphs may be drawn either in white
+ * on a transparent background or in white on an opaque black
+ * background.
+ * 
+ * The buffer object is reset to an ARGB buffer with the dimensions of
+ * the sheet, the sheet is loaded into it as if by skvm_load_png(), and
+ * the font is attached to the buffer object, where skvm_text() can use
+ * it.  The font keeps its own copy of the glyph coverage, so changing
+ * the pixel data of the buffer object afterwards does not change the
+ * glyphs.  The font stays attached until the buffer object is reset.
+ * 
+ * Only the sheet goes through the warm asset cache (see skvm_keep_warm).
+ * The table is parsed again, and the glyph cache that skvm_text() fills
+ * starts out empty, every time a font is loaded.
+ * 
+ * If this operation fails, skvm_reason() can return an error message,
+ * and the buffer object is left unloaded.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer to load
+ * 
+ *   pPath - the path to the font table
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int skvm_load_font(SKVM_CTX *pv, int32_t i, const char *pPath);
+
+/*
+ * Check whether a buffer has a font attached.
+ * 
+ * i is the index of the buffer object.  It must be at least zero and
+ * less than the bufc value passed to skvm_alloc().
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer
+ * 
+ * Return:
+ * 
+ *   non-zero if the buffer was loaded with skvm_load_font(), zero if
+ *   not
+ */
+int skvm_has_font(SKVM_CTX *pv, int32_t i);
 
 /*
  * Store the contents of a loaded buffer into a PNG file.
  * 
  * i is the index of the buffer object to store.  It must be at least
- * zero and less than the bufc value passed to skvm_init().
+ * zero and less than the bufc value passed to skvm_alloc().
  * 
  * If the buffer is not currently loaded, this function will fail.
  * 
  * pPath is the path to the PNG file to write.  If the path already
  * exists, it will be overwritten.
  * 
+ * If stores are pipelined (see skvm_pipeline), the file may be written
+ * after the function returns, and the function also fails if an
+ * earlier pending store failed.
+ * 
  * If the function fails, skvm_reason() can retrieve a reason.
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   i - the buffer to store
  * 
  *   pPath - path to the PNG file to store to
@@ -447,13 +1289,13 @@ void skvm_load_fill(int32_t i, int a, int r, int g, int b);
  * 
  *   non-zero if successful, zero if error
  */
-int skvm_store_png(int32_t i, const char *pPath);
+int skvm_store_png(SKVM_CTX *pv, int32_t i, const char *pPath);
 
 /*
  * Store the contents of a loaded buffer into a (M-)JPEG file.
  * 
  * i is the index of the buffer object to store.  It must be at least
- * zero and less than the bufc value passed to skvm_init().
+ * zero and less than the bufc value passed to skvm_alloc().
  * 
  * If the buffer is not currently loaded, this function will fail.
  * 
@@ -465,10 +1307,16 @@ int skvm_store_png(int32_t i, const char *pPath);
  * If mjpg is non-zero, then we are in M-JPEG mode.  If the file at path
  * pPath already exists, we will append this new frame to the end of it.
  * 
+ * If stores are pipelined (see skvm_pipeline), the file may be written
+ * after the function returns, and the function also fails if an
+ * earlier pending store failed.
+ * 
  * If the function fails, skvm_reason() can retrieve a reason.
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   i - the buffer to store
  * 
  *   pPath - path to the JPEG file to store to
@@ -482,19 +1330,26 @@ int skvm_store_png(int32_t i, const char *pPath);
  * 
  *   non-zero if successful, zero if error
  */
-int skvm_store_jpeg(int32_t i, const char *pPath, int mjpg, int q);
+int skvm_store_jpeg(
+    SKVM_CTX    * pv,
+    int32_t       i,
+    const char  * pPath,
+    int           mjpg,
+    int           q);
 
 /*
  * Reset a given matrix register to the identity.
  * 
  * m is the index of the matrix register.  It must be at least zero and
- * less than the matc value passed to skvm_init().
+ * less than the matc value passed to skvm_alloc().
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   m - the matrix register
  */
-void skvm_matrix_reset(int32_t m);
+void skvm_matrix_reset(SKVM_CTX *pv, int32_t m);
 
 /*
  * Multiply two matrix registers together and store the result in a
@@ -505,64 +1360,78 @@ void skvm_matrix_reset(int32_t m);
  *     m = a * b
  * 
  * All three arguments must be matrix registers that are at least zero
- * and less than the matc value passed to skvm_init().
+ * and less than the matc value passed to skvm_alloc().
  * 
  * In addition, the m register may not be the same as either the a or b
  * registers.  However, the a and b registers may be the same.
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   m - the matrix register to store the result in
  * 
  *   a - the first matrix register operand
  * 
  *   b - the second matrix register operand
  */
-void skvm_matrix_multiply(int32_t m, int32_t a, int32_t b);
+void skvm_matrix_multiply(
+    SKVM_CTX    * pv,
+    int32_t       m,
+    int32_t       a,
+    int32_t       b);
 
 /*
  * Premultiply a matrix register by a translation transform.
  * 
  * m is the index of the matrix register.  It must be at least zero and
- * less than the matc value passed to skvm_init().
+ * less than the matc value passed to skvm_alloc().
  * 
  * tx and ty are the translations that are done on X coordinates and Y
  * coordinates, respectively.  Both values must be finite.
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   m - the matrix register to modify
  * 
  *   tx - the X translation
  * 
  *   ty - the Y translation
  */
-void skvm_matrix_translate(int32_t m, double tx, double ty);
+void skvm_matrix_translate(
+    SKVM_CTX    * pv,
+    int32_t       m,
+    double        tx,
+    double        ty);
 
 /*
  * Premultiply a matrix register by a scaling transform.
  * 
  * m is the index of the matrix register.  It must be at least zero and
- * less than the matc value passed to skvm_init().
+ * less than the matc value passed to skvm_alloc().
  * 
  * sx and sy are the scaling values for the X and Y coordinates,
  * respectively.  They may have any finite, non-zero value.
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   m - the matrix register to modify
  * 
  *   sx - the X axis scaling value
  * 
  *   sy - the Y axis scaling value
  */
-void skvm_matrix_scale(int32_t m, double sx, double sy);
+void skvm_matrix_scale(SKVM_CTX *pv, int32_t m, double sx, double sy);
 
 /*
  * Premultiply a matrix register by a rotation transform.
  * 
  * m is the index of the matrix register.  It must be at least zero and
- * less than the matc value passed to skvm_init().
+ * less than the matc value passed to skvm_alloc().
  * 
  * deg is the clockwise rotation angle in degrees.  It may be any finite
  * value.  Values outside the range (-360.0, 360.0) are automatically
@@ -570,11 +1439,64 @@ void skvm_matrix_scale(int32_t m, double sx, double sy);
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   m - the matrix register to modify
  * 
  *   deg - the clockwise rotation in degrees
  */
-void skvm_matrix_rotate(int32_t m, double deg);
+void skvm_matrix_rotate(SKVM_CTX *pv, int32_t m, double deg);
+
+/*
+ * Get the values of a matrix register.
+ * 
+ * m is the index of the matrix register.  It must be at least zero and
+ * less than the matc value passed to skvm_alloc().
+ * 
+ * pMat points to an array of six doubles that receives the matrix
+ * values a b c d e f in that order, where the matrix is:
+ * 
+ *   | a b c |
+ *   | d e f |
+ *   | 0 0 1 |
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   m - the matrix register
+ * 
+ *   pMat - the array that receives the matrix values
+ */
+void skvm_matrix_get(SKVM_CTX *pv, int32_t m, double *pMat);
+
+/*
+ * Set the values of a matrix register.
+ * 
+ * m is the index of the matrix register.  It must be at least zero and
+ * less than the matc value passed to skvm_alloc().
+ * 
+ * pMat points to an array of six doubles holding the matrix values in
+ * the same order as for skvm_matrix_get().
+ * 
+ * The operation fails if any of the matrix values or any of the values
+ * of its inverse are not finite, which includes the case where the
+ * matrix can not be inverted.  The register is left unchanged in that
+ * case.  Use skvm_reason() to get an error message.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   m - the matrix register
+ * 
+ *   pMat - the matrix values
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int skvm_matrix_set(SKVM_CTX *pv, int32_t m, const double *pMat);
 
 /*
  * Perform a sampling operation.
@@ -584,26 +1506,311 @@ void skvm_matrix_rotate(int32_t m, double deg);
  * SparkleSpec.md for further information about how the sampling
  * operation works.
  * 
+ * If a color transform is given, it is applied to each sampled pixel
+ * just before it is composited.  The source buffer is not changed, and
+ * no temporary copy of it is made.
+ * 
+ * Large rendering areas are split into tiles that are rendered on
+ * several threads (see skvm_threads), with idle threads stealing tiles
+ * from busy ones.  See skvm_balance() for how the work was divided.
+ * 
  * The given structure may be modified by this procedure.
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   ps - the sampling parameters
  */
-void skvm_sample(SKVM_SAMPLE_PARAM *ps);
+void skvm_sample(SKVM_CTX *pv, SKVM_SAMPLE_PARAM *ps);
+
+/*
+ * Draw a string of text.
+ * 
+ * The text is drawn with the font attached to the src_buf buffer by
+ * skvm_load_font() into the target_buf buffer, with the same masking
+ * and blending as skvm_sample().  The fields of the sampling parameters
+ * have the same meaning as for skvm_sample(), except that the flags
+ * may not include SKVM_FLAG_SUBAREA, SKVM_FLAG_COLORLUT, or
+ * SKVM_FLAG_COLORMATRIX, and the t_matrix transforms text space rather
+ * than the source buffer.
+ * 
+ * In text space, the pen starts out at the origin, which is on the
+ * baseline of the first line at the left edge of the text.  Each glyph
+ * moves the pen to the right by its advance.  A line feed moves the pen
+ * back to an X coordinate of zero and down by the line distance of the
+ * font.
+ * 
+ * size is the font size in pixels of text space.  It must be finite
+ * and greater than zero and at most SKVM_FONT_MAX_SIZE or a fault
+ * occurs.  The font is scaled by size divided by the size of the font
+ * table.
+ * 
+ * a, r, g, and b are the non-premultiplied color of the text, each in
+ * range [0, 255].  The alpha of the color is multiplied by the
+ * coverage of the glyphs.
+ * 
+ * pText is the nul-terminated text in UTF-8.
+ * 
+ * Each glyph is rasterized at the requested size the first time it is
+ * drawn, and kept in the glyph cache of the font, so drawing the same
+ * characters again at the same size only blits the cached coverage.
+ * Glyphs are placed at whole pixels of text space, so text drawn with
+ * a matrix that translates by whole pixels is blitted exactly, without
+ * any resampling, whatever the sampling algorithm.
+ * 
+ * The operation fails without drawing anything if the source buffer
+ * has no font, the text is not valid UTF-8, the font has no glyph for
+ * one of the characters, or a glyph would be too large for a buffer
+ * at the requested size.  skvm_reason() can then return an error
+ * message.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   ps - the sampling parameters
+ * 
+ *   size - the font size
+ * 
+ *   a - the alpha channel of the text color
+ * 
+ *   r - the red channel of the text color
+ * 
+ *   g - the green channel of the text color
+ * 
+ *   b - the blue channel of the text color
+ * 
+ *   pText - the text to draw
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int skvm_text(
+          SKVM_CTX          * pv,
+    const SKVM_SAMPLE_PARAM * ps,
+          double              size,
+          int                 a,
+          int                 r,
+          int                 g,
+          int                 b,
+    const char              * pText);
+
+/*
+ * Get how the work of the most recent skvm_sample() call on the
+ * calling thread was balanced across threads.
+ * 
+ * Large rendering areas are split into tiles.  The cost of each tile
+ * is estimated by probing how much of it is covered by the projected
+ * source area and left visible by the mask, and the tiles are then
+ * divided among the threads in contiguous runs of about equal cost.
+ * Threads that run out of tiles steal tiles from the end of the run of
+ * the thread with the most estimated work left.  This information is
+ * meant for benchmarks that measure how well the work is balanced.
+ * 
+ * If skvm_sample() has not been called on the calling thread, the
+ * structure is filled with zeros.
+ * 
+ * Parameters:
+ * 
+ *   pb - receives the balance information
+ */
+void skvm_balance(SKVM_BALANCE *pb);
+
+/*
+ * Apply a per-channel color lookup table to a specific buffer.
+ * 
+ * i is the index of the buffer object to modify.  It must be at least
+ * zero and less than the bufc value passed to skvm_alloc().
+ * 
+ * pLut points to 1024 bytes, holding four tables of 256 entries each
+ * for the alpha, red, green, and blue channels, in that order.  Each
+ * channel value is replaced by the entry at that index in the table of
+ * its channel.  RGB buffers ignore the alpha table, and grayscale
+ * buffers use only the green table.  The table is copied, so it does
+ * not need to remain valid after the function returns.
+ * 
+ * The lookup is not applied right away.  Instead, it is composed with
+ * any other lookups on the same buffer, and all of them are applied in
+ * a single pass the next time the pixel data of the buffer is needed.
+ * Large buffers are processed on several threads.
+ * 
+ * If the buffer is not currently loaded, a fault will occur.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer to modify
+ * 
+ *   pLut - the lookup table
+ */
+void skvm_color_lut(SKVM_CTX *pv, int32_t i, const uint8_t *pLut);
+
+/*
+ * Apply a 4x5 color matrix to a specific buffer.
+ * 
+ * i is the index of the buffer object to modify.  It must be at least
+ * zero and less than the bufc value passed to skvm_alloc().
+ * 
+ * pMat points to 20 values, which are four rows of five values each.
+ * The rows compute the output alpha, red, green, and blue channels, in
+ * that order.  Each row holds the coefficients of the input alpha,
+ * red, green, and blue channels, followed by an offset that is added.
+ * Channels are in range [0, 255], and the offset is in the same units.
+ * Results are rounded and clamped to [0, 255].
+ * 
+ * The matrix works on non-premultiplied channels, which is how ARGB
+ * buffers store them, so changes to alpha do not affect the color
+ * channels.  RGB buffers have an input alpha of 255 and ignore the
+ * alpha row.  Grayscale buffers use the gray value as the red, green,
+ * and blue input with an alpha of 255, and store the result of the
+ * green row.
+ * 
+ * Coefficients must be finite with a magnitude of at most
+ * SKVM_CMAT_MAX_COEF, and offsets must be finite with a magnitude of at
+ * most SKVM_CMAT_MAX_OFFSET, or a fault occurs.  The matrix is applied
+ * in fixed point, and large buffers are processed on several threads.
+ * 
+ * If the buffer is not currently loaded, a fault will occur.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer to modify
+ * 
+ *   pMat - the color matrix
+ */
+void skvm_color_matrix(SKVM_CTX *pv, int32_t i, const double *pMat);
+
+/*
+ * Blur a specific buffer.
+ * 
+ * i is the index of the buffer object to modify.  It must be at least
+ * zero and less than the bufc value passed to skvm_alloc().
+ * 
+ * sigma is the standard deviation in pixels of the Gaussian blur.  It
+ * must be finite and in range [0.0, SKVM_BLUR_MAX_SIGMA] or a fault
+ * occurs.  Very small values do nothing.
+ * 
+ * The Gaussian is approximated with three passes of box blurs in each
+ * direction, which takes the same time per pixel for any sigma.  ARGB
+ * buffers are blurred with premultiplied alpha, so transparent pixels
+ * do not darken their neighbors.  Pixels beyond the edges of the
+ * buffer are taken to be copies of the nearest edge pixel.  Large
+ * buffers are processed on several threads.
+ * 
+ * If the buffer is not currently loaded, a fault will occur.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer to blur
+ * 
+ *   sigma - the standard deviation of the blur
+ */
+void skvm_blur(SKVM_CTX *pv, int32_t i, double sigma);
 
 /*
  * Invert all the color channels (except alpha) in a specific buffer.
  * 
  * i is the index of the buffer object to store.  It must be at least
- * zero and less than the bufc value passed to skvm_init().
+ * zero and less than the bufc value passed to skvm_alloc().
+ * 
+ * This is a color lookup, see skvm_color_lut().
  * 
  * If the buffer is not currently loaded, a fault will occur.
  * 
  * Parameters:
  * 
+ *   pv - the context
+ * 
  *   i - the buffer to invert
  */
-void skvm_color_invert(int32_t i);
+void skvm_color_invert(SKVM_CTX *pv, int32_t i);
+
+/*
+ * Compress a grayscale buffer into a compressed mask.
+ * 
+ * i is the index of the buffer object to compress.  It must be at least
+ * zero and less than the bufc value passed to skvm_alloc().
+ * 
+ * Each scanline is stored as runs of fully masked and fully unmasked
+ * pixels, with literal runs holding the partial mask values between
+ * them.  The pixel data of the buffer is then released, so the buffer
+ * is no longer loaded.  It may still be used as a raster mask for
+ * skvm_sample(), which decodes only the runs it needs and skips
+ * everything in fully masked runs.  Reloading or resetting the buffer
+ * discards the compressed mask.
+ * 
+ * If the buffer is not currently loaded or is not grayscale, a fault
+ * will occur.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer to compress
+ */
+void skvm_mask_compress(SKVM_CTX *pv, int32_t i);
+
+/*
+ * Compute the statistics of a specific buffer.
+ * 
+ * i is the index of the buffer object to measure.  It must be at least
+ * zero and less than the bufc value passed to skvm_alloc().
+ * 
+ * The histogram, mean, minimum, and maximum of each channel are
+ * computed in a single pass, and large buffers are processed on
+ * several threads.  See the SKVM_STATS structure for details.
+ * 
+ * If the buffer is not currently loaded, a fault will occur.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   i - the buffer to measure
+ * 
+ *   ps - receives the statistics
+ */
+void skvm_stats(SKVM_CTX *pv, int32_t i, SKVM_STATS *ps);
+
+/*
+ * Compare two buffers.
+ * 
+ * a and b are the indices of the buffer objects to compare.  Each must
+ * be at least zero and less than the bufc value passed to skvm_alloc().
+ * They may be the same buffer object.
+ * 
+ * The mean squared error, PSNR, SSIM, and per-channel maximum error
+ * between the buffers are computed in a single pass, and large buffers
+ * are processed on several threads.  All channels are compared,
+ * including alpha.  Float buffers are compared as the ARGB values they
+ * would be stored as.
+ * The result does not depend on how many threads are used.  See the
+ * SKVM_COMPARE structure for details.
+ * 
+ * If either buffer is not currently loaded, or if the buffers do not
+ * have the same dimensions and channel count, a fault will occur.
+ * 
+ * Parameters:
+ * 
+ *   pv - the context
+ * 
+ *   a - the first buffer to compare
+ * 
+ *   b - the second buffer to compare
+ * 
+ *   pc - receives the comparison
+ */
+void skvm_compare(
+    SKVM_CTX      * pv,
+    int32_t         a,
+    int32_t         b,
+    SKVM_COMPARE  * pc);
 
 #endif
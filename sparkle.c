@@ -7,8 +7,72 @@
  * This module interprets the Shastina script and dispatches the calls
  * to the skvm module to do the actual rendering.
  * 
- * The Shastina script is read from standard input.  Error and log
- * messages written to standard error.  Standard output is unused.
+ * By default, a single Shastina script is read from standard input.
+ * Error and log messages written to standard error.  Standard output
+ * is unused.
+ * 
+ * Daemon mode:
+ * 
+ * Invoking the program as "sparkle -daemon" runs many scripts within a
+ * single process.  Scripts are read one after another from standard
+ * input, with each script terminated by a line consisting of exactly
+ * "%%" or by the end of input.  After each script, a line "OK" or
+ * "FAIL" is written to standard output.  Invoking the program as
+ * "sparkle -socket path" does the same for each client that connects
+ * to a Unix domain socket at the given path, writing results back to
+ * the client.
+ * 
+ * In both daemon modes, the skvm module keeps warm state between
+ * scripts, so that decoded source images, Motion-JPEG frame indices,
+ * and buffer memory are reused rather than reloaded for every frame.
+ * Each script gets a fresh interpreter with its own stack, operator
+ * module state, and virtual machine context, so every script behaves
+ * exactly as if it had been run in a fresh process.
+ * 
+ * Batch mode:
+ * 
+ * Invoking the program as "sparkle --batch list.txt -j N" runs all the
+ * script files named in the list file, using N worker threads that run
+ * scripts in parallel within one process.  The list file has one
+ * script path per line.  Blank lines and lines beginning with "#" are
+ * ignored.  The "-j N" option may be omitted, in which case there is
+ * one worker thread per online processor.  "-batch" is accepted as a
+ * synonym for "--batch".
+ * 
+ * Warm state is kept for the whole batch, so decoded source images are
+ * shared between all scripts.  Buffers loaded from the same image
+ * share one copy of the decoded pixel data until a script modifies its
+ * buffer.  When all scripts have run, a summary with the result and
+ * running time of each script is written to standard output.
+ * 
+ * Pack mode:
+ * 
+ * Invoking the program as "sparkle --pack dir out" packs all the PNG
+ * files in the directory into a single atlas sheet, written to
+ * out.png, along with the atlas table out.atlas that the load_atlas
+ * operator reads.  Each file becomes a sub-image named after the file
+ * without its ".png" extension, and sub-images are numbered in file
+ * name order.  The sheet and the table must stay in the same
+ * directory.
+ * 
+ * Threads:
+ * 
+ * Operations on large buffers split their work among threads taken
+ * from a single worker pool in the skvm module, which is shared by all
+ * scripts running in the process.  The "%threads" header of a script
+ * sets how many threads its operations may use.  Without it, the
+ * SPARKLE_THREADS environment variable sets the default, or else there
+ * is one thread per online processor.
+ * 
+ * The "%pipeline" header lets store operations finish writing their
+ * files on the worker pool while the script goes on.  Errors of such
+ * stores are reported by a later store or at the end of the script.
+ * 
+ * Setting the SPARKLE_REFERENCE environment variable to anything other
+ * than an empty string or "0" renders all sampling with the reference
+ * renderer of the skvm module instead of its fast paths.  This is much
+ * slower, but it gives the output that the fast paths are checked
+ * against (see conform/skconform.c).
  * 
  * Module registration:
  * 
@@ -27,12 +91,23 @@
  * defined by this module to register each of its operators.  Then, the
  * operators will be invoked when encountered during interpretation.
  * 
+ * Operator modules must not keep state between operator invocations in
+ * static variables, because several interpreters may be running at the
+ * same time.  Instead, the registration function should use the
+ * register_state() function defined by this module to declare a state
+ * block.  Each interpreter then allocates its own copy of the block,
+ * and operators retrieve it with interp_state().  Likewise, operators must
+ * use interp_vm() to get the virtual machine context of the interpreter
+ * they were invoked on.
+ * 
  * Compilation:
  * 
  *   - Module(s) defining operators
  *   - Recommended: 64-bit file mode with _FILE_OFFSET_BITS=64
  *   - May require the math library -lm on some platforms
  *   - Requires the skvm.c module
+ *   - Requires POSIX fmemopen(), opendir(), and Unix domain sockets
+ *   - Requires POSIX threads, which may require -lpthread
  *   - Requires librfdict beta 0.3.0 or compatible
  *   - Requires libshastina beta 0.9.3 or compatible
  *   - Requires libsophistry
@@ -46,9 +121,20 @@
 
 #include <errno.h>
 #include <math.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "skvm.h"
 
@@ -64,6 +150,7 @@
 
 #include "skcore.h"
 #include "sksample.h"
+#include "sktrack.h"
 
 /*
  * Constants
@@ -80,6 +167,11 @@
  */
 #define MAX_OPERATORS (1024)
 
+/*
+ * The maximum number of module state slots that may be registered.
+ */
+#define MAX_STATES (64)
+
 /*
  * The maximum length of literal strings within the scripts, not
  * including terminating nul.
@@ -94,6 +186,43 @@
 #define HEADSTATE_BUFC      (2) /* Just read %bufcount */
 #define HEADSTATE_MATC      (3) /* Just read %matcount */
 #define HEADSTATE_SET       (4) /* Just read arg, expecting END_META */
+#define HEADSTATE_THRD      (5) /* Just read %threads */
+#define HEADSTATE_PIPE      (6) /* Just read %pipeline */
+#define HEADSTATE_TRKC      (7) /* Just read %trackcount */
+
+/*
+ * Program mode constants, selected by the program arguments.
+ */
+#define MODE_SINGLE (0) /* Run one script from standard input */
+#define MODE_DAEMON (1) /* Run scripts from standard input */
+#define MODE_SOCKET (2) /* Run scripts from Unix socket clients */
+#define MODE_BATCH  (3) /* Run a list of script files in parallel */
+#define MODE_PACK   (4) /* Pack a directory of PNG files into an atlas */
+
+/*
+ * The line that separates scripts from each other in daemon mode.
+ */
+#define DAEMON_SEPARATOR "%%"
+
+/*
+ * The maximum number of worker threads in batch mode.
+ */
+#define MAX_JOBS (256)
+
+/*
+ * The number of buffer and matrix registers used in pack mode.
+ */
+#define PACK_BUFC (2)
+#define PACK_MATC (1)
+
+/*
+ * The number of transparent pixels left between images in pack mode.
+ * 
+ * Sampling covers one more pixel than the source area at the right and
+ * bottom edges, so images copied into the sheet would otherwise clip
+ * the edges of their neighbors.
+ */
+#define PACK_GUTTER (1)
 
 /*
  * Type declarations
@@ -130,6 +259,121 @@ struct CELL_TAG {
   
 };
 
+/*
+ * INTERP structure that stores the state of one script interpreter.
+ * 
+ * Prototype defined in the header file.
+ */
+struct INTERP_TAG {
+  
+  /*
+   * The virtual machine context, or NULL if the header has not been
+   * interpreted yet.
+   */
+  SKVM_CTX *pv;
+  
+  /*
+   * The number of transform tracks declared by the %trackcount header,
+   * in range [0, MAX_TRACKC].
+   */
+  int32_t trackc;
+  
+  /*
+   * The interpreter stack.
+   * 
+   * stack_count is how many items are currently pushed onto the stack,
+   * which is in range [0, STACK_HEIGHT].
+   * 
+   * stack stores the actual stack.  When the stack is not empty, the
+   * top element of the stack is (stack_count - 1).  Unused cells are
+   * set to the special "NULL" type.
+   * 
+   * Use the stack_ functions to manipulate.
+   */
+  int32_t stack_count;
+  CELL stack[STACK_HEIGHT];
+  
+  /*
+   * The module state blocks, one for each registered state slot.
+   */
+  void *pState[MAX_STATES];
+  
+};
+
+/*
+ * BATCH_JOB structure that stores one script of a batch.
+ */
+typedef struct {
+  
+  /*
+   * Dynamically allocated copy of the path to the script file.
+   */
+  char *pPath;
+  
+  /*
+   * Non-zero if the script ran successfully, zero if it failed.
+   */
+  int status;
+  
+  /*
+   * The time in seconds it took to run the script.
+   */
+  double secs;
+  
+} BATCH_JOB;
+
+/*
+ * BATCH structure that stores the shared state of the worker threads
+ * in batch mode.
+ */
+typedef struct {
+  
+  /*
+   * Lock protecting next.
+   */
+  pthread_mutex_t lock;
+  
+  /*
+   * The index of the next job that has not been taken by a worker.
+   */
+  int32_t next;
+  
+  /*
+   * The number of jobs.
+   */
+  int32_t count;
+  
+  /*
+   * The array of jobs.
+   */
+  BATCH_JOB *pJob;
+  
+} BATCH;
+
+/*
+ * PACK_ITEM structure that stores one sub-image in pack mode.
+ */
+typedef struct {
+  
+  /*
+   * Dynamically allocated copy of the file name of the PNG file, and
+   * the length of the name without the ".png" extension, which is the
+   * name of the sub-image.
+   */
+  char *pFile;
+  size_t name_len;
+  
+  /*
+   * The dimensions of the image, and the position of its top-left
+   * corner within the sheet.
+   */
+  int32_t w;
+  int32_t h;
+  int32_t x;
+  int32_t y;
+  
+} PACK_ITEM;
+
 /*
  * Static data
  * ===========
@@ -142,24 +386,6 @@ struct CELL_TAG {
  */
 static const char *pModule = NULL;
 
-/*
- * The interpreter stack.
- * 
- * m_stack_init tracks whether this has been initialized yet.
- * 
- * If initialized, m_stack_count is how many items are currently pushed
- * onto the stack, which is in range [0, STACK_HEIGHT].
- * 
- * m_stack stores the actual stack.  When the stack is not empty, the
- * top element of the stack is (m_stack_count - 1).  Unused cells are
- * set to the special "NULL" type.
- * 
- * Use the stack_ functions to manipulate.
- */
-static int m_stack_init = 0;
-static int32_t m_stack_count;
-static CELL m_stack[STACK_HEIGHT];
-
 /*
  * The operator dispatch table.
  * 
@@ -176,6 +402,23 @@ static int32_t m_op_count;
 static RFDICT *m_op_map;
 static fp_op m_op[MAX_OPERATORS];
 
+/*
+ * The module state registry.
+ * 
+ * m_state_count is the number of state slots that have been registered.
+ * For each slot, m_state_size is the size in bytes of the state block
+ * that each interpreter allocates, m_state_reset is the function that
+ * initializes a newly allocated state block, and m_state_release is
+ * the function that releases a state block before it is freed, or NULL.
+ * 
+ * Like the operator dispatch table, the registry is only modified
+ * during module registration, before any interpreters are allocated.
+ */
+static int32_t m_state_count = 0;
+static size_t m_state_size[MAX_STATES];
+static fp_reset m_state_reset[MAX_STATES];
+static fp_release m_state_release[MAX_STATES];
+
 /*
  * Local functions
  * ===============
@@ -191,9 +434,32 @@ static void cell_set_int(CELL *pc, int32_t v);
 static void cell_set_float(CELL *pc, double v);
 static void cell_set_string(CELL *pc, const char *pstr);
 
-static void stack_init(void);
+static INTERP *interp_alloc(void);
+static void interp_free(INTERP *pi);
+
+static double clock_secs(void);
+static int batch_read(
+    const char  *  pListPath,
+    BATCH_JOB   ** ppJob,
+    int32_t     *  pCount);
+static void batch_free(BATCH_JOB *pJob, int32_t count);
+static void *batch_worker(void *pArg);
+
+static int pack_cmp_name(const void *pA, const void *pB);
+static int pack_cmp_size(const void *pA, const void *pB);
+static int pack_read(
+    const char  *  pDir,
+    PACK_ITEM   ** ppItem,
+    int32_t     *  pCount);
+static void pack_free(PACK_ITEM *pItem, int32_t count);
+static int pack_place(
+    PACK_ITEM * pItem,
+    int32_t     count,
+    int32_t   * pw,
+    int32_t   * ph);
+
 static void op_init(void);
-static int op_invoke(const char *pOpName, long line_num);
+static int op_invoke(INTERP *pi, const char *pOpName, long line_num);
 
 /*
  * Parse the given string as a signed integer.
@@ -448,22 +714,81 @@ static void cell_set_string(CELL *pc, const char *pstr) {
 }
 
 /*
- * Initialize the interpreter stack if not already initialized.
+ * Allocate a new interpreter.
+ * 
+ * The interpreter starts out with an empty stack and no virtual machine
+ * context.  A state block is allocated for each registered module state
+ * slot and initialized with its reset function.
+ * 
+ * Return:
  * 
- * The other stack functions will call this automatically.
+ *   the new interpreter
  */
-static void stack_init(void) {
+static INTERP *interp_alloc(void) {
   
   int32_t i = 0;
+  INTERP *pi = NULL;
+  
+  /* Allocate the interpreter */
+  pi = (INTERP *) calloc(1, sizeof(INTERP));
+  if (pi == NULL) {
+    abort();
+  }
+  
+  /* Initialize the stack */
+  pi->pv = NULL;
+  pi->trackc = 0;
+  pi->stack_count = 0;
+  for(i = 0; i < STACK_HEIGHT; i++) {
+    cell_init(&((pi->stack)[i]));
+  }
+  
+  /* Allocate and reset module state blocks */
+  for(i = 0; i < MAX_STATES; i++) {
+    (pi->pState)[i] = NULL;
+  }
+  for(i = 0; i < m_state_count; i++) {
+    (pi->pState)[i] = calloc(1, m_state_size[i]);
+    if ((pi->pState)[i] == NULL) {
+      abort();
+    }
+    m_state_reset[i]((pi->pState)[i]);
+  }
+  
+  /* Return the new interpreter */
+  return pi;
+}
+
+/*
+ * Release an interpreter.
+ * 
+ * Anything left on the stack is released, and the virtual machine
+ * context is released if there is one.  If NULL is passed, the call is
+ * ignored.
+ * 
+ * Parameters:
+ * 
+ *   pi - the interpreter to release, or NULL
+ */
+static void interp_free(INTERP *pi) {
   
-  if (!m_stack_init) {
+  int32_t i = 0;
   
-    m_stack_count = 0;
-    memset(m_stack, 0, ((size_t) STACK_HEIGHT) * sizeof(CELL));
-    for(i = 0; i < STACK_HEIGHT; i++) {
-      cell_init(&(m_stack[i]));
+  if (pi != NULL) {
+    stack_pop(pi, pi->stack_count);
+    
+    skvm_free(pi->pv);
+    pi->pv = NULL;
+    
+    for(i = 0; i < m_state_count; i++) {
+      if (m_state_release[i] != NULL) {
+        m_state_release[i]((pi->pState)[i]);
+      }
+      free((pi->pState)[i]);
+      (pi->pState)[i] = NULL;
     }
-    m_stack_init = 1;
+    
+    free(pi);
   }
 }
 
@@ -492,7 +817,8 @@ static void op_init(void) {
 /*
  * Use the operator registration table to invoke a named operator.
  * 
- * pOpName is the name of the operator to invoke.  line_num is the line
+ * pi is the interpreter the operator is invoked on.  pOpName is the
+ * name of the operator to invoke.  line_num is the line
  * number in the script, used for diagnostic messages, which is also
  * passed through to the operator implementation.
  * 
@@ -505,6 +831,8 @@ static void op_init(void) {
  * 
  * Parameters:
  * 
+ *   pi - the interpreter
+ * 
  *   pOpName - the operator name
  * 
  *   line_num - the line number in the script
@@ -514,7 +842,7 @@ static void op_init(void) {
  *   non-zero if successful, zero if operator invocation failed or
  *   operator failed
  */
-static int op_invoke(const char *pOpName, long line_num) {
+static int op_invoke(INTERP *pi, const char *pOpName, long line_num) {
   
   int status = 1;
   long oi = 0;
@@ -523,7 +851,7 @@ static int op_invoke(const char *pOpName, long line_num) {
   op_init();
   
   /* Check parameters */
-  if (pOpName == NULL) {
+  if ((pi == NULL) || (pOpName == NULL)) {
     abort();
   }
   
@@ -537,7 +865,7 @@ static int op_invoke(const char *pOpName, long line_num) {
   
   /* Dispatch to operator function */
   if (status) {
-    if (!(m_op[oi](pModule, line_num))) {
+    if (!(m_op[oi](pi, pModule, line_num))) {
       status = 0;
       fprintf(stderr, "%s: [Line %ld] Operator %s failed!\n",
         pModule, line_num, pOpName);
@@ -607,6 +935,88 @@ void register_operator(const char *pOpName, fp_op pFunc) {
   m_op_count++;
 }
 
+/*
+ * register_state function.
+ */
+int32_t register_state(
+    size_t      state_size,
+    fp_reset    pReset,
+    fp_release  pRelease) {
+  
+  int32_t slot = 0;
+  
+  /* Check parameters */
+  if ((state_size < 1) || (pReset == NULL)) {
+    abort();
+  }
+  
+  /* Check if we have space remaining */
+  if (m_state_count >= MAX_STATES) {
+    fprintf(stderr,
+      "%s: [Initialization] Too many state registrations!\n",
+      pModule);
+    abort();
+  }
+  
+  /* Add the state slot */
+  slot = m_state_count;
+  m_state_size[slot] = state_size;
+  m_state_reset[slot] = pReset;
+  m_state_release[slot] = pRelease;
+  m_state_count++;
+  
+  /* Return the slot index */
+  return slot;
+}
+
+/*
+ * interp_state function.
+ */
+void *interp_state(INTERP *pi, int32_t slot) {
+  
+  /* Check parameters */
+  if (pi == NULL) {
+    abort();
+  }
+  if ((slot < 0) || (slot >= m_state_count)) {
+    abort();
+  }
+  
+  /* Return the state block */
+  return (pi->pState)[slot];
+}
+
+/*
+ * interp_vm function.
+ */
+SKVM_CTX *interp_vm(INTERP *pi) {
+  
+  /* Check parameter */
+  if (pi == NULL) {
+    abort();
+  }
+  if (pi->pv == NULL) {
+    abort();
+  }
+  
+  /* Return the context */
+  return pi->pv;
+}
+
+/*
+ * interp_trackc function.
+ */
+int32_t interp_trackc(INTERP *pi) {
+  
+  /* Check parameter */
+  if (pi == NULL) {
+    abort();
+  }
+  
+  /* Return the track count */
+  return pi->trackc;
+}
+
 /*
  * cell_type function.
  */
@@ -708,22 +1118,24 @@ const char *cell_string_ptr(const CELL *pc) {
 /*
  * stack_push_int function.
  */
-int stack_push_int(int32_t v) {
+int stack_push_int(INTERP *pi, int32_t v) {
   
   int status = 1;
   
-  /* Initialize stack if necessary */
-  stack_init();
+  /* Check interpreter */
+  if (pi == NULL) {
+    abort();
+  }
   
   /* Fail if stack is full */
-  if (m_stack_count >= STACK_HEIGHT) {
-    status = 1;
+  if (pi->stack_count >= STACK_HEIGHT) {
+    status = 0;
   }
   
   /* Push the integer value */
   if (status) {
-    cell_set_int(&(m_stack[m_stack_count]), v);
-    m_stack_count++;
+    cell_set_int(&((pi->stack)[pi->stack_count]), v);
+    pi->stack_count++;
   }
   
   /* Return status */
@@ -733,22 +1145,24 @@ int stack_push_int(int32_t v) {
 /*
  * stack_push_float function.
  */
-int stack_push_float(double v) {
+int stack_push_float(INTERP *pi, double v) {
   
   int status = 1;
   
-  /* Initialize stack if necessary */
-  stack_init();
+  /* Check interpreter */
+  if (pi == NULL) {
+    abort();
+  }
   
   /* Fail if stack is full */
-  if (m_stack_count >= STACK_HEIGHT) {
-    status = 1;
+  if (pi->stack_count >= STACK_HEIGHT) {
+    status = 0;
   }
   
   /* Push the float value */
   if (status) {
-    cell_set_float(&(m_stack[m_stack_count]), v);
-    m_stack_count++;
+    cell_set_float(&((pi->stack)[pi->stack_count]), v);
+    pi->stack_count++;
   }
   
   /* Return status */
@@ -758,22 +1172,24 @@ int stack_push_float(double v) {
 /*
  * stack_push_string function.
  */
-int stack_push_string(const char *pstr) {
+int stack_push_string(INTERP *pi, const char *pstr) {
   
   int status = 1;
   
-  /* Initialize stack if necessary */
-  stack_init();
+  /* Check interpreter */
+  if (pi == NULL) {
+    abort();
+  }
   
   /* Fail if stack is full */
-  if (m_stack_count >= STACK_HEIGHT) {
-    status = 1;
+  if (pi->stack_count >= STACK_HEIGHT) {
+    status = 0;
   }
   
   /* Push the string value */
   if (status) {
-    cell_set_string(&(m_stack[m_stack_count]), pstr);
-    m_stack_count++;
+    cell_set_string(&((pi->stack)[pi->stack_count]), pstr);
+    pi->stack_count++;
   }
   
   /* Return status */
@@ -783,44 +1199,50 @@ int stack_push_string(const char *pstr) {
 /*
  * stack_count function.
  */
-int32_t stack_count(void) {
+int32_t stack_count(INTERP *pi) {
   
-  /* Initialize stack if necessary */
-  stack_init();
+  /* Check interpreter */
+  if (pi == NULL) {
+    abort();
+  }
   
   /* Return result */
-  return m_stack_count;
+  return pi->stack_count;
 }
 
 /*
  * stack_index function.
  */
-const CELL *stack_index(int32_t i) {
+const CELL *stack_index(INTERP *pi, int32_t i) {
   
-  /* Initialize stack if necessary */
-  stack_init();
+  /* Check interpreter */
+  if (pi == NULL) {
+    abort();
+  }
   
   /* Check parameter */
-  if ((i < 0) || (i >= m_stack_count)) {
+  if ((i < 0) || (i >= pi->stack_count)) {
     abort();
   }
   
   /* Return the requested element */
-  return &(m_stack[m_stack_count - 1 - i]);
+  return &((pi->stack)[pi->stack_count - 1 - i]);
 }
 
 /*
  * stack_pop function.
  */
-void stack_pop(int32_t count) {
+void stack_pop(INTERP *pi, int32_t count) {
   
   int i = 0;
   
-  /* Initialize stack if necessary */
-  stack_init();
+  /* Check interpreter */
+  if (pi == NULL) {
+    abort();
+  }
   
   /* Check parameter */
-  if ((count < 0) || (count > m_stack_count)) {
+  if ((count < 0) || (count > pi->stack_count)) {
     abort();
   }
   
@@ -829,11 +1251,11 @@ void stack_pop(int32_t count) {
   
     /* Clear elements from the top of the stack */
     for(i = 0; i < count; i++) {
-      cell_clear(&(m_stack[m_stack_count - 1 - i]));
+      cell_clear(&((pi->stack)[pi->stack_count - 1 - i]));
     }
   
     /* Reduce the stack height */
-    m_stack_count -= count;
+    pi->stack_count -= count;
   }
 }
 
@@ -846,14 +1268,34 @@ static void register_modules(void) {
   /* Call the operator module registration functions here */
   skcore_register();
   sksample_register();
+  sktrack_register();
 }
 
 /*
- * Program entrypoint
- * ==================
+ * Script interpretation
+ * =====================
  */
 
-int main(int argc, char *argv[]) {
+/*
+ * Interpret a single Sparkle script.
+ * 
+ * The operator modules must already be registered.  Each call uses its
+ * own interpreter, with its own stack, module state, and virtual
+ * machine context, so this function may be called repeatedly to run
+ * several scripts within one process, and it may also be called
+ * concurrently from different threads.
+ * 
+ * Error messages are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pin - the Shastina source to read the script from
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the script failed
+ */
+static int run_script(SNSOURCE *pin) {
   
   int status = 1;
   
@@ -862,8 +1304,11 @@ int main(int argc, char *argv[]) {
   int32_t config_value = 0;
   int32_t bufc_value = -1;
   int32_t matc_value = -1;
+  int32_t trkc_value = -1;
+  int32_t thrd_value = -1;
+  int32_t pipe_value = -1;
   
-  SNSOURCE *pin = NULL;
+  INTERP *pi = NULL;
   SNPARSER *ps = NULL;
   
   SNENTITY ent;
@@ -881,26 +1326,14 @@ int main(int argc, char *argv[]) {
   memset(&ent, 0, sizeof(SNENTITY));
   memset(sbuf, 0, MAX_STRING_LEN + 1);
   
-  /* Set module name */
-  pModule = NULL;
-  if ((argc > 0) && (argv != NULL)) {
-    pModule = argv[0];
-  }
-  if (pModule == NULL) {
-    pModule = "sparkle";
-  }
-  
-  /* No arguments expected */
-  if (argc > 1) {
-    status = 0;
-    fprintf(stderr, "%s: Not expecting arguments!\n", pModule);
+  /* Check parameters */
+  if (pin == NULL) {
+    abort();
   }
   
-  /* Wrap standard input in a Shastina source and allocate a parser */
-  if (status) {
-    pin = snsource_stream(stdin, SNSTREAM_NORMAL);
-    ps = snparser_alloc();
-  }
+  /* Allocate an interpreter and a parser */
+  pi = interp_alloc();
+  ps = snparser_alloc();
   
   /* ------------------------- */
   /*                           */
@@ -977,6 +1410,36 @@ int main(int argc, char *argv[]) {
                 pModule);
             }
             
+          } else if (strcmp(ent.pKey, "trackcount") == 0) {
+            if (read_signature) {
+              head_state = HEADSTATE_TRKC;
+            } else {
+              status = 0;
+              fprintf(stderr,
+                "%s: Failed to read %%sparkle; signature!\n",
+                pModule);
+            }
+            
+          } else if (strcmp(ent.pKey, "threads") == 0) {
+            if (read_signature) {
+              head_state = HEADSTATE_THRD;
+            } else {
+              status = 0;
+              fprintf(stderr,
+                "%s: Failed to read %%sparkle; signature!\n",
+                pModule);
+            }
+            
+          } else if (strcmp(ent.pKey, "pipeline") == 0) {
+            if (read_signature) {
+              head_state = HEADSTATE_PIPE;
+            } else {
+              status = 0;
+              fprintf(stderr,
+                "%s: Failed to read %%sparkle; signature!\n",
+                pModule);
+            }
+            
           } else {
             /* Unrecognized token */
             status = 0;
@@ -989,7 +1452,10 @@ int main(int argc, char *argv[]) {
         }
         
       } else if ((head_state == HEADSTATE_BUFC) ||
-                  (head_state == HEADSTATE_MATC)) {
+                  (head_state == HEADSTATE_MATC) ||
+                  (head_state == HEADSTATE_TRKC) ||
+                  (head_state == HEADSTATE_THRD) ||
+                  (head_state == HEADSTATE_PIPE)) {
         /* We are now ready to read the token value */
         if (ent.status != SNENTITY_META_TOKEN) {
           status = 0;
@@ -1040,6 +1506,33 @@ int main(int argc, char *argv[]) {
                 (long) SKVM_MAX_MATC);
             }
             
+          } else if (head_state == HEADSTATE_TRKC) {
+            if (config_value > MAX_TRACKC) {
+              status = 0;
+              fprintf(stderr,
+                "%s: Maximum value for %%trackcount is %ld!\n",
+                pModule,
+                (long) MAX_TRACKC);
+            }
+            
+          } else if (head_state == HEADSTATE_THRD) {
+            if (config_value > SKVM_MAX_THREADS) {
+              status = 0;
+              fprintf(stderr,
+                "%s: Maximum value for %%threads is %ld!\n",
+                pModule,
+                (long) SKVM_MAX_THREADS);
+            }
+            
+          } else if (head_state == HEADSTATE_PIPE) {
+            if (config_value > SKVM_MAX_PIPELINE) {
+              status = 0;
+              fprintf(stderr,
+                "%s: Maximum value for %%pipeline is %ld!\n",
+                pModule,
+                (long) SKVM_MAX_PIPELINE);
+            }
+            
           } else {
             /* Shouldn't happen */
             abort();
@@ -1071,6 +1564,39 @@ int main(int argc, char *argv[]) {
                 snparser_count(ps));
             }
             
+          } else if (head_state == HEADSTATE_TRKC) {
+            if (trkc_value < 0) {
+              trkc_value = config_value;
+            } else {
+              status = 0;
+              fprintf(stderr,
+                "%s: [Line %ld] %%trackcount already set!\n",
+                pModule,
+                snparser_count(ps));
+            }
+            
+          } else if (head_state == HEADSTATE_THRD) {
+            if (thrd_value < 0) {
+              thrd_value = config_value;
+            } else {
+              status = 0;
+              fprintf(stderr,
+                "%s: [Line %ld] %%threads already set!\n",
+                pModule,
+                snparser_count(ps));
+            }
+            
+          } else if (head_state == HEADSTATE_PIPE) {
+            if (pipe_value < 0) {
+              pipe_value = config_value;
+            } else {
+              status = 0;
+              fprintf(stderr,
+                "%s: [Line %ld] %%pipeline already set!\n",
+                pModule,
+                snparser_count(ps));
+            }
+            
           } else {
             /* Shouldn't happen */
             abort();
@@ -1141,17 +1667,34 @@ int main(int argc, char *argv[]) {
       if (matc_value < 0) {
         matc_value = 0;
       }
+      if (trkc_value < 0) {
+        trkc_value = 0;
+      }
+      if (thrd_value < 0) {
+        thrd_value = 0;
+      }
+      if (pipe_value < 0) {
+        pipe_value = 0;
+      }
     }
   }
   
-  /* Initialize the skvm module */
+  /* Set the number of threads that operations of this script may use,
+   * where zero selects the default */
   if (status) {
-    skvm_init(bufc_value, matc_value);
+    skvm_threads(thrd_value);
   }
   
-  /* Register operator modules */
+  /* Allocate the virtual machine context */
   if (status) {
-    register_modules();
+    pi->pv = skvm_alloc(bufc_value, matc_value);
+    pi->trackc = trkc_value;
+  }
+  
+  /* Set how many stores may be pending, where zero writes each file
+   * before the store operation returns */
+  if (status) {
+    skvm_pipeline(pi->pv, pipe_value);
   }
   
   /* -------------- */
@@ -1231,7 +1774,7 @@ int main(int argc, char *argv[]) {
         
         /* Push a copy of the string onto the stack */
         if (status) {
-          if (!stack_push_string(sbuf)) {
+          if (!stack_push_string(pi, sbuf)) {
             status = 0;
             fprintf(stderr, "%s: [Line %ld] Stack overflow!\n",
               pModule, snparser_count(ps));
@@ -1276,7 +1819,7 @@ int main(int argc, char *argv[]) {
           
           /* Push the float onto the stack */
           if (status) {
-            if (!stack_push_float(dv)) {
+            if (!stack_push_float(pi, dv)) {
               status = 0;
               fprintf(stderr, "%s: [Line %ld] Stack overflow!\n",
                 pModule, snparser_count(ps));
@@ -1294,7 +1837,7 @@ int main(int argc, char *argv[]) {
           
           /* Push the integer onto the stack */
           if (status) {
-            if (!stack_push_int(iv)) {
+            if (!stack_push_int(pi, iv)) {
               status = 0;
               fprintf(stderr, "%s: [Line %ld] Stack overflow!\n",
                 pModule, snparser_count(ps));
@@ -1304,7 +1847,7 @@ int main(int argc, char *argv[]) {
         
       } else if (ent.status == SNENTITY_OPERATION) {
         /* Operation, so dispatch operation */
-        if (!op_invoke(ent.pKey, snparser_count(ps))) {
+        if (!op_invoke(pi, ent.pKey, snparser_count(ps))) {
           status = 0;
         }
         
@@ -1345,20 +1888,1402 @@ int main(int argc, char *argv[]) {
   
   /* Check that interpreter stack is empty */
   if (status) {
-    if (!(stack_count() < 1)) {
+    if (!(stack_count(pi) < 1)) {
       status = 0;
       fprintf(stderr, "%s: Interpreter stack not empty at EOF!\n",
         pModule);
     }
   }
   
+  /* Wait for any pipelined stores and check that they succeeded */
+  if (status) {
+    if (!skvm_sync(pi->pv)) {
+      status = 0;
+      fprintf(stderr, "%s: Pipelined store failed: %s!\n",
+        pModule, skvm_reason(pi->pv));
+    }
+  }
+  
   /* Free Shastina parser if allocated */
   snparser_free(ps);
   ps = NULL;
   
-  /* Free Shastina input source if allocated */
-  snsource_free(pin);
-  pin = NULL;
+  /* Free the interpreter along with its virtual machine context */
+  interp_free(pi);
+  pi = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Run a stream of Sparkle scripts in daemon mode.
+ * 
+ * Scripts are read one after another from pIn.  Each script is
+ * terminated either by a line consisting of exactly DAEMON_SEPARATOR or
+ * by the end of the stream.  After each script is run, a line with
+ * either "OK" or "FAIL" is written to pOut and pOut is flushed.  An
+ * empty script at the end of the stream is ignored.
+ * 
+ * Error messages from the scripts are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pIn - the stream to read scripts from
+ * 
+ *   pOut - the stream to write results to
+ * 
+ * Return:
+ * 
+ *   the number of scripts that failed
+ */
+static int32_t run_stream(FILE *pIn, FILE *pOut) {
+  
+  int done = 0;
+  int result = 0;
+  int32_t fail_count = 0;
+  int c = 0;
+  
+  char *pScript = NULL;
+  size_t script_cap = 0;
+  size_t script_len = 0;
+  size_t line_start = 0;
+  
+  FILE *pf = NULL;
+  SNSOURCE *pin = NULL;
+  
+  /* Check parameters */
+  if ((pIn == NULL) || (pOut == NULL)) {
+    abort();
+  }
+  
+  /* Allocate an initial script buffer */
+  script_cap = 4096;
+  pScript = (char *) malloc(script_cap);
+  if (pScript == NULL) {
+    abort();
+  }
+  
+  /* Process scripts until end of input */
+  while (!done) {
+    
+    /* Read a script into the buffer, stopping at a separator line or
+     * the end of input */
+    script_len = 0;
+    line_start = 0;
+    for(c = getc(pIn); c != EOF; c = getc(pIn)) {
+      
+      /* Expand the buffer if necessary */
+      if (script_len >= script_cap) {
+        script_cap *= 2;
+        pScript = (char *) realloc(pScript, script_cap);
+        if (pScript == NULL) {
+          abort();
+        }
+      }
+      
+      /* Add the character */
+      pScript[script_len] = (char) c;
+      script_len++;
+      
+      /* If this completes a line, check whether the line was a
+       * separator, dropping it from the script if so */
+      if (c == '\n') {
+        if ((script_len - line_start ==
+              strlen(DAEMON_SEPARATOR) + 1) &&
+            (memcmp(&(pScript[line_start]), DAEMON_SEPARATOR,
+                strlen(DAEMON_SEPARATOR)) == 0)) {
+          script_len = line_start;
+          break;
+        }
+        line_start = script_len;
+      }
+    }
+    
+    /* At the end of input, a final separator line need not have a line
+     * break, and an empty final script is ignored */
+    if (c == EOF) {
+      done = 1;
+      if ((script_len - line_start == strlen(DAEMON_SEPARATOR)) &&
+          (memcmp(&(pScript[line_start]), DAEMON_SEPARATOR,
+              strlen(DAEMON_SEPARATOR)) == 0)) {
+        script_len = line_start;
+      } else if (script_len < 1) {
+        break;
+      }
+    }
+    
+    /* Run the script from a memory stream */
+    result = 0;
+    if (script_len > 0) {
+      pf = fmemopen(pScript, script_len, "rb");
+      if (pf != NULL) {
+        pin = snsource_stream(pf, SNSTREAM_OWNER);
+        result = run_script(pin);
+        snsource_free(pin);
+        pin = NULL;
+        pf = NULL;
+        
+      } else {
+        fprintf(stderr, "%s: Failed to open script stream!\n",
+          pModule);
+      }
+      
+    } else {
+      fprintf(stderr, "%s: Empty script!\n", pModule);
+    }
+    
+    /* Report the result */
+    if (result) {
+      fprintf(pOut, "OK\n");
+    } else {
+      fprintf(pOut, "FAIL\n");
+      fail_count++;
+    }
+    fflush(pOut);
+    fflush(stderr);
+  }
+  
+  /* Release the script buffer */
+  free(pScript);
+  pScript = NULL;
+  
+  /* Return the failure count */
+  return fail_count;
+}
+
+/*
+ * Run Sparkle as a daemon listening on a Unix domain socket.
+ * 
+ * Each accepted connection is handled in turn with run_stream(), using
+ * the connection both for reading scripts and for writing results.  If
+ * a socket already exists at the given path, it is replaced.  This
+ * function only returns if the socket could not be set up or accepting
+ * a connection failed.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path of the socket
+ * 
+ * Return:
+ * 
+ *   non-zero if the daemon shut down cleanly, zero if error
+ */
+static int run_socket(const char *pPath) {
+  
+  int status = 1;
+  int sfd = -1;
+  int cfd = -1;
+  int dfd = -1;
+  
+  FILE *pIn = NULL;
+  FILE *pOut = NULL;
+  
+  struct sockaddr_un addr;
+  struct stat st;
+  
+  /* Initialize structures */
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  memset(&st, 0, sizeof(struct stat));
+  
+  /* Check parameters */
+  if (pPath == NULL) {
+    abort();
+  }
+  
+  /* Check that path fits in a socket address */
+  if (strlen(pPath) >= sizeof(addr.sun_path)) {
+    status = 0;
+    fprintf(stderr, "%s: Socket path is too long!\n", pModule);
+  }
+  
+  /* If something already exists at the path, remove it only if it is
+   * a stale socket */
+  if (status) {
+    if (lstat(pPath, &st) == 0) {
+      if (S_ISSOCK(st.st_mode)) {
+        if (unlink(pPath)) {
+          status = 0;
+          fprintf(stderr, "%s: Failed to remove old socket!\n",
+            pModule);
+        }
+      } else {
+        status = 0;
+        fprintf(stderr, "%s: Socket path exists and is not a socket!\n",
+          pModule);
+      }
+    }
+  }
+  
+  /* Create, bind, and listen on the socket */
+  if (status) {
+    sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sfd < 0) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to create socket!\n", pModule);
+    }
+  }
+  if (status) {
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, pPath);
+    if (bind(sfd, (struct sockaddr *) &addr,
+          sizeof(struct sockaddr_un))) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to bind socket!\n", pModule);
+    }
+  }
+  if (status) {
+    if (listen(sfd, 8)) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to listen on socket!\n", pModule);
+    }
+  }
+  
+  /* Clients that disconnect early should not terminate the daemon */
+  if (status) {
+    signal(SIGPIPE, SIG_IGN);
+  }
+  
+  /* Handle connections one at a time */
+  while (status) {
+    
+    /* Accept a connection, retrying if interrupted */
+    cfd = accept(sfd, NULL, NULL);
+    if (cfd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      status = 0;
+      fprintf(stderr, "%s: Failed to accept connection!\n", pModule);
+      break;
+    }
+    
+    /* Wrap the connection in separate input and output streams */
+    dfd = dup(cfd);
+    if (dfd >= 0) {
+      pIn = fdopen(cfd, "rb");
+      pOut = fdopen(dfd, "wb");
+    }
+    
+    /* Run the scripts on the connection */
+    if ((pIn != NULL) && (pOut != NULL)) {
+      run_stream(pIn, pOut);
+    } else {
+      fprintf(stderr, "%s: Failed to open connection streams!\n",
+        pModule);
+    }
+    
+    /* Close the connection */
+    if (pIn != NULL) {
+      fclose(pIn);
+      pIn = NULL;
+    } else {
+      close(cfd);
+    }
+    if (pOut != NULL) {
+      fclose(pOut);
+      pOut = NULL;
+    } else if (dfd >= 0) {
+      close(dfd);
+    }
+    cfd = -1;
+    dfd = -1;
+  }
+  
+  /* Close the listening socket */
+  if (sfd >= 0) {
+    close(sfd);
+    sfd = -1;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Get the current time of the monotonic clock in seconds.
+ * 
+ * Return:
+ * 
+ *   the current monotonic time
+ */
+static double clock_secs(void) {
+  
+  struct timespec ts;
+  
+  /* Initialize structures */
+  memset(&ts, 0, sizeof(struct timespec));
+  
+  /* Read the clock */
+  if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+    abort();
+  }
+  
+  /* Return the time in seconds */
+  return ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0);
+}
+
+/*
+ * Read a batch list file.
+ * 
+ * The list has one script path per line.  Blank lines and lines that
+ * begin with "#" are ignored, and trailing whitespace is removed from
+ * each path.
+ * 
+ * If successful, *ppJob is set to a dynamically allocated array of
+ * jobs, each with a dynamically allocated path, and *pCount is set to
+ * the number of jobs.  Use batch_free() to release the array.
+ * 
+ * Error messages are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pListPath - the path to the list file
+ * 
+ *   ppJob - pointer to receive the job array
+ * 
+ *   pCount - pointer to receive the number of jobs
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the list could not be read
+ */
+static int batch_read(
+    const char  *  pListPath,
+    BATCH_JOB   ** ppJob,
+    int32_t     *  pCount) {
+  
+  int status = 1;
+  int c = 0;
+  
+  FILE *pf = NULL;
+  
+  char *pLine = NULL;
+  size_t line_cap = 0;
+  size_t line_len = 0;
+  
+  BATCH_JOB *pJob = NULL;
+  int32_t job_cap = 0;
+  int32_t job_count = 0;
+  
+  /* Check parameters */
+  if ((pListPath == NULL) || (ppJob == NULL) || (pCount == NULL)) {
+    abort();
+  }
+  
+  /* Open the list file */
+  pf = fopen(pListPath, "rb");
+  if (pf == NULL) {
+    status = 0;
+    fprintf(stderr, "%s: Failed to open batch list!\n", pModule);
+  }
+  
+  /* Allocate initial line and job buffers */
+  if (status) {
+    line_cap = 256;
+    pLine = (char *) malloc(line_cap);
+    if (pLine == NULL) {
+      abort();
+    }
+    
+    job_cap = 64;
+    pJob = (BATCH_JOB *) calloc((size_t) job_cap, sizeof(BATCH_JOB));
+    if (pJob == NULL) {
+      abort();
+    }
+  }
+  
+  /* Read each line */
+  while (status) {
+    
+    /* Read the line into the buffer without its line break */
+    line_len = 0;
+    for(c = getc(pf); (c != EOF) && (c != '\n'); c = getc(pf)) {
+      if (line_len >= line_cap - 1) {
+        line_cap *= 2;
+        pLine = (char *) realloc(pLine, line_cap);
+        if (pLine == NULL) {
+          abort();
+        }
+      }
+      pLine[line_len] = (char) c;
+      line_len++;
+    }
+    if (ferror(pf)) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to read batch list!\n", pModule);
+      break;
+    }
+    
+    /* Drop trailing whitespace and terminate the line */
+    while (line_len > 0) {
+      if ((pLine[line_len - 1] != ' ') &&
+          (pLine[line_len - 1] != '\t') &&
+          (pLine[line_len - 1] != '\r')) {
+        break;
+      }
+      line_len--;
+    }
+    pLine[line_len] = (char) 0;
+    
+    /* Add a job unless the line is blank or a comment */
+    if ((line_len > 0) && (pLine[0] != '#')) {
+      if (job_count >= job_cap) {
+        if (job_cap > INT32_MAX / 2) {
+          status = 0;
+          fprintf(stderr, "%s: Too many scripts in batch list!\n",
+            pModule);
+          break;
+        }
+        job_cap *= 2;
+        pJob = (BATCH_JOB *) realloc(pJob,
+                  ((size_t) job_cap) * sizeof(BATCH_JOB));
+        if (pJob == NULL) {
+          abort();
+        }
+      }
+      
+      memset(&(pJob[job_count]), 0, sizeof(BATCH_JOB));
+      pJob[job_count].pPath = (char *) malloc(line_len + 1);
+      if (pJob[job_count].pPath == NULL) {
+        abort();
+      }
+      strcpy(pJob[job_count].pPath, pLine);
+      job_count++;
+    }
+    
+    /* Stop at end of file */
+    if (c == EOF) {
+      break;
+    }
+  }
+  
+  /* Close the list file if open */
+  if (pf != NULL) {
+    fclose(pf);
+    pf = NULL;
+  }
+  
+  /* Release the line buffer if allocated */
+  if (pLine != NULL) {
+    free(pLine);
+    pLine = NULL;
+  }
+  
+  /* Return the jobs if successful, else release them */
+  if (status) {
+    *ppJob = pJob;
+    *pCount = job_count;
+  } else {
+    batch_free(pJob, job_count);
+    pJob = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Release a job array allocated by batch_read().
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pJob - the job array, or NULL
+ * 
+ *   count - the number of jobs in the array
+ */
+static void batch_free(BATCH_JOB *pJob, int32_t count) {
+  
+  int32_t i = 0;
+  
+  if (pJob != NULL) {
+    for(i = 0; i < count; i++) {
+      free(pJob[i].pPath);
+      pJob[i].pPath = NULL;
+    }
+    free(pJob);
+  }
+}
+
+/*
+ * Worker thread function for batch mode.
+ * 
+ * The worker repeatedly takes the next job that has not been taken yet
+ * and runs it, until there are no jobs left.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the BATCH structure shared by the workers
+ * 
+ * Return:
+ * 
+ *   always NULL
+ */
+static void *batch_worker(void *pArg) {
+  
+  int32_t j = 0;
+  double t = 0.0;
+  
+  BATCH *pb = NULL;
+  BATCH_JOB *pj = NULL;
+  FILE *pf = NULL;
+  SNSOURCE *pin = NULL;
+  
+  /* Check parameters */
+  if (pArg == NULL) {
+    abort();
+  }
+  pb = (BATCH *) pArg;
+  
+  /* Run jobs until none are left */
+  while (1) {
+    
+    /* Take the next job */
+    if (pthread_mutex_lock(&(pb->lock))) {
+      abort();
+    }
+    j = pb->next;
+    if (j < pb->count) {
+      (pb->next)++;
+    }
+    if (pthread_mutex_unlock(&(pb->lock))) {
+      abort();
+    }
+    
+    if (j >= pb->count) {
+      break;
+    }
+    pj = &((pb->pJob)[j]);
+    
+    /* Run the script and time it */
+    t = clock_secs();
+    
+    pj->status = 0;
+    pf = fopen(pj->pPath, "rb");
+    if (pf != NULL) {
+      pin = snsource_stream(pf, SNSTREAM_OWNER);
+      pj->status = run_script(pin);
+      snsource_free(pin);
+      pin = NULL;
+      pf = NULL;
+      
+    } else {
+      fprintf(stderr, "%s: Failed to open script %s!\n",
+        pModule, pj->pPath);
+    }
+    
+    pj->secs = clock_secs() - t;
+  }
+  
+  return NULL;
+}
+
+/*
+ * Run a batch of script files in parallel.
+ * 
+ * The scripts named in the list file are run by the given number of
+ * worker threads.  Warm state must already be enabled in the skvm
+ * module so that decoded assets are shared between the scripts.  When
+ * all scripts have run, a summary is written to standard output.
+ * 
+ * Error messages from the scripts are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pListPath - the path to the list file
+ * 
+ *   jobs - the number of worker threads, in range [1, MAX_JOBS]
+ * 
+ * Return:
+ * 
+ *   non-zero if all scripts succeeded, zero if any script failed or
+ *   the batch could not be run
+ */
+static int run_batch(const char *pListPath, int32_t jobs) {
+  
+  int status = 1;
+  int32_t i = 0;
+  int32_t started = 0;
+  int32_t fail_count = 0;
+  double t = 0.0;
+  double total = 0.0;
+  
+  BATCH b;
+  pthread_t thr[MAX_JOBS];
+  
+  /* Initialize structures */
+  memset(&b, 0, sizeof(BATCH));
+  
+  /* Check parameters */
+  if ((pListPath == NULL) || (jobs < 1) || (jobs > MAX_JOBS)) {
+    abort();
+  }
+  
+  /* Read the list of scripts */
+  status = batch_read(pListPath, &(b.pJob), &(b.count));
+  
+  /* Don't start more workers than there are scripts */
+  if (status) {
+    if (jobs > b.count) {
+      jobs = b.count;
+    }
+  }
+  
+  /* Start the workers and wait for them to run all the scripts */
+  if (status) {
+    if (pthread_mutex_init(&(b.lock), NULL)) {
+      abort();
+    }
+    b.next = 0;
+    
+    t = clock_secs();
+    for(i = 0; i < jobs; i++) {
+      if (pthread_create(&(thr[i]), NULL, &batch_worker, &b)) {
+        fprintf(stderr, "%s: Failed to start worker thread!\n",
+          pModule);
+        break;
+      }
+      started++;
+    }
+    
+    /* If no worker could be started, run the scripts on this thread */
+    if (started < 1) {
+      batch_worker(&b);
+    }
+    
+    for(i = 0; i < started; i++) {
+      if (pthread_join(thr[i], NULL)) {
+        abort();
+      }
+    }
+    t = clock_secs() - t;
+    
+    if (pthread_mutex_destroy(&(b.lock))) {
+      abort();
+    }
+  }
+  
+  /* Write the summary */
+  if (status) {
+    fflush(stderr);
+    for(i = 0; i < b.count; i++) {
+      if (!(b.pJob[i].status)) {
+        fail_count++;
+      }
+      total += b.pJob[i].secs;
+      printf("%-4s %10.3f  %s\n",
+        (b.pJob[i].status ? "OK" : "FAIL"),
+        b.pJob[i].secs,
+        b.pJob[i].pPath);
+    }
+    printf("%ld scripts, %ld failed, %ld threads\n",
+      (long) b.count, (long) fail_count, (long) started);
+    printf("%.3f seconds elapsed, %.3f seconds total\n", t, total);
+    fflush(stdout);
+    
+    if (fail_count > 0) {
+      status = 0;
+    }
+  }
+  
+  /* Release the jobs */
+  batch_free(b.pJob, b.count);
+  b.pJob = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Compare two pack items by file name, for qsort().
+ * 
+ * Parameters:
+ * 
+ *   pA - the first PACK_ITEM
+ * 
+ *   pB - the second PACK_ITEM
+ * 
+ * Return:
+ * 
+ *   less than, equal to, or greater than zero as the first file name
+ *   sorts before, equal to, or after the second
+ */
+static int pack_cmp_name(const void *pA, const void *pB) {
+  
+  /* Check parameters */
+  if ((pA == NULL) || (pB == NULL)) {
+    abort();
+  }
+  
+  /* Compare the file names */
+  return strcmp(((const PACK_ITEM *) pA)->pFile,
+                ((const PACK_ITEM *) pB)->pFile);
+}
+
+/*
+ * Compare two pointers to pack items in the order they are placed, for
+ * qsort().
+ * 
+ * Taller images are placed first, then wider images, and images of the
+ * same size are placed in file name order, so that packing is
+ * reproducible.
+ * 
+ * Parameters:
+ * 
+ *   pA - pointer to the first PACK_ITEM pointer
+ * 
+ *   pB - pointer to the second PACK_ITEM pointer
+ * 
+ * Return:
+ * 
+ *   less than, equal to, or greater than zero as the first item is
+ *   placed before, at the same time as, or after the second
+ */
+static int pack_cmp_size(const void *pA, const void *pB) {
+  
+  const PACK_ITEM *pa = NULL;
+  const PACK_ITEM *pb = NULL;
+  
+  /* Check parameters */
+  if ((pA == NULL) || (pB == NULL)) {
+    abort();
+  }
+  pa = *((const PACK_ITEM * const *) pA);
+  pb = *((const PACK_ITEM * const *) pB);
+  
+  /* Compare heights, then widths, then names */
+  if (pa->h != pb->h) {
+    return (pa->h > pb->h) ? -1 : 1;
+  }
+  if (pa->w != pb->w) {
+    return (pa->w > pb->w) ? -1 : 1;
+  }
+  return strcmp(pa->pFile, pb->pFile);
+}
+
+/*
+ * Read the PNG files of a directory for pack mode.
+ * 
+ * Every file in the directory whose name ends in ".png" becomes an
+ * item, sorted by file name.  Other files are ignored.  The part of the
+ * name before the extension must be a valid atlas sub-image name.  The
+ * dimensions of the items are not filled in.
+ * 
+ * Error messages are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the directory
+ * 
+ *   ppItem - pointer to receive the item array
+ * 
+ *   pCount - pointer to receive the number of items
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the directory could not be read
+ *   or a file name is not usable
+ */
+static int pack_read(
+    const char  *  pDir,
+    PACK_ITEM   ** ppItem,
+    int32_t     *  pCount) {
+  
+  int status = 1;
+  size_t len = 0;
+  const char *pc = NULL;
+  
+  DIR *pd = NULL;
+  struct dirent *pe = NULL;
+  
+  PACK_ITEM *pItem = NULL;
+  int32_t item_cap = 0;
+  int32_t item_count = 0;
+  
+  /* Check parameters */
+  if ((pDir == NULL) || (ppItem == NULL) || (pCount == NULL)) {
+    abort();
+  }
+  
+  /* Open the directory */
+  pd = opendir(pDir);
+  if (pd == NULL) {
+    status = 0;
+    fprintf(stderr, "%s: Failed to open pack directory!\n", pModule);
+  }
+  
+  /* Allocate the initial item buffer */
+  if (status) {
+    item_cap = 64;
+    pItem = (PACK_ITEM *) calloc((size_t) item_cap, sizeof(PACK_ITEM));
+    if (pItem == NULL) {
+      abort();
+    }
+  }
+  
+  /* Add each PNG file */
+  while (status) {
+    errno = 0;
+    pe = readdir(pd);
+    if (pe == NULL) {
+      if (errno != 0) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to read pack directory!\n",
+          pModule);
+      }
+      break;
+    }
+    
+    /* Skip files that are not PNG files */
+    len = strlen(pe->d_name);
+    if (len < 5) {
+      continue;
+    }
+    if (strcmp(pe->d_name + (len - 4), ".png") != 0) {
+      continue;
+    }
+    
+    /* Check the sub-image name */
+    if (len - 4 > SKVM_ATLAS_MAX_NAME) {
+      status = 0;
+      fprintf(stderr, "%s: File name is too long: %s\n",
+        pModule, pe->d_name);
+      break;
+    }
+    for(pc = pe->d_name; *pc != 0; pc++) {
+      if ((*pc <= ' ') || (*pc > '~')) {
+        status = 0;
+        fprintf(stderr, "%s: Unusable file name: %s\n",
+          pModule, pe->d_name);
+        break;
+      }
+    }
+    if (!status) {
+      break;
+    }
+    
+    /* Add the item */
+    if (item_count >= item_cap) {
+      if (item_cap >= SKVM_ATLAS_MAX_COUNT) {
+        status = 0;
+        fprintf(stderr, "%s: Too many PNG files to pack!\n", pModule);
+        break;
+      }
+      item_cap *= 2;
+      pItem = (PACK_ITEM *) realloc(pItem,
+                ((size_t) item_cap) * sizeof(PACK_ITEM));
+      if (pItem == NULL) {
+        abort();
+      }
+    }
+    
+    memset(&(pItem[item_count]), 0, sizeof(PACK_ITEM));
+    pItem[item_count].pFile = (char *) malloc(len + 1);
+    if (pItem[item_count].pFile == NULL) {
+      abort();
+    }
+    strcpy(pItem[item_count].pFile, pe->d_name);
+    pItem[item_count].name_len = len - 4;
+    item_count++;
+  }
+  
+  /* Close the directory if open */
+  if (pd != NULL) {
+    closedir(pd);
+    pd = NULL;
+  }
+  
+  /* There must be at least one file */
+  if (status && (item_count < 1)) {
+    status = 0;
+    fprintf(stderr, "%s: No PNG files to pack!\n", pModule);
+  }
+  
+  /* Sort by file name, so that sub-image indices follow the names */
+  if (status) {
+    qsort(pItem, (size_t) item_count, sizeof(PACK_ITEM),
+          &pack_cmp_name);
+  }
+  
+  /* Return the items if successful, else release them */
+  if (status) {
+    *ppItem = pItem;
+    *pCount = item_count;
+  } else {
+    pack_free(pItem, item_count);
+    pItem = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Release an item array allocated by pack_read().
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pItem - the item array, or NULL
+ * 
+ *   count - the number of items in the array
+ */
+static void pack_free(PACK_ITEM *pItem, int32_t count) {
+  
+  int32_t i = 0;
+  
+  if (pItem != NULL) {
+    for(i = 0; i < count; i++) {
+      free(pItem[i].pFile);
+      pItem[i].pFile = NULL;
+    }
+    free(pItem);
+  }
+}
+
+/*
+ * Place the items of pack mode within a sheet.
+ * 
+ * The dimensions of all items must be filled in.  Items are placed on
+ * shelves, from the tallest to the shortest, filling each shelf from
+ * left to right before starting a new shelf below it.  Items are
+ * separated by PACK_GUTTER pixels.  The shelf width starts out at the
+ * width of a square with the total area of the items and is doubled
+ * until the sheet height fits within SKVM_MAX_DIM.
+ * 
+ * Parameters:
+ * 
+ *   pItem - the items
+ * 
+ *   count - the number of items
+ * 
+ *   pw - receives the width of the sheet
+ * 
+ *   ph - receives the height of the sheet
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the items do not fit in a sheet
+ */
+static int pack_place(
+    PACK_ITEM * pItem,
+    int32_t     count,
+    int32_t   * pw,
+    int32_t   * ph) {
+  
+  int status = 0;
+  int32_t i = 0;
+  int32_t max_w = 0;
+  int32_t limit = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t shelf_h = 0;
+  int32_t sheet_w = 0;
+  double area = 0.0;
+  PACK_ITEM **ppOrder = NULL;
+  PACK_ITEM *pi = NULL;
+  
+  /* Check parameters */
+  if ((pItem == NULL) || (count < 1) || (pw == NULL) || (ph == NULL)) {
+    abort();
+  }
+  
+  /* Sort pointers to the items into placement order */
+  ppOrder = (PACK_ITEM **) calloc((size_t) count, sizeof(PACK_ITEM *));
+  if (ppOrder == NULL) {
+    abort();
+  }
+  for(i = 0; i < count; i++) {
+    ppOrder[i] = &(pItem[i]);
+    area += ((double) (pItem[i].w + PACK_GUTTER)) *
+              ((double) (pItem[i].h + PACK_GUTTER));
+    if (pItem[i].w > max_w) {
+      max_w = pItem[i].w;
+    }
+  }
+  qsort(ppOrder, (size_t) count, sizeof(PACK_ITEM *), &pack_cmp_size);
+  
+  /* Get the initial shelf width */
+  limit = (int32_t) ceil(sqrt(area));
+  if (limit < max_w) {
+    limit = max_w;
+  }
+  if (limit > SKVM_MAX_DIM) {
+    limit = SKVM_MAX_DIM;
+  }
+  
+  /* Place the items on shelves, widening the shelves until the sheet
+   * is short enough */
+  while (!status) {
+    x = 0;
+    y = 0;
+    shelf_h = 0;
+    sheet_w = 0;
+    status = 1;
+    
+    for(i = 0; i < count; i++) {
+      pi = ppOrder[i];
+      if (x > limit - pi->w) {
+        y += shelf_h + PACK_GUTTER;
+        x = 0;
+        shelf_h = 0;
+      }
+      if (y > SKVM_MAX_DIM - pi->h) {
+        status = 0;
+        break;
+      }
+      pi->x = x;
+      pi->y = y;
+      x += pi->w;
+      if (pi->h > shelf_h) {
+        shelf_h = pi->h;
+      }
+      if (x > sheet_w) {
+        sheet_w = x;
+      }
+      x += PACK_GUTTER;
+    }
+    
+    if (!status) {
+      if (limit >= SKVM_MAX_DIM) {
+        break;
+      }
+      limit *= 2;
+      if (limit > SKVM_MAX_DIM) {
+        limit = SKVM_MAX_DIM;
+      }
+    }
+  }
+  
+  /* Release the placement order */
+  free(ppOrder);
+  ppOrder = NULL;
+  
+  /* Return the sheet dimensions if successful */
+  if (status) {
+    *pw = sheet_w;
+    *ph = y + shelf_h;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Run pack mode.
+ * 
+ * All the PNG files in the directory are packed into a single atlas
+ * sheet, which is written to [out].png, along with an atlas table
+ * [out].atlas that can be loaded with the load_atlas operator.
+ * 
+ * Error messages are written to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the directory of PNG files
+ * 
+ *   pOut - the path of the output files without extension
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int run_pack(const char *pDir, const char *pOut) {
+  
+  int status = 1;
+  int32_t i = 0;
+  int32_t count = 0;
+  int32_t w = 0;
+  int32_t h = 0;
+  size_t dir_len = 0;
+  size_t out_len = 0;
+  const char *pSheet = NULL;
+  char *pPath = NULL;
+  
+  PACK_ITEM *pItem = NULL;
+  SKVM_CTX *pv = NULL;
+  FILE *pf = NULL;
+  SKVM_SAMPLE_PARAM sp;
+  
+  /* Initialize structures */
+  memset(&sp, 0, sizeof(SKVM_SAMPLE_PARAM));
+  
+  /* Check parameters */
+  if ((pDir == NULL) || (pOut == NULL)) {
+    abort();
+  }
+  
+  /* The sheet is named in the table without its directory, so the
+   * name must be short enough for the table */
+  pSheet = strrchr(pOut, '/');
+  if (pSheet != NULL) {
+    pSheet++;
+  } else {
+    pSheet = pOut;
+  }
+  if ((strlen(pSheet) < 1) ||
+      (strlen(pSheet) + 4 > SKVM_ATLAS_MAX_NAME)) {
+    status = 0;
+    fprintf(stderr, "%s: Invalid atlas output name!\n", pModule);
+  }
+  
+  /* Allocate a path buffer large enough for any file path */
+  if (status) {
+    dir_len = strlen(pDir);
+    out_len = strlen(pOut);
+    pPath = (char *) malloc(
+              ((dir_len > out_len) ? dir_len : out_len) +
+              SKVM_ATLAS_MAX_NAME + 8);
+    if (pPath == NULL) {
+      abort();
+    }
+  }
+  
+  /* Read the directory and get the dimensions of each image */
+  if (status) {
+    status = pack_read(pDir, &pItem, &count);
+  }
+  if (status) {
+    pv = skvm_alloc(PACK_BUFC, PACK_MATC);
+    for(i = 0; i < count; i++) {
+      sprintf(pPath, "%s/%s", pDir, pItem[i].pFile);
+      if (!skvm_probe_png(pv, pPath,
+                &(pItem[i].w), &(pItem[i].h))) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to read %s: %s\n",
+          pModule, pItem[i].pFile, skvm_reason(pv));
+        break;
+      }
+    }
+  }
+  
+  /* Place the images */
+  if (status) {
+    if (!pack_place(pItem, count, &w, &h)) {
+      status = 0;
+      fprintf(stderr, "%s: Images do not fit in one atlas sheet!\n",
+        pModule);
+    }
+  }
+  
+  /* Copy each image into a transparent sheet, using exact sampling
+   * with a whole-pixel translation */
+  if (status) {
+    skvm_reset(pv, 0, w, h, 4);
+    skvm_load_fill(pv, 0, 0, 0, 0, 0);
+    
+    sp.src_buf = 1;
+    sp.target_buf = 0;
+    sp.t_matrix = 0;
+    sp.sample_alg = SKVM_ALG_NEAREST;
+    sp.blend = SKVM_BLEND_SRC;
+    sp.flags = SKVM_FLAG_PROCMASK | SKVM_FLAG_LEFTMODE |
+                SKVM_FLAG_ABOVEMODE;
+    sp.mask_shape = SKVM_SHAPE_NONE;
+    
+    for(i = 0; i < count; i++) {
+      sprintf(pPath, "%s/%s", pDir, pItem[i].pFile);
+      skvm_reset(pv, 1, pItem[i].w, pItem[i].h, 4);
+      if (!skvm_load_png(pv, 1, pPath)) {
+        status = 0;
+        fprintf(stderr, "%s: Failed to load %s: %s\n",
+          pModule, pItem[i].pFile, skvm_reason(pv));
+        break;
+      }
+      
+      skvm_matrix_reset(pv, 0);
+      skvm_matrix_translate(pv, 0,
+        (double) pItem[i].x, (double) pItem[i].y);
+      skvm_sample(pv, &sp);
+    }
+  }
+  
+  /* Store the sheet */
+  if (status) {
+    sprintf(pPath, "%s.png", pOut);
+    if (!skvm_store_png(pv, 0, pPath)) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to store atlas sheet: %s\n",
+        pModule, skvm_reason(pv));
+    }
+  }
+  if (status) {
+    if (!skvm_sync(pv)) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to store atlas sheet: %s\n",
+        pModule, skvm_reason(pv));
+    }
+  }
+  
+  /* Write the table, with sub-images in file name order */
+  if (status) {
+    sprintf(pPath, "%s.atlas", pOut);
+    pf = fopen(pPath, "w");
+    if (pf == NULL) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to create atlas table!\n", pModule);
+    }
+  }
+  if (status) {
+    fprintf(pf, "# Sparkle atlas table\n");
+    fprintf(pf, "%s.png %ld %ld\n", pSheet, (long) w, (long) h);
+    for(i = 0; i < count; i++) {
+      fprintf(pf, "%.*s %ld %ld %ld %ld\n",
+        (int) pItem[i].name_len, pItem[i].pFile,
+        (long) pItem[i].x, (long) pItem[i].y,
+        (long) pItem[i].w, (long) pItem[i].h);
+    }
+    if (fclose(pf)) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to write atlas table!\n", pModule);
+    }
+    pf = NULL;
+  }
+  
+  /* Report the result */
+  if (status) {
+    printf("%ld images packed into %ldx%ld sheet\n",
+      (long) count, (long) w, (long) h);
+    fflush(stdout);
+  }
+  
+  /* Release everything */
+  skvm_free(pv);
+  pv = NULL;
+  
+  pack_free(pItem, count);
+  pItem = NULL;
+  
+  free(pPath);
+  pPath = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Program entrypoint
+ * ==================
+ */
+
+int main(int argc, char *argv[]) {
+  
+  int status = 1;
+  int mode = MODE_SINGLE;
+  int32_t jobs = 0;
+  long ncpu = 0;
+  
+  SNSOURCE *pin = NULL;
+  
+  /* Set module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "sparkle";
+  }
+  
+  /* Determine the mode from the arguments */
+  if (argc <= 1) {
+    mode = MODE_SINGLE;
+    
+  } else if ((argc == 2) && (strcmp(argv[1], "-daemon") == 0)) {
+    mode = MODE_DAEMON;
+    
+  } else if ((argc == 3) && (strcmp(argv[1], "-socket") == 0)) {
+    mode = MODE_SOCKET;
+    
+  } else if (((argc == 3) || (argc == 5)) &&
+              ((strcmp(argv[1], "--batch") == 0) ||
+                (strcmp(argv[1], "-batch") == 0))) {
+    mode = MODE_BATCH;
+    
+    /* Get the number of worker threads, defaulting to the number of
+     * online processors */
+    if (argc == 5) {
+      if (strcmp(argv[3], "-j") != 0) {
+        status = 0;
+        fprintf(stderr, "%s: Unrecognized arguments!\n", pModule);
+      }
+      if (status) {
+        if (!parseInt(argv[4], &jobs)) {
+          status = 0;
+          fprintf(stderr, "%s: Invalid job count!\n", pModule);
+        }
+      }
+      if (status) {
+        if ((jobs < 1) || (jobs > MAX_JOBS)) {
+          status = 0;
+          fprintf(stderr, "%s: Job count out of range!\n", pModule);
+        }
+      }
+      
+    } else {
+      ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+      if (ncpu < 1) {
+        jobs = 1;
+      } else if (ncpu > MAX_JOBS) {
+        jobs = MAX_JOBS;
+      } else {
+        jobs = (int32_t) ncpu;
+      }
+    }
+    
+  } else if ((argc == 4) && (strcmp(argv[1], "--pack") == 0)) {
+    mode = MODE_PACK;
+    
+  } else {
+    status = 0;
+    fprintf(stderr, "%s: Unrecognized arguments!\n", pModule);
+  }
+  
+  /* Register operator modules */
+  if (status) {
+    register_modules();
+  }
+  
+  /* Run in the selected mode */
+  if (status) {
+    if (mode == MODE_SINGLE) {
+      /* Wrap standard input in a Shastina source and run it */
+      pin = snsource_stream(stdin, SNSTREAM_NORMAL);
+      status = run_script(pin);
+      snsource_free(pin);
+      pin = NULL;
+      
+    } else if (mode == MODE_DAEMON) {
+      /* Keep warm state between scripts read from standard input */
+      skvm_keep_warm(1);
+      if (run_stream(stdin, stdout) > 0) {
+        status = 0;
+      }
+      skvm_keep_warm(0);
+      
+    } else if (mode == MODE_SOCKET) {
+      /* Keep warm state between scripts read from socket clients */
+      skvm_keep_warm(1);
+      status = run_socket(argv[2]);
+      skvm_keep_warm(0);
+      
+    } else if (mode == MODE_BATCH) {
+      /* Keep warm state so the scripts of the batch share assets */
+      skvm_keep_warm(1);
+      status = run_batch(argv[2], jobs);
+      skvm_keep_warm(0);
+      
+    } else if (mode == MODE_PACK) {
+      /* Pack a directory of images into an atlas */
+      status = run_pack(argv[2], argv[3]);
+      
+    } else {
+      /* Shouldn't happen */
+      abort();
+    }
+  }
   
   /* Invert status and return */
   if (status) {
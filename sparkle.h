@@ -14,6 +14,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "skvm.h"
+
 /*
  * Constants
  * =========
@@ -25,6 +27,16 @@
  */
 #define MAX_OP_NAME (255)
 
+/*
+ * The maximum value of the %trackcount header, which is the number of
+ * transform tracks a script may use.  Tracks are allocated when a
+ * script first uses them, and each one holds up to 64 keys in about
+ * 3.5 kilobytes, so this bounds the track memory of an interpreter to
+ * a few megabytes, in line with how %bufcount and %matcount bound the
+ * register tables of the virtual machine.
+ */
+#define MAX_TRACKC (1024)
+
 /*
  * Type constants for use with CELL structure.
  */
@@ -38,12 +50,23 @@
  * =================
  */
 
+/*
+ * Prototype for the INTERP structure.
+ * 
+ * Each script is run by its own interpreter, which holds the
+ * interpreter stack, the module state blocks, and the virtual machine
+ * context.  The actual structure is defined in the implementation file.
+ */
+struct INTERP_TAG;
+typedef struct INTERP_TAG INTERP;
+
 /*
  * Function pointer type for operator implementation functions.
  * 
- * pModule is the name of the executable module, for use in any
- * diagnostic messages.  line_num is the current line number in the
- * script file, for use in diagnostic messages.
+ * pi is the interpreter the operator is being invoked on.  pModule is
+ * the name of the executable module, for use in any diagnostic
+ * messages.  line_num is the current line number in the script file,
+ * for use in diagnostic messages.
  * 
  * If there is a failure in the operator, the operator should print some
  * reasonable error message to standard error.
@@ -54,6 +77,8 @@
  * 
  * Parameters:
  * 
+ *   pi - the interpreter
+ * 
  *   pModule - the name of this executable
  * 
  *   line_num - the current line number
@@ -62,7 +87,32 @@
  * 
  *   non-zero if successful, zero if failure
  */
-typedef int (*fp_op)(const char *pModule, long line_num);
+typedef int (*fp_op)(INTERP *pi, const char *pModule, long line_num);
+
+/*
+ * Function pointer type for module state reset functions.
+ * 
+ * The function is passed a newly allocated state block, with all bytes
+ * set to zero, and should initialize it to the default state.
+ * 
+ * Parameters:
+ * 
+ *   pState - the state block to initialize
+ */
+typedef void (*fp_reset)(void *pState);
+
+/*
+ * Function pointer type for module state release functions.
+ * 
+ * The function is passed a state block just before it is freed, and
+ * should release any memory that the state block refers to.  It must
+ * not free the state block itself.
+ * 
+ * Parameters:
+ * 
+ *   pState - the state block to release
+ */
+typedef void (*fp_release)(void *pState);
 
 /*
  * Prototype for the CELL structure.
@@ -108,6 +158,93 @@ typedef struct CELL_TAG CELL;
  */
 void register_operator(const char *pOpName, fp_op pFunc);
 
+/*
+ * Register a module state block.
+ * 
+ * Operator modules that need state that persists between operator
+ * invocations must not keep it in static variables, because several
+ * interpreters may be running at the same time.  Instead, they call
+ * this function from their registration function to declare a state
+ * block.
+ * 
+ * Every interpreter allocates its own state block of state_size bytes
+ * for each registered slot and initializes it with pReset before
+ * running its script.  Operators then use interp_state() with the
+ * returned slot index to get at the state block of the interpreter they
+ * were invoked on.  If pRelease is not NULL, it is called on the state
+ * block when the interpreter is released, so that state blocks may
+ * refer to memory that the module allocates.
+ * 
+ * If there are too many state registrations, an error message will be
+ * printed and then a fault will occur.
+ * 
+ * Parameters:
+ * 
+ *   state_size - the size in bytes of the state block
+ * 
+ *   pReset - the function that initializes a new state block
+ * 
+ *   pRelease - the function that releases a state block, or NULL
+ * 
+ * Return:
+ * 
+ *   the slot index of the state block
+ */
+int32_t register_state(
+    size_t      state_size,
+    fp_reset    pReset,
+    fp_release  pRelease);
+
+/*
+ * Get a module state block of an interpreter.
+ * 
+ * slot must be a slot index returned by register_state().
+ * 
+ * Parameters:
+ * 
+ *   pi - the interpreter
+ * 
+ *   slot - the state slot index
+ * 
+ * Return:
+ * 
+ *   the state block
+ */
+void *interp_state(INTERP *pi, int32_t slot);
+
+/*
+ * Get the virtual machine context of an interpreter.
+ * 
+ * The context is always available when operators are invoked, because
+ * it is allocated after the script header has been read.
+ * 
+ * Parameters:
+ * 
+ *   pi - the interpreter
+ * 
+ * Return:
+ * 
+ *   the virtual machine context
+ */
+SKVM_CTX *interp_vm(INTERP *pi);
+
+/*
+ * Get the number of transform tracks of an interpreter.
+ * 
+ * This is the value of the %trackcount header of the script, which is
+ * in range [0, MAX_TRACKC].  Like the virtual machine context, it is
+ * available whenever operators are invoked.
+ * 
+ * Parameters:
+ * 
+ *   pi - the interpreter
+ * 
+ * Return:
+ * 
+ *   the number of transform tracks
+ */
+int32_t interp_trackc(INTERP *pi);
+
 /*
  * Return the type of value stored in the given cell.
  * 
@@ -194,13 +331,15 @@ const char *cell_string_ptr(const CELL *pc);
  * 
  * Parameters:
  * 
+ *   pi - the interpreter
+ * 
  *   v - the integer value to push
  * 
  * Return:
  * 
  *   non-zero if successful, zero if stack is full
  */
-int stack_push_int(int32_t v);
+int stack_push_int(INTERP *pi, int32_t v);
 
 /*
  * Push a float value on top of the interpreter stack.
@@ -210,13 +349,15 @@ int stack_push_int(int32_t v);
  * 
  * Parameters:
  * 
+ *   pi - the interpreter
+ * 
  *   v - the float value to push
  * 
  * Return:
  * 
  *   non-zero if successful, zero if stack is full
  */
-int stack_push_float(double v);
+int stack_push_float(INTERP *pi, double v);
 
 /*
  * Push a string value on top of the interpreter stack.
@@ -227,22 +368,28 @@ int stack_push_float(double v);
  * 
  * Parameters:
  * 
+ *   pi - the interpreter
+ * 
  *   pstr - the string to copy and push
  * 
  * Return:
  * 
  *   non-zero if successful, zero if stack is full
  */
-int stack_push_string(const char *pstr);
+int stack_push_string(INTERP *pi, const char *pstr);
 
 /*
  * Return how many values are currently on the interpreter stack.
  * 
+ * Parameters:
+ * 
+ *   pi - the interpreter
+ * 
  * Return:
  * 
  *   the current height of the interpreter stack
  */
-int32_t stack_count(void);
+int32_t stack_count(INTERP *pi);
 
 /*
  * Return a specific element on the stack.
@@ -250,17 +397,19 @@ int32_t stack_count(void);
  * i is the index of the element from the top of the stack.  A value of
  * zero means the element on top of the stack.  A value of one means the
  * value below it, and so forth.  i must be greater than or equal to
- * zero and less than the stack_count() or a fault occurs.
+ * zero and less than stack_count() or a fault occurs.
  * 
  * Parameters:
  * 
+ *   pi - the interpreter
+ * 
  *   i - the index of the element
  * 
  * Return:
  * 
  *   the requested stack element
  */
-const CELL *stack_index(int32_t i);
+const CELL *stack_index(INTERP *pi, int32_t i);
 
 /*
  * Remove elements from the top of the stack.
@@ -271,8 +420,10 @@ const CELL *stack_index(int32_t i);
  * 
  * Parameters:
  * 
+ *   pi - the interpreter
+ * 
  *   count - the number of elements to remove from the stack
  */
-void stack_pop(int32_t count);
+void stack_pop(INTERP *pi, int32_t count);
 
 #endif
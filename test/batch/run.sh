@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# run.sh
+# ======
+#
+# Batch mode tests of sparkle.
+#
+# Syntax:
+#
+#   run.sh [sparkle]
+#
+# [sparkle] is the path to the sparkle program, which defaults to the
+# sparkle program at the top of the repository.  The scripts are run in
+# this directory, and the files they write are removed afterwards.  The
+# exit status is zero only if every batch succeeded.
+#
+
+SPARKLE=${1:-"$(dirname "$0")/../../sparkle"}
+case "$SPARKLE" in
+  /*) ;;
+  *) SPARKLE="$(pwd)/$SPARKLE" ;;
+esac
+
+cd "$(dirname "$0")" || exit 1
+
+# A file written by one script must be seen by a later script, even
+# though the warm asset cache holds the old image of the file
+rm -f stale.png stale.json
+"$SPARKLE" --batch stale.list -j 1
+STATUS=$?
+rm -f stale.png stale.json
+
+exit $STATUS